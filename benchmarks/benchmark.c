@@ -4,11 +4,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_decode_msgpack.h>
+#include <cmetrics/cmt_decode_opentelemetry.h>
+#include <cmetrics/cmt_decode_prometheus.h>
+#include <cmetrics/cmt_decode_prometheus_remote_write.h>
+#include <cmetrics/cmt_decode_statsd.h>
+#include <cmetrics/cmt_decode_influx.h>
+#include <cmetrics/cmt_encode_graphite.h>
+#include <cmetrics/cmt_decode_graphite.h>
+#include <cmetrics/cmt_encode_msgpack.h>
+#include <cmetrics/cmt_msgpack_view.h>
 #include <cmetrics/cmt_encode_opentelemetry.h>
 #include <cmetrics/cmt_encode_prometheus.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write_v2.h>
+#include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_histogram.h>
 
@@ -100,6 +115,99 @@ static int create_mixed_series(struct cmt *cmt, size_t cardinality)
     return 0;
 }
 
+/*
+ * The remote write encoder drops samples older than an hour, so these series
+ * are stamped with the current time.
+ */
+static int create_remote_write_series(struct cmt *cmt, size_t cardinality)
+{
+    size_t index;
+    uint64_t timestamp;
+    char label[32];
+    char *values[] = {label};
+    struct cmt_counter *counter;
+    struct cmt_gauge *gauge;
+    struct cmt_histogram *histogram;
+    struct cmt_histogram_buckets *buckets;
+
+    counter = cmt_counter_create(cmt, "bench", "", "requests_total",
+                                 "benchmark counter", 1,
+                                 (char *[]) {"series"});
+    gauge = cmt_gauge_create(cmt, "bench", "", "queue_depth",
+                             "benchmark gauge", 1,
+                             (char *[]) {"series"});
+    buckets = cmt_histogram_buckets_create(4, 0.01, 0.1, 1.0, 10.0);
+    histogram = cmt_histogram_create(cmt, "bench", "", "latency_seconds",
+                                     "benchmark histogram", buckets, 1,
+                                     (char *[]) {"series"});
+    if (counter == NULL || gauge == NULL || buckets == NULL ||
+        histogram == NULL) {
+        return -1;
+    }
+
+    timestamp = cfl_time_now();
+
+    for (index = 0; index < cardinality; index++) {
+        snprintf(label, sizeof(label), "series-%zu", index);
+        if (cmt_counter_set(counter, timestamp, 1.0, 1, values) != 0 ||
+            cmt_gauge_set(gauge, timestamp, (double) index, 1, values) != 0 ||
+            cmt_histogram_observe(histogram, timestamp,
+                                  (double) (index % 100) / 10.0,
+                                  1, values) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int create_exp_histogram_series(struct cmt *cmt, size_t cardinality,
+                                       uint64_t timestamp)
+{
+    size_t index;
+    char label[32];
+    char *values[] = {label};
+    uint64_t positive[8];
+    uint64_t negative[2];
+    struct cmt_exp_histogram *exp_histogram;
+
+    exp_histogram = cmt_exp_histogram_create(cmt, "bench", "", "duration_seconds",
+                                             "benchmark exponential histogram",
+                                             1, (char *[]) {"series"});
+    if (exp_histogram == NULL) {
+        return -1;
+    }
+
+    for (index = 0; index < cardinality; index++) {
+        snprintf(label, sizeof(label), "series-%zu", index);
+
+        positive[0] = index % 7;
+        positive[1] = 3;
+        positive[2] = 0;
+        positive[3] = index % 5;
+        positive[4] = 11;
+        positive[5] = 0;
+        positive[6] = 0;
+        positive[7] = 2;
+        negative[0] = 1;
+        negative[1] = index % 3;
+
+        if (cmt_exp_histogram_set_default(exp_histogram,
+                                          timestamp + index + 1, 3,
+                                          index % 2, 0.0,
+                                          -4, 8, positive,
+                                          -2, 2, negative,
+                                          CMT_TRUE, (double) index,
+                                          20 + (index % 7) + (index % 5) +
+                                          (index % 3) + (index % 2),
+                                          1, values) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 static int benchmark_lookup(size_t cardinality, size_t operations)
 {
     size_t index;
@@ -223,6 +331,291 @@ static int benchmark_prometheus(size_t cardinality, size_t operations)
     return 0;
 }
 
+static int benchmark_prometheus_protobuf(size_t cardinality, size_t operations)
+{
+    size_t index;
+    size_t bytes = 0;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t output;
+    struct cmt *cmt;
+
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (create_series(cmt, cardinality) == NULL) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        output = cmt_encode_prometheus_protobuf_create(cmt, CMT_FALSE);
+        if (output == NULL) {
+            cmt_destroy(cmt);
+            return -1;
+        }
+        bytes += cfl_sds_len(output);
+        cmt_encode_prometheus_protobuf_destroy(output);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=prometheus-protobuf cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_destroy(cmt);
+    return 0;
+}
+
+/*
+ * Exponential histograms are exposed as explicit buckets by the text encoder
+ * and as native histograms by the protobuf encoder.
+ */
+static int benchmark_prometheus_exp_histogram(size_t cardinality,
+                                              size_t operations,
+                                              int protobuf)
+{
+    size_t index;
+    size_t bytes = 0;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t output;
+    struct cmt *cmt;
+
+    cmt = cmt_create();
+    if (cmt == NULL || create_exp_histogram_series(cmt, cardinality, 0) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (protobuf) {
+            output = cmt_encode_prometheus_protobuf_create(cmt, CMT_FALSE);
+        }
+        else {
+            output = cmt_encode_prometheus_create(cmt, CMT_FALSE);
+        }
+        if (output == NULL) {
+            cmt_destroy(cmt);
+            return -1;
+        }
+        bytes += cfl_sds_len(output);
+        cfl_sds_destroy(output);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           protobuf ? "prometheus-protobuf-exp-histogram" :
+                      "prometheus-exp-histogram",
+           cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_destroy(cmt);
+    return 0;
+}
+
+struct remote_write_encoder {
+    const char *name;
+    cfl_sds_t (*create)(struct cmt *cmt);
+    void (*destroy)(cfl_sds_t payload);
+};
+
+static const struct remote_write_encoder remote_write_encoders[] = {
+    {"prometheus-remote-write",
+     cmt_encode_prometheus_remote_write_create,
+     cmt_encode_prometheus_remote_write_destroy},
+    {"prometheus-remote-write-compressed",
+     cmt_encode_prometheus_remote_write_create_compressed,
+     cmt_encode_prometheus_remote_write_destroy},
+    {"prometheus-remote-write-v2",
+     cmt_encode_prometheus_remote_write_v2_create,
+     cmt_encode_prometheus_remote_write_v2_destroy},
+    {"prometheus-remote-write-v2-compressed",
+     cmt_encode_prometheus_remote_write_v2_create_compressed,
+     cmt_encode_prometheus_remote_write_v2_destroy},
+    {NULL, NULL, NULL}
+};
+
+static int benchmark_prometheus_remote_write(const struct remote_write_encoder *encoder,
+                                             size_t cardinality,
+                                             size_t operations)
+{
+    size_t index;
+    size_t bytes = 0;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t output;
+    struct cmt *cmt;
+
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (create_remote_write_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        output = encoder->create(cmt);
+        if (output == NULL) {
+            cmt_destroy(cmt);
+            return -1;
+        }
+        bytes += cfl_sds_len(output);
+        encoder->destroy(output);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           encoder->name, cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_destroy(cmt);
+    return 0;
+}
+
+/* Decode a request carrying the remote write series with their metadata */
+static int benchmark_prometheus_remote_write_decode(size_t cardinality,
+                                                    size_t operations)
+{
+    int result;
+    size_t index;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cmt *decoded;
+
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (create_remote_write_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = cmt_encode_prometheus_remote_write_create(cmt);
+    cmt_destroy(cmt);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        result = cmt_decode_prometheus_remote_write_create(&decoded, payload,
+                                                           cfl_sds_len(payload));
+        if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            cmt_encode_prometheus_remote_write_destroy(payload);
+            return -1;
+        }
+        cmt_decode_prometheus_remote_write_destroy(decoded);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=prometheus-remote-write-decode cardinality=%zu "
+           "operations=%zu bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           cardinality, operations,
+           cfl_sds_len(payload) * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) cfl_sds_len(payload) * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_encode_prometheus_remote_write_destroy(payload);
+    return 0;
+}
+
+/*
+ * Round trip exponential histograms through remote write 1.0 requests, where
+ * each data point is sent as a single native histogram series.
+ */
+static int benchmark_prometheus_remote_write_exp_histogram(size_t cardinality,
+                                                           size_t operations,
+                                                           int decode)
+{
+    int result;
+    size_t index;
+    size_t bytes = 0;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cmt *decoded;
+
+    cmt = cmt_create();
+    if (cmt == NULL ||
+        create_exp_histogram_series(cmt, cardinality, cfl_time_now()) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = NULL;
+    if (decode) {
+        payload = cmt_encode_prometheus_remote_write_create(cmt);
+        if (payload == NULL) {
+            cmt_destroy(cmt);
+            return -1;
+        }
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (decode) {
+            result = cmt_decode_prometheus_remote_write_create(&decoded, payload,
+                                                               cfl_sds_len(payload));
+            if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+                cmt_encode_prometheus_remote_write_destroy(payload);
+                cmt_destroy(cmt);
+                return -1;
+            }
+            bytes += cfl_sds_len(payload);
+            cmt_decode_prometheus_remote_write_destroy(decoded);
+        }
+        else {
+            payload = cmt_encode_prometheus_remote_write_create(cmt);
+            if (payload == NULL) {
+                cmt_destroy(cmt);
+                return -1;
+            }
+            bytes += cfl_sds_len(payload);
+            cmt_encode_prometheus_remote_write_destroy(payload);
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           decode ? "prometheus-remote-write-exp-histogram-decode" :
+                    "prometheus-remote-write-exp-histogram",
+           cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    if (decode) {
+        cmt_encode_prometheus_remote_write_destroy(payload);
+    }
+    cmt_destroy(cmt);
+    return 0;
+}
+
 static int benchmark_opentelemetry(size_t cardinality, size_t operations)
 {
     size_t index;
@@ -303,22 +696,734 @@ static int benchmark_opentelemetry_mixed(size_t cardinality, size_t operations)
     return 0;
 }
 
-int main(int argc, char **argv)
+static int benchmark_opentelemetry_decode(size_t cardinality, size_t operations,
+                                          int streaming)
 {
-    size_t cardinality;
-    size_t operations;
+    int result;
+    size_t index;
+    size_t offset;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cfl_list contexts;
 
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s lookup|update|prometheus|opentelemetry|"
-                        "opentelemetry-mixed "
-                        "CARDINALITY OPERATIONS\n",
-                argv[0]);
-        return EXIT_FAILURE;
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
     }
 
-    cardinality = parse_size(argv[2], "cardinality");
-    operations = parse_size(argv[3], "operations");
-    cmt_initialize();
+    if (create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    cmt_destroy(cmt);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        offset = 0;
+        if (streaming) {
+            result = cmt_decode_opentelemetry_stream_create(&contexts, payload,
+                                                            cfl_sds_len(payload),
+                                                            &offset, NULL, NULL);
+        }
+        else {
+            result = cmt_decode_opentelemetry_create(&contexts, payload,
+                                                     cfl_sds_len(payload),
+                                                     &offset);
+        }
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            cmt_encode_opentelemetry_destroy(payload);
+            return -1;
+        }
+        cmt_decode_opentelemetry_destroy(&contexts);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=opentelemetry-decode%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           streaming ? "-stream" : "", cardinality, operations,
+           cfl_sds_len(payload) * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) cfl_sds_len(payload) * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_encode_opentelemetry_destroy(payload);
+    return 0;
+}
+
+/*
+ * Encode the opentelemetry-mixed series as OTLP/JSON or decode the document
+ * produced by that encoder, to compare against the protobuf workloads.
+ */
+static int benchmark_opentelemetry_json(size_t cardinality, size_t operations,
+                                        int decode)
+{
+    int result;
+    size_t index;
+    size_t bytes;
+    size_t offset;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    cfl_sds_t output;
+    struct cmt *cmt;
+    struct cfl_list contexts;
+
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = cmt_encode_opentelemetry_json_create(cmt);
+    if (payload == NULL) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    bytes = 0;
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (decode) {
+            offset = 0;
+            result = cmt_decode_opentelemetry_json_create(&contexts, payload,
+                                                          cfl_sds_len(payload),
+                                                          &offset);
+            if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                cmt_encode_opentelemetry_json_destroy(payload);
+                cmt_destroy(cmt);
+                return -1;
+            }
+            bytes += offset;
+            cmt_decode_opentelemetry_destroy(&contexts);
+        }
+        else {
+            output = cmt_encode_opentelemetry_json_create(cmt);
+            if (output == NULL) {
+                cmt_encode_opentelemetry_json_destroy(payload);
+                cmt_destroy(cmt);
+                return -1;
+            }
+            bytes += cfl_sds_len(output);
+            cmt_encode_opentelemetry_json_destroy(output);
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=opentelemetry-json%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           decode ? "-decode" : "", cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_encode_opentelemetry_json_destroy(payload);
+    cmt_destroy(cmt);
+    return 0;
+}
+
+/*
+ * DogStatsD traffic for 'cardinality' routes: every route gets sampled
+ * request counters, a timer, a relative gauge and a set member, and every
+ * line is repeated so the decoder folds several samples into each series.
+ */
+#define STATSD_REPEATS 4
+
+static cfl_sds_t create_statsd_payload(size_t cardinality)
+{
+    size_t index;
+    size_t round;
+    cfl_sds_t payload;
+
+    payload = cfl_sds_create_size(cardinality * STATSD_REPEATS * 320);
+    if (payload == NULL) {
+        return NULL;
+    }
+
+    for (round = 0; round < STATSD_REPEATS; round++) {
+        for (index = 0; index < cardinality; index++) {
+            if (cfl_sds_printf(&payload,
+                    "api.request.count:1|c|@0.5|#env:prod,service:checkout,"
+                    "route:/v1/items/%zu,method:GET,status:200\n"
+                    "api.request.duration:%zu.%zu|ms|#env:prod,"
+                    "service:checkout,route:/v1/items/%zu\n"
+                    "api.inflight:+1|g|#env:prod,service:checkout,"
+                    "host:web-%zu\n"
+                    "api.users:%zu|s|#env:prod,service:checkout|c:abc123\n",
+                    index, 10 + round, index % 10, index, index % 64,
+                    index) == NULL) {
+                cfl_sds_destroy(payload);
+                return NULL;
+            }
+        }
+    }
+
+    return payload;
+}
+
+static int benchmark_statsd_decode(size_t cardinality, size_t operations)
+{
+    int result;
+    size_t index;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *decoded;
+
+    payload = create_statsd_payload(cardinality);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        result = cmt_decode_statsd_create(&decoded, payload,
+                                          cfl_sds_len(payload),
+                                          CMT_DECODE_STATSD_GAUGE_OBSERVER);
+        if (result != CMT_DECODE_STATSD_SUCCESS) {
+            cfl_sds_destroy(payload);
+            return -1;
+        }
+        cmt_decode_statsd_destroy(decoded);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=statsd-decode cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           cardinality, operations,
+           cfl_sds_len(payload) * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) cfl_sds_len(payload) * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cfl_sds_destroy(payload);
+    return 0;
+}
+
+/*
+ * Telegraf style line protocol for 'cardinality' hosts: every host reports a
+ * cpu line with three float fields and a mem line with integer fields, twice
+ * so the second round updates the series created by the first one.
+ */
+#define INFLUX_ROUNDS 2
+
+static cfl_sds_t create_influx_payload(size_t cardinality)
+{
+    size_t index;
+    size_t round;
+    cfl_sds_t payload;
+
+    payload = cfl_sds_create_size(cardinality * INFLUX_ROUNDS * 256);
+    if (payload == NULL) {
+        return NULL;
+    }
+
+    for (round = 0; round < INFLUX_ROUNDS; round++) {
+        for (index = 0; index < cardinality; index++) {
+            if (cfl_sds_printf(&payload,
+                    "cpu,cpu=cpu-total,host=web-%zu,region=eu-west-1 "
+                    "usage_idle=%zu.25,usage_system=%zu.5,usage_user=1.75 "
+                    "17000000%02zu000000000\n"
+                    "mem,host=web-%zu,region=eu-west-1 "
+                    "used=%zui,free=%zui,available_percent=62.5 "
+                    "17000000%02zu000000000\n",
+                    index, 90 + round, index % 10, round,
+                    index, index * 4096, 1048576 - index, round) == NULL) {
+                cfl_sds_destroy(payload);
+                return NULL;
+            }
+        }
+    }
+
+    return payload;
+}
+
+static int benchmark_influx_decode(size_t cardinality, size_t operations)
+{
+    int result;
+    size_t index;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *decoded;
+
+    payload = create_influx_payload(cardinality);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        result = cmt_decode_influx_create(&decoded, payload,
+                                          cfl_sds_len(payload), NULL);
+        if (result != CMT_DECODE_INFLUX_SUCCESS) {
+            cfl_sds_destroy(payload);
+            return -1;
+        }
+        cmt_decode_influx_destroy(decoded);
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=influx-decode cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           cardinality, operations,
+           cfl_sds_len(payload) * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) cfl_sds_len(payload) * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cfl_sds_destroy(payload);
+    return 0;
+}
+
+#ifdef CMT_HAVE_PROMETHEUS_TEXT_DECODER
+/* Decode the text exposition of the mixed series with the selected parser */
+#define PROMETHEUS_STREAM_CHUNK_SIZE 65536
+
+static int discard_family(void *data, struct cmt *cmt)
+{
+    (void) data;
+
+    cmt_destroy(cmt);
+    return 0;
+}
+
+/* Feed the payload in fixed size chunks, families are dropped once emitted */
+static int decode_prometheus_stream(cfl_sds_t payload,
+                                    struct cmt_decode_prometheus_parse_opts *opts)
+{
+    int result;
+    size_t offset;
+    size_t size;
+    struct cmt_decode_prometheus_stream *stream;
+
+    result = cmt_decode_prometheus_stream_create(&stream, opts, NULL,
+                                                 discard_family);
+    if (result != CMT_DECODE_PROMETHEUS_SUCCESS) {
+        return result;
+    }
+
+    for (offset = 0; offset < cfl_sds_len(payload); offset += size) {
+        size = cfl_sds_len(payload) - offset;
+        if (size > PROMETHEUS_STREAM_CHUNK_SIZE) {
+            size = PROMETHEUS_STREAM_CHUNK_SIZE;
+        }
+        result = cmt_decode_prometheus_stream_feed(stream, payload + offset, size);
+        if (result != CMT_DECODE_PROMETHEUS_SUCCESS) {
+            cmt_decode_prometheus_stream_destroy(stream);
+            return result;
+        }
+    }
+
+    result = cmt_decode_prometheus_stream_finish(stream, NULL);
+    cmt_decode_prometheus_stream_destroy(stream);
+    return result;
+}
+
+static int benchmark_prometheus_decode(size_t cardinality, size_t operations,
+                                       int parser, int streaming)
+{
+    int result;
+    size_t index;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cmt *decoded;
+    struct cmt_decode_prometheus_parse_opts opts;
+
+    cmt = cmt_create();
+    if (cmt == NULL) {
+        return -1;
+    }
+
+    if (create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = cmt_encode_prometheus_create(cmt, CMT_TRUE);
+    cmt_destroy(cmt);
+    if (payload == NULL) {
+        return -1;
+    }
+
+    memset(&opts, 0, sizeof(opts));
+    opts.parser = parser;
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (streaming) {
+            result = decode_prometheus_stream(payload, &opts);
+        }
+        else {
+            result = cmt_decode_prometheus_create(&decoded, payload,
+                                                  cfl_sds_len(payload), &opts);
+            if (result == CMT_DECODE_PROMETHEUS_SUCCESS) {
+                cmt_decode_prometheus_destroy(decoded);
+            }
+        }
+        if (result != CMT_DECODE_PROMETHEUS_SUCCESS) {
+            cmt_encode_prometheus_destroy(payload);
+            return -1;
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=prometheus-decode%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           streaming ? "-stream" :
+           parser == CMT_DECODE_PROMETHEUS_PARSER_FAST ? "-fast" : "",
+           cardinality, operations,
+           cfl_sds_len(payload) * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) cfl_sds_len(payload) * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cmt_encode_prometheus_destroy(payload);
+    return 0;
+}
+#endif
+
+#define MSGPACK_ENCODE 0
+#define MSGPACK_DECODE 1
+#define MSGPACK_VIEW   2
+
+static int encode_msgpack(struct cmt *cmt, int compact,
+                          char **buffer, size_t *size)
+{
+    if (compact) {
+        return cmt_encode_msgpack_compact_create(cmt, buffer, size);
+    }
+
+    return cmt_encode_msgpack_create(cmt, buffer, size);
+}
+
+/* Index the payload and read every series with its labels */
+static int view_msgpack(char *payload, size_t payload_size)
+{
+    int result;
+    size_t offset;
+    size_t family_index;
+    size_t series_index;
+    struct cmt_msgpack_view *view;
+    struct cmt_msgpack_view_family *family;
+    struct cmt_msgpack_view_series series;
+    struct cmt_msgpack_view_string label;
+    struct cmt_msgpack_view_label_iterator iterator;
+
+    offset = 0;
+    result = cmt_msgpack_view_create(&view, payload, payload_size, &offset);
+    if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+        return -1;
+    }
+
+    for (family_index = 0; family_index < view->family_count; family_index++) {
+        family = cmt_msgpack_view_family_get(view, family_index);
+
+        for (series_index = 0; series_index < family->series_count;
+             series_index++) {
+            result = cmt_msgpack_view_series_get(view, family, series_index,
+                                                 &series);
+            if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+                cmt_msgpack_view_destroy(view);
+                return -1;
+            }
+
+            cmt_msgpack_view_series_labels(view, &series, &iterator);
+            while (cmt_msgpack_view_label_next(&iterator, &label)) {
+            }
+            if (iterator.error != CMT_DECODE_MSGPACK_SUCCESS) {
+                cmt_msgpack_view_destroy(view);
+                return -1;
+            }
+        }
+    }
+
+    cmt_msgpack_view_destroy(view);
+    return 0;
+}
+
+static int benchmark_msgpack(size_t cardinality, size_t operations,
+                             int compact, int mode)
+{
+    int result;
+    size_t index;
+    size_t bytes;
+    size_t size;
+    size_t offset;
+    uint64_t start;
+    uint64_t elapsed;
+    char *buffer;
+    char *payload;
+    size_t payload_size;
+    struct cmt *cmt;
+    struct cmt *decoded;
+
+    bytes = 0;
+    cmt = cmt_create();
+    if (cmt == NULL || create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = NULL;
+    payload_size = 0;
+    if (mode != MSGPACK_ENCODE) {
+        result = encode_msgpack(cmt, compact, &payload, &payload_size);
+        cmt_destroy(cmt);
+        cmt = NULL;
+        if (result != 0) {
+            return -1;
+        }
+    }
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (mode == MSGPACK_DECODE) {
+            offset = 0;
+            result = cmt_decode_msgpack_create(&decoded, payload, payload_size,
+                                               &offset);
+            if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+                cmt_encode_msgpack_destroy(payload);
+                return -1;
+            }
+            cmt_decode_msgpack_destroy(decoded);
+            bytes += payload_size;
+        }
+        else if (mode == MSGPACK_VIEW) {
+            if (view_msgpack(payload, payload_size) != 0) {
+                cmt_encode_msgpack_destroy(payload);
+                return -1;
+            }
+            bytes += payload_size;
+        }
+        else {
+            if (encode_msgpack(cmt, compact, &buffer, &size) != 0) {
+                cmt_destroy(cmt);
+                return -1;
+            }
+            bytes += size;
+            cmt_encode_msgpack_destroy(buffer);
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=msgpack%s%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           mode == MSGPACK_DECODE ? "-decode" :
+           mode == MSGPACK_VIEW ? "-view" : "",
+           compact ? "-compact" : "",
+           cardinality, operations, bytes, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+
+    if (mode != MSGPACK_ENCODE) {
+        cmt_encode_msgpack_destroy(payload);
+    }
+    else {
+        cmt_destroy(cmt);
+    }
+    return 0;
+}
+
+/*
+ * Encode the opentelemetry-mixed series with the graphite plaintext or pickle
+ * encoder, or decode the plaintext payload.
+ */
+static int benchmark_graphite(size_t cardinality, size_t operations,
+                              int pickle, int decode)
+{
+    int result;
+    size_t index;
+    size_t bytes;
+    uint64_t start;
+    uint64_t elapsed;
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cmt *decoded;
+
+    cmt = cmt_create();
+    if (cmt == NULL || create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    payload = pickle ? cmt_encode_graphite_pickle_create(cmt) :
+                       cmt_encode_graphite_create(cmt);
+    if (payload == NULL) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+    bytes = cfl_sds_len(payload);
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (decode) {
+            result = cmt_decode_graphite_create(&decoded, payload, bytes,
+                                                NULL);
+            if (result != CMT_DECODE_GRAPHITE_SUCCESS) {
+                cfl_sds_destroy(payload);
+                cmt_destroy(cmt);
+                return -1;
+            }
+            cmt_decode_graphite_destroy(decoded);
+        }
+        else {
+            cfl_sds_destroy(payload);
+            payload = pickle ? cmt_encode_graphite_pickle_create(cmt) :
+                               cmt_encode_graphite_create(cmt);
+            if (payload == NULL) {
+                cmt_destroy(cmt);
+                return -1;
+            }
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=graphite%s%s cardinality=%zu operations=%zu "
+           "bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           pickle ? "-pickle" : "", decode ? "-decode" : "",
+           cardinality, operations, bytes * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) bytes * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+    cfl_sds_destroy(payload);
+    cmt_destroy(cmt);
+    return 0;
+}
+
+#define MSGPACK_CHUNK_COUNT 32
+
+/*
+ * Decode a buffer holding MSGPACK_CHUNK_COUNT concatenated contexts, either
+ * one context after the other or with the parallel decoder using one worker
+ * per online CPU.
+ */
+static int benchmark_msgpack_chunks(size_t cardinality, size_t operations,
+                                    int parallel)
+{
+    int result;
+    size_t index;
+    size_t offset;
+    size_t size;
+    size_t worker_count;
+    long cpu_count;
+    uint64_t start;
+    uint64_t elapsed;
+    char *payload;
+    char *buffer;
+    struct cmt *cmt;
+    struct cmt *decoded;
+    struct cfl_list contexts;
+
+    cmt = cmt_create();
+    if (cmt == NULL || create_mixed_series(cmt, cardinality) != 0) {
+        cmt_destroy(cmt);
+        return -1;
+    }
+
+    result = cmt_encode_msgpack_create(cmt, &payload, &size);
+    cmt_destroy(cmt);
+    if (result != 0) {
+        return -1;
+    }
+
+    buffer = malloc(size * MSGPACK_CHUNK_COUNT);
+    if (buffer == NULL) {
+        cmt_encode_msgpack_destroy(payload);
+        return -1;
+    }
+    for (index = 0; index < MSGPACK_CHUNK_COUNT; index++) {
+        memcpy(&buffer[index * size], payload, size);
+    }
+    cmt_encode_msgpack_destroy(payload);
+    size *= MSGPACK_CHUNK_COUNT;
+
+    cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = cpu_count > 0 ? (size_t) cpu_count : 1;
+
+    start = monotonic_ns();
+    for (index = 0; index < operations; index++) {
+        if (parallel) {
+            cfl_list_init(&contexts);
+            result = cmt_decode_msgpack_parallel_create(&contexts, buffer, size,
+                                                        worker_count);
+            if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+                free(buffer);
+                return -1;
+            }
+            cmt_decode_msgpack_parallel_destroy(&contexts);
+            continue;
+        }
+
+        offset = 0;
+        while (offset < size) {
+            result = cmt_decode_msgpack_create(&decoded, buffer, size, &offset);
+            if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+                free(buffer);
+                return -1;
+            }
+            cmt_decode_msgpack_destroy(decoded);
+        }
+    }
+    elapsed = monotonic_ns() - start;
+
+    printf("benchmark=msgpack-decode-%s cardinality=%zu operations=%zu "
+           "workers=%zu bytes=%zu elapsed_ns=%" PRIu64 " ns_per_op=%.2f "
+           "mb_per_second=%.2f\n",
+           parallel ? "parallel" : "chunks", cardinality, operations,
+           parallel ? worker_count : 1, size * operations, elapsed,
+           (double) elapsed / operations,
+           ((double) size * operations / (1024.0 * 1024.0)) /
+           ((double) elapsed / 1000000000.0));
+
+    free(buffer);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    size_t index;
+    size_t cardinality;
+    size_t operations;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s lookup|update|prometheus|"
+                        "prometheus-protobuf|prometheus-exp-histogram|"
+                        "prometheus-protobuf-exp-histogram|"
+                        "prometheus-decode[-fast|-stream]|"
+                        "prometheus-remote-write[-v2][-compressed]|"
+                        "prometheus-remote-write-decode|"
+                        "prometheus-remote-write-exp-histogram[-decode]|"
+                        "opentelemetry|"
+                        "opentelemetry-mixed|"
+                        "opentelemetry-decode[-stream]|"
+                        "opentelemetry-json[-decode]|statsd-decode|"
+                        "influx-decode|graphite[-pickle|-decode]|"
+                        "msgpack[-decode|-view][-compact]|"
+                        "msgpack-decode-chunks|msgpack-decode-parallel "
+                        "CARDINALITY OPERATIONS\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    cardinality = parse_size(argv[2], "cardinality");
+    operations = parse_size(argv[3], "operations");
+    cmt_initialize();
 
     if (strcmp(argv[1], "lookup") == 0) {
         return benchmark_lookup(cardinality, operations) == 0 ?
@@ -332,6 +1437,65 @@ int main(int argc, char **argv)
         return benchmark_prometheus(cardinality, operations) == 0 ?
                EXIT_SUCCESS : EXIT_FAILURE;
     }
+    if (strcmp(argv[1], "prometheus-protobuf") == 0) {
+        return benchmark_prometheus_protobuf(cardinality, operations) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-exp-histogram") == 0) {
+        return benchmark_prometheus_exp_histogram(cardinality, operations,
+                                                  CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-protobuf-exp-histogram") == 0) {
+        return benchmark_prometheus_exp_histogram(cardinality, operations,
+                                                  CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+#ifdef CMT_HAVE_PROMETHEUS_TEXT_DECODER
+    if (strcmp(argv[1], "prometheus-decode") == 0) {
+        return benchmark_prometheus_decode(cardinality, operations,
+                                           CMT_DECODE_PROMETHEUS_PARSER_BISON,
+                                           CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-decode-fast") == 0) {
+        return benchmark_prometheus_decode(cardinality, operations,
+                                           CMT_DECODE_PROMETHEUS_PARSER_FAST,
+                                           CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-decode-stream") == 0) {
+        return benchmark_prometheus_decode(cardinality, operations,
+                                           CMT_DECODE_PROMETHEUS_PARSER_FAST,
+                                           CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+#endif
+    for (index = 0; remote_write_encoders[index].name != NULL; index++) {
+        if (strcmp(argv[1], remote_write_encoders[index].name) == 0) {
+            return benchmark_prometheus_remote_write(&remote_write_encoders[index],
+                                                     cardinality,
+                                                     operations) == 0 ?
+                   EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (strcmp(argv[1], "prometheus-remote-write-decode") == 0) {
+        return benchmark_prometheus_remote_write_decode(cardinality,
+                                                        operations) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-remote-write-exp-histogram") == 0) {
+        return benchmark_prometheus_remote_write_exp_histogram(cardinality,
+                                                               operations,
+                                                               CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "prometheus-remote-write-exp-histogram-decode") == 0) {
+        return benchmark_prometheus_remote_write_exp_histogram(cardinality,
+                                                               operations,
+                                                               CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
     if (strcmp(argv[1], "opentelemetry") == 0) {
         return benchmark_opentelemetry(cardinality, operations) == 0 ?
                EXIT_SUCCESS : EXIT_FAILURE;
@@ -340,6 +1504,92 @@ int main(int argc, char **argv)
         return benchmark_opentelemetry_mixed(cardinality, operations) == 0 ?
                EXIT_SUCCESS : EXIT_FAILURE;
     }
+    if (strcmp(argv[1], "opentelemetry-decode") == 0) {
+        return benchmark_opentelemetry_decode(cardinality, operations,
+                                              CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "opentelemetry-decode-stream") == 0) {
+        return benchmark_opentelemetry_decode(cardinality, operations,
+                                              CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "opentelemetry-json") == 0) {
+        return benchmark_opentelemetry_json(cardinality, operations,
+                                            CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "opentelemetry-json-decode") == 0) {
+        return benchmark_opentelemetry_json(cardinality, operations,
+                                            CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "statsd-decode") == 0) {
+        return benchmark_statsd_decode(cardinality, operations) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "influx-decode") == 0) {
+        return benchmark_influx_decode(cardinality, operations) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "graphite") == 0) {
+        return benchmark_graphite(cardinality, operations,
+                                  CMT_FALSE, CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "graphite-pickle") == 0) {
+        return benchmark_graphite(cardinality, operations,
+                                  CMT_TRUE, CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "graphite-decode") == 0) {
+        return benchmark_graphite(cardinality, operations,
+                                  CMT_FALSE, CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "msgpack") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_FALSE, MSGPACK_ENCODE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "msgpack-compact") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_TRUE, MSGPACK_ENCODE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "msgpack-decode") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_FALSE, MSGPACK_DECODE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "msgpack-decode-compact") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_TRUE, MSGPACK_DECODE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "msgpack-view") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_FALSE, MSGPACK_VIEW) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "msgpack-view-compact") == 0) {
+        return benchmark_msgpack(cardinality, operations,
+                                 CMT_TRUE, MSGPACK_VIEW) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "msgpack-decode-chunks") == 0) {
+        return benchmark_msgpack_chunks(cardinality, operations,
+                                        CMT_FALSE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "msgpack-decode-parallel") == 0) {
+        return benchmark_msgpack_chunks(cardinality, operations,
+                                        CMT_TRUE) == 0 ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     fprintf(stderr, "unknown benchmark: %s\n", argv[1]);
     return EXIT_FAILURE;
@@ -21,8 +21,39 @@ run_repeated lookup 5000 100000
 run_repeated update 5000 100000
 run_repeated update 1 5000000
 run_repeated prometheus 5000 100
+run_repeated prometheus-protobuf 5000 100
+run_repeated prometheus-exp-histogram 2000 100
+run_repeated prometheus-protobuf-exp-histogram 2000 100
+run_repeated prometheus-decode 2000 20
+run_repeated prometheus-decode-fast 2000 20
+run_repeated prometheus-decode-stream 2000 20
+run_repeated prometheus-remote-write 10000 10
+run_repeated prometheus-remote-write 100000 1
+run_repeated prometheus-remote-write-v2 10000 10
+run_repeated prometheus-remote-write-compressed 10000 10
+run_repeated prometheus-remote-write-v2-compressed 10000 10
+run_repeated prometheus-remote-write-decode 10000 10
+run_repeated prometheus-remote-write-exp-histogram 10000 10
+run_repeated prometheus-remote-write-exp-histogram-decode 10000 10
 run_repeated opentelemetry 5000 100
 run_repeated opentelemetry-mixed 2000 100
+run_repeated opentelemetry-decode 2000 20
+run_repeated opentelemetry-decode-stream 2000 20
+run_repeated opentelemetry-json 2000 20
+run_repeated opentelemetry-json-decode 2000 20
+run_repeated statsd-decode 2000 20
+run_repeated influx-decode 2000 20
+run_repeated graphite 2000 20
+run_repeated graphite-pickle 2000 20
+run_repeated graphite-decode 2000 20
+run_repeated msgpack 2000 100
+run_repeated msgpack-compact 2000 100
+run_repeated msgpack-decode 2000 100
+run_repeated msgpack-decode-compact 2000 100
+run_repeated msgpack-view 2000 100
+run_repeated msgpack-view-compact 2000 100
+run_repeated msgpack-decode-chunks 500 20
+run_repeated msgpack-decode-parallel 500 20
 
 perf stat \
     -e cycles,instructions,branches,branch-misses,cache-misses \
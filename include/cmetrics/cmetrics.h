@@ -70,7 +70,7 @@ struct cmt {
     struct cfl_list summaries;
     struct cfl_list untypeds;
 
-    /* Only used by the otlp decoder */
+    /* Only used by the otlp and the parallel msgpack decoders */
     struct cfl_list _head;
 };
 
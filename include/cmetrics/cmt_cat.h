@@ -39,4 +39,12 @@ int cmt_cat_exp_histogram(struct cmt *cmt, struct cmt_exp_histogram *exp_histogr
 int cmt_cat_summary(struct cmt *cmt, struct cmt_summary *summary, struct cmt_map *filtered_map);
 int cmt_cat(struct cmt *dst, struct cmt *src);
 
+/*
+ * Merge 'src' into 'dst' with the cmt_cat() semantics, but families and
+ * series that 'dst' does not have yet are moved out of 'src' instead of being
+ * copied, so they keep their unit and aggregation type. 'src' still has to be
+ * destroyed afterwards and must not be used for anything else.
+ */
+int cmt_cat_move(struct cmt *dst, struct cmt *src);
+
 #endif
@@ -0,0 +1,86 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_DECODE_GRAPHITE_H
+#define CMT_DECODE_GRAPHITE_H
+
+#include <cmetrics/cmetrics.h>
+
+#define CMT_DECODE_GRAPHITE_SUCCESS                 0
+#define CMT_DECODE_GRAPHITE_ALLOCATION_ERROR        1
+#define CMT_DECODE_GRAPHITE_UNEXPECTED_ERROR        2
+#define CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR  3
+#define CMT_DECODE_GRAPHITE_DECODE_ERROR            4
+#define CMT_DECODE_GRAPHITE_MERGE_ERROR             5
+
+/* a path can carry at most this many tags */
+#define CMT_DECODE_GRAPHITE_MAX_TAGS              128
+
+/*
+ * Selects the type of the paths matching 'name', a NULL pattern matches
+ * anything. A pattern ending with '*' matches a prefix, one starting with
+ * '*' matches a suffix, other patterns match exactly.
+ */
+struct cmt_decode_graphite_rule {
+    char *name;
+    int   type;          /* CMT_COUNTER or CMT_GAUGE */
+};
+
+struct cmt_decode_graphite_opts {
+    /* the first matching rule wins, paths matching no rule are gauges */
+    struct cmt_decode_graphite_rule *rules;
+    size_t                           rule_count;
+};
+
+struct cmt_decode_graphite_stream;
+
+/*
+ * Decode plaintext lines, 'path value [timestamp]'. The path up to the
+ * first ';' is the metric name, the ';key=value' tags that follow become
+ * labels sorted by key. Paths sharing a name and tag keys share a metric
+ * family, a series seen on several lines keeps its last value. Timestamps
+ * are in seconds, lines without one or with -1 get the decoding time.
+ * 'opts' can be NULL when every series is a gauge.
+ */
+int cmt_decode_graphite_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
+                               struct cmt_decode_graphite_opts *opts);
+
+/*
+ * Decode and merge the result into 'dst' with cmt_cat_move(), see
+ * cmetrics/cmt_cat.h.
+ */
+int cmt_decode_graphite_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                              struct cmt_decode_graphite_opts *opts);
+void cmt_decode_graphite_destroy(struct cmt *cmt);
+
+/*
+ * Incremental plaintext decoder, chunks can end anywhere and only the line
+ * a chunk ends in is carried over to the next one. Series are aggregated
+ * across chunks and handed over by cmt_decode_graphite_stream_finish(),
+ * nothing can be fed to the stream afterwards.
+ */
+int cmt_decode_graphite_stream_create(struct cmt_decode_graphite_stream **out_stream,
+                                      struct cmt_decode_graphite_opts *opts);
+int cmt_decode_graphite_stream_feed(struct cmt_decode_graphite_stream *stream,
+                                    const char *chunk, size_t size);
+int cmt_decode_graphite_stream_finish(struct cmt_decode_graphite_stream *stream,
+                                      struct cmt **out_cmt);
+void cmt_decode_graphite_stream_destroy(struct cmt_decode_graphite_stream *stream);
+
+#endif
@@ -0,0 +1,81 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_DECODE_INFLUX_H
+#define CMT_DECODE_INFLUX_H
+
+#include <cmetrics/cmetrics.h>
+
+#define CMT_DECODE_INFLUX_SUCCESS                 0
+#define CMT_DECODE_INFLUX_ALLOCATION_ERROR        1
+#define CMT_DECODE_INFLUX_UNEXPECTED_ERROR        2
+#define CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR  3
+#define CMT_DECODE_INFLUX_DECODE_ERROR            4
+#define CMT_DECODE_INFLUX_MERGE_ERROR             5
+
+/* unit of the line timestamps */
+#define CMT_DECODE_INFLUX_PRECISION_NANOSECONDS   0
+#define CMT_DECODE_INFLUX_PRECISION_MICROSECONDS  1
+#define CMT_DECODE_INFLUX_PRECISION_MILLISECONDS  2
+#define CMT_DECODE_INFLUX_PRECISION_SECONDS       3
+
+/* a line can carry at most this many tags and fields */
+#define CMT_DECODE_INFLUX_MAX_TAGS              128
+#define CMT_DECODE_INFLUX_MAX_FIELDS            128
+
+/*
+ * Selects the type of the fields matching 'measurement' and 'field', a NULL
+ * pattern matches anything. A pattern ending with '*' matches a prefix, one
+ * starting with '*' matches a suffix, other patterns match exactly.
+ */
+struct cmt_decode_influx_rule {
+    char *measurement;
+    char *field;
+    int   type;          /* CMT_COUNTER or CMT_GAUGE */
+};
+
+struct cmt_decode_influx_opts {
+    int                            precision;
+
+    /* the first matching rule wins, fields matching no rule are gauges */
+    struct cmt_decode_influx_rule *rules;
+    size_t                         rule_count;
+};
+
+/*
+ * Every field of a line becomes a series named after the field in the
+ * namespace named after the measurement, tags become labels sorted by key.
+ * Fields of the same measurement and name sharing the same tag keys share a
+ * metric family, a series seen on several lines keeps its last value.
+ * Integer fields keep their 64 bit value, booleans are decoded as 0 and 1,
+ * string fields are skipped. Lines without a timestamp get the decoding time.
+ * 'opts' can be NULL for nanosecond timestamps and gauges only.
+ */
+int cmt_decode_influx_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
+                             struct cmt_decode_influx_opts *opts);
+
+/*
+ * Decode and merge the result into 'dst' with cmt_cat_move(), see
+ * cmetrics/cmt_cat.h.
+ */
+int cmt_decode_influx_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                            struct cmt_decode_influx_opts *opts);
+void cmt_decode_influx_destroy(struct cmt *cmt);
+
+#endif
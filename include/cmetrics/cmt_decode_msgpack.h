@@ -38,12 +38,19 @@
 
 #define CMT_DECODE_MSGPACK_DICTIONARY_LOOKUP_ERROR    CMT_MPACK_ERROR_CUTOFF + 1
 #define CMT_DECODE_MSGPACK_VERSION_ERROR              CMT_MPACK_ERROR_CUTOFF + 2
+#define CMT_DECODE_MSGPACK_MERGE_ERROR                CMT_MPACK_ERROR_CUTOFF + 3
 
 struct cmt_msgpack_temporary_bucket {
     double upper_bound;
     struct cfl_list _head;
 };
 
+/* Compact payload dictionary entry, it points into the input buffer */
+struct cmt_msgpack_dictionary_entry {
+    const char *data;
+    size_t      length;
+};
+
 struct cmt_msgpack_decode_context {
     struct cmt        *cmt;
     struct cmt_map    *map;
@@ -56,10 +63,61 @@ struct cmt_msgpack_decode_context {
     size_t             summary_quantiles_count;
     int                aggregation_type;
     int                metric_value_type_set;
+
+    /* compact format state */
+    int                                  compact;
+    struct cmt_msgpack_dictionary_entry *dictionary;
+    size_t                               dictionary_size;
+    uint64_t                             timestamp;
+};
+
+/* Position of one context in a buffer of concatenated contexts */
+struct cmt_msgpack_chunk {
+    size_t offset;
+    size_t size;
 };
 
 int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size, 
                               size_t *offset);
 void cmt_decode_msgpack_destroy(struct cmt *cmt);
 
+/*
+ * Decode the context found at 'offset' and merge it into 'dst' with
+ * cmt_cat_move(), the decoded families and series are moved into 'dst'
+ * instead of being copied. On a merge error 'dst' can be partially updated.
+ */
+int cmt_decode_msgpack_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                             size_t *offset);
+
+/*
+ * Find the boundaries of the contexts concatenated in a buffer by skipping
+ * over their msgpack objects, nothing is decoded.
+ */
+int cmt_decode_msgpack_scan(char *in_buf, size_t in_size,
+                            struct cmt_msgpack_chunk **out_chunks,
+                            size_t *out_chunk_count);
+void cmt_decode_msgpack_scan_destroy(struct cmt_msgpack_chunk *chunks);
+
+/*
+ * Decode every context of a buffer using up to 'worker_count' threads, the
+ * calling thread included. Each worker decodes a contiguous range of
+ * contexts. The decoded contexts are appended to 'out_context_list' in buffer
+ * order, and nothing is appended when any of them fails. Without thread
+ * support the contexts are decoded in the calling thread.
+ */
+int cmt_decode_msgpack_parallel_create(struct cfl_list *out_context_list,
+                                       char *in_buf, size_t in_size,
+                                       size_t worker_count);
+void cmt_decode_msgpack_parallel_destroy(struct cfl_list *context_list);
+
+/*
+ * Same as above but the contexts are merged into 'dst' with cmt_cat_move().
+ * Every worker merges its own range first, so values that cmt_cat() overwrites
+ * keep the last value in buffer order. Histogram sums are added in a different
+ * order than sequential merges would, so they can differ in the last bits.
+ */
+int cmt_decode_msgpack_parallel_merge(struct cmt *dst,
+                                      char *in_buf, size_t in_size,
+                                      size_t worker_count);
+
 #endif
@@ -22,6 +22,7 @@
 #define CMT_DECODE_OPENTELEMETRY_H
 
 #include <cmetrics/cmetrics.h>
+#include <cfl/cfl_arena.h>
 #include <opentelemetry/proto/metrics/v1/metrics.pb-c.h>
 #include <opentelemetry/proto/collector/metrics/v1/metrics_service.pb-c.h>
 
@@ -30,6 +31,7 @@
 #define CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR 2
 #define CMT_DECODE_OPENTELEMETRY_KVLIST_ACCESS_ERROR    3
 #define CMT_DECODE_OPENTELEMETRY_ARRAY_ACCESS_ERROR     4
+#define CMT_DECODE_OPENTELEMETRY_MERGE_ERROR            5
 
 struct cmt_opentelemetry_decode_context {
     struct cmt        *cmt;
@@ -43,6 +45,55 @@ int cmt_decode_opentelemetry_create(struct cfl_list *result_context_list,
                                     char *in_buf, size_t in_size,
                                     size_t *offset);
 
+/*
+ * Decode using 'arena' for every allocation made while unpacking the
+ * request. Metadata strings (resource and scope attributes, schema urls,
+ * metric metadata) reference the unpacked request instead of being copied,
+ * labels, names and units remain owned by the contexts. The arena must
+ * outlive the decoded contexts: call cmt_decode_opentelemetry_destroy()
+ * before cfl_arena_destroy(), use cmt_cat() to keep data beyond that point.
+ */
+int cmt_decode_opentelemetry_create_with_arena(struct cfl_list *result_context_list,
+                                               char *in_buf, size_t in_size,
+                                               size_t *offset,
+                                               struct cfl_arena *arena);
+
+/*
+ * Single pass decoder that walks the ExportMetricsServiceRequest wire format
+ * instead of unpacking the whole request: only one data point is unpacked
+ * at a time, so peak memory is the input plus the resulting contexts.
+ *
+ * When 'filter' is set it receives every metric name (not NUL terminated)
+ * and metrics for which it does not return CMT_TRUE are skipped without
+ * decoding their data points.
+ */
+int cmt_decode_opentelemetry_stream_create(struct cfl_list *result_context_list,
+                                           char *in_buf, size_t in_size,
+                                           size_t *offset,
+                                           void *filter_context,
+                                           int (*filter)(void *filter_context,
+                                                         const char *name,
+                                                         size_t length));
+
+/*
+ * Decode with the single pass decoder and merge every resulting context into
+ * 'dst' with cmt_cat_move(), see cmetrics/cmt_cat.h. Resource and scope
+ * metadata are not carried over, the same as with cmt_cat().
+ */
+int cmt_decode_opentelemetry_merge(struct cmt *dst,
+                                   char *in_buf, size_t in_size,
+                                   size_t *offset);
+
+/*
+ * Decode an OTLP/JSON document (MetricsData or ExportMetricsServiceRequest)
+ * in a single pass, without building a document tree. On success 'offset' is
+ * moved past the document. Release the result with
+ * cmt_decode_opentelemetry_destroy().
+ */
+int cmt_decode_opentelemetry_json_create(struct cfl_list *result_context_list,
+                                         char *in_buf, size_t in_size,
+                                         size_t *offset);
+
 void cmt_decode_opentelemetry_destroy(struct cfl_list *context_list);
 
 #endif
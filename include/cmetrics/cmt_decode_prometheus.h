@@ -27,6 +27,7 @@
 #include <stdbool.h>
 
 #include <cmetrics/cmetrics.h>
+#include <cfl/cfl_arena.h>
 #include <stdint.h>
 
 #define CMT_DECODE_PROMETHEUS_SUCCESS                     0
@@ -38,9 +39,20 @@
 #define CMT_DECODE_PROMETHEUS_PARSE_VALUE_FAILED         60
 #define CMT_DECODE_PROMETHEUS_PARSE_TIMESTAMP_FAILED     70
 #define CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_TOO_LONG      80
+#define CMT_DECODE_PROMETHEUS_MERGE_ERROR                90
+#define CMT_DECODE_PROMETHEUS_CALLBACK_ERROR            100
 
 #define CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT 128
 
+/*
+ * Parsers selectable through cmt_decode_prometheus_parse_opts.parser, both
+ * build the same context and report the same errors. The fast parser is a
+ * hand written single pass scanner, requests with a start token always use
+ * the bison parser.
+ */
+#define CMT_DECODE_PROMETHEUS_PARSER_BISON  0
+#define CMT_DECODE_PROMETHEUS_PARSER_FAST   1
+
 enum cmt_decode_prometheus_context_sample_type {
     CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_NORMAL = 0,
     CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_BUCKET = 1,
@@ -48,11 +60,28 @@ enum cmt_decode_prometheus_context_sample_type {
     CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_COUNT = 3
 };
 
+/* what is known about a sample value and timestamp once they are parsed */
+#define CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID      (1 << 0)
+#define CMT_DECODE_PROMETHEUS_SAMPLE_COUNT_INVALID      (1 << 1)
+#define CMT_DECODE_PROMETHEUS_SAMPLE_HAS_TIMESTAMP      (1 << 2)
+#define CMT_DECODE_PROMETHEUS_SAMPLE_TIMESTAMP_INVALID  (1 << 3)
+
+/*
+ * Samples live in the arena of their family until it is added to the
+ * context. Values are parsed as soon as the sample ends, the raw text is only
+ * kept to report the ones that failed. A sample holds the label values known
+ * when it ended, labels that show up later are unset for it.
+ */
 struct cmt_decode_prometheus_context_sample {
-    char value1[64];
-    char value2[64];
     int type;
-    cfl_sds_t label_values[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
+    int flags;
+    double value;
+    uint64_t count;             /* bucket and count samples */
+    uint64_t timestamp;         /* milliseconds */
+    char *value_text;
+    char *timestamp_text;
+    size_t label_count;
+    char **label_values;
 
     struct cfl_list _head;
 };
@@ -67,7 +96,10 @@ struct cmt_decode_prometheus_context_metric {
     cfl_sds_t docstring;
     size_t label_count;
     cfl_sds_t labels[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
+    /* label values of the sample being parsed */
+    char *label_values[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
     struct cfl_list samples;
+    struct cfl_arena *arena;
     char *name_buf;
 };
 
@@ -77,6 +109,7 @@ struct cmt_decode_prometheus_parse_opts {
     uint64_t override_timestamp;
     char *errbuf;
     size_t errbuf_size;
+    int parser;
 };
 
 struct cmt_decode_prometheus_context {
@@ -108,13 +141,67 @@ struct cmt_decode_prometheus_context {
 
 LEX_DECL; /* Declear as an entity of yylex function declaration. */
 
+/*
+ * Incremental decoder, input is parsed with the hand written parser as it is
+ * fed and only the statement a chunk ends in is carried over to the next one.
+ */
+struct cmt_decode_prometheus_stream {
+    struct cmt_decode_prometheus_context context;
+    int status;
+
+    /* unparsed tail of the previous chunks */
+    char *buffer;
+    size_t buffer_length;
+    size_t buffer_size;
+    int line_start;
+    size_t statements;
+
+    void *callback_data;
+    int (*callback)(void *callback_data, struct cmt *cmt);
+};
+
 int cmt_decode_prometheus_create(
         struct cmt **out_cmt,
         const char *in_buf,
         size_t in_size,
         struct cmt_decode_prometheus_parse_opts *opts);
+
+/*
+ * Decode and merge the result into 'dst' with cmt_cat_move(), see
+ * cmetrics/cmt_cat.h.
+ */
+int cmt_decode_prometheus_merge(
+        struct cmt *dst,
+        const char *in_buf,
+        size_t in_size,
+        struct cmt_decode_prometheus_parse_opts *opts);
 void cmt_decode_prometheus_destroy(struct cmt *cmt);
 
+/*
+ * When 'callback' is set every family is passed to it, in a context of its
+ * own, as soon as the next one starts and the callback takes ownership of the
+ * context. A non zero return value stops decoding. Without a callback the
+ * families are accumulated and returned by cmt_decode_prometheus_stream_finish().
+ */
+int cmt_decode_prometheus_stream_create(
+        struct cmt_decode_prometheus_stream **out_stream,
+        struct cmt_decode_prometheus_parse_opts *opts,
+        void *callback_data,
+        int (*callback)(void *callback_data, struct cmt *cmt));
+int cmt_decode_prometheus_stream_feed(
+        struct cmt_decode_prometheus_stream *stream,
+        const char *chunk,
+        size_t size);
+
+/*
+ * Parse what is left and hand over the decoded context, 'out_cmt' may be NULL
+ * when a callback is used. Nothing can be fed to the stream afterwards.
+ */
+int cmt_decode_prometheus_stream_finish(
+        struct cmt_decode_prometheus_stream *stream,
+        struct cmt **out_cmt);
+void cmt_decode_prometheus_stream_destroy(struct cmt_decode_prometheus_stream *stream);
+
 #endif /* CMT_HAVE_PROMETHEUS_TEXT_DECODER */
 
 #endif
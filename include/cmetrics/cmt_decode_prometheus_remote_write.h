@@ -32,8 +32,27 @@
 #define CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR            5
 #define CMT_DECODE_PROMETHEUS_REMOTE_WRITE_UNPACK_ERROR            6
 #define CMT_DECODE_PROMETHEUS_REMOTE_WRITE_UNSUPPORTED_METRIC_TYPE 7
+#define CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECOMPRESSION_ERROR     8
+#define CMT_DECODE_PROMETHEUS_REMOTE_WRITE_MERGE_ERROR             9
 
 int cmt_decode_prometheus_remote_write_create(struct cmt **out_cmt, char *in_buf, size_t in_size);
+
+/*
+ * Decode a snappy compressed payload. The payload is decompressed into
+ * 'buffer' which is grown as needed and kept for the caller to reuse it on the
+ * next call (release it with cfl_sds_destroy), if 'buffer' is NULL a
+ * temporary buffer is used.
+ */
+int cmt_decode_prometheus_remote_write_create_compressed(struct cmt **out_cmt,
+                                                         char *in_buf,
+                                                         size_t in_size,
+                                                         cfl_sds_t *buffer);
+
+/*
+ * Decode and merge the result into 'dst' with cmt_cat_move(), see
+ * cmetrics/cmt_cat.h.
+ */
+int cmt_decode_prometheus_remote_write_merge(struct cmt *dst, char *in_buf, size_t in_size);
 void cmt_decode_prometheus_remote_write_destroy(struct cmt *cmt);
 
 #endif
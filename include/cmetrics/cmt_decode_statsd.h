@@ -23,10 +23,12 @@
 
 #include <cmetrics/cmetrics.h>
 
-#define CMT_DECODE_STATSD_TYPE_COUNTER 1
-#define CMT_DECODE_STATSD_TYPE_GAUGE   2
-#define CMT_DECODE_STATSD_TYPE_TIMER   3
-#define CMT_DECODE_STATSD_TYPE_SET     4
+#define CMT_DECODE_STATSD_TYPE_COUNTER      1
+#define CMT_DECODE_STATSD_TYPE_GAUGE        2
+#define CMT_DECODE_STATSD_TYPE_TIMER        3
+#define CMT_DECODE_STATSD_TYPE_SET          4
+#define CMT_DECODE_STATSD_TYPE_HISTOGRAM    5
+#define CMT_DECODE_STATSD_TYPE_DISTRIBUTION 6
 
 #define CMT_DECODE_STATSD_SUCCESS                  0
 #define CMT_DECODE_STATSD_ALLOCATION_ERROR         1
@@ -37,24 +39,75 @@
 #define CMT_DECODE_STATSD_UNPACK_ERROR             6
 #define CMT_DECODE_STATSD_UNSUPPORTED_METRIC_TYPE  7
 #define CMT_DECODE_STATSD_INVALID_TAG_FORMAT_ERROR 8
+#define CMT_DECODE_STATSD_MERGE_ERROR              9
 
-#define CMT_DECODE_STATSD_GAUGE_OBSERVER     1 << 0
+/*
+ * Timers (|ms), histograms (|h) and distributions (|d) are recorded into a
+ * histogram per series, with explicit buckets unless the exponential observer
+ * is selected. The gauge observer only keeps the last value of every series.
+ */
+#define CMT_DECODE_STATSD_GAUGE_OBSERVER          1 << 0
+#define CMT_DECODE_STATSD_EXP_HISTOGRAM_OBSERVER  1 << 1
+
+/* upper bounds of the default buckets, in milliseconds */
+#define CMT_DECODE_STATSD_DEFAULT_BUCKETS                                     \
+    5.0, 10.0, 25.0, 50.0, 100.0, 250.0, 500.0, 1000.0, 2500.0, 5000.0, 10000.0
+
+/* exponential histograms start at this scale and downscale to fit */
+#define CMT_DECODE_STATSD_EXP_HISTOGRAM_MAX_SCALE    20
+#define CMT_DECODE_STATSD_EXP_HISTOGRAM_MAX_BUCKETS 160
 
 /*
  * The "cmt_statsd_message" represents a single line in UDP packet.
- * It's just a bunch of pointers to ephemeral buffer.
+ * It's just a bunch of pointers to ephemeral buffer, the slices are not NUL
+ * terminated.
  */
 struct cmt_statsd_message {
     char *bucket;
     int bucket_len;
     char *value;
     char *labels;
+    int labels_len;
     int value_len;
     int type;
     double sample_rate;
 };
 
+struct cmt_decode_statsd_opts {
+    int     flags;
+
+    /* sorted upper bounds of the explicit buckets, NULL for the defaults */
+    double *buckets;
+    size_t  bucket_count;
+
+    /* exponential histogram buckets per sign, 0 for the default */
+    size_t  exp_histogram_max_buckets;
+};
+
+/*
+ * Lines are aggregated per series: counter increments are summed after being
+ * scaled by their sample rate, gauges keep the last value and apply relative
+ * (+/-) updates to it. Gauges that only received relative updates are
+ * reported with an incremental="true" label. Observations are counted with
+ * the inverse of their sample rate. Sets count their distinct members with a
+ * HyperLogLog sketch and are reported as gauges holding the estimate, the
+ * sketch stays attached to the series so merged contexts count the union.
+ * Tags become labels and lines of a bucket sharing the same tag keys share a
+ * metric family.
+ */
 int cmt_decode_statsd_create(struct cmt **out_cmt, char *in_buf, size_t in_size, int flags);
+int cmt_decode_statsd_create_with_opts(struct cmt **out_cmt,
+                                       char *in_buf, size_t in_size,
+                                       struct cmt_decode_statsd_opts *opts);
+
+/*
+ * Decode and merge the result into 'dst' with cmt_cat_move(), see
+ * cmetrics/cmt_cat.h.
+ */
+int cmt_decode_statsd_merge(struct cmt *dst, char *in_buf, size_t in_size, int flags);
+int cmt_decode_statsd_merge_with_opts(struct cmt *dst,
+                                      char *in_buf, size_t in_size,
+                                      struct cmt_decode_statsd_opts *opts);
 void cmt_decode_statsd_destroy(struct cmt *cmt);
 
 #endif
@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_ENCODE_GRAPHITE_H
+#define CMT_ENCODE_GRAPHITE_H
+
+#include <cmetrics/cmetrics.h>
+
+/*
+ * Series are written as dotted paths, namespace, subsystem and name, with
+ * the static and series labels as ';key=value' tags and the timestamp in
+ * seconds:
+ *
+ *   ns.subsystem.name;key=value 42 1700000000
+ *
+ * Histograms are written as '.bucket' series with an 'le' tag plus '.sum'
+ * and '.count', summaries as the base path with a 'quantile' tag plus '.sum'
+ * and '.count'. Spaces and ';' are replaced with '_', labels with an empty
+ * value are left out.
+ */
+cfl_sds_t cmt_encode_graphite_create(struct cmt *cmt);
+void cmt_encode_graphite_destroy(cfl_sds_t text);
+
+/*
+ * Same series as a carbon pickle message: a list of (path, (timestamp,
+ * value)) tuples pickled with protocol 2, prefixed by its size as a 32 bit
+ * big endian integer.
+ */
+cfl_sds_t cmt_encode_graphite_pickle_create(struct cmt *cmt);
+void cmt_encode_graphite_pickle_destroy(cfl_sds_t payload);
+
+#endif
@@ -25,7 +25,68 @@
 
 #define MSGPACK_ENCODER_VERSION 2
 
+/*
+ * Compact payloads are a top level array instead of a map:
+ *
+ *   [version, [dictionary strings], context header, [metrics]]
+ *
+ * Metric and value fields are keyed by the integer tags below, strings are
+ * references into the dictionary (entry zero is the empty string) and value
+ * timestamps are deltas from the previous value of the payload.
+ */
+#define MSGPACK_COMPACT_VERSION                   1
+
+#define MSGPACK_COMPACT_META_TYPE                 0
+#define MSGPACK_COMPACT_META_OPTS                 1
+#define MSGPACK_COMPACT_META_LABELS               2
+#define MSGPACK_COMPACT_META_BUCKETS              3
+#define MSGPACK_COMPACT_META_QUANTILES            4
+#define MSGPACK_COMPACT_META_AGGREGATION_TYPE     5
+#define MSGPACK_COMPACT_META_VALUES               6
+#define MSGPACK_COMPACT_META_FIELD_COUNT          7
+
+#define MSGPACK_COMPACT_VALUE_TS                  0
+#define MSGPACK_COMPACT_VALUE_START_TS            1
+#define MSGPACK_COMPACT_VALUE_DOUBLE              2
+#define MSGPACK_COMPACT_VALUE_INT64               3
+#define MSGPACK_COMPACT_VALUE_UINT64              4
+#define MSGPACK_COMPACT_VALUE_LABELS              5
+#define MSGPACK_COMPACT_VALUE_HISTOGRAM           6
+#define MSGPACK_COMPACT_VALUE_SUMMARY             7
+#define MSGPACK_COMPACT_VALUE_EXP_HISTOGRAM       8
+#define MSGPACK_COMPACT_VALUE_HASH                9
+#define MSGPACK_COMPACT_VALUE_FIELD_COUNT         10
+
+#define MSGPACK_COMPACT_HISTOGRAM_BUCKETS         0
+#define MSGPACK_COMPACT_HISTOGRAM_SUM             1
+#define MSGPACK_COMPACT_HISTOGRAM_COUNT           2
+#define MSGPACK_COMPACT_HISTOGRAM_FIELD_COUNT     3
+
+#define MSGPACK_COMPACT_SUMMARY_QUANTILES_SET     0
+#define MSGPACK_COMPACT_SUMMARY_QUANTILES         1
+#define MSGPACK_COMPACT_SUMMARY_COUNT             2
+#define MSGPACK_COMPACT_SUMMARY_SUM               3
+#define MSGPACK_COMPACT_SUMMARY_FIELD_COUNT       4
+
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_SCALE            0
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_ZERO_COUNT       1
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_ZERO_THRESHOLD   2
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_POSITIVE_OFFSET  3
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_POSITIVE_BUCKETS 4
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_NEGATIVE_OFFSET  5
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_NEGATIVE_BUCKETS 6
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_COUNT            7
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_SUM_SET          8
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_SUM              9
+#define MSGPACK_COMPACT_EXP_HISTOGRAM_FIELD_COUNT      10
+
 int cmt_encode_msgpack_create(struct cmt *cmt, char **out_buf, size_t *out_size);
+
+/*
+ * Serialize the context using the compact format, the payload is decoded by
+ * cmt_decode_msgpack_create() and released with cmt_encode_msgpack_destroy().
+ */
+int cmt_encode_msgpack_compact_create(struct cmt *cmt, char **out_buf, size_t *out_size);
 void cmt_encode_msgpack_destroy(char *out_buf);
 
 #endif
@@ -22,6 +22,7 @@
 #define CMT_ENCODE_OPENTELEMETRY_H
 
 #include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_encode_split.h>
 #include <opentelemetry/proto/metrics/v1/metrics.pb-c.h>
 #include <opentelemetry/proto/collector/metrics/v1/metrics_service.pb-c.h>
 
@@ -43,4 +44,23 @@ struct cmt_opentelemetry_context
 cfl_sds_t cmt_encode_opentelemetry_create(struct cmt *cmt);
 void cmt_encode_opentelemetry_destroy(cfl_sds_t text);
 
+/*
+ * Encode the context as a list of independent MetricsData payloads (see
+ * cmt_encode_split.h), splitting between data points. A payload holds at most
+ * 'max_series' data points and stays within 'max_bytes', zero disables either
+ * limit. Resource and scope information is repeated in every payload and a
+ * data point larger than 'max_bytes' is sent alone.
+ */
+struct cfl_list *cmt_encode_opentelemetry_create_split(struct cmt *cmt,
+                                                       size_t max_bytes,
+                                                       size_t max_series);
+
+/*
+ * Encode the context as an OTLP/JSON MetricsData document, the format used by
+ * the OTLP/HTTP JSON transport. Release the result with
+ * cmt_encode_opentelemetry_json_destroy().
+ */
+cfl_sds_t cmt_encode_opentelemetry_json_create(struct cmt *cmt);
+void cmt_encode_opentelemetry_json_destroy(cfl_sds_t text);
+
 #endif
@@ -0,0 +1,46 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#ifndef CMT_ENCODE_PROMETHEUS_PROTOBUF_H
+#define CMT_ENCODE_PROMETHEUS_PROTOBUF_H
+
+#include <cmetrics/cmetrics.h>
+
+/* HTTP content type of the delimited MetricFamily exposition format */
+#define CMT_ENCODE_PROMETHEUS_PROTOBUF_CONTENT_TYPE                           \
+    "application/vnd.google.protobuf; "                                       \
+    "proto=io.prometheus.client.MetricFamily; encoding=delimited"
+
+/*
+ * Native histograms support schemas -4 to 8, exponential histograms with a
+ * finer scale are merged down to the highest supported schema.
+ */
+#define CMT_ENCODE_PROMETHEUS_PROTOBUF_MIN_SCHEMA  -4
+#define CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA   8
+
+/*
+ * Encode the context as a stream of varint size prefixed
+ * io.prometheus.client.MetricFamily messages. Exponential histograms are
+ * exposed as native histograms.
+ */
+cfl_sds_t cmt_encode_prometheus_protobuf_create(struct cmt *cmt, int add_timestamp);
+void cmt_encode_prometheus_protobuf_destroy(cfl_sds_t payload);
+
+#endif
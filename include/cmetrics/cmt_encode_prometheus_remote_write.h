@@ -22,6 +22,7 @@
 #define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_H
 
 #include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_encode_split.h>
 #include <prometheus_remote_write/remote.pb-c.h>
 
 #define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ADD_METADATA           CMT_FALSE
@@ -37,6 +38,9 @@
 struct cmt_prometheus_metric_metadata {
     Prometheus__MetricMetadata data;
     struct cfl_list _head;
+
+    /* family the metadata describes, payload splitting emits it per batch */
+    struct cmt_map *map;
 };
 
 struct cmt_prometheus_time_series {
@@ -53,9 +57,38 @@ struct cmt_prometheus_remote_write_context
     uint64_t                 sequence_number;
     Prometheus__WriteRequest write_request;
     struct cmt              *cmt;
+
+    /* Internal lookup index. Keep these after the established public fields. */
+    struct cfl_list          *time_series_buckets;
+    size_t                    time_series_bucket_count;
+    size_t                    time_series_count;
+
+    /* Payload splitting, see cmt_encode_prometheus_remote_write_create_split() */
+    struct cfl_list          *split_payloads;
+    size_t                    split_max_bytes;
+    size_t                    split_max_series;
+    size_t                    split_pending_bytes;
+    size_t                    split_pending_series;
+    struct cmt_map           *split_pending_map;
+    int                       split_compress;
 };
 
 cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt);
+cfl_sds_t cmt_encode_prometheus_remote_write_create_compressed(struct cmt *cmt);
 void cmt_encode_prometheus_remote_write_destroy(cfl_sds_t text);
 
+/*
+ * Encode the context as a list of independent WriteRequest payloads (see
+ * cmt_encode_split.h). A payload holds at most 'max_series' time series and
+ * its uncompressed size stays within 'max_bytes', zero disables either limit.
+ * Time series are flushed while the context is being walked, a time series
+ * larger than 'max_bytes' is sent alone. Metadata is repeated in every payload.
+ */
+struct cfl_list *cmt_encode_prometheus_remote_write_create_split(struct cmt *cmt,
+                                                                 size_t max_bytes,
+                                                                 size_t max_series);
+struct cfl_list *cmt_encode_prometheus_remote_write_create_split_compressed(struct cmt *cmt,
+                                                                            size_t max_bytes,
+                                                                            size_t max_series);
+
 #endif
@@ -0,0 +1,51 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+
+#ifndef CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_H
+#define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_H
+
+#include <cmetrics/cmetrics.h>
+
+/* HTTP content type of an io.prometheus.write.v2.Request */
+#define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_CONTENT_TYPE                    \
+    "application/x-protobuf;proto=io.prometheus.write.v2.Request"
+
+#define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS             0
+#define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR    1
+#define CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_UNEXPECTED_ERROR    2
+
+/*
+ * Encode the context as a Remote Write 2.0 request. Every label name, label
+ * value, help and unit string is stored once in the request symbols table
+ * and referenced by index from the time series, which also carry their own
+ * metadata. Exponential histograms are sent as native histograms.
+ *
+ * Samples older than CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_THRESHOLD are
+ * skipped, the same as in the 1.0 encoder.
+ */
+cfl_sds_t cmt_encode_prometheus_remote_write_v2_create(struct cmt *cmt);
+
+/* Same as above, with the request snappy compressed as sent over the wire */
+cfl_sds_t cmt_encode_prometheus_remote_write_v2_create_compressed(struct cmt *cmt);
+
+void cmt_encode_prometheus_remote_write_v2_destroy(cfl_sds_t payload);
+
+#endif
@@ -0,0 +1,43 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_ENCODE_SPLIT_H
+#define CMT_ENCODE_SPLIT_H
+
+#include <cmetrics/cmetrics.h>
+
+/*
+ * Size bounded encoders emit a list of payloads instead of a single buffer,
+ * every payload is a complete request that can be sent on its own.
+ */
+struct cmt_encode_split_payload {
+    cfl_sds_t       data;
+    size_t          series_count;
+    struct cfl_list _head;
+};
+
+struct cfl_list *cmt_encode_split_create(void);
+
+/* Append 'data' to the list, ownership of the buffer is transferred on success */
+int cmt_encode_split_append(struct cfl_list *payloads,
+                            cfl_sds_t data, size_t series_count);
+
+void cmt_encode_split_destroy(struct cfl_list *payloads);
+
+#endif
@@ -49,7 +49,7 @@ struct cmt_histogram_buckets *cmt_histogram_buckets_linear_create(double start,
 struct cmt_histogram_buckets *cmt_histogram_buckets_exponential_create(double start,
                                                                        double factor,
                                                                        size_t count);
-/* Histogram */
+/* Histogram, 'buckets' are owned by the histogram once it is created */
 struct cmt_histogram *cmt_histogram_create(struct cmt *cmt,
                                            char *ns, char *subsystem,
                                            char *name, char *help,
@@ -0,0 +1,52 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_HLL_H
+#define CMT_HLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * HyperLogLog sketch used to count the distinct members of StatsD sets. The
+ * registers take 4 KiB whatever the number of members and the estimate has a
+ * standard error of about 1.6%. Sketches built with the same precision merge
+ * without loss, merging is what cmt_cat() does for set series.
+ */
+#define CMT_HLL_PRECISION 12
+#define CMT_HLL_REGISTERS (1 << CMT_HLL_PRECISION)
+
+struct cmt_hll {
+    uint8_t registers[CMT_HLL_REGISTERS];
+};
+
+struct cmt_hll *cmt_hll_create();
+struct cmt_hll *cmt_hll_clone(struct cmt_hll *hll);
+void cmt_hll_destroy(struct cmt_hll *hll);
+
+/* Add a member, or a member already hashed to 64 bits */
+void cmt_hll_add(struct cmt_hll *hll, const void *data, size_t length);
+void cmt_hll_add_hash(struct cmt_hll *hll, uint64_t hash);
+
+/* Fold 'src' into 'dst', the result counts the union of both sets */
+void cmt_hll_merge(struct cmt_hll *dst, struct cmt_hll *src);
+
+double cmt_hll_estimate(struct cmt_hll *hll);
+
+#endif
@@ -0,0 +1,37 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_INFO_H
+#define CMT_INFO_H
+
+#define CMT_SOURCE_DIR "/root/repo"
+
+/* General flags set by /CMakeLists.txt */
+#ifndef CMT_HAVE_TIMESPEC_GET
+#define CMT_HAVE_TIMESPEC_GET
+#endif
+#ifndef CMT_HAVE_GMTIME_R
+#define CMT_HAVE_GMTIME_R
+#endif
+#ifndef CMT_HAVE_PTHREAD
+#define CMT_HAVE_PTHREAD
+#endif
+
+
+#endif
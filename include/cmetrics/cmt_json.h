@@ -0,0 +1,156 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_JSON_H
+#define CMT_JSON_H
+
+#include <cmetrics/cmetrics.h>
+#include <stdint.h>
+
+#define CMT_JSON_SUCCESS                 0
+#define CMT_JSON_ALLOCATION_ERROR        1
+#define CMT_JSON_INVALID_ARGUMENT_ERROR  2
+#define CMT_JSON_CORRUPTED_INPUT_ERROR   3
+
+#define CMT_JSON_TYPE_INVALID            0
+#define CMT_JSON_TYPE_OBJECT             1
+#define CMT_JSON_TYPE_ARRAY              2
+#define CMT_JSON_TYPE_STRING             3
+#define CMT_JSON_TYPE_NUMBER             4
+#define CMT_JSON_TYPE_BOOLEAN            5
+#define CMT_JSON_TYPE_NULL               6
+
+/* maximum container nesting accepted by cmt_json_skip_value() */
+#define CMT_JSON_MAXIMUM_DEPTH           64
+
+/*
+ * Minimal JSON writer, values are serialized straight into a growing buffer
+ * and separators are inserted automatically, so an object is written as a
+ * sequence of key / value calls between begin and end.
+ *
+ * Errors are sticky the same way they are for the protobuf writer: once an
+ * allocation fails every further write becomes a no-op.
+ */
+struct cmt_json_writer {
+    char   *data;
+    size_t  size;
+    size_t  capacity;
+    int     error;
+
+    /* set when the next value needs a leading comma */
+    int     separator;
+};
+
+int cmt_json_writer_init(struct cmt_json_writer *writer,
+                         size_t initial_capacity);
+void cmt_json_writer_destroy(struct cmt_json_writer *writer);
+cfl_sds_t cmt_json_writer_to_sds(struct cmt_json_writer *writer);
+
+void cmt_json_begin_object(struct cmt_json_writer *writer);
+void cmt_json_end_object(struct cmt_json_writer *writer);
+void cmt_json_begin_array(struct cmt_json_writer *writer);
+void cmt_json_end_array(struct cmt_json_writer *writer);
+
+/* 'key' is written as is, it must not need escaping */
+void cmt_json_write_key(struct cmt_json_writer *writer, const char *key);
+
+void cmt_json_write_string(struct cmt_json_writer *writer,
+                           const char *value, size_t length);
+void cmt_json_write_uint64(struct cmt_json_writer *writer, uint64_t value);
+void cmt_json_write_int64(struct cmt_json_writer *writer, int64_t value);
+
+/* 64 bit integers as quoted decimal strings, as proto3 JSON mapping does */
+void cmt_json_write_uint64_string(struct cmt_json_writer *writer,
+                                  uint64_t value);
+void cmt_json_write_int64_string(struct cmt_json_writer *writer,
+                                 int64_t value);
+
+/* non finite values are written as the "NaN", "Infinity" and "-Infinity" strings */
+void cmt_json_write_double(struct cmt_json_writer *writer, double value);
+void cmt_json_write_bool(struct cmt_json_writer *writer, int value);
+
+/* binary data as a base64 (standard alphabet, padded) or lowercase hex string */
+void cmt_json_write_base64(struct cmt_json_writer *writer,
+                           const void *data, size_t length);
+void cmt_json_write_hex(struct cmt_json_writer *writer,
+                        const void *data, size_t length);
+
+/*
+ * Pull reader, it walks the input one value at a time without building a
+ * document tree. Strings are returned as slices of the input, the 'escaped'
+ * flag tells when cmt_json_unescape() is needed to get the actual content.
+ *
+ * Objects are iterated with cmt_json_object_next() which returns the next
+ * key and leaves the reader on its value, arrays with cmt_json_array_next().
+ * Both set 'more' to CMT_FALSE once the closing bracket was consumed.
+ */
+struct cmt_json_reader {
+    const char *data;
+    size_t      size;
+    size_t      offset;
+
+    /* set right after a container was opened */
+    int         first;
+};
+
+void cmt_json_reader_init(struct cmt_json_reader *reader,
+                          const void *data, size_t size);
+
+/* type of the next value, it does not consume any input */
+int cmt_json_peek(struct cmt_json_reader *reader);
+
+int cmt_json_object_begin(struct cmt_json_reader *reader);
+int cmt_json_object_next(struct cmt_json_reader *reader, int *more,
+                         const char **key, size_t *length);
+int cmt_json_array_begin(struct cmt_json_reader *reader);
+int cmt_json_array_next(struct cmt_json_reader *reader, int *more);
+
+int cmt_json_read_string(struct cmt_json_reader *reader,
+                         const char **data, size_t *length, int *escaped);
+int cmt_json_read_number(struct cmt_json_reader *reader,
+                         const char **data, size_t *length);
+int cmt_json_read_bool(struct cmt_json_reader *reader, int *value);
+int cmt_json_read_null(struct cmt_json_reader *reader);
+
+/* integers are accepted either as numbers or as quoted strings */
+int cmt_json_read_uint64(struct cmt_json_reader *reader, uint64_t *value);
+int cmt_json_read_int64(struct cmt_json_reader *reader, int64_t *value);
+
+/* doubles also accept the "NaN", "Infinity" and "-Infinity" strings */
+int cmt_json_read_double(struct cmt_json_reader *reader, double *value);
+
+int cmt_json_skip_value(struct cmt_json_reader *reader);
+
+/*
+ * Decode the escape sequences of a string returned by cmt_json_read_string()
+ * into 'output', which must hold at least 'length' bytes: the decoded form is
+ * never longer than the escaped one. Returns the decoded length or -1.
+ */
+int cmt_json_unescape(const char *data, size_t length, char *output);
+
+/*
+ * Decode the content of a base64 or hex string into 'output', which must hold
+ * at least 'length' bytes. Returns the decoded length or -1.
+ */
+int cmt_json_base64_decode(const char *data, size_t length,
+                           unsigned char *output);
+int cmt_json_hex_decode(const char *data, size_t length,
+                        unsigned char *output);
+
+#endif
@@ -51,6 +51,8 @@ struct cmt_map {
     size_t indexed_metric_count;
     /* Most recently created metric; only changed with the metric list. */
     struct cmt_metric *last_metric;
+    /* Every series up to this list entry is indexed, NULL when unknown. */
+    struct cfl_list *indexed_tail;
 };
 
 struct cmt_map *cmt_map_create(int type, struct cmt_opts *opts,
@@ -63,6 +65,16 @@ void cmt_map_destroy(struct cmt_map *map);
 struct cmt_metric *cmt_map_metric_get(struct cmt_opts *opts, struct cmt_map *map,
                                       int labels_count, char **labels_val,
                                       int write_op);
+/* Recompute the hash of every series from its labels and rebuild the lookup
+ * index, for maps whose series were not created through the map API. */
+void cmt_map_reindex(struct cmt_map *map);
+
+/* Return the series matching 'labels_val' or, when there is none, move
+ * 'metric' out of the map it belongs to and into 'map'. The source map must
+ * not be in use concurrently. Without labels the static metric is returned. */
+struct cmt_metric *cmt_map_metric_move(struct cmt_opts *opts, struct cmt_map *map,
+                                       int labels_count, char **labels_val,
+                                       struct cmt_metric *metric);
 int cmt_map_metric_get_val(struct cmt_opts *opts, struct cmt_map *map,
                            int labels_count, char **labels_val,
                            double *out_val);
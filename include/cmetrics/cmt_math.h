@@ -21,6 +21,7 @@
 #define CMT_MATH_H
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 
 union val_union {
@@ -59,4 +60,28 @@ static inline uint64_t cmt_math_sum_native_uint64_as_d64(uint64_t dst, uint64_t
     return cmt_math_d64_to_uint64(val);
 }
 
+/*
+ * Parse a decimal number that is not NUL terminated, the whole input has to
+ * be consumed. Returns 0 on success and -1 on error.
+ */
+int cmt_math_parse_double(const char *in, size_t length, double *out);
+
+/*
+ * Parse a decimal integer that is not NUL terminated, the signed variant
+ * accepts a leading sign. Returns 0 on success and -1 on error or overflow.
+ */
+int cmt_math_parse_int64(const char *in, size_t length, int64_t *out);
+int cmt_math_parse_uint64(const char *in, size_t length, uint64_t *out);
+
+/* room needed by the formatting functions, including the NUL terminator */
+#define CMT_MATH_FORMAT_SIZE 32
+
+/*
+ * Format a number the way "%" PRIu64 and "%.17g" do, integral doubles are
+ * formatted without going through snprintf(). Returns the length written to
+ * 'out', which must hold CMT_MATH_FORMAT_SIZE bytes.
+ */
+size_t cmt_math_format_uint64(char *out, uint64_t val);
+size_t cmt_math_format_double(char *out, double val);
+
 #endif
@@ -75,6 +75,9 @@ struct cmt_metric {
     int hash_indexed;
     struct cmt_map *map;
     struct cfl_list _hash_head;
+
+    /* distinct members of a set, the value holds its estimate */
+    struct cmt_hll *hll;
 };
 
 struct cmt_exp_histogram_snapshot {
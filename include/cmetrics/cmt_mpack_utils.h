@@ -39,9 +39,14 @@ int cmt_mpack_consume_string_tag(mpack_reader_t *reader, cfl_sds_t *output_buffe
 int cmt_mpack_unpack_map(mpack_reader_t *reader, 
                          struct cmt_mpack_map_entry_callback_t *callback_list, 
                          void *context);
+int cmt_mpack_unpack_tagged_map(mpack_reader_t *reader,
+                                cmt_mpack_unpacker_entry_callback_fn_t *callback_list,
+                                size_t callback_count,
+                                void *context);
 int cmt_mpack_unpack_array(mpack_reader_t *reader, 
                            cmt_mpack_unpacker_entry_callback_fn_t entry_processor_callback, 
                            void *context);
 int cmt_mpack_peek_array_length(mpack_reader_t *reader);
+int cmt_mpack_skip_object(const char *buffer, size_t size, size_t *object_size);
 
 #endif
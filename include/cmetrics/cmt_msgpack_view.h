@@ -0,0 +1,146 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_MSGPACK_VIEW_H
+#define CMT_MSGPACK_VIEW_H
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_decode_msgpack.h>
+
+/*
+ * Read-only view over a msgpack encoded context (v1 or compact). Creating a
+ * view indexes the families and the position of every series without
+ * materializing them, series, labels and values are then read on demand
+ * straight from the buffer, which must outlive the view. Strings are not NUL
+ * terminated. The status codes are the CMT_DECODE_MSGPACK_* ones.
+ */
+
+struct cmt_msgpack_view_string {
+    const char *data;        /* NULL for a nil label */
+    size_t      length;
+};
+
+struct cmt_msgpack_view_family {
+    int                            type;
+    struct cmt_msgpack_view_string ns;
+    struct cmt_msgpack_view_string subsystem;
+    struct cmt_msgpack_view_string name;
+    struct cmt_msgpack_view_string description;
+    struct cmt_msgpack_view_string unit;
+
+    /* label keys */
+    size_t                         label_count;
+    size_t                         labels_offset;
+
+    /* range of the family in the series index */
+    size_t                         first_series;
+    size_t                         series_count;
+};
+
+struct cmt_msgpack_view_series_entry {
+    size_t   offset;
+
+    /* compact payloads delta encode timestamps, this is the running value */
+    uint64_t timestamp;
+};
+
+struct cmt_msgpack_view {
+    const char                           *buffer;
+    size_t                                size;
+    int                                   compact;
+
+    struct cmt_msgpack_dictionary_entry  *dictionary;
+    size_t                                dictionary_size;
+
+    struct cmt_msgpack_view_family       *families;
+    size_t                                family_count;
+
+    struct cmt_msgpack_view_series_entry *series;
+    size_t                                series_count;
+    size_t                                series_capacity;
+
+    /* indexing state */
+    uint64_t                              timestamp;
+};
+
+/*
+ * A single series. Scalars set value_type to one of the CMT_METRIC_VALUE_*
+ * types, 'value' always holds the value as a double. Histograms, exponential
+ * histograms and summaries only expose their count and sum, a full decode is
+ * needed for the buckets and quantiles.
+ */
+struct cmt_msgpack_view_series {
+    uint64_t timestamp;
+    int      has_start_timestamp;
+    uint64_t start_timestamp;
+
+    int      value_type;
+    double   value;
+    int64_t  int64_value;
+    uint64_t uint64_value;
+
+    uint64_t count;
+    double   sum;
+
+    uint64_t hash;
+
+    size_t   label_count;
+    size_t   labels_offset;
+};
+
+struct cmt_msgpack_view_label_iterator {
+    struct cmt_msgpack_view *view;
+    size_t                   offset;
+    size_t                   remaining;
+    int                      error;
+};
+
+/*
+ * Index the context found at 'offset', on success 'offset' is moved past it
+ * the same way cmt_decode_msgpack_create() does.
+ */
+int cmt_msgpack_view_create(struct cmt_msgpack_view **out_view,
+                            char *in_buf, size_t in_size, size_t *offset);
+void cmt_msgpack_view_destroy(struct cmt_msgpack_view *view);
+
+struct cmt_msgpack_view_family *cmt_msgpack_view_family_get(struct cmt_msgpack_view *view,
+                                                            size_t index);
+
+/* Read the series 'index' of 'family' */
+int cmt_msgpack_view_series_get(struct cmt_msgpack_view *view,
+                                struct cmt_msgpack_view_family *family,
+                                size_t index,
+                                struct cmt_msgpack_view_series *series);
+
+/* Iterate over the label keys of a family or the label values of a series */
+void cmt_msgpack_view_family_labels(struct cmt_msgpack_view *view,
+                                    struct cmt_msgpack_view_family *family,
+                                    struct cmt_msgpack_view_label_iterator *iterator);
+void cmt_msgpack_view_series_labels(struct cmt_msgpack_view *view,
+                                    struct cmt_msgpack_view_series *series,
+                                    struct cmt_msgpack_view_label_iterator *iterator);
+
+/*
+ * Returns CMT_TRUE when 'label' was set, CMT_FALSE once the labels are
+ * exhausted or when they cannot be read, in which case 'error' is set.
+ */
+int cmt_msgpack_view_label_next(struct cmt_msgpack_view_label_iterator *iterator,
+                                struct cmt_msgpack_view_string *label);
+
+#endif
@@ -0,0 +1,54 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_SNAPPY_H
+#define CMT_SNAPPY_H
+
+#include <stddef.h>
+
+#define CMT_SNAPPY_SUCCESS                 0
+#define CMT_SNAPPY_INVALID_ARGUMENT_ERROR  1
+#define CMT_SNAPPY_BUFFER_TOO_SMALL_ERROR  2
+#define CMT_SNAPPY_CORRUPTED_INPUT_ERROR   3
+
+/*
+ * Snappy block format (no framing), as used by the Prometheus remote write
+ * protocol. The uncompressed length is limited to 32 bits by the format.
+ */
+
+/* Worst case size of the compressed representation of 'length' bytes */
+size_t cmt_snappy_max_compressed_length(size_t length);
+
+/*
+ * Compress 'input' into 'output', which must be able to hold at least
+ * cmt_snappy_max_compressed_length(input_length) bytes.
+ */
+int cmt_snappy_compress(const char *input, size_t input_length,
+                        char *output, size_t output_capacity,
+                        size_t *output_length);
+
+/* Read the uncompressed length stored in the preamble of a compressed block */
+int cmt_snappy_uncompressed_length(const char *input, size_t input_length,
+                                   size_t *result);
+
+int cmt_snappy_uncompress(const char *input, size_t input_length,
+                          char *output, size_t output_capacity,
+                          size_t *output_length);
+
+#endif
@@ -26,6 +26,7 @@
 #include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_summary.h>
+#include <cmetrics/cmt_hll.h>
 #include <cmetrics/cmt_atomic.h>
 
 int cmt_cat_copy_label_keys(struct cmt_map *map, char **out)
@@ -197,6 +198,43 @@ static inline int cat_summary_values(struct cmt_metric *metric_dst, struct cmt_s
     return 0;
 }
 
+static inline int exp_histogram_values_unset(struct cmt_metric *metric)
+{
+    return metric->exp_hist_positive_buckets == NULL &&
+           metric->exp_hist_negative_buckets == NULL &&
+           metric->exp_hist_positive_count == 0 &&
+           metric->exp_hist_negative_count == 0 &&
+           cmt_atomic_load(&metric->exp_hist_count) == 0 &&
+           metric->exp_hist_zero_count == 0 &&
+           cmt_atomic_load(&metric->exp_hist_sum) == 0 &&
+           metric->exp_hist_scale == 0 &&
+           metric->exp_hist_positive_offset == 0 &&
+           metric->exp_hist_negative_offset == 0 &&
+           metric->exp_hist_zero_threshold == 0.0;
+}
+
+/* series that cat_exp_histogram_values() can merge without failing */
+static int exp_histogram_values_compatible(struct cmt_metric *metric_dst,
+                                           struct cmt_metric *metric_src)
+{
+    int ret;
+
+    cmt_metric_exp_hist_lock(metric_dst);
+
+    if (exp_histogram_values_unset(metric_dst)) {
+        ret = CMT_TRUE;
+    }
+    else {
+        ret = metric_dst->exp_hist_scale == metric_src->exp_hist_scale &&
+              metric_dst->exp_hist_zero_threshold ==
+              metric_src->exp_hist_zero_threshold;
+    }
+
+    cmt_metric_exp_hist_unlock(metric_dst);
+
+    return ret;
+}
+
 static inline int cat_exp_histogram_values(struct cmt_metric *metric_dst,
                                            struct cmt_metric *metric_src)
 {
@@ -251,17 +289,7 @@ static inline int cat_exp_histogram_values(struct cmt_metric *metric_dst,
         goto cleanup;
     }
 
-    if (metric_dst->exp_hist_positive_buckets == NULL &&
-        metric_dst->exp_hist_negative_buckets == NULL &&
-        metric_dst->exp_hist_positive_count == 0 &&
-        metric_dst->exp_hist_negative_count == 0 &&
-        cmt_atomic_load(&metric_dst->exp_hist_count) == 0 &&
-        metric_dst->exp_hist_zero_count == 0 &&
-        cmt_atomic_load(&metric_dst->exp_hist_sum) == 0 &&
-        metric_dst->exp_hist_scale == 0 &&
-        metric_dst->exp_hist_positive_offset == 0 &&
-        metric_dst->exp_hist_negative_offset == 0 &&
-        metric_dst->exp_hist_zero_threshold == 0.0) {
+    if (exp_histogram_values_unset(metric_dst)) {
         if (metric_src->exp_hist_positive_count > 0) {
             metric_dst->exp_hist_positive_buckets = calloc(metric_src->exp_hist_positive_count,
                                                            sizeof(uint64_t));
@@ -470,6 +498,69 @@ static inline void cat_scalar_value(struct cmt_metric *metric_dst,
     }
 }
 
+/*
+ * Set sketches are merged instead of overwritten, the value is the estimate
+ * of the union.
+ */
+static inline int cat_hll_values(struct cmt_metric *metric_dst,
+                                 struct cmt_metric *metric_src)
+{
+    if (metric_dst->hll == NULL) {
+        metric_dst->hll = cmt_hll_clone(metric_src->hll);
+        if (metric_dst->hll == NULL) {
+            return -1;
+        }
+    }
+    else {
+        cmt_hll_merge(metric_dst->hll, metric_src->hll);
+    }
+
+    cmt_metric_set_double(metric_dst, cmt_metric_get_timestamp(metric_src),
+                          cmt_hll_estimate(metric_dst->hll));
+
+    return 0;
+}
+
+static int cat_metric_values(struct cmt_map *dst, struct cmt_map *src,
+                             struct cmt_metric *metric_dst,
+                             struct cmt_metric *metric_src)
+{
+    int ret;
+    struct cmt_summary *summary;
+    struct cmt_histogram *histogram_src;
+    struct cmt_histogram *histogram_dst;
+
+    if (src->type == CMT_HISTOGRAM) {
+        histogram_src = (struct cmt_histogram *) src->parent;
+        histogram_dst = (struct cmt_histogram *) dst->parent;
+        ret = cat_histogram_values(metric_dst, histogram_src, metric_src, histogram_dst);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+    else if (src->type == CMT_SUMMARY) {
+        summary = (struct cmt_summary *) src->parent;
+        ret = cat_summary_values(metric_dst, summary, metric_src);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+    else if (src->type == CMT_EXP_HISTOGRAM) {
+        ret = cat_exp_histogram_values(metric_dst, metric_src);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    cat_scalar_value(metric_dst, metric_src);
+
+    if (metric_src->hll != NULL) {
+        return cat_hll_values(metric_dst, metric_src);
+    }
+
+    return 0;
+}
+
 int cmt_cat_copy_map(struct cmt_opts *opts, struct cmt_map *dst, struct cmt_map *src)
 {
     int c;
@@ -478,9 +569,6 @@ int cmt_cat_copy_map(struct cmt_opts *opts, struct cmt_map *dst, struct cmt_map
     struct cfl_list *head;
     struct cmt_metric *metric_dst;
     struct cmt_metric *metric_src;
-    struct cmt_summary *summary;
-    struct cmt_histogram *histogram_src;
-    struct cmt_histogram *histogram_dst;
 
     /* Handle static metric (no labels case) */
     if (src->metric_static_set) {
@@ -490,29 +578,10 @@ int cmt_cat_copy_map(struct cmt_opts *opts, struct cmt_map *dst, struct cmt_map
         metric_dst = &dst->metric;
         metric_src = &src->metric;
 
-        if (src->type == CMT_HISTOGRAM) {
-            histogram_src = (struct cmt_histogram *) src->parent;
-            histogram_dst = (struct cmt_histogram *) dst->parent;
-            ret = cat_histogram_values(metric_dst, histogram_src, metric_src, histogram_dst);
-            if (ret == -1) {
-                return -1;
-            }
-        }
-        else if (src->type == CMT_SUMMARY) {
-            summary = (struct cmt_summary *) src->parent;
-            ret = cat_summary_values(metric_dst, summary, metric_src);
-            if (ret == -1) {
-                return -1;
-            }
-        }
-        else if (src->type == CMT_EXP_HISTOGRAM) {
-            ret = cat_exp_histogram_values(metric_dst, metric_src);
-            if (ret == -1) {
-                return -1;
-            }
+        ret = cat_metric_values(dst, src, metric_dst, metric_src);
+        if (ret == -1) {
+            return -1;
         }
-
-        cat_scalar_value(metric_dst, metric_src);
     }
 
     /* Process map dynamic metrics */
@@ -532,33 +601,65 @@ int cmt_cat_copy_map(struct cmt_opts *opts, struct cmt_map *dst, struct cmt_map
             return -1;
         }
 
-        if (src->type == CMT_HISTOGRAM) {
-            histogram_src = (struct cmt_histogram *) src->parent;
-            histogram_dst = (struct cmt_histogram *) dst->parent;
-            ret = cat_histogram_values(metric_dst, histogram_src, metric_src, histogram_dst);
-            if (ret == -1) {
-                return -1;
-            }
+        ret = cat_metric_values(dst, src, metric_dst, metric_src);
+        if (ret == -1) {
+            return -1;
         }
-        else if (src->type == CMT_SUMMARY) {
-            summary = (struct cmt_summary *) src->parent;
-            ret = cat_summary_values(metric_dst, summary, metric_src);
-            if (ret == -1) {
-                return -1;
-            }
+    }
+
+    return 0;
+
+}
+
+/*
+ * Same as cmt_cat_copy_map() but series missing from 'dst' are moved out of
+ * 'src' instead of being copied.
+ */
+static int move_map(struct cmt_opts *opts, struct cmt_map *dst, struct cmt_map *src)
+{
+    int c;
+    int ret;
+    char **labels = NULL;
+    struct cfl_list *tmp;
+    struct cfl_list *head;
+    struct cmt_metric *metric_dst;
+    struct cmt_metric *metric_src;
+
+    if (src->metric_static_set) {
+        dst->metric_static_set = CMT_TRUE;
+
+        ret = cat_metric_values(dst, src, &dst->metric, &src->metric);
+        if (ret == -1) {
+            return -1;
         }
-        else if (src->type == CMT_EXP_HISTOGRAM) {
-            ret = cat_exp_histogram_values(metric_dst, metric_src);
-            if (ret == -1) {
-                return -1;
-            }
+    }
+
+    cfl_list_foreach_safe(head, tmp, &src->metrics) {
+        metric_src = cfl_list_entry(head, struct cmt_metric, _head);
+
+        c = copy_label_values(metric_src, (char **) &labels);
+        if (c == -1) {
+            return -1;
         }
 
-        cat_scalar_value(metric_dst, metric_src);
+        metric_dst = cmt_map_metric_move(opts, dst, c, labels, metric_src);
+        free(labels);
+
+        if (!metric_dst) {
+            return -1;
+        }
+
+        if (metric_dst == metric_src) {
+            continue;
+        }
+
+        ret = cat_metric_values(dst, src, metric_dst, metric_src);
+        if (ret == -1) {
+            return -1;
+        }
     }
 
     return 0;
-
 }
 
 static inline int cmt_opts_compare(struct cmt_opts *a, struct cmt_opts *b)
@@ -583,123 +684,190 @@ static inline int cmt_opts_compare(struct cmt_opts *a, struct cmt_opts *b)
     return strcmp(a->description, b->description);
 }
 
-static struct cmt_counter *counter_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static int label_keys_match(struct cmt_map *left, struct cmt_map *right)
+{
+    struct cfl_list *left_head;
+    struct cfl_list *right_head;
+    struct cmt_map_label *left_label;
+    struct cmt_map_label *right_label;
+
+    left_head = left->label_keys.next;
+    right_head = right->label_keys.next;
+
+    while (left_head != &left->label_keys &&
+           right_head != &right->label_keys) {
+        left_label = cfl_list_entry(left_head, struct cmt_map_label, _head);
+        right_label = cfl_list_entry(right_head, struct cmt_map_label, _head);
+
+        if (left_label->name == NULL || right_label->name == NULL ||
+            strcmp(left_label->name, right_label->name) != 0) {
+            return CMT_FALSE;
+        }
+
+        left_head = left_head->next;
+        right_head = right_head->next;
+    }
+
+    return left_head == &left->label_keys &&
+           right_head == &right->label_keys;
+}
+
+/*
+ * Family lookups: when 'keys' is set only families with the same label keys
+ * match, otherwise the options alone identify the family.
+ */
+static struct cmt_counter *counter_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                          struct cmt_map *keys)
 {
     struct cmt_counter *counter;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->counters) {
         counter = cfl_list_entry(head, struct cmt_counter, _head);
-        if (cmt_opts_compare(&counter->opts, opts) == 0) {
-            return counter;
+        if (cmt_opts_compare(&counter->opts, opts) != 0) {
+            continue;
+        }
+
+        if (keys != NULL && !label_keys_match(counter->map, keys)) {
+            continue;
         }
+
+        return counter;
     }
 
     return NULL;
 }
 
-static struct cmt_gauge *gauge_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static struct cmt_gauge *gauge_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                      struct cmt_map *keys)
 {
     struct cmt_gauge *gauge;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->gauges) {
         gauge = cfl_list_entry(head, struct cmt_gauge, _head);
-        if (cmt_opts_compare(&gauge->opts, opts) == 0) {
-            return gauge;
+        if (cmt_opts_compare(&gauge->opts, opts) != 0) {
+            continue;
         }
+
+        if (keys != NULL && !label_keys_match(gauge->map, keys)) {
+            continue;
+        }
+
+        return gauge;
     }
 
     return NULL;
 }
 
-static struct cmt_untyped *untyped_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static struct cmt_untyped *untyped_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                          struct cmt_map *keys)
 {
     struct cmt_untyped *untyped;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->untypeds) {
         untyped = cfl_list_entry(head, struct cmt_untyped, _head);
-        if (cmt_opts_compare(&untyped->opts, opts) == 0) {
-            return untyped;
+        if (cmt_opts_compare(&untyped->opts, opts) != 0) {
+            continue;
         }
+
+        if (keys != NULL && !label_keys_match(untyped->map, keys)) {
+            continue;
+        }
+
+        return untyped;
     }
 
     return NULL;
 }
 
-static struct cmt_histogram *histogram_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static struct cmt_histogram *histogram_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                              struct cmt_map *keys)
 {
     struct cmt_histogram *histogram;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->histograms) {
         histogram = cfl_list_entry(head, struct cmt_histogram, _head);
-        if (cmt_opts_compare(&histogram->opts, opts) == 0) {
-            return histogram;
+        if (cmt_opts_compare(&histogram->opts, opts) != 0) {
+            continue;
         }
+
+        if (keys != NULL && !label_keys_match(histogram->map, keys)) {
+            continue;
+        }
+
+        return histogram;
     }
 
     return NULL;
 }
 
-static struct cmt_exp_histogram *exp_histogram_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static struct cmt_exp_histogram *exp_histogram_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                                      struct cmt_map *keys)
 {
     struct cmt_exp_histogram *exp_histogram;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->exp_histograms) {
         exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
-        if (cmt_opts_compare(&exp_histogram->opts, opts) == 0) {
-            return exp_histogram;
+        if (cmt_opts_compare(&exp_histogram->opts, opts) != 0) {
+            continue;
         }
+
+        if (keys != NULL && !label_keys_match(exp_histogram->map, keys)) {
+            continue;
+        }
+
+        return exp_histogram;
     }
 
     return NULL;
 }
 
-static struct cmt_summary *summary_lookup(struct cmt *cmt, struct cmt_opts *opts)
+static struct cmt_summary *summary_lookup(struct cmt *cmt, struct cmt_opts *opts,
+                                          struct cmt_map *keys)
 {
     struct cmt_summary *summary;
     struct cfl_list *head;
 
     cfl_list_foreach(head, &cmt->summaries) {
         summary = cfl_list_entry(head, struct cmt_summary, _head);
-        if (cmt_opts_compare(&summary->opts, opts) == 0) {
-            return summary;
+        if (cmt_opts_compare(&summary->opts, opts) != 0) {
+            continue;
         }
+
+        if (keys != NULL && !label_keys_match(summary->map, keys)) {
+            continue;
+        }
+
+        return summary;
     }
 
     return NULL;
 }
 
-static int summary_label_keys_match(struct cmt_map *left,
-                                    struct cmt_map *right)
+static int summary_compatible(struct cmt_summary *left,
+                              struct cmt_summary *right)
 {
-    struct cfl_list *left_head;
-    struct cfl_list *right_head;
-    struct cmt_map_label *left_label;
-    struct cmt_map_label *right_label;
+    size_t i;
 
-    left_head = left->label_keys.next;
-    right_head = right->label_keys.next;
+    if (!label_keys_match(left->map, right->map)) {
+        return CMT_FALSE;
+    }
 
-    while (left_head != &left->label_keys &&
-           right_head != &right->label_keys) {
-        left_label = cfl_list_entry(left_head, struct cmt_map_label, _head);
-        right_label = cfl_list_entry(right_head, struct cmt_map_label, _head);
+    if (left->quantiles_count != right->quantiles_count) {
+        return CMT_FALSE;
+    }
 
-        if (left_label->name == NULL || right_label->name == NULL ||
-            strcmp(left_label->name, right_label->name) != 0) {
+    for (i = 0; i < right->quantiles_count; i++) {
+        if (left->quantiles[i] != right->quantiles[i]) {
             return CMT_FALSE;
         }
-
-        left_head = left_head->next;
-        right_head = right_head->next;
     }
 
-    return left_head == &left->label_keys &&
-           right_head == &right->label_keys;
+    return CMT_TRUE;
 }
 
 int cmt_cat_counter(struct cmt *cmt, struct cmt_counter *counter,
@@ -719,7 +887,7 @@ int cmt_cat_counter(struct cmt *cmt, struct cmt_counter *counter,
         return -1;
     }
 
-    c = counter_lookup(cmt, opts);
+    c = counter_lookup(cmt, opts, NULL);
     if (!c) {
         /* create counter */
         c = cmt_counter_create(cmt,
@@ -766,7 +934,7 @@ int cmt_cat_gauge(struct cmt *cmt, struct cmt_gauge *gauge,
         return -1;
     }
 
-    g = gauge_lookup(cmt, opts);
+    g = gauge_lookup(cmt, opts, NULL);
     if (!g) {
         /* create counter */
         g = cmt_gauge_create(cmt,
@@ -813,7 +981,7 @@ int cmt_cat_untyped(struct cmt *cmt, struct cmt_untyped *untyped,
         return -1;
     }
 
-    u = untyped_lookup(cmt, opts);
+    u = untyped_lookup(cmt, opts, NULL);
     if (!u) {
         /* create counter */
         u = cmt_untyped_create(cmt,
@@ -862,7 +1030,7 @@ int cmt_cat_histogram(struct cmt *cmt, struct cmt_histogram *histogram,
         return -1;
     }
 
-    hist = histogram_lookup(cmt, opts);
+    hist = histogram_lookup(cmt, opts, NULL);
     if (!hist) {
         buckets_count = histogram->buckets->count;
         buckets = cmt_histogram_buckets_create_size(histogram->buckets->upper_bounds,
@@ -874,6 +1042,10 @@ int cmt_cat_histogram(struct cmt *cmt, struct cmt_histogram *histogram,
                                     opts->name, opts->description,
                                     buckets,
                                     map->label_count, labels);
+
+        if (!hist) {
+            cmt_histogram_buckets_destroy(buckets);
+        }
     }
     free(labels);
 
@@ -900,7 +1072,6 @@ int cmt_cat_histogram(struct cmt *cmt, struct cmt_histogram *histogram,
 int cmt_cat_summary(struct cmt *cmt, struct cmt_summary *summary,
                     struct cmt_map *filtered_map)
 {
-    size_t i;
     int ret;
     char **labels = NULL;
     struct cmt_map *map;
@@ -915,24 +1086,12 @@ int cmt_cat_summary(struct cmt *cmt, struct cmt_summary *summary,
         return -1;
     }
 
-    sum = summary_lookup(cmt, opts);
+    sum = summary_lookup(cmt, opts, NULL);
     if (sum != NULL) {
-        if (!summary_label_keys_match(sum->map, map)) {
+        if (!summary_compatible(sum, summary)) {
             free(labels);
             return -1;
         }
-
-        if (sum->quantiles_count != summary->quantiles_count) {
-            free(labels);
-            return -1;
-        }
-
-        for (i = 0; i < summary->quantiles_count; i++) {
-            if (sum->quantiles[i] != summary->quantiles[i]) {
-                free(labels);
-                return -1;
-            }
-        }
     }
     else {
         quantiles = NULL;
@@ -993,7 +1152,7 @@ int cmt_cat_exp_histogram(struct cmt *cmt, struct cmt_exp_histogram *exp_histogr
         return -1;
     }
 
-    eh = exp_histogram_lookup(cmt, opts);
+    eh = exp_histogram_lookup(cmt, opts, NULL);
     if (!eh) {
         eh = cmt_exp_histogram_create(cmt,
                                       opts->ns, opts->subsystem,
@@ -1102,3 +1261,245 @@ int cmt_cat(struct cmt *dst, struct cmt *src)
 
     return append_context(dst, src);
 }
+
+static int exp_histogram_move_compatible(struct cmt_exp_histogram *dst,
+                                        struct cmt_exp_histogram *src)
+{
+    int c;
+    char **labels = NULL;
+    struct cfl_list *head;
+    struct cmt_metric *metric_dst;
+    struct cmt_metric *metric_src;
+
+    if (src->map->metric_static_set && dst->map->metric_static_set &&
+        !exp_histogram_values_compatible(&dst->map->metric, &src->map->metric)) {
+        return CMT_FALSE;
+    }
+
+    cfl_list_foreach(head, &src->map->metrics) {
+        metric_src = cfl_list_entry(head, struct cmt_metric, _head);
+
+        c = copy_label_values(metric_src, (char **) &labels);
+        if (c == -1) {
+            return CMT_FALSE;
+        }
+
+        metric_dst = cmt_map_metric_get(&dst->opts, dst->map, c, labels,
+                                        CMT_FALSE);
+        free(labels);
+
+        if (metric_dst != NULL &&
+            !exp_histogram_values_compatible(metric_dst, metric_src)) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+/*
+ * Reject the move before anything is touched when a family cannot be merged
+ * into its destination, so a failed cmt_cat_move() leaves both contexts as
+ * they were.
+ */
+static int move_context_check(struct cmt *dst, struct cmt *src)
+{
+    struct cfl_list *head;
+    struct cmt_histogram *histogram;
+    struct cmt_histogram *hist;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_exp_histogram *eh;
+    struct cmt_summary *summary;
+    struct cmt_summary *sum;
+
+    /* moved series keep their buckets, the layouts must match */
+    cfl_list_foreach(head, &src->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+
+        hist = histogram_lookup(dst, &histogram->opts, histogram->map);
+        if (hist && hist->buckets->count != histogram->buckets->count) {
+            return -1;
+        }
+    }
+
+    cfl_list_foreach(head, &src->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+
+        eh = exp_histogram_lookup(dst, &exp_histogram->opts, exp_histogram->map);
+        if (eh && !exp_histogram_move_compatible(eh, exp_histogram)) {
+            return -1;
+        }
+    }
+
+    cfl_list_foreach(head, &src->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+
+        sum = summary_lookup(dst, &summary->opts, summary->map);
+        if (sum && !summary_compatible(sum, summary)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int move_context(struct cmt *dst, struct cmt *src)
+{
+    int ret;
+    struct cfl_list *tmp;
+    struct cfl_list *head;
+    struct cmt_counter *counter;
+    struct cmt_counter *c;
+    struct cmt_gauge *gauge;
+    struct cmt_gauge *g;
+    struct cmt_untyped *untyped;
+    struct cmt_untyped *u;
+    struct cmt_histogram *histogram;
+    struct cmt_histogram *hist;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_exp_histogram *eh;
+    struct cmt_summary *summary;
+    struct cmt_summary *sum;
+
+    /*
+     * Families missing from the destination (same options and label keys)
+     * are moved as a whole, the others get their series merged. Decoders fill
+     * the series lists directly, so moved families are reindexed to keep the
+     * destination lookups exact.
+     */
+    ret = move_context_check(dst, src);
+    if (ret == -1) {
+        return -1;
+    }
+
+    /* Counters */
+    cfl_list_foreach_safe(head, tmp, &src->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+
+        c = counter_lookup(dst, &counter->opts, counter->map);
+        if (!c) {
+            cfl_list_del(&counter->_head);
+            cfl_list_add(&counter->_head, &dst->counters);
+            counter->cmt = dst;
+            cmt_map_reindex(counter->map);
+            continue;
+        }
+
+        ret = move_map(&c->opts, c->map, counter->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    /* Gauges */
+    cfl_list_foreach_safe(head, tmp, &src->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+
+        g = gauge_lookup(dst, &gauge->opts, gauge->map);
+        if (!g) {
+            cfl_list_del(&gauge->_head);
+            cfl_list_add(&gauge->_head, &dst->gauges);
+            gauge->cmt = dst;
+            cmt_map_reindex(gauge->map);
+            continue;
+        }
+
+        ret = move_map(&g->opts, g->map, gauge->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    /* Untyped */
+    cfl_list_foreach_safe(head, tmp, &src->untypeds) {
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+
+        u = untyped_lookup(dst, &untyped->opts, untyped->map);
+        if (!u) {
+            cfl_list_del(&untyped->_head);
+            cfl_list_add(&untyped->_head, &dst->untypeds);
+            untyped->cmt = dst;
+            cmt_map_reindex(untyped->map);
+            continue;
+        }
+
+        ret = move_map(&u->opts, u->map, untyped->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    /* Histogram */
+    cfl_list_foreach_safe(head, tmp, &src->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+
+        hist = histogram_lookup(dst, &histogram->opts, histogram->map);
+        if (!hist) {
+            cfl_list_del(&histogram->_head);
+            cfl_list_add(&histogram->_head, &dst->histograms);
+            histogram->cmt = dst;
+            cmt_map_reindex(histogram->map);
+            continue;
+        }
+
+        ret = move_map(&hist->opts, hist->map, histogram->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    /* Exponential Histogram */
+    cfl_list_foreach_safe(head, tmp, &src->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+
+        eh = exp_histogram_lookup(dst, &exp_histogram->opts, exp_histogram->map);
+        if (!eh) {
+            cfl_list_del(&exp_histogram->_head);
+            cfl_list_add(&exp_histogram->_head, &dst->exp_histograms);
+            exp_histogram->cmt = dst;
+            cmt_map_reindex(exp_histogram->map);
+            continue;
+        }
+
+        eh->aggregation_type = exp_histogram->aggregation_type;
+
+        ret = move_map(&eh->opts, eh->map, exp_histogram->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    /* Summary */
+    cfl_list_foreach_safe(head, tmp, &src->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+
+        sum = summary_lookup(dst, &summary->opts, summary->map);
+        if (!sum) {
+            cfl_list_del(&summary->_head);
+            cfl_list_add(&summary->_head, &dst->summaries);
+            summary->cmt = dst;
+            cmt_map_reindex(summary->map);
+            continue;
+        }
+
+        ret = move_map(&sum->opts, sum->map, summary->map);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int cmt_cat_move(struct cmt *dst, struct cmt *src)
+{
+    if (!dst) {
+        return -1;
+    }
+
+    if (!src) {
+        return -1;
+    }
+
+    return move_context(dst, src);
+}
@@ -0,0 +1,854 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_math.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_cat.h>
+#include <cmetrics/cmt_decode_graphite.h>
+
+#include <math.h>
+
+/*
+ * Graphite plaintext protocol
+ * ---------------------------
+ * https://graphite.readthedocs.io/en/latest/feeding-carbon.html
+ * https://graphite.readthedocs.io/en/latest/tags.html
+ */
+
+#define GRAPHITE_TABLE_INITIAL_SIZE    64
+#define GRAPHITE_TABLE_LOAD_NUMERATOR   3
+#define GRAPHITE_TABLE_LOAD_DENOMINATOR 4
+
+/* latest timestamp in seconds that fits in nanoseconds */
+#define GRAPHITE_MAX_SECONDS   (UINT64_MAX / 1000000000)
+
+struct graphite_tag {
+    char *key;
+    char *value;
+};
+
+/*
+ * A family is identified by its name and sorted tag keys, its type is
+ * resolved through the rules once when it is created.
+ */
+struct graphite_family {
+    uint64_t         hash;
+    char            *name;
+    size_t           label_count;
+    char           **keys;
+    struct cmt_map  *map;
+
+    struct cfl_list  _head;
+};
+
+struct graphite_slot {
+    uint64_t                hash;
+    struct graphite_family *family;
+};
+
+struct cmt_decode_graphite_stream {
+    struct cmt                      *cmt;
+    int                              status;
+    int                              finished;
+    uint64_t                         now;
+    struct cmt_decode_graphite_rule *rules;
+    size_t                           rule_count;
+
+    struct graphite_slot            *slots;
+    size_t                           slot_count;
+    size_t                           family_count;
+    struct cfl_list                  families;
+
+    /* NUL terminated name, tag keys and values of the current path */
+    char                            *scratch;
+    size_t                           scratch_size;
+    struct graphite_tag              tags[CMT_DECODE_GRAPHITE_MAX_TAGS];
+    char                            *values[CMT_DECODE_GRAPHITE_MAX_TAGS];
+    size_t                           tag_count;
+
+    /* incomplete line at the end of the previous chunks */
+    char                            *buffer;
+    size_t                           buffer_length;
+    size_t                           buffer_size;
+};
+
+static int pattern_matches(char *pattern, char *string)
+{
+    size_t pattern_length;
+    size_t string_length;
+
+    if (pattern == NULL) {
+        return CMT_TRUE;
+    }
+
+    pattern_length = strlen(pattern);
+
+    if (pattern_length > 0 && pattern[pattern_length - 1] == '*') {
+        return strncmp(pattern, string, pattern_length - 1) == 0;
+    }
+
+    if (pattern_length > 0 && pattern[0] == '*') {
+        string_length = strlen(string);
+
+        return string_length >= pattern_length - 1 &&
+               strcmp(&string[string_length - (pattern_length - 1)],
+                      &pattern[1]) == 0;
+    }
+
+    return strcmp(pattern, string) == 0;
+}
+
+static int family_type(struct cmt_decode_graphite_stream *stream, char *name)
+{
+    size_t index;
+
+    for (index = 0 ; index < stream->rule_count ; index++) {
+        if (pattern_matches(stream->rules[index].name, name)) {
+            return stream->rules[index].type;
+        }
+    }
+
+    return CMT_GAUGE;
+}
+
+static int table_grow(struct cmt_decode_graphite_stream *stream)
+{
+    size_t                index;
+    size_t                position;
+    size_t                slot_count;
+    struct graphite_slot *slots;
+
+    slot_count = stream->slot_count * 2;
+    slots = calloc(slot_count, sizeof(struct graphite_slot));
+
+    if (slots == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < stream->slot_count ; index++) {
+        if (stream->slots[index].family == NULL) {
+            continue;
+        }
+
+        position = stream->slots[index].hash & (slot_count - 1);
+
+        while (slots[position].family != NULL) {
+            position = (position + 1) & (slot_count - 1);
+        }
+
+        slots[position] = stream->slots[index];
+    }
+
+    free(stream->slots);
+
+    stream->slots = slots;
+    stream->slot_count = slot_count;
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+static uint64_t family_hash(char *name, struct graphite_tag *tags,
+                            size_t tag_count)
+{
+    size_t           index;
+    cfl_hash_state_t state;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, name, strlen(name) + 1);
+
+    for (index = 0 ; index < tag_count ; index++) {
+        cfl_hash_64bits_update(&state, tags[index].key,
+                               strlen(tags[index].key) + 1);
+    }
+
+    return cfl_hash_64bits_digest(&state);
+}
+
+static int family_matches(struct graphite_family *family, char *name,
+                          struct graphite_tag *tags, size_t tag_count)
+{
+    size_t index;
+
+    if (family->label_count != tag_count ||
+        strcmp(family->name, name) != 0) {
+        return CMT_FALSE;
+    }
+
+    for (index = 0 ; index < tag_count ; index++) {
+        if (strcmp(family->keys[index], tags[index].key) != 0) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+static struct graphite_family *family_create(struct cmt_decode_graphite_stream *stream,
+                                             uint64_t hash, char *name,
+                                             struct graphite_tag *tags,
+                                             size_t tag_count)
+{
+    char                   *buffer;
+    size_t                  index;
+    size_t                  size;
+    size_t                  length;
+    struct cmt_counter     *counter;
+    struct cmt_gauge       *gauge;
+    struct graphite_family *family;
+
+    size = sizeof(struct graphite_family) + tag_count * sizeof(char *) +
+           strlen(name) + 1;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        size += strlen(tags[index].key) + 1;
+    }
+
+    family = calloc(1, size);
+
+    if (family == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    family->hash = hash;
+    family->label_count = tag_count;
+    family->keys = (char **) (family + 1);
+
+    buffer = (char *) (family->keys + tag_count);
+
+    length = strlen(name) + 1;
+    family->name = memcpy(buffer, name, length);
+    buffer += length;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        length = strlen(tags[index].key) + 1;
+        family->keys[index] = memcpy(buffer, tags[index].key, length);
+        buffer += length;
+    }
+
+    cfl_list_add(&family->_head, &stream->families);
+
+    if (family_type(stream, name) == CMT_COUNTER) {
+        counter = cmt_counter_create(stream->cmt, "", "", family->name, "-",
+                                     tag_count, family->keys);
+
+        if (counter != NULL) {
+            family->map = counter->map;
+        }
+    }
+    else {
+        gauge = cmt_gauge_create(stream->cmt, "", "", family->name, "-",
+                                 tag_count, family->keys);
+
+        if (gauge != NULL) {
+            family->map = gauge->map;
+        }
+    }
+
+    if (family->map == NULL) {
+        return NULL;
+    }
+
+    return family;
+}
+
+static struct graphite_family *family_lookup(struct cmt_decode_graphite_stream *stream,
+                                             char *name,
+                                             struct graphite_tag *tags,
+                                             size_t tag_count)
+{
+    size_t                  position;
+    uint64_t                hash;
+    struct graphite_slot   *slot;
+    struct graphite_family *family;
+
+    hash = family_hash(name, tags, tag_count);
+    position = hash & (stream->slot_count - 1);
+
+    while (stream->slots[position].family != NULL) {
+        slot = &stream->slots[position];
+
+        if (slot->hash == hash &&
+            family_matches(slot->family, name, tags, tag_count)) {
+            return slot->family;
+        }
+
+        position = (position + 1) & (stream->slot_count - 1);
+    }
+
+    family = family_create(stream, hash, name, tags, tag_count);
+
+    if (family == NULL) {
+        return NULL;
+    }
+
+    stream->slots[position].hash = hash;
+    stream->slots[position].family = family;
+    stream->family_count++;
+
+    if (stream->family_count * GRAPHITE_TABLE_LOAD_DENOMINATOR >=
+        stream->slot_count * GRAPHITE_TABLE_LOAD_NUMERATOR &&
+        table_grow(stream) != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return NULL;
+    }
+
+    return family;
+}
+
+/* Sort the tags by key, a repeated key keeps its last value */
+static void tags_sort(struct cmt_decode_graphite_stream *stream)
+{
+    size_t              index;
+    size_t              position;
+    size_t              count;
+    struct graphite_tag tag;
+
+    for (index = 1 ; index < stream->tag_count ; index++) {
+        tag = stream->tags[index];
+
+        for (position = index ;
+             position > 0 &&
+             strcmp(stream->tags[position - 1].key, tag.key) > 0 ;
+             position--) {
+            stream->tags[position] = stream->tags[position - 1];
+        }
+
+        stream->tags[position] = tag;
+    }
+
+    count = 0;
+
+    for (index = 0 ; index < stream->tag_count ; index++) {
+        if (count > 0 &&
+            strcmp(stream->tags[count - 1].key, stream->tags[index].key) == 0) {
+            count--;
+        }
+
+        stream->tags[count++] = stream->tags[index];
+    }
+
+    stream->tag_count = count;
+
+    for (index = 0 ; index < count ; index++) {
+        stream->values[index] = stream->tags[index].value;
+    }
+}
+
+/* Split 'name;key=value;...' into the scratch buffer */
+static int path_parse(struct cmt_decode_graphite_stream *stream,
+                      const char *path, size_t length)
+{
+    char   *cursor;
+    char   *end;
+    char   *next;
+    char   *scratch;
+    struct graphite_tag *tag;
+
+    if (length + 1 > stream->scratch_size) {
+        scratch = realloc(stream->scratch, length + 1);
+
+        if (scratch == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+        }
+
+        stream->scratch = scratch;
+        stream->scratch_size = length + 1;
+    }
+
+    memcpy(stream->scratch, path, length);
+    stream->scratch[length] = '\0';
+
+    cursor = stream->scratch;
+    end = cursor + length;
+    stream->tag_count = 0;
+
+    next = memchr(cursor, ';', end - cursor);
+    if (next == cursor) {
+        return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+    }
+
+    while (next != NULL) {
+        *next = '\0';
+        cursor = next + 1;
+
+        if (stream->tag_count == CMT_DECODE_GRAPHITE_MAX_TAGS) {
+            return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+        }
+
+        tag = &stream->tags[stream->tag_count++];
+        tag->key = cursor;
+
+        next = memchr(cursor, ';', end - cursor);
+        if (next == NULL) {
+            next = end;
+        }
+
+        cursor = memchr(cursor, '=', next - cursor);
+        if (cursor == NULL || cursor == tag->key || cursor + 1 == next) {
+            return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+        }
+
+        *cursor = '\0';
+        tag->value = cursor + 1;
+
+        next = next == end ? NULL : next;
+    }
+
+    tags_sort(stream);
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+static int record(struct cmt_decode_graphite_stream *stream,
+                  const char *path, size_t length,
+                  double value, uint64_t timestamp)
+{
+    int                     result;
+    struct graphite_family *family;
+    struct cmt_metric      *metric;
+
+    if (length == 0) {
+        return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+    }
+
+    result = path_parse(stream, path, length);
+    if (result != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return result;
+    }
+
+    family = family_lookup(stream, stream->scratch, stream->tags,
+                           stream->tag_count);
+
+    if (family == NULL) {
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    metric = cmt_map_metric_get(family->map->opts, family->map,
+                                stream->tag_count, stream->values,
+                                CMT_TRUE);
+
+    if (metric == NULL) {
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    cmt_metric_set(metric, timestamp, value);
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+/* Seconds since the epoch, -1 stands for the decoding time */
+static int seconds_to_timestamp(struct cmt_decode_graphite_stream *stream,
+                                double seconds, uint64_t *timestamp)
+{
+    if (seconds == -1) {
+        *timestamp = stream->now;
+
+        return 0;
+    }
+
+    if (!(seconds >= 0 && seconds < (double) GRAPHITE_MAX_SECONDS)) {
+        return -1;
+    }
+
+    *timestamp = (uint64_t) (seconds * 1000000000.0);
+
+    return 0;
+}
+
+static int timestamp_parse(struct cmt_decode_graphite_stream *stream,
+                           const char *text, size_t length,
+                           uint64_t *timestamp)
+{
+    uint64_t seconds;
+    double   value;
+
+    if (length == 0) {
+        *timestamp = stream->now;
+
+        return 0;
+    }
+
+    if (cmt_math_parse_uint64(text, length, &seconds) == 0) {
+        if (seconds > GRAPHITE_MAX_SECONDS) {
+            return -1;
+        }
+
+        *timestamp = seconds * 1000000000;
+
+        return 0;
+    }
+
+    if (cmt_math_parse_double(text, length, &value) != 0) {
+        return -1;
+    }
+
+    return seconds_to_timestamp(stream, value, timestamp);
+}
+
+static const char *skip_blanks(const char *cursor, const char *end)
+{
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t')) {
+        cursor++;
+    }
+
+    return cursor;
+}
+
+static const char *find_blank(const char *cursor, const char *end)
+{
+    while (cursor < end && *cursor != ' ' && *cursor != '\t') {
+        cursor++;
+    }
+
+    return cursor;
+}
+
+static int process_line(struct cmt_decode_graphite_stream *stream,
+                        const char *line, size_t length)
+{
+    double      value;
+    uint64_t    timestamp;
+    const char *end;
+    const char *path;
+    const char *path_end;
+    const char *number;
+    const char *number_end;
+    const char *cursor;
+
+    end = line + length;
+
+    if (length > 0 && end[-1] == '\r') {
+        end--;
+    }
+
+    path = skip_blanks(line, end);
+    if (path == end) {
+        return CMT_DECODE_GRAPHITE_SUCCESS;
+    }
+
+    path_end = find_blank(path, end);
+
+    number = skip_blanks(path_end, end);
+    number_end = find_blank(number, end);
+
+    if (cmt_math_parse_double(number, number_end - number, &value) != 0) {
+        return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+    }
+
+    cursor = skip_blanks(number_end, end);
+    line = find_blank(cursor, end);
+
+    if (timestamp_parse(stream, cursor, line - cursor, &timestamp) != 0 ||
+        skip_blanks(line, end) != end) {
+        return CMT_DECODE_GRAPHITE_DECODE_ERROR;
+    }
+
+    return record(stream, path, path_end - path, value, timestamp);
+}
+
+/* Process the complete lines and return the start of the incomplete one */
+static const char *process_lines(struct cmt_decode_graphite_stream *stream,
+                                 const char *cursor, const char *end)
+{
+    const char *newline;
+
+    while (cursor < end) {
+        newline = memchr(cursor, '\n', end - cursor);
+        if (newline == NULL) {
+            break;
+        }
+
+        stream->status = process_line(stream, cursor, newline - cursor);
+        if (stream->status != CMT_DECODE_GRAPHITE_SUCCESS) {
+            break;
+        }
+
+        cursor = newline + 1;
+    }
+
+    return cursor;
+}
+
+static int buffer_append(struct cmt_decode_graphite_stream *stream,
+                         const char *data, size_t size)
+{
+    char   *buffer;
+    size_t  buffer_size;
+
+    if (stream->buffer_length + size > stream->buffer_size) {
+        buffer_size = stream->buffer_size > 0 ? stream->buffer_size : 256;
+
+        while (buffer_size < stream->buffer_length + size) {
+            buffer_size *= 2;
+        }
+
+        buffer = realloc(stream->buffer, buffer_size);
+        if (buffer == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+        }
+
+        stream->buffer = buffer;
+        stream->buffer_size = buffer_size;
+    }
+
+    memcpy(stream->buffer + stream->buffer_length, data, size);
+    stream->buffer_length += size;
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+int cmt_decode_graphite_stream_create(struct cmt_decode_graphite_stream **out_stream,
+                                      struct cmt_decode_graphite_opts *opts)
+{
+    size_t                             index;
+    struct cmt_decode_graphite_stream *stream;
+
+    if (out_stream == NULL) {
+        return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (opts != NULL) {
+        if (opts->rule_count > 0 && opts->rules == NULL) {
+            return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+        }
+
+        for (index = 0 ; index < opts->rule_count ; index++) {
+            if (opts->rules[index].type != CMT_COUNTER &&
+                opts->rules[index].type != CMT_GAUGE) {
+                return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+            }
+        }
+    }
+
+    stream = calloc(1, sizeof(struct cmt_decode_graphite_stream));
+    if (stream == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    cfl_list_init(&stream->families);
+
+    if (opts != NULL) {
+        stream->rules = opts->rules;
+        stream->rule_count = opts->rule_count;
+    }
+
+    stream->slots = calloc(GRAPHITE_TABLE_INITIAL_SIZE,
+                           sizeof(struct graphite_slot));
+    if (stream->slots == NULL) {
+        cmt_errno();
+        free(stream);
+
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    stream->slot_count = GRAPHITE_TABLE_INITIAL_SIZE;
+
+    stream->cmt = cmt_create();
+    if (stream->cmt == NULL) {
+        free(stream->slots);
+        free(stream);
+
+        return CMT_DECODE_GRAPHITE_ALLOCATION_ERROR;
+    }
+
+    stream->now = cfl_time_now();
+    *out_stream = stream;
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+int cmt_decode_graphite_stream_feed(struct cmt_decode_graphite_stream *stream,
+                                    const char *chunk, size_t size)
+{
+    const char *end;
+    const char *newline;
+
+    if (stream->finished) {
+        return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (stream->status != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return stream->status;
+    }
+
+    stream->now = cfl_time_now();
+    end = chunk + size;
+
+    /* complete the line carried over from the previous chunk */
+    if (stream->buffer_length > 0) {
+        newline = memchr(chunk, '\n', size);
+
+        if (newline == NULL) {
+            stream->status = buffer_append(stream, chunk, size);
+
+            return stream->status;
+        }
+
+        stream->status = buffer_append(stream, chunk, newline - chunk);
+        if (stream->status == CMT_DECODE_GRAPHITE_SUCCESS) {
+            stream->status = process_line(stream, stream->buffer,
+                                          stream->buffer_length);
+        }
+
+        if (stream->status != CMT_DECODE_GRAPHITE_SUCCESS) {
+            return stream->status;
+        }
+
+        stream->buffer_length = 0;
+        chunk = newline + 1;
+    }
+
+    chunk = process_lines(stream, chunk, end);
+
+    if (stream->status == CMT_DECODE_GRAPHITE_SUCCESS && chunk < end) {
+        stream->status = buffer_append(stream, chunk, end - chunk);
+    }
+
+    return stream->status;
+}
+
+int cmt_decode_graphite_stream_finish(struct cmt_decode_graphite_stream *stream,
+                                      struct cmt **out_cmt)
+{
+    if (stream->finished || out_cmt == NULL) {
+        return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (stream->status != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return stream->status;
+    }
+
+    if (stream->buffer_length > 0) {
+        stream->status = process_line(stream, stream->buffer,
+                                      stream->buffer_length);
+        stream->buffer_length = 0;
+
+        if (stream->status != CMT_DECODE_GRAPHITE_SUCCESS) {
+            return stream->status;
+        }
+    }
+
+    stream->finished = CMT_TRUE;
+
+    *out_cmt = stream->cmt;
+    stream->cmt = NULL;
+
+    return CMT_DECODE_GRAPHITE_SUCCESS;
+}
+
+void cmt_decode_graphite_stream_destroy(struct cmt_decode_graphite_stream *stream)
+{
+    struct cfl_list        *head;
+    struct cfl_list        *tmp;
+    struct graphite_family *family;
+
+    if (stream == NULL) {
+        return;
+    }
+
+    cfl_list_foreach_safe(head, tmp, &stream->families) {
+        family = cfl_list_entry(head, struct graphite_family, _head);
+        cfl_list_del(&family->_head);
+        free(family);
+    }
+
+    if (stream->cmt != NULL) {
+        cmt_destroy(stream->cmt);
+    }
+
+    free(stream->slots);
+    free(stream->scratch);
+    free(stream->buffer);
+    free(stream);
+}
+
+int cmt_decode_graphite_create(struct cmt **out_cmt, char *in_buf,
+                               size_t in_size,
+                               struct cmt_decode_graphite_opts *opts)
+{
+    int                                result;
+    char                              *end;
+    struct cmt_decode_graphite_stream *stream;
+
+    if (out_cmt == NULL || in_buf == NULL) {
+        return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    /* the payload might be NUL terminated */
+    end = memchr(in_buf, '\0', in_size);
+    if (end != NULL) {
+        in_size = end - in_buf;
+    }
+
+    result = cmt_decode_graphite_stream_create(&stream, opts);
+    if (result != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return result;
+    }
+
+    result = cmt_decode_graphite_stream_feed(stream, in_buf, in_size);
+    if (result == CMT_DECODE_GRAPHITE_SUCCESS) {
+        result = cmt_decode_graphite_stream_finish(stream, out_cmt);
+    }
+
+    cmt_decode_graphite_stream_destroy(stream);
+
+    return result;
+}
+
+int cmt_decode_graphite_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                              struct cmt_decode_graphite_opts *opts)
+{
+    int         result;
+    struct cmt *cmt;
+
+    if (dst == NULL) {
+        return CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_graphite_create(&cmt, in_buf, in_size, opts);
+    if (result != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_cat_move(dst, cmt) != 0) {
+        result = CMT_DECODE_GRAPHITE_MERGE_ERROR;
+    }
+
+    cmt_destroy(cmt);
+
+    return result;
+}
+
+void cmt_decode_graphite_destroy(struct cmt *cmt)
+{
+    cmt_destroy(cmt);
+}
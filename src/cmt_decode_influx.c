@@ -0,0 +1,907 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_math.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_cat.h>
+#include <cmetrics/cmt_decode_influx.h>
+
+/*
+ * Influx line protocol
+ * --------------------
+ * https://docs.influxdata.com/influxdb/cloud/reference/syntax/line-protocol/
+ *
+ *   measurement[,tag=value...] field=value[,field=value...] [timestamp]
+ */
+
+#define INFLUX_TABLE_INITIAL_SIZE    64
+#define INFLUX_TABLE_LOAD_NUMERATOR   3
+#define INFLUX_TABLE_LOAD_DENOMINATOR 4
+
+#define INFLUX_VALUE_FLOAT    0
+#define INFLUX_VALUE_INT64    1
+#define INFLUX_VALUE_UINT64   2
+#define INFLUX_VALUE_STRING   3
+
+struct influx_tag {
+    char *key;
+    char *value;
+};
+
+/* unescaped key and raw value of a field */
+struct influx_field {
+    char   *key;
+    char   *value;
+    size_t  value_length;
+};
+
+/*
+ * A family is identified by its measurement, field and sorted tag keys, its
+ * type is resolved through the rules once when it is created.
+ */
+struct influx_family {
+    uint64_t         hash;
+    char            *measurement;
+    char            *field;
+    size_t           label_count;
+    char           **keys;
+    struct cmt_map  *map;
+
+    struct cfl_list  _head;
+};
+
+struct influx_slot {
+    uint64_t              hash;
+    struct influx_family *family;
+};
+
+struct influx_context {
+    struct cmt                    *cmt;
+    uint64_t                       precision;
+    uint64_t                       now;
+    struct cmt_decode_influx_rule *rules;
+    size_t                         rule_count;
+
+    struct influx_slot            *slots;
+    size_t                         slot_count;
+    size_t                         family_count;
+    struct cfl_list                families;
+
+    /*
+     * Unescaped strings of the current line, NUL terminated. Every element
+     * shrinks or keeps its size once unescaped, so twice the line length is
+     * always enough.
+     */
+    char                          *scratch;
+    size_t                         scratch_size;
+
+    struct influx_tag              tags[CMT_DECODE_INFLUX_MAX_TAGS];
+    char                          *values[CMT_DECODE_INFLUX_MAX_TAGS];
+    size_t                         tag_count;
+    struct influx_field            fields[CMT_DECODE_INFLUX_MAX_FIELDS];
+    size_t                         field_count;
+};
+
+/*
+ * Return the position of the first unescaped character of 'delimiters', or
+ * 'end' when there is none.
+ */
+static char *scan_element(char *cursor, char *end, const char *delimiters)
+{
+    while (cursor < end) {
+        if (*cursor == '\\' && cursor + 1 < end) {
+            cursor += 2;
+            continue;
+        }
+
+        if (strchr(delimiters, *cursor) != NULL) {
+            break;
+        }
+
+        cursor++;
+    }
+
+    return cursor;
+}
+
+/* Copy and unescape an element, returns the position past its terminator */
+static char *unescape_element(char *out, char *in, char *end)
+{
+    while (in < end) {
+        if (*in == '\\' && in + 1 < end &&
+            (in[1] == ',' || in[1] == '=' || in[1] == ' ' ||
+             in[1] == '"' || in[1] == '\\')) {
+            in++;
+        }
+
+        *out++ = *in++;
+    }
+
+    *out++ = '\0';
+
+    return out;
+}
+
+static int pattern_matches(char *pattern, char *string)
+{
+    size_t pattern_length;
+    size_t string_length;
+
+    if (pattern == NULL) {
+        return CMT_TRUE;
+    }
+
+    pattern_length = strlen(pattern);
+
+    if (pattern_length > 0 && pattern[pattern_length - 1] == '*') {
+        return strncmp(pattern, string, pattern_length - 1) == 0;
+    }
+
+    if (pattern_length > 0 && pattern[0] == '*') {
+        string_length = strlen(string);
+
+        return string_length >= pattern_length - 1 &&
+               strcmp(&string[string_length - (pattern_length - 1)],
+                      &pattern[1]) == 0;
+    }
+
+    return strcmp(pattern, string) == 0;
+}
+
+static int family_type(struct influx_context *context,
+                       char *measurement, char *field)
+{
+    size_t                         index;
+    struct cmt_decode_influx_rule *rule;
+
+    for (index = 0 ; index < context->rule_count ; index++) {
+        rule = &context->rules[index];
+
+        if (pattern_matches(rule->measurement, measurement) &&
+            pattern_matches(rule->field, field)) {
+            return rule->type;
+        }
+    }
+
+    return CMT_GAUGE;
+}
+
+static int table_grow(struct influx_context *context)
+{
+    size_t              index;
+    size_t              position;
+    size_t              slot_count;
+    struct influx_slot *slots;
+
+    slot_count = context->slot_count * 2;
+    slots = calloc(slot_count, sizeof(struct influx_slot));
+
+    if (slots == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < context->slot_count ; index++) {
+        if (context->slots[index].family == NULL) {
+            continue;
+        }
+
+        position = context->slots[index].hash & (slot_count - 1);
+
+        while (slots[position].family != NULL) {
+            position = (position + 1) & (slot_count - 1);
+        }
+
+        slots[position] = context->slots[index];
+    }
+
+    free(context->slots);
+
+    context->slots = slots;
+    context->slot_count = slot_count;
+
+    return CMT_DECODE_INFLUX_SUCCESS;
+}
+
+static uint64_t family_hash(char *measurement, char *field,
+                            struct influx_tag *tags, size_t tag_count)
+{
+    size_t           index;
+    cfl_hash_state_t state;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, measurement, strlen(measurement) + 1);
+    cfl_hash_64bits_update(&state, field, strlen(field) + 1);
+
+    for (index = 0 ; index < tag_count ; index++) {
+        cfl_hash_64bits_update(&state, tags[index].key,
+                               strlen(tags[index].key) + 1);
+    }
+
+    return cfl_hash_64bits_digest(&state);
+}
+
+static int family_matches(struct influx_family *family,
+                          char *measurement, char *field,
+                          struct influx_tag *tags, size_t tag_count)
+{
+    size_t index;
+
+    if (family->label_count != tag_count ||
+        strcmp(family->field, field) != 0 ||
+        strcmp(family->measurement, measurement) != 0) {
+        return CMT_FALSE;
+    }
+
+    for (index = 0 ; index < tag_count ; index++) {
+        if (strcmp(family->keys[index], tags[index].key) != 0) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+static struct influx_family *family_create(struct influx_context *context,
+                                           uint64_t hash,
+                                           char *measurement, char *field,
+                                           struct influx_tag *tags,
+                                           size_t tag_count)
+{
+    char                 *buffer;
+    size_t                index;
+    size_t                size;
+    size_t                length;
+    struct cmt_counter   *counter;
+    struct cmt_gauge     *gauge;
+    struct influx_family *family;
+
+    size = sizeof(struct influx_family) + tag_count * sizeof(char *) +
+           strlen(measurement) + 1 + strlen(field) + 1;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        size += strlen(tags[index].key) + 1;
+    }
+
+    family = calloc(1, size);
+
+    if (family == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    family->hash = hash;
+    family->label_count = tag_count;
+    family->keys = (char **) (family + 1);
+
+    buffer = (char *) (family->keys + tag_count);
+
+    length = strlen(measurement) + 1;
+    family->measurement = memcpy(buffer, measurement, length);
+    buffer += length;
+
+    length = strlen(field) + 1;
+    family->field = memcpy(buffer, field, length);
+    buffer += length;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        length = strlen(tags[index].key) + 1;
+        family->keys[index] = memcpy(buffer, tags[index].key, length);
+        buffer += length;
+    }
+
+    cfl_list_add(&family->_head, &context->families);
+
+    if (family_type(context, measurement, field) == CMT_COUNTER) {
+        counter = cmt_counter_create(context->cmt, family->measurement, "",
+                                     family->field, "-",
+                                     tag_count, family->keys);
+
+        if (counter != NULL) {
+            family->map = counter->map;
+        }
+    }
+    else {
+        gauge = cmt_gauge_create(context->cmt, family->measurement, "",
+                                 family->field, "-",
+                                 tag_count, family->keys);
+
+        if (gauge != NULL) {
+            family->map = gauge->map;
+        }
+    }
+
+    if (family->map == NULL) {
+        return NULL;
+    }
+
+    return family;
+}
+
+static struct influx_family *family_lookup(struct influx_context *context,
+                                           char *measurement, char *field,
+                                           struct influx_tag *tags,
+                                           size_t tag_count)
+{
+    size_t                position;
+    uint64_t              hash;
+    struct influx_slot   *slot;
+    struct influx_family *family;
+
+    hash = family_hash(measurement, field, tags, tag_count);
+    position = hash & (context->slot_count - 1);
+
+    while (context->slots[position].family != NULL) {
+        slot = &context->slots[position];
+
+        if (slot->hash == hash &&
+            family_matches(slot->family, measurement, field, tags, tag_count)) {
+            return slot->family;
+        }
+
+        position = (position + 1) & (context->slot_count - 1);
+    }
+
+    family = family_create(context, hash, measurement, field, tags, tag_count);
+
+    if (family == NULL) {
+        return NULL;
+    }
+
+    context->slots[position].hash = hash;
+    context->slots[position].family = family;
+    context->family_count++;
+
+    if (context->family_count * INFLUX_TABLE_LOAD_DENOMINATOR >=
+        context->slot_count * INFLUX_TABLE_LOAD_NUMERATOR &&
+        table_grow(context) != CMT_DECODE_INFLUX_SUCCESS) {
+        return NULL;
+    }
+
+    return family;
+}
+
+/* Sort the tags by key, a repeated key keeps its last value */
+static void tags_sort(struct influx_context *context)
+{
+    size_t            index;
+    size_t            position;
+    size_t            count;
+    struct influx_tag tag;
+
+    for (index = 1 ; index < context->tag_count ; index++) {
+        tag = context->tags[index];
+
+        for (position = index ;
+             position > 0 &&
+             strcmp(context->tags[position - 1].key, tag.key) > 0 ;
+             position--) {
+            context->tags[position] = context->tags[position - 1];
+        }
+
+        context->tags[position] = tag;
+    }
+
+    count = 0;
+
+    for (index = 0 ; index < context->tag_count ; index++) {
+        if (count > 0 &&
+            strcmp(context->tags[count - 1].key, context->tags[index].key) == 0) {
+            count--;
+        }
+
+        context->tags[count++] = context->tags[index];
+    }
+
+    context->tag_count = count;
+
+    for (index = 0 ; index < count ; index++) {
+        context->values[index] = context->tags[index].value;
+    }
+}
+
+static int field_value_parse(char *value, size_t length, int *type,
+                             double *double_value, int64_t *int64_value,
+                             uint64_t *uint64_value)
+{
+    if (length == 0) {
+        return -1;
+    }
+
+    if (value[0] == '"') {
+        *type = INFLUX_VALUE_STRING;
+
+        return length >= 2 && value[length - 1] == '"' ? 0 : -1;
+    }
+
+    if (value[length - 1] == 'i') {
+        *type = INFLUX_VALUE_INT64;
+
+        return cmt_math_parse_int64(value, length - 1, int64_value);
+    }
+
+    if (value[length - 1] == 'u') {
+        *type = INFLUX_VALUE_UINT64;
+
+        return cmt_math_parse_uint64(value, length - 1, uint64_value);
+    }
+
+    *type = INFLUX_VALUE_FLOAT;
+
+    switch (value[0]) {
+    case 't':
+    case 'T':
+        if (length == 1 ||
+            (length == 4 && (strncmp(value, "true", 4) == 0 ||
+                             strncmp(value, "True", 4) == 0 ||
+                             strncmp(value, "TRUE", 4) == 0))) {
+            *double_value = 1.0;
+
+            return 0;
+        }
+
+        return -1;
+    case 'f':
+    case 'F':
+        if (length == 1 ||
+            (length == 5 && (strncmp(value, "false", 5) == 0 ||
+                             strncmp(value, "False", 5) == 0 ||
+                             strncmp(value, "FALSE", 5) == 0))) {
+            *double_value = 0.0;
+
+            return 0;
+        }
+
+        return -1;
+    }
+
+    return cmt_math_parse_double(value, length, double_value);
+}
+
+static int timestamp_parse(struct influx_context *context,
+                           char *value, size_t length, uint64_t *timestamp)
+{
+    uint64_t parsed;
+
+    if (length == 0) {
+        *timestamp = context->now;
+
+        return 0;
+    }
+
+    /* cmetrics timestamps are unsigned, pre-epoch lines are rejected */
+    if (cmt_math_parse_uint64(value, length, &parsed) != 0 ||
+        parsed > UINT64_MAX / context->precision) {
+        return -1;
+    }
+
+    *timestamp = parsed * context->precision;
+
+    return 0;
+}
+
+static int record_fields(struct influx_context *context, char *measurement,
+                         uint64_t timestamp)
+{
+    int                   type;
+    double                double_value;
+    int64_t               int64_value;
+    uint64_t              uint64_value;
+    size_t                index;
+    struct influx_field  *field;
+    struct influx_family *family;
+    struct cmt_metric    *metric;
+
+    for (index = 0 ; index < context->field_count ; index++) {
+        field = &context->fields[index];
+
+        if (field_value_parse(field->value, field->value_length, &type,
+                              &double_value, &int64_value,
+                              &uint64_value) != 0) {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        if (type == INFLUX_VALUE_STRING) {
+            continue;
+        }
+
+        family = family_lookup(context, measurement, field->key,
+                               context->tags, context->tag_count);
+
+        if (family == NULL) {
+            return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+        }
+
+        metric = cmt_map_metric_get(family->map->opts, family->map,
+                                    context->tag_count, context->values,
+                                    CMT_TRUE);
+
+        if (metric == NULL) {
+            return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+        }
+
+        if (type == INFLUX_VALUE_INT64) {
+            cmt_metric_set_int64(metric, timestamp, int64_value);
+        }
+        else if (type == INFLUX_VALUE_UINT64) {
+            cmt_metric_set_uint64(metric, timestamp, uint64_value);
+        }
+        else {
+            cmt_metric_set_double(metric, timestamp, double_value);
+        }
+    }
+
+    return CMT_DECODE_INFLUX_SUCCESS;
+}
+
+static int scratch_reserve(struct influx_context *context, size_t length)
+{
+    char   *scratch;
+    size_t  size;
+
+    size = length * 2 + 2;
+
+    if (size <= context->scratch_size) {
+        return CMT_DECODE_INFLUX_SUCCESS;
+    }
+
+    scratch = realloc(context->scratch, size);
+
+    if (scratch == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+    }
+
+    context->scratch = scratch;
+    context->scratch_size = size;
+
+    return CMT_DECODE_INFLUX_SUCCESS;
+}
+
+static int influx_process_line(struct influx_context *context,
+                               char *line, size_t length)
+{
+    int       result;
+    char     *cursor;
+    char     *end;
+    char     *next;
+    char     *out;
+    char     *measurement;
+    uint64_t  timestamp;
+    struct influx_tag   *tag;
+    struct influx_field *field;
+
+    end = line + length;
+
+    for (cursor = line ; cursor < end && (*cursor == ' ' || *cursor == '\t') ;
+         cursor++);
+
+    if (cursor == end || *cursor == '#') {
+        return CMT_DECODE_INFLUX_SUCCESS;
+    }
+
+    result = scratch_reserve(context, end - cursor);
+    if (result != CMT_DECODE_INFLUX_SUCCESS) {
+        return result;
+    }
+
+    out = context->scratch;
+    context->tag_count = 0;
+    context->field_count = 0;
+
+    /* measurement */
+    next = scan_element(cursor, end, ", ");
+    if (next == cursor) {
+        return CMT_DECODE_INFLUX_DECODE_ERROR;
+    }
+
+    measurement = out;
+    out = unescape_element(out, cursor, next);
+    cursor = next;
+
+    /* tag set */
+    while (cursor < end && *cursor == ',') {
+        if (context->tag_count == CMT_DECODE_INFLUX_MAX_TAGS) {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        tag = &context->tags[context->tag_count++];
+
+        cursor++;
+        next = scan_element(cursor, end, "=, ");
+        if (next == cursor || next == end || *next != '=') {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        tag->key = out;
+        out = unescape_element(out, cursor, next);
+        cursor = next + 1;
+
+        next = scan_element(cursor, end, ", ");
+        if (next == cursor) {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        tag->value = out;
+        out = unescape_element(out, cursor, next);
+        cursor = next;
+    }
+
+    if (cursor == end || *cursor != ' ') {
+        return CMT_DECODE_INFLUX_DECODE_ERROR;
+    }
+
+    while (cursor < end && *cursor == ' ') {
+        cursor++;
+    }
+
+    /* field set */
+    while (1) {
+        if (context->field_count == CMT_DECODE_INFLUX_MAX_FIELDS) {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        field = &context->fields[context->field_count++];
+
+        next = scan_element(cursor, end, "=, ");
+        if (next == cursor || next == end || *next != '=') {
+            return CMT_DECODE_INFLUX_DECODE_ERROR;
+        }
+
+        field->key = out;
+        out = unescape_element(out, cursor, next);
+        cursor = next + 1;
+
+        if (cursor < end && *cursor == '"') {
+            /* string values can hold any unescaped delimiter */
+            next = scan_element(cursor + 1, end, "\"");
+            if (next == end) {
+                return CMT_DECODE_INFLUX_DECODE_ERROR;
+            }
+
+            next++;
+        }
+        else {
+            next = scan_element(cursor, end, ", ");
+        }
+
+        field->value = cursor;
+        field->value_length = next - cursor;
+        cursor = next;
+
+        if (cursor == end || *cursor != ',') {
+            break;
+        }
+
+        cursor++;
+    }
+
+    if (cursor < end && *cursor != ' ') {
+        return CMT_DECODE_INFLUX_DECODE_ERROR;
+    }
+
+    while (cursor < end && *cursor == ' ') {
+        cursor++;
+    }
+
+    /* optional timestamp, trailing blanks are allowed */
+    next = cursor;
+    while (next < end && *next != ' ') {
+        next++;
+    }
+
+    if (timestamp_parse(context, cursor, next - cursor, &timestamp) != 0) {
+        return CMT_DECODE_INFLUX_DECODE_ERROR;
+    }
+
+    while (next < end && *next == ' ') {
+        next++;
+    }
+
+    if (next != end) {
+        return CMT_DECODE_INFLUX_DECODE_ERROR;
+    }
+
+    tags_sort(context);
+
+    return record_fields(context, measurement, timestamp);
+}
+
+static int decode_lines(struct influx_context *context,
+                        char *in_buf, size_t in_size)
+{
+    int     ret = CMT_DECODE_INFLUX_SUCCESS;
+    char   *end;
+    char   *line;
+    char   *newline;
+    size_t  length;
+
+    /* the input might be NUL terminated */
+    end = memchr(in_buf, '\0', in_size);
+    if (end == NULL) {
+        end = in_buf + in_size;
+    }
+
+    for (line = in_buf ; line < end ; line = newline + 1) {
+        newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            newline = end;
+        }
+
+        length = newline - line;
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+
+        ret = influx_process_line(context, line, length);
+        if (ret != CMT_DECODE_INFLUX_SUCCESS) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
+static int context_init(struct influx_context *context, struct cmt *cmt,
+                        struct cmt_decode_influx_opts *opts)
+{
+    size_t index;
+
+    memset(context, 0, sizeof(struct influx_context));
+
+    context->cmt = cmt;
+    context->precision = 1;
+    context->now = cfl_time_now();
+    cfl_list_init(&context->families);
+
+    if (opts != NULL) {
+        switch (opts->precision) {
+        case CMT_DECODE_INFLUX_PRECISION_NANOSECONDS:
+            break;
+        case CMT_DECODE_INFLUX_PRECISION_MICROSECONDS:
+            context->precision = 1000;
+            break;
+        case CMT_DECODE_INFLUX_PRECISION_MILLISECONDS:
+            context->precision = 1000000;
+            break;
+        case CMT_DECODE_INFLUX_PRECISION_SECONDS:
+            context->precision = 1000000000;
+            break;
+        default:
+            return CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (opts->rule_count > 0 && opts->rules == NULL) {
+            return CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR;
+        }
+
+        for (index = 0 ; index < opts->rule_count ; index++) {
+            if (opts->rules[index].type != CMT_COUNTER &&
+                opts->rules[index].type != CMT_GAUGE) {
+                return CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR;
+            }
+        }
+
+        context->rules = opts->rules;
+        context->rule_count = opts->rule_count;
+    }
+
+    context->slots = calloc(INFLUX_TABLE_INITIAL_SIZE, sizeof(struct influx_slot));
+    if (context->slots == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+    }
+
+    context->slot_count = INFLUX_TABLE_INITIAL_SIZE;
+
+    return CMT_DECODE_INFLUX_SUCCESS;
+}
+
+static void context_destroy(struct influx_context *context)
+{
+    struct cfl_list      *head;
+    struct cfl_list      *tmp;
+    struct influx_family *family;
+
+    cfl_list_foreach_safe(head, tmp, &context->families) {
+        family = cfl_list_entry(head, struct influx_family, _head);
+        cfl_list_del(&family->_head);
+        free(family);
+    }
+
+    free(context->slots);
+    free(context->scratch);
+}
+
+int cmt_decode_influx_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
+                             struct cmt_decode_influx_opts *opts)
+{
+    int                   result;
+    struct cmt           *cmt;
+    struct influx_context context;
+
+    if (out_cmt == NULL || in_buf == NULL) {
+        return CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR;
+    }
+
+    cmt = cmt_create();
+
+    if (cmt == NULL) {
+        return CMT_DECODE_INFLUX_ALLOCATION_ERROR;
+    }
+
+    result = context_init(&context, cmt, opts);
+    if (result != CMT_DECODE_INFLUX_SUCCESS) {
+        context_destroy(&context);
+        cmt_destroy(cmt);
+
+        return result;
+    }
+
+    result = decode_lines(&context, in_buf, in_size);
+
+    context_destroy(&context);
+
+    if (result != CMT_DECODE_INFLUX_SUCCESS) {
+        cmt_destroy(cmt);
+
+        return result;
+    }
+
+    *out_cmt = cmt;
+
+    return result;
+}
+
+int cmt_decode_influx_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                            struct cmt_decode_influx_opts *opts)
+{
+    int         result;
+    struct cmt *cmt;
+
+    if (dst == NULL) {
+        return CMT_DECODE_INFLUX_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_influx_create(&cmt, in_buf, in_size, opts);
+    if (result != CMT_DECODE_INFLUX_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_cat_move(dst, cmt) != 0) {
+        result = CMT_DECODE_INFLUX_MERGE_ERROR;
+    }
+
+    cmt_destroy(cmt);
+
+    return result;
+}
+
+void cmt_decode_influx_destroy(struct cmt *cmt)
+{
+    cmt_destroy(cmt);
+}
@@ -32,9 +32,14 @@
 #include <cmetrics/cmt_variant_utils.h>
 #include <cmetrics/cmt_mpack_utils.h>
 #include <cmetrics/cmt_atomic.h>
+#include <cmetrics/cmt_cat.h>
 
 #include <limits.h>
 
+#ifdef CMT_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 static int create_counter_instance(struct cmt_map *map)
 {
     struct cmt_counter *counter;
@@ -252,6 +257,61 @@ static int unpack_opts_unit(mpack_reader_t *reader, size_t index, void *context)
     return CMT_DECODE_MSGPACK_SUCCESS;
 }
 
+/* Fill the missing names and compose the fully qualified name */
+static int finalize_opts(struct cmt_map *map)
+{
+    struct cmt_opts *opts;
+
+    opts = map->opts;
+
+    /* Ensure required string fields are not NULL */
+    if (NULL == opts->ns) {
+        opts->ns = cfl_sds_create("");
+        if (NULL == opts->ns) {
+            return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+        }
+    }
+    if (NULL == opts->subsystem) {
+        opts->subsystem = cfl_sds_create("");
+        if (NULL == opts->subsystem) {
+            return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+        }
+    }
+    if (NULL == opts->name) {
+        opts->name = cfl_sds_create("");
+        if (NULL == opts->name) {
+            return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+        }
+    }
+
+    /* Allocate enough space for the three components, the separators
+     * and the terminator so we don't have to worry about possible realloc issues
+     * later on.
+     */
+
+    opts->fqname = cfl_sds_create_size(cfl_sds_len(opts->ns) + \
+                                       cfl_sds_len(opts->subsystem) + \
+                                       cfl_sds_len(opts->name) + \
+                                       4);
+
+    if (NULL == opts->fqname) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    if (cfl_sds_len(opts->ns) > 0) {
+        cfl_sds_cat_safe(&opts->fqname, opts->ns, cfl_sds_len(opts->ns));
+        cfl_sds_cat_safe(&opts->fqname, "_", 1);
+    }
+
+    if (cfl_sds_len(opts->subsystem) > 0) {
+        cfl_sds_cat_safe(&opts->fqname, opts->subsystem, cfl_sds_len(opts->subsystem));
+        cfl_sds_cat_safe(&opts->fqname, "_", 1);
+    }
+    cfl_sds_cat_safe(&opts->fqname, opts->name, cfl_sds_len(opts->name));
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
 static int unpack_opts(mpack_reader_t *reader, struct cmt_map *map)
 {
     int                                   result;
@@ -278,50 +338,7 @@ static int unpack_opts(mpack_reader_t *reader, struct cmt_map *map)
     result = cmt_mpack_unpack_map(reader, callbacks, (void *) map);
 
     if (CMT_DECODE_MSGPACK_SUCCESS == result) {
-        /* Ensure required string fields are not NULL */
-        if (NULL == opts->ns) {
-            opts->ns = cfl_sds_create("");
-            if (NULL == opts->ns) {
-                return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
-            }
-        }
-        if (NULL == opts->subsystem) {
-            opts->subsystem = cfl_sds_create("");
-            if (NULL == opts->subsystem) {
-                return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
-            }
-        }
-        if (NULL == opts->name) {
-            opts->name = cfl_sds_create("");
-            if (NULL == opts->name) {
-                return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
-            }
-        }
-
-        /* Allocate enough space for the three components, the separators
-         * and the terminator so we don't have to worry about possible realloc issues
-         * later on.
-         */
-
-        opts->fqname = cfl_sds_create_size(cfl_sds_len(opts->ns) + \
-                                           cfl_sds_len(opts->subsystem) + \
-                                           cfl_sds_len(opts->name) + \
-                                           4);
-
-        if (NULL == opts->fqname) {
-            return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
-        }
-
-        if (cfl_sds_len(opts->ns) > 0) {
-            cfl_sds_cat_safe(&opts->fqname, opts->ns, cfl_sds_len(opts->ns));
-            cfl_sds_cat_safe(&opts->fqname, "_", 1);
-        }
-
-        if (cfl_sds_len(opts->subsystem) > 0) {
-            cfl_sds_cat_safe(&opts->fqname, opts->subsystem, cfl_sds_len(opts->subsystem));
-            cfl_sds_cat_safe(&opts->fqname, "_", 1);
-        }
-        cfl_sds_cat_safe(&opts->fqname, opts->name, cfl_sds_len(opts->name));
+        result = finalize_opts(map);
     }
 
     return result;
@@ -1193,6 +1210,233 @@ static int unpack_metric_hash(mpack_reader_t *reader, size_t index, void *contex
     return cmt_mpack_consume_uint_tag(reader, &decode_context->metric->hash);
 }
 
+/* Compact format strings are references into the payload dictionary */
+static int consume_dictionary_string(mpack_reader_t *reader,
+                                     struct cmt_msgpack_decode_context *decode_context,
+                                     cfl_sds_t *output_buffer)
+{
+    int                                  result;
+    uint64_t                             index;
+    struct cmt_msgpack_dictionary_entry *entry;
+
+    result = cmt_mpack_consume_uint_tag(reader, &index);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (index >= decode_context->dictionary_size) {
+        return CMT_DECODE_MSGPACK_DICTIONARY_LOOKUP_ERROR;
+    }
+
+    entry = &decode_context->dictionary[index];
+
+    *output_buffer = cfl_sds_create_len(entry->data, entry->length);
+
+    if (NULL == *output_buffer) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_compact_label(mpack_reader_t *reader,
+                                struct cmt_msgpack_decode_context *decode_context,
+                                struct cfl_list *target_label_list)
+{
+    mpack_tag_t           tag;
+    struct cmt_map_label *new_label;
+    int                   result;
+
+    new_label = calloc(1, sizeof(struct cmt_map_label));
+
+    if (NULL == new_label) {
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    tag = mpack_peek_tag(reader);
+    if (mpack_ok != mpack_reader_error(reader)) {
+        free(new_label);
+
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    if (mpack_tag_type(&tag) == mpack_type_nil) {
+        mpack_expect_nil(reader);
+
+        result = CMT_DECODE_MSGPACK_SUCCESS;
+
+        if (mpack_ok != mpack_reader_error(reader)) {
+            result = CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+    }
+    else {
+        result = consume_dictionary_string(reader, decode_context, &new_label->name);
+    }
+
+    if (result != CMT_DECODE_MSGPACK_SUCCESS) {
+        free(new_label);
+
+        return result;
+    }
+
+    cfl_list_add(&new_label->_head, target_label_list);
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_compact_metric_label(mpack_reader_t *reader, size_t index, void *context)
+{
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    return unpack_compact_label(reader, decode_context,
+                                &decode_context->metric->labels);
+}
+
+static int unpack_compact_metric_labels(mpack_reader_t *reader, size_t index, void *context)
+{
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return cmt_mpack_unpack_array(reader,
+                                  unpack_compact_metric_label,
+                                  context);
+}
+
+/* Timestamps are deltas from the previous value of the payload */
+static int unpack_compact_metric_ts(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    int64_t                            delta;
+    uint64_t                           timestamp;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    result = cmt_mpack_consume_int_tag(reader, &delta);
+
+    if (result == CMT_DECODE_MSGPACK_SUCCESS) {
+        timestamp = decode_context->timestamp + (uint64_t) delta;
+
+        cmt_metric_set_timestamp(decode_context->metric, timestamp);
+        decode_context->timestamp = timestamp;
+    }
+
+    return result;
+}
+
+/* The start timestamp is a delta from the value timestamp */
+static int unpack_compact_metric_start_ts(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    int64_t                            delta;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    result = cmt_mpack_consume_int_tag(reader, &delta);
+
+    if (result == CMT_DECODE_MSGPACK_SUCCESS) {
+        cmt_metric_set_start_timestamp(decode_context->metric,
+                                       cmt_metric_get_timestamp(decode_context->metric) +
+                                       (uint64_t) delta);
+    }
+
+    return result;
+}
+
+static int unpack_compact_metric_histogram(mpack_reader_t *reader, size_t index, void *context)
+{
+    cmt_mpack_unpacker_entry_callback_fn_t callbacks[MSGPACK_COMPACT_HISTOGRAM_FIELD_COUNT] = \
+        {
+            unpack_histogram_buckets,
+            unpack_histogram_sum,
+            unpack_histogram_count
+        };
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return cmt_mpack_unpack_tagged_map(reader, callbacks,
+                                       MSGPACK_COMPACT_HISTOGRAM_FIELD_COUNT,
+                                       context);
+}
+
+static int unpack_compact_metric_summary(mpack_reader_t *reader, size_t index, void *context)
+{
+    cmt_mpack_unpacker_entry_callback_fn_t callbacks[MSGPACK_COMPACT_SUMMARY_FIELD_COUNT] = \
+        {
+            unpack_summary_quantiles_set,
+            unpack_summary_quantiles,
+            unpack_summary_count,
+            unpack_summary_sum
+        };
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return cmt_mpack_unpack_tagged_map(reader, callbacks,
+                                       MSGPACK_COMPACT_SUMMARY_FIELD_COUNT,
+                                       context);
+}
+
+static int unpack_compact_metric_exp_histogram(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                    result;
+    struct cmt_msgpack_decode_context     *decode_context;
+    cmt_mpack_unpacker_entry_callback_fn_t callbacks[MSGPACK_COMPACT_EXP_HISTOGRAM_FIELD_COUNT] = \
+        {
+            unpack_exp_histogram_scale,
+            unpack_exp_histogram_zero_count,
+            unpack_exp_histogram_zero_threshold,
+            unpack_exp_histogram_positive_offset,
+            unpack_exp_histogram_positive_buckets,
+            unpack_exp_histogram_negative_offset,
+            unpack_exp_histogram_negative_buckets,
+            unpack_exp_histogram_count,
+            unpack_exp_histogram_sum_set,
+            unpack_exp_histogram_sum
+        };
+
+    if (NULL == reader  ||
+        NULL == context ) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    cmt_metric_exp_hist_lock(decode_context->metric);
+    result = cmt_mpack_unpack_tagged_map(reader, callbacks,
+                                         MSGPACK_COMPACT_EXP_HISTOGRAM_FIELD_COUNT,
+                                         context);
+    cmt_metric_exp_hist_unlock(decode_context->metric);
+
+    return result;
+}
+
 static int unpack_metric(mpack_reader_t *reader,
                          struct cmt_msgpack_decode_context *decode_context,
                          struct cmt_metric **out_metric)
@@ -1216,6 +1460,19 @@ static int unpack_metric(mpack_reader_t *reader,
             {"hash",      unpack_metric_hash},
             {NULL,        NULL}
         };
+    cmt_mpack_unpacker_entry_callback_fn_t compact_callbacks[MSGPACK_COMPACT_VALUE_FIELD_COUNT] = \
+        {
+            unpack_compact_metric_ts,
+            unpack_compact_metric_start_ts,
+            unpack_metric_value,
+            unpack_metric_value_int64,
+            unpack_metric_value_uint64,
+            unpack_compact_metric_labels,
+            unpack_compact_metric_histogram,
+            unpack_compact_metric_summary,
+            unpack_compact_metric_exp_histogram,
+            unpack_metric_hash
+        };
 
     if (NULL == reader         ||
         NULL == decode_context ||
@@ -1270,7 +1527,14 @@ static int unpack_metric(mpack_reader_t *reader,
     decode_context->metric = metric;
     decode_context->metric_value_type_set = CMT_FALSE;
 
-    result = cmt_mpack_unpack_map(reader, callbacks, (void *) decode_context);
+    if (decode_context->compact) {
+        result = cmt_mpack_unpack_tagged_map(reader, compact_callbacks,
+                                             MSGPACK_COMPACT_VALUE_FIELD_COUNT,
+                                             (void *) decode_context);
+    }
+    else {
+        result = cmt_mpack_unpack_map(reader, callbacks, (void *) decode_context);
+    }
 
     if (CMT_DECODE_MSGPACK_SUCCESS != result) {
         destroy_label_list(&metric->labels);
@@ -1633,13 +1897,77 @@ static int unpack_meta_quantiles(mpack_reader_t *reader, size_t index, void *con
     return cmt_mpack_unpack_array(reader, unpack_meta_quantile, context);
 }
 
+static int validate_basic_type_meta(struct cmt_msgpack_decode_context *decode_context)
+{
+    if (decode_context->map == NULL ||
+        decode_context->map->parent == NULL ||
+        decode_context->map->opts == NULL ||
+        decode_context->map->opts->name == NULL ||
+        decode_context->map->opts->description == NULL) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+/* Validate the metric meta fields and apply them to the map */
+static int finalize_basic_type_meta(struct cmt_msgpack_decode_context *decode_context)
+{
+    int                       result;
+    struct cmt_summary       *summary;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_counter       *counter;
+
+    result = validate_basic_type_meta(decode_context);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    decode_context->map->label_count = cfl_list_size(&decode_context->map->label_keys);
+    if (decode_context->map->type == CMT_HISTOGRAM) {
+        histogram = (struct cmt_histogram *) decode_context->map->parent;
+
+        if (decode_context->bucket_count > 0) {
+            histogram->buckets =
+                cmt_histogram_buckets_create_size(decode_context->bucket_list,
+                                                  decode_context->bucket_count);
+
+            if (histogram->buckets == NULL) {
+                result = CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+            }
+        }
+        else {
+            histogram->buckets = NULL;
+        }
+
+        histogram->aggregation_type = decode_context->aggregation_type;
+    }
+    else if (decode_context->map->type == CMT_EXP_HISTOGRAM) {
+        exp_histogram = (struct cmt_exp_histogram *) decode_context->map->parent;
+        exp_histogram->aggregation_type = decode_context->aggregation_type;
+    }
+    else if (decode_context->map->type == CMT_SUMMARY) {
+        summary = (struct cmt_summary *) decode_context->map->parent;
+
+        summary->quantiles = decode_context->quantile_list;
+        summary->quantiles_count = decode_context->quantile_count;
+
+        decode_context->quantile_list = NULL;
+        decode_context->quantile_count = 0;
+    }
+    else if(decode_context->map->type == CMT_COUNTER) {
+        counter = (struct cmt_counter *) decode_context->map->parent;
+        counter->aggregation_type = decode_context->aggregation_type;
+    }
+
+    return result;
+}
+
 static int unpack_basic_type_meta(mpack_reader_t *reader, size_t index, void *context)
 {
     int                                   result;
-    struct cmt_summary                   *summary;
-    struct cmt_histogram                 *histogram;
-    struct cmt_exp_histogram             *exp_histogram;
-    struct cmt_counter                   *counter;
     struct cmt_msgpack_decode_context    *decode_context;
     struct cmt_mpack_map_entry_callback_t callbacks[] = \
         {
@@ -1663,79 +1991,167 @@ static int unpack_basic_type_meta(mpack_reader_t *reader, size_t index, void *co
     result = cmt_mpack_unpack_map(reader, callbacks, context);
 
     if (CMT_DECODE_MSGPACK_SUCCESS == result) {
-        if (decode_context->map == NULL ||
-            decode_context->map->parent == NULL ||
-            decode_context->map->opts == NULL ||
-            decode_context->map->opts->name == NULL ||
-            decode_context->map->opts->description == NULL) {
-            return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
-        }
-
-        decode_context->map->label_count = cfl_list_size(&decode_context->map->label_keys);
-        if (decode_context->map->type == CMT_HISTOGRAM) {
-            histogram = (struct cmt_histogram *) decode_context->map->parent;
+        result = finalize_basic_type_meta(decode_context);
+    }
 
-            if (decode_context->bucket_count > 0) {
-                histogram->buckets =
-                    cmt_histogram_buckets_create_size(decode_context->bucket_list,
-                                                      decode_context->bucket_count);
+    return result;
+}
 
-                if (histogram->buckets == NULL) {
-                    result = CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
-                }
+static int unpack_basic_type_values(mpack_reader_t *reader, size_t index, void *context)
+{
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return cmt_mpack_unpack_array(reader,
+                                  unpack_metric_array_entry,
+                                  context);
+}
+
+static int unpack_compact_opts_entry(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    cfl_sds_t                          unit;
+    struct cmt_opts                   *opts;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+    opts = decode_context->map->opts;
+
+    switch (index) {
+    case 0:
+        return consume_dictionary_string(reader, decode_context, &opts->ns);
+    case 1:
+        return consume_dictionary_string(reader, decode_context, &opts->subsystem);
+    case 2:
+        return consume_dictionary_string(reader, decode_context, &opts->name);
+    case 3:
+        return consume_dictionary_string(reader, decode_context, &opts->description);
+    case 4:
+        result = consume_dictionary_string(reader, decode_context, &unit);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+            if (cfl_sds_len(unit) > 0) {
+                decode_context->map->unit = unit;
             }
             else {
-                histogram->buckets = NULL;
+                cfl_sds_destroy(unit);
             }
-
-            histogram->aggregation_type = decode_context->aggregation_type;
-        }
-        else if (decode_context->map->type == CMT_EXP_HISTOGRAM) {
-            exp_histogram = (struct cmt_exp_histogram *) decode_context->map->parent;
-            exp_histogram->aggregation_type = decode_context->aggregation_type;
         }
-        else if (decode_context->map->type == CMT_SUMMARY) {
-            summary = (struct cmt_summary *) decode_context->map->parent;
 
-            summary->quantiles = decode_context->quantile_list;
-            summary->quantiles_count = decode_context->quantile_count;
+        return result;
+    }
 
-            decode_context->quantile_list = NULL;
-            decode_context->quantile_count = 0;
-        }
-        else if(decode_context->map->type == CMT_COUNTER) {
-            counter = (struct cmt_counter *) decode_context->map->parent;
-            counter->aggregation_type = decode_context->aggregation_type;
-        }
+    return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+}
+
+static int unpack_compact_meta_opts(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    struct cmt_opts                   *opts;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+    opts = decode_context->map->opts;
+
+    if (opts == NULL) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_mpack_unpack_array(reader, unpack_compact_opts_entry, context);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        result = finalize_opts(decode_context->map);
     }
 
     return result;
 }
 
-static int unpack_basic_type_values(mpack_reader_t *reader, size_t index, void *context)
+static int unpack_compact_meta_label(mpack_reader_t *reader, size_t index, void *context)
 {
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    return unpack_compact_label(reader, decode_context,
+                                &decode_context->map->label_keys);
+}
+
+static int unpack_compact_meta_labels(mpack_reader_t *reader, size_t index, void *context)
+{
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return cmt_mpack_unpack_array(reader, unpack_compact_meta_label, context);
+}
+
+/* The meta fields precede the values, so they are applied to the map first */
+static int unpack_compact_basic_type_values(mpack_reader_t *reader, size_t index, void *context)
+{
+    int result;
+
     if (NULL == reader ||
         NULL == context) {
         return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
     }
 
+    result = finalize_basic_type_meta((struct cmt_msgpack_decode_context *) context);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
     return cmt_mpack_unpack_array(reader,
                                   unpack_metric_array_entry,
                                   context);
 }
 
-static int unpack_basic_type(mpack_reader_t *reader, struct cmt *cmt, struct cmt_map **map)
-{
-    int                                   result;
-    struct cmt_summary                   *summary;
-    struct cmt_histogram                 *histogram;
-    struct cmt_msgpack_decode_context     decode_context;
-    struct cmt_mpack_map_entry_callback_t callbacks[] = \
+/*
+ * Metrics of compact payloads share the state of the payload, that is the
+ * dictionary and the timestamp of the last value decoded.
+ */
+static int unpack_basic_type(mpack_reader_t *reader, struct cmt *cmt,
+                             struct cmt_msgpack_decode_context *compact_context,
+                             struct cmt_map **map)
+{
+    int                                    result;
+    struct cmt_summary                    *summary;
+    struct cmt_histogram                  *histogram;
+    struct cmt_msgpack_decode_context      decode_context;
+    struct cmt_mpack_map_entry_callback_t  callbacks[] = \
         {
             {"meta",   unpack_basic_type_meta},
             {"values", unpack_basic_type_values},
             {NULL,     NULL}
         };
+    cmt_mpack_unpacker_entry_callback_fn_t compact_callbacks[MSGPACK_COMPACT_META_FIELD_COUNT] = \
+        {
+            unpack_meta_type,
+            unpack_compact_meta_opts,
+            unpack_compact_meta_labels,
+            unpack_meta_buckets,
+            unpack_meta_quantiles,
+            unpack_meta_aggregation_type,
+            unpack_compact_basic_type_values
+        };
 
     if (NULL == reader ||
         NULL == map) {
@@ -1762,7 +2178,25 @@ static int unpack_basic_type(mpack_reader_t *reader, struct cmt *cmt, struct cmt
     decode_context.cmt = cmt;
     decode_context.map = *map;
 
-    result = cmt_mpack_unpack_map(reader, callbacks, (void *) &decode_context);
+    if (compact_context != NULL) {
+        decode_context.compact = CMT_TRUE;
+        decode_context.dictionary = compact_context->dictionary;
+        decode_context.dictionary_size = compact_context->dictionary_size;
+        decode_context.timestamp = compact_context->timestamp;
+
+        result = cmt_mpack_unpack_tagged_map(reader, compact_callbacks,
+                                             MSGPACK_COMPACT_META_FIELD_COUNT,
+                                             (void *) &decode_context);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+            result = validate_basic_type_meta(&decode_context);
+        }
+
+        compact_context->timestamp = decode_context.timestamp;
+    }
+    else {
+        result = cmt_mpack_unpack_map(reader, callbacks, (void *) &decode_context);
+    }
 
     if ((*map)->parent == NULL) {
         result = CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
@@ -1995,6 +2429,34 @@ static int append_unpacked_exp_histogram_to_metrics_context(
     return CMT_DECODE_MSGPACK_SUCCESS;
 }
 
+static int append_unpacked_basic_type(struct cmt *cmt, struct cmt_map *map)
+{
+    int result;
+
+    result = CMT_DECODE_MSGPACK_SUCCESS;
+
+    if (CMT_COUNTER == map->type) {
+        result = append_unpacked_counter_to_metrics_context(cmt, map);
+    }
+    else if (CMT_GAUGE == map->type) {
+        result = append_unpacked_gauge_to_metrics_context(cmt, map);
+    }
+    else if (CMT_SUMMARY == map->type) {
+        result = append_unpacked_summary_to_metrics_context(cmt, map);
+    }
+    else if (CMT_HISTOGRAM == map->type) {
+        result = append_unpacked_histogram_to_metrics_context(cmt, map);
+    }
+    else if (CMT_EXP_HISTOGRAM == map->type) {
+        result = append_unpacked_exp_histogram_to_metrics_context(cmt, map);
+    }
+    else if (CMT_UNTYPED == map->type) {
+        result = append_unpacked_untyped_to_metrics_context(cmt, map);
+    }
+
+    return result;
+}
+
 static int unpack_basic_type_entry(mpack_reader_t *reader, size_t index, void *context)
 {
     int             result;
@@ -2008,27 +2470,32 @@ static int unpack_basic_type_entry(mpack_reader_t *reader, size_t index, void *c
 
     cmt = (struct cmt *) context;
 
-    result = unpack_basic_type(reader, cmt, &map);
+    result = unpack_basic_type(reader, cmt, NULL, &map);
 
     if (CMT_DECODE_MSGPACK_SUCCESS == result) {
-        if (CMT_COUNTER == map->type) {
-            result = append_unpacked_counter_to_metrics_context(cmt, map);
-        }
-        else if (CMT_GAUGE == map->type) {
-            result = append_unpacked_gauge_to_metrics_context(cmt, map);
-        }
-        else if (CMT_SUMMARY == map->type) {
-            result = append_unpacked_summary_to_metrics_context(cmt, map);
-        }
-        else if (CMT_HISTOGRAM == map->type) {
-            result = append_unpacked_histogram_to_metrics_context(cmt, map);
-        }
-        else if (CMT_EXP_HISTOGRAM == map->type) {
-            result = append_unpacked_exp_histogram_to_metrics_context(cmt, map);
-        }
-        else if (CMT_UNTYPED == map->type) {
-            result = append_unpacked_untyped_to_metrics_context(cmt, map);
-        }
+        result = append_unpacked_basic_type(cmt, map);
+    }
+
+    return result;
+}
+
+static int unpack_compact_basic_type_entry(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    struct cmt_map                    *map;
+    struct cmt_msgpack_decode_context *compact_context;
+
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    compact_context = (struct cmt_msgpack_decode_context *) context;
+
+    result = unpack_basic_type(reader, compact_context->cmt, compact_context, &map);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        result = append_unpacked_basic_type(compact_context->cmt, map);
     }
 
     return result;
@@ -2147,12 +2614,169 @@ static int unpack_context(mpack_reader_t *reader, struct cmt *cmt)
     return cmt_mpack_unpack_map(reader, callbacks, (void *) cmt);
 }
 
-/* Convert cmetrics msgpack payload and generate a CMetrics context */
+/* Dictionary strings are not copied, they refer to the input buffer */
+static int unpack_compact_dictionary(mpack_reader_t *reader,
+                                     struct cmt_msgpack_decode_context *decode_context)
+{
+    uint32_t                             index;
+    uint32_t                             entry_count;
+    uint32_t                             length;
+    const char                          *data;
+    mpack_tag_t                          tag;
+    struct cmt_msgpack_dictionary_entry *dictionary;
+
+    if (NULL != decode_context->dictionary) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (mpack_type_array != mpack_tag_type(&tag)) {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    entry_count = mpack_tag_array_count(&tag);
+
+    /* Every entry takes at least one byte, the first one is the empty string */
+    if (0 == entry_count ||
+        entry_count > mpack_reader_remaining(reader, NULL)) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    dictionary = calloc(entry_count, sizeof(struct cmt_msgpack_dictionary_entry));
+
+    if (NULL == dictionary) {
+        cmt_errno();
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    decode_context->dictionary = dictionary;
+
+    for (index = 0 ; index < entry_count ; index++) {
+        tag = mpack_read_tag(reader);
+
+        if (mpack_ok != mpack_reader_error(reader)) {
+            return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+        }
+
+        if (mpack_type_str != mpack_tag_type(&tag)) {
+            return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+        }
+
+        length = mpack_tag_str_length(&tag);
+        data = mpack_read_bytes_inplace(reader, length);
+        mpack_done_str(reader);
+
+        if (mpack_ok != mpack_reader_error(reader)) {
+            return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+        }
+
+        /* same as every other cmetrics string, embedded NUL bytes are rejected */
+        if (length > 0 && NULL != memchr(data, '\0', length)) {
+            return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+
+        dictionary[index].data = data;
+        dictionary[index].length = length;
+
+        decode_context->dictionary_size++;
+    }
+
+    mpack_done_array(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_PENDING_ARRAY_ENTRIES;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int unpack_compact_context_entry(mpack_reader_t *reader, size_t index, void *context)
+{
+    int                                result;
+    uint64_t                           version;
+    struct cmt_msgpack_decode_context *decode_context;
+
+    if (NULL == reader ||
+        NULL == context) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    decode_context = (struct cmt_msgpack_decode_context *) context;
+
+    switch (index) {
+    case 0:
+        result = cmt_mpack_consume_uint_tag(reader, &version);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result &&
+            MSGPACK_COMPACT_VERSION != version) {
+            result = CMT_DECODE_MSGPACK_VERSION_ERROR;
+        }
+
+        return result;
+    case 1:
+        return unpack_compact_dictionary(reader, decode_context);
+    case 2:
+        return unpack_context_header(reader, index, decode_context->cmt);
+    case 3:
+        if (NULL == decode_context->dictionary) {
+            return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+        }
+
+        return cmt_mpack_unpack_array(reader,
+                                      unpack_compact_basic_type_entry,
+                                      context);
+    }
+
+    return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+}
+
+/* [version, dictionary, context header, metrics] */
+static int unpack_compact_context(mpack_reader_t *reader, struct cmt *cmt)
+{
+    int                               result;
+    struct cmt_msgpack_decode_context decode_context;
+
+    if (NULL == reader ||
+        NULL == cmt) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (4 != cmt_mpack_peek_array_length(reader)) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    memset(&decode_context, 0, sizeof(struct cmt_msgpack_decode_context));
+
+    decode_context.cmt = cmt;
+    decode_context.compact = CMT_TRUE;
+
+    result = cmt_mpack_unpack_array(reader,
+                                    unpack_compact_context_entry,
+                                    (void *) &decode_context);
+
+    if (NULL != decode_context.dictionary) {
+        free(decode_context.dictionary);
+    }
+
+    return result;
+}
+
+/*
+ * Convert cmetrics msgpack payload and generate a CMetrics context, compact
+ * payloads are told apart by their top level array.
+ */
 int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
                               size_t *offset)
 {
     struct cmt     *cmt;
     mpack_reader_t  reader;
+    mpack_tag_t     tag;
     int             result;
     size_t          remainder;
 
@@ -2180,7 +2804,15 @@ int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size
 
     mpack_reader_init_data(&reader, &in_buf[*offset], in_size);
 
-    result = unpack_context(&reader, cmt);
+    tag = mpack_peek_tag(&reader);
+
+    if (mpack_ok == mpack_reader_error(&reader) &&
+        mpack_type_array == mpack_tag_type(&tag)) {
+        result = unpack_compact_context(&reader, cmt);
+    }
+    else {
+        result = unpack_context(&reader, cmt);
+    }
 
     remainder = mpack_reader_remaining(&reader, NULL);
 
@@ -2198,9 +2830,407 @@ int cmt_decode_msgpack_create(struct cmt **out_cmt, char *in_buf, size_t in_size
     return result;
 }
 
+int cmt_decode_msgpack_merge(struct cmt *dst, char *in_buf, size_t in_size,
+                             size_t *offset)
+{
+    struct cmt *cmt;
+    int         result;
+
+    if (NULL == dst) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_msgpack_create(&cmt, in_buf, in_size, offset);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (0 != cmt_cat_move(dst, cmt)) {
+        result = CMT_DECODE_MSGPACK_MERGE_ERROR;
+    }
+
+    cmt_decode_msgpack_destroy(cmt);
+
+    return result;
+}
+
 void cmt_decode_msgpack_destroy(struct cmt *cmt)
 {
     if (NULL != cmt) {
         cmt_destroy(cmt);
     }
 }
+
+/*
+ * Parallel decoding
+ * -----------------
+ * The context boundaries are found by skipping over the msgpack objects,
+ * then every worker decodes a contiguous range of contexts so the results
+ * can be put back in buffer order.
+ */
+
+#define MSGPACK_SCAN_INITIAL_CHUNK_COUNT 16
+
+struct msgpack_decode_worker {
+    char                     *buffer;
+    struct cmt_msgpack_chunk *chunks;
+    size_t                    chunk_count;
+
+    /* one context per chunk, or a single merged one */
+    struct cmt              **contexts;
+    int                       merge;
+    struct cmt               *partial;
+
+    int                       result;
+#ifdef CMT_HAVE_PTHREAD
+    pthread_t                 thread;
+    int                       started;
+#endif
+};
+
+int cmt_decode_msgpack_scan(char *in_buf, size_t in_size,
+                            struct cmt_msgpack_chunk **out_chunks,
+                            size_t *out_chunk_count)
+{
+    int                       result;
+    size_t                    offset;
+    size_t                    size;
+    size_t                    capacity;
+    size_t                    count;
+    struct cmt_msgpack_chunk *chunks;
+    struct cmt_msgpack_chunk *tmp;
+
+    if (NULL == in_buf ||
+        NULL == out_chunks ||
+        NULL == out_chunk_count) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    *out_chunks = NULL;
+    *out_chunk_count = 0;
+
+    if (0 == in_size) {
+        return CMT_DECODE_MSGPACK_INSUFFICIENT_DATA;
+    }
+
+    chunks = NULL;
+    capacity = 0;
+    count = 0;
+    offset = 0;
+
+    while (offset < in_size) {
+        result = cmt_mpack_skip_object(&in_buf[offset], in_size - offset, &size);
+
+        if (CMT_MPACK_SUCCESS != result) {
+            free(chunks);
+
+            return result;
+        }
+
+        if (count == capacity) {
+            capacity = capacity == 0 ? MSGPACK_SCAN_INITIAL_CHUNK_COUNT : capacity * 2;
+
+            tmp = realloc(chunks, capacity * sizeof(struct cmt_msgpack_chunk));
+
+            if (NULL == tmp) {
+                cmt_errno();
+                free(chunks);
+
+                return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+            }
+
+            chunks = tmp;
+        }
+
+        chunks[count].offset = offset;
+        chunks[count].size = size;
+        count++;
+
+        offset += size;
+    }
+
+    *out_chunks = chunks;
+    *out_chunk_count = count;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+void cmt_decode_msgpack_scan_destroy(struct cmt_msgpack_chunk *chunks)
+{
+    if (NULL != chunks) {
+        free(chunks);
+    }
+}
+
+static void *decode_worker_run(void *data)
+{
+    int                           result;
+    size_t                        index;
+    size_t                        offset;
+    struct cmt                   *cmt;
+    struct cmt_msgpack_chunk     *chunk;
+    struct msgpack_decode_worker *worker;
+
+    worker = (struct msgpack_decode_worker *) data;
+
+    for (index = 0 ; index < worker->chunk_count ; index++) {
+        chunk = &worker->chunks[index];
+        offset = 0;
+
+        result = cmt_decode_msgpack_create(&cmt, &worker->buffer[chunk->offset],
+                                           chunk->size, &offset);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            worker->result = result;
+
+            return NULL;
+        }
+
+        if (!worker->merge) {
+            worker->contexts[index] = cmt;
+        }
+        else if (NULL == worker->partial) {
+            /* the first context of the range is the merge target */
+            worker->partial = cmt;
+        }
+        else {
+            result = cmt_cat_move(worker->partial, cmt);
+            cmt_decode_msgpack_destroy(cmt);
+
+            if (0 != result) {
+                worker->result = CMT_DECODE_MSGPACK_MERGE_ERROR;
+
+                return NULL;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void decode_workers_run(struct msgpack_decode_worker *workers,
+                               size_t worker_count)
+{
+    size_t index;
+
+#ifdef CMT_HAVE_PTHREAD
+    /* the calling thread takes the last range */
+    for (index = 0 ; index + 1 < worker_count ; index++) {
+        workers[index].started = (0 == pthread_create(&workers[index].thread, NULL,
+                                                      decode_worker_run,
+                                                      &workers[index]));
+
+        /* a worker that cannot be started runs in the calling thread */
+        if (!workers[index].started) {
+            decode_worker_run(&workers[index]);
+        }
+    }
+
+    decode_worker_run(&workers[worker_count - 1]);
+
+    for (index = 0 ; index + 1 < worker_count ; index++) {
+        if (workers[index].started) {
+            pthread_join(workers[index].thread, NULL);
+        }
+    }
+#else
+    for (index = 0 ; index < worker_count ; index++) {
+        decode_worker_run(&workers[index]);
+    }
+#endif
+}
+
+/* Split the chunks into contiguous ranges of about the same size in bytes */
+static struct msgpack_decode_worker *decode_workers_create(char *in_buf,
+                                                           struct cmt_msgpack_chunk *chunks,
+                                                           size_t chunk_count,
+                                                           size_t *worker_count)
+{
+    size_t                        index;
+    size_t                        next;
+    size_t                        total;
+    size_t                        assigned;
+    struct msgpack_decode_worker *workers;
+
+#ifndef CMT_HAVE_PTHREAD
+    *worker_count = 1;
+#endif
+
+    if (0 == *worker_count) {
+        *worker_count = 1;
+    }
+
+    if (*worker_count > chunk_count) {
+        *worker_count = chunk_count;
+    }
+
+    workers = calloc(*worker_count, sizeof(struct msgpack_decode_worker));
+
+    if (NULL == workers) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    total = 0;
+
+    for (index = 0 ; index < chunk_count ; index++) {
+        total += chunks[index].size;
+    }
+
+    next = 0;
+    assigned = 0;
+
+    for (index = 0 ; index < *worker_count ; index++) {
+        workers[index].buffer = in_buf;
+        workers[index].chunks = &chunks[next];
+
+        /* leave at least one chunk for each of the remaining workers */
+        while (next < chunk_count - (*worker_count - index - 1) &&
+               (0 == workers[index].chunk_count ||
+                index + 1 == *worker_count ||
+                assigned < total / *worker_count * (index + 1))) {
+            assigned += chunks[next].size;
+            workers[index].chunk_count++;
+            next++;
+        }
+    }
+
+    return workers;
+}
+
+static int decode_parallel(char *in_buf, size_t in_size, size_t worker_count,
+                           struct cfl_list *out_context_list, struct cmt *dst)
+{
+    int                           result;
+    size_t                        index;
+    size_t                        chunk_index;
+    size_t                        chunk_count;
+    struct cmt                  **contexts;
+    struct cmt_msgpack_chunk     *chunks;
+    struct msgpack_decode_worker *workers;
+
+    result = cmt_decode_msgpack_scan(in_buf, in_size, &chunks, &chunk_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    contexts = NULL;
+
+    if (NULL != out_context_list) {
+        contexts = calloc(chunk_count, sizeof(struct cmt *));
+
+        if (NULL == contexts) {
+            cmt_errno();
+            cmt_decode_msgpack_scan_destroy(chunks);
+
+            return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+        }
+    }
+
+    workers = decode_workers_create(in_buf, chunks, chunk_count, &worker_count);
+
+    if (NULL == workers) {
+        free(contexts);
+        cmt_decode_msgpack_scan_destroy(chunks);
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < worker_count ; index++) {
+        workers[index].merge = (NULL == out_context_list);
+
+        if (NULL != contexts) {
+            workers[index].contexts = &contexts[workers[index].chunks - chunks];
+        }
+    }
+
+    decode_workers_run(workers, worker_count);
+
+    for (index = 0 ; index < worker_count ; index++) {
+        if (CMT_DECODE_MSGPACK_SUCCESS != workers[index].result) {
+            result = workers[index].result;
+            break;
+        }
+    }
+
+    /* the partial results are merged in buffer order */
+    for (index = 0 ; index < worker_count ; index++) {
+        if (NULL == workers[index].partial) {
+            continue;
+        }
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result &&
+            0 != cmt_cat_move(dst, workers[index].partial)) {
+            result = CMT_DECODE_MSGPACK_MERGE_ERROR;
+        }
+
+        cmt_decode_msgpack_destroy(workers[index].partial);
+    }
+
+    if (NULL != contexts) {
+        for (chunk_index = 0 ; chunk_index < chunk_count ; chunk_index++) {
+            if (NULL == contexts[chunk_index]) {
+                continue;
+            }
+
+            if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+                cfl_list_add(&contexts[chunk_index]->_head, out_context_list);
+            }
+            else {
+                cmt_decode_msgpack_destroy(contexts[chunk_index]);
+            }
+        }
+
+        free(contexts);
+    }
+
+    free(workers);
+    cmt_decode_msgpack_scan_destroy(chunks);
+
+    return result;
+}
+
+int cmt_decode_msgpack_parallel_create(struct cfl_list *out_context_list,
+                                       char *in_buf, size_t in_size,
+                                       size_t worker_count)
+{
+    if (NULL == out_context_list ||
+        NULL == in_buf) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return decode_parallel(in_buf, in_size, worker_count, out_context_list, NULL);
+}
+
+int cmt_decode_msgpack_parallel_merge(struct cmt *dst,
+                                      char *in_buf, size_t in_size,
+                                      size_t worker_count)
+{
+    if (NULL == dst ||
+        NULL == in_buf) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    return decode_parallel(in_buf, in_size, worker_count, NULL, dst);
+}
+
+void cmt_decode_msgpack_parallel_destroy(struct cfl_list *context_list)
+{
+    struct cfl_list *tmp;
+    struct cfl_list *head;
+    struct cmt      *cmt;
+
+    if (NULL == context_list) {
+        return;
+    }
+
+    cfl_list_foreach_safe(head, tmp, context_list) {
+        cmt = cfl_list_entry(head, struct cmt, _head);
+
+        cfl_list_del(&cmt->_head);
+        cmt_decode_msgpack_destroy(cmt);
+    }
+}
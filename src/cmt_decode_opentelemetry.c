@@ -28,23 +28,53 @@
 #include <cmetrics/cmt_untyped.h>
 #include <cmetrics/cmt_atomic.h>
 #include <cmetrics/cmt_compat.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_decode_opentelemetry.h>
+#include <cmetrics/cmt_json.h>
+
+#include "cmt_protobuf_wire.h"
 
 #include <math.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <limits.h>
 
-static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyValue *source);
+#define CMT_DECODE_OPENTELEMETRY_LABEL_SLOTS 32
+
+/* field numbers used by the streaming decoder */
+#define OTLP_EXPORT_REQUEST_RESOURCE_METRICS    1
+#define OTLP_RESOURCE_METRICS_SCOPE_METRICS     2
+#define OTLP_SCOPE_METRICS_SCOPE                1
+#define OTLP_SCOPE_METRICS_METRICS              2
+#define OTLP_SCOPE_METRICS_SCHEMA_URL           3
+#define OTLP_METRIC_NAME                        1
+#define OTLP_METRIC_DESCRIPTION                 2
+#define OTLP_METRIC_UNIT                        3
+#define OTLP_METRIC_GAUGE                       5
+#define OTLP_METRIC_SUM                         7
+#define OTLP_METRIC_HISTOGRAM                   9
+#define OTLP_METRIC_EXPONENTIAL_HISTOGRAM      10
+#define OTLP_METRIC_SUMMARY                    11
+#define OTLP_METRIC_METADATA                   12
+#define OTLP_DATA_DATA_POINTS                   1
+#define OTLP_DATA_AGGREGATION_TEMPORALITY       2
+#define OTLP_SUM_IS_MONOTONIC                   3
+
+static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyValue *source,
+                                         int referenced);
 
 static int clone_array(struct cfl_array *target,
-                       Opentelemetry__Proto__Common__V1__ArrayValue *source);
+                       Opentelemetry__Proto__Common__V1__ArrayValue *source,
+                       int referenced);
 static int clone_array_entry(struct cfl_array *target,
-                             Opentelemetry__Proto__Common__V1__AnyValue *source);
+                             Opentelemetry__Proto__Common__V1__AnyValue *source,
+                             int referenced);
 static int clone_kvlist(struct cfl_kvlist *target,
-                                Opentelemetry__Proto__Common__V1__KeyValueList *source);
+                                Opentelemetry__Proto__Common__V1__KeyValueList *source,
+                                int referenced);
 static int clone_kvlist_entry(struct cfl_kvlist *target,
-                           Opentelemetry__Proto__Common__V1__KeyValue *source);
+                           Opentelemetry__Proto__Common__V1__KeyValue *source,
+                           int referenced);
 
 static struct cmt_map_label *create_label(char *caption, size_t length);
 static int append_new_map_label_key(struct cmt_map *map, char *name);
@@ -58,9 +88,17 @@ static struct cfl_kvlist *get_or_create_data_point_metadata_context(struct cmt *
                                                                      uint64_t timestamp);
 static int clone_exemplars_to_kvlist(struct cfl_kvlist *target,
                                      Opentelemetry__Proto__Metrics__V1__Exemplar **exemplars,
-                                     size_t exemplar_count);
-
-static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyValue *source)
+                                     size_t exemplar_count,
+                                     int referenced);
+
+/*
+ * When 'referenced' is set the request was unpacked into a caller provided
+ * arena that outlives the decoded contexts, string values then point to the
+ * unpacked data instead of being duplicated. Bytes are always copied since
+ * their consumers expect a cfl_sds_t.
+ */
+static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyValue *source,
+                                         int referenced)
 {
     struct cfl_kvlist  *new_child_kvlist;
     struct cfl_array   *new_child_array;
@@ -71,7 +109,9 @@ static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyVa
         return NULL;
     }
     if (source->value_case == OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE) {
-        result_instance = cfl_variant_create_from_string(source->string_value);
+        result_instance = cfl_variant_create_from_string_s(source->string_value,
+                                                           strlen(source->string_value),
+                                                           referenced);
     }
     else if (source->value_case == OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE_STRINDEX) {
         result_instance = cfl_variant_create_from_string("");
@@ -99,7 +139,7 @@ static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyVa
             return NULL;
         }
 
-        result = clone_kvlist(new_child_kvlist, source->kvlist_value);
+        result = clone_kvlist(new_child_kvlist, source->kvlist_value, referenced);
         if (result) {
             cfl_variant_destroy(result_instance);
 
@@ -120,7 +160,7 @@ static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyVa
             return NULL;
         }
 
-        result = clone_array(new_child_array, source->array_value);
+        result = clone_array(new_child_array, source->array_value, referenced);
         if (result) {
             cfl_variant_destroy(result_instance);
 
@@ -136,7 +176,8 @@ static struct cfl_variant *clone_variant(Opentelemetry__Proto__Common__V1__AnyVa
 }
 
 static int clone_array(struct cfl_array *target,
-                       Opentelemetry__Proto__Common__V1__ArrayValue *source)
+                       Opentelemetry__Proto__Common__V1__ArrayValue *source,
+                       int referenced)
 {
     int    result;
     size_t index;
@@ -147,14 +188,15 @@ static int clone_array(struct cfl_array *target,
          result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
          index < source->n_values ;
          index++) {
-        result = clone_array_entry(target, source->values[index]);
+        result = clone_array_entry(target, source->values[index], referenced);
     }
 
     return result;
 }
 
 static int clone_array_entry(struct cfl_array *target,
-                             Opentelemetry__Proto__Common__V1__AnyValue *source)
+                             Opentelemetry__Proto__Common__V1__AnyValue *source,
+                             int referenced)
 {
     struct cfl_variant *new_child_instance;
     int                 result;
@@ -164,7 +206,7 @@ static int clone_array_entry(struct cfl_array *target,
         return CMT_DECODE_OPENTELEMETRY_SUCCESS;
     }
 
-    new_child_instance = clone_variant(source);
+    new_child_instance = clone_variant(source, referenced);
     if (new_child_instance == NULL) {
         return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
     }
@@ -179,7 +221,8 @@ static int clone_array_entry(struct cfl_array *target,
 }
 
 static int clone_kvlist(struct cfl_kvlist *target,
-                        Opentelemetry__Proto__Common__V1__KeyValueList *source)
+                        Opentelemetry__Proto__Common__V1__KeyValueList *source,
+                        int referenced)
 {
     int    result;
     size_t index;
@@ -190,14 +233,15 @@ static int clone_kvlist(struct cfl_kvlist *target,
          result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
          index < source->n_values ;
          index++) {
-        result = clone_kvlist_entry(target, source->values[index]);
+        result = clone_kvlist_entry(target, source->values[index], referenced);
     }
 
     return result;
 }
 
 static int clone_kvlist_entry(struct cfl_kvlist *target,
-                              Opentelemetry__Proto__Common__V1__KeyValue *source)
+                              Opentelemetry__Proto__Common__V1__KeyValue *source,
+                              int referenced)
 {
     struct cfl_variant *new_child_instance;
     int                 result;
@@ -211,7 +255,7 @@ static int clone_kvlist_entry(struct cfl_kvlist *target,
         return CMT_DECODE_OPENTELEMETRY_SUCCESS;
     }
 
-    new_child_instance = clone_variant(source->value);
+    new_child_instance = clone_variant(source->value, referenced);
 
     if (new_child_instance == NULL) {
         return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
@@ -228,6 +272,13 @@ static int clone_kvlist_entry(struct cfl_kvlist *target,
     return CMT_DECODE_OPENTELEMETRY_SUCCESS;
 }
 
+static int insert_metadata_string(struct cfl_kvlist *kvlist, char *key,
+                                  char *value, int referenced)
+{
+    return cfl_kvlist_insert_string_s(kvlist, key, strlen(key),
+                                      value, strlen(value), referenced);
+}
+
 struct cfl_kvlist *get_or_create_external_metadata_kvlist(
     struct cfl_kvlist *root, char *key)
 {
@@ -419,7 +470,8 @@ static struct cfl_kvlist *get_or_create_data_point_metadata_context(struct cmt *
 
 static int clone_exemplars_to_kvlist(struct cfl_kvlist *target,
                                      Opentelemetry__Proto__Metrics__V1__Exemplar **exemplars,
-                                     size_t exemplar_count)
+                                     size_t exemplar_count,
+                                     int referenced)
 {
     size_t index;
     size_t entry_index;
@@ -499,7 +551,7 @@ static int clone_exemplars_to_kvlist(struct cfl_kvlist *target,
             }
 
             for (entry_index = 0 ; entry_index < exemplars[index]->n_filtered_attributes ; entry_index++) {
-                result = clone_kvlist_entry(filtered_attributes, exemplars[index]->filtered_attributes[entry_index]);
+                result = clone_kvlist_entry(filtered_attributes, exemplars[index]->filtered_attributes[entry_index], referenced);
                 if (result != 0) {
                     cfl_kvlist_destroy(filtered_attributes);
                     cfl_kvlist_destroy(entry);
@@ -572,6 +624,7 @@ static int decode_data_point_labels(struct cmt *cmt,
                                     Opentelemetry__Proto__Common__V1__KeyValue **attribute_list)
 {
     char                                        dummy_label_value[32];
+    void                                       *value_index_buffer[CMT_DECODE_OPENTELEMETRY_LABEL_SLOTS];
     void                                      **value_index_list;
     size_t                                      alloc_count;
     size_t                                      attribute_index;
@@ -600,10 +653,20 @@ static int decode_data_point_labels(struct cmt *cmt,
     }
 
     alloc_count = map_label_count + attribute_count;
-    value_index_list = calloc(alloc_count, sizeof(void *));
 
-    if (value_index_list == NULL) {
-        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    /* most data points carry a handful of labels, avoid a heap round trip */
+    if (alloc_count <= CMT_DECODE_OPENTELEMETRY_LABEL_SLOTS) {
+        memset(value_index_buffer, 0, sizeof(void *) * alloc_count);
+        value_index_list = value_index_buffer;
+    }
+    else {
+        value_index_list = calloc(alloc_count, sizeof(void *));
+
+        if (value_index_list == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
     }
 
     for (attribute_index = 0 ;
@@ -718,14 +781,17 @@ static int decode_data_point_labels(struct cmt *cmt,
         }
     }
 
-    free(value_index_list);
+    if (value_index_list != value_index_buffer) {
+        free(value_index_list);
+    }
 
     return result;
 }
 
 static int decode_numerical_data_point(struct cmt *cmt,
                                        struct cmt_map *map,
-                                       Opentelemetry__Proto__Metrics__V1__NumberDataPoint *data_point)
+                                       Opentelemetry__Proto__Metrics__V1__NumberDataPoint *data_point,
+                                       int referenced)
 {
     int                static_metric_detected;
     struct cmt_metric *sample;
@@ -807,7 +873,7 @@ static int decode_numerical_data_point(struct cmt *cmt,
             else {
                 cfl_kvlist_insert_string(point_metadata, "number_value_case", "double");
             }
-            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars);
+            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars, referenced);
         }
 
         if (data_point->start_time_unix_nano > 0) {
@@ -824,7 +890,8 @@ static int decode_numerical_data_point(struct cmt *cmt,
 static int decode_numerical_data_point_list(struct cmt *cmt,
                                             struct cmt_map *map,
                                             size_t data_point_count,
-                                            Opentelemetry__Proto__Metrics__V1__NumberDataPoint **data_point_list)
+                                            Opentelemetry__Proto__Metrics__V1__NumberDataPoint **data_point_list,
+                                            int referenced)
 {
     size_t index;
     int    result;
@@ -842,7 +909,7 @@ static int decode_numerical_data_point_list(struct cmt *cmt,
             return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
         }
 
-        result = decode_numerical_data_point(cmt, map, data_point_list[index]);
+        result = decode_numerical_data_point(cmt, map, data_point_list[index], referenced);
     }
 
     return result;
@@ -999,7 +1066,8 @@ static int decode_summary_data_point_list(struct cmt *cmt,
 
 static int decode_histogram_data_point(struct cmt *cmt,
                                        struct cmt_map *map,
-                                       Opentelemetry__Proto__Metrics__V1__HistogramDataPoint *data_point)
+                                       Opentelemetry__Proto__Metrics__V1__HistogramDataPoint *data_point,
+                                       int referenced)
 {
     int                   static_metric_detected;
     struct cmt_histogram *histogram;
@@ -1117,7 +1185,7 @@ static int decode_histogram_data_point(struct cmt *cmt,
                 cfl_kvlist_insert_bool(point_metadata, "has_max", CFL_TRUE);
                 cfl_kvlist_insert_double(point_metadata, "max", data_point->max);
             }
-            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars);
+            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars, referenced);
         }
 
         if (data_point->start_time_unix_nano > 0) {
@@ -1134,7 +1202,8 @@ static int decode_histogram_data_point(struct cmt *cmt,
 static int decode_histogram_data_point_list(struct cmt *cmt,
                                             struct cmt_map *map,
                                             size_t data_point_count,
-                                            Opentelemetry__Proto__Metrics__V1__HistogramDataPoint **data_point_list)
+                                            Opentelemetry__Proto__Metrics__V1__HistogramDataPoint **data_point_list,
+                                            int referenced)
 {
     size_t index;
     int    result;
@@ -1152,7 +1221,7 @@ static int decode_histogram_data_point_list(struct cmt *cmt,
             return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
         }
 
-        result = decode_histogram_data_point(cmt, map, data_point_list[index]);
+        result = decode_histogram_data_point(cmt, map, data_point_list[index], referenced);
     }
 
     return result;
@@ -1160,7 +1229,8 @@ static int decode_histogram_data_point_list(struct cmt *cmt,
 
 static int decode_counter_entry(struct cmt *cmt,
     void *instance,
-    Opentelemetry__Proto__Metrics__V1__Sum *metric)
+    Opentelemetry__Proto__Metrics__V1__Sum *metric,
+    int referenced)
 {
     struct cmt_counter *counter;
     int                 result;
@@ -1175,7 +1245,8 @@ static int decode_counter_entry(struct cmt *cmt,
     result = decode_numerical_data_point_list(cmt,
                                               counter->map,
                                               metric->n_data_points,
-                                              metric->data_points);
+                                              metric->data_points,
+                                              referenced);
 
     if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
         if (metric->aggregation_temporality == OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA) {
@@ -1195,7 +1266,8 @@ static int decode_counter_entry(struct cmt *cmt,
 
 static int decode_gauge_entry(struct cmt *cmt,
     void *instance,
-    Opentelemetry__Proto__Metrics__V1__Gauge *metric)
+    Opentelemetry__Proto__Metrics__V1__Gauge *metric,
+    int referenced)
 {
     struct cmt_gauge *gauge;
     int               result;
@@ -1207,7 +1279,8 @@ static int decode_gauge_entry(struct cmt *cmt,
     result = decode_numerical_data_point_list(cmt,
                                               gauge->map,
                                               metric->n_data_points,
-                                              metric->data_points);
+                                              metric->data_points,
+                                              referenced);
 
     return result;
 }
@@ -1239,7 +1312,8 @@ static int decode_summary_entry(struct cmt *cmt,
 
 static int decode_histogram_entry(struct cmt *cmt,
     void *instance,
-    Opentelemetry__Proto__Metrics__V1__Histogram *metric)
+    Opentelemetry__Proto__Metrics__V1__Histogram *metric,
+    int referenced)
 {
     struct cmt_histogram *histogram;
     int                   result;
@@ -1252,7 +1326,8 @@ static int decode_histogram_entry(struct cmt *cmt,
     result = decode_histogram_data_point_list(cmt,
                                               histogram->map,
                                               metric->n_data_points,
-                                              metric->data_points);
+                                              metric->data_points,
+                                              referenced);
 
     if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
         if (metric->aggregation_temporality == OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA) {
@@ -1271,7 +1346,8 @@ static int decode_histogram_entry(struct cmt *cmt,
 
 static int decode_exponential_histogram_data_point(struct cmt *cmt,
                                                    struct cmt_map *map,
-                                                   Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint *data_point)
+                                                   Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint *data_point,
+                                                   int referenced)
 {
     Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint__Buckets *positive;
     Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint__Buckets *negative;
@@ -1410,7 +1486,7 @@ static int decode_exponential_histogram_data_point(struct cmt *cmt,
                 cfl_kvlist_insert_bool(point_metadata, "has_max", CFL_TRUE);
                 cfl_kvlist_insert_double(point_metadata, "max", data_point->max);
             }
-            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars);
+            clone_exemplars_to_kvlist(point_metadata, data_point->exemplars, data_point->n_exemplars, referenced);
         }
 
         if (data_point->start_time_unix_nano > 0) {
@@ -1428,7 +1504,8 @@ static int decode_exponential_histogram_data_point_list(
     struct cmt *cmt,
     struct cmt_map *map,
     size_t data_point_count,
-    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint **data_point_list)
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint **data_point_list,
+    int referenced)
 {
     size_t index;
     int    result;
@@ -1447,7 +1524,7 @@ static int decode_exponential_histogram_data_point_list(
             return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
         }
 
-        result = decode_exponential_histogram_data_point(cmt, map, data_point_list[index]);
+        result = decode_exponential_histogram_data_point(cmt, map, data_point_list[index], referenced);
     }
 
     return result;
@@ -1455,7 +1532,8 @@ static int decode_exponential_histogram_data_point_list(
 
 static int decode_exponential_histogram_entry(struct cmt *cmt,
     void *instance,
-    Opentelemetry__Proto__Metrics__V1__ExponentialHistogram *metric)
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogram *metric,
+    int referenced)
 {
     struct cmt_exp_histogram *exp_histogram;
     int                       result;
@@ -1467,7 +1545,8 @@ static int decode_exponential_histogram_entry(struct cmt *cmt,
     result = decode_exponential_histogram_data_point_list(cmt,
                                                           exp_histogram->map,
                                                           metric->n_data_points,
-                                                          metric->data_points);
+                                                          metric->data_points,
+                                                          referenced);
 
     if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
         if (metric->aggregation_temporality == OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA) {
@@ -1485,7 +1564,8 @@ static int decode_exponential_histogram_entry(struct cmt *cmt,
 }
 
 static int decode_metrics_entry(struct cmt *cmt,
-    Opentelemetry__Proto__Metrics__V1__Metric *metric)
+    Opentelemetry__Proto__Metrics__V1__Metric *metric,
+    int referenced)
 {
     char *metric_description;
     char *metric_namespace;
@@ -1538,7 +1618,7 @@ static int decode_metrics_entry(struct cmt *cmt,
             return result;
         }
 
-        result = decode_counter_entry(cmt, instance, metric->sum);
+        result = decode_counter_entry(cmt, instance, metric->sum, referenced);
 
         if (result) {
             cmt_counter_destroy(instance);
@@ -1553,7 +1633,7 @@ static int decode_metrics_entry(struct cmt *cmt,
                 metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
                 if (metric_metadata != NULL) {
                     for (index = 0; index < metric->n_metadata; index++) {
-                        clone_kvlist_entry(metric_metadata, metric->metadata[index]);
+                        clone_kvlist_entry(metric_metadata, metric->metadata[index], referenced);
                     }
                 }
             }
@@ -1582,7 +1662,7 @@ static int decode_metrics_entry(struct cmt *cmt,
             return result;
         }
 
-        result = decode_gauge_entry(cmt, instance, metric->gauge);
+        result = decode_gauge_entry(cmt, instance, metric->gauge, referenced);
 
         if (result) {
             cmt_gauge_destroy(instance);
@@ -1597,7 +1677,7 @@ static int decode_metrics_entry(struct cmt *cmt,
                 metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
                 if (metric_metadata != NULL) {
                     for (index = 0; index < metric->n_metadata; index++) {
-                        clone_kvlist_entry(metric_metadata, metric->metadata[index]);
+                        clone_kvlist_entry(metric_metadata, metric->metadata[index], referenced);
                     }
                 }
             }
@@ -1646,7 +1726,7 @@ static int decode_metrics_entry(struct cmt *cmt,
                 metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
                 if (metric_metadata != NULL) {
                     for (index = 0; index < metric->n_metadata; index++) {
-                        clone_kvlist_entry(metric_metadata, metric->metadata[index]);
+                        clone_kvlist_entry(metric_metadata, metric->metadata[index], referenced);
                     }
                 }
             }
@@ -1676,7 +1756,7 @@ static int decode_metrics_entry(struct cmt *cmt,
             return result;
         }
 
-        result = decode_histogram_entry(cmt, instance, metric->histogram);
+        result = decode_histogram_entry(cmt, instance, metric->histogram, referenced);
 
         if (result) {
             cmt_histogram_destroy(instance);
@@ -1691,7 +1771,7 @@ static int decode_metrics_entry(struct cmt *cmt,
                 metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
                 if (metric_metadata != NULL) {
                     for (index = 0; index < metric->n_metadata; index++) {
-                        clone_kvlist_entry(metric_metadata, metric->metadata[index]);
+                        clone_kvlist_entry(metric_metadata, metric->metadata[index], referenced);
                     }
                 }
             }
@@ -1722,7 +1802,8 @@ static int decode_metrics_entry(struct cmt *cmt,
 
         result = decode_exponential_histogram_entry(cmt,
                                                     instance,
-                                                    metric->exponential_histogram);
+                                                    metric->exponential_histogram,
+                                                    referenced);
 
         if (result) {
             cmt_exp_histogram_destroy(instance);
@@ -1737,7 +1818,7 @@ static int decode_metrics_entry(struct cmt *cmt,
                 metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
                 if (metric_metadata != NULL) {
                     for (index = 0; index < metric->n_metadata; index++) {
-                        clone_kvlist_entry(metric_metadata, metric->metadata[index]);
+                        clone_kvlist_entry(metric_metadata, metric->metadata[index], referenced);
                     }
                 }
             }
@@ -1751,7 +1832,8 @@ static int decode_metrics_entry(struct cmt *cmt,
 }
 
 static int decode_scope_metadata_and_attributes(struct cfl_kvlist *external_metadata,
-    Opentelemetry__Proto__Common__V1__InstrumentationScope *scope)
+    Opentelemetry__Proto__Common__V1__InstrumentationScope *scope,
+    int referenced)
 {
     struct cfl_kvlist *attributes;
     struct cfl_kvlist *metadata;
@@ -1782,7 +1864,7 @@ static int decode_scope_metadata_and_attributes(struct cfl_kvlist *external_meta
     }
 
     if (scope->name != NULL) {
-        result = cfl_kvlist_insert_string(metadata, "name", scope->name);
+        result = insert_metadata_string(metadata, "name", scope->name, referenced);
 
         if (result != 0) {
             return -4;
@@ -1790,7 +1872,7 @@ static int decode_scope_metadata_and_attributes(struct cfl_kvlist *external_meta
     }
 
     if (scope->version != NULL) {
-        result = cfl_kvlist_insert_string(metadata, "version", scope->version);
+        result = insert_metadata_string(metadata, "version", scope->version, referenced);
 
         if (result != 0) {
             return -5;
@@ -1808,7 +1890,8 @@ static int decode_scope_metadata_and_attributes(struct cfl_kvlist *external_meta
          index < scope->n_attributes ;
          index++) {
          result = clone_kvlist_entry(attributes,
-                                     scope->attributes[index]);
+                                     scope->attributes[index],
+                                     referenced);
     }
 
     if (result != 0) {
@@ -1819,7 +1902,8 @@ static int decode_scope_metadata_and_attributes(struct cfl_kvlist *external_meta
 }
 
 static int decode_scope_metrics_metadata(struct cfl_kvlist *external_metadata,
-    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics)
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics,
+    int referenced)
 {
     struct cfl_kvlist *scope_metrics_metadata;
     struct cfl_kvlist *scope_metrics_root;
@@ -1842,7 +1926,7 @@ static int decode_scope_metrics_metadata(struct cfl_kvlist *external_metadata,
     }
 
     if (scope_metrics->schema_url != NULL) {
-        result = cfl_kvlist_insert_string(scope_metrics_metadata, "schema_url", scope_metrics->schema_url);
+        result = insert_metadata_string(scope_metrics_metadata, "schema_url", scope_metrics->schema_url, referenced);
 
         if (result != 0) {
             return -3;
@@ -1853,7 +1937,8 @@ static int decode_scope_metrics_metadata(struct cfl_kvlist *external_metadata,
 }
 
 static int decode_scope_metrics_entry(struct cfl_list *context_list,
-    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *metrics)
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *metrics,
+    int referenced)
 {
     struct cmt *context;
     int         result;
@@ -1881,7 +1966,8 @@ static int decode_scope_metrics_entry(struct cfl_list *context_list,
 
     if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
         result = decode_scope_metadata_and_attributes(context->external_metadata,
-                                                      metrics->scope);
+                                                      metrics->scope,
+                                                      referenced);
 
         if (result != 0) {
             result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
@@ -1890,7 +1976,8 @@ static int decode_scope_metrics_entry(struct cfl_list *context_list,
 
     if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
         result = decode_scope_metrics_metadata(context->external_metadata,
-                                               metrics);
+                                               metrics,
+                                               referenced);
 
         if (result != 0) {
             result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
@@ -1910,7 +1997,8 @@ static int decode_scope_metrics_entry(struct cfl_list *context_list,
          index < metrics->n_metrics ;
          index++) {
         result = decode_metrics_entry(context,
-                                      metrics->metrics[index]);
+                                      metrics->metrics[index],
+                                      referenced);
     }
 
     return result;
@@ -1918,7 +2006,8 @@ static int decode_scope_metrics_entry(struct cfl_list *context_list,
 
 
 static int decode_resource_metadata_and_attributes(struct cfl_kvlist *external_metadata,
-    Opentelemetry__Proto__Resource__V1__Resource *resource)
+    Opentelemetry__Proto__Resource__V1__Resource *resource,
+    int referenced)
 {
     struct cfl_kvlist *attributes;
     struct cfl_kvlist *metadata;
@@ -1959,7 +2048,8 @@ static int decode_resource_metadata_and_attributes(struct cfl_kvlist *external_m
          index < resource->n_attributes ;
          index++) {
          result = clone_kvlist_entry(attributes,
-                                     resource->attributes[index]);
+                                     resource->attributes[index],
+                                     referenced);
     }
 
     if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
@@ -1970,7 +2060,8 @@ static int decode_resource_metadata_and_attributes(struct cfl_kvlist *external_m
 }
 
 static int decode_resource_metrics_metadata(struct cfl_kvlist *external_metadata,
-    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics)
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics,
+    int referenced)
 {
     struct cfl_kvlist *resource_metrics_metadata;
     struct cfl_kvlist *resource_metrics_root;
@@ -1993,7 +2084,7 @@ static int decode_resource_metrics_metadata(struct cfl_kvlist *external_metadata
     }
 
     if (resource_metrics->schema_url != NULL) {
-        result = cfl_kvlist_insert_string(resource_metrics_metadata, "schema_url", resource_metrics->schema_url);
+        result = insert_metadata_string(resource_metrics_metadata, "schema_url", resource_metrics->schema_url, referenced);
 
         if (result != 0) {
             return -3;
@@ -2003,9 +2094,39 @@ static int decode_resource_metrics_metadata(struct cfl_kvlist *external_metadata
     return 0;
 }
 
+static int attach_resource_metrics_metadata(struct cmt *context,
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics,
+    int referenced)
+{
+    int result;
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    if (resource_metrics->resource != NULL) {
+        result = decode_resource_metadata_and_attributes(context->external_metadata,
+                                                         resource_metrics->resource,
+                                                         referenced);
+
+        if (result != 0) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+    }
+
+    result = decode_resource_metrics_metadata(context->external_metadata,
+                                              resource_metrics,
+                                              referenced);
+
+    if (result != 0) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
 static int decode_resource_metrics_entry(
     struct cfl_list *context_list,
-    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics)
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics,
+    int referenced)
 {
     struct cmt *context;
     int         result;
@@ -2027,29 +2148,16 @@ static int decode_resource_metrics_entry(
          index < resource_metrics->n_scope_metrics ;
          index++) {
         result = decode_scope_metrics_entry(context_list,
-                    resource_metrics->scope_metrics[index]);
+                    resource_metrics->scope_metrics[index],
+                    referenced);
 
         if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
             context = cfl_list_entry_last(context_list, struct cmt, _head);
 
             if (context != NULL) {
-                if (resource_metrics->resource != NULL) {
-                    result = decode_resource_metadata_and_attributes(context->external_metadata,
-                                                                     resource_metrics->resource);
-
-                    if (result != 0) {
-                        result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
-                    }
-                }
-
-                if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
-                    result = decode_resource_metrics_metadata(context->external_metadata,
-                                                              resource_metrics);
-
-                    if (result != 0) {
-                        result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
-                    }
-                }
+                result = attach_resource_metrics_metadata(context,
+                                                          resource_metrics,
+                                                          referenced);
             }
         }
     }
@@ -2073,7 +2181,8 @@ static void destroy_context_list(struct cfl_list *context_list)
 }
 
 static int decode_service_request(struct cfl_list *context_list,
-    Opentelemetry__Proto__Collector__Metrics__V1__ExportMetricsServiceRequest *service_request)
+    Opentelemetry__Proto__Collector__Metrics__V1__ExportMetricsServiceRequest *service_request,
+    int referenced)
 {
     int    result;
     size_t index;
@@ -2091,43 +2200,2717 @@ static int decode_service_request(struct cfl_list *context_list,
              index++) {
 
             result = decode_resource_metrics_entry(context_list,
-                                                   service_request->resource_metrics[index]);
+                                                   service_request->resource_metrics[index],
+                                                   referenced);
         }
     }
 
     return result;
 }
 
-int cmt_decode_opentelemetry_create(struct cfl_list *result_context_list,
-                                    char *in_buf, size_t in_size,
-                                    size_t *offset)
+static int read_length_delimited(struct cmt_protobuf_reader *reader,
+                                 int wire_type,
+                                 const unsigned char **data,
+                                 size_t *length)
 {
-    Opentelemetry__Proto__Collector__Metrics__V1__ExportMetricsServiceRequest *service_request;
-    int                                                                        result;
+    if (wire_type != CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED ||
+        cmt_protobuf_read_bytes(reader, data, length) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int skip_field(struct cmt_protobuf_reader *reader, int wire_type)
+{
+    if (cmt_protobuf_skip_field(reader, wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int copy_wire_string(cfl_sds_t *target,
+                            const unsigned char *data, size_t length)
+{
+    if (*target != NULL) {
+        cfl_sds_destroy(*target);
+    }
+
+    *target = cfl_sds_create_len((const char *) data, length);
+
+    if (*target == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static struct cmt_map *get_last_metric_map(struct cmt *cmt, int data_case)
+{
+    struct cfl_list *list;
+
+    switch (data_case) {
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+        list = &cmt->counters;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+        list = &cmt->gauges;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+        list = &cmt->summaries;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+        list = &cmt->histograms;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM:
+        list = &cmt->exp_histograms;
+        break;
+    default:
+        return NULL;
+    }
+
+    if (cfl_list_is_empty(list)) {
+        return NULL;
+    }
+
+    switch (data_case) {
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+        return cfl_list_entry_last(list, struct cmt_counter, _head)->map;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+        return cfl_list_entry_last(list, struct cmt_gauge, _head)->map;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+        return cfl_list_entry_last(list, struct cmt_summary, _head)->map;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+        return cfl_list_entry_last(list, struct cmt_histogram, _head)->map;
+    }
+
+    return cfl_list_entry_last(list, struct cmt_exp_histogram, _head)->map;
+}
+
+static int stream_data_point(struct cmt *cmt,
+                             struct cmt_map *map,
+                             int data_case,
+                             const unsigned char *data,
+                             size_t length)
+{
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint *exp_histogram_point;
+    Opentelemetry__Proto__Metrics__V1__HistogramDataPoint            *histogram_point;
+    Opentelemetry__Proto__Metrics__V1__SummaryDataPoint              *summary_point;
+    Opentelemetry__Proto__Metrics__V1__NumberDataPoint               *number_point;
+    int                                                               result;
 
     result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
 
-    cfl_list_init(result_context_list);
+    if (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM ||
+        data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE) {
+        number_point = opentelemetry__proto__metrics__v1__number_data_point__unpack(NULL, length, data);
 
-    service_request = opentelemetry__proto__collector__metrics__v1__export_metrics_service_request__unpack(NULL, in_size - *offset,
-                                                                                                           (unsigned char *) &in_buf[*offset]);
+        if (number_point != NULL) {
+            result = decode_numerical_data_point(cmt, map, number_point, CFL_FALSE);
 
-    if (service_request != NULL) {
-        result = decode_service_request(result_context_list, service_request);
+            opentelemetry__proto__metrics__v1__number_data_point__free_unpacked(number_point, NULL);
+        }
+    }
+    else if (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY) {
+        summary_point = opentelemetry__proto__metrics__v1__summary_data_point__unpack(NULL, length, data);
+
+        if (summary_point != NULL) {
+            result = decode_summary_data_point(cmt, map, summary_point);
+
+            opentelemetry__proto__metrics__v1__summary_data_point__free_unpacked(summary_point, NULL);
+        }
+    }
+    else if (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM) {
+        histogram_point = opentelemetry__proto__metrics__v1__histogram_data_point__unpack(NULL, length, data);
+
+        if (histogram_point != NULL) {
+            result = decode_histogram_data_point(cmt, map, histogram_point, CFL_FALSE);
+
+            opentelemetry__proto__metrics__v1__histogram_data_point__free_unpacked(histogram_point, NULL);
+        }
+    }
+    else if (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM) {
+        exp_histogram_point = opentelemetry__proto__metrics__v1__exponential_histogram_data_point__unpack(NULL, length, data);
+
+        if (exp_histogram_point != NULL) {
+            result = decode_exponential_histogram_data_point(cmt, map, exp_histogram_point, CFL_FALSE);
+
+            opentelemetry__proto__metrics__v1__exponential_histogram_data_point__free_unpacked(exp_histogram_point, NULL);
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Walk the Gauge/Sum/Histogram/... container, 'data_points_pass' selects
+ * between collecting the aggregation settings and decoding the data points.
+ */
+static int stream_metric_data(struct cmt *cmt,
+                              struct cmt_map *map,
+                              int data_case,
+                              const unsigned char *data,
+                              size_t length,
+                              int data_points_pass,
+                              uint64_t *aggregation_temporality,
+                              uint64_t *is_monotonic)
+{
+    struct cmt_protobuf_reader  reader;
+    const unsigned char        *field_data;
+    size_t                      field_length;
+    uint32_t                    field;
+    int                         wire_type;
+    int                         result;
+    int                         has_aggregation;
+
+    has_aggregation = (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM ||
+                       data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM ||
+                       data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM);
+
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (field == OTLP_DATA_DATA_POINTS && data_points_pass) {
+            result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                result = stream_data_point(cmt, map, data_case, field_data, field_length);
+            }
+        }
+        else if (field == OTLP_DATA_AGGREGATION_TEMPORALITY && has_aggregation &&
+                 !data_points_pass && wire_type == CMT_PROTOBUF_WIRE_TYPE_VARINT) {
+            if (cmt_protobuf_read_varint(&reader, aggregation_temporality) != CMT_PROTOBUF_WIRE_SUCCESS) {
+                return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+        }
+        else if (field == OTLP_SUM_IS_MONOTONIC && !data_points_pass &&
+                 data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM &&
+                 wire_type == CMT_PROTOBUF_WIRE_TYPE_VARINT) {
+            if (cmt_protobuf_read_varint(&reader, is_monotonic) != CMT_PROTOBUF_WIRE_SUCCESS) {
+                return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+        }
+        else {
+            result = skip_field(&reader, wire_type);
+        }
+    }
+
+    return result;
+}
 
-        opentelemetry__proto__collector__metrics__v1__export_metrics_service_request__free_unpacked(service_request, NULL);
+static int stream_metric_metadata(struct cmt *cmt,
+                                  struct cmt_map *map,
+                                  const unsigned char *data,
+                                  size_t length)
+{
+    Opentelemetry__Proto__Common__V1__KeyValue *entry;
+    struct cmt_protobuf_reader                  reader;
+    const unsigned char                        *field_data;
+    size_t                                      field_length;
+    struct cfl_kvlist                          *metric_context;
+    struct cfl_kvlist                          *metric_metadata;
+    uint32_t                                    field;
+    int                                         wire_type;
+    int                                         result;
+
+    metric_metadata = NULL;
+
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (field != OTLP_METRIC_METADATA) {
+            result = skip_field(&reader, wire_type);
+            continue;
+        }
+
+        result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            break;
+        }
+
+        entry = opentelemetry__proto__common__v1__key_value__unpack(NULL, field_length, field_data);
+
+        if (entry == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (metric_metadata == NULL) {
+            metric_context = get_or_create_metric_metadata_context(cmt, map);
+
+            if (metric_context != NULL) {
+                metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
+            }
+        }
+
+        /* same as the tree decoder, metadata is best effort */
+        if (metric_metadata != NULL) {
+            clone_kvlist_entry(metric_metadata, entry, CFL_FALSE);
+        }
+
+        opentelemetry__proto__common__v1__key_value__free_unpacked(entry, NULL);
+    }
+
+    return result;
+}
+
+static int stream_metric(struct cmt *cmt,
+                         const unsigned char *data,
+                         size_t length,
+                         void *filter_context,
+                         int (*filter)(void *filter_context,
+                                       const char *name,
+                                       size_t length))
+{
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogram  exp_histogram = OPENTELEMETRY__PROTO__METRICS__V1__EXPONENTIAL_HISTOGRAM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Histogram             histogram = OPENTELEMETRY__PROTO__METRICS__V1__HISTOGRAM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Summary               summary = OPENTELEMETRY__PROTO__METRICS__V1__SUMMARY__INIT;
+    Opentelemetry__Proto__Metrics__V1__Gauge                 gauge = OPENTELEMETRY__PROTO__METRICS__V1__GAUGE__INIT;
+    Opentelemetry__Proto__Metrics__V1__Sum                   sum = OPENTELEMETRY__PROTO__METRICS__V1__SUM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Metric                metric = OPENTELEMETRY__PROTO__METRICS__V1__METRIC__INIT;
+    struct cmt_protobuf_reader                               reader;
+    const unsigned char                                     *field_data;
+    size_t                                                   field_length;
+    const unsigned char                                     *metric_data;
+    size_t                                                   metric_data_length;
+    const unsigned char                                     *name;
+    size_t                                                   name_length;
+    uint64_t                                                 aggregation_temporality;
+    uint64_t                                                 is_monotonic;
+    struct cmt_map                                          *map;
+    cfl_sds_t                                                description;
+    cfl_sds_t                                                metric_name;
+    cfl_sds_t                                                unit;
+    uint32_t                                                 field;
+    int                                                      wire_type;
+    int                                                      result;
+
+    metric_data = NULL;
+    metric_data_length = 0;
+    name = (const unsigned char *) "";
+    name_length = 0;
+    description = NULL;
+    metric_name = NULL;
+    unit = NULL;
+
+    /* first pass: only slice the fields, the name decides if we go further */
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            goto cleanup;
+        }
+
+        switch (field) {
+        case OTLP_METRIC_NAME:
+            result = read_length_delimited(&reader, wire_type, &name, &name_length);
+            break;
+        case OTLP_METRIC_DESCRIPTION:
+        case OTLP_METRIC_UNIT:
+            result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                result = copy_wire_string(field == OTLP_METRIC_UNIT ? &unit : &description,
+                                          field_data, field_length);
+            }
+            break;
+        case OTLP_METRIC_GAUGE:
+        case OTLP_METRIC_SUM:
+        case OTLP_METRIC_HISTOGRAM:
+        case OTLP_METRIC_EXPONENTIAL_HISTOGRAM:
+        case OTLP_METRIC_SUMMARY:
+            /* the data oneof case values match the field numbers */
+            metric.data_case = field;
+            result = read_length_delimited(&reader, wire_type, &metric_data, &metric_data_length);
+            break;
+        default:
+            result = skip_field(&reader, wire_type);
+        }
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+        filter != NULL &&
+        filter(filter_context, (const char *) name, name_length) != CMT_TRUE) {
+        goto cleanup;
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        result = copy_wire_string(&metric_name, name, name_length);
     }
 
     if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
-        destroy_context_list(result_context_list);
+        goto cleanup;
+    }
+
+    aggregation_temporality = 0;
+    is_monotonic = 0;
+
+    if (metric_data != NULL) {
+        result = stream_metric_data(cmt, NULL, metric.data_case,
+                                    metric_data, metric_data_length, CMT_FALSE,
+                                    &aggregation_temporality, &is_monotonic);
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    /*
+     * The metric is created from a container without data points, which
+     * are then unpacked and decoded one at a time into its map.
+     */
+    metric.name = metric_name;
+
+    if (description != NULL) {
+        metric.description = description;
+    }
+
+    if (unit != NULL) {
+        metric.unit = unit;
+    }
+
+    switch (metric.data_case) {
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+        sum.aggregation_temporality = aggregation_temporality;
+        sum.is_monotonic = is_monotonic != 0;
+        metric.sum = &sum;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+        metric.gauge = &gauge;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+        metric.summary = &summary;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+        histogram.aggregation_temporality = aggregation_temporality;
+        metric.histogram = &histogram;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM:
+        exp_histogram.aggregation_temporality = aggregation_temporality;
+        metric.exponential_histogram = &exp_histogram;
+        break;
+    default:
+        /* rejected by decode_metrics_entry() */
+        break;
+    }
+
+    result = decode_metrics_entry(cmt, &metric, CFL_FALSE);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        goto cleanup;
+    }
+
+    map = get_last_metric_map(cmt, metric.data_case);
+
+    if (map == NULL) {
+        result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        goto cleanup;
+    }
+
+    result = stream_metric_data(cmt, map, metric.data_case,
+                                metric_data, metric_data_length, CMT_TRUE,
+                                NULL, NULL);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        result = stream_metric_metadata(cmt, map, data, length);
+    }
+
+cleanup:
+    if (metric_name != NULL) {
+        cfl_sds_destroy(metric_name);
+    }
+
+    if (description != NULL) {
+        cfl_sds_destroy(description);
+    }
+
+    if (unit != NULL) {
+        cfl_sds_destroy(unit);
     }
 
     return result;
 }
 
-void cmt_decode_opentelemetry_destroy(struct cfl_list *context_list)
+/*
+ * ScopeMetrics and ResourceMetrics are walked twice: the scope, resource and
+ * schema url are collected first since the wire order is not guaranteed, the
+ * nested entries are then decoded in a second pass.
+ */
+static int stream_scan_container(const unsigned char *data,
+                                 size_t length,
+                                 const unsigned char **header,
+                                 size_t *header_length,
+                                 cfl_sds_t *schema_url)
 {
-    if (context_list != NULL) {
-        destroy_context_list(context_list);
+    struct cmt_protobuf_reader  reader;
+    const unsigned char        *field_data;
+    size_t                      field_length;
+    uint32_t                    field;
+    int                         wire_type;
+    int                         result;
+
+    /* ResourceMetrics and ScopeMetrics share their field numbers */
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (field == OTLP_SCOPE_METRICS_SCOPE) {
+            result = read_length_delimited(&reader, wire_type, header, header_length);
+        }
+        else if (field == OTLP_SCOPE_METRICS_SCHEMA_URL) {
+            result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                result = copy_wire_string(schema_url, field_data, field_length);
+            }
+        }
+        else {
+            result = skip_field(&reader, wire_type);
+        }
+    }
+
+    return result;
+}
+
+static int stream_scope_metrics(struct cfl_list *context_list,
+                                const unsigned char *data,
+                                size_t length,
+                                void *filter_context,
+                                int (*filter)(void *filter_context,
+                                              const char *name,
+                                              size_t length))
+{
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics  scope_metrics = OPENTELEMETRY__PROTO__METRICS__V1__SCOPE_METRICS__INIT;
+    struct cmt_protobuf_reader                       reader;
+    const unsigned char                             *field_data;
+    size_t                                           field_length;
+    const unsigned char                             *scope;
+    size_t                                           scope_length;
+    cfl_sds_t                                        schema_url;
+    struct cmt                                      *context;
+    uint32_t                                         field;
+    int                                              wire_type;
+    int                                              result;
+
+    scope = NULL;
+    scope_length = 0;
+    schema_url = NULL;
+
+    result = stream_scan_container(data, length, &scope, &scope_length, &schema_url);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && scope != NULL) {
+        scope_metrics.scope = opentelemetry__proto__common__v1__instrumentation_scope__unpack(NULL, scope_length, scope);
+
+        if (scope_metrics.scope == NULL) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        if (schema_url != NULL) {
+            scope_metrics.schema_url = schema_url;
+        }
+
+        result = decode_scope_metrics_entry(context_list, &scope_metrics, CFL_FALSE);
     }
+
+    if (scope_metrics.scope != NULL) {
+        opentelemetry__proto__common__v1__instrumentation_scope__free_unpacked(scope_metrics.scope, NULL);
+    }
+
+    if (schema_url != NULL) {
+        cfl_sds_destroy(schema_url);
+    }
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return result;
+    }
+
+    context = cfl_list_entry_last(context_list, struct cmt, _head);
+
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (field == OTLP_SCOPE_METRICS_METRICS) {
+            result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                result = stream_metric(context, field_data, field_length,
+                                       filter_context, filter);
+            }
+        }
+        else {
+            result = skip_field(&reader, wire_type);
+        }
+    }
+
+    return result;
+}
+
+static int stream_resource_metrics(struct cfl_list *context_list,
+                                   const unsigned char *data,
+                                   size_t length,
+                                   void *filter_context,
+                                   int (*filter)(void *filter_context,
+                                                 const char *name,
+                                                 size_t length))
+{
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics  resource_metrics = OPENTELEMETRY__PROTO__METRICS__V1__RESOURCE_METRICS__INIT;
+    struct cmt_protobuf_reader                          reader;
+    const unsigned char                                *field_data;
+    size_t                                              field_length;
+    const unsigned char                                *resource;
+    size_t                                              resource_length;
+    cfl_sds_t                                           schema_url;
+    struct cmt                                         *context;
+    uint32_t                                            field;
+    int                                                 wire_type;
+    int                                                 result;
+
+    resource = NULL;
+    resource_length = 0;
+    schema_url = NULL;
+
+    result = stream_scan_container(data, length, &resource, &resource_length, &schema_url);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && resource != NULL) {
+        resource_metrics.resource = opentelemetry__proto__resource__v1__resource__unpack(NULL, resource_length, resource);
+
+        if (resource_metrics.resource == NULL) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+    }
+
+    if (schema_url != NULL) {
+        resource_metrics.schema_url = schema_url;
+    }
+
+    cmt_protobuf_reader_init(&reader, data, length);
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            break;
+        }
+
+        if (field != OTLP_RESOURCE_METRICS_SCOPE_METRICS) {
+            result = skip_field(&reader, wire_type);
+            continue;
+        }
+
+        result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            result = stream_scope_metrics(context_list, field_data, field_length,
+                                          filter_context, filter);
+        }
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            context = cfl_list_entry_last(context_list, struct cmt, _head);
+
+            result = attach_resource_metrics_metadata(context,
+                                                      &resource_metrics,
+                                                      CFL_FALSE);
+        }
+    }
+
+    if (resource_metrics.resource != NULL) {
+        opentelemetry__proto__resource__v1__resource__free_unpacked(resource_metrics.resource, NULL);
+    }
+
+    if (schema_url != NULL) {
+        cfl_sds_destroy(schema_url);
+    }
+
+    return result;
+}
+
+int cmt_decode_opentelemetry_stream_create(struct cfl_list *result_context_list,
+                                           char *in_buf, size_t in_size,
+                                           size_t *offset,
+                                           void *filter_context,
+                                           int (*filter)(void *filter_context,
+                                                         const char *name,
+                                                         size_t length))
+{
+    struct cmt_protobuf_reader  reader;
+    const unsigned char        *field_data;
+    size_t                      field_length;
+    uint32_t                    field;
+    int                         wire_type;
+    int                         result;
+
+    cfl_list_init(result_context_list);
+
+    if (in_buf == NULL || offset == NULL || *offset > in_size) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    cmt_protobuf_reader_init(&reader, &in_buf[*offset], in_size - *offset);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           cmt_protobuf_reader_has_data(&reader)) {
+        if (cmt_protobuf_read_tag(&reader, &field, &wire_type) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            break;
+        }
+
+        if (field != OTLP_EXPORT_REQUEST_RESOURCE_METRICS) {
+            result = skip_field(&reader, wire_type);
+            continue;
+        }
+
+        result = read_length_delimited(&reader, wire_type, &field_data, &field_length);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            result = stream_resource_metrics(result_context_list,
+                                             field_data, field_length,
+                                             filter_context, filter);
+        }
+    }
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        destroy_context_list(result_context_list);
+    }
+
+    return result;
+}
+
+static void *arena_allocator_alloc(void *allocator_data, size_t size)
+{
+    return cfl_arena_alloc((struct cfl_arena *) allocator_data, size);
+}
+
+/* arena memory is released as a whole by cfl_arena_destroy() */
+static void arena_allocator_free(void *allocator_data, void *pointer)
+{
+    (void) allocator_data;
+    (void) pointer;
+}
+
+static int decode_opentelemetry(struct cfl_list *result_context_list,
+                                char *in_buf, size_t in_size,
+                                size_t *offset,
+                                ProtobufCAllocator *allocator,
+                                int referenced)
+{
+    Opentelemetry__Proto__Collector__Metrics__V1__ExportMetricsServiceRequest *service_request;
+    int                                                                        result;
+
+    result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+
+    cfl_list_init(result_context_list);
+
+    service_request = opentelemetry__proto__collector__metrics__v1__export_metrics_service_request__unpack(allocator, in_size - *offset,
+                                                                                                           (unsigned char *) &in_buf[*offset]);
+
+    if (service_request != NULL) {
+        result = decode_service_request(result_context_list, service_request, referenced);
+
+        /* with an arena the unpacked request lives until the arena is destroyed */
+        if (allocator == NULL) {
+            opentelemetry__proto__collector__metrics__v1__export_metrics_service_request__free_unpacked(service_request, NULL);
+        }
+    }
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        destroy_context_list(result_context_list);
+    }
+
+    return result;
+}
+
+int cmt_decode_opentelemetry_create(struct cfl_list *result_context_list,
+                                    char *in_buf, size_t in_size,
+                                    size_t *offset)
+{
+    return decode_opentelemetry(result_context_list, in_buf, in_size, offset,
+                                NULL, CFL_FALSE);
+}
+
+int cmt_decode_opentelemetry_create_with_arena(struct cfl_list *result_context_list,
+                                               char *in_buf, size_t in_size,
+                                               size_t *offset,
+                                               struct cfl_arena *arena)
+{
+    ProtobufCAllocator allocator;
+
+    if (arena == NULL) {
+        cfl_list_init(result_context_list);
+
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    allocator.alloc = arena_allocator_alloc;
+    allocator.free = arena_allocator_free;
+    allocator.allocator_data = arena;
+
+    return decode_opentelemetry(result_context_list, in_buf, in_size, offset,
+                                &allocator, CFL_TRUE);
+}
+
+int cmt_decode_opentelemetry_merge(struct cmt *dst,
+                                   char *in_buf, size_t in_size,
+                                   size_t *offset)
+{
+    int              result;
+    struct cfl_list  context_list;
+    struct cfl_list *head;
+    struct cmt      *cmt;
+
+    if (dst == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_opentelemetry_stream_create(&context_list,
+                                                    in_buf, in_size, offset,
+                                                    NULL, NULL);
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return result;
+    }
+
+    /* every resource and scope decodes into its own context */
+    cfl_list_foreach(head, &context_list) {
+        cmt = cfl_list_entry(head, struct cmt, _head);
+
+        if (cmt_cat_move(dst, cmt) != 0) {
+            result = CMT_DECODE_OPENTELEMETRY_MERGE_ERROR;
+            break;
+        }
+    }
+
+    destroy_context_list(&context_list);
+
+    return result;
+}
+
+void cmt_decode_opentelemetry_destroy(struct cfl_list *context_list)
+{
+    if (context_list != NULL) {
+        destroy_context_list(context_list);
+    }
+}
+
+/*
+ * OTLP/JSON decoder: a single pass over the document with the pull reader
+ * from cmt_json.h, no generic document tree is built. Each data point is
+ * staged as a protobuf-c structure in a scratch arena, handed to the same
+ * decode_*_data_point() helpers the protobuf decoders use and the arena is
+ * rewound for the next one.
+ *
+ * Members are processed in the order they come. The few that depend on a
+ * member that may come later are skipped and revisited at the end of their
+ * object: the data of a metric seen before its name, metric metadata seen
+ * before the data and the data points of a sum seen before isMonotonic.
+ * Both the lowerCamelCase names of the protobuf JSON mapping and the
+ * original field names are accepted.
+ */
+#define OTLP_JSON_SCRATCH_ALIGNMENT      16
+#define OTLP_JSON_SCRATCH_MINIMUM_SIZE   4096
+#define OTLP_JSON_MAXIMUM_VALUE_DEPTH    16
+
+struct otlp_json_scratch_chunk {
+    struct otlp_json_scratch_chunk *next;
+    size_t                          size;
+    size_t                          used;
+    size_t                          padding;
+    char                            data[];
+};
+
+struct otlp_json_scratch {
+    struct otlp_json_scratch_chunk *chunks;
+    size_t                          chunk_size;
+};
+
+struct otlp_json_decoder {
+    struct cmt_json_reader   reader;
+
+    /* staging for data points, scopes and metric metadata */
+    struct otlp_json_scratch scratch;
+
+    /* the resource has to outlive the scopes that follow it */
+    struct otlp_json_scratch resource_scratch;
+};
+
+static void *json_scratch_alloc(struct otlp_json_scratch *scratch, size_t size)
+{
+    void                           *memory;
+    size_t                          chunk_size;
+    struct otlp_json_scratch_chunk *chunk;
+
+    size = (size + (OTLP_JSON_SCRATCH_ALIGNMENT - 1)) &
+           ~((size_t) OTLP_JSON_SCRATCH_ALIGNMENT - 1);
+    if (size == 0) {
+        size = OTLP_JSON_SCRATCH_ALIGNMENT;
+    }
+
+    chunk = scratch->chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk_size = scratch->chunk_size;
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+
+        chunk = malloc(sizeof(struct otlp_json_scratch_chunk) + chunk_size);
+        if (chunk == NULL) {
+            cmt_errno();
+            return NULL;
+        }
+
+        chunk->next = scratch->chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        scratch->chunks = chunk;
+        scratch->chunk_size *= 2;
+    }
+
+    memory = &chunk->data[chunk->used];
+    chunk->used += size;
+
+    return memory;
+}
+
+/* rewind, the newest (largest) chunk is kept for the next round */
+static void json_scratch_reset(struct otlp_json_scratch *scratch)
+{
+    struct otlp_json_scratch_chunk *chunk;
+
+    if (scratch->chunks == NULL) {
+        return;
+    }
+
+    while (scratch->chunks->next != NULL) {
+        chunk = scratch->chunks->next;
+        scratch->chunks->next = chunk->next;
+        free(chunk);
+    }
+
+    scratch->chunks->used = 0;
+}
+
+static void json_scratch_destroy(struct otlp_json_scratch *scratch)
+{
+    struct otlp_json_scratch_chunk *chunk;
+
+    while (scratch->chunks != NULL) {
+        chunk = scratch->chunks;
+        scratch->chunks = chunk->next;
+        free(chunk);
+    }
+}
+
+/* make room for one more element of a repeated field */
+static void *json_scratch_grow(struct otlp_json_scratch *scratch,
+                               void *array, size_t count, size_t *capacity,
+                               size_t element_size)
+{
+    void   *grown;
+    size_t  new_capacity;
+
+    if (count < *capacity) {
+        return array;
+    }
+
+    new_capacity = *capacity > 0 ? *capacity * 2 : 8;
+
+    grown = json_scratch_alloc(scratch, new_capacity * element_size);
+    if (grown == NULL) {
+        return NULL;
+    }
+
+    if (count > 0) {
+        memcpy(grown, array, count * element_size);
+    }
+    *capacity = new_capacity;
+
+    return grown;
+}
+
+static int json_key_is(const char *key, size_t length,
+                       const char *camel_case, const char *snake_case)
+{
+    if (strlen(camel_case) == length && memcmp(key, camel_case, length) == 0) {
+        return CMT_TRUE;
+    }
+
+    if (snake_case != NULL &&
+        strlen(snake_case) == length && memcmp(key, snake_case, length) == 0) {
+        return CMT_TRUE;
+    }
+
+    return CMT_FALSE;
+}
+
+/* next member of an object, members set to null are default values */
+static int json_next_member(struct cmt_json_reader *reader, int *more,
+                            const char **key, size_t *length)
+{
+    while (1) {
+        if (cmt_json_object_next(reader, more, key, length) != CMT_JSON_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (!*more || cmt_json_peek(reader) != CMT_JSON_TYPE_NULL) {
+            return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+        }
+
+        if (cmt_json_read_null(reader) != CMT_JSON_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+    }
+}
+
+static int json_status(int result)
+{
+    if (result != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+/* NUL terminated copy of a string in the scratch arena */
+static int json_read_text(struct cmt_json_reader *reader,
+                          struct otlp_json_scratch *scratch,
+                          char **text, size_t *text_length)
+{
+    int          escaped;
+    int          length;
+    size_t       size;
+    const char  *data;
+    char        *output;
+
+    if (cmt_json_read_string(reader, &data, &size, &escaped) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    output = json_scratch_alloc(scratch, size + 1);
+    if (output == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    if (escaped) {
+        length = cmt_json_unescape(data, size, output);
+        if (length < 0) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+        size = length;
+    }
+    else {
+        memcpy(output, data, size);
+    }
+    output[size] = '\0';
+
+    *text = output;
+    if (text_length != NULL) {
+        *text_length = size;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+/* same as json_read_text() for strings that outlive the scratch arena */
+static int json_read_sds(struct cmt_json_reader *reader, cfl_sds_t *target)
+{
+    int          escaped;
+    int          length;
+    size_t       size;
+    const char  *data;
+
+    if (cmt_json_read_string(reader, &data, &size, &escaped) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (*target != NULL) {
+        cfl_sds_destroy(*target);
+    }
+
+    *target = cfl_sds_create_size(size + 1);
+    if (*target == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    if (escaped) {
+        length = cmt_json_unescape(data, size, *target);
+        if (length < 0) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+        size = length;
+    }
+    else {
+        memcpy(*target, data, size);
+    }
+    (*target)[size] = '\0';
+    cfl_sds_set_len(*target, size);
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+/* bytes fields are base64 strings, trace and span identifiers are hex */
+static int json_read_bytes(struct cmt_json_reader *reader,
+                           struct otlp_json_scratch *scratch,
+                           int hex,
+                           ProtobufCBinaryData *bytes)
+{
+    int            escaped;
+    int            length;
+    size_t         size;
+    const char    *data;
+    unsigned char *output;
+
+    if (cmt_json_read_string(reader, &data, &size, &escaped) != CMT_JSON_SUCCESS ||
+        escaped) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    output = json_scratch_alloc(scratch, size + 1);
+    if (output == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    if (hex) {
+        length = cmt_json_hex_decode(data, size, output);
+    }
+    else {
+        length = cmt_json_base64_decode(data, size, output);
+    }
+
+    if (length < 0) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    bytes->data = output;
+    bytes->len = length;
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int json_read_uint32(struct cmt_json_reader *reader, uint32_t *value)
+{
+    uint64_t number;
+
+    if (cmt_json_read_uint64(reader, &number) != CMT_JSON_SUCCESS ||
+        number > UINT32_MAX) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    *value = (uint32_t) number;
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int json_read_int32(struct cmt_json_reader *reader, int32_t *value)
+{
+    int64_t number;
+
+    if (cmt_json_read_int64(reader, &number) != CMT_JSON_SUCCESS ||
+        number < INT32_MIN || number > INT32_MAX) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    *value = (int32_t) number;
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+/* enums are accepted as numbers or by name */
+static int json_read_aggregation_temporality(struct cmt_json_reader *reader,
+                                             uint64_t *value)
+{
+    int          escaped;
+    size_t       length;
+    const char  *data;
+
+    if (cmt_json_peek(reader) != CMT_JSON_TYPE_STRING) {
+        return json_status(cmt_json_read_uint64(reader, value));
+    }
+
+    if (cmt_json_read_string(reader, &data, &length, &escaped) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (json_key_is(data, length, "AGGREGATION_TEMPORALITY_UNSPECIFIED", NULL)) {
+        *value = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_UNSPECIFIED;
+    }
+    else if (json_key_is(data, length, "AGGREGATION_TEMPORALITY_DELTA", NULL)) {
+        *value = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
+    }
+    else if (json_key_is(data, length, "AGGREGATION_TEMPORALITY_CUMULATIVE", NULL)) {
+        *value = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
+    }
+    else {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int json_read_key_value_list(struct cmt_json_reader *reader,
+                                    struct otlp_json_scratch *scratch,
+                                    Opentelemetry__Proto__Common__V1__KeyValue ***list,
+                                    size_t *count,
+                                    int depth);
+
+static int json_read_any_value(struct cmt_json_reader *reader,
+                               struct otlp_json_scratch *scratch,
+                               Opentelemetry__Proto__Common__V1__AnyValue **output,
+                               int depth)
+{
+    int                                           more;
+    int                                           inner_more;
+    int                                           result;
+    size_t                                        length;
+    size_t                                        capacity;
+    const char                                   *key;
+    Opentelemetry__Proto__Common__V1__AnyValue   *value;
+    Opentelemetry__Proto__Common__V1__ArrayValue *array;
+
+    if (depth > OTLP_JSON_MAXIMUM_VALUE_DEPTH) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    value = json_scratch_alloc(scratch, sizeof(Opentelemetry__Proto__Common__V1__AnyValue));
+    if (value == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__common__v1__any_value__init(value);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "stringValue", "string_value")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE;
+            result = json_read_text(reader, scratch, &value->string_value, NULL);
+        }
+        else if (json_key_is(key, length, "boolValue", "bool_value")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BOOL_VALUE;
+            result = json_status(cmt_json_read_bool(reader, &more));
+            value->bool_value = more;
+            more = CMT_TRUE;
+        }
+        else if (json_key_is(key, length, "intValue", "int_value")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_INT_VALUE;
+            result = json_status(cmt_json_read_int64(reader, &value->int_value));
+        }
+        else if (json_key_is(key, length, "doubleValue", "double_value")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_DOUBLE_VALUE;
+            result = json_status(cmt_json_read_double(reader, &value->double_value));
+        }
+        else if (json_key_is(key, length, "bytesValue", "bytes_value")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BYTES_VALUE;
+            result = json_read_bytes(reader, scratch, CMT_FALSE, &value->bytes_value);
+        }
+        else if (json_key_is(key, length, "stringValueStrindex", "string_value_strindex")) {
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE_STRINDEX;
+            result = json_read_int32(reader, &value->string_value_strindex);
+        }
+        else if (json_key_is(key, length, "arrayValue", "array_value")) {
+            array = json_scratch_alloc(scratch, sizeof(Opentelemetry__Proto__Common__V1__ArrayValue));
+            if (array == NULL) {
+                return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+            }
+            opentelemetry__proto__common__v1__array_value__init(array);
+
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_ARRAY_VALUE;
+            value->array_value = array;
+
+            if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+                return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+
+            while ((result = json_next_member(reader, &inner_more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   inner_more) {
+                if (!json_key_is(key, length, "values", NULL)) {
+                    result = json_status(cmt_json_skip_value(reader));
+                }
+                else if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+                    result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+                }
+                else {
+                    capacity = 0;
+
+                    while ((result = json_status(cmt_json_array_next(reader, &inner_more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                           inner_more) {
+                        array->values = json_scratch_grow(scratch, array->values,
+                                                          array->n_values, &capacity,
+                                                          sizeof(void *));
+                        if (array->values == NULL) {
+                            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+                        }
+
+                        result = json_read_any_value(reader, scratch,
+                                                     &array->values[array->n_values],
+                                                     depth + 1);
+                        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                            return result;
+                        }
+
+                        array->n_values++;
+                    }
+
+                    inner_more = CMT_TRUE;
+                }
+
+                if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                    return result;
+                }
+            }
+        }
+        else if (json_key_is(key, length, "kvlistValue", "kvlist_value")) {
+            value->kvlist_value = json_scratch_alloc(scratch, sizeof(Opentelemetry__Proto__Common__V1__KeyValueList));
+            if (value->kvlist_value == NULL) {
+                return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+            }
+            opentelemetry__proto__common__v1__key_value_list__init(value->kvlist_value);
+
+            value->value_case = OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_KVLIST_VALUE;
+
+            if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+                return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+
+            while ((result = json_next_member(reader, &inner_more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   inner_more) {
+                if (json_key_is(key, length, "values", NULL)) {
+                    result = json_read_key_value_list(reader, scratch,
+                                                      &value->kvlist_value->values,
+                                                      &value->kvlist_value->n_values,
+                                                      depth + 1);
+                }
+                else {
+                    result = json_status(cmt_json_skip_value(reader));
+                }
+
+                if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                    return result;
+                }
+            }
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = value;
+
+    return result;
+}
+
+static int json_read_key_value(struct cmt_json_reader *reader,
+                               struct otlp_json_scratch *scratch,
+                               Opentelemetry__Proto__Common__V1__KeyValue **output,
+                               int depth)
+{
+    int                                         more;
+    int                                         result;
+    size_t                                      length;
+    const char                                 *key;
+    Opentelemetry__Proto__Common__V1__KeyValue *pair;
+
+    pair = json_scratch_alloc(scratch, sizeof(Opentelemetry__Proto__Common__V1__KeyValue));
+    if (pair == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__common__v1__key_value__init(pair);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "key", NULL)) {
+            result = json_read_text(reader, scratch, &pair->key, NULL);
+        }
+        else if (json_key_is(key, length, "value", NULL)) {
+            result = json_read_any_value(reader, scratch, &pair->value, depth);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = pair;
+
+    return result;
+}
+
+static int json_read_key_value_list(struct cmt_json_reader *reader,
+                                    struct otlp_json_scratch *scratch,
+                                    Opentelemetry__Proto__Common__V1__KeyValue ***list,
+                                    size_t *count,
+                                    int depth)
+{
+    int                                          more;
+    int                                          result;
+    size_t                                       capacity;
+    Opentelemetry__Proto__Common__V1__KeyValue **pairs;
+
+    if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    pairs = *list;
+    capacity = *count;
+
+    while ((result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        pairs = json_scratch_grow(scratch, pairs, *count, &capacity, sizeof(void *));
+        if (pairs == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+
+        result = json_read_key_value(reader, scratch, &pairs[*count], depth);
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+
+        (*count)++;
+        *list = pairs;
+    }
+
+    return result;
+}
+
+static int json_read_uint64_list(struct cmt_json_reader *reader,
+                                 struct otlp_json_scratch *scratch,
+                                 uint64_t **list, size_t *count)
+{
+    int       more;
+    int       result;
+    size_t    capacity;
+
+    if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    *count = 0;
+    capacity = 0;
+
+    while ((result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        *list = json_scratch_grow(scratch, *list, *count, &capacity, sizeof(uint64_t));
+        if (*list == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+
+        if (cmt_json_read_uint64(reader, &(*list)[*count]) != CMT_JSON_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        (*count)++;
+    }
+
+    return result;
+}
+
+static int json_read_double_list(struct cmt_json_reader *reader,
+                                 struct otlp_json_scratch *scratch,
+                                 double **list, size_t *count)
+{
+    int       more;
+    int       result;
+    size_t    capacity;
+
+    if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    *count = 0;
+    capacity = 0;
+
+    while ((result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        *list = json_scratch_grow(scratch, *list, *count, &capacity, sizeof(double));
+        if (*list == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+
+        if (cmt_json_read_double(reader, &(*list)[*count]) != CMT_JSON_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        (*count)++;
+    }
+
+    return result;
+}
+
+static int json_read_exemplar(struct cmt_json_reader *reader,
+                              struct otlp_json_scratch *scratch,
+                              Opentelemetry__Proto__Metrics__V1__Exemplar **output)
+{
+    int                                          more;
+    int                                          result;
+    size_t                                       length;
+    const char                                  *key;
+    Opentelemetry__Proto__Metrics__V1__Exemplar *exemplar;
+
+    exemplar = json_scratch_alloc(scratch, sizeof(Opentelemetry__Proto__Metrics__V1__Exemplar));
+    if (exemplar == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__metrics__v1__exemplar__init(exemplar);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "filteredAttributes", "filtered_attributes")) {
+            result = json_read_key_value_list(reader, scratch,
+                                              &exemplar->filtered_attributes,
+                                              &exemplar->n_filtered_attributes, 0);
+        }
+        else if (json_key_is(key, length, "timeUnixNano", "time_unix_nano")) {
+            result = json_status(cmt_json_read_uint64(reader, &exemplar->time_unix_nano));
+        }
+        else if (json_key_is(key, length, "asDouble", "as_double")) {
+            exemplar->value_case = OPENTELEMETRY__PROTO__METRICS__V1__EXEMPLAR__VALUE_AS_DOUBLE;
+            result = json_status(cmt_json_read_double(reader, &exemplar->as_double));
+        }
+        else if (json_key_is(key, length, "asInt", "as_int")) {
+            exemplar->value_case = OPENTELEMETRY__PROTO__METRICS__V1__EXEMPLAR__VALUE_AS_INT;
+            result = json_status(cmt_json_read_int64(reader, &exemplar->as_int));
+        }
+        else if (json_key_is(key, length, "spanId", "span_id")) {
+            result = json_read_bytes(reader, scratch, CMT_TRUE, &exemplar->span_id);
+        }
+        else if (json_key_is(key, length, "traceId", "trace_id")) {
+            result = json_read_bytes(reader, scratch, CMT_TRUE, &exemplar->trace_id);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = exemplar;
+
+    return result;
+}
+
+static int json_read_exemplar_list(struct cmt_json_reader *reader,
+                                   struct otlp_json_scratch *scratch,
+                                   Opentelemetry__Proto__Metrics__V1__Exemplar ***list,
+                                   size_t *count)
+{
+    int    more;
+    int    result;
+    size_t capacity;
+
+    if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    capacity = *count;
+
+    while ((result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        *list = json_scratch_grow(scratch, *list, *count, &capacity, sizeof(void *));
+        if (*list == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+
+        result = json_read_exemplar(reader, scratch, &(*list)[*count]);
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+
+        (*count)++;
+    }
+
+    return result;
+}
+
+/*
+ * Members shared by every data point type, returns CMT_FALSE when 'key' is
+ * none of them so the caller can try its own.
+ */
+static int json_read_common_point_member(struct cmt_json_reader *reader,
+                                         struct otlp_json_scratch *scratch,
+                                         const char *key, size_t length,
+                                         Opentelemetry__Proto__Common__V1__KeyValue ***attributes,
+                                         size_t *attribute_count,
+                                         uint64_t *start_time_unix_nano,
+                                         uint64_t *time_unix_nano,
+                                         uint32_t *flags,
+                                         int *result)
+{
+    if (json_key_is(key, length, "attributes", NULL)) {
+        *result = json_read_key_value_list(reader, scratch,
+                                           attributes, attribute_count, 0);
+    }
+    else if (json_key_is(key, length, "startTimeUnixNano", "start_time_unix_nano")) {
+        *result = json_status(cmt_json_read_uint64(reader, start_time_unix_nano));
+    }
+    else if (json_key_is(key, length, "timeUnixNano", "time_unix_nano")) {
+        *result = json_status(cmt_json_read_uint64(reader, time_unix_nano));
+    }
+    else if (json_key_is(key, length, "flags", NULL)) {
+        *result = json_read_uint32(reader, flags);
+    }
+    else {
+        return CMT_FALSE;
+    }
+
+    return CMT_TRUE;
+}
+
+static int json_decode_number_data_point(struct otlp_json_decoder *decoder,
+                                         struct cmt *cmt,
+                                         struct cmt_map *map)
+{
+    int                                                 more;
+    int                                                 result;
+    size_t                                              length;
+    const char                                         *key;
+    struct cmt_json_reader                             *reader;
+    Opentelemetry__Proto__Metrics__V1__NumberDataPoint  data_point;
+
+    reader = &decoder->reader;
+
+    opentelemetry__proto__metrics__v1__number_data_point__init(&data_point);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_read_common_point_member(reader, &decoder->scratch, key, length,
+                                          &data_point.attributes,
+                                          &data_point.n_attributes,
+                                          &data_point.start_time_unix_nano,
+                                          &data_point.time_unix_nano,
+                                          &data_point.flags,
+                                          &result)) {
+        }
+        else if (json_key_is(key, length, "asDouble", "as_double")) {
+            data_point.value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE;
+            result = json_status(cmt_json_read_double(reader, &data_point.as_double));
+        }
+        else if (json_key_is(key, length, "asInt", "as_int")) {
+            data_point.value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT;
+            result = json_status(cmt_json_read_int64(reader, &data_point.as_int));
+        }
+        else if (json_key_is(key, length, "exemplars", NULL)) {
+            result = json_read_exemplar_list(reader, &decoder->scratch,
+                                             &data_point.exemplars,
+                                             &data_point.n_exemplars);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    return decode_numerical_data_point(cmt, map, &data_point, CFL_FALSE);
+}
+
+static int json_read_quantile_list(struct cmt_json_reader *reader,
+                                   struct otlp_json_scratch *scratch,
+                                   Opentelemetry__Proto__Metrics__V1__SummaryDataPoint *data_point)
+{
+    int                                                                more;
+    int                                                                inner_more;
+    int                                                                result;
+    size_t                                                             length;
+    size_t                                                             capacity;
+    const char                                                        *key;
+    Opentelemetry__Proto__Metrics__V1__SummaryDataPoint__ValueAtQuantile *quantile;
+
+    if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    capacity = data_point->n_quantile_values;
+
+    while ((result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        data_point->quantile_values = json_scratch_grow(scratch, data_point->quantile_values,
+                                                        data_point->n_quantile_values,
+                                                        &capacity, sizeof(void *));
+        quantile = json_scratch_alloc(scratch, sizeof(*quantile));
+
+        if (data_point->quantile_values == NULL || quantile == NULL) {
+            return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+
+        opentelemetry__proto__metrics__v1__summary_data_point__value_at_quantile__init(quantile);
+
+        if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+            return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        while ((result = json_next_member(reader, &inner_more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+               inner_more) {
+            if (json_key_is(key, length, "quantile", NULL)) {
+                result = json_status(cmt_json_read_double(reader, &quantile->quantile));
+            }
+            else if (json_key_is(key, length, "value", NULL)) {
+                result = json_status(cmt_json_read_double(reader, &quantile->value));
+            }
+            else {
+                result = json_status(cmt_json_skip_value(reader));
+            }
+
+            if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                return result;
+            }
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+
+        data_point->quantile_values[data_point->n_quantile_values++] = quantile;
+    }
+
+    return result;
+}
+
+static int json_decode_summary_data_point(struct otlp_json_decoder *decoder,
+                                          struct cmt *cmt,
+                                          struct cmt_map *map)
+{
+    int                                                  more;
+    int                                                  result;
+    size_t                                               length;
+    const char                                          *key;
+    struct cmt_json_reader                              *reader;
+    Opentelemetry__Proto__Metrics__V1__SummaryDataPoint  data_point;
+
+    reader = &decoder->reader;
+
+    opentelemetry__proto__metrics__v1__summary_data_point__init(&data_point);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_read_common_point_member(reader, &decoder->scratch, key, length,
+                                          &data_point.attributes,
+                                          &data_point.n_attributes,
+                                          &data_point.start_time_unix_nano,
+                                          &data_point.time_unix_nano,
+                                          &data_point.flags,
+                                          &result)) {
+        }
+        else if (json_key_is(key, length, "count", NULL)) {
+            result = json_status(cmt_json_read_uint64(reader, &data_point.count));
+        }
+        else if (json_key_is(key, length, "sum", NULL)) {
+            result = json_status(cmt_json_read_double(reader, &data_point.sum));
+        }
+        else if (json_key_is(key, length, "quantileValues", "quantile_values")) {
+            result = json_read_quantile_list(reader, &decoder->scratch, &data_point);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    return decode_summary_data_point(cmt, map, &data_point);
+}
+
+static int json_decode_histogram_data_point(struct otlp_json_decoder *decoder,
+                                            struct cmt *cmt,
+                                            struct cmt_map *map)
+{
+    int                                                    more;
+    int                                                    result;
+    size_t                                                 length;
+    const char                                            *key;
+    struct cmt_json_reader                                *reader;
+    Opentelemetry__Proto__Metrics__V1__HistogramDataPoint  data_point;
+
+    reader = &decoder->reader;
+
+    opentelemetry__proto__metrics__v1__histogram_data_point__init(&data_point);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_read_common_point_member(reader, &decoder->scratch, key, length,
+                                          &data_point.attributes,
+                                          &data_point.n_attributes,
+                                          &data_point.start_time_unix_nano,
+                                          &data_point.time_unix_nano,
+                                          &data_point.flags,
+                                          &result)) {
+        }
+        else if (json_key_is(key, length, "count", NULL)) {
+            result = json_status(cmt_json_read_uint64(reader, &data_point.count));
+        }
+        else if (json_key_is(key, length, "sum", NULL)) {
+            data_point.has_sum = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.sum));
+        }
+        else if (json_key_is(key, length, "bucketCounts", "bucket_counts")) {
+            result = json_read_uint64_list(reader, &decoder->scratch,
+                                           &data_point.bucket_counts,
+                                           &data_point.n_bucket_counts);
+        }
+        else if (json_key_is(key, length, "explicitBounds", "explicit_bounds")) {
+            result = json_read_double_list(reader, &decoder->scratch,
+                                           &data_point.explicit_bounds,
+                                           &data_point.n_explicit_bounds);
+        }
+        else if (json_key_is(key, length, "exemplars", NULL)) {
+            result = json_read_exemplar_list(reader, &decoder->scratch,
+                                             &data_point.exemplars,
+                                             &data_point.n_exemplars);
+        }
+        else if (json_key_is(key, length, "min", NULL)) {
+            data_point.has_min = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.min));
+        }
+        else if (json_key_is(key, length, "max", NULL)) {
+            data_point.has_max = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.max));
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    return decode_histogram_data_point(cmt, map, &data_point, CFL_FALSE);
+}
+
+static int json_read_exponential_buckets(struct cmt_json_reader *reader,
+                                         struct otlp_json_scratch *scratch,
+                                         Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint__Buckets **output)
+{
+    int                                                                        more;
+    int                                                                        result;
+    size_t                                                                     length;
+    const char                                                                *key;
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint__Buckets *buckets;
+
+    buckets = json_scratch_alloc(scratch, sizeof(*buckets));
+    if (buckets == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__metrics__v1__exponential_histogram_data_point__buckets__init(buckets);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "offset", NULL)) {
+            result = json_read_int32(reader, &buckets->offset);
+        }
+        else if (json_key_is(key, length, "bucketCounts", "bucket_counts")) {
+            result = json_read_uint64_list(reader, scratch,
+                                           &buckets->bucket_counts,
+                                           &buckets->n_bucket_counts);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = buckets;
+
+    return result;
+}
+
+static int json_decode_exponential_histogram_data_point(struct otlp_json_decoder *decoder,
+                                                        struct cmt *cmt,
+                                                        struct cmt_map *map)
+{
+    int                                                               more;
+    int                                                               result;
+    size_t                                                            length;
+    const char                                                       *key;
+    struct cmt_json_reader                                           *reader;
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint  data_point;
+
+    reader = &decoder->reader;
+
+    opentelemetry__proto__metrics__v1__exponential_histogram_data_point__init(&data_point);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_read_common_point_member(reader, &decoder->scratch, key, length,
+                                          &data_point.attributes,
+                                          &data_point.n_attributes,
+                                          &data_point.start_time_unix_nano,
+                                          &data_point.time_unix_nano,
+                                          &data_point.flags,
+                                          &result)) {
+        }
+        else if (json_key_is(key, length, "count", NULL)) {
+            result = json_status(cmt_json_read_uint64(reader, &data_point.count));
+        }
+        else if (json_key_is(key, length, "sum", NULL)) {
+            data_point.has_sum = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.sum));
+        }
+        else if (json_key_is(key, length, "scale", NULL)) {
+            result = json_read_int32(reader, &data_point.scale);
+        }
+        else if (json_key_is(key, length, "zeroCount", "zero_count")) {
+            result = json_status(cmt_json_read_uint64(reader, &data_point.zero_count));
+        }
+        else if (json_key_is(key, length, "positive", NULL)) {
+            result = json_read_exponential_buckets(reader, &decoder->scratch,
+                                                   &data_point.positive);
+        }
+        else if (json_key_is(key, length, "negative", NULL)) {
+            result = json_read_exponential_buckets(reader, &decoder->scratch,
+                                                   &data_point.negative);
+        }
+        else if (json_key_is(key, length, "exemplars", NULL)) {
+            result = json_read_exemplar_list(reader, &decoder->scratch,
+                                             &data_point.exemplars,
+                                             &data_point.n_exemplars);
+        }
+        else if (json_key_is(key, length, "min", NULL)) {
+            data_point.has_min = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.min));
+        }
+        else if (json_key_is(key, length, "max", NULL)) {
+            data_point.has_max = CMT_TRUE;
+            result = json_status(cmt_json_read_double(reader, &data_point.max));
+        }
+        else if (json_key_is(key, length, "zeroThreshold", "zero_threshold")) {
+            result = json_status(cmt_json_read_double(reader, &data_point.zero_threshold));
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    return decode_exponential_histogram_data_point(cmt, map, &data_point, CFL_FALSE);
+}
+
+static int json_decode_data_points(struct otlp_json_decoder *decoder,
+                                   struct cmt *cmt,
+                                   struct cmt_map *map,
+                                   int data_case)
+{
+    int more;
+    int result;
+
+    if (cmt_json_array_begin(&decoder->reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_status(cmt_json_array_next(&decoder->reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        switch (data_case) {
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+            result = json_decode_number_data_point(decoder, cmt, map);
+            break;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+            result = json_decode_summary_data_point(decoder, cmt, map);
+            break;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+            result = json_decode_histogram_data_point(decoder, cmt, map);
+            break;
+        default:
+            result = json_decode_exponential_histogram_data_point(decoder, cmt, map);
+            break;
+        }
+
+        json_scratch_reset(&decoder->scratch);
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    return result;
+}
+
+/* the same mapping decode_counter_entry() and its siblings apply */
+static void json_apply_aggregation_temporality(struct cmt_map *map,
+                                               uint64_t temporality)
+{
+    int aggregation_type;
+
+    if (temporality == OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA) {
+        aggregation_type = CMT_AGGREGATION_TYPE_DELTA;
+    }
+    else if (temporality == OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE) {
+        aggregation_type = CMT_AGGREGATION_TYPE_CUMULATIVE;
+    }
+    else {
+        aggregation_type = CMT_AGGREGATION_TYPE_UNSPECIFIED;
+    }
+
+    if (map->type == CMT_COUNTER) {
+        ((struct cmt_counter *) map->parent)->aggregation_type = aggregation_type;
+    }
+    else if (map->type == CMT_HISTOGRAM) {
+        ((struct cmt_histogram *) map->parent)->aggregation_type = aggregation_type;
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        ((struct cmt_exp_histogram *) map->parent)->aggregation_type = aggregation_type;
+    }
+}
+
+/*
+ * Gauge, Sum, Histogram, ExponentialHistogram or Summary object of a metric
+ * that was already created. Counters need to know if they are monotonic
+ * before their data points are decoded, the data points of a sum that come
+ * first are revisited once the whole object was read.
+ */
+static int json_decode_metric_data(struct otlp_json_decoder *decoder,
+                                   struct cmt *cmt,
+                                   struct cmt_map *map,
+                                   int data_case)
+{
+    int                     more;
+    int                     result;
+    int                     is_monotonic;
+    int                     monotonic_set;
+    size_t                  length;
+    size_t                  end_offset;
+    size_t                  data_points_offset;
+    uint64_t                temporality;
+    const char             *key;
+    struct cmt_json_reader *reader;
+
+    reader = &decoder->reader;
+    monotonic_set = CMT_FALSE;
+    data_points_offset = 0;
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "dataPoints", "data_points")) {
+            if (data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM &&
+                !monotonic_set) {
+                data_points_offset = reader->offset;
+                result = json_status(cmt_json_skip_value(reader));
+            }
+            else {
+                result = json_decode_data_points(decoder, cmt, map, data_case);
+            }
+        }
+        else if (json_key_is(key, length, "aggregationTemporality", "aggregation_temporality")) {
+            result = json_read_aggregation_temporality(reader, &temporality);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                json_apply_aggregation_temporality(map, temporality);
+            }
+        }
+        else if (json_key_is(key, length, "isMonotonic", "is_monotonic") &&
+                 data_case == OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM) {
+            result = json_status(cmt_json_read_bool(reader, &is_monotonic));
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                ((struct cmt_counter *) map->parent)->allow_reset = !is_monotonic;
+                monotonic_set = CMT_TRUE;
+            }
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && data_points_offset > 0) {
+        end_offset = reader->offset;
+        reader->offset = data_points_offset;
+
+        result = json_decode_data_points(decoder, cmt, map, data_case);
+
+        reader->offset = end_offset;
+    }
+
+    return result;
+}
+
+static int json_decode_metric_metadata(struct otlp_json_decoder *decoder,
+                                       struct cmt *cmt,
+                                       struct cmt_map *map)
+{
+    int                                          result;
+    size_t                                       index;
+    size_t                                       count;
+    struct cfl_kvlist                           *metric_context;
+    struct cfl_kvlist                           *metric_metadata;
+    Opentelemetry__Proto__Common__V1__KeyValue **entries;
+
+    entries = NULL;
+    count = 0;
+
+    result = json_read_key_value_list(&decoder->reader, &decoder->scratch,
+                                      &entries, &count, 0);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && count > 0) {
+        metric_context = get_or_create_metric_metadata_context(cmt, map);
+
+        if (metric_context != NULL) {
+            metric_metadata = get_or_create_external_metadata_kvlist(metric_context, "metadata");
+
+            /* same as the tree decoder, metadata is best effort */
+            if (metric_metadata != NULL) {
+                for (index = 0 ; index < count ; index++) {
+                    clone_kvlist_entry(metric_metadata, entries[index], CFL_FALSE);
+                }
+            }
+        }
+    }
+
+    json_scratch_reset(&decoder->scratch);
+
+    return result;
+}
+
+static int json_data_case(const char *key, size_t length)
+{
+    if (json_key_is(key, length, "gauge", NULL)) {
+        return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE;
+    }
+    else if (json_key_is(key, length, "sum", NULL)) {
+        return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM;
+    }
+    else if (json_key_is(key, length, "histogram", NULL)) {
+        return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM;
+    }
+    else if (json_key_is(key, length, "exponentialHistogram", "exponential_histogram")) {
+        return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM;
+    }
+    else if (json_key_is(key, length, "summary", NULL)) {
+        return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY;
+    }
+
+    return OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA__NOT_SET;
+}
+
+/* create the metric from empty containers, the same way stream_metric() does */
+static int json_create_metric(struct cmt *cmt, int data_case,
+                              cfl_sds_t name, cfl_sds_t description,
+                              cfl_sds_t unit, struct cmt_map **map)
+{
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogram  exp_histogram = OPENTELEMETRY__PROTO__METRICS__V1__EXPONENTIAL_HISTOGRAM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Histogram             histogram = OPENTELEMETRY__PROTO__METRICS__V1__HISTOGRAM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Summary               summary = OPENTELEMETRY__PROTO__METRICS__V1__SUMMARY__INIT;
+    Opentelemetry__Proto__Metrics__V1__Gauge                 gauge = OPENTELEMETRY__PROTO__METRICS__V1__GAUGE__INIT;
+    Opentelemetry__Proto__Metrics__V1__Sum                   sum = OPENTELEMETRY__PROTO__METRICS__V1__SUM__INIT;
+    Opentelemetry__Proto__Metrics__V1__Metric                metric = OPENTELEMETRY__PROTO__METRICS__V1__METRIC__INIT;
+    int                                                      result;
+
+    if (name == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    metric.name = name;
+    metric.data_case = data_case;
+
+    if (description != NULL) {
+        metric.description = description;
+    }
+
+    if (unit != NULL) {
+        metric.unit = unit;
+    }
+
+    switch (data_case) {
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+        metric.sum = &sum;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+        metric.gauge = &gauge;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+        metric.summary = &summary;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+        metric.histogram = &histogram;
+        break;
+    case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM:
+        metric.exponential_histogram = &exp_histogram;
+        break;
+    default:
+        /* rejected by decode_metrics_entry() */
+        break;
+    }
+
+    result = decode_metrics_entry(cmt, &metric, CFL_FALSE);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return result;
+    }
+
+    *map = get_last_metric_map(cmt, data_case);
+
+    if (*map == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+/* description and unit that come after the data of the metric */
+static int json_update_metric_description(struct cmt_map *map,
+                                          cfl_sds_t description)
+{
+    cfl_sds_t value;
+
+    if (cfl_sds_len(description) == 0) {
+        value = cfl_sds_create("-");
+    }
+    else {
+        value = cfl_sds_create_len(description, cfl_sds_len(description));
+    }
+
+    if (value == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    cfl_sds_destroy(map->opts->description);
+    map->opts->description = value;
+
+    return CMT_DECODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int json_decode_metric(struct otlp_json_decoder *decoder,
+                              struct cmt *cmt)
+{
+    int                     more;
+    int                     result;
+    int                     data_case;
+    int                     key_case;
+    size_t                  length;
+    size_t                  end_offset;
+    size_t                  data_offset;
+    size_t                  metadata_offset;
+    const char             *key;
+    cfl_sds_t               name;
+    cfl_sds_t               description;
+    cfl_sds_t               unit;
+    struct cmt_map         *map;
+    struct cmt_json_reader *reader;
+
+    reader = &decoder->reader;
+    name = NULL;
+    description = NULL;
+    unit = NULL;
+    map = NULL;
+    data_case = OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA__NOT_SET;
+    data_offset = 0;
+    metadata_offset = 0;
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        key_case = json_data_case(key, length);
+
+        if (key_case != OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA__NOT_SET) {
+            /* data is a oneof, a second member is malformed input */
+            if (data_case != OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA__NOT_SET) {
+                result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+            else if (name == NULL) {
+                data_case = key_case;
+                data_offset = reader->offset;
+                result = json_status(cmt_json_skip_value(reader));
+            }
+            else {
+                data_case = key_case;
+                result = json_create_metric(cmt, data_case, name, description, unit, &map);
+
+                if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+                    result = json_decode_metric_data(decoder, cmt, map, data_case);
+                }
+            }
+        }
+        else if (json_key_is(key, length, "name", NULL)) {
+            result = json_read_sds(reader, &name);
+        }
+        else if (json_key_is(key, length, "description", NULL)) {
+            result = json_read_sds(reader, &description);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && map != NULL) {
+                result = json_update_metric_description(map, description);
+            }
+        }
+        else if (json_key_is(key, length, "unit", NULL)) {
+            result = json_read_sds(reader, &unit);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && map != NULL) {
+                result = decode_metric_unit(map, unit);
+            }
+        }
+        else if (json_key_is(key, length, "metadata", NULL)) {
+            if (map == NULL) {
+                metadata_offset = reader->offset;
+                result = json_status(cmt_json_skip_value(reader));
+            }
+            else {
+                result = json_decode_metric_metadata(decoder, cmt, map);
+            }
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            goto cleanup;
+        }
+    }
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        goto cleanup;
+    }
+
+    end_offset = reader->offset;
+
+    if (map == NULL) {
+        result = json_create_metric(cmt, data_case, name, description, unit, &map);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && data_offset > 0) {
+            reader->offset = data_offset;
+            result = json_decode_metric_data(decoder, cmt, map, data_case);
+        }
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS && metadata_offset > 0) {
+        reader->offset = metadata_offset;
+        result = json_decode_metric_metadata(decoder, cmt, map);
+    }
+
+    reader->offset = end_offset;
+
+cleanup:
+    if (name != NULL) {
+        cfl_sds_destroy(name);
+    }
+
+    if (description != NULL) {
+        cfl_sds_destroy(description);
+    }
+
+    if (unit != NULL) {
+        cfl_sds_destroy(unit);
+    }
+
+    return result;
+}
+
+static int json_read_scope(struct cmt_json_reader *reader,
+                           struct otlp_json_scratch *scratch,
+                           Opentelemetry__Proto__Common__V1__InstrumentationScope **output)
+{
+    int                                                     more;
+    int                                                     result;
+    size_t                                                  length;
+    const char                                             *key;
+    Opentelemetry__Proto__Common__V1__InstrumentationScope *scope;
+
+    scope = json_scratch_alloc(scratch, sizeof(*scope));
+    if (scope == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__common__v1__instrumentation_scope__init(scope);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "name", NULL)) {
+            result = json_read_text(reader, scratch, &scope->name, NULL);
+        }
+        else if (json_key_is(key, length, "version", NULL)) {
+            result = json_read_text(reader, scratch, &scope->version, NULL);
+        }
+        else if (json_key_is(key, length, "attributes", NULL)) {
+            result = json_read_key_value_list(reader, scratch,
+                                              &scope->attributes,
+                                              &scope->n_attributes, 0);
+        }
+        else if (json_key_is(key, length, "droppedAttributesCount", "dropped_attributes_count")) {
+            result = json_read_uint32(reader, &scope->dropped_attributes_count);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = scope;
+
+    return result;
+}
+
+static int json_read_resource(struct cmt_json_reader *reader,
+                              struct otlp_json_scratch *scratch,
+                              Opentelemetry__Proto__Resource__V1__Resource **output)
+{
+    int                                           more;
+    int                                           result;
+    size_t                                        length;
+    const char                                   *key;
+    Opentelemetry__Proto__Resource__V1__Resource *resource;
+
+    resource = json_scratch_alloc(scratch, sizeof(*resource));
+    if (resource == NULL) {
+        return CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+    opentelemetry__proto__resource__v1__resource__init(resource);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "attributes", NULL)) {
+            result = json_read_key_value_list(reader, scratch,
+                                              &resource->attributes,
+                                              &resource->n_attributes, 0);
+        }
+        else if (json_key_is(key, length, "droppedAttributesCount", "dropped_attributes_count")) {
+            result = json_read_uint32(reader, &resource->dropped_attributes_count);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    *output = resource;
+
+    return result;
+}
+
+/*
+ * The context is created as soon as the ScopeMetrics object opens so metrics
+ * can be decoded in place, the scope metadata is filled in whenever the
+ * scope member shows up and the schema url once the object is complete.
+ */
+static int json_decode_scope_metrics(struct otlp_json_decoder *decoder,
+                                     struct cfl_list *context_list)
+{
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics         scope_metrics = OPENTELEMETRY__PROTO__METRICS__V1__SCOPE_METRICS__INIT;
+    Opentelemetry__Proto__Common__V1__InstrumentationScope *scope;
+    int                                                     more;
+    int                                                     result;
+    size_t                                                  length;
+    const char                                             *key;
+    cfl_sds_t                                               schema_url;
+    struct cmt                                             *context;
+    struct cmt_json_reader                                 *reader;
+
+    reader = &decoder->reader;
+    schema_url = NULL;
+
+    /* no schema url yet, decode_scope_metrics_metadata() only adds it once */
+    scope_metrics.schema_url = NULL;
+
+    result = decode_scope_metrics_entry(context_list, &scope_metrics, CFL_FALSE);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return result;
+    }
+
+    context = cfl_list_entry_last(context_list, struct cmt, _head);
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "metrics", NULL)) {
+            if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+                result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+
+            while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   (result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   more) {
+                result = json_decode_metric(decoder, context);
+            }
+
+            more = CMT_TRUE;
+        }
+        else if (json_key_is(key, length, "scope", NULL)) {
+            result = json_read_scope(reader, &decoder->scratch, &scope);
+
+            if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                decode_scope_metadata_and_attributes(context->external_metadata,
+                                                     scope, CFL_FALSE) != 0) {
+                result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+            }
+
+            json_scratch_reset(&decoder->scratch);
+        }
+        else if (json_key_is(key, length, "schemaUrl", "schema_url")) {
+            result = json_read_sds(reader, &schema_url);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            break;
+        }
+    }
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        scope_metrics.schema_url = schema_url != NULL ?
+                                   schema_url : (char *) protobuf_c_empty_string;
+
+        if (decode_scope_metrics_metadata(context->external_metadata,
+                                          &scope_metrics, CFL_FALSE) != 0) {
+            result = CMT_DECODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+    }
+
+    if (schema_url != NULL) {
+        cfl_sds_destroy(schema_url);
+    }
+
+    return result;
+}
+
+/*
+ * Every scope of a ResourceMetrics object decodes into its own context, the
+ * resource metadata is attached to all of them once the object is complete.
+ */
+static int json_decode_resource_metrics(struct otlp_json_decoder *decoder,
+                                        struct cfl_list *context_list)
+{
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics  resource_metrics = OPENTELEMETRY__PROTO__METRICS__V1__RESOURCE_METRICS__INIT;
+    int                                                 more;
+    int                                                 result;
+    size_t                                              length;
+    const char                                         *key;
+    cfl_sds_t                                           schema_url;
+    struct cfl_list                                    *first;
+    struct cfl_list                                    *head;
+    struct cmt                                         *context;
+    struct cmt_json_reader                             *reader;
+
+    reader = &decoder->reader;
+    schema_url = NULL;
+
+    /* last context that belongs to a previous resource */
+    first = context_list->prev;
+
+    if (cmt_json_object_begin(reader) != CMT_JSON_SUCCESS) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    while ((result = json_next_member(reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (json_key_is(key, length, "scopeMetrics", "scope_metrics")) {
+            if (cmt_json_array_begin(reader) != CMT_JSON_SUCCESS) {
+                result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+
+            while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   (result = json_status(cmt_json_array_next(reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+                   more) {
+                result = json_decode_scope_metrics(decoder, context_list);
+            }
+
+            more = CMT_TRUE;
+        }
+        else if (json_key_is(key, length, "resource", NULL)) {
+            json_scratch_reset(&decoder->resource_scratch);
+
+            result = json_read_resource(reader, &decoder->resource_scratch,
+                                        &resource_metrics.resource);
+        }
+        else if (json_key_is(key, length, "schemaUrl", "schema_url")) {
+            result = json_read_sds(reader, &schema_url);
+        }
+        else {
+            result = json_status(cmt_json_skip_value(reader));
+        }
+
+        if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            break;
+        }
+    }
+
+    if (schema_url != NULL) {
+        resource_metrics.schema_url = schema_url;
+    }
+
+    for (head = first->next ;
+         result == CMT_DECODE_OPENTELEMETRY_SUCCESS && head != context_list ;
+         head = head->next) {
+        context = cfl_list_entry(head, struct cmt, _head);
+
+        result = attach_resource_metrics_metadata(context, &resource_metrics,
+                                                  CFL_FALSE);
+    }
+
+    json_scratch_reset(&decoder->resource_scratch);
+
+    if (schema_url != NULL) {
+        cfl_sds_destroy(schema_url);
+    }
+
+    return result;
+}
+
+int cmt_decode_opentelemetry_json_create(struct cfl_list *result_context_list,
+                                         char *in_buf, size_t in_size,
+                                         size_t *offset)
+{
+    int                      more;
+    int                      result;
+    size_t                   length;
+    const char              *key;
+    struct otlp_json_decoder decoder;
+
+    cfl_list_init(result_context_list);
+
+    if (in_buf == NULL || offset == NULL || *offset > in_size) {
+        return CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    memset(&decoder, 0, sizeof(struct otlp_json_decoder));
+    decoder.scratch.chunk_size = OTLP_JSON_SCRATCH_MINIMUM_SIZE;
+    decoder.resource_scratch.chunk_size = OTLP_JSON_SCRATCH_MINIMUM_SIZE;
+
+    cmt_json_reader_init(&decoder.reader, &in_buf[*offset], in_size - *offset);
+
+    result = CMT_DECODE_OPENTELEMETRY_SUCCESS;
+
+    if (cmt_json_object_begin(&decoder.reader) != CMT_JSON_SUCCESS) {
+        result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    /* MetricsData and ExportMetricsServiceRequest share their JSON form */
+    while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           (result = json_next_member(&decoder.reader, &more, &key, &length)) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+           more) {
+        if (!json_key_is(key, length, "resourceMetrics", "resource_metrics")) {
+            result = json_status(cmt_json_skip_value(&decoder.reader));
+            continue;
+        }
+
+        if (cmt_json_array_begin(&decoder.reader) != CMT_JSON_SUCCESS) {
+            result = CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+        }
+
+        while (result == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+               (result = json_status(cmt_json_array_next(&decoder.reader, &more))) == CMT_DECODE_OPENTELEMETRY_SUCCESS &&
+               more) {
+            result = json_decode_resource_metrics(&decoder, result_context_list);
+        }
+
+        more = CMT_TRUE;
+    }
+
+    json_scratch_destroy(&decoder.scratch);
+    json_scratch_destroy(&decoder.resource_scratch);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        destroy_context_list(result_context_list);
+
+        return result;
+    }
+
+    *offset += decoder.reader.offset;
+
+    return result;
 }
@@ -19,6 +19,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -29,27 +30,30 @@
 #include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_summary.h>
 #include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_decode_prometheus.h>
 
 #include <cmt_decode_prometheus_parser.h>
 #include <stdio.h>
 #include <string.h>
 #include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_math.h>
+
+/* the arena of a family starts small, most families have a few samples */
+#define SAMPLE_ARENA_CHUNK_SIZE         1024
+#define SAMPLE_ARENA_MAX_CHUNK_SIZE     65536
+
+/* longest value or timestamp, the flex scanner truncates anything longer */
+#define SAMPLE_VALUE_MAX_LENGTH         63
 
 static void reset_context(struct cmt_decode_prometheus_context *context,
                           bool reset_summary)
 {
     int i;
-    struct cmt_decode_prometheus_context_sample *sample;
 
-    while (!cfl_list_is_empty(&context->metric.samples)) {
-        sample = cfl_list_entry_first(&context->metric.samples,
-                                     struct cmt_decode_prometheus_context_sample, _head);
-        for (i = 0; i < context->metric.label_count; i++) {
-            cfl_sds_destroy(sample->label_values[i]);
-        }
-        cfl_list_del(&sample->_head);
-        free(sample);
+    /* samples and label values are released with the arena */
+    if (context->metric.arena) {
+        cfl_arena_destroy(context->metric.arena);
     }
 
     for (i = 0; i < context->metric.label_count; i++) {
@@ -72,14 +76,37 @@ static void reset_context(struct cmt_decode_prometheus_context *context,
 }
 
 
+static int fast_parse(struct cmt_decode_prometheus_context *context,
+                      const char *in_buf, size_t in_size);
+
+static int bison_parse(struct cmt_decode_prometheus_context *context,
+                       const char *in_buf, size_t in_size)
+{
+    yyscan_t scanner;
+    YY_BUFFER_STATE buf;
+    int result;
+
+    cmt_decode_prometheus_lex_init(&scanner);
+    buf = cmt_decode_prometheus__scan_bytes((char *)in_buf, in_size, scanner);
+    if (!buf) {
+        cmt_decode_prometheus_lex_destroy(scanner);
+        return CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR;
+    }
+
+    result = cmt_decode_prometheus_parse(scanner, context);
+
+    cmt_decode_prometheus__delete_buffer(buf, scanner);
+    cmt_decode_prometheus_lex_destroy(scanner);
+
+    return result;
+}
+
 int cmt_decode_prometheus_create(
         struct cmt **out_cmt,
         const char *in_buf,
         size_t in_size,
         struct cmt_decode_prometheus_parse_opts *opts)
 {
-    yyscan_t scanner;
-    YY_BUFFER_STATE buf;
     struct cmt *cmt;
     struct cmt_decode_prometheus_context context;
     int result;
@@ -96,17 +123,18 @@ int cmt_decode_prometheus_create(
         context.opts = *opts;
     }
     cfl_list_init(&(context.metric.samples));
-    cmt_decode_prometheus_lex_init(&scanner);
     if (!in_size) {
         in_size = strlen(in_buf);
     }
-    buf = cmt_decode_prometheus__scan_bytes((char *)in_buf, in_size, scanner);
-    if (!buf) {
-        cmt_destroy(cmt);
-        return CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR;
-    }
 
-    result = cmt_decode_prometheus_parse(scanner, &context);
+    /* start tokens are a grammar entry point, only the bison parser has them */
+    if (context.opts.parser == CMT_DECODE_PROMETHEUS_PARSER_FAST &&
+        !context.opts.start_token) {
+        result = fast_parse(&context, in_buf, in_size);
+    }
+    else {
+        result = bison_parse(&context, in_buf, in_size);
+    }
 
     if (context.errcode) {
         result = context.errcode;
@@ -121,8 +149,28 @@ int cmt_decode_prometheus_create(
 
     reset_context(&context, true);
 
-    cmt_decode_prometheus__delete_buffer(buf, scanner);
-    cmt_decode_prometheus_lex_destroy(scanner);
+    return result;
+}
+
+int cmt_decode_prometheus_merge(
+        struct cmt *dst,
+        const char *in_buf,
+        size_t in_size,
+        struct cmt_decode_prometheus_parse_opts *opts)
+{
+    struct cmt *cmt;
+    int result;
+
+    result = cmt_decode_prometheus_create(&cmt, in_buf, in_size, opts);
+    if (result != CMT_DECODE_PROMETHEUS_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_cat_move(dst, cmt) != 0) {
+        result = CMT_DECODE_PROMETHEUS_MERGE_ERROR;
+    }
+
+    cmt_destroy(cmt);
 
     return result;
 }
@@ -197,6 +245,16 @@ static int parse_uint64(const char *in, uint64_t *out)
 {
     char *end;
     int64_t val;
+    const char *digit;
+
+    /* plain runs of up to 18 digits cannot overflow, skip strtoll for them */
+    for (digit = in, val = 0; *digit >= '0' && *digit <= '9'; digit++) {
+        val = val * 10 + (*digit - '0');
+    }
+    if (digit != in && *digit == 0 && digit - in <= 18) {
+        *out = val;
+        return 0;
+    }
 
     errno = 0;
     val = strtoll(in, &end, 10);
@@ -215,79 +273,84 @@ static int parse_uint64(const char *in, uint64_t *out)
 
 static int parse_double(const char *in, double *out)
 {
-    char *end;
-    double val;
-    errno = 0;
-    val = strtod(in, &end);
-    if (end == in || *end != 0 || errno) {
-        return -1;
-    }
-    *out = val;
-    return 0;
+    return cmt_math_parse_double(in, strlen(in), out);
 }
 
-static int parse_timestamp(struct cmt_decode_prometheus_context *context,
-                           char *data_source, uint64_t *timestamp)
+static int sample_timestamp(struct cmt_decode_prometheus_context *context,
+                            struct cmt_decode_prometheus_context_sample *sample,
+                            uint64_t *timestamp)
 {
-    int result;
-
-    result = CMT_DECODE_PROMETHEUS_SUCCESS;
-
-    if (data_source != NULL && strlen(data_source) > 0) {
-        result = parse_uint64(data_source, timestamp);
-
-        if (result) {
-            result = report_error(context,
-                                  CMT_DECODE_PROMETHEUS_PARSE_TIMESTAMP_FAILED,
-                                  "failed to parse sample: \"%s\" is not a valid "
-                                  "timestamp", data_source);
-        }
-        else {
-            /* prometheus text format timestamps are expressed in milliseconds,
-             * while cmetrics expresses them in nanoseconds, so multiply by 10e5
-             */
+    if (!(sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_HAS_TIMESTAMP)) {
+        return CMT_DECODE_PROMETHEUS_SUCCESS;
+    }
 
-            *timestamp *= 10e5;
-        }
+    if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_TIMESTAMP_INVALID) {
+        return report_error(context,
+                            CMT_DECODE_PROMETHEUS_PARSE_TIMESTAMP_FAILED,
+                            "failed to parse sample: \"%s\" is not a valid "
+                            "timestamp", sample->timestamp_text);
     }
 
-    return result;
+    /* prometheus text format timestamps are expressed in milliseconds,
+     * while cmetrics expresses them in nanoseconds, so multiply by 10e5
+     */
+    *timestamp = sample->timestamp * 10e5;
+
+    return CMT_DECODE_PROMETHEUS_SUCCESS;
 }
 
-static int parse_value_timestamp(
+static int sample_value_timestamp(
         struct cmt_decode_prometheus_context *context,
         struct cmt_decode_prometheus_context_sample *sample,
         double *value,
         uint64_t *timestamp)
 {
-
-    if (parse_double(sample->value1, value)) {
+    if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID) {
         return report_error(context,
                 CMT_DECODE_PROMETHEUS_PARSE_VALUE_FAILED,
                 "failed to parse sample: \"%s\" is not a valid "
-                "value", sample->value1);
+                "value", sample->value_text);
     }
+    *value = sample->value;
 
     if (context->opts.override_timestamp) {
-        *timestamp = context->opts.override_timestamp;
-    }
-    else if (!strlen(sample->value2)) {
-        /* No timestamp was specified, use default value */
-        *timestamp = context->opts.default_timestamp;
+        /* scaled like the timestamps of the input */
+        *timestamp = context->opts.override_timestamp * 10e5;
         return 0;
     }
-    else if (parse_uint64(sample->value2, timestamp)) {
-        return report_error(context,
-                CMT_DECODE_PROMETHEUS_PARSE_TIMESTAMP_FAILED,
-                "failed to parse sample: \"%s\" is not a valid "
-                "timestamp", sample->value2);
+
+    /* No timestamp was specified, use default value */
+    *timestamp = context->opts.default_timestamp;
+
+    return sample_timestamp(context, sample, timestamp);
+}
+
+/*
+ * Label values of a sample for all the labels of the family, the ones that
+ * showed up after the sample are unset.
+ */
+static char **sample_label_values(struct cmt_decode_prometheus_context *context,
+                                  struct cmt_decode_prometheus_context_sample *sample,
+                                  char **buffer)
+{
+    size_t label_count;
+
+    label_count = context->metric.label_count;
+    if (!label_count) {
+        return NULL;
+    }
+    if (sample->label_count == label_count) {
+        return sample->label_values;
     }
 
-    /* prometheus text format timestamps are in milliseconds, while cmetrics is in
-     * nanoseconds, so multiply by 10e5 */
-    *timestamp = *timestamp * 10e5;
+    if (sample->label_count > 0) {
+        memcpy(buffer, sample->label_values,
+               sample->label_count * sizeof(char *));
+    }
+    memset(buffer + sample->label_count, 0,
+           (label_count - sample->label_count) * sizeof(char *));
 
-    return 0;
+    return buffer;
 }
 
 static int add_metric_counter(struct cmt_decode_prometheus_context *context)
@@ -300,6 +363,7 @@ static int add_metric_counter(struct cmt_decode_prometheus_context *context)
     struct cmt_decode_prometheus_context_sample *sample;
     double value;
     uint64_t timestamp;
+    char *label_values[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
 
     c = cmt_counter_create(context->cmt,
             context->metric.ns,
@@ -318,7 +382,7 @@ static int add_metric_counter(struct cmt_decode_prometheus_context *context)
     cfl_list_foreach_safe(head, tmp, &context->metric.samples) {
         sample = cfl_list_entry(head, struct cmt_decode_prometheus_context_sample, _head);
         label_count = context->metric.label_count;
-        ret = parse_value_timestamp(context, sample, &value, &timestamp);
+        ret = sample_value_timestamp(context, sample, &value, &timestamp);
         if (ret) {
             return ret;
         }
@@ -326,7 +390,7 @@ static int add_metric_counter(struct cmt_decode_prometheus_context *context)
                     timestamp,
                     value,
                     label_count,
-                    label_count ? sample->label_values : NULL)) {
+                    sample_label_values(context, sample, label_values))) {
             return report_error(context,
                     CMT_DECODE_PROMETHEUS_CMT_SET_ERROR,
                     "cmt_counter_set failed");
@@ -346,6 +410,7 @@ static int add_metric_gauge(struct cmt_decode_prometheus_context *context)
     struct cmt_decode_prometheus_context_sample *sample;
     double value;
     uint64_t timestamp;
+    char *label_values[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
 
     c = cmt_gauge_create(context->cmt,
             context->metric.ns,
@@ -364,7 +429,7 @@ static int add_metric_gauge(struct cmt_decode_prometheus_context *context)
     cfl_list_foreach_safe(head, tmp, &context->metric.samples) {
         sample = cfl_list_entry(head, struct cmt_decode_prometheus_context_sample, _head);
         label_count = context->metric.label_count;
-        ret = parse_value_timestamp(context, sample, &value, &timestamp);
+        ret = sample_value_timestamp(context, sample, &value, &timestamp);
         if (ret) {
             return ret;
         }
@@ -372,7 +437,7 @@ static int add_metric_gauge(struct cmt_decode_prometheus_context *context)
                     timestamp,
                     value,
                     label_count,
-                    label_count ? sample->label_values : NULL)) {
+                    sample_label_values(context, sample, label_values))) {
             return report_error(context,
                     CMT_DECODE_PROMETHEUS_CMT_SET_ERROR,
                     "cmt_gauge_set failed");
@@ -392,6 +457,7 @@ static int add_metric_untyped(struct cmt_decode_prometheus_context *context)
     struct cmt_decode_prometheus_context_sample *sample;
     double value;
     uint64_t timestamp;
+    char *label_values[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT];
 
     c = cmt_untyped_create(context->cmt,
             context->metric.ns,
@@ -410,7 +476,7 @@ static int add_metric_untyped(struct cmt_decode_prometheus_context *context)
     cfl_list_foreach_safe(head, tmp, &context->metric.samples) {
         sample = cfl_list_entry(head, struct cmt_decode_prometheus_context_sample, _head);
         label_count = context->metric.label_count;
-        ret = parse_value_timestamp(context, sample, &value, &timestamp);
+        ret = sample_value_timestamp(context, sample, &value, &timestamp);
         if (ret) {
             return ret;
         }
@@ -418,7 +484,7 @@ static int add_metric_untyped(struct cmt_decode_prometheus_context *context)
                     timestamp,
                     value,
                     label_count,
-                    label_count ? sample->label_values : NULL)) {
+                    sample_label_values(context, sample, label_values))) {
             return report_error(context,
                     CMT_DECODE_PROMETHEUS_CMT_SET_ERROR,
                     "cmt_untyped_set failed");
@@ -440,7 +506,6 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
     uint64_t *bucket_defaults = NULL;
     double sum = 0;
     uint64_t count = 0;
-    double count_dbl;
     struct cfl_list *head;
     struct cfl_list *tmp;
     struct cmt_decode_prometheus_context_sample *sample;
@@ -448,7 +513,7 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
     struct cmt_histogram *h;
     struct cmt_histogram_buckets *cmt_buckets;
     cfl_sds_t *labels_without_le = NULL;
-    cfl_sds_t *values_without_le = NULL;
+    char **values_without_le = NULL;
     int label_i;
     uint64_t timestamp = 0;
 
@@ -520,7 +585,8 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
             le_label_index = i;
         } else {
             labels_without_le[label_i] = context->metric.labels[i];
-            values_without_le[label_i] = sample->label_values[i];
+            values_without_le[label_i] = i < sample->label_count ?
+                                         sample->label_values[i] : NULL;
             label_i++;
         }
     }
@@ -534,7 +600,8 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
                     /* probably last bucket, which has "Inf" */
                     break;
                 }
-                if (!sample->label_values[le_label_index] ||
+                if (le_label_index >= sample->label_count ||
+                    !sample->label_values[le_label_index] ||
                     sample->label_values[le_label_index][0] == '\0') {
                     ret = report_error(context,
                             CMT_DECODE_PROMETHEUS_SYNTAX_ERROR,
@@ -548,24 +615,17 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
                             "failed to parse bucket");
                     goto end;
                 }
-                if (parse_uint64(sample->value1,
-                            bucket_defaults + bucket_index)) {
-                    /* Count is supposed to be integer, but apparently
-                     * some tools can generate count in a floating format.
-                     * Try to parse as a double and then cast to uint64_t */
-                    if (parse_double(sample->value1, &count_dbl) || count_dbl < 0) {
-                        ret = report_error(context,
-                                CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
-                                "failed to parse count");
-                        goto end;
-                    } else {
-                        *(bucket_defaults + bucket_index) = (uint64_t)count_dbl;
-                    }
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_COUNT_INVALID) {
+                    ret = report_error(context,
+                            CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
+                            "failed to parse count");
+                    goto end;
                 }
+                bucket_defaults[bucket_index] = sample->count;
                 bucket_index++;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -574,15 +634,16 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
 
                 break;
             case CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_SUM:
-                if (parse_double(sample->value1, &sum)) {
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID) {
                     ret = report_error(context,
                             CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
                             "failed to parse sum");
                     goto end;
                 }
+                sum = sample->value;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -591,23 +652,17 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
 
                 break;
             case CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_COUNT:
-                if (parse_uint64(sample->value1, &count)) {
-                    /* Count is supposed to be integer, but apparently
-                     * some tools can generate count in a floating format.
-                     * Try to parse as a double and then cast to uint64_t */
-                    if (parse_double(sample->value1, &count_dbl) || count_dbl < 0) {
-                        ret = report_error(context,
-                                CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
-                                "failed to parse count");
-                        goto end;
-                    } else {
-                        count = (uint64_t)count_dbl;
-                    }
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_COUNT_INVALID) {
+                    ret = report_error(context,
+                            CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
+                            "failed to parse count");
+                    goto end;
                 }
+                count = sample->count;
                 bucket_defaults[bucket_index] = count;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -643,6 +698,7 @@ static int add_metric_histogram(struct cmt_decode_prometheus_context *context)
                                  label_i ? labels_without_le : NULL);
 
         if (!h) {
+            cmt_histogram_buckets_destroy(cmt_buckets);
             ret = report_error(context,
                     CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
                     "cmt_histogram_create failed");
@@ -688,7 +744,6 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
     double *quantiles = NULL;
     double *quantile_defaults = NULL;
     double sum = 0.0;
-    double count_dbl;
     size_t label_count;
     uint64_t count = 0;
     struct cfl_list *head;
@@ -697,7 +752,7 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
     size_t quantile_label_index = 0;
     struct cmt_summary *s;
     cfl_sds_t *labels_without_quantile = NULL;
-    cfl_sds_t *values_without_quantile = NULL;
+    char **values_without_quantile = NULL;
     int label_i;
     uint64_t timestamp = 0;
 
@@ -762,7 +817,8 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
             break;
         } else {
             labels_without_quantile[label_i] = context->metric.labels[i];
-            values_without_quantile[label_i] = sample->label_values[i];
+            values_without_quantile[label_i] = i < sample->label_count ?
+                                               sample->label_values[i] : NULL;
             label_i++;
         }
     }
@@ -772,24 +828,26 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
         sample = cfl_list_entry(head, struct cmt_decode_prometheus_context_sample, _head);
         switch (sample->type) {
             case CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_NORMAL:
-                if (parse_double(sample->label_values[quantile_label_index],
+                if (quantile_label_index >= sample->label_count ||
+                    !sample->label_values[quantile_label_index] ||
+                    parse_double(sample->label_values[quantile_label_index],
                             quantiles + quantile_index)) {
                     ret = report_error(context,
                             CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
                             "failed to parse bucket");
                     goto end;
                 }
-                if (parse_double(sample->value1,
-                            quantile_defaults + quantile_index)) {
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID) {
                     ret = report_error(context,
                             CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
                             "failed to parse quantile value");
                     goto end;
                 }
+                quantile_defaults[quantile_index] = sample->value;
                 quantile_index++;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -798,15 +856,16 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
 
                 break;
             case CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_SUM:
-                if (parse_double(sample->value1, &sum)) {
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID) {
                     ret = report_error(context,
                             CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
                             "failed to parse summary sum");
                     goto end;
                 }
+                sum = sample->value;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -816,22 +875,16 @@ static int add_metric_summary(struct cmt_decode_prometheus_context *context)
                 break;
 
             case CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_COUNT:
-                if (parse_uint64(sample->value1, &count)) {
-                    /* Count is supposed to be integer, but apparently
-                     * some tools can generate count in a floating format.
-                     * Try to parse as a double and then cast to uint64_t */
-                    if (parse_double(sample->value1, &count_dbl) || count_dbl < 0) {
-                        ret = report_error(context,
-                                CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
-                                "failed to parse count");
-                        goto end;
-                    } else {
-                        count = (uint64_t)count_dbl;
-                    }
+                if (sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_COUNT_INVALID) {
+                    ret = report_error(context,
+                            CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR,
+                            "failed to parse count");
+                    goto end;
                 }
+                count = sample->count;
 
                 if (!timestamp) {
-                    ret = parse_timestamp(context, sample->value2, &timestamp);
+                    ret = sample_timestamp(context, sample, &timestamp);
 
                     if (ret) {
                         goto end;
@@ -1124,16 +1177,33 @@ static int parse_metric_name(
     return ret;
 }
 
-static int parse_label(
-        struct cmt_decode_prometheus_context *context,
-        cfl_sds_t name, cfl_sds_t value)
+static struct cfl_arena *sample_arena(struct cmt_decode_prometheus_context *context)
+{
+    struct cfl_arena_options options;
+
+    if (!context->metric.arena) {
+        cfl_arena_options_init(&options);
+        options.chunk_size = SAMPLE_ARENA_CHUNK_SIZE;
+        options.maximum_chunk_size = SAMPLE_ARENA_MAX_CHUNK_SIZE;
+        context->metric.arena = cfl_arena_create_with_options(&options);
+        if (!context->metric.arena) {
+            report_error(context,
+                         CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                         "memory allocation failed");
+        }
+    }
+
+    return context->metric.arena;
+}
+
+/* 'value' is allocated from the sample arena */
+static int add_label(struct cmt_decode_prometheus_context *context,
+                     cfl_sds_t name, char *value)
 {
     int i;
-    struct cmt_decode_prometheus_context_sample *sample;
 
     if (context->metric.label_count >= CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT) {
         cfl_sds_destroy(name);
-        cfl_sds_destroy(value);
         return report_error(context,
                 CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT_EXCEEDED,
                 "maximum number of labels exceeded");
@@ -1154,60 +1224,142 @@ static int parse_label(
         context->metric.label_count++;
     }
 
-    sample = cfl_list_entry_last(&context->metric.samples,
-            struct cmt_decode_prometheus_context_sample, _head);
-    sample->label_values[i] = value;
+    context->metric.label_values[i] = value;
     return 0;
 }
 
+static int parse_label(
+        struct cmt_decode_prometheus_context *context,
+        cfl_sds_t name, cfl_sds_t value)
+{
+    char *arena_value;
+
+    if (context->metric.label_count >= CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT) {
+        cfl_sds_destroy(name);
+        cfl_sds_destroy(value);
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT_EXCEEDED,
+                "maximum number of labels exceeded");
+    }
+
+    arena_value = NULL;
+    if (sample_arena(context)) {
+        arena_value = cfl_arena_strndup(context->metric.arena, value,
+                                        cfl_sds_len(value));
+    }
+    cfl_sds_destroy(value);
+    if (!arena_value) {
+        cfl_sds_destroy(name);
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                "memory allocation failed");
+    }
+
+    return add_label(context, name, arena_value);
+}
+
 static int sample_start(struct cmt_decode_prometheus_context *context)
 {
     struct cmt_decode_prometheus_context_sample *sample;
 
-    sample = malloc(sizeof(*sample));
+    if (!sample_arena(context)) {
+        return context->errcode;
+    }
+
+    sample = cfl_arena_calloc(context->metric.arena, 1, sizeof(*sample));
     if (!sample) {
         return report_error(context,
                 CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
                 "memory allocation failed");
     }
 
-    memset(sample, 0, sizeof(*sample));
     sample->type = context->metric.current_sample_type;
     cfl_list_add(&sample->_head, &context->metric.samples);
     return 0;
 }
 
+/*
+ * Parse the values of the sample and move its label values out of the
+ * context. Invalid values are reported when the family is added, like before
+ * samples were parsed early, so errors keep the same order.
+ */
 static int parse_sample(struct cmt_decode_prometheus_context *context,
                         const char *value1,
                         const char *value2)
 {
-    int len;
+    size_t length1;
+    size_t length2;
+    size_t label_count;
+    struct cfl_arena *arena;
     struct cmt_decode_prometheus_context_sample *sample;
+
     sample = cfl_list_entry_last(&context->metric.samples,
             struct cmt_decode_prometheus_context_sample, _head);
+    arena = context->metric.arena;
 
-    /* value1 */
-    len = strlen(value1);
-    if (len >= sizeof(sample->value1) - 1) {
+    length1 = strlen(value1);
+    length2 = strlen(value2);
+    if (length1 >= SAMPLE_VALUE_MAX_LENGTH ||
+        length2 >= SAMPLE_VALUE_MAX_LENGTH) {
         return report_error(context,
                 CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_TOO_LONG,
-                "sample value is too long (max %zu characters)", sizeof(sample->value1) - 1);
+                "sample value is too long (max %zu characters)",
+                (size_t) SAMPLE_VALUE_MAX_LENGTH);
+    }
+
+    if (parse_double(value1, &sample->value)) {
+        sample->flags |= CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID;
+        sample->value_text = cfl_arena_strndup(arena, value1, length1);
+        if (!sample->value_text) {
+            goto error;
+        }
     }
 
-    memcpy(sample->value1, value1, len);
-    sample->value1[len] = 0;
+    if (sample->type == CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_BUCKET ||
+        sample->type == CMT_DECODE_PROMETHEUS_CONTEXT_SAMPLE_TYPE_COUNT) {
+        if (parse_uint64(value1, &sample->count)) {
+            /* Count is supposed to be integer, but apparently
+             * some tools can generate count in a floating format.
+             * Try to parse as a double and then cast to uint64_t */
+            if ((sample->flags & CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_INVALID) ||
+                sample->value < 0) {
+                sample->flags |= CMT_DECODE_PROMETHEUS_SAMPLE_COUNT_INVALID;
+            }
+            else {
+                sample->count = (uint64_t) sample->value;
+            }
+        }
+    }
 
-    /* value2 */
-    len = strlen(value2);
-    if (len >= sizeof(sample->value2) - 1) {
-        return report_error(context,
-                CMT_DECODE_PROMETHEUS_SAMPLE_VALUE_TOO_LONG,
-                "sample value is too long (max %zu characters)", sizeof(sample->value2) - 1);
+    if (length2) {
+        sample->flags |= CMT_DECODE_PROMETHEUS_SAMPLE_HAS_TIMESTAMP;
+        if (parse_uint64(value2, &sample->timestamp)) {
+            sample->flags |= CMT_DECODE_PROMETHEUS_SAMPLE_TIMESTAMP_INVALID;
+            sample->timestamp_text = cfl_arena_strndup(arena, value2, length2);
+            if (!sample->timestamp_text) {
+                goto error;
+            }
+        }
+    }
+
+    label_count = context->metric.label_count;
+    if (label_count) {
+        sample->label_values = cfl_arena_alloc(arena, label_count * sizeof(char *));
+        if (!sample->label_values) {
+            goto error;
+        }
+        memcpy(sample->label_values, context->metric.label_values,
+               label_count * sizeof(char *));
+        memset(context->metric.label_values, 0, label_count * sizeof(char *));
+        sample->label_count = label_count;
     }
-    memcpy(sample->value2, value2, len);
-    sample->value2[len] = 0;
 
     return 0;
+
+error:
+    return report_error(context,
+            CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+            "memory allocation failed");
 }
 
 /* called automatically by the generated parser code on error */
@@ -1221,3 +1373,993 @@ static int cmt_decode_prometheus_error(void *yyscanner,
 
     return 0;
 }
+
+/*
+ * Hand written parser
+ * -------------------
+ * A single pass alternative to the flex scanner and the bison grammar. It
+ * accepts the same language (newlines are whitespace between the tokens of
+ * a sample, '#' only starts a comment at the beginning of a line) and drives
+ * the same actions, so both parsers build identical contexts and report the
+ * same error codes. Delimiters are found through character class tables and
+ * memchr(), and metric or label names are only copied when they are new.
+ *
+ * Samples are read in full before their actions run, so when the input is
+ * not final the parser can stop in the middle of a statement and resume it
+ * once more input is available, see cmt_decode_prometheus_stream_feed().
+ */
+
+#define FAST_CLASS_IDENTIFIER_START  0x01
+#define FAST_CLASS_IDENTIFIER        0x02
+#define FAST_CLASS_NUMBER            0x04
+#define FAST_CLASS_QUOTED_STOP       0x08
+#define FAST_CLASS_BLANK             0x10
+
+/* the input ends inside a statement, only returned when it is not final */
+#define FAST_NEED_MORE              -1
+#define FAST_TOKEN_INVALID           1
+
+struct fast_token {
+    int type;
+    const char *start;
+    size_t length;
+
+    /* quoted string containing escape sequences */
+    int escaped;
+
+    /* HELP docstring */
+    const char *text;
+    size_t text_length;
+
+    /* TYPE metric type */
+    int metric_type;
+};
+
+struct fast_label {
+    const char *name;
+    size_t name_length;
+    const char *value;
+    size_t value_length;
+    int escaped;
+};
+
+struct fast_parser {
+    struct cmt_decode_prometheus_context *context;
+    struct cmt_decode_prometheus_stream *stream;
+    const char *cursor;
+    const char *end;
+    int line_start;
+    int final;
+    size_t statements;
+};
+
+/* bytes above 0x7f have no class */
+static const unsigned char fast_classes[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x08, 0x00, 0x00, 0x08, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x10, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x07, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x00, 0x08, 0x00, 0x00, 0x03,
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x07, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static inline int fast_class(const char *p, int mask)
+{
+    return fast_classes[(unsigned char) *p] & mask;
+}
+
+static const char *fast_skip_class(const char *p, const char *end, int class_mask)
+{
+    while (p < end && fast_class(p, class_mask)) {
+        p++;
+    }
+    return p;
+}
+
+static const char *fast_find_class(const char *p, const char *end, int class_mask)
+{
+    while (p < end && !fast_class(p, class_mask)) {
+        p++;
+    }
+    return p;
+}
+
+static int fast_syntax_error(struct cmt_decode_prometheus_context *context,
+                             struct fast_token *token)
+{
+    if (context->errcode) {
+        return context->errcode;
+    }
+
+    if (token->type == 0) {
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_SYNTAX_ERROR,
+                "syntax error, unexpected end of file");
+    }
+
+    return report_error(context,
+            CMT_DECODE_PROMETHEUS_SYNTAX_ERROR,
+            "syntax error, unexpected \"%.*s\"",
+            (int) (token->length > 32 ? 32 : token->length), token->start);
+}
+
+/*
+ * '#' lines: HELP and TYPE headers become tokens, comments are skipped and
+ * leave the token type unset. 'p' points right after the '#'.
+ */
+static int fast_header(struct fast_parser *parser, const char *p,
+                       struct fast_token *token)
+{
+    int help;
+    size_t length;
+    const char *end;
+    const char *line_end;
+    static const struct {
+        const char *name;
+        size_t length;
+        int type;
+    } types[] = {
+        {"counter", 7, COUNTER},
+        {"gauge", 5, GAUGE},
+        {"summary", 7, SUMMARY},
+        {"untyped", 7, UNTYPED},
+        {"histogram", 9, HISTOGRAM},
+        {NULL, 0, 0}
+    };
+
+    end = parser->end;
+    while (p < end && *p == ' ') {
+        p++;
+    }
+
+    /* nothing is decided before the whole line is available */
+    line_end = memchr(p, '\n', end - p);
+    if (!line_end) {
+        if (!parser->final) {
+            return FAST_NEED_MORE;
+        }
+        line_end = end;
+    }
+
+    if (line_end - p < 5 ||
+        (memcmp(p, "HELP", 4) && memcmp(p, "TYPE", 4)) ||
+        (p[4] != ' ' && p[4] != '\t')) {
+        /* comment, the newline is handled by the caller */
+        parser->cursor = line_end;
+        return 0;
+    }
+
+    /*
+     * Like the flex scanner the metric name runs until the next blank, even
+     * across lines, so a HELP without docstring swallows the line after it.
+     */
+    help = p[0] == 'H';
+    p = fast_skip_class(p + 4, end, FAST_CLASS_BLANK);
+    token->start = p;
+    p = fast_find_class(p, end, FAST_CLASS_BLANK);
+    token->length = p - token->start;
+    if (p == end) {
+        return parser->final ? FAST_TOKEN_INVALID : FAST_NEED_MORE;
+    }
+    p = fast_skip_class(p, end, FAST_CLASS_BLANK);
+
+    line_end = memchr(p, '\n', end - p);
+    if (!line_end) {
+        if (!parser->final) {
+            return FAST_NEED_MORE;
+        }
+        line_end = end;
+    }
+
+    if (help) {
+        /* the docstring runs until the end of the line */
+        length = line_end - p;
+        if (length && p[length - 1] == '\r') {
+            length--;
+        }
+        token->type = HELP;
+        token->text = p;
+        token->text_length = length;
+        parser->cursor = line_end;
+        return 0;
+    }
+
+    for (token->metric_type = 0; types[token->metric_type].name; token->metric_type++) {
+        length = types[token->metric_type].length;
+        if ((size_t) (line_end - p) >= length &&
+            !memcmp(p, types[token->metric_type].name, length)) {
+            break;
+        }
+    }
+    if (!types[token->metric_type].name) {
+        token->type = TYPE;
+        return FAST_TOKEN_INVALID;
+    }
+    p = fast_skip_class(p + length, line_end, FAST_CLASS_BLANK);
+    if (p < line_end && !(*p == '\r' && p + 1 == line_end)) {
+        token->type = TYPE;
+        return FAST_TOKEN_INVALID;
+    }
+    token->type = TYPE;
+    token->metric_type = types[token->metric_type].type;
+    parser->cursor = line_end;
+    return 0;
+}
+
+/* a sign followed by inf or nan, in any case */
+static size_t fast_infnan_length(const char *p, const char *end)
+{
+    size_t sign;
+    char lower[3];
+
+    sign = *p == '+' || *p == '-';
+    if ((size_t) (end - p) < sign + 3) {
+        return 0;
+    }
+    p += sign;
+    lower[0] = tolower((unsigned char) p[0]);
+    lower[1] = tolower((unsigned char) p[1]);
+    lower[2] = tolower((unsigned char) p[2]);
+    if (memcmp(lower, "inf", 3) && memcmp(lower, "nan", 3)) {
+        return 0;
+    }
+    return sign + 3;
+}
+
+/*
+ * Read the next token, a zero type means the input is over. Tokens follow
+ * the flex rules: the longest match wins and ties go to INF/NAN, then
+ * identifiers, then numbers. Returns FAST_TOKEN_INVALID on a character the
+ * flex scanner would not accept and FAST_NEED_MORE when the input is not
+ * final and the token could continue past its end, the cursor is left on
+ * the token in that case.
+ */
+static int fast_next_token(struct fast_parser *parser, struct fast_token *token)
+{
+    int ret;
+    size_t infnan;
+    size_t identifier;
+    size_t number;
+    const char *p;
+    const char *end;
+
+    end = parser->end;
+    memset(token, 0, sizeof(*token));
+
+    while (parser->cursor < end) {
+        p = parser->cursor;
+
+        if (parser->line_start) {
+            while (p < end && *p == ' ') {
+                p++;
+            }
+            if (p == end && !parser->final) {
+                return FAST_NEED_MORE;
+            }
+            if (p < end && *p == '#') {
+                ret = fast_header(parser, p + 1, token);
+                if (ret) {
+                    return ret;
+                }
+                parser->line_start = 0;
+                if (token->type) {
+                    return 0;
+                }
+                continue;
+            }
+            parser->line_start = 0;
+        }
+
+        switch (*p) {
+            case '\n':
+                parser->cursor = p + 1;
+                parser->line_start = 1;
+                continue;
+            case '\r':
+                if (p + 1 == end && !parser->final) {
+                    return FAST_NEED_MORE;
+                }
+                if (p + 1 < end && p[1] == '\n') {
+                    parser->cursor = p + 2;
+                    parser->line_start = 1;
+                    continue;
+                }
+                break;
+            case ' ':
+            case '\t':
+                parser->cursor = fast_skip_class(p, end, FAST_CLASS_BLANK);
+                continue;
+            case '"':
+                /* stop at the closing quote, escapes are resolved later */
+                token->type = QUOTED;
+                token->start = p + 1;
+                p = token->start;
+                while (1) {
+                    p = fast_find_class(p, end, FAST_CLASS_QUOTED_STOP);
+                    if (p + 1 < end && *p == '\\' &&
+                        (p[1] == '"' || p[1] == 'n' || p[1] == '\\')) {
+                        token->escaped = 1;
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                if (!parser->final &&
+                    (p == end || (*p == '\\' && p + 1 == end))) {
+                    return FAST_NEED_MORE;
+                }
+                if (p >= end || *p != '"') {
+                    token->type = '"';
+                    token->start--;
+                    token->length = 1;
+                    return FAST_TOKEN_INVALID;
+                }
+                token->length = p - token->start;
+                parser->cursor = p + 1;
+                return 0;
+            case '{':
+            case '}':
+            case '=':
+            case ',':
+                token->type = *p;
+                token->start = p;
+                token->length = 1;
+                parser->cursor = p + 1;
+                return 0;
+        }
+
+        infnan = fast_infnan_length(p, end);
+        identifier = 0;
+        if (fast_class(p, FAST_CLASS_IDENTIFIER_START)) {
+            identifier = fast_skip_class(p + 1, end, FAST_CLASS_IDENTIFIER) - p;
+        }
+        number = fast_skip_class(p, end, FAST_CLASS_NUMBER) - p;
+
+        token->start = p;
+        if (infnan && infnan >= identifier && infnan >= number) {
+            token->type = INFNAN;
+            token->length = infnan;
+        }
+        else if (identifier && identifier >= number) {
+            token->type = IDENTIFIER;
+            token->length = identifier;
+        }
+        else if (number) {
+            token->type = NUMSTR;
+            token->length = number;
+        }
+        else {
+            token->type = (unsigned char) *p;
+            token->length = 1;
+            return FAST_TOKEN_INVALID;
+        }
+
+        /* a sign alone can still become INF or NAN */
+        if (!parser->final &&
+            (p + token->length == end ||
+             ((*p == '+' || *p == '-') && end - p < 4))) {
+            return FAST_NEED_MORE;
+        }
+
+        parser->cursor = p + token->length;
+        return 0;
+    }
+
+    if (!parser->final) {
+        return FAST_NEED_MORE;
+    }
+
+    token->type = 0;
+    return 0;
+}
+
+/* like fast_next_token() but syntax errors are reported */
+static int fast_expect(struct fast_parser *parser, struct fast_token *token)
+{
+    int ret;
+
+    ret = fast_next_token(parser, token);
+    if (ret == FAST_TOKEN_INVALID) {
+        return fast_syntax_error(parser->context, token);
+    }
+    return ret;
+}
+
+/* copy a quoted string or a docstring resolving its escape sequences */
+/*
+ * Resolve the escapes of 'length' bytes at 'p' into 'out', which must hold
+ * as many bytes, and return the resulting length. '\"' is only an escape
+ * in quoted strings, unknown escapes are kept as they are.
+ */
+static size_t fast_unescape_to(char *out, const char *p, size_t length,
+                               int quoted)
+{
+    char *o;
+    const char *end;
+
+    o = out;
+    end = p + length;
+    while (p < end) {
+        if (*p != '\\' || p + 1 == end) {
+            *o++ = *p++;
+        }
+        else if (p[1] == 'n') {
+            *o++ = '\n';
+            p += 2;
+        }
+        else if (p[1] == '\\' || (quoted && p[1] == '"')) {
+            *o++ = p[1];
+            p += 2;
+        }
+        else {
+            *o++ = *p++;
+        }
+    }
+
+    return o - out;
+}
+
+static cfl_sds_t fast_unescape(const char *p, size_t length, int quoted)
+{
+    cfl_sds_t out;
+
+    out = cfl_sds_create_size(length + 1);
+    if (!out) {
+        return NULL;
+    }
+
+    length = fast_unescape_to(out, p, length, quoted);
+    out[length] = 0;
+    cfl_sds_set_len(out, length);
+
+    return out;
+}
+
+static cfl_sds_t fast_string(struct cmt_decode_prometheus_context *context,
+                             const char *start, size_t length)
+{
+    cfl_sds_t str;
+
+    str = cfl_sds_create_len(start, length);
+    if (!str) {
+        report_error(context,
+                CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                "memory allocation failed");
+    }
+
+    return str;
+}
+
+/* same as parse_metric_name(), without copying a repeated name */
+static int fast_metric_name(struct cmt_decode_prometheus_context *context,
+                            struct fast_token *token)
+{
+    cfl_sds_t name;
+
+    if (context->metric.name_orig &&
+        context->metric.type != HISTOGRAM &&
+        context->metric.type != SUMMARY &&
+        cfl_sds_len(context->metric.name_orig) == token->length &&
+        !memcmp(context->metric.name_orig, token->start, token->length)) {
+        return 0;
+    }
+
+    name = fast_string(context, token->start, token->length);
+    if (!name) {
+        return context->errcode;
+    }
+
+    return parse_metric_name(context, name);
+}
+
+/* same as parse_label(), without copying a label name that is known */
+/* same as parse_label(), the value goes straight to the sample arena */
+static int fast_label(struct cmt_decode_prometheus_context *context,
+                      struct fast_label *label)
+{
+    int i;
+    size_t length;
+    char *value;
+    cfl_sds_t name;
+
+    if (context->metric.label_count >= CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT) {
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT_EXCEEDED,
+                "maximum number of labels exceeded");
+    }
+
+    value = cfl_arena_alloc(context->metric.arena, label->value_length + 1);
+    if (!value) {
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                "memory allocation failed");
+    }
+    if (label->escaped) {
+        length = fast_unescape_to(value, label->value, label->value_length,
+                                  CMT_TRUE);
+    }
+    else {
+        length = label->value_length;
+        memcpy(value, label->value, length);
+    }
+    value[length] = 0;
+
+    for (i = 0; i < context->metric.label_count; i++) {
+        if (cfl_sds_len(context->metric.labels[i]) == label->name_length &&
+            !memcmp(context->metric.labels[i], label->name, label->name_length)) {
+            context->metric.label_values[i] = value;
+            return 0;
+        }
+    }
+
+    name = fast_string(context, label->name, label->name_length);
+    if (!name) {
+        return context->errcode;
+    }
+
+    return add_label(context, name, value);
+}
+
+static int fast_is_value(struct fast_token *token)
+{
+    return token->type == NUMSTR || token->type == INFNAN;
+}
+
+static void fast_value(struct fast_token *token, char *buf, size_t size)
+{
+    size_t length;
+
+    /* the flex scanner truncates values the same way */
+    length = token->length < size - 1 ? token->length : size - 1;
+    memcpy(buf, token->start, length);
+    buf[length] = 0;
+}
+
+/*
+ * Read a whole sample, then run its actions. A sample has at most one more
+ * label than the context accepts, which is enough to report the error.
+ */
+static int fast_sample(struct fast_parser *parser, struct fast_token *name)
+{
+    int i;
+    int ret;
+    size_t label_count;
+    char value1[64];
+    char value2[64];
+    struct fast_token token;
+    struct fast_token value;
+    struct fast_token label;
+    struct fast_parser lookahead;
+    struct fast_label labels[CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT + 1];
+    struct cmt_decode_prometheus_context *context;
+
+    context = parser->context;
+    label_count = 0;
+
+    ret = fast_expect(parser, &token);
+    if (ret) {
+        return ret;
+    }
+
+    if (token.type == '{') {
+        ret = fast_expect(parser, &token);
+        if (ret) {
+            return ret;
+        }
+        while (token.type != '}') {
+            label = token;
+            if (label.type != IDENTIFIER) {
+                return fast_syntax_error(context, &label);
+            }
+            ret = fast_expect(parser, &token);
+            if (ret) {
+                return ret;
+            }
+            if (token.type != '=') {
+                return fast_syntax_error(context, &token);
+            }
+            ret = fast_expect(parser, &token);
+            if (ret) {
+                return ret;
+            }
+            if (token.type != QUOTED) {
+                return fast_syntax_error(context, &token);
+            }
+
+            if (label_count == sizeof(labels) / sizeof(labels[0])) {
+                return report_error(context,
+                        CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT_EXCEEDED,
+                        "maximum number of labels exceeded");
+            }
+            labels[label_count].name = label.start;
+            labels[label_count].name_length = label.length;
+            labels[label_count].value = token.start;
+            labels[label_count].value_length = token.length;
+            labels[label_count].escaped = token.escaped;
+            label_count++;
+
+            ret = fast_expect(parser, &token);
+            if (ret) {
+                return ret;
+            }
+            if (token.type == ',') {
+                ret = fast_expect(parser, &token);
+                if (ret) {
+                    return ret;
+                }
+            }
+            else if (token.type != '}') {
+                return fast_syntax_error(context, &token);
+            }
+        }
+
+        ret = fast_expect(parser, &token);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    if (!fast_is_value(&token)) {
+        return fast_syntax_error(context, &token);
+    }
+    value = token;
+
+    /* the timestamp is optional, anything else belongs to the next statement */
+    lookahead = *parser;
+    ret = fast_next_token(parser, &token);
+    if (ret == FAST_NEED_MORE) {
+        return ret;
+    }
+    if (ret || !fast_is_value(&token)) {
+        *parser = lookahead;
+        token.type = 0;
+    }
+
+    ret = fast_metric_name(context, name);
+    if (ret) {
+        return ret;
+    }
+    ret = sample_start(context);
+    if (ret) {
+        return ret;
+    }
+    for (i = 0; i < label_count; i++) {
+        ret = fast_label(context, &labels[i]);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    fast_value(&value, value1, sizeof(value1));
+    value2[0] = 0;
+    if (token.type) {
+        fast_value(&token, value2, sizeof(value2));
+    }
+
+    return parse_sample(context, value1, value2);
+}
+
+static int stream_emit(struct cmt_decode_prometheus_stream *stream);
+
+/*
+ * Parse statements until the input is over. Returns FAST_NEED_MORE when it
+ * is not final, the cursor is then left at the start of the statement the
+ * input ends in.
+ */
+static int fast_statements(struct fast_parser *parser)
+{
+    int ret;
+    cfl_sds_t docstring;
+    struct fast_token token;
+    struct fast_parser statement;
+    struct cmt_decode_prometheus_context *context;
+
+    context = parser->context;
+
+    while (1) {
+        ret = fast_expect(parser, &token);
+        if (ret) {
+            return ret;
+        }
+
+        if (token.type == 0) {
+            return 0;
+        }
+        else if (token.type == HELP) {
+            docstring = fast_unescape(token.text, token.text_length, CMT_FALSE);
+            if (!docstring) {
+                return report_error(context,
+                        CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                        "memory allocation failed");
+            }
+            ret = fast_metric_name(context, &token);
+            if (ret) {
+                cfl_sds_destroy(docstring);
+                return ret;
+            }
+            cfl_sds_destroy(context->metric.docstring);
+            context->metric.docstring = docstring;
+        }
+        else if (token.type == TYPE) {
+            ret = fast_metric_name(context, &token);
+            if (ret) {
+                return ret;
+            }
+            context->metric.type = token.metric_type;
+        }
+        else if (token.type == IDENTIFIER) {
+            statement = *parser;
+            statement.cursor = token.start;
+            ret = fast_sample(parser, &token);
+            if (ret == FAST_NEED_MORE) {
+                *parser = statement;
+                return ret;
+            }
+            if (ret) {
+                return ret;
+            }
+        }
+        else {
+            return fast_syntax_error(context, &token);
+        }
+
+        parser->statements++;
+
+        if (parser->stream) {
+            ret = stream_emit(parser->stream);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+}
+
+static int fast_parse(struct cmt_decode_prometheus_context *context,
+                      const char *in_buf, size_t in_size)
+{
+    int ret;
+    struct fast_token token;
+    struct fast_parser parser;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.context = context;
+    parser.cursor = in_buf;
+    parser.end = in_buf + in_size;
+    parser.line_start = 1;
+    parser.final = 1;
+
+    ret = fast_statements(&parser);
+    if (ret) {
+        return ret;
+    }
+
+    if (!parser.statements) {
+        token.type = 0;
+        return fast_syntax_error(context, &token);
+    }
+
+    return finish_metric(context, true, NULL);
+}
+
+static int stream_emit(struct cmt_decode_prometheus_stream *stream)
+{
+    struct cmt *cmt;
+    struct cmt *next;
+    struct cmt_decode_prometheus_context *context;
+
+    context = &stream->context;
+
+    /* histogram and summary families grow until another metric starts */
+    if (!stream->callback || context->current.summary) {
+        return 0;
+    }
+
+    cmt = context->cmt;
+    if (cfl_list_is_empty(&cmt->counters) &&
+        cfl_list_is_empty(&cmt->gauges) &&
+        cfl_list_is_empty(&cmt->untypeds) &&
+        cfl_list_is_empty(&cmt->histograms) &&
+        cfl_list_is_empty(&cmt->summaries)) {
+        return 0;
+    }
+
+    next = cmt_create();
+    if (!next) {
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                "memory allocation failed");
+    }
+    context->cmt = next;
+
+    if (stream->callback(stream->callback_data, cmt)) {
+        return report_error(context,
+                CMT_DECODE_PROMETHEUS_CALLBACK_ERROR,
+                "stream callback failed");
+    }
+
+    return 0;
+}
+
+static int stream_reserve(struct cmt_decode_prometheus_stream *stream,
+                          size_t size)
+{
+    char *buffer;
+
+    if (size <= stream->buffer_size) {
+        return 0;
+    }
+
+    if (size < stream->buffer_size * 2) {
+        size = stream->buffer_size * 2;
+    }
+
+    buffer = realloc(stream->buffer, size);
+    if (!buffer) {
+        cmt_errno();
+        return report_error(&stream->context,
+                CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR,
+                "memory allocation failed");
+    }
+    stream->buffer = buffer;
+    stream->buffer_size = size;
+
+    return 0;
+}
+
+/* parse 'data' and keep the statement it ends in for the next chunk */
+static int stream_parse(struct cmt_decode_prometheus_stream *stream,
+                        const char *data, size_t length, int final)
+{
+    int ret;
+    size_t remaining;
+    struct fast_parser parser;
+
+    memset(&parser, 0, sizeof(parser));
+    parser.context = &stream->context;
+    parser.stream = stream;
+    parser.cursor = data;
+    parser.end = data + length;
+    parser.line_start = stream->line_start;
+    parser.final = final;
+    parser.statements = stream->statements;
+
+    ret = fast_statements(&parser);
+    stream->statements = parser.statements;
+    stream->line_start = parser.line_start;
+    if (ret != FAST_NEED_MORE) {
+        stream->buffer_length = 0;
+        return ret;
+    }
+
+    remaining = parser.end - parser.cursor;
+    ret = stream_reserve(stream, remaining);
+    if (ret) {
+        return ret;
+    }
+    if (remaining > 0) {
+        memmove(stream->buffer, parser.cursor, remaining);
+    }
+    stream->buffer_length = remaining;
+
+    return 0;
+}
+
+int cmt_decode_prometheus_stream_create(
+        struct cmt_decode_prometheus_stream **out_stream,
+        struct cmt_decode_prometheus_parse_opts *opts,
+        void *callback_data,
+        int (*callback)(void *callback_data, struct cmt *cmt))
+{
+    struct cmt_decode_prometheus_stream *stream;
+
+    stream = calloc(1, sizeof(struct cmt_decode_prometheus_stream));
+    if (!stream) {
+        cmt_errno();
+        return CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR;
+    }
+
+    stream->context.cmt = cmt_create();
+    if (!stream->context.cmt) {
+        free(stream);
+        return CMT_DECODE_PROMETHEUS_ALLOCATION_ERROR;
+    }
+
+    if (opts) {
+        stream->context.opts = *opts;
+    }
+    cfl_list_init(&stream->context.metric.samples);
+    stream->line_start = 1;
+    stream->callback_data = callback_data;
+    stream->callback = callback;
+
+    *out_stream = stream;
+
+    return CMT_DECODE_PROMETHEUS_SUCCESS;
+}
+
+int cmt_decode_prometheus_stream_feed(struct cmt_decode_prometheus_stream *stream,
+                                      const char *chunk, size_t size)
+{
+    int ret;
+
+    if (stream->status) {
+        return stream->status;
+    }
+
+    if (!stream->buffer_length) {
+        ret = stream_parse(stream, chunk, size, CMT_FALSE);
+    }
+    else {
+        ret = stream_reserve(stream, stream->buffer_length + size);
+        if (!ret) {
+            memcpy(stream->buffer + stream->buffer_length, chunk, size);
+            stream->buffer_length += size;
+            ret = stream_parse(stream, stream->buffer, stream->buffer_length,
+                               CMT_FALSE);
+        }
+    }
+
+    /* some actions record an error without returning it, as in create */
+    if (!ret && stream->context.errcode) {
+        ret = stream->context.errcode;
+    }
+
+    if (ret) {
+        stream->status = ret;
+    }
+
+    return ret;
+}
+
+int cmt_decode_prometheus_stream_finish(struct cmt_decode_prometheus_stream *stream,
+                                        struct cmt **out_cmt)
+{
+    int ret;
+    struct fast_token token;
+
+    if (stream->status) {
+        return stream->status;
+    }
+
+    ret = stream_parse(stream, stream->buffer, stream->buffer_length, CMT_TRUE);
+    if (!ret && !stream->statements) {
+        token.type = 0;
+        ret = fast_syntax_error(&stream->context, &token);
+    }
+    if (!ret) {
+        ret = finish_metric(&stream->context, true, NULL);
+    }
+    if (!ret) {
+        ret = stream_emit(stream);
+    }
+    if (!ret && stream->context.errcode) {
+        ret = stream->context.errcode;
+    }
+
+    if (ret) {
+        stream->status = ret;
+        return ret;
+    }
+
+    if (out_cmt) {
+        *out_cmt = stream->context.cmt;
+        stream->context.cmt = NULL;
+    }
+
+    /* nothing can be fed to a finished stream */
+    stream->status = CMT_DECODE_PROMETHEUS_SYNTAX_ERROR;
+
+    return CMT_DECODE_PROMETHEUS_SUCCESS;
+}
+
+void cmt_decode_prometheus_stream_destroy(struct cmt_decode_prometheus_stream *stream)
+{
+    reset_context(&stream->context, true);
+    if (stream->context.cmt) {
+        cmt_destroy(stream->context.cmt);
+    }
+    free(stream->buffer);
+    free(stream);
+}
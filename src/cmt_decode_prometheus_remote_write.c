@@ -21,841 +21,1010 @@
 #include <cmetrics/cmt_map.h>
 #include <cmetrics/cmt_counter.h>
 #include <cmetrics/cmt_summary.h>
-#include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_snappy.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_decode_prometheus_remote_write.h>
 
 #include <stdint.h>
 #include <limits.h>
 
-static void *__cmt_allocator_alloc(void *data, size_t size) {
-    return malloc(size);
-}
-static void __cmt_allocator_free(void *data, void *ptr) {
-    free(ptr);
-}
-
-static ProtobufCAllocator __cmt_allocator = {
-  .alloc = __cmt_allocator_alloc,
-  .free = __cmt_allocator_free,
-  .allocator_data = NULL
+/*
+ * The unpacked request is only read while the context is built, so every
+ * message, string and repeated field array of a request is carved out of a
+ * bump arena and released at once instead of going through malloc() and
+ * free() one by one. Unpacked messages take several times the size of their
+ * encoding, the first chunk is sized after the payload so most requests need
+ * a single allocation.
+ */
+#define RW_ARENA_ALIGNMENT       16
+#define RW_ARENA_MINIMUM_SIZE    4096
+#define RW_ARENA_PAYLOAD_FACTOR  8
+
+struct rw_arena_chunk {
+    struct rw_arena_chunk *next;
+    size_t                 size;
+    size_t                 used;
+    size_t                 padding;
+    char                   data[];
 };
 
-#define cmt_system_allocator __cmt_allocator
+struct rw_arena {
+    struct rw_arena_chunk *chunks;
+    size_t                 chunk_size;
+};
 
-static char *cmt_metric_name_from_labels(Prometheus__TimeSeries *ts)
+static int arena_grow(struct rw_arena *arena, size_t size)
 {
-    int i;
-    int count;
+    struct rw_arena_chunk *chunk;
+    size_t                 chunk_size;
 
-    if (ts == NULL || ts->labels == NULL) {
-        return NULL;
+    chunk_size = arena->chunk_size;
+    if (chunk_size < size) {
+        chunk_size = size;
     }
 
-    count = ts->n_labels;
-    for (i = 0; i < count; i++) {
-        if (ts->labels[i] == NULL ||
-            ts->labels[i]->name == NULL ||
-            ts->labels[i]->name[0] == '\0') {
-            continue;
-        }
-
-        if (strncmp("__name__", ts->labels[i]->name, 8) == 0) {
-            if (ts->labels[i]->value == NULL) {
-                return NULL;
-            }
+    chunk = malloc(sizeof(struct rw_arena_chunk) + chunk_size);
+    if (chunk == NULL) {
+        cmt_errno();
 
-            return strdup(ts->labels[i]->value);
-        }
+        return -1;
     }
 
-    return NULL;
+    chunk->next = arena->chunks;
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    arena->chunks = chunk;
+
+    /* later chunks double so a bad estimate costs a few allocations at most */
+    arena->chunk_size *= 2;
+
+    return 0;
 }
 
-static struct cmt_map_label *create_map_label(char *caption, size_t length)
+static void *arena_alloc(void *data, size_t size)
 {
-    struct cmt_map_label *map_label;
+    void                  *memory;
+    struct rw_arena       *arena;
+    struct rw_arena_chunk *chunk;
 
-    if (caption == NULL) {
-        return NULL;
-    }
+    arena = data;
 
-    map_label = calloc(1, sizeof(struct cmt_map_label));
-    if (!map_label) {
-        return NULL;
+    size = (size + (RW_ARENA_ALIGNMENT - 1)) & ~((size_t) RW_ARENA_ALIGNMENT - 1);
+    if (size == 0) {
+        size = RW_ARENA_ALIGNMENT;
     }
 
-    if (map_label != NULL) {
-        if (length == 0) {
-            length = strlen(caption);
+    chunk = arena->chunks;
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        if (arena_grow(arena, size) != 0) {
+            return NULL;
         }
 
-        map_label->name = cfl_sds_create_len(caption, length);
+        chunk = arena->chunks;
+    }
 
-        if (map_label->name == NULL) {
-            cmt_errno();
+    memory = &chunk->data[chunk->used];
+    chunk->used += size;
 
-            free(map_label);
+    return memory;
+}
 
-            map_label = NULL;
-        }
+static void arena_free(void *data, void *ptr)
+{
+    /* released with the whole arena */
+    (void) data;
+    (void) ptr;
+}
+
+static void arena_init(struct rw_arena *arena, ProtobufCAllocator *allocator,
+                       size_t payload_size)
+{
+    arena->chunks = NULL;
+    arena->chunk_size = RW_ARENA_MINIMUM_SIZE;
+
+    if (payload_size < SIZE_MAX / RW_ARENA_PAYLOAD_FACTOR &&
+        payload_size * RW_ARENA_PAYLOAD_FACTOR > arena->chunk_size) {
+        arena->chunk_size = payload_size * RW_ARENA_PAYLOAD_FACTOR;
     }
 
-    return map_label;
+    allocator->alloc = arena_alloc;
+    allocator->free = arena_free;
+    allocator->allocator_data = arena;
 }
 
-static int append_new_map_label_key(struct cmt_map *map, char *name)
+static void arena_destroy(struct rw_arena *arena)
 {
-    struct cmt_map_label *label;
-
-    label = create_map_label(name, 0);
+    struct rw_arena_chunk *chunk;
 
-    if (label == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    while (arena->chunks != NULL) {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        free(chunk);
     }
+}
 
-    cfl_list_add(&label->_head, &map->label_keys);
-    map->label_count++;
+#define RW_TABLE_INITIAL_SIZE    64
 
-    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
-}
+/*
+ * Series carrying native histograms become exponential histograms, they get
+ * a family type of their own as the metadata only knows about histograms.
+ */
+#define RW_FAMILY_NATIVE_HISTOGRAM    -1
+
+/* schemas of the exponential histograms and upper bound of the dense bucket
+ * range a native histogram expands into */
+#define RW_NATIVE_HISTOGRAM_MINIMUM_SCHEMA   -4
+#define RW_NATIVE_HISTOGRAM_MAXIMUM_SCHEMA    8
+#define RW_NATIVE_HISTOGRAM_MAXIMUM_BUCKETS  65536
+
+/*
+ * Series of a request are grouped into one family per type, metric name and
+ * set of label keys. Metadata and families are found through open addressing
+ * tables so a request costs one lookup per series whatever the number of
+ * metadata entries and families it carries.
+ */
+struct rw_family {
+    uint64_t            hash;
+    int                 type;
+    char               *name;
+    size_t              label_count;
+    Prometheus__Label **keys;
+    struct cmt_map     *map;
+};
 
-static int append_new_metric_label_value(struct cmt_metric *metric, char *name, size_t length)
-{
-    struct cmt_map_label *label;
+struct rw_context {
+    struct cmt                  *cmt;
 
-    label = create_map_label(name, length);
+    /* metadata by metric family name, the first entry of a name wins */
+    Prometheus__MetricMetadata **metadata;
+    size_t                       metadata_size;
 
-    if (label == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-    }
+    struct rw_family           **families;
+    size_t                       family_size;
+    size_t                       family_count;
 
-    cfl_list_add(&label->_head, &metric->labels);
+    /* labels and label values of the current series, sorted by name */
+    Prometheus__Label          **labels;
+    char                       **values;
+    size_t                       label_capacity;
 
-    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
-}
+    /* dense bucket counts of the current native histogram */
+    uint64_t                    *buckets;
+    size_t                       bucket_capacity;
+};
 
-static int decode_labels(struct cmt *cmt,
-                         struct cmt_map *map,
-                         struct cmt_metric *metric,
-                         size_t n_labels,
-                         Prometheus__Label **labels)
+static uint64_t string_hash(const char *string)
 {
-    void                 **value_index_list;
-    size_t                 alloc_count;
-    size_t                 prom_label_index;
-    size_t                 map_label_index;
-    size_t                 map_label_count;
-    struct cfl_list       *label_iterator;
-    struct cmt_map_label  *current_label;
-    size_t                 label_index;
-    int                    label_found;
-    Prometheus__Label     *label;
-    int                    result;
-
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    return cfl_hash_64bits(string, strlen(string));
+}
 
-    if (n_labels == 0) {
-        return result;
-    }
+static int metadata_index_create(struct rw_context *context,
+                                 Prometheus__WriteRequest *write)
+{
+    size_t                      size;
+    size_t                      slot;
+    size_t                      index;
+    Prometheus__MetricMetadata *metadata;
 
-    if (labels == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    if (write->n_metadata == 0) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
     }
 
-    map_label_count = cfl_list_size(&map->label_keys);
-    if (n_labels > SIZE_MAX - map_label_count) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    /* at most half full */
+    size = RW_TABLE_INITIAL_SIZE;
+    while (size < write->n_metadata * 2) {
+        size *= 2;
     }
 
-    alloc_count = map_label_count + n_labels;
-    value_index_list = calloc(alloc_count, sizeof(void *));
+    context->metadata = calloc(size, sizeof(Prometheus__MetricMetadata *));
+    if (context->metadata == NULL) {
+        cmt_errno();
 
-    if (value_index_list == NULL) {
         return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
-    for (prom_label_index = 0;
-         result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
-         prom_label_index < n_labels;
-         prom_label_index++) {
+    context->metadata_size = size;
 
-        label = labels[prom_label_index];
-        if (label == NULL || label->name == NULL || label->name[0] == '\0') {
-            result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-            break;
-        }
-
-        label_found = CMT_FALSE;
-        label_index = 0;
-
-        cfl_list_foreach(label_iterator, &map->label_keys) {
-            current_label = cfl_list_entry(label_iterator, struct cmt_map_label, _head);
+    for (index = 0 ; index < write->n_metadata ; index++) {
+        metadata = write->metadata[index];
 
-            if (current_label->name != NULL &&
-                strcmp(current_label->name, label->name) == 0) {
-                label_found = CMT_TRUE;
+        if (metadata == NULL || metadata->metric_family_name == NULL) {
+            continue;
+        }
 
-                break;
-            }
+        slot = string_hash(metadata->metric_family_name) & (size - 1);
 
-            label_index++;
+        while (context->metadata[slot] != NULL &&
+               strcmp(context->metadata[slot]->metric_family_name,
+                      metadata->metric_family_name) != 0) {
+            slot = (slot + 1) & (size - 1);
         }
 
-        if (label_found == CMT_FALSE) {
-            result = append_new_map_label_key(map, label->name);
+        if (context->metadata[slot] == NULL) {
+            context->metadata[slot] = metadata;
         }
+    }
 
-        if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
-            if (label_index >= alloc_count) {
-                result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-                break;
-            }
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-            value_index_list[label_index] = (void *) label;
-        }
-    }
+static Prometheus__MetricMetadata *metadata_lookup(struct rw_context *context,
+                                                   char *name)
+{
+    size_t slot;
 
-    map_label_count = cfl_list_size(&map->label_keys);
+    if (context->metadata == NULL) {
+        return NULL;
+    }
 
-    for (map_label_index = 0 ;
-         result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
-         map_label_index < map_label_count ;
-         map_label_index++) {
+    slot = string_hash(name) & (context->metadata_size - 1);
 
-        if (map_label_index >= alloc_count) {
-            result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-            break;
+    while (context->metadata[slot] != NULL) {
+        if (strcmp(context->metadata[slot]->metric_family_name, name) == 0) {
+            return context->metadata[slot];
         }
 
-        if (value_index_list[map_label_index] != NULL) {
-            label = (Prometheus__Label *) value_index_list[map_label_index];
-            result = append_new_metric_label_value(metric,
-                                                   label->value != NULL ? label->value : "",
-                                                   0);
-        }
-        else {
-            result = append_new_metric_label_value(metric, "", 0);
-        }
+        slot = (slot + 1) & (context->metadata_size - 1);
     }
 
-    free(value_index_list);
-
-    return result;
+    return NULL;
 }
 
-static int decode_numerical_samples(struct cmt *cmt,
-                                    struct cmt_map *map,
-                                    size_t n_samples,
-                                    Prometheus__Sample *sample,
-                                    size_t n_labels,
-                                    Prometheus__Label **labels)
+/*
+ * Collect the labels of a series sorted by name, senders are required to
+ * sort them already so this is a single pass in the common case. A repeated
+ * label name keeps its last value.
+ */
+static int series_labels_collect(struct rw_context *context,
+                                 Prometheus__TimeSeries *ts,
+                                 size_t *out_count, char **out_name)
 {
-    int                static_metric_detected;
-    struct cmt_metric *metric;
-    int                result;
+    size_t              index;
+    size_t              position;
+    size_t              count;
+    size_t              capacity;
+    void               *buffer;
+    Prometheus__Label  *label;
 
-    static_metric_detected = CMT_FALSE;
+    if (ts->n_labels > 0 && ts->labels == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
 
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    if (ts->n_labels > context->label_capacity) {
+        capacity = ts->n_labels * 2;
 
-    if (n_samples == 0) {
-        if (map->metric_static_set == CMT_FALSE) {
-            static_metric_detected = CMT_TRUE;
+        buffer = realloc(context->labels, capacity * sizeof(Prometheus__Label *));
+        if (buffer == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
         }
-    }
+        context->labels = buffer;
 
-    if (static_metric_detected == CMT_FALSE) {
-        metric = calloc(1, sizeof(struct cmt_metric));
+        buffer = realloc(context->values, capacity * sizeof(char *));
+        if (buffer == NULL) {
+            cmt_errno();
 
-        if (metric == NULL) {
             return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
         }
+        context->values = buffer;
 
-        cfl_list_init(&metric->labels);
+        context->label_capacity = capacity;
+    }
 
-        result = decode_labels(cmt,
-                               map,
-                               metric,
-                               n_labels,
-                               labels);
+    count = 0;
+    *out_name = NULL;
 
-        if (result) {
-            destroy_label_list(&metric->labels);
+    for (index = 0 ; index < ts->n_labels ; index++) {
+        label = ts->labels[index];
 
-            free(metric);
+        if (label == NULL || label->name == NULL || label->name[0] == '\0') {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
         }
-        else {
-            cfl_list_add(&metric->_head, &map->metrics);
+
+        if (strcmp(label->name, "__name__") == 0) {
+            *out_name = label->value;
+        }
+
+        position = count;
+        while (position > 0 &&
+               strcmp(context->labels[position - 1]->name, label->name) > 0) {
+            position--;
+        }
+
+        if (position > 0 &&
+            strcmp(context->labels[position - 1]->name, label->name) == 0) {
+            context->labels[position - 1] = label;
+            continue;
         }
-    }
-    else {
-        metric = &map->metric;
 
-        map->metric_static_set = CMT_TRUE;
+        memmove(&context->labels[position + 1], &context->labels[position],
+                (count - position) * sizeof(Prometheus__Label *));
+        context->labels[position] = label;
+        count++;
     }
 
-    if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
-        cmt_metric_set(metric, sample->timestamp * 1000000, sample->value);
+    for (index = 0 ; index < count ; index++) {
+        context->values[index] = context->labels[index]->value != NULL ?
+                                 context->labels[index]->value : "";
     }
 
-    return result;
+    *out_count = count;
+
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
 }
 
-static int decode_numerical_time_series(struct cmt *cmt,
-                                        struct cmt_map *map,
-                                        size_t ts_count,
-                                        Prometheus__TimeSeries *ts)
+static uint64_t family_hash(int type, char *name,
+                            Prometheus__Label **labels, size_t count)
 {
-    size_t              index;
-    int                 result;
-    Prometheus__Sample *sample = NULL;
+    size_t           index;
+    cfl_hash_state_t state;
 
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, &type, sizeof(type));
+    cfl_hash_64bits_update(&state, name, strlen(name) + 1);
 
-    for (index = 0; index < ts->n_samples; index++) {
-        sample = ts->samples[index];
-        result = decode_numerical_samples(cmt, map,
-                                          ts->n_samples, sample,
-                                          ts->n_labels, ts->labels);
+    for (index = 0 ; index < count ; index++) {
+        cfl_hash_64bits_update(&state, labels[index]->name,
+                               strlen(labels[index]->name) + 1);
     }
 
-    return result;
+    return cfl_hash_64bits_digest(&state);
 }
 
-static int decode_counter_entry(struct cmt *cmt,
-                                void *instance,
-                                Prometheus__TimeSeries *ts)
+static int family_matches(struct rw_family *family, uint64_t hash, int type,
+                          char *name, Prometheus__Label **labels, size_t count)
 {
-    struct cmt_counter *counter;
-    int                 result;
-
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
-
-    counter = (struct cmt_counter *) instance;
+    size_t index;
 
-    counter->map->metric_static_set = 0;
+    if (family->hash != hash || family->type != type ||
+        family->label_count != count || strcmp(family->name, name) != 0) {
+        return CMT_FALSE;
+    }
 
-    result = decode_numerical_time_series(cmt,
-                                          counter->map,
-                                          ts->n_samples,
-                                          ts);
+    for (index = 0 ; index < count ; index++) {
+        if (strcmp(family->keys[index]->name, labels[index]->name) != 0) {
+            return CMT_FALSE;
+        }
+    }
 
-    return result;
+    return CMT_TRUE;
 }
 
-static int decode_gauge_entry(struct cmt *cmt,
-                              void *instance,
-                              Prometheus__TimeSeries *ts)
+static int family_table_grow(struct rw_context *context)
 {
-    struct cmt_gauge *gauge;
-    int               result;
-
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    size_t             size;
+    size_t             slot;
+    size_t             index;
+    struct rw_family **families;
 
-    gauge = (struct cmt_gauge *) instance;
+    size = context->family_size == 0 ? RW_TABLE_INITIAL_SIZE :
+                                       context->family_size * 2;
 
-    gauge->map->metric_static_set = 0;
+    families = calloc(size, sizeof(struct rw_family *));
+    if (families == NULL) {
+        cmt_errno();
 
-    result = decode_numerical_time_series(cmt,
-                                          gauge->map,
-                                          ts->n_samples,
-                                          ts);
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
 
-    return result;
-}
+    for (index = 0 ; index < context->family_size ; index++) {
+        if (context->families[index] == NULL) {
+            continue;
+        }
 
-static int decode_untyped_entry(struct cmt *cmt,
-                                void *instance,
-                                Prometheus__TimeSeries *ts)
-{
-    struct cmt_untyped *untyped;
-    int                 result;
+        slot = context->families[index]->hash & (size - 1);
+        while (families[slot] != NULL) {
+            slot = (slot + 1) & (size - 1);
+        }
 
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+        families[slot] = context->families[index];
+    }
 
-    untyped = (struct cmt_untyped *) instance;
+    free(context->families);
 
-    untyped->map->metric_static_set = 0;
+    context->families = families;
+    context->family_size = size;
 
-    result = decode_numerical_time_series(cmt,
-                                          untyped->map,
-                                          ts->n_samples,
-                                          ts);
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-    return result;
+static struct cmt_map *family_instance_create(struct rw_context *context,
+                                              int type, char *name,
+                                              char *description,
+                                              size_t label_count,
+                                              char **keys)
+{
+    struct cmt_counter       *counter;
+    struct cmt_gauge         *gauge;
+    struct cmt_untyped       *untyped;
+    struct cmt_exp_histogram *exp_histogram;
+
+    switch (type) {
+    case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__COUNTER:
+        counter = cmt_counter_create(context->cmt, "", "", name, description,
+                                     label_count, keys);
+
+        return counter != NULL ? counter->map : NULL;
+    case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__GAUGE:
+        gauge = cmt_gauge_create(context->cmt, "", "", name, description,
+                                 label_count, keys);
+
+        return gauge != NULL ? gauge->map : NULL;
+    case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__UNKNOWN:
+        untyped = cmt_untyped_create(context->cmt, "", "", name, description,
+                                     label_count, keys);
+
+        return untyped != NULL ? untyped->map : NULL;
+    default:
+        exp_histogram = cmt_exp_histogram_create(context->cmt, "", "", name,
+                                                 description, label_count,
+                                                 keys);
+
+        return exp_histogram != NULL ? exp_histogram->map : NULL;
+    }
 }
 
-static int decode_histogram_points(struct cmt *cmt,
-                                   struct cmt_map *map,
-                                   size_t n_histograms,
-                                   Prometheus__Histogram *hist,
-                                   size_t n_labels,
-                                   Prometheus__Label **labels)
+static struct cmt_map *family_lookup(struct rw_context *context, int type,
+                                     char *name, char *description,
+                                     size_t count)
 {
-    int                   i;
-    int                   bucket_index;
-    size_t                count_index;
-    size_t                count_size;
-    size_t                span_index;
-    int                   static_metric_detected;
-    struct cmt_histogram *histogram;
-    struct cmt_metric    *metric;
-    int                   result;
-    double               *spans;
-
-    static_metric_detected = CMT_FALSE;
+    size_t            slot;
+    size_t            index;
+    uint64_t          hash;
+    char            **keys;
+    struct rw_family *family;
 
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    hash = family_hash(type, name, context->labels, count);
 
-    histogram = (struct cmt_histogram *) map->parent;
+    if (context->family_size > 0) {
+        slot = hash & (context->family_size - 1);
 
-    if (hist == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-    }
+        while (context->families[slot] != NULL) {
+            if (family_matches(context->families[slot], hash, type, name,
+                               context->labels, count)) {
+                return context->families[slot]->map;
+            }
 
-    if (hist->n_negative_spans > 0 && hist->negative_spans == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+            slot = (slot + 1) & (context->family_size - 1);
+        }
     }
 
-    if (hist->n_positive_spans > 0 && hist->positive_spans == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    if ((context->family_count + 1) * 4 > context->family_size * 3) {
+        if (family_table_grow(context) != 0) {
+            return NULL;
+        }
     }
 
-    if (hist->n_negative_counts > 0 && hist->negative_counts == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    family = calloc(1, sizeof(struct rw_family));
+    if (family == NULL) {
+        cmt_errno();
+
+        return NULL;
     }
 
-    if (hist->n_positive_counts > 0 && hist->positive_counts == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    /* the label pointers stay valid as long as the unpacked request */
+    family->keys = calloc(count + 1, sizeof(Prometheus__Label *));
+    keys = calloc(count + 1, sizeof(char *));
+
+    if (family->keys == NULL || keys == NULL) {
+        cmt_errno();
+        free(family->keys);
+        free(family);
+        free(keys);
+
+        return NULL;
     }
 
-    if (hist->n_negative_counts > INT_MAX ||
-        hist->n_positive_counts > INT_MAX) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    for (index = 0 ; index < count ; index++) {
+        family->keys[index] = context->labels[index];
+        keys[index] = context->labels[index]->name;
     }
 
-    if (histogram->buckets == NULL) {
-        if (hist->n_negative_spans > 0) {
-            count_size = hist->n_negative_counts;
-            spans = calloc(count_size, sizeof(double));
-            if (spans == NULL) {
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+    family->hash = hash;
+    family->type = type;
+    family->name = name;
+    family->label_count = count;
+    family->map = family_instance_create(context, type, name, description,
+                                         count, keys);
+    free(keys);
 
-            bucket_index = 0;
-            count_index = 0;
-            for (span_index = 0; span_index < hist->n_negative_spans; span_index++) {
-                if (hist->negative_spans[span_index] == NULL) {
-                    free(spans);
-                    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-                }
+    if (family->map == NULL) {
+        free(family->keys);
+        free(family);
 
-                bucket_index += hist->negative_spans[span_index]->offset;
+        return NULL;
+    }
 
-                for (i = 0; i < hist->negative_spans[span_index]->length; i++) {
-                    if (count_index >= count_size) {
-                        break;
-                    }
+    slot = hash & (context->family_size - 1);
+    while (context->families[slot] != NULL) {
+        slot = (slot + 1) & (context->family_size - 1);
+    }
 
-                    spans[count_index++] = (double) bucket_index++;
-                }
-            }
+    context->families[slot] = family;
+    context->family_count++;
 
-            histogram->buckets = cmt_histogram_buckets_create_size(spans,
-                                                                   count_index);
-            free(spans);
-        }
-        else if (hist->n_positive_spans > 0) {
-            count_size = hist->n_positive_counts;
-            spans = calloc(count_size, sizeof(double));
-            if (spans == NULL) {
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+    return family->map;
+}
 
-            bucket_index = 0;
-            count_index = 0;
-            for (span_index = 0; span_index < hist->n_positive_spans; span_index++) {
-                if (hist->positive_spans[span_index] == NULL) {
-                    free(spans);
-                    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-                }
+static void context_destroy(struct rw_context *context)
+{
+    size_t index;
 
-                bucket_index += hist->positive_spans[span_index]->offset;
+    for (index = 0 ; index < context->family_size ; index++) {
+        if (context->families[index] != NULL) {
+            free(context->families[index]->keys);
+            free(context->families[index]);
+        }
+    }
 
-                for (i = 0; i < hist->positive_spans[span_index]->length; i++) {
-                    if (count_index >= count_size) {
-                        break;
-                    }
+    free(context->families);
+    free(context->metadata);
+    free(context->labels);
+    free(context->values);
+    free(context->buckets);
+}
 
-                    spans[count_index++] = (double) bucket_index++;
-                }
-            }
+static int decode_numerical_time_series(struct rw_context *context,
+                                        struct cmt_map *map,
+                                        size_t label_count,
+                                        Prometheus__TimeSeries *ts)
+{
+    size_t              index;
+    struct cmt_metric  *metric;
+    Prometheus__Sample *sample;
 
-            histogram->buckets = cmt_histogram_buckets_create_size(spans,
-                                                                   count_index);
-            free(spans);
-        }
+    if (ts->n_samples == 0) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
 
-        if (histogram->buckets == NULL) {
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-        }
+    if (ts->samples == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
     }
 
-    if (n_histograms == 0) {
-        if (map->metric_static_set == CMT_FALSE) {
-            static_metric_detected = CMT_TRUE;
-        }
+    metric = cmt_map_metric_get(map->opts, map, label_count, context->values,
+                                CMT_TRUE);
+    if (metric == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
-    if (static_metric_detected == CMT_FALSE) {
-        metric = calloc(1, sizeof(struct cmt_metric));
+    for (index = 0 ; index < ts->n_samples ; index++) {
+        sample = ts->samples[index];
 
-        if (metric == NULL) {
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+        if (sample == NULL) {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
         }
 
-        cfl_list_init(&metric->labels);
+        cmt_metric_set(metric, sample->timestamp * 1000000, sample->value);
+    }
 
-        result = decode_labels(cmt,
-                               map,
-                               metric,
-                               n_labels,
-                               labels);
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-        if (result) {
-            destroy_label_list(&metric->labels);
+/*
+ * Validate the spans of one side of a native histogram, 'length' is set to
+ * the size of the dense bucket range they cover and 'values' to the number
+ * of buckets they list. The first span offset is the index of the first
+ * bucket, the following ones are gaps and cannot be negative.
+ */
+static int native_histogram_side_length(size_t n_spans,
+                                        Prometheus__BucketSpan **spans,
+                                        size_t *length, size_t *values)
+{
+    size_t   index;
+    uint64_t total;
+    uint64_t listed;
+
+    if (n_spans > 0 && spans == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
 
-            free(metric);
+    total = 0;
+    listed = 0;
 
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+    for (index = 0 ; index < n_spans ; index++) {
+        if (spans[index] == NULL) {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+        }
+
+        if (index == 0) {
+            /* the previous bucket index is the exponential histogram offset */
+            if (spans[index]->offset == INT32_MIN) {
+                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+            }
         }
         else {
-            cfl_list_add(&metric->_head, &map->metrics);
+            if (spans[index]->offset < 0) {
+                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+            }
+
+            total += spans[index]->offset;
         }
-    }
-    else {
-        metric = &map->metric;
 
-        map->metric_static_set = CMT_TRUE;
+        total += spans[index]->length;
+        listed += spans[index]->length;
+
+        if (total > RW_NATIVE_HISTOGRAM_MAXIMUM_BUCKETS) {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+        }
     }
 
-    if (metric->hist_buckets == NULL) {
-        if (histogram->buckets->count >= INT_MAX) {
-            if (static_metric_detected == CMT_FALSE) {
-                destroy_label_list(&metric->labels);
+    *length = total;
+    *values = listed;
 
-                cfl_list_del(&metric->_head);
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-                free(metric);
-            }
+static int native_histogram_count(double value, uint64_t *count)
+{
+    /* also rejects NaN */
+    if (!(value >= 0.0 && value < 18446744073709551616.0)) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+    }
 
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-        }
+    *count = (uint64_t) (value + 0.5);
 
-        metric->hist_buckets = calloc(histogram->buckets->count + 1,
-                                      sizeof(uint64_t));
-        if (metric->hist_buckets == NULL) {
-            if (static_metric_detected == CMT_FALSE) {
-                if (metric->hist_buckets != NULL) {
-                    free(metric->hist_buckets);
-                }
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-                destroy_label_list(&metric->labels);
+/*
+ * Expand one side into dense bucket counts, integer histograms carry the
+ * difference to the previous bucket while float histograms carry absolute
+ * counts which are rounded.
+ */
+static int native_histogram_side_expand(size_t n_spans,
+                                        Prometheus__BucketSpan **spans,
+                                        size_t n_deltas, int64_t *deltas,
+                                        size_t n_counts, double *counts,
+                                        size_t values,
+                                        uint64_t *buckets,
+                                        int32_t *offset)
+{
+    int      result;
+    size_t   index;
+    size_t   position;
+    size_t   value_index;
+    uint32_t bucket;
+    int64_t  current;
 
-                cfl_list_del(&metric->_head);
+    *offset = 0;
 
-                free(metric);
-            }
+    if (values == 0) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
 
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    if (n_deltas > 0) {
+        if (deltas == NULL || n_deltas != values) {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
         }
     }
+    else if (counts == NULL || n_counts != values) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+    }
 
-    if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
-        if (hist->n_negative_spans > 0) {
-            for (i = 0; i < hist->n_negative_counts &&
-                        (size_t) i < histogram->buckets->count; i++) {
-                cmt_metric_hist_set(metric, hist->timestamp * 1000000,
-                                    i, hist->negative_counts[i]);
-            }
-        }
-        else if (hist->n_positive_spans > 0) {
-            for (i = 0; i < hist->n_positive_counts &&
-                        (size_t) i < histogram->buckets->count; i++) {
-                cmt_metric_hist_set(metric, hist->timestamp * 1000000,
-                                    i, hist->positive_counts[i]);
-            }
+    /* a native bucket covers (base^(i-1), base^i], one index above OTLP */
+    *offset = spans[0]->offset - 1;
+
+    position = 0;
+    value_index = 0;
+    current = 0;
+
+    for (index = 0 ; index < n_spans ; index++) {
+        if (index > 0) {
+            memset(&buckets[position], 0, spans[index]->offset * sizeof(uint64_t));
+            position += spans[index]->offset;
         }
-        else {
-            if (static_metric_detected == CMT_FALSE) {
-                if (metric->hist_buckets != NULL) {
-                    free(metric->hist_buckets);
-                }
 
-                destroy_label_list(&metric->labels);
+        for (bucket = 0 ; bucket < spans[index]->length ; bucket++) {
+            if (n_deltas > 0) {
+                current += deltas[value_index];
 
-                cfl_list_del(&metric->_head);
+                if (current < 0) {
+                    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+                }
 
-                free(metric);
+                buckets[position] = (uint64_t) current;
+            }
+            else {
+                result = native_histogram_count(counts[value_index],
+                                                &buckets[position]);
+                if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+                    return result;
+                }
             }
 
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+            position++;
+            value_index++;
         }
     }
 
-    cmt_metric_hist_sum_set(metric, hist->timestamp * 1000000, hist->sum);
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
+static int decode_native_histogram(struct rw_context *context,
+                                   struct cmt_map *map,
+                                   size_t label_count,
+                                   Prometheus__Histogram *hist)
+{
+    int       result;
+    int32_t   negative_offset;
+    int32_t   positive_offset;
+    size_t    negative_length;
+    size_t    positive_length;
+    size_t    negative_values;
+    size_t    positive_values;
+    size_t    size;
+    uint64_t  count;
+    uint64_t  zero_count;
+    uint64_t *buckets;
+
+    result = native_histogram_side_length(hist->n_negative_spans,
+                                          hist->negative_spans,
+                                          &negative_length, &negative_values);
+
+    if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        result = native_histogram_side_length(hist->n_positive_spans,
+                                              hist->positive_spans,
+                                              &positive_length,
+                                              &positive_values);
+    }
+
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return result;
+    }
+
     if (hist->count_case == PROMETHEUS__HISTOGRAM__COUNT_COUNT_INT) {
-        cmt_metric_hist_count_set(metric, hist->timestamp * 1000000,
-                                  hist->count_int);
+        count = hist->count_int;
     }
     else if (hist->count_case == PROMETHEUS__HISTOGRAM__COUNT_COUNT_FLOAT) {
-        cmt_metric_hist_count_set(metric, hist->timestamp * 1000000,
-                                  hist->count_float);
+        result = native_histogram_count(hist->count_float, &count);
     }
     else {
-        if (static_metric_detected == CMT_FALSE) {
-            if (metric->hist_buckets != NULL) {
-                free(metric->hist_buckets);
-            }
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+    }
 
-            destroy_label_list(&metric->labels);
+    zero_count = 0;
+    if (hist->zero_count_case == PROMETHEUS__HISTOGRAM__ZERO_COUNT_ZERO_COUNT_INT) {
+        zero_count = hist->zero_count_int;
+    }
+    else if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
+             hist->zero_count_case == PROMETHEUS__HISTOGRAM__ZERO_COUNT_ZERO_COUNT_FLOAT) {
+        result = native_histogram_count(hist->zero_count_float, &zero_count);
+    }
 
-            cfl_list_del(&metric->_head);
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return result;
+    }
+
+    size = negative_length + positive_length;
 
-            free(metric);
+    if (size > context->bucket_capacity) {
+        buckets = realloc(context->buckets, size * sizeof(uint64_t));
+        if (buckets == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
         }
 
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+        context->buckets = buckets;
+        context->bucket_capacity = size;
     }
 
-    return result;
-}
+    result = native_histogram_side_expand(hist->n_negative_spans,
+                                          hist->negative_spans,
+                                          hist->n_negative_deltas,
+                                          hist->negative_deltas,
+                                          hist->n_negative_counts,
+                                          hist->negative_counts,
+                                          negative_values,
+                                          context->buckets,
+                                          &negative_offset);
 
-static int decode_histogram_time_series(struct cmt *cmt,
-                                        struct cmt_map *map,
-                                        size_t hist_count,
-                                        Prometheus__TimeSeries *ts)
-{
-    size_t index;
-    int    result;
-    Prometheus__Histogram *histogram = NULL;
-
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    if (result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        result = native_histogram_side_expand(hist->n_positive_spans,
+                                              hist->positive_spans,
+                                              hist->n_positive_deltas,
+                                              hist->positive_deltas,
+                                              hist->n_positive_counts,
+                                              hist->positive_counts,
+                                              positive_values,
+                                              &context->buckets[negative_length],
+                                              &positive_offset);
+    }
 
-    if (hist_count > 0 && ts->histograms == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return result;
     }
 
-    for (index = 0; result == 0 && index < hist_count; index++) {
-        histogram = ts->histograms[index];
-        result = decode_histogram_points(cmt, map,
-                                         ts->n_histograms,
-                                         histogram,
-                                         ts->n_labels,
-                                         ts->labels);
+    /* remote write has no way to tell a missing sum apart from a zero one */
+    result = cmt_exp_histogram_set_default((struct cmt_exp_histogram *) map->parent,
+                                           hist->timestamp * 1000000,
+                                           hist->schema,
+                                           zero_count,
+                                           hist->zero_threshold,
+                                           positive_offset,
+                                           positive_length,
+                                           &context->buckets[negative_length],
+                                           negative_offset,
+                                           negative_length,
+                                           context->buckets,
+                                           CMT_TRUE,
+                                           hist->sum,
+                                           count,
+                                           label_count, context->values);
+
+    if (result != 0) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
-    return result;
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
 }
 
-static int decode_histogram_entry(struct cmt *cmt,
-                                  void *instance,
-                                  Prometheus__TimeSeries *ts)
+static int decode_native_histogram_time_series(struct rw_context *context,
+                                               struct cmt_map *map,
+                                               size_t label_count,
+                                               Prometheus__TimeSeries *ts)
 {
-    struct cmt_histogram *histogram;
-    int                   result;
+    size_t index;
+    int    result;
 
     result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
 
-    histogram = (struct cmt_histogram *) instance;
-
-    histogram->map->metric_static_set = 0;
-
-    result = decode_histogram_time_series(cmt,
-                                          histogram->map,
-                                          ts->n_histograms,
-                                          ts);
+    for (index = 0 ;
+         result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
+         index < ts->n_histograms ;
+         index++) {
+        result = decode_native_histogram(context, map, label_count,
+                                         ts->histograms[index]);
+    }
 
     return result;
 }
 
-static int decode_metrics_entry(struct cmt *cmt,
-                                Prometheus__WriteRequest *write)
+/*
+ * Schemas outside of the exponential range (custom buckets among others)
+ * have no exponential histogram equivalent, their series are skipped.
+ */
+static int native_histogram_series_check(Prometheus__TimeSeries *ts,
+                                         int *supported)
 {
-    int   i;
-    int   j;
-    char *metric_name = NULL;
-    char *metric_subsystem   = NULL;
-    char *metric_namespace   = NULL;
-    char *metric_description = NULL;
-    void *instance;
-    int   result;
-    int   ts_count = 0;
-    int   hist_count = 0;
-    int   meta_count = 0;
-    Prometheus__MetricMetadata             *metadata = NULL;
-    Prometheus__MetricMetadata__MetricType  type;
-    Prometheus__TimeSeries                 *ts = NULL;
-
-    result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    size_t index;
 
-    ts_count = write->n_timeseries;
-    if (ts_count > 0 && write->timeseries == NULL) {
-        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
-    }
+    *supported = CMT_TRUE;
 
-    if (write->n_metadata > 0 && write->metadata == NULL) {
+    if (ts->histograms == NULL) {
         return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
     }
 
-    for (i = 0; i < ts_count; i++) {
-        ts = write->timeseries[i];
-        if (ts == NULL) {
-            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
+    for (index = 0 ; index < ts->n_histograms ; index++) {
+        if (ts->histograms[index] == NULL) {
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
         }
 
-        meta_count = write->n_metadata;
-        hist_count = ts->n_histograms;
-        metadata = NULL;
-
-        metric_name = cmt_metric_name_from_labels(ts);
-        if (metric_name == NULL) {
-            continue;
+        if (ts->histograms[index]->schema < RW_NATIVE_HISTOGRAM_MINIMUM_SCHEMA ||
+            ts->histograms[index]->schema > RW_NATIVE_HISTOGRAM_MAXIMUM_SCHEMA) {
+            *supported = CMT_FALSE;
         }
+    }
 
-        for (j = 0; j < meta_count; j++) {
-            if (write->metadata[j] == NULL ||
-                write->metadata[j]->metric_family_name == NULL) {
-                continue;
-            }
+    return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
 
-            if (strcmp(write->metadata[j]->metric_family_name, metric_name) == 0) {
-                metadata = write->metadata[j];
-                break;
-            }
-        }
+static int decode_time_series(struct rw_context *context,
+                              Prometheus__TimeSeries *ts)
+{
+    int                         type;
+    int                         result;
+    int                         supported;
+    char                       *name;
+    char                       *description;
+    size_t                      label_count;
+    struct cmt_map             *map;
+    Prometheus__MetricMetadata *metadata;
+
+    result = series_labels_collect(context, ts, &label_count, &name);
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return result;
+    }
 
-        if (hist_count > 0) {
-            type = PROMETHEUS__METRIC_METADATA__METRIC_TYPE__HISTOGRAM;
-            metric_description = metadata != NULL ? metadata->help : "-";
-            if (metric_description == NULL) {
-                metric_description = "-";
-            }
-        }
-        else if (metadata == NULL) {
-            type = PROMETHEUS__METRIC_METADATA__METRIC_TYPE__GAUGE;
-            metric_description = "-";
-        }
-        else {
-            type = metadata->type;
-            metric_description = metadata->help;
-            if (metric_description == NULL) {
-                metric_description = "-";
-            }
-        }
+    /* series without a name cannot be attached to a family */
+    if (name == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
 
-        metric_namespace = "";
-        metric_subsystem = "";
+    metadata = metadata_lookup(context, name);
 
-        switch (type) {
-        case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__COUNTER:
-            instance = cmt_counter_create(cmt,
-                                          metric_namespace,
-                                          metric_subsystem,
-                                          metric_name,
-                                          metric_description,
-                                          0, NULL);
+    description = "-";
+    if (metadata != NULL && metadata->help != NULL) {
+        description = metadata->help;
+    }
 
-            if (instance == NULL) {
-                free(metric_name);
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+    if (ts->n_histograms > 0) {
+        result = native_histogram_series_check(ts, &supported);
+        if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS ||
+            supported == CMT_FALSE) {
+            return result;
+        }
 
-            result = decode_counter_entry(cmt, instance, ts);
+        type = RW_FAMILY_NATIVE_HISTOGRAM;
+    }
+    else if (metadata == NULL) {
+        type = PROMETHEUS__METRIC_METADATA__METRIC_TYPE__GAUGE;
+    }
+    else {
+        type = metadata->type;
+    }
 
-            if (result) {
-                cmt_counter_destroy(instance);
-            }
-            break;
-        case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__GAUGE:
-            instance = cmt_gauge_create(cmt,
-                                        metric_namespace,
-                                        metric_subsystem,
-                                        metric_name,
-                                        metric_description,
-                                        0, NULL);
-
-            if (instance == NULL) {
-                free(metric_name);
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+    /*
+     * summaries, classic histograms and the other types are not supported,
+     * skip their series
+     */
+    if (type != PROMETHEUS__METRIC_METADATA__METRIC_TYPE__COUNTER &&
+        type != PROMETHEUS__METRIC_METADATA__METRIC_TYPE__GAUGE &&
+        type != PROMETHEUS__METRIC_METADATA__METRIC_TYPE__UNKNOWN &&
+        type != RW_FAMILY_NATIVE_HISTOGRAM) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
 
-            result = decode_gauge_entry(cmt, instance, ts);
+    map = family_lookup(context, type, name, description, label_count);
+    if (map == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
 
-            if (result) {
-                cmt_gauge_destroy(instance);
-            }
-            break;
-        case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__UNKNOWN:
-            instance = cmt_untyped_create(cmt,
-                                          metric_namespace,
-                                          metric_subsystem,
-                                          metric_name,
-                                          metric_description,
-                                          0, NULL);
-
-            if (instance == NULL) {
-                free(metric_name);
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+    if (type == RW_FAMILY_NATIVE_HISTOGRAM) {
+        return decode_native_histogram_time_series(context, map, label_count,
+                                                   ts);
+    }
 
-            result = decode_untyped_entry(cmt, instance, ts);
+    return decode_numerical_time_series(context, map, label_count, ts);
+}
 
-            if (result) {
-                cmt_untyped_destroy(instance);
-            }
-            break;
-        case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__HISTOGRAM:
-            instance = cmt_histogram_create(cmt,
-                                            metric_namespace,
-                                            metric_subsystem,
-                                            metric_name,
-                                            metric_description,
-                                            NULL,
-                                            0, NULL);
-
-            if (instance == NULL) {
-                free(metric_name);
-                return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
-            }
+static int decode_metrics_entry(struct cmt *cmt,
+                                Prometheus__WriteRequest *write)
+{
+    size_t            index;
+    int               result;
+    struct rw_context context;
+
+    if (write->n_timeseries > 0 && write->timeseries == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
 
-            cmt_histogram_buckets_destroy(((struct cmt_histogram *) instance)->buckets);
-            ((struct cmt_histogram *) instance)->buckets = NULL;
+    if (write->n_metadata > 0 && write->metadata == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
 
-            result = decode_histogram_entry(cmt, instance, ts);
+    memset(&context, 0, sizeof(struct rw_context));
+    context.cmt = cmt;
 
-            if (result) {
-                cmt_histogram_destroy(instance);
-            }
-            break;
-        /* case PROMETHEUS__METRIC_METADATA__METRIC_TYPE__SUMMARY: */
+    result = metadata_index_create(&context, write);
 
-        default:
-            result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_UNSUPPORTED_METRIC_TYPE;
+    for (index = 0 ;
+         result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
+         index < write->n_timeseries ;
+         index++) {
+        if (write->timeseries[index] == NULL) {
+            result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
             break;
         }
 
-        free(metric_name);
+        result = decode_time_series(&context, write->timeseries[index]);
     }
 
+    context_destroy(&context);
+
     return result;
 }
 
 int cmt_decode_prometheus_remote_write_create(struct cmt **out_cmt, char *in_buf, size_t in_size)
 {
     int                       result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    struct rw_arena           arena;
+    ProtobufCAllocator        allocator;
     Prometheus__WriteRequest *write  = NULL;
     struct cmt               *cmt    = NULL;
 
@@ -865,31 +1034,125 @@ int cmt_decode_prometheus_remote_write_create(struct cmt **out_cmt, char *in_buf
         return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
-    write = prometheus__write_request__unpack(&cmt_system_allocator,
+    arena_init(&arena, &allocator, in_size);
+
+    /* the request lives in the arena, it is never freed message by message */
+    write = prometheus__write_request__unpack(&allocator,
                                               in_size,
                                               (uint8_t *) in_buf);
     if (write == NULL) {
         result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_UNPACK_ERROR;
+        arena_destroy(&arena);
         cmt_destroy(cmt);
         return result;
     }
 
     result = decode_metrics_entry(cmt, write);
+
+    arena_destroy(&arena);
+
     if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
         cmt_destroy(cmt);
-        prometheus__write_request__free_unpacked(write, &cmt_system_allocator);
         result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR;
 
         return result;
     }
 
-    prometheus__write_request__free_unpacked(write, &cmt_system_allocator);
-
     *out_cmt = cmt;
 
     return result;
 }
 
+int cmt_decode_prometheus_remote_write_create_compressed(struct cmt **out_cmt,
+                                                         char *in_buf,
+                                                         size_t in_size,
+                                                         cfl_sds_t *buffer)
+{
+    int       result;
+    size_t    uncompressed_size;
+    cfl_sds_t local_buffer;
+    cfl_sds_t uncompressed_buffer;
+
+    if (out_cmt == NULL || in_buf == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_snappy_uncompressed_length(in_buf, in_size, &uncompressed_size);
+    if (result != CMT_SNAPPY_SUCCESS) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECOMPRESSION_ERROR;
+    }
+
+    local_buffer = NULL;
+
+    if (buffer == NULL) {
+        buffer = &local_buffer;
+    }
+
+    uncompressed_buffer = *buffer;
+
+    if (uncompressed_buffer == NULL ||
+        cfl_sds_alloc(uncompressed_buffer) < uncompressed_size) {
+        if (uncompressed_buffer != NULL) {
+            cfl_sds_destroy(uncompressed_buffer);
+            *buffer = NULL;
+        }
+
+        uncompressed_buffer = cfl_sds_create_size(uncompressed_size);
+        if (uncompressed_buffer == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+        }
+
+        *buffer = uncompressed_buffer;
+    }
+
+    result = cmt_snappy_uncompress(in_buf, in_size,
+                                   uncompressed_buffer,
+                                   cfl_sds_alloc(uncompressed_buffer),
+                                   &uncompressed_size);
+
+    if (result == CMT_SNAPPY_SUCCESS) {
+        cfl_sds_set_len(uncompressed_buffer, uncompressed_size);
+
+        result = cmt_decode_prometheus_remote_write_create(out_cmt,
+                                                           uncompressed_buffer,
+                                                           uncompressed_size);
+    }
+    else {
+        result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECOMPRESSION_ERROR;
+    }
+
+    if (local_buffer != NULL) {
+        cfl_sds_destroy(local_buffer);
+    }
+
+    return result;
+}
+
+int cmt_decode_prometheus_remote_write_merge(struct cmt *dst, char *in_buf, size_t in_size)
+{
+    int         result;
+    struct cmt *cmt;
+
+    if (dst == NULL) {
+        return CMT_DECODE_PROMETHEUS_REMOTE_WRITE_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_prometheus_remote_write_create(&cmt, in_buf, in_size);
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_cat_move(dst, cmt) != 0) {
+        result = CMT_DECODE_PROMETHEUS_REMOTE_WRITE_MERGE_ERROR;
+    }
+
+    cmt_destroy(cmt);
+
+    return result;
+}
+
 void cmt_decode_prometheus_remote_write_destroy(struct cmt *cmt)
 {
     cmt_destroy(cmt);
@@ -18,70 +18,1126 @@
  */
 
 #include <float.h> /* for DBL_EPSILON */
+#include <math.h>
 #include <cmetrics/cmetrics.h>
 #include <cmetrics/cmt_metric.h>
 #include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_math.h>
 #include <cmetrics/cmt_counter.h>
 #include <cmetrics/cmt_summary.h>
 #include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
+#include <cmetrics/cmt_hll.h>
 #include <cmetrics/cmt_gauge.h>
-#include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_decode_statsd.h>
 #include <cmetrics/cmt_compat.h>
 
-static struct cmt_map_label *create_map_label(char *caption, size_t length)
+/* tags of a single line, label keys of a family */
+#define STATSD_MAX_TAGS             128
+
+#define STATSD_TABLE_INITIAL_SIZE    64
+#define STATSD_TABLE_LOAD_NUMERATOR   3
+#define STATSD_TABLE_LOAD_DENOMINATOR 4
+
+struct statsd_tag {
+    const char *key;
+    size_t      key_length;
+    const char *value;
+    size_t      value_length;
+};
+
+/*
+ * Lines are aggregated per series before the context is built. A family is
+ * identified by its type, bucket name and sorted tag keys, a series by its
+ * family and tag values.
+ */
+struct statsd_family {
+    uint64_t         hash;
+    int              type;
+    char            *name;
+    size_t           label_count;
+    char           **keys;
+
+    /* regular and incremental="true" instances, created on demand */
+    struct cmt_map  *maps[2];
+
+    struct cfl_list  _head;
+};
+
+/*
+ * Bucket weights of one sign of an exponential histogram, 'counts' holds
+ * 'count' buckets starting at index 'offset' and has room for the maximum
+ * number of buckets, slots past 'count' are always zero.
+ */
+struct statsd_exp_buckets {
+    int32_t  offset;
+    size_t   count;
+    double  *counts;
+};
+
+struct statsd_exp_histogram {
+    int32_t                   scale;
+    double                    zero_count;
+    struct statsd_exp_buckets positive;
+    struct statsd_exp_buckets negative;
+};
+
+struct statsd_series {
+    uint64_t                     hash;
+    struct statsd_family        *family;
+    double                       value;
+
+    /* gauge that only received relative updates */
+    int                          incremental;
+
+    /*
+     * Observations, weighted by the inverse of their sample rate. Explicit
+     * buckets are not cumulative, the last one is +Inf.
+     */
+    double                       count;
+    double                       sum;
+    double                      *buckets;
+    struct statsd_exp_histogram *exp_histogram;
+
+    /* distinct members of a set */
+    struct cmt_hll              *hll;
+
+    char                       **values;
+
+    struct cfl_list              _head;
+};
+
+/*
+ * Raw bucket name and tag list of a line, clients repeat lines verbatim so
+ * most lines are resolved without parsing and sorting their tags.
+ */
+struct statsd_alias {
+    uint64_t              hash;
+    int                   type;
+    size_t                name_length;
+    size_t                tags_length;
+    struct statsd_series *series;
+
+    /* name followed by the tags */
+    char                 *key;
+
+    struct cfl_list       _head;
+};
+
+struct statsd_slot {
+    uint64_t  hash;
+    void     *entry;
+};
+
+struct statsd_table {
+    struct statsd_slot *slots;
+    size_t              slot_count;
+    size_t              entry_count;
+};
+
+struct statsd_context {
+    struct cmt          *cmt;
+    int                  flags;
+    double              *buckets;
+    size_t               bucket_count;
+    size_t               exp_histogram_max_buckets;
+    struct statsd_table  family_table;
+    struct statsd_table  series_table;
+    struct statsd_table  alias_table;
+    struct cfl_list      families;
+    struct cfl_list      series;
+    struct cfl_list      aliases;
+};
+
+static int slice_compare(const char *left, size_t left_length,
+                         const char *right, size_t right_length)
+{
+    int result;
+
+    result = memcmp(left, right,
+                    left_length < right_length ? left_length : right_length);
+
+    if (result != 0) {
+        return result;
+    }
+
+    return (left_length > right_length) - (left_length < right_length);
+}
+
+static int slice_equals(const char *string, const char *slice, size_t length)
+{
+    return strncmp(string, slice, length) == 0 && string[length] == '\0';
+}
+
+static int table_init(struct statsd_table *table)
+{
+    table->slots = calloc(STATSD_TABLE_INITIAL_SIZE, sizeof(struct statsd_slot));
+
+    if (table->slots == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+    }
+
+    table->slot_count = STATSD_TABLE_INITIAL_SIZE;
+    table->entry_count = 0;
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int table_grow(struct statsd_table *table)
+{
+    size_t              index;
+    size_t              position;
+    size_t              slot_count;
+    struct statsd_slot *slots;
+
+    slot_count = table->slot_count * 2;
+    slots = calloc(slot_count, sizeof(struct statsd_slot));
+
+    if (slots == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < table->slot_count ; index++) {
+        if (table->slots[index].entry == NULL) {
+            continue;
+        }
+
+        position = table->slots[index].hash & (slot_count - 1);
+
+        while (slots[position].entry != NULL) {
+            position = (position + 1) & (slot_count - 1);
+        }
+
+        slots[position] = table->slots[index];
+    }
+
+    free(table->slots);
+
+    table->slots = slots;
+    table->slot_count = slot_count;
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+/* Store 'entry' in the empty slot returned by a failed lookup */
+static int table_insert(struct statsd_table *table, struct statsd_slot *slot,
+                        uint64_t hash, void *entry)
+{
+    slot->hash = hash;
+    slot->entry = entry;
+
+    table->entry_count++;
+
+    if (table->entry_count * STATSD_TABLE_LOAD_DENOMINATOR >=
+        table->slot_count * STATSD_TABLE_LOAD_NUMERATOR) {
+        return table_grow(table);
+    }
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int family_matches(struct statsd_family *family, int type,
+                          struct cmt_statsd_message *m,
+                          struct statsd_tag *tags, size_t tag_count)
+{
+    size_t index;
+
+    if (family->type != type ||
+        family->label_count != tag_count ||
+        !slice_equals(family->name, m->bucket, m->bucket_len)) {
+        return CMT_FALSE;
+    }
+
+    for (index = 0 ; index < tag_count ; index++) {
+        if (!slice_equals(family->keys[index],
+                          tags[index].key, tags[index].key_length)) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+static struct statsd_family *family_create(struct statsd_context *context,
+                                           uint64_t hash, int type,
+                                           struct cmt_statsd_message *m,
+                                           struct statsd_tag *tags,
+                                           size_t tag_count)
+{
+    char                 *buffer;
+    size_t                index;
+    size_t                size;
+    struct statsd_family *family;
+
+    size = sizeof(struct statsd_family) + tag_count * sizeof(char *) +
+           m->bucket_len + 1;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        size += tags[index].key_length + 1;
+    }
+
+    family = calloc(1, size);
+
+    if (family == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    family->hash = hash;
+    family->type = type;
+    family->label_count = tag_count;
+    family->keys = (char **) (family + 1);
+
+    buffer = (char *) (family->keys + tag_count);
+
+    family->name = buffer;
+    memcpy(buffer, m->bucket, m->bucket_len);
+    buffer += m->bucket_len + 1;
+
+    for (index = 0 ; index < tag_count ; index++) {
+        family->keys[index] = buffer;
+        memcpy(buffer, tags[index].key, tags[index].key_length);
+        buffer += tags[index].key_length + 1;
+    }
+
+    cfl_list_add(&family->_head, &context->families);
+
+    return family;
+}
+
+static struct statsd_family *family_lookup(struct statsd_context *context, int type,
+                                           struct cmt_statsd_message *m,
+                                           struct statsd_tag *tags, size_t tag_count)
+{
+    size_t                index;
+    size_t                position;
+    uint64_t              hash;
+    cfl_hash_state_t      state;
+    struct statsd_slot   *slot;
+    struct statsd_family *family;
+    struct statsd_table  *table;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, &type, sizeof(type));
+    cfl_hash_64bits_update(&state, m->bucket, m->bucket_len);
+
+    for (index = 0 ; index < tag_count ; index++) {
+        cfl_hash_64bits_update(&state, tags[index].key, tags[index].key_length);
+        cfl_hash_64bits_update(&state, ",", 1);
+    }
+
+    hash = cfl_hash_64bits_digest(&state);
+
+    table = &context->family_table;
+    position = hash & (table->slot_count - 1);
+
+    while (table->slots[position].entry != NULL) {
+        slot = &table->slots[position];
+
+        if (slot->hash == hash &&
+            family_matches(slot->entry, type, m, tags, tag_count)) {
+            return slot->entry;
+        }
+
+        position = (position + 1) & (table->slot_count - 1);
+    }
+
+    family = family_create(context, hash, type, m, tags, tag_count);
+
+    if (family == NULL) {
+        return NULL;
+    }
+
+    if (table_insert(table, &table->slots[position], hash, family) != 0) {
+        return NULL;
+    }
+
+    return family;
+}
+
+static int series_matches(struct statsd_series *series,
+                          struct statsd_family *family,
+                          struct statsd_tag *tags, size_t tag_count)
+{
+    size_t index;
+
+    if (series->family != family) {
+        return CMT_FALSE;
+    }
+
+    for (index = 0 ; index < tag_count ; index++) {
+        if (!slice_equals(series->values[index],
+                          tags[index].value, tags[index].value_length)) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+static struct statsd_series *series_create(struct statsd_context *context,
+                                           uint64_t hash,
+                                           struct statsd_family *family,
+                                           struct statsd_tag *tags,
+                                           size_t tag_count)
+{
+    char                 *buffer;
+    size_t                index;
+    size_t                size;
+    struct statsd_series *series;
+
+    size = sizeof(struct statsd_series) + tag_count * sizeof(char *);
+
+    for (index = 0 ; index < tag_count ; index++) {
+        size += tags[index].value_length + 1;
+    }
+
+    series = calloc(1, size);
+
+    if (series == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    series->hash = hash;
+    series->family = family;
+    series->values = (char **) (series + 1);
+
+    buffer = (char *) (series->values + tag_count);
+
+    for (index = 0 ; index < tag_count ; index++) {
+        series->values[index] = buffer;
+        memcpy(buffer, tags[index].value, tags[index].value_length);
+        buffer += tags[index].value_length + 1;
+    }
+
+    cfl_list_add(&series->_head, &context->series);
+
+    return series;
+}
+
+static struct statsd_series *series_lookup(struct statsd_context *context,
+                                           struct statsd_family *family,
+                                           struct statsd_tag *tags,
+                                           size_t tag_count,
+                                           int *created)
+{
+    size_t                index;
+    size_t                position;
+    uint64_t              hash;
+    cfl_hash_state_t      state;
+    struct statsd_slot   *slot;
+    struct statsd_series *series;
+    struct statsd_table  *table;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, &family->hash, sizeof(family->hash));
+
+    for (index = 0 ; index < tag_count ; index++) {
+        cfl_hash_64bits_update(&state, tags[index].value, tags[index].value_length);
+        cfl_hash_64bits_update(&state, ",", 1);
+    }
+
+    hash = cfl_hash_64bits_digest(&state);
+
+    table = &context->series_table;
+    position = hash & (table->slot_count - 1);
+
+    while (table->slots[position].entry != NULL) {
+        slot = &table->slots[position];
+
+        if (slot->hash == hash &&
+            series_matches(slot->entry, family, tags, tag_count)) {
+            *created = CMT_FALSE;
+
+            return slot->entry;
+        }
+
+        position = (position + 1) & (table->slot_count - 1);
+    }
+
+    series = series_create(context, hash, family, tags, tag_count);
+
+    if (series == NULL) {
+        return NULL;
+    }
+
+    if (table_insert(table, &table->slots[position], hash, series) != 0) {
+        return NULL;
+    }
+
+    *created = CMT_TRUE;
+
+    return series;
+}
+
+static uint64_t alias_hash(struct cmt_statsd_message *m)
+{
+    uint64_t hash;
+
+    hash = cfl_hash_64bits(m->bucket, m->bucket_len);
+
+    if (m->labels != NULL) {
+        hash ^= cfl_hash_64bits(m->labels, m->labels_len) * UINT64_C(0x9e3779b97f4a7c15);
+    }
+
+    return hash + m->type;
+}
+
+static struct statsd_slot *alias_lookup(struct statsd_context *context,
+                                        struct cmt_statsd_message *m,
+                                        uint64_t hash)
+{
+    size_t               position;
+    struct statsd_slot  *slot;
+    struct statsd_alias *alias;
+    struct statsd_table *table;
+
+    table = &context->alias_table;
+    position = hash & (table->slot_count - 1);
+
+    while (table->slots[position].entry != NULL) {
+        slot = &table->slots[position];
+        alias = slot->entry;
+
+        if (slot->hash == hash &&
+            alias->type == m->type &&
+            alias->name_length == (size_t) m->bucket_len &&
+            alias->tags_length == (size_t) m->labels_len &&
+            memcmp(alias->key, m->bucket, m->bucket_len) == 0 &&
+            (m->labels_len == 0 ||
+             memcmp(alias->key + m->bucket_len, m->labels, m->labels_len) == 0)) {
+            return slot;
+        }
+
+        position = (position + 1) & (table->slot_count - 1);
+    }
+
+    return &table->slots[position];
+}
+
+static int alias_create(struct statsd_context *context,
+                        struct statsd_slot *slot, uint64_t hash,
+                        struct cmt_statsd_message *m,
+                        struct statsd_series *series)
+{
+    struct statsd_alias *alias;
+
+    alias = malloc(sizeof(struct statsd_alias) + m->bucket_len + m->labels_len);
+
+    if (alias == NULL) {
+        cmt_errno();
+
+        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+    }
+
+    alias->hash = hash;
+    alias->type = m->type;
+    alias->name_length = m->bucket_len;
+    alias->tags_length = m->labels_len;
+    alias->series = series;
+    alias->key = (char *) (alias + 1);
+
+    memcpy(alias->key, m->bucket, m->bucket_len);
+    if (m->labels_len > 0) {
+        memcpy(alias->key + m->bucket_len, m->labels, m->labels_len);
+    }
+
+    cfl_list_add(&alias->_head, &context->aliases);
+
+    return table_insert(&context->alias_table, slot, hash, alias);
+}
+
+/*
+ * Split the 'key:value,...' tag list, tags are kept sorted by key so the tag
+ * order of a line does not matter, a repeated key keeps its last value and a
+ * tag without a colon gets an empty value.
+ */
+static int decode_tags(char *labels, size_t length,
+                       struct statsd_tag *tags, size_t *tag_count)
+{
+    int         result;
+    char       *end;
+    char       *comma;
+    char       *colon;
+    size_t      count;
+    size_t      position;
+    size_t      key_length;
+    const char *value;
+    size_t      value_length;
+
+    count = 0;
+    end = labels + length;
+
+    while (labels < end) {
+        comma = memchr(labels, ',', end - labels);
+
+        if (comma == NULL) {
+            comma = end;
+        }
+
+        colon = memchr(labels, ':', comma - labels);
+
+        if (colon != NULL) {
+            key_length = colon - labels;
+            value = colon + 1;
+            value_length = comma - value;
+        }
+        else {
+            key_length = comma - labels;
+            value = "";
+            value_length = 0;
+        }
+
+        if (key_length == 0) {
+            labels = comma + 1;
+
+            continue;
+        }
+
+        result = 1;
+        position = count;
+
+        while (position > 0) {
+            result = slice_compare(tags[position - 1].key,
+                                   tags[position - 1].key_length,
+                                   labels, key_length);
+
+            if (result <= 0) {
+                break;
+            }
+
+            position--;
+        }
+
+        if (position > 0 && result == 0) {
+            tags[position - 1].value = value;
+            tags[position - 1].value_length = value_length;
+        }
+        else {
+            if (count == STATSD_MAX_TAGS) {
+                return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+            }
+
+            memmove(&tags[position + 1], &tags[position],
+                    (count - position) * sizeof(struct statsd_tag));
+
+            tags[position].key = labels;
+            tags[position].key_length = key_length;
+            tags[position].value = value;
+            tags[position].value_length = value_length;
+
+            count++;
+        }
+
+        labels = comma + 1;
+    }
+
+    *tag_count = count;
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int is_incremental(char *str)
+{
+    return (*str == '+' || *str == '-');
+}
+
+static int is_observation(int type)
+{
+    return (type == CMT_DECODE_STATSD_TYPE_TIMER ||
+            type == CMT_DECODE_STATSD_TYPE_HISTOGRAM ||
+            type == CMT_DECODE_STATSD_TYPE_DISTRIBUTION);
+}
+
+/* Shift right rounding towards negative infinity */
+static int64_t floor_shift(int64_t index, int shift)
+{
+    if (index >= 0) {
+        return index >> shift;
+    }
+
+    return -((-(index + 1)) >> shift) - 1;
+}
+
+/*
+ * Index of the bucket holding 'value' (> 0), bucket i spans
+ * (base^i, base^(i + 1)] with base = 2^(2^-scale).
+ */
+static int32_t exp_histogram_index(double value, int32_t scale)
+{
+    int     exponent;
+    double  fraction;
+    int32_t index;
+
+    fraction = frexp(value, &exponent);
+
+    if (scale <= 0) {
+        /* exact powers of two close the bucket below them */
+        index = exponent - 1;
+        if (fraction == 0.5) {
+            index--;
+        }
+
+        return (int32_t) floor_shift(index, -scale);
+    }
+
+    if (fraction == 0.5) {
+        return (exponent - 1) * (INT32_C(1) << scale) - 1;
+    }
+
+    return (int32_t) floor(log2(value) * ldexp(1.0, scale));
+}
+
+/* Scale reduction needed to fit 'index' in 'buckets' */
+static int exp_buckets_change(struct statsd_exp_buckets *buckets,
+                              int32_t index, size_t max_buckets)
+{
+    int     change;
+    int64_t low;
+    int64_t high;
+
+    if (buckets->count == 0) {
+        return 0;
+    }
+
+    low = buckets->offset < index ? buckets->offset : index;
+    high = (int64_t) buckets->offset + buckets->count - 1;
+    if (index > high) {
+        high = index;
+    }
+
+    for (change = 0 ; (size_t) (high - low) >= max_buckets ; change++) {
+        low = floor_shift(low, 1);
+        high = floor_shift(high, 1);
+    }
+
+    return change;
+}
+
+/* Merge the buckets in place, every bucket moves to the same or a lower slot */
+static void exp_buckets_downscale(struct statsd_exp_buckets *buckets, int change)
+{
+    size_t  index;
+    size_t  target;
+    int32_t offset;
+
+    if (buckets->count == 0) {
+        return;
+    }
+
+    offset = (int32_t) floor_shift(buckets->offset, change);
+
+    for (index = 0 ; index < buckets->count ; index++) {
+        target = floor_shift(buckets->offset + (int32_t) index, change) - offset;
+
+        if (target != index) {
+            buckets->counts[target] += buckets->counts[index];
+            buckets->counts[index] = 0;
+        }
+    }
+
+    buckets->count = floor_shift(buckets->offset + (int32_t) buckets->count - 1,
+                                 change) - offset + 1;
+    buckets->offset = offset;
+}
+
+static int exp_buckets_add(struct statsd_exp_buckets *buckets, int32_t index,
+                           double weight, size_t max_buckets)
+{
+    size_t shift;
+
+    if (buckets->counts == NULL) {
+        buckets->counts = calloc(max_buckets, sizeof(double));
+
+        if (buckets->counts == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+    }
+
+    if (buckets->count == 0) {
+        buckets->offset = index;
+        buckets->count = 1;
+    }
+    else if (index < buckets->offset) {
+        shift = buckets->offset - index;
+
+        memmove(&buckets->counts[shift], buckets->counts,
+                buckets->count * sizeof(double));
+        memset(buckets->counts, 0, shift * sizeof(double));
+
+        buckets->offset = index;
+        buckets->count += shift;
+    }
+    else if ((size_t) (index - buckets->offset) >= buckets->count) {
+        buckets->count = index - buckets->offset + 1;
+    }
+
+    buckets->counts[index - buckets->offset] += weight;
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+/*
+ * Record into an exponential histogram, both signs share the scale which is
+ * lowered whenever a value does not fit in the maximum number of buckets.
+ */
+static int exp_histogram_record(struct statsd_context *context,
+                                struct statsd_series *series,
+                                double value, double weight)
+{
+    int                          change;
+    int32_t                      index;
+    struct statsd_exp_buckets   *buckets;
+    struct statsd_exp_histogram *histogram;
+
+    histogram = series->exp_histogram;
+
+    if (histogram == NULL) {
+        histogram = calloc(1, sizeof(struct statsd_exp_histogram));
+
+        if (histogram == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+
+        histogram->scale = CMT_DECODE_STATSD_EXP_HISTOGRAM_MAX_SCALE;
+        series->exp_histogram = histogram;
+    }
+
+    if (value == 0) {
+        histogram->zero_count += weight;
+
+        return CMT_DECODE_STATSD_SUCCESS;
+    }
+
+    buckets = value > 0 ? &histogram->positive : &histogram->negative;
+    index = exp_histogram_index(fabs(value), histogram->scale);
+
+    change = exp_buckets_change(buckets, index,
+                                context->exp_histogram_max_buckets);
+
+    if (change > 0) {
+        exp_buckets_downscale(&histogram->positive, change);
+        exp_buckets_downscale(&histogram->negative, change);
+
+        histogram->scale -= change;
+        index = (int32_t) floor_shift(index, change);
+    }
+
+    return exp_buckets_add(buckets, index, weight,
+                           context->exp_histogram_max_buckets);
+}
+
+static int series_observe(struct statsd_context *context,
+                          struct statsd_series *series,
+                          double value, double weight)
+{
+    size_t index;
+
+    /* infinities and NaN have no bucket and would poison the sum */
+    if (!isfinite(value)) {
+        return CMT_DECODE_STATSD_SUCCESS;
+    }
+
+    series->count += weight;
+    series->sum += value * weight;
+
+    if (context->flags & CMT_DECODE_STATSD_EXP_HISTOGRAM_OBSERVER) {
+        return exp_histogram_record(context, series, value, weight);
+    }
+
+    if (series->buckets == NULL) {
+        series->buckets = calloc(context->bucket_count + 1, sizeof(double));
+
+        if (series->buckets == NULL) {
+            cmt_errno();
+
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+    }
+
+    for (index = 0 ; index < context->bucket_count ; index++) {
+        if (value <= context->buckets[index]) {
+            break;
+        }
+    }
+
+    series->buckets[index] += weight;
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int series_update(struct statsd_context *context,
+                         struct statsd_series *series,
+                         struct cmt_statsd_message *m,
+                         char *text, size_t length, int created)
+{
+    double value;
+    double weight;
+
+    if (cmt_math_parse_double(text, length, &value) != 0) {
+        return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+    }
+
+    weight = 1.0;
+
+    if ((m->sample_rate - 0.0) > DBL_EPSILON &&
+        (1.0 - m->sample_rate) > DBL_EPSILON) {
+        weight = 1.0 / m->sample_rate;
+    }
+
+    switch (m->type) {
+    case CMT_DECODE_STATSD_TYPE_COUNTER:
+        series->value += value * weight;
+        break;
+    case CMT_DECODE_STATSD_TYPE_GAUGE:
+        if (is_incremental(text)) {
+            if (created) {
+                series->incremental = CMT_TRUE;
+            }
+
+            series->value += value;
+        }
+        else {
+            series->incremental = CMT_FALSE;
+            series->value = value;
+        }
+        break;
+    default:
+        if (context->flags & CMT_DECODE_STATSD_GAUGE_OBSERVER) {
+            series->value = value;
+            break;
+        }
+
+        return series_observe(context, series, value, weight);
+    }
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int decode_statsd_message(struct statsd_context *context,
+                                 struct cmt_statsd_message *m)
+{
+    int                   result;
+    int                   created;
+    char                 *value;
+    char                 *value_end;
+    char                 *separator;
+    uint64_t              hash;
+    size_t                tag_count;
+    struct statsd_tag     tags[STATSD_MAX_TAGS];
+    struct statsd_slot   *slot;
+    struct statsd_family *family;
+    struct statsd_series *series;
+
+    if (m->type != CMT_DECODE_STATSD_TYPE_COUNTER &&
+        m->type != CMT_DECODE_STATSD_TYPE_GAUGE &&
+        m->type != CMT_DECODE_STATSD_TYPE_SET &&
+        !is_observation(m->type)) {
+        return CMT_DECODE_STATSD_UNSUPPORTED_METRIC_TYPE;
+    }
+
+    hash = alias_hash(m);
+    slot = alias_lookup(context, m, hash);
+
+    if (slot->entry != NULL) {
+        series = ((struct statsd_alias *) slot->entry)->series;
+        created = CMT_FALSE;
+    }
+    else {
+        tag_count = 0;
+
+        if (m->labels != NULL) {
+            result = decode_tags(m->labels, m->labels_len, tags, &tag_count);
+
+            if (result != CMT_DECODE_STATSD_SUCCESS) {
+                return result;
+            }
+        }
+
+        family = family_lookup(context, m->type, m, tags, tag_count);
+
+        if (family == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+
+        series = series_lookup(context, family, tags, tag_count, &created);
+
+        if (series == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+
+        result = alias_create(context, slot, hash, m, series);
+
+        if (result != CMT_DECODE_STATSD_SUCCESS) {
+            return result;
+        }
+    }
+
+    /* set members are opaque, only their hash is kept */
+    if (m->type == CMT_DECODE_STATSD_TYPE_SET) {
+        if (series->hll == NULL) {
+            series->hll = cmt_hll_create();
+
+            if (series->hll == NULL) {
+                return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+            }
+        }
+
+        cmt_hll_add(series->hll, m->value, m->value_len);
+
+        return CMT_DECODE_STATSD_SUCCESS;
+    }
+
+    /* DogStatsD packs several values of a line as 'value:value:...' */
+    value = m->value;
+    value_end = m->value + m->value_len;
+
+    do {
+        separator = memchr(value, ':', value_end - value);
+
+        if (separator == NULL) {
+            separator = value_end;
+        }
+
+        result = series_update(context, series, m,
+                               value, separator - value, created);
+
+        if (result != CMT_DECODE_STATSD_SUCCESS) {
+            return result;
+        }
+
+        created = CMT_FALSE;
+        value = separator + 1;
+    } while (separator < value_end);
+
+    return CMT_DECODE_STATSD_SUCCESS;
+}
+
+static int family_instance_create(struct statsd_context *context,
+                                  struct statsd_family *family,
+                                  int incremental)
 {
-    struct cmt_map_label *map_label;
+    int                           label_count;
+    char                         *keys[STATSD_MAX_TAGS + 1];
+    struct cmt_counter           *counter;
+    struct cmt_gauge             *gauge;
+    struct cmt_histogram         *histogram;
+    struct cmt_histogram_buckets *buckets;
+    struct cmt_exp_histogram     *exp_histogram;
 
-    map_label = calloc(1, sizeof(struct cmt_map_label));
-    if (!map_label) {
-        return NULL;
+    label_count = 0;
+
+    if (incremental) {
+        keys[label_count++] = "incremental";
     }
 
-    if (map_label != NULL) {
-        if (caption != NULL) {
-            if (length == 0) {
-                length = strlen(caption);
+    memcpy(&keys[label_count], family->keys, family->label_count * sizeof(char *));
+    label_count += family->label_count;
+
+    switch (family->type) {
+    case CMT_DECODE_STATSD_TYPE_COUNTER:
+        counter = cmt_counter_create(context->cmt, "", "", family->name, "-",
+                                     label_count, keys);
+
+        if (counter == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+
+        family->maps[incremental] = counter->map;
+        break;
+    case CMT_DECODE_STATSD_TYPE_SET:
+    case CMT_DECODE_STATSD_TYPE_GAUGE:
+        gauge = cmt_gauge_create(context->cmt, "", "", family->name, "-",
+                                 label_count, keys);
+
+        if (gauge == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+
+        family->maps[incremental] = gauge->map;
+        break;
+    default:
+        if (context->flags & CMT_DECODE_STATSD_EXP_HISTOGRAM_OBSERVER) {
+            exp_histogram = cmt_exp_histogram_create(context->cmt, "", "",
+                                                     family->name, "-",
+                                                     label_count, keys);
+
+            if (exp_histogram == NULL) {
+                return CMT_DECODE_STATSD_ALLOCATION_ERROR;
             }
 
-            map_label->name = cfl_sds_create_len(caption, length);
+            family->maps[incremental] = exp_histogram->map;
+            break;
+        }
+
+        if (!(context->flags & CMT_DECODE_STATSD_GAUGE_OBSERVER)) {
+            /* the histogram takes ownership of its own copy of the bounds */
+            buckets = cmt_histogram_buckets_create_size(context->buckets,
+                                                        context->bucket_count);
+
+            if (buckets == NULL) {
+                return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+            }
 
-            if (map_label->name == NULL) {
-                cmt_errno();
+            histogram = cmt_histogram_create(context->cmt, "", "",
+                                             family->name, "-", buckets,
+                                             label_count, keys);
 
-                free(map_label);
+            if (histogram == NULL) {
+                cmt_histogram_buckets_destroy(buckets);
 
-                map_label = NULL;
+                return CMT_DECODE_STATSD_ALLOCATION_ERROR;
             }
+
+            family->maps[incremental] = histogram->map;
+            break;
+        }
+
+        /* observations keep their last value */
+        gauge = cmt_gauge_create(context->cmt, "", "", family->name, "-",
+                                 label_count, keys);
+
+        if (gauge == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
         }
+
+        family->maps[incremental] = gauge->map;
+        break;
     }
 
-    return map_label;
+    return CMT_DECODE_STATSD_SUCCESS;
 }
 
-static int append_new_map_label_key(struct cmt_map *map, char *name)
+static int append_label_value(struct cmt_metric *metric, char *value)
 {
     struct cmt_map_label *label;
 
-    label = create_map_label(name, 0);
+    label = calloc(1, sizeof(struct cmt_map_label));
 
     if (label == NULL) {
+        cmt_errno();
+
         return CMT_DECODE_STATSD_ALLOCATION_ERROR;
     }
 
-    cfl_list_add(&label->_head, &map->label_keys);
-    map->label_count++;
-
-    return CMT_DECODE_STATSD_SUCCESS;
-}
-
-static int append_new_metric_label_value(struct cmt_metric *metric, char *name, size_t length)
-{
-    struct cmt_map_label *label;
+    label->name = cfl_sds_create(value);
 
-    label = create_map_label(name, length);
+    if (label->name == NULL) {
+        cmt_errno();
+        free(label);
 
-    if (label == NULL) {
         return CMT_DECODE_STATSD_ALLOCATION_ERROR;
     }
 
@@ -90,410 +1146,341 @@ static int append_new_metric_label_value(struct cmt_metric *metric, char *name,
     return CMT_DECODE_STATSD_SUCCESS;
 }
 
-static int is_incremental(char *str)
+/* Weights are rounded once, cumulatively, so bucket counts stay monotonic */
+static int histogram_metric_set(struct statsd_context *context,
+                                struct cmt_metric *metric,
+                                struct statsd_series *series, uint64_t ts)
 {
-    return (*str == '+' || *str == '-');
-}
-
-static int decode_labels(struct cmt *cmt,
-                         struct cmt_map *map,
-                         struct cmt_metric *metric,
-                         char *labels, int incremental)
-{
-    void                 **value_index_list;
-    size_t                 map_label_index;
-    size_t                 map_label_count;
-    struct cfl_list       *label_iterator;
-    struct cmt_map_label  *current_label;
-    size_t                 label_index;
-    int                    label_found;
-    char                  *label_kv, *colon;
-    cfl_sds_t              label_k = NULL, label_v = NULL, tmp = NULL;
-    int                    result;
-    struct cfl_list *head = NULL;
-    struct cfl_list *kvs = NULL;
-    struct cfl_split_entry *cur = NULL;
-
-    result = CMT_DECODE_STATSD_SUCCESS;
+    size_t index;
+    double total;
 
-    value_index_list = calloc(128, sizeof(void *));
+    if (metric->hist_buckets == NULL) {
+        metric->hist_buckets = calloc(context->bucket_count + 1,
+                                      sizeof(uint64_t));
 
-    if (value_index_list == NULL) {
-        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
-    }
+        if (metric->hist_buckets == NULL) {
+            cmt_errno();
 
-    label_found = CMT_FALSE;
-    label_index = 0;
-
-    if (incremental) {
-        label_k = cfl_sds_create("incremental");
-        if (label_k != NULL) {
-            result = append_new_map_label_key(map, label_k);
-            cfl_sds_destroy(label_k);
-
-            if (result == CMT_DECODE_STATSD_SUCCESS) {
-                tmp = (void *) cfl_sds_create("true");
-                if (tmp != NULL) {
-                    value_index_list[label_index] = tmp;
-                }
-            }
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
         }
     }
 
-    if (labels != NULL) {
-        kvs = cfl_utils_split(labels, ',', -1 );
-        if (kvs == NULL) {
-            goto split_error;
-        }
-
-        cfl_list_foreach(head, kvs) {
-        retry:
-            cur = cfl_list_entry(head, struct cfl_split_entry, _head);
-            label_kv = cur->value;
+    total = 0;
 
-            colon = strchr(label_kv, ':');
-            if (colon == NULL) {
-                goto retry;
-            }
-            label_k = cfl_sds_create_len(label_kv, colon - label_kv);
-            if (label_k == NULL) {
-                for (label_index = 0 ; label_index < 128 ; label_index++) {
-                    if (value_index_list[label_index] != NULL) {
-                        cfl_sds_destroy(value_index_list[label_index]);
-                    }
-                }
+    for (index = 0 ; index <= context->bucket_count ; index++) {
+        if (series->buckets != NULL) {
+            total += series->buckets[index];
+        }
 
-                free(value_index_list);
+        cmt_metric_hist_set(metric, ts, index, round(total));
+    }
 
-                if (kvs != NULL) {
-                    cfl_utils_split_free(kvs);
-                }
+    cmt_metric_hist_count_set(metric, ts, (uint64_t) round(total));
+    cmt_metric_hist_sum_set(metric, ts, series->sum);
 
-                return CMT_DECODE_STATSD_INVALID_TAG_FORMAT_ERROR;
-            }
-            label_v = cfl_sds_create_len(colon + 1, strlen(label_kv) - strlen(label_k) - 1);
-            if (label_v == NULL) {
-                cfl_sds_destroy(label_k);
+    return CMT_DECODE_STATSD_SUCCESS;
+}
 
-                for (label_index = 0 ; label_index < 128 ; label_index++) {
-                    if (value_index_list[label_index] != NULL) {
-                        cfl_sds_destroy(value_index_list[label_index]);
-                    }
-                }
+static uint64_t *exp_buckets_round(struct statsd_exp_buckets *buckets,
+                                   uint64_t *count)
+{
+    size_t    index;
+    uint64_t *counts;
 
-                free(value_index_list);
+    counts = calloc(buckets->count, sizeof(uint64_t));
 
-                if (kvs != NULL) {
-                    cfl_utils_split_free(kvs);
-                }
+    if (counts == NULL) {
+        cmt_errno();
 
-                return CMT_DECODE_STATSD_INVALID_TAG_FORMAT_ERROR;
-            }
+        return NULL;
+    }
 
-            cfl_list_foreach(label_iterator, &map->label_keys) {
-                current_label = cfl_list_entry(label_iterator, struct cmt_map_label, _head);
+    for (index = 0 ; index < buckets->count ; index++) {
+        counts[index] = (uint64_t) round(buckets->counts[index]);
+        *count += counts[index];
+    }
 
-                if (strcmp(current_label->name, label_k) == 0) {
-                    label_found = CMT_TRUE;
+    return counts;
+}
 
-                    break;
-                }
+static int exp_histogram_metric_set(struct cmt_metric *metric,
+                                    struct statsd_series *series, uint64_t ts)
+{
+    uint64_t                     count;
+    uint64_t                    *positive;
+    uint64_t                    *negative;
+    struct statsd_exp_histogram *histogram;
 
-                label_index++;
-            }
+    histogram = series->exp_histogram;
 
-            if (label_index > 127) {
-                cfl_sds_destroy(label_k);
-                cfl_sds_destroy(label_v);
+    if (histogram == NULL) {
+        cmt_metric_set_exp_hist_count(metric, 0);
+        cmt_metric_set_exp_hist_sum(metric, CMT_TRUE, 0);
+        cmt_metric_set_timestamp(metric, ts);
 
-                for (label_index = 0 ; label_index < 128 ; label_index++) {
-                    if (value_index_list[label_index] != NULL) {
-                        cfl_sds_destroy(value_index_list[label_index]);
-                    }
-                }
+        return CMT_DECODE_STATSD_SUCCESS;
+    }
 
-                free(value_index_list);
+    count = (uint64_t) round(histogram->zero_count);
+    positive = NULL;
+    negative = NULL;
 
-                if (kvs != NULL) {
-                    cfl_utils_split_free(kvs);
-                }
+    if (histogram->positive.count > 0) {
+        positive = exp_buckets_round(&histogram->positive, &count);
 
-                return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
-            }
+        if (positive == NULL) {
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+        }
+    }
 
-            if (label_found == CMT_FALSE) {
-                result = append_new_map_label_key(map, label_k);
-            }
+    if (histogram->negative.count > 0) {
+        negative = exp_buckets_round(&histogram->negative, &count);
 
-            if (result == CMT_DECODE_STATSD_SUCCESS) {
-                value_index_list[label_index] = (void *) cfl_sds_create_len(label_v,
-                                                                            cfl_sds_len(label_v));
-            }
+        if (negative == NULL) {
+            free(positive);
 
-            cfl_sds_destroy(label_k);
-            cfl_sds_destroy(label_v);
+            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
         }
     }
 
-split_error: /* Nop for adding labels */
-
-    map_label_count = cfl_list_size(&map->label_keys);
+    metric->exp_hist_scale = histogram->scale;
+    metric->exp_hist_zero_count = (uint64_t) round(histogram->zero_count);
+    metric->exp_hist_zero_threshold = 0;
+    metric->exp_hist_positive_offset = histogram->positive.offset;
+    metric->exp_hist_positive_buckets = positive;
+    metric->exp_hist_positive_count = histogram->positive.count;
+    metric->exp_hist_negative_offset = histogram->negative.offset;
+    metric->exp_hist_negative_buckets = negative;
+    metric->exp_hist_negative_count = histogram->negative.count;
 
-    for (map_label_index = 0 ;
-         result == CMT_DECODE_STATSD_SUCCESS &&
-         map_label_index < map_label_count ;
-         map_label_index++) {
+    cmt_metric_set_exp_hist_count(metric, count);
+    cmt_metric_set_exp_hist_sum(metric, CMT_TRUE, series->sum);
+    cmt_metric_set_timestamp(metric, ts);
 
-        if (value_index_list[map_label_index] != NULL) {
-            label_v = (char *) value_index_list[map_label_index];
-            result = append_new_metric_label_value(metric, label_v, 0);
-        }
-    }
+    return CMT_DECODE_STATSD_SUCCESS;
+}
 
-    for (label_index = 0 ; label_index < 128 ; label_index++) {
-        if (value_index_list[label_index] != NULL) {
-            cfl_sds_destroy(value_index_list[label_index]);
+static int series_metric_set(struct statsd_context *context,
+                             struct cmt_map *map, struct cmt_metric *metric,
+                             struct statsd_series *series, uint64_t ts)
+{
+    switch (map->type) {
+    case CMT_HISTOGRAM:
+        return histogram_metric_set(context, metric, series, ts);
+    case CMT_EXP_HISTOGRAM:
+        return exp_histogram_metric_set(metric, series, ts);
+    default:
+        if (series->hll != NULL) {
+            /* the metric takes the sketch so contexts can still be merged */
+            series->value = cmt_hll_estimate(series->hll);
+            metric->hll = series->hll;
+            series->hll = NULL;
         }
-    }
 
-    free(value_index_list);
-
-    if (kvs != NULL) {
-        cfl_utils_split_free(kvs);
+        cmt_metric_set(metric, ts, series->value);
     }
 
-    return result;
+    return CMT_DECODE_STATSD_SUCCESS;
 }
 
-static int decode_numerical_message(struct cmt *cmt,
-                                    struct cmt_map *map,
-                                    struct cmt_statsd_message *m)
+/*
+ * Series are unique at this point, so they are appended to the metric list
+ * directly instead of going through a map lookup, the maps are reindexed once
+ * all of them are in place.
+ */
+static int series_metric_create(struct statsd_context *context,
+                                 struct cmt_map *map, struct statsd_series *series,
+                                 int incremental, uint64_t ts)
 {
-    struct cmt_metric *metric;
     int                result;
-    uint64_t           ts;
-    int                incremental = 0;
+    size_t             index;
+    struct cmt_metric *metric;
 
-    ts = cfl_time_now();
+    if (map->label_count == 0) {
+        map->metric_static_set = CMT_TRUE;
 
-    result = CMT_DECODE_STATSD_SUCCESS;
+        return series_metric_set(context, map, &map->metric, series, ts);
+    }
 
     metric = calloc(1, sizeof(struct cmt_metric));
 
     if (metric == NULL) {
+        cmt_errno();
+
         return CMT_DECODE_STATSD_ALLOCATION_ERROR;
     }
 
     cfl_list_init(&metric->labels);
+    cfl_list_init(&metric->_hash_head);
 
-    incremental = is_incremental(m->value);
-
-    result = decode_labels(cmt,
-                           map,
-                           metric,
-                           m->labels,
-                           incremental);
-
-    if (result) {
-        destroy_label_list(&metric->labels);
+    result = CMT_DECODE_STATSD_SUCCESS;
 
-        free(metric);
+    if (incremental) {
+        result = append_label_value(metric, "true");
     }
-    else {
-        cfl_list_add(&metric->_head, &map->metrics);
+
+    for (index = 0 ;
+         result == CMT_DECODE_STATSD_SUCCESS &&
+         index < series->family->label_count ;
+         index++) {
+        result = append_label_value(metric, series->values[index]);
     }
 
     if (result == CMT_DECODE_STATSD_SUCCESS) {
-        if ((m->sample_rate - 0.0) > DBL_EPSILON &&
-            (1.0 - m->sample_rate) > DBL_EPSILON) {
-            cmt_metric_set(metric, ts, strtod(m->value, NULL) / m->sample_rate);
-        }
-        else {
-            cmt_metric_set(metric, ts, strtod(m->value, NULL));
-        }
+        result = series_metric_set(context, map, metric, series, ts);
     }
 
-    return result;
-}
-
-static int decode_counter_entry(struct cmt *cmt,
-                                void *instance,
-                                struct cmt_statsd_message *m)
-{
-    struct cmt_counter *counter;
-    int                 result;
-
-    result = CMT_DECODE_STATSD_SUCCESS;
-
-    counter = (struct cmt_counter *) instance;
+    if (result != CMT_DECODE_STATSD_SUCCESS) {
+        destroy_label_list(&metric->labels);
+        free(metric->hist_buckets);
+        free(metric);
 
-    counter->map->metric_static_set = 0;
+        return result;
+    }
 
-    result = decode_numerical_message(cmt,
-                                      counter->map,
-                                      m);
+    cfl_list_add(&metric->_head, &map->metrics);
 
-    return result;
+    return CMT_DECODE_STATSD_SUCCESS;
 }
 
-static int decode_gauge_entry(struct cmt *cmt,
-                              void *instance,
-                              struct cmt_statsd_message *m)
+/* Create the metric families and series of the aggregated lines */
+static int flush_series(struct statsd_context *context)
 {
-    struct cmt_gauge *gauge;
-    int               result;
+    int                   result;
+    int                   incremental;
+    uint64_t              ts;
+    struct cfl_list      *head;
+    struct statsd_family *family;
+    struct statsd_series *series;
 
-    result = CMT_DECODE_STATSD_SUCCESS;
-
-    gauge = (struct cmt_gauge *) instance;
-
-    gauge->map->metric_static_set = 0;
+    ts = cfl_time_now();
 
-    result = decode_numerical_message(cmt,
-                                      gauge->map,
-                                      m);
+    cfl_list_foreach(head, &context->series) {
+        series = cfl_list_entry(head, struct statsd_series, _head);
+        family = series->family;
+        incremental = series->incremental ? 1 : 0;
 
-    return result;
-}
+        if (family->maps[incremental] == NULL) {
+            result = family_instance_create(context, family, incremental);
 
-static int decode_untyped_entry(struct cmt *cmt,
-                                void *instance,
-                                struct cmt_statsd_message *m)
-{
-    struct cmt_untyped *untyped;
-    int                 result;
+            if (result != CMT_DECODE_STATSD_SUCCESS) {
+                return result;
+            }
+        }
 
-    result = CMT_DECODE_STATSD_SUCCESS;
+        result = series_metric_create(context, family->maps[incremental],
+                                      series, incremental, ts);
 
-    untyped = (struct cmt_untyped *) instance;
+        if (result != CMT_DECODE_STATSD_SUCCESS) {
+            return result;
+        }
+    }
 
-    untyped->map->metric_static_set = 0;
+    cfl_list_foreach(head, &context->families) {
+        family = cfl_list_entry(head, struct statsd_family, _head);
 
-    result = decode_numerical_message(cmt,
-                                      untyped->map,
-                                      m);
+        for (incremental = 0 ; incremental < 2 ; incremental++) {
+            if (family->maps[incremental] != NULL) {
+                cmt_map_reindex(family->maps[incremental]);
+            }
+        }
+    }
 
-    return result;
+    return CMT_DECODE_STATSD_SUCCESS;
 }
 
-static int decode_statsd_message(struct cmt *cmt,
-                                 struct cmt_statsd_message *m,
-                                 int flags)
+static double default_buckets[] = { CMT_DECODE_STATSD_DEFAULT_BUCKETS };
+
+static int context_init(struct statsd_context *context, struct cmt *cmt,
+                        struct cmt_decode_statsd_opts *opts)
 {
-    char *metric_name = NULL;
-    char *metric_subsystem   = NULL;
-    char *metric_namespace   = NULL;
-    char *metric_description = NULL;
-    void *instance;
-    int   result;
+    size_t index;
 
-    result = CMT_DECODE_STATSD_SUCCESS;
+    memset(context, 0, sizeof(struct statsd_context));
 
-    metric_description = "-";
-    metric_name = cfl_sds_create_len(m->bucket, m->bucket_len);
-    if (metric_name == NULL) {
-        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
-    }
-    metric_namespace = "";
-    metric_subsystem = "";
+    context->cmt = cmt;
+    context->flags = opts->flags;
+    context->buckets = default_buckets;
+    context->bucket_count = sizeof(default_buckets) / sizeof(double);
+    context->exp_histogram_max_buckets = CMT_DECODE_STATSD_EXP_HISTOGRAM_MAX_BUCKETS;
 
-    switch (m->type) {
-    case CMT_DECODE_STATSD_TYPE_COUNTER:
-        instance = cmt_counter_create(cmt,
-                                      metric_namespace,
-                                      metric_subsystem,
-                                      metric_name,
-                                      metric_description,
-                                      0, NULL);
-
-        if (instance == NULL) {
-            cfl_sds_destroy(metric_name);
-            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+    if (opts->buckets != NULL && opts->bucket_count > 0) {
+        for (index = 1 ; index < opts->bucket_count ; index++) {
+            if (!(opts->buckets[index - 1] < opts->buckets[index])) {
+                return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+            }
         }
 
-        result = decode_counter_entry(cmt, instance, m);
+        context->buckets = opts->buckets;
+        context->bucket_count = opts->bucket_count;
+    }
 
-        if (result) {
-            cfl_sds_destroy(metric_name);
-            cmt_counter_destroy(instance);
-        }
-        break;
-    case CMT_DECODE_STATSD_TYPE_GAUGE:
-        instance = cmt_gauge_create(cmt,
-                                    metric_namespace,
-                                    metric_subsystem,
-                                    metric_name,
-                                    metric_description,
-                                    0, NULL);
-
-        if (instance == NULL) {
-            cfl_sds_destroy(metric_name);
-            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
-        }
+    if (opts->exp_histogram_max_buckets > 0) {
+        context->exp_histogram_max_buckets = opts->exp_histogram_max_buckets;
+    }
 
-        result = decode_gauge_entry(cmt, instance, m);
+    cfl_list_init(&context->families);
+    cfl_list_init(&context->series);
+    cfl_list_init(&context->aliases);
 
-        if (result) {
-            cfl_sds_destroy(metric_name);
-            cmt_gauge_destroy(instance);
-        }
-        break;
-    case CMT_DECODE_STATSD_TYPE_SET:
-        /* Set type will be translated as an untyped */
-        instance = cmt_untyped_create(cmt,
-                                      metric_namespace,
-                                      metric_subsystem,
-                                      metric_name,
-                                      metric_description,
-                                      0, NULL);
-
-        if (instance == NULL) {
-            cfl_sds_destroy(metric_name);
-            return CMT_DECODE_STATSD_ALLOCATION_ERROR;
-        }
+    if (table_init(&context->family_table) != 0 ||
+        table_init(&context->series_table) != 0 ||
+        table_init(&context->alias_table) != 0) {
+        free(context->family_table.slots);
+        free(context->series_table.slots);
+
+        return CMT_DECODE_STATSD_ALLOCATION_ERROR;
+    }
 
-        result = decode_untyped_entry(cmt, instance, m);
+    return CMT_DECODE_STATSD_SUCCESS;
+}
 
-        if (result) {
-            cfl_sds_destroy(metric_name);
-            cmt_untyped_destroy(instance);
-        }
-        break;
-    case CMT_DECODE_STATSD_TYPE_TIMER:
-        /* TODO: Add histogram observer */
-        if (flags & CMT_DECODE_STATSD_GAUGE_OBSERVER) {
-            instance = cmt_gauge_create(cmt,
-                                        metric_namespace,
-                                        metric_subsystem,
-                                        metric_name,
-                                        metric_description,
-                                        0, NULL);
-
-            if (instance == NULL) {
-                cfl_sds_destroy(metric_name);
-                return CMT_DECODE_STATSD_ALLOCATION_ERROR;
-            }
+static void context_destroy(struct statsd_context *context)
+{
+    struct cfl_list      *head;
+    struct cfl_list      *tmp;
+    struct statsd_family *family;
+    struct statsd_series *series;
+    struct statsd_alias  *alias;
+
+    cfl_list_foreach_safe(head, tmp, &context->aliases) {
+        alias = cfl_list_entry(head, struct statsd_alias, _head);
+        cfl_list_del(&alias->_head);
+        free(alias);
+    }
 
-            result = decode_gauge_entry(cmt, instance, m);
+    cfl_list_foreach_safe(head, tmp, &context->series) {
+        series = cfl_list_entry(head, struct statsd_series, _head);
+        cfl_list_del(&series->_head);
 
-            if (result) {
-                cfl_sds_destroy(metric_name);
-                cmt_gauge_destroy(instance);
-            }
+        if (series->exp_histogram != NULL) {
+            free(series->exp_histogram->positive.counts);
+            free(series->exp_histogram->negative.counts);
+            free(series->exp_histogram);
         }
-        break;
-    default:
-        result = CMT_DECODE_STATSD_UNSUPPORTED_METRIC_TYPE;
-        break;
+
+        cmt_hll_destroy(series->hll);
+        free(series->buckets);
+        free(series);
     }
 
-    cfl_sds_destroy(metric_name);
+    cfl_list_foreach_safe(head, tmp, &context->families) {
+        family = cfl_list_entry(head, struct statsd_family, _head);
+        cfl_list_del(&family->_head);
+        free(family);
+    }
 
-    return result;
+    free(context->family_table.slots);
+    free(context->series_table.slots);
+    free(context->alias_table.slots);
 }
 
-static int cmt_get_statsd_type(char *str)
+static int cmt_get_statsd_type(char *str, size_t length)
 {
+    if (length == 0) {
+        return CMT_DECODE_STATSD_TYPE_COUNTER;
+    }
+
     switch (*str) {
     case 'g':
         return CMT_DECODE_STATSD_TYPE_GAUGE;
@@ -501,94 +1488,126 @@ static int cmt_get_statsd_type(char *str)
         return CMT_DECODE_STATSD_TYPE_SET;
     case 'c':
         return CMT_DECODE_STATSD_TYPE_COUNTER;
+    case 'h':
+        return CMT_DECODE_STATSD_TYPE_HISTOGRAM;
+    case 'd':
+        return CMT_DECODE_STATSD_TYPE_DISTRIBUTION;
     case 'm':
-        if (*(str + 1) == 's') {
+        if (length > 1 && *(str + 1) == 's') {
             return CMT_DECODE_STATSD_TYPE_TIMER;
         }
     }
     return CMT_DECODE_STATSD_TYPE_COUNTER;
 }
 
-static int statsd_process_line(struct cmt *cmt, char *line, int flags)
+/*
+ * Scan a single line in place, the message only points to slices of the
+ * line, which is not NUL terminated.
+ */
+static int statsd_process_line(struct statsd_context *context,
+                               char *line, size_t length)
 {
-    char *colon = NULL, *bar = NULL, *atmark = NULL, *labels = NULL;
+    char  *end;
+    char  *colon;
+    char  *bar;
+    char  *field;
+    double sample_rate;
     struct cmt_statsd_message m = {0};
 
+    end = line + length;
+
+    /* StatsD format always has | at least one. */
+    bar = memchr(line, '|', length);
+    if (bar == NULL) {
+        return CMT_DECODE_STATSD_SUCCESS;
+    }
+
     /*
      * bucket:value|type|@sample_rate|#key1:value1,key2:value2,...
-     * ------
+     * ------ -----
      */
-    colon = strchr(line, ':');
-    if (colon == NULL) {
+    colon = memchr(line, ':', bar - line);
+
+    /* a metric cannot be created without a name */
+    if (colon == NULL || colon == line) {
         return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
     }
     m.bucket = line;
     m.bucket_len = (colon - line);
+    m.value = colon + 1;
+    m.value_len = (bar - colon - 1);
+    m.sample_rate = 1.0;
 
     /*
      * bucket:value|type|@sample_rate|#key1:value1,key2:value2,...
      *              ----
      */
-    bar = strchr(colon + 1, '|');
+    field = bar + 1;
+    bar = memchr(field, '|', end - field);
     if (bar == NULL) {
-        return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+        bar = end;
     }
-    m.type = cmt_get_statsd_type(bar + 1);
+    m.type = cmt_get_statsd_type(field, bar - field);
 
     /*
      * bucket:value|type|@sample_rate|#key1:value1,key2:value2,...
-     *        -----
+     *                   ------------ ------------------------------
+     * other extensions (container id, timestamp) are skipped
      */
-    m.value = colon + 1;
-    m.value_len = (bar - colon - 1);
+    while (bar < end) {
+        field = bar + 1;
+        bar = memchr(field, '|', end - field);
+        if (bar == NULL) {
+            bar = end;
+        }
 
-    /*
-     * bucket:value|type|@sample_rate|#key1:value1,key2:value2,...
-     *                   ------------
-     */
-    atmark = strstr(bar + 1, "|@");
-    if (atmark == NULL || atof(atmark + 2) == 0) {
-        m.sample_rate = 1.0;
-    }
-    else {
-        m.sample_rate = atof(atmark + 2);
-    }
+        if (field == bar) {
+            continue;
+        }
 
-    /*
-     * bucket:value|type|@sample_rate|#key1:value1,key2:value2,...
-     *                                ------------
-     */
-    labels = strstr(bar + 1, "|#");
-    if (labels != NULL) {
-        m.labels = labels + 2;
+        if (*field == '@') {
+            if (cmt_math_parse_double(field + 1, bar - field - 1,
+                                      &sample_rate) == 0 &&
+                sample_rate > 0) {
+                m.sample_rate = sample_rate;
+            }
+        }
+        else if (*field == '#') {
+            m.labels = field + 1;
+            m.labels_len = (bar - field - 1);
+        }
     }
 
-    return decode_statsd_message(cmt, &m, flags);
+    return decode_statsd_message(context, &m);
 }
 
-static int decode_metrics_lines(struct cmt *cmt,
-                                char *in_buf, size_t in_size,
-                                int flags)
+static int decode_metrics_lines(struct statsd_context *context,
+                                char *in_buf, size_t in_size)
 {
-    int ret = CMT_DECODE_STATSD_SUCCESS;
-    struct cfl_list *head = NULL;
-    struct cfl_list *kvs = NULL;
-    struct cfl_split_entry *cur = NULL;
-
-    kvs = cfl_utils_split(in_buf, '\n', -1 );
-    if (kvs == NULL) {
-        goto split_error;
+    int     ret = CMT_DECODE_STATSD_SUCCESS;
+    char   *end;
+    char   *line;
+    char   *newline;
+    size_t  length;
+
+    /* the input might be NUL terminated */
+    end = memchr(in_buf, '\0', in_size);
+    if (end == NULL) {
+        end = in_buf + in_size;
     }
 
-    cfl_list_foreach(head, kvs) {
-retry:
-        cur = cfl_list_entry(head, struct cfl_split_entry, _head);
-        /* StatsD format always has | at least one. */
-        if (strstr(cur->value, "|") == NULL) {
-            goto retry;
+    for (line = in_buf ; line < end ; line = newline + 1) {
+        newline = memchr(line, '\n', end - line);
+        if (newline == NULL) {
+            newline = end;
+        }
+
+        length = newline - line;
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
         }
 
-        ret = statsd_process_line(cmt, cur->value, flags);
+        ret = statsd_process_line(context, line, length);
         if (ret != CMT_DECODE_STATSD_SUCCESS) {
             ret = CMT_DECODE_STATSD_DECODE_ERROR;
 
@@ -596,20 +1615,16 @@ retry:
         }
     }
 
-    if (kvs != NULL) {
-        cfl_utils_split_free(kvs);
-    }
-
     return ret;
-
-split_error:
-    return -1;
 }
 
-int cmt_decode_statsd_create(struct cmt **out_cmt, char *in_buf, size_t in_size, int flags)
+int cmt_decode_statsd_create_with_opts(struct cmt **out_cmt,
+                                       char *in_buf, size_t in_size,
+                                       struct cmt_decode_statsd_opts *opts)
 {
-    int         result = CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
-    struct cmt *cmt    = NULL;
+    int                   result = CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+    struct cmt           *cmt    = NULL;
+    struct statsd_context context;
 
     cmt = cmt_create();
 
@@ -617,7 +1632,20 @@ int cmt_decode_statsd_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
         return CMT_DECODE_STATSD_ALLOCATION_ERROR;
     }
 
-    result = decode_metrics_lines(cmt, in_buf, in_size, flags);
+    result = context_init(&context, cmt, opts);
+    if (result != CMT_DECODE_STATSD_SUCCESS) {
+        cmt_destroy(cmt);
+
+        return result;
+    }
+
+    result = decode_metrics_lines(&context, in_buf, in_size);
+    if (result == CMT_DECODE_STATSD_SUCCESS) {
+        result = flush_series(&context);
+    }
+
+    context_destroy(&context);
+
     if (result != CMT_DECODE_STATSD_SUCCESS) {
         cmt_destroy(cmt);
         result = CMT_DECODE_STATSD_DECODE_ERROR;
@@ -630,6 +1658,49 @@ int cmt_decode_statsd_create(struct cmt **out_cmt, char *in_buf, size_t in_size,
     return result;
 }
 
+int cmt_decode_statsd_create(struct cmt **out_cmt, char *in_buf, size_t in_size, int flags)
+{
+    struct cmt_decode_statsd_opts opts = {0};
+
+    opts.flags = flags;
+
+    return cmt_decode_statsd_create_with_opts(out_cmt, in_buf, in_size, &opts);
+}
+
+int cmt_decode_statsd_merge_with_opts(struct cmt *dst,
+                                      char *in_buf, size_t in_size,
+                                      struct cmt_decode_statsd_opts *opts)
+{
+    int         result;
+    struct cmt *cmt;
+
+    if (dst == NULL) {
+        return CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR;
+    }
+
+    result = cmt_decode_statsd_create_with_opts(&cmt, in_buf, in_size, opts);
+    if (result != CMT_DECODE_STATSD_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_cat_move(dst, cmt) != 0) {
+        result = CMT_DECODE_STATSD_MERGE_ERROR;
+    }
+
+    cmt_destroy(cmt);
+
+    return result;
+}
+
+int cmt_decode_statsd_merge(struct cmt *dst, char *in_buf, size_t in_size, int flags)
+{
+    struct cmt_decode_statsd_opts opts = {0};
+
+    opts.flags = flags;
+
+    return cmt_decode_statsd_merge_with_opts(dst, in_buf, in_size, &opts);
+}
+
 void cmt_decode_statsd_destroy(struct cmt *cmt)
 {
     cmt_destroy(cmt);
@@ -0,0 +1,544 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_math.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_summary.h>
+#include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
+#include <cmetrics/cmt_atomic.h>
+#include <cmetrics/cmt_encode_graphite.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+/*
+ * Graphite plaintext protocol
+ * ---------------------------
+ * https://graphite.readthedocs.io/en/latest/feeding-carbon.html
+ * https://graphite.readthedocs.io/en/latest/tags.html
+ */
+
+/* pickle opcodes, see Lib/pickletools.py */
+#define PICKLE_PROTO       0x80
+#define PICKLE_EMPTY_LIST  ']'
+#define PICKLE_MARK        '('
+#define PICKLE_APPENDS     'e'
+#define PICKLE_BINUNICODE  'X'
+#define PICKLE_BININT      'J'
+#define PICKLE_LONG1       0x8a
+#define PICKLE_BINFLOAT    'G'
+#define PICKLE_TUPLE2      0x86
+#define PICKLE_STOP        '.'
+
+/* the Python pickler appends list items in batches of this size */
+#define PICKLE_BATCH_SIZE  1000
+
+struct graphite_writer {
+    struct cmt *cmt;
+    int         pickle;
+    cfl_sds_t   buf;
+
+    /* dotted path of the current family and tags of the current series */
+    cfl_sds_t   path;
+    cfl_sds_t   tags;
+    uint64_t    timestamp;
+
+    /* items appended since the last APPENDS */
+    size_t      batch;
+};
+
+/* Append 'length' bytes and replace the characters graphite reserves */
+static void append_sanitized(cfl_sds_t *buf, const char *str, size_t length,
+                             int tag_key)
+{
+    size_t  index;
+    size_t  offset;
+    char   *out;
+
+    offset = cfl_sds_len(*buf);
+    cfl_sds_cat_safe(buf, str, length);
+
+    if (cfl_sds_len(*buf) != offset + length) {
+        return;
+    }
+
+    out = *buf + offset;
+
+    for (index = 0 ; index < length ; index++) {
+        if (out[index] == ' ' || out[index] == ';' || out[index] == '\n' ||
+            (tag_key && (out[index] == '=' || out[index] == '!' ||
+                         out[index] == '^')) ||
+            (!tag_key && index == 0 && out[index] == '~')) {
+            out[index] = '_';
+        }
+    }
+}
+
+static void append_tag(cfl_sds_t *buf, const char *key, size_t key_length,
+                       const char *value, size_t value_length)
+{
+    if (key_length == 0 || value_length == 0) {
+        return;
+    }
+
+    cfl_sds_cat_safe(buf, ";", 1);
+    append_sanitized(buf, key, key_length, CMT_TRUE);
+    cfl_sds_cat_safe(buf, "=", 1);
+    append_sanitized(buf, value, value_length, CMT_FALSE);
+}
+
+static void family_path(struct graphite_writer *writer, struct cmt_map *map)
+{
+    struct cmt_opts *opts;
+
+    opts = map->opts;
+    cfl_sds_len_set(writer->path, 0);
+
+    if (cfl_sds_len(opts->ns) > 0) {
+        append_sanitized(&writer->path, opts->ns, cfl_sds_len(opts->ns),
+                         CMT_FALSE);
+        cfl_sds_cat_safe(&writer->path, ".", 1);
+    }
+
+    if (cfl_sds_len(opts->subsystem) > 0) {
+        append_sanitized(&writer->path, opts->subsystem,
+                         cfl_sds_len(opts->subsystem), CMT_FALSE);
+        cfl_sds_cat_safe(&writer->path, ".", 1);
+    }
+
+    append_sanitized(&writer->path, opts->name, cfl_sds_len(opts->name),
+                     CMT_FALSE);
+}
+
+static void series_tags(struct graphite_writer *writer, struct cmt_map *map,
+                        struct cmt_metric *metric)
+{
+    struct cfl_list      *head;
+    struct cmt_label     *slabel;
+    struct cmt_map_label *label_k;
+    struct cmt_map_label *label_v;
+
+    cfl_sds_len_set(writer->tags, 0);
+
+    cfl_list_foreach(head, &writer->cmt->static_labels->list) {
+        slabel = cfl_list_entry(head, struct cmt_label, _head);
+        append_tag(&writer->tags, slabel->key, cfl_sds_len(slabel->key),
+                   slabel->val, cfl_sds_len(slabel->val));
+    }
+
+    if (cfl_list_is_empty(&metric->labels)) {
+        return;
+    }
+
+    label_k = cfl_list_entry_first(&map->label_keys, struct cmt_map_label, _head);
+
+    cfl_list_foreach(head, &metric->labels) {
+        label_v = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label_k->name != NULL && label_v->name != NULL) {
+            append_tag(&writer->tags, label_k->name, cfl_sds_len(label_k->name),
+                       label_v->name, cfl_sds_len(label_v->name));
+        }
+
+        if (label_k->_head.next == &map->label_keys) {
+            break;
+        }
+
+        label_k = cfl_list_entry_next(&label_k->_head, struct cmt_map_label,
+                                      _head, &map->label_keys);
+    }
+}
+
+/* Bucket bounds and quantiles use the shortest form that reads back exactly */
+static void format_bound(char *out, double val)
+{
+    if (isinf(val)) {
+        strcpy(out, val > 0 ? "+Inf" : "-Inf");
+        return;
+    }
+
+    snprintf(out, CMT_MATH_FORMAT_SIZE, "%g", val);
+
+    if (strtod(out, NULL) != val) {
+        snprintf(out, CMT_MATH_FORMAT_SIZE, "%.17g", val);
+    }
+}
+
+static void pickle_append(cfl_sds_t *buf, int opcode, const void *data,
+                          size_t length)
+{
+    char op;
+
+    op = (char) opcode;
+    cfl_sds_cat_safe(buf, &op, 1);
+
+    if (length > 0) {
+        cfl_sds_cat_safe(buf, data, length);
+    }
+}
+
+static void pickle_item(struct graphite_writer *writer, const char *suffix,
+                        size_t suffix_length, const char *extra,
+                        size_t extra_length, double val)
+{
+    int            index;
+    size_t         length;
+    uint8_t        bytes[8];
+    uint64_t       bits;
+    int64_t        timestamp;
+    union val_union u;
+
+    if (writer->batch == 0) {
+        pickle_append(&writer->buf, PICKLE_MARK, NULL, 0);
+    }
+
+    length = cfl_sds_len(writer->path) + suffix_length +
+             cfl_sds_len(writer->tags) + extra_length;
+
+    for (index = 0 ; index < 4 ; index++) {
+        bytes[index] = (length >> (index * 8)) & 0xff;
+    }
+
+    pickle_append(&writer->buf, PICKLE_BINUNICODE, bytes, 4);
+    cfl_sds_cat_safe(&writer->buf, writer->path, cfl_sds_len(writer->path));
+
+    /* plain series have neither a suffix nor an extra tag */
+    if (suffix_length > 0) {
+        cfl_sds_cat_safe(&writer->buf, suffix, suffix_length);
+    }
+
+    cfl_sds_cat_safe(&writer->buf, writer->tags, cfl_sds_len(writer->tags));
+
+    if (extra_length > 0) {
+        cfl_sds_cat_safe(&writer->buf, extra, extra_length);
+    }
+
+    /* BININT holds a signed 32 bit value, later timestamps need a LONG1 */
+    timestamp = (int64_t) writer->timestamp;
+
+    if (timestamp <= INT32_MAX) {
+        for (index = 0 ; index < 4 ; index++) {
+            bytes[index] = ((uint64_t) timestamp >> (index * 8)) & 0xff;
+        }
+
+        pickle_append(&writer->buf, PICKLE_BININT, bytes, 4);
+    }
+    else {
+        bytes[0] = 8;
+        pickle_append(&writer->buf, PICKLE_LONG1, bytes, 1);
+
+        for (index = 0 ; index < 8 ; index++) {
+            bytes[index] = ((uint64_t) timestamp >> (index * 8)) & 0xff;
+        }
+
+        cfl_sds_cat_safe(&writer->buf, (char *) bytes, 8);
+    }
+
+    /* BINFLOAT is big endian */
+    u.d = val;
+    bits = u.u;
+
+    for (index = 0 ; index < 8 ; index++) {
+        bytes[index] = (bits >> ((7 - index) * 8)) & 0xff;
+    }
+
+    pickle_append(&writer->buf, PICKLE_BINFLOAT, bytes, 8);
+    pickle_append(&writer->buf, PICKLE_TUPLE2, NULL, 0);
+    pickle_append(&writer->buf, PICKLE_TUPLE2, NULL, 0);
+
+    writer->batch++;
+
+    if (writer->batch == PICKLE_BATCH_SIZE) {
+        pickle_append(&writer->buf, PICKLE_APPENDS, NULL, 0);
+        writer->batch = 0;
+    }
+}
+
+/*
+ * Write one series, 'suffix' is appended to the family path and 'extra_key'
+ * (an 'le' or 'quantile' tag) after the series tags.
+ */
+static void emit(struct graphite_writer *writer, const char *suffix,
+                 const char *extra_key, double extra_value, double val)
+{
+    size_t  length;
+    size_t  suffix_length;
+    size_t  extra_length;
+    char    extra[64];
+    char    number[CMT_MATH_FORMAT_SIZE];
+
+    suffix_length = suffix != NULL ? strlen(suffix) : 0;
+    extra_length = 0;
+
+    if (extra_key != NULL) {
+        format_bound(number, extra_value);
+        extra_length = snprintf(extra, sizeof(extra), ";%s=%s",
+                                extra_key, number);
+    }
+
+    if (writer->pickle) {
+        pickle_item(writer, suffix, suffix_length, extra, extra_length, val);
+        return;
+    }
+
+    cfl_sds_cat_safe(&writer->buf, writer->path, cfl_sds_len(writer->path));
+
+    if (suffix_length > 0) {
+        cfl_sds_cat_safe(&writer->buf, suffix, suffix_length);
+    }
+
+    cfl_sds_cat_safe(&writer->buf, writer->tags, cfl_sds_len(writer->tags));
+
+    if (extra_length > 0) {
+        cfl_sds_cat_safe(&writer->buf, extra, extra_length);
+    }
+
+    number[0] = ' ';
+    length = 1 + cmt_math_format_double(&number[1], val);
+    cfl_sds_cat_safe(&writer->buf, number, length);
+
+    number[0] = ' ';
+    length = 1 + cmt_math_format_uint64(&number[1], writer->timestamp);
+    number[length++] = '\n';
+    cfl_sds_cat_safe(&writer->buf, number, length);
+}
+
+static void emit_histogram(struct graphite_writer *writer,
+                           struct cmt_histogram_buckets *buckets,
+                           uint64_t *counts, uint64_t count, double sum)
+{
+    size_t index;
+
+    for (index = 0 ; index <= buckets->count ; index++) {
+        emit(writer, ".bucket", "le",
+             index < buckets->count ? buckets->upper_bounds[index] : INFINITY,
+             (double) counts[index]);
+    }
+
+    emit(writer, ".sum", NULL, 0, sum);
+    emit(writer, ".count", NULL, 0, (double) count);
+}
+
+static void format_metric(struct graphite_writer *writer, struct cmt_map *map,
+                          struct cmt_metric *metric)
+{
+    size_t                        index;
+    size_t                        bucket_count;
+    size_t                        upper_bounds_count;
+    uint64_t                     *bucket_values;
+    double                       *upper_bounds;
+    struct cmt_summary           *summary;
+    struct cmt_histogram         *histogram;
+    struct cmt_histogram_buckets  buckets;
+
+    writer->timestamp = cmt_metric_get_timestamp(metric) / 1000000000;
+    series_tags(writer, map, metric);
+
+    if (map->type == CMT_HISTOGRAM) {
+        histogram = (struct cmt_histogram *) map->parent;
+
+        /* bucket values are read one by one, they are atomics */
+        bucket_values = malloc(sizeof(uint64_t) * (histogram->buckets->count + 1));
+        if (bucket_values == NULL) {
+            cmt_errno();
+            return;
+        }
+
+        for (index = 0 ; index <= histogram->buckets->count ; index++) {
+            bucket_values[index] = cmt_metric_hist_get_value(metric, index);
+        }
+
+        emit_histogram(writer, histogram->buckets, bucket_values,
+                       cmt_metric_hist_get_count_value(metric),
+                       cmt_metric_hist_get_sum_value(metric));
+        free(bucket_values);
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        if (cmt_exp_histogram_to_explicit(metric,
+                                          &upper_bounds,
+                                          &upper_bounds_count,
+                                          &bucket_values,
+                                          &bucket_count) != 0) {
+            return;
+        }
+
+        buckets.count = upper_bounds_count;
+        buckets.upper_bounds = upper_bounds;
+
+        emit_histogram(writer, &buckets, bucket_values,
+                       bucket_values[bucket_count - 1],
+                       cmt_math_uint64_to_d64(
+                           cmt_atomic_load(&metric->exp_hist_sum)));
+
+        free(bucket_values);
+        free(upper_bounds);
+    }
+    else if (map->type == CMT_SUMMARY) {
+        if (!cmt_atomic_load(&metric->sum_quantiles_set)) {
+            return;
+        }
+
+        summary = (struct cmt_summary *) map->parent;
+
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            emit(writer, NULL, "quantile", summary->quantiles[index],
+                 cmt_summary_quantile_get_value(metric, index));
+        }
+
+        emit(writer, ".sum", NULL, 0, cmt_summary_get_sum_value(metric));
+        emit(writer, ".count", NULL, 0,
+             (double) cmt_summary_get_count_value(metric));
+    }
+    else {
+        emit(writer, NULL, NULL, 0, cmt_metric_get_value(metric));
+    }
+}
+
+static void format_metrics(struct graphite_writer *writer, struct cmt_map *map)
+{
+    struct cfl_list   *head;
+    struct cmt_metric *metric;
+
+    family_path(writer, map);
+
+    if (map->metric_static_set == 1) {
+        format_metric(writer, map, &map->metric);
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        format_metric(writer, map, metric);
+    }
+}
+
+static cfl_sds_t encode(struct cmt *cmt, int pickle)
+{
+    uint32_t                  length;
+    struct cfl_list          *head;
+    struct cmt_counter       *counter;
+    struct cmt_gauge         *gauge;
+    struct cmt_untyped       *untyped;
+    struct cmt_summary       *summary;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct graphite_writer    writer;
+
+    memset(&writer, 0, sizeof(struct graphite_writer));
+    writer.cmt = cmt;
+    writer.pickle = pickle;
+    writer.buf = cfl_sds_create_size(1024);
+    writer.path = cfl_sds_create_size(128);
+    writer.tags = cfl_sds_create_size(128);
+
+    if (writer.buf == NULL || writer.path == NULL || writer.tags == NULL) {
+        cmt_errno();
+
+        if (writer.buf != NULL) {
+            cfl_sds_destroy(writer.buf);
+        }
+        if (writer.path != NULL) {
+            cfl_sds_destroy(writer.path);
+        }
+        if (writer.tags != NULL) {
+            cfl_sds_destroy(writer.tags);
+        }
+
+        return NULL;
+    }
+
+    if (pickle) {
+        /* room for the size prefix, then protocol 2 and the list */
+        cfl_sds_cat_safe(&writer.buf, "\0\0\0\0\x80\x02]", 7);
+    }
+
+    cfl_list_foreach(head, &cmt->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        format_metrics(&writer, counter->map);
+    }
+
+    cfl_list_foreach(head, &cmt->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        format_metrics(&writer, gauge->map);
+    }
+
+    cfl_list_foreach(head, &cmt->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        format_metrics(&writer, summary->map);
+    }
+
+    cfl_list_foreach(head, &cmt->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        format_metrics(&writer, histogram->map);
+    }
+
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        format_metrics(&writer, exp_histogram->map);
+    }
+
+    cfl_list_foreach(head, &cmt->untypeds) {
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        format_metrics(&writer, untyped->map);
+    }
+
+    if (pickle) {
+        if (writer.batch > 0) {
+            pickle_append(&writer.buf, PICKLE_APPENDS, NULL, 0);
+        }
+
+        pickle_append(&writer.buf, PICKLE_STOP, NULL, 0);
+
+        length = cfl_sds_len(writer.buf) - 4;
+        writer.buf[0] = (length >> 24) & 0xff;
+        writer.buf[1] = (length >> 16) & 0xff;
+        writer.buf[2] = (length >> 8) & 0xff;
+        writer.buf[3] = length & 0xff;
+    }
+
+    cfl_sds_destroy(writer.path);
+    cfl_sds_destroy(writer.tags);
+
+    return writer.buf;
+}
+
+cfl_sds_t cmt_encode_graphite_create(struct cmt *cmt)
+{
+    return encode(cmt, CMT_FALSE);
+}
+
+void cmt_encode_graphite_destroy(cfl_sds_t text)
+{
+    cfl_sds_destroy(text);
+}
+
+cfl_sds_t cmt_encode_graphite_pickle_create(struct cmt *cmt)
+{
+    return encode(cmt, CMT_TRUE);
+}
+
+void cmt_encode_graphite_pickle_destroy(cfl_sds_t payload)
+{
+    cfl_sds_destroy(payload);
+}
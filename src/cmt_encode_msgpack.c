@@ -469,11 +469,10 @@ static int pack_static_processing_section(mpack_writer_t *writer, struct cmt *cm
     return 0;
 }
 
-static int pack_context_header(mpack_writer_t *writer, struct cmt *cmt)
+static int pack_context_header_map(mpack_writer_t *writer, struct cmt *cmt)
 {
     int result;
 
-    mpack_write_cstr(writer, "meta");
     mpack_start_map(writer, 3);
 
     mpack_write_cstr(writer, "cmetrics");
@@ -497,6 +496,13 @@ static int pack_context_header(mpack_writer_t *writer, struct cmt *cmt)
     return 0;
 }
 
+static int pack_context_header(mpack_writer_t *writer, struct cmt *cmt)
+{
+    mpack_write_cstr(writer, "meta");
+
+    return pack_context_header_map(writer, cmt);
+}
+
 static int pack_context_metrics(mpack_writer_t *writer, struct cmt *cmt)
 {
     size_t                metric_count;
@@ -679,6 +685,674 @@ int cmt_encode_msgpack_create(struct cmt *cmt, char **out_buf, size_t *out_size)
     return 0;
 }
 
+/*
+ * Compact format
+ * --------------
+ * The metrics are packed in a separate buffer while their strings are
+ * interned, the dictionary is then written ahead of them.
+ */
+
+#define MSGPACK_COMPACT_INITIAL_SLOT_COUNT      256
+#define MSGPACK_COMPACT_INITIAL_STRING_COUNT    64
+
+/* The dictionary hash table is kept at most 3/4 full */
+#define MSGPACK_COMPACT_LOAD_NUMERATOR          3
+#define MSGPACK_COMPACT_LOAD_DENOMINATOR        4
+
+/*
+ * Dictionary strings are not copied, they point to the strings of the
+ * context being encoded. Index zero is the empty string, so it also marks
+ * unused slots.
+ */
+struct msgpack_compact_string {
+    const char *value;
+    size_t      length;
+};
+
+struct msgpack_compact_slot {
+    uint64_t hash;
+    uint32_t index;
+};
+
+struct msgpack_compact_context {
+    mpack_writer_t                 writer;
+
+    struct msgpack_compact_string *strings;
+    size_t                         string_count;
+    size_t                         string_capacity;
+
+    struct msgpack_compact_slot   *slots;
+    size_t                         slot_count;
+
+    /* timestamp of the last value packed */
+    uint64_t                       timestamp;
+    int                            error;
+};
+
+static int compact_dictionary_resize(struct msgpack_compact_context *context,
+                                     size_t slot_count)
+{
+    size_t                       index;
+    size_t                       position;
+    struct msgpack_compact_slot *slots;
+
+    slots = calloc(slot_count, sizeof(struct msgpack_compact_slot));
+
+    if (slots == NULL) {
+        cmt_errno();
+
+        return -1;
+    }
+
+    for (index = 0 ; index < context->slot_count ; index++) {
+        if (context->slots[index].index == 0) {
+            continue;
+        }
+
+        position = context->slots[index].hash & (slot_count - 1);
+
+        while (slots[position].index != 0) {
+            position = (position + 1) & (slot_count - 1);
+        }
+
+        slots[position] = context->slots[index];
+    }
+
+    if (context->slots != NULL) {
+        free(context->slots);
+    }
+
+    context->slots = slots;
+    context->slot_count = slot_count;
+
+    return 0;
+}
+
+/*
+ * Make room for 'count' more strings up front, a family with many series
+ * would otherwise grow the table several times while its values are packed.
+ */
+static int compact_dictionary_reserve(struct msgpack_compact_context *context,
+                                      size_t count)
+{
+    size_t slot_count;
+
+    slot_count = context->slot_count;
+
+    while ((context->string_count + count) * MSGPACK_COMPACT_LOAD_DENOMINATOR >=
+           slot_count * MSGPACK_COMPACT_LOAD_NUMERATOR) {
+        slot_count *= 2;
+    }
+
+    if (slot_count == context->slot_count) {
+        return 0;
+    }
+
+    return compact_dictionary_resize(context, slot_count);
+}
+
+/* Return the dictionary index of a string, adding it if needed */
+static uint32_t compact_intern(struct msgpack_compact_context *context,
+                               const char *value, size_t length)
+{
+    uint32_t                       index;
+    size_t                         position;
+    uint64_t                       hash;
+    struct msgpack_compact_slot   *slot;
+    struct msgpack_compact_string *strings;
+    struct msgpack_compact_string *entry;
+
+    if (value == NULL || length == 0) {
+        return 0;
+    }
+
+    hash = cfl_hash_64bits(value, length);
+
+    position = hash & (context->slot_count - 1);
+
+    while (context->slots[position].index != 0) {
+        slot = &context->slots[position];
+        entry = &context->strings[slot->index];
+
+        if (slot->hash == hash &&
+            entry->length == length &&
+            memcmp(entry->value, value, length) == 0) {
+            return slot->index;
+        }
+
+        position = (position + 1) & (context->slot_count - 1);
+    }
+
+    if (context->string_count == context->string_capacity) {
+        strings = realloc(context->strings,
+                          context->string_capacity * 2 *
+                          sizeof(struct msgpack_compact_string));
+
+        if (strings == NULL) {
+            cmt_errno();
+            context->error = CMT_TRUE;
+
+            return 0;
+        }
+
+        context->strings = strings;
+        context->string_capacity *= 2;
+    }
+
+    entry = &context->strings[context->string_count];
+    entry->value = value;
+    entry->length = length;
+
+    index = context->string_count++;
+
+    slot = &context->slots[position];
+    slot->hash = hash;
+    slot->index = index;
+
+    if (context->string_count * MSGPACK_COMPACT_LOAD_DENOMINATOR >=
+        context->slot_count * MSGPACK_COMPACT_LOAD_NUMERATOR) {
+        if (compact_dictionary_resize(context, context->slot_count * 2) != 0) {
+            context->error = CMT_TRUE;
+        }
+    }
+
+    return index;
+}
+
+static void pack_compact_string(struct msgpack_compact_context *context,
+                                cfl_sds_t value)
+{
+    size_t length;
+
+    length = 0;
+
+    if (value != NULL) {
+        length = cfl_sds_len(value);
+    }
+
+    mpack_write_uint(&context->writer, compact_intern(context, value, length));
+}
+
+/* Label names and values can be NULL, those are packed as nil */
+static void pack_compact_labels(struct msgpack_compact_context *context,
+                                struct cfl_list *labels)
+{
+    struct cfl_list      *head;
+    struct cmt_map_label *label;
+
+    mpack_start_array(&context->writer, cfl_list_size(labels));
+
+    cfl_list_foreach(head, labels) {
+        label = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label->name != NULL) {
+            pack_compact_string(context, label->name);
+        }
+        else {
+            mpack_write_nil(&context->writer);
+        }
+    }
+
+    mpack_finish_array(&context->writer);
+}
+
+static int pack_compact_metric(struct msgpack_compact_context *context,
+                               struct cmt_map *map, struct cmt_metric *metric)
+{
+    int                               field_count;
+    int                               has_start_timestamp;
+    size_t                            index;
+    uint64_t                          timestamp;
+    mpack_writer_t                   *writer;
+    struct cmt_summary               *summary;
+    struct cmt_histogram             *histogram;
+    struct cmt_exp_histogram_snapshot snapshot;
+
+    writer = &context->writer;
+
+    /* 'ts', the sample and 'hash' */
+    field_count = 3;
+
+    if (!cfl_list_is_empty(&metric->labels)) {
+        field_count++;
+    }
+
+    has_start_timestamp = cmt_metric_has_start_timestamp(metric);
+
+    if (has_start_timestamp) {
+        field_count++;
+    }
+
+    if (map->type == CMT_EXP_HISTOGRAM) {
+        if (cmt_metric_exp_hist_get_snapshot(metric, &snapshot) != 0) {
+            return -1;
+        }
+    }
+
+    mpack_start_map(writer, field_count);
+
+    /* deltas are computed modulo 2^64 so any pair of timestamps round trips */
+    timestamp = cmt_metric_get_timestamp(metric);
+
+    mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_TS);
+    mpack_write_i64(writer, (int64_t) (timestamp - context->timestamp));
+
+    context->timestamp = timestamp;
+
+    if (has_start_timestamp) {
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_START_TS);
+        mpack_write_i64(writer,
+                        (int64_t) (cmt_metric_get_start_timestamp(metric) - timestamp));
+    }
+
+    if (map->type == CMT_HISTOGRAM) {
+        histogram = (struct cmt_histogram *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_HISTOGRAM);
+        mpack_start_map(writer, MSGPACK_COMPACT_HISTOGRAM_FIELD_COUNT);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_HISTOGRAM_BUCKETS);
+        mpack_start_array(writer, histogram->buckets->count + 1);
+        for (index = 0 ; index <= histogram->buckets->count ; index++) {
+            mpack_write_uint(writer, cmt_metric_hist_get_value(metric, index));
+        }
+        mpack_finish_array(writer);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_HISTOGRAM_SUM);
+        mpack_write_double(writer, cmt_metric_hist_get_sum_value(metric));
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_HISTOGRAM_COUNT);
+        mpack_write_uint(writer, cmt_metric_hist_get_count_value(metric));
+
+        mpack_finish_map(writer);
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_EXP_HISTOGRAM);
+        mpack_start_map(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_FIELD_COUNT);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_SCALE);
+        mpack_write_int(writer, snapshot.scale);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_ZERO_COUNT);
+        mpack_write_uint(writer, snapshot.zero_count);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_ZERO_THRESHOLD);
+        mpack_write_double(writer, snapshot.zero_threshold);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_POSITIVE_OFFSET);
+        mpack_write_int(writer, snapshot.positive_offset);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_POSITIVE_BUCKETS);
+        mpack_start_array(writer, snapshot.positive_count);
+        for (index = 0 ; index < snapshot.positive_count ; index++) {
+            mpack_write_uint(writer, snapshot.positive_buckets[index]);
+        }
+        mpack_finish_array(writer);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_NEGATIVE_OFFSET);
+        mpack_write_int(writer, snapshot.negative_offset);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_NEGATIVE_BUCKETS);
+        mpack_start_array(writer, snapshot.negative_count);
+        for (index = 0 ; index < snapshot.negative_count ; index++) {
+            mpack_write_uint(writer, snapshot.negative_buckets[index]);
+        }
+        mpack_finish_array(writer);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_COUNT);
+        mpack_write_uint(writer, snapshot.count);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_SUM_SET);
+        mpack_write_uint(writer, snapshot.sum_set);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_EXP_HISTOGRAM_SUM);
+        mpack_write_uint(writer, snapshot.sum);
+
+        mpack_finish_map(writer);
+
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+    }
+    else if (map->type == CMT_SUMMARY) {
+        summary = (struct cmt_summary *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_SUMMARY);
+        mpack_start_map(writer, MSGPACK_COMPACT_SUMMARY_FIELD_COUNT);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_SUMMARY_QUANTILES_SET);
+        mpack_write_uint(writer, cmt_atomic_load(&metric->sum_quantiles_set));
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_SUMMARY_QUANTILES);
+        mpack_start_array(writer, summary->quantiles_count);
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            mpack_write_uint(writer,
+                             cmt_atomic_load(&metric->sum_quantiles[index]));
+        }
+        mpack_finish_array(writer);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_SUMMARY_COUNT);
+        mpack_write_uint(writer, cmt_summary_get_count_value(metric));
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_SUMMARY_SUM);
+        mpack_write_uint(writer, cmt_atomic_load(&metric->sum_sum));
+
+        mpack_finish_map(writer);
+    }
+    else if (cmt_metric_get_value_type(metric) == CMT_METRIC_VALUE_INT64) {
+        /* the floating point value is derived from the integer one */
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_INT64);
+        mpack_write_i64(writer, cmt_metric_get_int64_value(metric));
+    }
+    else if (cmt_metric_get_value_type(metric) == CMT_METRIC_VALUE_UINT64) {
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_UINT64);
+        mpack_write_u64(writer, cmt_metric_get_uint64_value(metric));
+    }
+    else {
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_DOUBLE);
+        mpack_write_double(writer, cmt_metric_get_value(metric));
+    }
+
+    if (!cfl_list_is_empty(&metric->labels)) {
+        mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_LABELS);
+        pack_compact_labels(context, &metric->labels);
+    }
+
+    mpack_write_uint(writer, MSGPACK_COMPACT_VALUE_HASH);
+    mpack_write_uint(writer, metric->hash);
+
+    mpack_finish_map(writer);
+
+    return 0;
+}
+
+static int pack_compact_basic_type(struct msgpack_compact_context *context,
+                                   struct cmt_map *map)
+{
+    int                       result;
+    int                       field_count;
+    size_t                    index;
+    size_t                    value_count;
+    mpack_writer_t           *writer;
+    struct cfl_list          *head;
+    struct cmt_metric        *metric;
+    struct cmt_summary       *summary;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_counter       *counter;
+
+    writer = &context->writer;
+
+    /* 'type', 'opts', 'labels' and 'values' */
+    field_count = 4;
+
+    if (map->type == CMT_HISTOGRAM) {
+        field_count += 2;
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM ||
+             map->type == CMT_SUMMARY ||
+             map->type == CMT_COUNTER) {
+        field_count++;
+    }
+
+    mpack_start_map(writer, field_count);
+
+    mpack_write_uint(writer, MSGPACK_COMPACT_META_TYPE);
+    mpack_write_uint(writer, map->type);
+
+    /* [ns, subsystem, name, description, unit] */
+    mpack_write_uint(writer, MSGPACK_COMPACT_META_OPTS);
+    mpack_start_array(writer, 5);
+    pack_compact_string(context, map->opts->ns);
+    pack_compact_string(context, map->opts->subsystem);
+    pack_compact_string(context, map->opts->name);
+    pack_compact_string(context, map->opts->description);
+    pack_compact_string(context, map->unit);
+    mpack_finish_array(writer);
+
+    mpack_write_uint(writer, MSGPACK_COMPACT_META_LABELS);
+    pack_compact_labels(context, &map->label_keys);
+
+    if (map->type == CMT_HISTOGRAM) {
+        histogram = (struct cmt_histogram *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_META_BUCKETS);
+
+        if (histogram->buckets != NULL) {
+            mpack_start_array(writer, histogram->buckets->count);
+
+            for (index = 0 ; index < histogram->buckets->count ; index++) {
+                mpack_write_double(writer, histogram->buckets->upper_bounds[index]);
+            }
+        }
+        else {
+            mpack_start_array(writer, 0);
+        }
+
+        mpack_finish_array(writer);
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_META_AGGREGATION_TYPE);
+        mpack_write_int(writer, histogram->aggregation_type);
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        exp_histogram = (struct cmt_exp_histogram *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_META_AGGREGATION_TYPE);
+        mpack_write_int(writer, exp_histogram->aggregation_type);
+    }
+    else if (map->type == CMT_SUMMARY) {
+        summary = (struct cmt_summary *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_META_QUANTILES);
+        mpack_start_array(writer, summary->quantiles_count);
+
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            mpack_write_double(writer, summary->quantiles[index]);
+        }
+
+        mpack_finish_array(writer);
+    }
+    else if (map->type == CMT_COUNTER) {
+        counter = (struct cmt_counter *) map->parent;
+
+        mpack_write_uint(writer, MSGPACK_COMPACT_META_AGGREGATION_TYPE);
+        mpack_write_int(writer, counter->aggregation_type);
+    }
+
+    /* the values always go last, the decoder needs the meta fields first */
+    value_count = cfl_list_size(&map->metrics) + (map->metric_static_set ? 1 : 0);
+
+    mpack_write_uint(writer, MSGPACK_COMPACT_META_VALUES);
+    mpack_start_array(writer, value_count);
+
+    /* most series carry at least one label value of their own */
+    result = compact_dictionary_reserve(context, value_count);
+
+    if (result != 0) {
+        context->error = CMT_TRUE;
+    }
+
+    if (map->metric_static_set) {
+        result = pack_compact_metric(context, map, &map->metric);
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        if (result != 0) {
+            break;
+        }
+
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        result = pack_compact_metric(context, map, metric);
+    }
+
+    mpack_finish_array(writer);
+
+    mpack_finish_map(writer);
+
+    return result;
+}
+
+static int pack_compact_context_metrics(struct msgpack_compact_context *context,
+                                        struct cmt *cmt)
+{
+    int                       result;
+    size_t                    metric_count;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_summary       *summary;
+    struct cmt_untyped       *untyped;
+    struct cmt_counter       *counter;
+    struct cmt_gauge         *gauge;
+    struct cfl_list          *head;
+
+    metric_count  = 0;
+    metric_count += cfl_list_size(&cmt->counters);
+    metric_count += cfl_list_size(&cmt->gauges);
+    metric_count += cfl_list_size(&cmt->untypeds);
+    metric_count += cfl_list_size(&cmt->summaries);
+    metric_count += cfl_list_size(&cmt->histograms);
+    metric_count += cfl_list_size(&cmt->exp_histograms);
+
+    mpack_start_array(&context->writer, metric_count);
+
+    result = 0;
+
+    cfl_list_foreach(head, &cmt->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        result |= pack_compact_basic_type(context, counter->map);
+    }
+
+    cfl_list_foreach(head, &cmt->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        result |= pack_compact_basic_type(context, gauge->map);
+    }
+
+    cfl_list_foreach(head, &cmt->untypeds) {
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        result |= pack_compact_basic_type(context, untyped->map);
+    }
+
+    cfl_list_foreach(head, &cmt->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        result |= pack_compact_basic_type(context, summary->map);
+    }
+
+    cfl_list_foreach(head, &cmt->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        result |= pack_compact_basic_type(context, histogram->map);
+    }
+
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        result |= pack_compact_basic_type(context, exp_histogram->map);
+    }
+
+    mpack_finish_array(&context->writer);
+
+    if (result != 0 || context->error) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Takes a cmetrics context and serialize it using the compact msgpack format */
+int cmt_encode_msgpack_compact_create(struct cmt *cmt, char **out_buf, size_t *out_size)
+{
+    int                             result;
+    char                           *body;
+    size_t                          body_size;
+    char                           *data;
+    size_t                          size;
+    size_t                          index;
+    mpack_writer_t                  writer;
+    struct msgpack_compact_context  context;
+
+    if (cmt == NULL || out_buf == NULL || out_size == NULL) {
+        return -1;
+    }
+
+    memset(&context, 0, sizeof(struct msgpack_compact_context));
+
+    context.strings = calloc(MSGPACK_COMPACT_INITIAL_STRING_COUNT,
+                             sizeof(struct msgpack_compact_string));
+
+    if (context.strings == NULL) {
+        cmt_errno();
+
+        return -1;
+    }
+
+    context.string_capacity = MSGPACK_COMPACT_INITIAL_STRING_COUNT;
+
+    /* the first dictionary entry is always the empty string */
+    context.strings[0].value = "";
+    context.strings[0].length = 0;
+    context.string_count = 1;
+
+    if (compact_dictionary_resize(&context, MSGPACK_COMPACT_INITIAL_SLOT_COUNT) != 0) {
+        free(context.strings);
+
+        return -1;
+    }
+
+    body = NULL;
+    body_size = 0;
+
+    mpack_writer_init_growable(&context.writer, &body, &body_size);
+
+    result = pack_compact_context_metrics(&context, cmt);
+
+    if (mpack_writer_destroy(&context.writer) != mpack_ok) {
+        result = -1;
+    }
+
+    if (result == 0) {
+        data = NULL;
+        size = 0;
+
+        mpack_writer_init_growable(&writer, &data, &size);
+
+        mpack_start_array(&writer, 4);
+
+        mpack_write_uint(&writer, MSGPACK_COMPACT_VERSION);
+
+        mpack_start_array(&writer, context.string_count);
+        for (index = 0 ; index < context.string_count ; index++) {
+            mpack_write_str(&writer, context.strings[index].value,
+                            context.strings[index].length);
+        }
+        mpack_finish_array(&writer);
+
+        result = pack_context_header_map(&writer, cmt);
+
+        mpack_write_object_bytes(&writer, body, body_size);
+
+        mpack_finish_array(&writer);
+
+        if (mpack_writer_destroy(&writer) != mpack_ok) {
+            fprintf(stderr, "An error occurred encoding the data!\n");
+
+            result = -1;
+        }
+
+        if (result == 0) {
+            *out_buf = data;
+            *out_size = size;
+        }
+        else if (data != NULL) {
+            MPACK_FREE(data);
+        }
+    }
+
+    if (body != NULL) {
+        MPACK_FREE(body);
+    }
+
+    free(context.strings);
+    free(context.slots);
+
+    return result;
+}
+
 void cmt_encode_msgpack_destroy(char *out_buf)
 {
     if (NULL != out_buf) {
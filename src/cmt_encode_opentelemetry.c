@@ -26,15 +26,107 @@
 #include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_encode_opentelemetry.h>
+#include <cmetrics/cmt_encode_split.h>
+#include <cmetrics/cmt_json.h>
 #include <cfl/cfl_arena.h>
 #include <inttypes.h>
 
+#include "cmt_protobuf_wire.h"
+
 #define CMT_OTLP_ARENA_INITIAL_CHUNK_SIZE 4096
 #define CMT_OTLP_ARENA_MAX_CHUNK_SIZE     65536
 
+/* Initial output buffer size of the direct wire format encoder */
+#define CMT_OTLP_WRITER_INITIAL_SIZE      4096
+
+/* Field numbers used by the direct wire format encoder */
+#define OTLP_METRICS_DATA_RESOURCE_METRICS      1
+
+#define OTLP_RESOURCE_METRICS_RESOURCE          1
+#define OTLP_RESOURCE_METRICS_SCOPE_METRICS     2
+#define OTLP_RESOURCE_METRICS_SCHEMA_URL        3
+
+#define OTLP_SCOPE_METRICS_SCOPE                1
+#define OTLP_SCOPE_METRICS_METRICS              2
+#define OTLP_SCOPE_METRICS_SCHEMA_URL           3
+
+#define OTLP_METRIC_NAME                        1
+#define OTLP_METRIC_DESCRIPTION                 2
+#define OTLP_METRIC_UNIT                        3
+#define OTLP_METRIC_GAUGE                       5
+#define OTLP_METRIC_SUM                         7
+#define OTLP_METRIC_HISTOGRAM                   9
+#define OTLP_METRIC_EXPONENTIAL_HISTOGRAM      10
+#define OTLP_METRIC_SUMMARY                    11
+#define OTLP_METRIC_METADATA                   12
+
+/* Gauge, Sum, Summary, Histogram and ExponentialHistogram */
+#define OTLP_DATA_DATA_POINTS                   1
+#define OTLP_DATA_AGGREGATION_TEMPORALITY       2
+#define OTLP_SUM_IS_MONOTONIC                   3
+
+#define OTLP_KEY_VALUE_KEY                      1
+#define OTLP_KEY_VALUE_VALUE                    2
+#define OTLP_ANY_VALUE_STRING_VALUE             1
+
+#define OTLP_NUMBER_START_TIME_UNIX_NANO        2
+#define OTLP_NUMBER_TIME_UNIX_NANO              3
+#define OTLP_NUMBER_AS_DOUBLE                   4
+#define OTLP_NUMBER_EXEMPLARS                   5
+#define OTLP_NUMBER_AS_INT                      6
+#define OTLP_NUMBER_ATTRIBUTES                  7
+#define OTLP_NUMBER_FLAGS                       8
+
+#define OTLP_SUMMARY_START_TIME_UNIX_NANO       2
+#define OTLP_SUMMARY_TIME_UNIX_NANO             3
+#define OTLP_SUMMARY_COUNT                      4
+#define OTLP_SUMMARY_SUM                        5
+#define OTLP_SUMMARY_QUANTILE_VALUES            6
+#define OTLP_SUMMARY_ATTRIBUTES                 7
+#define OTLP_SUMMARY_FLAGS                      8
+#define OTLP_QUANTILE_QUANTILE                  1
+#define OTLP_QUANTILE_VALUE                     2
+
+#define OTLP_HISTOGRAM_START_TIME_UNIX_NANO     2
+#define OTLP_HISTOGRAM_TIME_UNIX_NANO           3
+#define OTLP_HISTOGRAM_COUNT                    4
+#define OTLP_HISTOGRAM_SUM                      5
+#define OTLP_HISTOGRAM_BUCKET_COUNTS            6
+#define OTLP_HISTOGRAM_EXPLICIT_BOUNDS          7
+#define OTLP_HISTOGRAM_EXEMPLARS                8
+#define OTLP_HISTOGRAM_ATTRIBUTES               9
+#define OTLP_HISTOGRAM_FLAGS                   10
+#define OTLP_HISTOGRAM_MIN                     11
+#define OTLP_HISTOGRAM_MAX                     12
+
+#define OTLP_EXP_HISTOGRAM_ATTRIBUTES           1
+#define OTLP_EXP_HISTOGRAM_START_TIME_UNIX_NANO 2
+#define OTLP_EXP_HISTOGRAM_TIME_UNIX_NANO       3
+#define OTLP_EXP_HISTOGRAM_COUNT                4
+#define OTLP_EXP_HISTOGRAM_SUM                  5
+#define OTLP_EXP_HISTOGRAM_SCALE                6
+#define OTLP_EXP_HISTOGRAM_ZERO_COUNT           7
+#define OTLP_EXP_HISTOGRAM_POSITIVE             8
+#define OTLP_EXP_HISTOGRAM_NEGATIVE             9
+#define OTLP_EXP_HISTOGRAM_FLAGS               10
+#define OTLP_EXP_HISTOGRAM_EXEMPLARS           11
+#define OTLP_EXP_HISTOGRAM_MIN                 12
+#define OTLP_EXP_HISTOGRAM_MAX                 13
+#define OTLP_EXP_HISTOGRAM_ZERO_THRESHOLD      14
+#define OTLP_BUCKETS_OFFSET                     1
+#define OTLP_BUCKETS_BUCKET_COUNTS              2
+
 struct cmt_opentelemetry_encoder {
     struct cmt_opentelemetry_context context;
     struct cfl_arena                 *arena;
+
+    /* Payload splitting, see cmt_encode_opentelemetry_create_split() */
+    struct cfl_list                  *split_payloads;
+    size_t                            split_max_bytes;
+    size_t                            split_max_series;
+    size_t                            split_base_bytes;
+    size_t                            split_pending_bytes;
+    size_t                            split_pending_series;
 };
 
 /*
@@ -2161,6 +2253,30 @@ static void destroy_exponential_histogram_data_point_list(
     }
 }
 
+static void set_numerical_data_point_value(
+    Opentelemetry__Proto__Metrics__V1__NumberDataPoint *data_point,
+    struct cmt_metric *sample)
+{
+    if (sample != NULL && cmt_metric_get_value_type(sample) == CMT_METRIC_VALUE_INT64) {
+        data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT;
+        data_point->as_int = cmt_metric_get_int64_value(sample);
+    }
+    else if (sample != NULL && cmt_metric_get_value_type(sample) == CMT_METRIC_VALUE_UINT64) {
+        if (cmt_metric_get_uint64_value(sample) <= INT64_MAX) {
+            data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT;
+            data_point->as_int = (int64_t) cmt_metric_get_uint64_value(sample);
+        }
+        else {
+            data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE;
+            data_point->as_double = (double) cmt_metric_get_uint64_value(sample);
+        }
+    }
+    else {
+        data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE;
+        data_point->as_double = sample != NULL ? cmt_metric_get_value(sample) : 0;
+    }
+}
+
 static Opentelemetry__Proto__Metrics__V1__NumberDataPoint *
     initialize_numerical_data_point(struct cfl_arena *arena,
                                     uint64_t start_time,
@@ -2183,24 +2299,9 @@ static Opentelemetry__Proto__Metrics__V1__NumberDataPoint *
 
     data_point->start_time_unix_nano = start_time;
     data_point->time_unix_nano = timestamp;
-    if (sample != NULL && cmt_metric_get_value_type(sample) == CMT_METRIC_VALUE_INT64) {
-        data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT;
-        data_point->as_int = cmt_metric_get_int64_value(sample);
-    }
-    else if (sample != NULL && cmt_metric_get_value_type(sample) == CMT_METRIC_VALUE_UINT64) {
-        if (cmt_metric_get_uint64_value(sample) <= INT64_MAX) {
-            data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT;
-            data_point->as_int = (int64_t) cmt_metric_get_uint64_value(sample);
-        }
-        else {
-            data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE;
-            data_point->as_double = (double) cmt_metric_get_uint64_value(sample);
-        }
-    }
-    else {
-        data_point->value_case = OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE;
-        data_point->as_double = sample != NULL ? cmt_metric_get_value(sample) : 0;
-    }
+
+    set_numerical_data_point_value(data_point, sample);
+
     data_point->attributes = attribute_list;
     data_point->n_attributes = attribute_count;
 
@@ -3430,50 +3531,29 @@ int append_sample_to_metric(struct cmt_opentelemetry_context *context,
     return result;
 }
 
-int pack_basic_type(struct cmt_opentelemetry_context *context,
-                    struct cmt_map *map,
-                    size_t *metric_index)
+static void resolve_metric_aggregation(struct cmt_map *map,
+                                       int *aggregation_temporality_type,
+                                       int *monotonism_flag)
 {
-    int                                        aggregation_temporality_type;
-    int                                        monotonism_flag;
-    size_t                                     sample_index;
-    size_t                                     sample_count;
-    struct cmt_counter                        *counter;
-    struct cmt_histogram                      *histogram;
-    struct cmt_exp_histogram                  *exp_histogram;
-    struct cmt_metric                         *sample;
-    Opentelemetry__Proto__Metrics__V1__Metric *metric;
-    int                                        result;
-    struct cfl_list                            *head;
-    size_t                                     target_scope_index;
-
-    sample_count = 0;
-
-    if (map->metric_static_set) {
-        sample_count++;
-    }
-
-    sample_count += cfl_list_size(&map->metrics);
-
-    if (sample_count == 0) {
-        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
-    }
+    struct cmt_counter       *counter;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
 
-    aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_UNSPECIFIED;
-    monotonism_flag = CMT_FALSE;
+    *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_UNSPECIFIED;
+    *monotonism_flag = CMT_FALSE;
 
     if (map->type == CMT_COUNTER) {
         if (map->parent != NULL) {
             counter = (struct cmt_counter *) map->parent;
 
             if (counter->aggregation_type == CMT_AGGREGATION_TYPE_DELTA) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
             }
             else if (counter->aggregation_type == CMT_AGGREGATION_TYPE_CUMULATIVE) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
             }
 
-            monotonism_flag = !counter->allow_reset;
+            *monotonism_flag = !counter->allow_reset;
         }
     }
     else if (map->type == CMT_HISTOGRAM) {
@@ -3481,10 +3561,10 @@ int pack_basic_type(struct cmt_opentelemetry_context *context,
             histogram = (struct cmt_histogram *) map->parent;
 
             if (histogram->aggregation_type == CMT_AGGREGATION_TYPE_DELTA) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
             }
             else if (histogram->aggregation_type == CMT_AGGREGATION_TYPE_CUMULATIVE) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
             }
         }
     }
@@ -3493,14 +3573,281 @@ int pack_basic_type(struct cmt_opentelemetry_context *context,
             exp_histogram = (struct cmt_exp_histogram *) map->parent;
 
             if (exp_histogram->aggregation_type == CMT_AGGREGATION_TYPE_DELTA) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_DELTA;
             }
             else if (exp_histogram->aggregation_type == CMT_AGGREGATION_TYPE_CUMULATIVE) {
-                aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
+                *aggregation_temporality_type = OPENTELEMETRY__PROTO__METRICS__V1__AGGREGATION_TEMPORALITY__AGGREGATION_TEMPORALITY_CUMULATIVE;
+            }
+        }
+    }
+}
+
+/*
+ * Payload splitting: data points are measured as they are appended, once the
+ * next one does not fit in the budget everything packed so far is rendered
+ * into a payload of its own (with the resource and scope envelopes) and
+ * released. The data point that triggered the flush opens the next payload.
+ */
+static cfl_sds_t render_opentelemetry_context_to_sds(
+    struct cmt_opentelemetry_context *context);
+
+static size_t repeated_field_size(size_t message_size)
+{
+    return 1 + cmt_protobuf_varint_size(message_size) + message_size;
+}
+
+static void **get_metric_data_point_list(
+    Opentelemetry__Proto__Metrics__V1__Metric *metric,
+    size_t **data_point_count)
+{
+    switch (metric->data_case) {
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUM:
+            *data_point_count = &metric->sum->n_data_points;
+            return (void **) metric->sum->data_points;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_GAUGE:
+            *data_point_count = &metric->gauge->n_data_points;
+            return (void **) metric->gauge->data_points;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_SUMMARY:
+            *data_point_count = &metric->summary->n_data_points;
+            return (void **) metric->summary->data_points;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_HISTOGRAM:
+            *data_point_count = &metric->histogram->n_data_points;
+            return (void **) metric->histogram->data_points;
+        case OPENTELEMETRY__PROTO__METRICS__V1__METRIC__DATA_EXPONENTIAL_HISTOGRAM:
+            *data_point_count = &metric->exponential_histogram->n_data_points;
+            return (void **) metric->exponential_histogram->data_points;
+        default:
+            *data_point_count = NULL;
+            return NULL;
+    }
+}
+
+static size_t get_data_point_packed_size(void *data_point, int data_point_type)
+{
+    switch (data_point_type) {
+        case CMT_COUNTER:
+        case CMT_GAUGE:
+        case CMT_UNTYPED:
+            return opentelemetry__proto__metrics__v1__number_data_point__get_packed_size(data_point);
+        case CMT_SUMMARY:
+            return opentelemetry__proto__metrics__v1__summary_data_point__get_packed_size(data_point);
+        case CMT_HISTOGRAM:
+            return opentelemetry__proto__metrics__v1__histogram_data_point__get_packed_size(data_point);
+        case CMT_EXP_HISTOGRAM:
+            return opentelemetry__proto__metrics__v1__exponential_histogram_data_point__get_packed_size(data_point);
+    }
+
+    return 0;
+}
+
+/*
+ * Size of the metric without data points, the margin covers the growth of
+ * the length prefixes of the metric and of its data container.
+ */
+static size_t get_metric_envelope_size(Opentelemetry__Proto__Metrics__V1__Metric *metric)
+{
+    size_t *data_point_count;
+    size_t  saved_count;
+    size_t  size;
+
+    get_metric_data_point_list(metric, &data_point_count);
+
+    saved_count = *data_point_count;
+    *data_point_count = 0;
+
+    size = repeated_field_size(
+            opentelemetry__proto__metrics__v1__metric__get_packed_size(metric));
+
+    *data_point_count = saved_count;
+
+    return size + 8;
+}
+
+static int flush_split_payload(struct cmt_opentelemetry_context *context,
+                               struct cmt_map *map,
+                               Opentelemetry__Proto__Metrics__V1__Metric *metric,
+                               size_t scope_index,
+                               size_t *sample_index)
+{
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics;
+    struct cmt_opentelemetry_encoder                *encoder;
+    void                                           **data_point_list;
+    size_t                                          *data_point_count;
+    size_t                                           data_point_slot_count;
+    size_t                                           emitted_count;
+    size_t                                           index;
+    size_t                                           metric_index;
+    cfl_sds_t                                        payload;
+    int                                              result;
+
+    encoder = (struct cmt_opentelemetry_encoder *) context;
+    scope_metrics = NULL;
+    data_point_list = NULL;
+    data_point_count = NULL;
+    data_point_slot_count = 0;
+    emitted_count = 0;
+    result = CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+
+    /* The metric being packed goes out without its last data point */
+    if (metric != NULL) {
+        data_point_list = get_metric_data_point_list(metric, &data_point_count);
+        data_point_slot_count = *data_point_count;
+        emitted_count = *sample_index - 1;
+
+        if (emitted_count > 0) {
+            *data_point_count = emitted_count;
+            scope_metrics = context->scope_metrics_list[scope_index];
+
+            result = append_metric_to_scope_metrics(scope_metrics,
+                                                    metric,
+                                                    get_metric_count(context->cmt));
+
+            if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+                scope_metrics = NULL;
+            }
+        }
+    }
+
+    if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+        payload = render_opentelemetry_context_to_sds(context);
+
+        if (payload == NULL) {
+            result = CMT_ENCODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+        else if (cmt_encode_split_append(encoder->split_payloads,
+                                         payload,
+                                         encoder->split_pending_series) != 0) {
+            cfl_sds_destroy(payload);
+
+            result = CMT_ENCODE_OPENTELEMETRY_ALLOCATION_ERROR;
+        }
+    }
+
+    if (scope_metrics != NULL) {
+        scope_metrics->n_metrics--;
+        scope_metrics->metrics[scope_metrics->n_metrics] = NULL;
+    }
+
+    if (metric != NULL) {
+        for (index = 0 ; index < emitted_count ; index++) {
+            destroy_data_point(data_point_list[index], map->type);
+        }
+
+        if (emitted_count > 0) {
+            data_point_list[0] = data_point_list[emitted_count];
+
+            for (index = 1 ; index <= emitted_count ; index++) {
+                data_point_list[index] = NULL;
             }
         }
+
+        *data_point_count = data_point_slot_count;
+        *sample_index = 1;
+    }
+
+    for (index = 0 ; index < context->scope_metrics_count ; index++) {
+        scope_metrics = context->scope_metrics_list[index];
+
+        for (metric_index = 0 ;
+             metric_index < scope_metrics->n_metrics ;
+             metric_index++) {
+            destroy_metric(scope_metrics->metrics[metric_index]);
+
+            scope_metrics->metrics[metric_index] = NULL;
+        }
+
+        scope_metrics->n_metrics = 0;
+    }
+
+    encoder->split_pending_bytes = encoder->split_base_bytes;
+    encoder->split_pending_series = 0;
+
+    return result;
+}
+
+/* Account for the data point appended last, 'sample_index' is the fill count */
+static int split_data_point(struct cmt_opentelemetry_context *context,
+                            struct cmt_map *map,
+                            Opentelemetry__Proto__Metrics__V1__Metric *metric,
+                            size_t scope_index,
+                            size_t *sample_index)
+{
+    struct cmt_opentelemetry_encoder *encoder;
+    void                            **data_point_list;
+    size_t                           *data_point_count;
+    size_t                            envelope_size;
+    size_t                            size;
+    int                               result;
+
+    encoder = (struct cmt_opentelemetry_encoder *) context;
+
+    if (encoder->split_payloads == NULL) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    data_point_list = get_metric_data_point_list(metric, &data_point_count);
+
+    size = repeated_field_size(
+            get_data_point_packed_size(data_point_list[*sample_index - 1], map->type));
+
+    envelope_size = 0;
+
+    if (*sample_index == 1) {
+        envelope_size = get_metric_envelope_size(metric);
+    }
+
+    if (encoder->split_pending_series > 0 &&
+        ((encoder->split_max_series > 0 &&
+          encoder->split_pending_series >= encoder->split_max_series) ||
+         (encoder->split_max_bytes > 0 &&
+          encoder->split_pending_bytes + envelope_size + size >
+          encoder->split_max_bytes))) {
+        if (*sample_index > 1) {
+            envelope_size = get_metric_envelope_size(metric);
+        }
+
+        result = flush_split_payload(context, map, metric, scope_index, sample_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    encoder->split_pending_bytes += envelope_size + size;
+    encoder->split_pending_series++;
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+int pack_basic_type(struct cmt_opentelemetry_context *context,
+                    struct cmt_map *map,
+                    size_t *metric_index)
+{
+    int                                        aggregation_temporality_type;
+    int                                        monotonism_flag;
+    size_t                                     sample_index;
+    size_t                                     sample_count;
+    struct cmt_metric                         *sample;
+    Opentelemetry__Proto__Metrics__V1__Metric *metric;
+    int                                        result;
+    struct cfl_list                            *head;
+    size_t                                     target_scope_index;
+    size_t                                    *data_point_count;
+
+    sample_count = 0;
+
+    if (map->metric_static_set) {
+        sample_count++;
+    }
+
+    sample_count += cfl_list_size(&map->metrics);
+
+    if (sample_count == 0) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
     }
 
+    resolve_metric_aggregation(map, &aggregation_temporality_type, &monotonism_flag);
+
     target_scope_index = resolve_target_scope_index(context, map);
     if (target_scope_index >= context->scope_metrics_count) {
         return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
@@ -3529,6 +3876,11 @@ int pack_basic_type(struct cmt_opentelemetry_context *context,
                                          &map->metric,
                                          sample_index++);
 
+        if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            result = split_data_point(context, map, metric,
+                                      target_scope_index, &sample_index);
+        }
+
         if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
             destroy_metric(metric);
 
@@ -3545,6 +3897,11 @@ int pack_basic_type(struct cmt_opentelemetry_context *context,
                                          sample,
                                          sample_index++);
 
+        if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            result = split_data_point(context, map, metric,
+                                      target_scope_index, &sample_index);
+        }
+
         if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
             destroy_metric(metric);
 
@@ -3552,6 +3909,13 @@ int pack_basic_type(struct cmt_opentelemetry_context *context,
         }
     }
 
+    /* Earlier data points could have been flushed in a previous payload */
+    if (sample_index < sample_count) {
+        get_metric_data_point_list(metric, &data_point_count);
+
+        *data_point_count = sample_index;
+    }
+
     result = append_metric_to_scope_metrics(context->scope_metrics_list[target_scope_index],
                                             metric,
                                             get_metric_count(context->cmt));
@@ -3589,10 +3953,9 @@ static cfl_sds_t render_opentelemetry_context_to_sds(
     return result_buffer;
 }
 
-cfl_sds_t cmt_encode_opentelemetry_create(struct cmt *cmt)
+static int pack_opentelemetry_context(struct cmt_opentelemetry_context *context)
 {
     size_t                            metric_index;
-    struct cmt_opentelemetry_context *context;
     struct cmt_histogram             *histogram;
     struct cmt_exp_histogram         *exp_histogram;
     struct cmt_summary               *summary;
@@ -3601,17 +3964,10 @@ cfl_sds_t cmt_encode_opentelemetry_create(struct cmt *cmt)
     int                               result;
     struct cmt_gauge                 *gauge;
     struct cfl_list                   *head;
-    cfl_sds_t                         buf;
+    struct cmt                       *cmt;
 
-    buf = NULL;
+    cmt = context->cmt;
     result = 0;
-
-    context = initialize_opentelemetry_context(cmt);
-
-    if (context == NULL) {
-        return NULL;
-    }
-
     metric_index = 0;
 
     if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
@@ -3680,16 +4036,1795 @@ cfl_sds_t cmt_encode_opentelemetry_create(struct cmt *cmt)
         }
     }
 
-    if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
-        buf = render_opentelemetry_context_to_sds(context);
+    return result;
+}
+
+/*
+ * Direct wire format encoder: the resource and scope envelopes still come
+ * from the skeleton built by initialize_opentelemetry_context(), metrics and
+ * data points are serialized straight from the maps into the output buffer.
+ * Each data point is staged in a protobuf-c structure on the stack so the
+ * metadata helpers are shared with the tree encoder, its arrays reference the
+ * sample storage instead of holding copies. Fields are written in field
+ * number order and zero valued proto3 fields are omitted, which keeps the
+ * output byte for byte identical to the protobuf-c packer.
+ */
+static void write_otlp_message(struct cmt_protobuf_writer *writer,
+                               uint32_t field,
+                               const ProtobufCMessage *message)
+{
+    size_t         size;
+    unsigned char *output;
+
+    size = protobuf_c_message_get_packed_size(message);
+
+    cmt_protobuf_write_tag(writer, field, CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED);
+    cmt_protobuf_write_varint(writer, size);
+
+    if (size == 0) {
+        return;
     }
 
-    destroy_opentelemetry_context(context);
+    output = cmt_protobuf_write_reserve(writer, size);
 
-    return buf;
+    if (output != NULL) {
+        protobuf_c_message_pack(message, output);
+    }
 }
 
-void cmt_encode_opentelemetry_destroy(cfl_sds_t text)
+static void write_otlp_string(struct cmt_protobuf_writer *writer,
+                              uint32_t field, const char *value)
+{
+    if (value != NULL && value[0] != '\0') {
+        cmt_protobuf_write_string_field(writer, field, value);
+    }
+}
+
+static void write_otlp_fixed64(struct cmt_protobuf_writer *writer,
+                               uint32_t field, uint64_t value)
+{
+    if (value != 0) {
+        cmt_protobuf_write_fixed64_field(writer, field, value);
+    }
+}
+
+static void write_otlp_double(struct cmt_protobuf_writer *writer,
+                              uint32_t field, double value)
+{
+    if (value != 0) {
+        cmt_protobuf_write_double_field(writer, field, value);
+    }
+}
+
+static void write_otlp_uint64(struct cmt_protobuf_writer *writer,
+                              uint32_t field, uint64_t value)
+{
+    if (value != 0) {
+        cmt_protobuf_write_uint64_field(writer, field, value);
+    }
+}
+
+static void write_otlp_string_attribute(struct cmt_protobuf_writer *writer,
+                                        uint32_t field,
+                                        const char *key, const char *value)
+{
+    size_t attribute_mark;
+    size_t value_mark;
+
+    attribute_mark = cmt_protobuf_begin_message(writer, field);
+
+    write_otlp_string(writer, OTLP_KEY_VALUE_KEY, key);
+
+    /* string_value is a oneof member, it is written even when empty */
+    value_mark = cmt_protobuf_begin_message(writer, OTLP_KEY_VALUE_VALUE);
+    cmt_protobuf_write_string_field(writer, OTLP_ANY_VALUE_STRING_VALUE, value);
+    cmt_protobuf_end_message(writer, value_mark);
+
+    cmt_protobuf_end_message(writer, attribute_mark);
+}
+
+static int write_otlp_attributes(struct cmt_opentelemetry_context *context,
+                                 struct cmt_protobuf_writer *writer,
+                                 uint32_t field,
+                                 struct cmt_map *map,
+                                 struct cmt_metric *sample)
+{
+    size_t                label_name_count;
+    size_t                label_name_index;
+    size_t                sample_label_count;
+    struct cmt_label     *static_label;
+    struct cmt_map_label *label_value;
+    struct cmt_map_label *label_name;
+    struct cfl_list      *head;
+
+    cfl_list_foreach(head, &context->cmt->static_labels->list) {
+        static_label = cfl_list_entry(head, struct cmt_label, _head);
+
+        write_otlp_string_attribute(writer, field,
+                                    static_label->key, static_label->val);
+    }
+
+    sample_label_count = 0;
+    cfl_list_foreach(head, &sample->labels) {
+        label_value = cfl_list_entry(head, struct cmt_map_label, _head);
+        if (label_value->name != NULL) {
+            sample_label_count++;
+        }
+    }
+
+    label_name_count = map->label_count;
+    if (sample_label_count > label_name_count) {
+        return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    label_name = NULL;
+    if (label_name_count > 0) {
+        label_name = cfl_list_entry_first(&map->label_keys, struct cmt_map_label, _head);
+    }
+
+    label_name_index = 0;
+    cfl_list_foreach(head, &sample->labels) {
+        label_value = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label_value->name != NULL) {
+            if (label_name_index >= label_name_count ||
+                label_name == NULL || label_name->name == NULL) {
+                return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+            }
+
+            write_otlp_string_attribute(writer, field,
+                                        label_name->name, label_value->name);
+        }
+
+        label_name_index++;
+        if (label_name_index < label_name_count) {
+            label_name = cfl_list_entry_next(&label_name->_head, struct cmt_map_label,
+                                             _head, &map->label_keys);
+        }
+    }
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+static void write_otlp_exemplars(struct cmt_protobuf_writer *writer,
+                                 uint32_t field,
+                                 Opentelemetry__Proto__Metrics__V1__Exemplar **exemplars,
+                                 size_t exemplar_count)
+{
+    size_t index;
+
+    for (index = 0 ; index < exemplar_count ; index++) {
+        write_otlp_message(writer, field, &exemplars[index]->base);
+    }
+}
+
+static void write_otlp_exponential_buckets(struct cmt_protobuf_writer *writer,
+                                           uint32_t field,
+                                           int32_t offset,
+                                           uint64_t *bucket_counts,
+                                           size_t bucket_count)
+{
+    size_t buckets_mark;
+    size_t counts_mark;
+    size_t index;
+
+    buckets_mark = cmt_protobuf_begin_message(writer, field);
+
+    if (offset != 0) {
+        cmt_protobuf_write_sint64_field(writer, OTLP_BUCKETS_OFFSET, offset);
+    }
+
+    counts_mark = cmt_protobuf_begin_message(writer, OTLP_BUCKETS_BUCKET_COUNTS);
+    for (index = 0 ; index < bucket_count ; index++) {
+        cmt_protobuf_write_varint(writer, bucket_counts[index]);
+    }
+    cmt_protobuf_end_message(writer, counts_mark);
+
+    cmt_protobuf_end_message(writer, buckets_mark);
+}
+
+static int write_otlp_number_data_point(struct cmt_opentelemetry_context *context,
+                                        struct cmt_protobuf_writer *writer,
+                                        struct cmt_map *map,
+                                        struct cmt_metric *sample,
+                                        uint64_t start_timestamp)
+{
+    int                                                 result;
+    size_t                                              mark;
+    Opentelemetry__Proto__Metrics__V1__NumberDataPoint  data_point;
+
+    opentelemetry__proto__metrics__v1__number_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+
+    set_numerical_data_point_value(&data_point, sample);
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    mark = cmt_protobuf_begin_message(writer, OTLP_DATA_DATA_POINTS);
+
+    write_otlp_fixed64(writer, OTLP_NUMBER_START_TIME_UNIX_NANO,
+                       data_point.start_time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_NUMBER_TIME_UNIX_NANO,
+                       data_point.time_unix_nano);
+
+    if (data_point.value_case == OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE) {
+        cmt_protobuf_write_double_field(writer, OTLP_NUMBER_AS_DOUBLE,
+                                        data_point.as_double);
+    }
+
+    write_otlp_exemplars(writer, OTLP_NUMBER_EXEMPLARS,
+                         data_point.exemplars, data_point.n_exemplars);
+
+    if (data_point.value_case == OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT) {
+        cmt_protobuf_write_fixed64_field(writer, OTLP_NUMBER_AS_INT,
+                                         (uint64_t) data_point.as_int);
+    }
+
+    result = write_otlp_attributes(context, writer, OTLP_NUMBER_ATTRIBUTES,
+                                   map, sample);
+
+    write_otlp_uint64(writer, OTLP_NUMBER_FLAGS, data_point.flags);
+
+    cmt_protobuf_end_message(writer, mark);
+
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_otlp_summary_data_point(struct cmt_opentelemetry_context *context,
+                                         struct cmt_protobuf_writer *writer,
+                                         struct cmt_map *map,
+                                         struct cmt_metric *sample,
+                                         uint64_t start_timestamp)
+{
+    int                                                  result;
+    size_t                                               index;
+    size_t                                               mark;
+    size_t                                               quantile_mark;
+    double                                               value;
+    struct cmt_summary                                  *summary;
+    Opentelemetry__Proto__Metrics__V1__SummaryDataPoint  data_point;
+
+    summary = (struct cmt_summary *) map->parent;
+
+    opentelemetry__proto__metrics__v1__summary_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    mark = cmt_protobuf_begin_message(writer, OTLP_DATA_DATA_POINTS);
+
+    write_otlp_fixed64(writer, OTLP_SUMMARY_START_TIME_UNIX_NANO,
+                       data_point.start_time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_SUMMARY_TIME_UNIX_NANO,
+                       data_point.time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_SUMMARY_COUNT,
+                       cmt_summary_get_count_value(sample));
+    write_otlp_double(writer, OTLP_SUMMARY_SUM,
+                      cmt_summary_get_sum_value(sample));
+
+    if (sample->sum_quantiles != NULL) {
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            value = cmt_math_uint64_to_d64(sample->sum_quantiles[index]);
+
+            quantile_mark = cmt_protobuf_begin_message(writer,
+                                                       OTLP_SUMMARY_QUANTILE_VALUES);
+            write_otlp_double(writer, OTLP_QUANTILE_QUANTILE,
+                              summary->quantiles[index]);
+            write_otlp_double(writer, OTLP_QUANTILE_VALUE, value);
+            cmt_protobuf_end_message(writer, quantile_mark);
+        }
+    }
+
+    result = write_otlp_attributes(context, writer, OTLP_SUMMARY_ATTRIBUTES,
+                                   map, sample);
+
+    write_otlp_uint64(writer, OTLP_SUMMARY_FLAGS, data_point.flags);
+
+    cmt_protobuf_end_message(writer, mark);
+
+    return result;
+}
+
+static int write_otlp_histogram_data_point(struct cmt_opentelemetry_context *context,
+                                           struct cmt_protobuf_writer *writer,
+                                           struct cmt_map *map,
+                                           struct cmt_metric *sample,
+                                           uint64_t start_timestamp)
+{
+    int                                                    result;
+    size_t                                                 index;
+    size_t                                                 mark;
+    size_t                                                 bucket_count;
+    size_t                                                 bound_count;
+    struct cmt_histogram                                  *histogram;
+    Opentelemetry__Proto__Metrics__V1__HistogramDataPoint  data_point;
+
+    histogram = (struct cmt_histogram *) map->parent;
+    bound_count = histogram->buckets->count;
+    bucket_count = bound_count + 1;
+
+    opentelemetry__proto__metrics__v1__histogram_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+    data_point.count = cmt_metric_hist_get_count_value(sample);
+    data_point.sum = cmt_metric_hist_get_sum_value(sample);
+    data_point.has_sum = 1;
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    mark = cmt_protobuf_begin_message(writer, OTLP_DATA_DATA_POINTS);
+
+    write_otlp_fixed64(writer, OTLP_HISTOGRAM_START_TIME_UNIX_NANO,
+                       data_point.start_time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_HISTOGRAM_TIME_UNIX_NANO,
+                       data_point.time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_HISTOGRAM_COUNT, data_point.count);
+
+    if (data_point.has_sum) {
+        cmt_protobuf_write_double_field(writer, OTLP_HISTOGRAM_SUM, data_point.sum);
+    }
+
+    /* Packed fixed size fields, the length is known upfront */
+    cmt_protobuf_write_tag(writer, OTLP_HISTOGRAM_BUCKET_COUNTS,
+                           CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED);
+    cmt_protobuf_write_varint(writer, bucket_count * sizeof(uint64_t));
+
+    for (index = 0 ; index < bucket_count ; index++) {
+        cmt_protobuf_write_fixed64(writer,
+                                   sample->hist_buckets != NULL ?
+                                   sample->hist_buckets[index] : 0);
+    }
+
+    if (bound_count > 0) {
+        cmt_protobuf_write_tag(writer, OTLP_HISTOGRAM_EXPLICIT_BOUNDS,
+                               CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED);
+        cmt_protobuf_write_varint(writer, bound_count * sizeof(double));
+
+        for (index = 0 ; index < bound_count ; index++) {
+            cmt_protobuf_write_double(writer,
+                                      histogram->buckets->upper_bounds[index]);
+        }
+    }
+
+    write_otlp_exemplars(writer, OTLP_HISTOGRAM_EXEMPLARS,
+                         data_point.exemplars, data_point.n_exemplars);
+
+    result = write_otlp_attributes(context, writer, OTLP_HISTOGRAM_ATTRIBUTES,
+                                   map, sample);
+
+    write_otlp_uint64(writer, OTLP_HISTOGRAM_FLAGS, data_point.flags);
+
+    if (data_point.has_min) {
+        cmt_protobuf_write_double_field(writer, OTLP_HISTOGRAM_MIN, data_point.min);
+    }
+
+    if (data_point.has_max) {
+        cmt_protobuf_write_double_field(writer, OTLP_HISTOGRAM_MAX, data_point.max);
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_otlp_exponential_histogram_data_point(
+    struct cmt_opentelemetry_context *context,
+    struct cmt_protobuf_writer *writer,
+    struct cmt_map *map,
+    struct cmt_metric *sample,
+    uint64_t start_timestamp)
+{
+    int                                                               result;
+    size_t                                                            mark;
+    struct cmt_exp_histogram_snapshot                                 snapshot;
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint  data_point;
+
+    if (cmt_metric_exp_hist_get_snapshot(sample, &snapshot) != 0) {
+        return CMT_ENCODE_OPENTELEMETRY_DATA_POINT_INIT_ERROR;
+    }
+
+    opentelemetry__proto__metrics__v1__exponential_histogram_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+    data_point.count = snapshot.count;
+
+    if (snapshot.sum_set) {
+        data_point.has_sum = CMT_TRUE;
+        data_point.sum = cmt_math_uint64_to_d64(snapshot.sum);
+    }
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    mark = cmt_protobuf_begin_message(writer, OTLP_DATA_DATA_POINTS);
+
+    result = write_otlp_attributes(context, writer, OTLP_EXP_HISTOGRAM_ATTRIBUTES,
+                                   map, sample);
+
+    write_otlp_fixed64(writer, OTLP_EXP_HISTOGRAM_START_TIME_UNIX_NANO,
+                       data_point.start_time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_EXP_HISTOGRAM_TIME_UNIX_NANO,
+                       data_point.time_unix_nano);
+    write_otlp_fixed64(writer, OTLP_EXP_HISTOGRAM_COUNT, data_point.count);
+
+    if (data_point.has_sum) {
+        cmt_protobuf_write_double_field(writer, OTLP_EXP_HISTOGRAM_SUM, data_point.sum);
+    }
+
+    if (snapshot.scale != 0) {
+        cmt_protobuf_write_sint64_field(writer, OTLP_EXP_HISTOGRAM_SCALE, snapshot.scale);
+    }
+
+    write_otlp_fixed64(writer, OTLP_EXP_HISTOGRAM_ZERO_COUNT, snapshot.zero_count);
+
+    if (snapshot.positive_count > 0) {
+        write_otlp_exponential_buckets(writer, OTLP_EXP_HISTOGRAM_POSITIVE,
+                                       snapshot.positive_offset,
+                                       snapshot.positive_buckets,
+                                       snapshot.positive_count);
+    }
+
+    if (snapshot.negative_count > 0) {
+        write_otlp_exponential_buckets(writer, OTLP_EXP_HISTOGRAM_NEGATIVE,
+                                       snapshot.negative_offset,
+                                       snapshot.negative_buckets,
+                                       snapshot.negative_count);
+    }
+
+    write_otlp_uint64(writer, OTLP_EXP_HISTOGRAM_FLAGS, data_point.flags);
+
+    write_otlp_exemplars(writer, OTLP_EXP_HISTOGRAM_EXEMPLARS,
+                         data_point.exemplars, data_point.n_exemplars);
+
+    if (data_point.has_min) {
+        cmt_protobuf_write_double_field(writer, OTLP_EXP_HISTOGRAM_MIN, data_point.min);
+    }
+
+    if (data_point.has_max) {
+        cmt_protobuf_write_double_field(writer, OTLP_EXP_HISTOGRAM_MAX, data_point.max);
+    }
+
+    write_otlp_double(writer, OTLP_EXP_HISTOGRAM_ZERO_THRESHOLD,
+                      snapshot.zero_threshold);
+
+    cmt_protobuf_end_message(writer, mark);
+
+    cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_otlp_data_point(struct cmt_opentelemetry_context *context,
+                                 struct cmt_protobuf_writer *writer,
+                                 struct cmt_map *map,
+                                 struct cmt_metric *sample)
+{
+    uint64_t start_timestamp;
+
+    start_timestamp = 0;
+
+    if (cmt_metric_has_start_timestamp(sample)) {
+        start_timestamp = cmt_metric_get_start_timestamp(sample);
+    }
+
+    switch (map->type) {
+        case CMT_COUNTER:
+        case CMT_GAUGE:
+        case CMT_UNTYPED:
+            return write_otlp_number_data_point(context, writer, map,
+                                                sample, start_timestamp);
+        case CMT_SUMMARY:
+            return write_otlp_summary_data_point(context, writer, map,
+                                                 sample, start_timestamp);
+        case CMT_HISTOGRAM:
+            return write_otlp_histogram_data_point(context, writer, map,
+                                                   sample, start_timestamp);
+        case CMT_EXP_HISTOGRAM:
+            return write_otlp_exponential_histogram_data_point(context, writer, map,
+                                                               sample, start_timestamp);
+    }
+
+    return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+}
+
+static int write_otlp_metric(struct cmt_opentelemetry_context *context,
+                             struct cmt_protobuf_writer *writer,
+                             struct cmt_map *map)
+{
+    int                                        aggregation_temporality_type;
+    int                                        monotonism_flag;
+    int                                        result;
+    uint32_t                                   data_field;
+    size_t                                     metric_mark;
+    size_t                                     data_mark;
+    size_t                                     index;
+    struct cmt_metric                         *sample;
+    struct cfl_list                           *head;
+    Opentelemetry__Proto__Metrics__V1__Metric  metric;
+
+    switch (map->type) {
+        case CMT_COUNTER:
+            data_field = OTLP_METRIC_SUM;
+            break;
+        case CMT_GAUGE:
+        case CMT_UNTYPED:
+            data_field = OTLP_METRIC_GAUGE;
+            break;
+        case CMT_SUMMARY:
+            data_field = OTLP_METRIC_SUMMARY;
+            break;
+        case CMT_HISTOGRAM:
+            data_field = OTLP_METRIC_HISTOGRAM;
+            break;
+        case CMT_EXP_HISTOGRAM:
+            data_field = OTLP_METRIC_EXPONENTIAL_HISTOGRAM;
+            break;
+        default:
+            return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    resolve_metric_aggregation(map, &aggregation_temporality_type, &monotonism_flag);
+
+    metric_mark = cmt_protobuf_begin_message(writer, OTLP_SCOPE_METRICS_METRICS);
+
+    write_otlp_string(writer, OTLP_METRIC_NAME, map->opts->fqname);
+    write_otlp_string(writer, OTLP_METRIC_DESCRIPTION, map->opts->description);
+    write_otlp_string(writer, OTLP_METRIC_UNIT, map->unit);
+
+    data_mark = cmt_protobuf_begin_message(writer, data_field);
+
+    if (map->metric_static_set) {
+        result = write_otlp_data_point(context, writer, map, &map->metric);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        sample = cfl_list_entry(head, struct cmt_metric, _head);
+
+        result = write_otlp_data_point(context, writer, map, sample);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (map->type == CMT_COUNTER ||
+        map->type == CMT_HISTOGRAM ||
+        map->type == CMT_EXP_HISTOGRAM) {
+        write_otlp_uint64(writer, OTLP_DATA_AGGREGATION_TEMPORALITY,
+                          aggregation_temporality_type);
+    }
+
+    if (map->type == CMT_COUNTER && monotonism_flag) {
+        cmt_protobuf_write_bool_field(writer, OTLP_SUM_IS_MONOTONIC, CMT_TRUE);
+    }
+
+    cmt_protobuf_end_message(writer, data_mark);
+
+    /* Metric level metadata is rare, it goes through protobuf-c */
+    opentelemetry__proto__metrics__v1__metric__init(&metric);
+
+    apply_metric_metadata_from_otlp_context(context->cmt, map, &metric);
+
+    if (metric.metadata != NULL) {
+        for (index = 0 ; index < metric.n_metadata ; index++) {
+            write_otlp_message(writer, OTLP_METRIC_METADATA,
+                               &metric.metadata[index]->base);
+        }
+
+        otlp_kvpair_list_destroy(metric.metadata, metric.n_metadata);
+    }
+
+    cmt_protobuf_end_message(writer, metric_mark);
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int write_otlp_scope_map(struct cmt_opentelemetry_context *context,
+                                struct cmt_protobuf_writer *writer,
+                                struct cmt_map *map,
+                                size_t scope_index)
+{
+    if (is_metric_empty(map)) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    if (resolve_target_scope_index(context, map) != scope_index) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    return write_otlp_metric(context, writer, map);
+}
+
+static int write_otlp_scope_metrics(struct cmt_opentelemetry_context *context,
+                                    struct cmt_protobuf_writer *writer,
+                                    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics,
+                                    size_t scope_index)
+{
+    int                       result;
+    size_t                    mark;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_summary       *summary;
+    struct cmt_untyped       *untyped;
+    struct cmt_counter       *counter;
+    struct cmt_gauge         *gauge;
+    struct cfl_list          *head;
+    struct cmt               *cmt;
+
+    cmt = context->cmt;
+    result = CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+
+    mark = cmt_protobuf_begin_message(writer, OTLP_RESOURCE_METRICS_SCOPE_METRICS);
+
+    if (scope_metrics->scope != NULL) {
+        write_otlp_message(writer, OTLP_SCOPE_METRICS_SCOPE,
+                           &scope_metrics->scope->base);
+    }
+
+    cfl_list_foreach(head, &cmt->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        result = write_otlp_scope_map(context, writer, counter->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        result = write_otlp_scope_map(context, writer, gauge->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->untypeds) {
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        result = write_otlp_scope_map(context, writer, untyped->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        result = write_otlp_scope_map(context, writer, summary->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        result = write_otlp_scope_map(context, writer, histogram->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        result = write_otlp_scope_map(context, writer, exp_histogram->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    write_otlp_string(writer, OTLP_SCOPE_METRICS_SCHEMA_URL, scope_metrics->schema_url);
+
+    cmt_protobuf_end_message(writer, mark);
+
+    return result;
+}
+
+static int write_opentelemetry_context(struct cmt_opentelemetry_context *context,
+                                       struct cmt_protobuf_writer *writer)
+{
+    int                                                 result;
+    size_t                                              mark;
+    size_t                                              resource_index;
+    size_t                                              scope_index;
+    size_t                                              flat_scope_index;
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics;
+
+    flat_scope_index = 0;
+
+    for (resource_index = 0 ;
+         resource_index < context->metrics_data->n_resource_metrics ;
+         resource_index++) {
+        resource_metrics = context->metrics_data->resource_metrics[resource_index];
+
+        mark = cmt_protobuf_begin_message(writer, OTLP_METRICS_DATA_RESOURCE_METRICS);
+
+        if (resource_metrics->resource != NULL) {
+            write_otlp_message(writer, OTLP_RESOURCE_METRICS_RESOURCE,
+                               &resource_metrics->resource->base);
+        }
+
+        for (scope_index = 0 ;
+             scope_index < resource_metrics->n_scope_metrics ;
+             scope_index++) {
+            result = write_otlp_scope_metrics(context, writer,
+                                              resource_metrics->scope_metrics[scope_index],
+                                              flat_scope_index++);
+
+            if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+                return result;
+            }
+        }
+
+        write_otlp_string(writer, OTLP_RESOURCE_METRICS_SCHEMA_URL,
+                          resource_metrics->schema_url);
+
+        cmt_protobuf_end_message(writer, mark);
+    }
+
+    if (writer->error != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return CMT_ENCODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+cfl_sds_t cmt_encode_opentelemetry_create(struct cmt *cmt)
+{
+    struct cmt_opentelemetry_context *context;
+    struct cmt_protobuf_writer        writer;
+    int                               result;
+    cfl_sds_t                         buf;
+
+    buf = NULL;
+
+    context = initialize_opentelemetry_context(cmt);
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    result = cmt_protobuf_writer_init(&writer, CMT_OTLP_WRITER_INITIAL_SIZE);
+
+    if (result != CMT_PROTOBUF_WIRE_SUCCESS) {
+        destroy_opentelemetry_context(context);
+
+        return NULL;
+    }
+
+    result = write_opentelemetry_context(context, &writer);
+
+    if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+        buf = cmt_protobuf_writer_to_sds(&writer);
+    }
+
+    cmt_protobuf_writer_destroy(&writer);
+    destroy_opentelemetry_context(context);
+
+    return buf;
+}
+
+struct cfl_list *cmt_encode_opentelemetry_create_split(struct cmt *cmt,
+                                                       size_t max_bytes,
+                                                       size_t max_series)
+{
+    struct cmt_opentelemetry_context *context;
+    struct cmt_opentelemetry_encoder *encoder;
+    struct cfl_list                  *payloads;
+    int                               result;
+
+    payloads = cmt_encode_split_create();
+
+    if (payloads == NULL) {
+        return NULL;
+    }
+
+    context = initialize_opentelemetry_context(cmt);
+
+    if (context == NULL) {
+        cmt_encode_split_destroy(payloads);
+
+        return NULL;
+    }
+
+    encoder = (struct cmt_opentelemetry_encoder *) context;
+
+    /*
+     * Every payload repeats the resource and scope envelopes, leave room for
+     * their length prefixes to grow.
+     */
+    encoder->split_payloads = payloads;
+    encoder->split_max_bytes = max_bytes;
+    encoder->split_max_series = max_series;
+    encoder->split_base_bytes =
+        opentelemetry__proto__metrics__v1__metrics_data__get_packed_size(context->metrics_data) +
+        context->scope_metrics_count * 8;
+    encoder->split_pending_bytes = encoder->split_base_bytes;
+
+    result = pack_opentelemetry_context(context);
+
+    if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS &&
+        encoder->split_pending_series > 0) {
+        result = flush_split_payload(context, NULL, NULL, 0, NULL);
+    }
+
+    destroy_opentelemetry_context(context);
+
+    if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+        cmt_encode_split_destroy(payloads);
+
+        return NULL;
+    }
+
+    return payloads;
+}
+
+void cmt_encode_opentelemetry_destroy(cfl_sds_t text)
+{
+    cfl_sds_destroy(text);
+}
+
+/*
+ * OTLP/JSON encoder: same walk as the direct wire format encoder, following
+ * the protobuf JSON mapping used by the OTLP/HTTP JSON transport. Field names
+ * are lowerCamelCase, 64 bit integers are quoted strings, enums are written as
+ * integers, trace and span identifiers are hex strings and proto3 default
+ * values are omitted. aggregationTemporality and isMonotonic are always
+ * written ahead of dataPoints so a decoder reading the output can create
+ * the metric before the first data point arrives.
+ */
+static void write_json_any_value(struct cmt_json_writer *writer,
+                                 Opentelemetry__Proto__Common__V1__AnyValue *value);
+
+static void write_json_string(struct cmt_json_writer *writer,
+                              const char *key, const char *value)
+{
+    if (value != NULL && value[0] != '\0') {
+        cmt_json_write_key(writer, key);
+        cmt_json_write_string(writer, value, strlen(value));
+    }
+}
+
+static void write_json_uint64(struct cmt_json_writer *writer,
+                              const char *key, uint64_t value)
+{
+    if (value != 0) {
+        cmt_json_write_key(writer, key);
+        cmt_json_write_uint64_string(writer, value);
+    }
+}
+
+static void write_json_double(struct cmt_json_writer *writer,
+                              const char *key, double value)
+{
+    if (value != 0) {
+        cmt_json_write_key(writer, key);
+        cmt_json_write_double(writer, value);
+    }
+}
+
+static void write_json_key_value(struct cmt_json_writer *writer,
+                                 Opentelemetry__Proto__Common__V1__KeyValue *pair)
+{
+    cmt_json_begin_object(writer);
+
+    write_json_string(writer, "key", pair->key);
+
+    if (pair->value != NULL) {
+        cmt_json_write_key(writer, "value");
+        write_json_any_value(writer, pair->value);
+    }
+
+    cmt_json_end_object(writer);
+}
+
+static void write_json_key_values(struct cmt_json_writer *writer,
+                                  const char *key,
+                                  Opentelemetry__Proto__Common__V1__KeyValue **pairs,
+                                  size_t pair_count)
+{
+    size_t index;
+
+    if (pair_count == 0) {
+        return;
+    }
+
+    cmt_json_write_key(writer, key);
+    cmt_json_begin_array(writer);
+
+    for (index = 0 ; index < pair_count ; index++) {
+        write_json_key_value(writer, pairs[index]);
+    }
+
+    cmt_json_end_array(writer);
+}
+
+static void write_json_any_value(struct cmt_json_writer *writer,
+                                 Opentelemetry__Proto__Common__V1__AnyValue *value)
+{
+    size_t index;
+
+    cmt_json_begin_object(writer);
+
+    switch (value->value_case) {
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE:
+            cmt_json_write_key(writer, "stringValue");
+            cmt_json_write_string(writer, value->string_value,
+                                  strlen(value->string_value));
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BOOL_VALUE:
+            cmt_json_write_key(writer, "boolValue");
+            cmt_json_write_bool(writer, value->bool_value);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_INT_VALUE:
+            cmt_json_write_key(writer, "intValue");
+            cmt_json_write_int64_string(writer, value->int_value);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_DOUBLE_VALUE:
+            cmt_json_write_key(writer, "doubleValue");
+            cmt_json_write_double(writer, value->double_value);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_ARRAY_VALUE:
+            cmt_json_write_key(writer, "arrayValue");
+            cmt_json_begin_object(writer);
+
+            if (value->array_value != NULL && value->array_value->n_values > 0) {
+                cmt_json_write_key(writer, "values");
+                cmt_json_begin_array(writer);
+
+                for (index = 0 ; index < value->array_value->n_values ; index++) {
+                    write_json_any_value(writer, value->array_value->values[index]);
+                }
+
+                cmt_json_end_array(writer);
+            }
+
+            cmt_json_end_object(writer);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_KVLIST_VALUE:
+            cmt_json_write_key(writer, "kvlistValue");
+            cmt_json_begin_object(writer);
+
+            if (value->kvlist_value != NULL) {
+                write_json_key_values(writer, "values",
+                                      value->kvlist_value->values,
+                                      value->kvlist_value->n_values);
+            }
+
+            cmt_json_end_object(writer);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_BYTES_VALUE:
+            cmt_json_write_key(writer, "bytesValue");
+            cmt_json_write_base64(writer, value->bytes_value.data,
+                                  value->bytes_value.len);
+            break;
+        case OPENTELEMETRY__PROTO__COMMON__V1__ANY_VALUE__VALUE_STRING_VALUE_STRINDEX:
+            cmt_json_write_key(writer, "stringValueStrindex");
+            cmt_json_write_int64(writer, value->string_value_strindex);
+            break;
+        default:
+            break;
+    }
+
+    cmt_json_end_object(writer);
+}
+
+static void write_json_string_attribute(struct cmt_json_writer *writer,
+                                        const char *key, const char *value)
+{
+    cmt_json_begin_object(writer);
+
+    write_json_string(writer, "key", key);
+
+    cmt_json_write_key(writer, "value");
+    cmt_json_begin_object(writer);
+    cmt_json_write_key(writer, "stringValue");
+    cmt_json_write_string(writer, value, strlen(value));
+    cmt_json_end_object(writer);
+
+    cmt_json_end_object(writer);
+}
+
+static int write_json_attributes(struct cmt_opentelemetry_context *context,
+                                 struct cmt_json_writer *writer,
+                                 struct cmt_map *map,
+                                 struct cmt_metric *sample)
+{
+    int                   result;
+    size_t                label_name_count;
+    size_t                label_name_index;
+    size_t                sample_label_count;
+    struct cmt_label     *static_label;
+    struct cmt_map_label *label_value;
+    struct cmt_map_label *label_name;
+    struct cfl_list      *head;
+
+    sample_label_count = 0;
+    cfl_list_foreach(head, &sample->labels) {
+        label_value = cfl_list_entry(head, struct cmt_map_label, _head);
+        if (label_value->name != NULL) {
+            sample_label_count++;
+        }
+    }
+
+    label_name_count = map->label_count;
+    if (sample_label_count > label_name_count) {
+        return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (sample_label_count == 0 &&
+        cfl_list_is_empty(&context->cmt->static_labels->list)) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    cmt_json_write_key(writer, "attributes");
+    cmt_json_begin_array(writer);
+
+    cfl_list_foreach(head, &context->cmt->static_labels->list) {
+        static_label = cfl_list_entry(head, struct cmt_label, _head);
+
+        write_json_string_attribute(writer, static_label->key, static_label->val);
+    }
+
+    label_name = NULL;
+    if (label_name_count > 0) {
+        label_name = cfl_list_entry_first(&map->label_keys, struct cmt_map_label, _head);
+    }
+
+    result = CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    label_name_index = 0;
+    cfl_list_foreach(head, &sample->labels) {
+        label_value = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label_value->name != NULL) {
+            if (label_name_index >= label_name_count ||
+                label_name == NULL || label_name->name == NULL) {
+                result = CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+                break;
+            }
+
+            write_json_string_attribute(writer, label_name->name, label_value->name);
+        }
+
+        label_name_index++;
+        if (label_name_index < label_name_count) {
+            label_name = cfl_list_entry_next(&label_name->_head, struct cmt_map_label,
+                                             _head, &map->label_keys);
+        }
+    }
+
+    cmt_json_end_array(writer);
+
+    return result;
+}
+
+static void write_json_exemplars(struct cmt_json_writer *writer,
+                                 Opentelemetry__Proto__Metrics__V1__Exemplar **exemplars,
+                                 size_t exemplar_count)
+{
+    size_t                                       index;
+    Opentelemetry__Proto__Metrics__V1__Exemplar *exemplar;
+
+    if (exemplar_count == 0) {
+        return;
+    }
+
+    cmt_json_write_key(writer, "exemplars");
+    cmt_json_begin_array(writer);
+
+    for (index = 0 ; index < exemplar_count ; index++) {
+        exemplar = exemplars[index];
+
+        cmt_json_begin_object(writer);
+
+        write_json_key_values(writer, "filteredAttributes",
+                              exemplar->filtered_attributes,
+                              exemplar->n_filtered_attributes);
+        write_json_uint64(writer, "timeUnixNano", exemplar->time_unix_nano);
+
+        if (exemplar->value_case == OPENTELEMETRY__PROTO__METRICS__V1__EXEMPLAR__VALUE_AS_DOUBLE) {
+            cmt_json_write_key(writer, "asDouble");
+            cmt_json_write_double(writer, exemplar->as_double);
+        }
+        else if (exemplar->value_case == OPENTELEMETRY__PROTO__METRICS__V1__EXEMPLAR__VALUE_AS_INT) {
+            cmt_json_write_key(writer, "asInt");
+            cmt_json_write_int64_string(writer, exemplar->as_int);
+        }
+
+        if (exemplar->span_id.len > 0) {
+            cmt_json_write_key(writer, "spanId");
+            cmt_json_write_hex(writer, exemplar->span_id.data, exemplar->span_id.len);
+        }
+
+        if (exemplar->trace_id.len > 0) {
+            cmt_json_write_key(writer, "traceId");
+            cmt_json_write_hex(writer, exemplar->trace_id.data, exemplar->trace_id.len);
+        }
+
+        cmt_json_end_object(writer);
+    }
+
+    cmt_json_end_array(writer);
+}
+
+static void write_json_exponential_buckets(struct cmt_json_writer *writer,
+                                           const char *key,
+                                           int32_t offset,
+                                           uint64_t *bucket_counts,
+                                           size_t bucket_count)
+{
+    size_t index;
+
+    cmt_json_write_key(writer, key);
+    cmt_json_begin_object(writer);
+
+    if (offset != 0) {
+        cmt_json_write_key(writer, "offset");
+        cmt_json_write_int64(writer, offset);
+    }
+
+    cmt_json_write_key(writer, "bucketCounts");
+    cmt_json_begin_array(writer);
+
+    for (index = 0 ; index < bucket_count ; index++) {
+        cmt_json_write_uint64_string(writer, bucket_counts[index]);
+    }
+
+    cmt_json_end_array(writer);
+
+    cmt_json_end_object(writer);
+}
+
+static int write_json_number_data_point(struct cmt_opentelemetry_context *context,
+                                        struct cmt_json_writer *writer,
+                                        struct cmt_map *map,
+                                        struct cmt_metric *sample,
+                                        uint64_t start_timestamp)
+{
+    int                                                 result;
+    Opentelemetry__Proto__Metrics__V1__NumberDataPoint  data_point;
+
+    opentelemetry__proto__metrics__v1__number_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+
+    set_numerical_data_point_value(&data_point, sample);
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    cmt_json_begin_object(writer);
+
+    result = write_json_attributes(context, writer, map, sample);
+
+    write_json_uint64(writer, "startTimeUnixNano", data_point.start_time_unix_nano);
+    write_json_uint64(writer, "timeUnixNano", data_point.time_unix_nano);
+
+    if (data_point.value_case == OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_DOUBLE) {
+        cmt_json_write_key(writer, "asDouble");
+        cmt_json_write_double(writer, data_point.as_double);
+    }
+    else if (data_point.value_case == OPENTELEMETRY__PROTO__METRICS__V1__NUMBER_DATA_POINT__VALUE_AS_INT) {
+        cmt_json_write_key(writer, "asInt");
+        cmt_json_write_int64_string(writer, data_point.as_int);
+    }
+
+    write_json_exemplars(writer, data_point.exemplars, data_point.n_exemplars);
+
+    if (data_point.flags != 0) {
+        cmt_json_write_key(writer, "flags");
+        cmt_json_write_uint64(writer, data_point.flags);
+    }
+
+    cmt_json_end_object(writer);
+
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_json_summary_data_point(struct cmt_opentelemetry_context *context,
+                                         struct cmt_json_writer *writer,
+                                         struct cmt_map *map,
+                                         struct cmt_metric *sample,
+                                         uint64_t start_timestamp)
+{
+    int                                                  result;
+    size_t                                               index;
+    struct cmt_summary                                  *summary;
+    Opentelemetry__Proto__Metrics__V1__SummaryDataPoint  data_point;
+
+    summary = (struct cmt_summary *) map->parent;
+
+    opentelemetry__proto__metrics__v1__summary_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    cmt_json_begin_object(writer);
+
+    result = write_json_attributes(context, writer, map, sample);
+
+    write_json_uint64(writer, "startTimeUnixNano", data_point.start_time_unix_nano);
+    write_json_uint64(writer, "timeUnixNano", data_point.time_unix_nano);
+    write_json_uint64(writer, "count", cmt_summary_get_count_value(sample));
+    write_json_double(writer, "sum", cmt_summary_get_sum_value(sample));
+
+    if (sample->sum_quantiles != NULL && summary->quantiles_count > 0) {
+        cmt_json_write_key(writer, "quantileValues");
+        cmt_json_begin_array(writer);
+
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            cmt_json_begin_object(writer);
+            write_json_double(writer, "quantile", summary->quantiles[index]);
+            write_json_double(writer, "value",
+                              cmt_math_uint64_to_d64(sample->sum_quantiles[index]));
+            cmt_json_end_object(writer);
+        }
+
+        cmt_json_end_array(writer);
+    }
+
+    if (data_point.flags != 0) {
+        cmt_json_write_key(writer, "flags");
+        cmt_json_write_uint64(writer, data_point.flags);
+    }
+
+    cmt_json_end_object(writer);
+
+    return result;
+}
+
+static int write_json_histogram_data_point(struct cmt_opentelemetry_context *context,
+                                           struct cmt_json_writer *writer,
+                                           struct cmt_map *map,
+                                           struct cmt_metric *sample,
+                                           uint64_t start_timestamp)
+{
+    int                                                    result;
+    size_t                                                 index;
+    size_t                                                 bucket_count;
+    size_t                                                 bound_count;
+    struct cmt_histogram                                  *histogram;
+    Opentelemetry__Proto__Metrics__V1__HistogramDataPoint  data_point;
+
+    histogram = (struct cmt_histogram *) map->parent;
+    bound_count = histogram->buckets->count;
+    bucket_count = bound_count + 1;
+
+    opentelemetry__proto__metrics__v1__histogram_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+    data_point.count = cmt_metric_hist_get_count_value(sample);
+    data_point.sum = cmt_metric_hist_get_sum_value(sample);
+    data_point.has_sum = 1;
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    cmt_json_begin_object(writer);
+
+    result = write_json_attributes(context, writer, map, sample);
+
+    write_json_uint64(writer, "startTimeUnixNano", data_point.start_time_unix_nano);
+    write_json_uint64(writer, "timeUnixNano", data_point.time_unix_nano);
+    write_json_uint64(writer, "count", data_point.count);
+
+    if (data_point.has_sum) {
+        cmt_json_write_key(writer, "sum");
+        cmt_json_write_double(writer, data_point.sum);
+    }
+
+    cmt_json_write_key(writer, "bucketCounts");
+    cmt_json_begin_array(writer);
+
+    for (index = 0 ; index < bucket_count ; index++) {
+        cmt_json_write_uint64_string(writer,
+                                     sample->hist_buckets != NULL ?
+                                     sample->hist_buckets[index] : 0);
+    }
+
+    cmt_json_end_array(writer);
+
+    if (bound_count > 0) {
+        cmt_json_write_key(writer, "explicitBounds");
+        cmt_json_begin_array(writer);
+
+        for (index = 0 ; index < bound_count ; index++) {
+            cmt_json_write_double(writer, histogram->buckets->upper_bounds[index]);
+        }
+
+        cmt_json_end_array(writer);
+    }
+
+    write_json_exemplars(writer, data_point.exemplars, data_point.n_exemplars);
+
+    if (data_point.flags != 0) {
+        cmt_json_write_key(writer, "flags");
+        cmt_json_write_uint64(writer, data_point.flags);
+    }
+
+    if (data_point.has_min) {
+        cmt_json_write_key(writer, "min");
+        cmt_json_write_double(writer, data_point.min);
+    }
+
+    if (data_point.has_max) {
+        cmt_json_write_key(writer, "max");
+        cmt_json_write_double(writer, data_point.max);
+    }
+
+    cmt_json_end_object(writer);
+
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_json_exponential_histogram_data_point(
+    struct cmt_opentelemetry_context *context,
+    struct cmt_json_writer *writer,
+    struct cmt_map *map,
+    struct cmt_metric *sample,
+    uint64_t start_timestamp)
+{
+    int                                                               result;
+    struct cmt_exp_histogram_snapshot                                 snapshot;
+    Opentelemetry__Proto__Metrics__V1__ExponentialHistogramDataPoint  data_point;
+
+    if (cmt_metric_exp_hist_get_snapshot(sample, &snapshot) != 0) {
+        return CMT_ENCODE_OPENTELEMETRY_DATA_POINT_INIT_ERROR;
+    }
+
+    opentelemetry__proto__metrics__v1__exponential_histogram_data_point__init(&data_point);
+
+    data_point.start_time_unix_nano = start_timestamp;
+    data_point.time_unix_nano = cmt_metric_get_timestamp(sample);
+    data_point.count = snapshot.count;
+
+    if (snapshot.sum_set) {
+        data_point.has_sum = CMT_TRUE;
+        data_point.sum = cmt_math_uint64_to_d64(snapshot.sum);
+    }
+
+    apply_data_point_metadata_from_otlp_context(context->cmt, map, sample, &data_point);
+
+    cmt_json_begin_object(writer);
+
+    result = write_json_attributes(context, writer, map, sample);
+
+    write_json_uint64(writer, "startTimeUnixNano", data_point.start_time_unix_nano);
+    write_json_uint64(writer, "timeUnixNano", data_point.time_unix_nano);
+    write_json_uint64(writer, "count", data_point.count);
+
+    if (data_point.has_sum) {
+        cmt_json_write_key(writer, "sum");
+        cmt_json_write_double(writer, data_point.sum);
+    }
+
+    if (snapshot.scale != 0) {
+        cmt_json_write_key(writer, "scale");
+        cmt_json_write_int64(writer, snapshot.scale);
+    }
+
+    write_json_uint64(writer, "zeroCount", snapshot.zero_count);
+
+    if (snapshot.positive_count > 0) {
+        write_json_exponential_buckets(writer, "positive",
+                                       snapshot.positive_offset,
+                                       snapshot.positive_buckets,
+                                       snapshot.positive_count);
+    }
+
+    if (snapshot.negative_count > 0) {
+        write_json_exponential_buckets(writer, "negative",
+                                       snapshot.negative_offset,
+                                       snapshot.negative_buckets,
+                                       snapshot.negative_count);
+    }
+
+    if (data_point.flags != 0) {
+        cmt_json_write_key(writer, "flags");
+        cmt_json_write_uint64(writer, data_point.flags);
+    }
+
+    write_json_exemplars(writer, data_point.exemplars, data_point.n_exemplars);
+
+    if (data_point.has_min) {
+        cmt_json_write_key(writer, "min");
+        cmt_json_write_double(writer, data_point.min);
+    }
+
+    if (data_point.has_max) {
+        cmt_json_write_key(writer, "max");
+        cmt_json_write_double(writer, data_point.max);
+    }
+
+    write_json_double(writer, "zeroThreshold", snapshot.zero_threshold);
+
+    cmt_json_end_object(writer);
+
+    cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+    destroy_data_point(&data_point, map->type);
+
+    return result;
+}
+
+static int write_json_data_point(struct cmt_opentelemetry_context *context,
+                                 struct cmt_json_writer *writer,
+                                 struct cmt_map *map,
+                                 struct cmt_metric *sample)
+{
+    uint64_t start_timestamp;
+
+    start_timestamp = 0;
+
+    if (cmt_metric_has_start_timestamp(sample)) {
+        start_timestamp = cmt_metric_get_start_timestamp(sample);
+    }
+
+    switch (map->type) {
+        case CMT_COUNTER:
+        case CMT_GAUGE:
+        case CMT_UNTYPED:
+            return write_json_number_data_point(context, writer, map,
+                                                sample, start_timestamp);
+        case CMT_SUMMARY:
+            return write_json_summary_data_point(context, writer, map,
+                                                 sample, start_timestamp);
+        case CMT_HISTOGRAM:
+            return write_json_histogram_data_point(context, writer, map,
+                                                   sample, start_timestamp);
+        case CMT_EXP_HISTOGRAM:
+            return write_json_exponential_histogram_data_point(context, writer, map,
+                                                               sample, start_timestamp);
+    }
+
+    return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+}
+
+static int write_json_metric(struct cmt_opentelemetry_context *context,
+                             struct cmt_json_writer *writer,
+                             struct cmt_map *map)
+{
+    int                                        aggregation_temporality_type;
+    int                                        monotonism_flag;
+    int                                        result;
+    char                                      *data_key;
+    struct cmt_metric                         *sample;
+    struct cfl_list                           *head;
+    Opentelemetry__Proto__Metrics__V1__Metric  metric;
+
+    switch (map->type) {
+        case CMT_COUNTER:
+            data_key = "sum";
+            break;
+        case CMT_GAUGE:
+        case CMT_UNTYPED:
+            data_key = "gauge";
+            break;
+        case CMT_SUMMARY:
+            data_key = "summary";
+            break;
+        case CMT_HISTOGRAM:
+            data_key = "histogram";
+            break;
+        case CMT_EXP_HISTOGRAM:
+            data_key = "exponentialHistogram";
+            break;
+        default:
+            return CMT_ENCODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR;
+    }
+
+    resolve_metric_aggregation(map, &aggregation_temporality_type, &monotonism_flag);
+
+    cmt_json_begin_object(writer);
+
+    write_json_string(writer, "name", map->opts->fqname);
+    write_json_string(writer, "description", map->opts->description);
+    write_json_string(writer, "unit", map->unit);
+
+    cmt_json_write_key(writer, data_key);
+    cmt_json_begin_object(writer);
+
+    if (map->type == CMT_COUNTER ||
+        map->type == CMT_HISTOGRAM ||
+        map->type == CMT_EXP_HISTOGRAM) {
+        cmt_json_write_key(writer, "aggregationTemporality");
+        cmt_json_write_uint64(writer, aggregation_temporality_type);
+    }
+
+    if (map->type == CMT_COUNTER) {
+        cmt_json_write_key(writer, "isMonotonic");
+        cmt_json_write_bool(writer, monotonism_flag);
+    }
+
+    cmt_json_write_key(writer, "dataPoints");
+    cmt_json_begin_array(writer);
+
+    if (map->metric_static_set) {
+        result = write_json_data_point(context, writer, map, &map->metric);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        sample = cfl_list_entry(head, struct cmt_metric, _head);
+
+        result = write_json_data_point(context, writer, map, sample);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cmt_json_end_array(writer);
+    cmt_json_end_object(writer);
+
+    opentelemetry__proto__metrics__v1__metric__init(&metric);
+
+    apply_metric_metadata_from_otlp_context(context->cmt, map, &metric);
+
+    if (metric.metadata != NULL) {
+        write_json_key_values(writer, "metadata", metric.metadata, metric.n_metadata);
+
+        otlp_kvpair_list_destroy(metric.metadata, metric.n_metadata);
+    }
+
+    cmt_json_end_object(writer);
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+static int write_json_scope_map(struct cmt_opentelemetry_context *context,
+                                struct cmt_json_writer *writer,
+                                struct cmt_map *map,
+                                size_t scope_index)
+{
+    if (is_metric_empty(map)) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    if (resolve_target_scope_index(context, map) != scope_index) {
+        return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+    }
+
+    return write_json_metric(context, writer, map);
+}
+
+static int write_json_scope_metrics(struct cmt_opentelemetry_context *context,
+                                    struct cmt_json_writer *writer,
+                                    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics,
+                                    size_t scope_index)
+{
+    int                                                    result;
+    struct cmt_histogram                                  *histogram;
+    struct cmt_exp_histogram                              *exp_histogram;
+    struct cmt_summary                                    *summary;
+    struct cmt_untyped                                    *untyped;
+    struct cmt_counter                                    *counter;
+    struct cmt_gauge                                      *gauge;
+    struct cfl_list                                       *head;
+    struct cmt                                            *cmt;
+    Opentelemetry__Proto__Common__V1__InstrumentationScope *scope;
+
+    cmt = context->cmt;
+    result = CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+
+    cmt_json_begin_object(writer);
+
+    scope = scope_metrics->scope;
+
+    if (scope != NULL) {
+        cmt_json_write_key(writer, "scope");
+        cmt_json_begin_object(writer);
+
+        write_json_string(writer, "name", scope->name);
+        write_json_string(writer, "version", scope->version);
+        write_json_key_values(writer, "attributes",
+                              scope->attributes, scope->n_attributes);
+
+        if (scope->dropped_attributes_count != 0) {
+            cmt_json_write_key(writer, "droppedAttributesCount");
+            cmt_json_write_uint64(writer, scope->dropped_attributes_count);
+        }
+
+        cmt_json_end_object(writer);
+    }
+
+    cmt_json_write_key(writer, "metrics");
+    cmt_json_begin_array(writer);
+
+    cfl_list_foreach(head, &cmt->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        result = write_json_scope_map(context, writer, counter->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        result = write_json_scope_map(context, writer, gauge->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->untypeds) {
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        result = write_json_scope_map(context, writer, untyped->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        result = write_json_scope_map(context, writer, summary->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        result = write_json_scope_map(context, writer, histogram->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        result = write_json_scope_map(context, writer, exp_histogram->map, scope_index);
+
+        if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+            return result;
+        }
+    }
+
+    cmt_json_end_array(writer);
+
+    write_json_string(writer, "schemaUrl", scope_metrics->schema_url);
+
+    cmt_json_end_object(writer);
+
+    return result;
+}
+
+static int write_json_opentelemetry_context(struct cmt_opentelemetry_context *context,
+                                            struct cmt_json_writer *writer)
+{
+    int                                                 result;
+    size_t                                              resource_index;
+    size_t                                              scope_index;
+    size_t                                              flat_scope_index;
+    Opentelemetry__Proto__Resource__V1__Resource       *resource;
+    Opentelemetry__Proto__Metrics__V1__ResourceMetrics *resource_metrics;
+
+    flat_scope_index = 0;
+
+    cmt_json_begin_object(writer);
+    cmt_json_write_key(writer, "resourceMetrics");
+    cmt_json_begin_array(writer);
+
+    for (resource_index = 0 ;
+         resource_index < context->metrics_data->n_resource_metrics ;
+         resource_index++) {
+        resource_metrics = context->metrics_data->resource_metrics[resource_index];
+        resource = resource_metrics->resource;
+
+        cmt_json_begin_object(writer);
+
+        if (resource != NULL) {
+            cmt_json_write_key(writer, "resource");
+            cmt_json_begin_object(writer);
+
+            write_json_key_values(writer, "attributes",
+                                  resource->attributes, resource->n_attributes);
+
+            if (resource->dropped_attributes_count != 0) {
+                cmt_json_write_key(writer, "droppedAttributesCount");
+                cmt_json_write_uint64(writer, resource->dropped_attributes_count);
+            }
+
+            cmt_json_end_object(writer);
+        }
+
+        cmt_json_write_key(writer, "scopeMetrics");
+        cmt_json_begin_array(writer);
+
+        for (scope_index = 0 ;
+             scope_index < resource_metrics->n_scope_metrics ;
+             scope_index++) {
+            result = write_json_scope_metrics(context, writer,
+                                              resource_metrics->scope_metrics[scope_index],
+                                              flat_scope_index++);
+
+            if (result != CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+                return result;
+            }
+        }
+
+        cmt_json_end_array(writer);
+
+        write_json_string(writer, "schemaUrl", resource_metrics->schema_url);
+
+        cmt_json_end_object(writer);
+    }
+
+    cmt_json_end_array(writer);
+    cmt_json_end_object(writer);
+
+    if (writer->error != CMT_JSON_SUCCESS) {
+        return CMT_ENCODE_OPENTELEMETRY_ALLOCATION_ERROR;
+    }
+
+    return CMT_ENCODE_OPENTELEMETRY_SUCCESS;
+}
+
+cfl_sds_t cmt_encode_opentelemetry_json_create(struct cmt *cmt)
+{
+    struct cmt_opentelemetry_context *context;
+    struct cmt_json_writer            writer;
+    int                               result;
+    cfl_sds_t                         buf;
+
+    buf = NULL;
+
+    context = initialize_opentelemetry_context(cmt);
+
+    if (context == NULL) {
+        return NULL;
+    }
+
+    result = cmt_json_writer_init(&writer, CMT_OTLP_WRITER_INITIAL_SIZE);
+
+    if (result != CMT_JSON_SUCCESS) {
+        destroy_opentelemetry_context(context);
+
+        return NULL;
+    }
+
+    result = write_json_opentelemetry_context(context, &writer);
+
+    if (result == CMT_ENCODE_OPENTELEMETRY_SUCCESS) {
+        buf = cmt_json_writer_to_sds(&writer);
+    }
+
+    cmt_json_writer_destroy(&writer);
+    destroy_opentelemetry_context(context);
+
+    return buf;
+}
+
+void cmt_encode_opentelemetry_json_destroy(cfl_sds_t text)
 {
     cfl_sds_destroy(text);
 }
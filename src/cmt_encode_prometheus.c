@@ -30,6 +30,7 @@
 #include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_atomic.h>
+#include <cmetrics/cmt_math.h>
 
 #include <cmetrics/cmt_untyped.h>
 #include <cmetrics/cmt_compat.h>
@@ -197,17 +198,19 @@ static void append_metric_value(cfl_sds_t *buf,
         }
     }
 
+    tmp[0] = ' ';
+    len = 1 + cmt_math_format_double(&tmp[1], val);
+
     if (add_timestamp) {
         ts = cmt_metric_get_timestamp(metric);
 
         /* convert from nanoseconds to milliseconds */
         ts /= 1000000;
 
-        len = snprintf(tmp, sizeof(tmp) - 1, " %.17g %" PRIu64 "\n", val, ts);
-    }
-    else {
-        len = snprintf(tmp, sizeof(tmp) - 1, " %.17g\n", val);
+        tmp[len++] = ' ';
+        len += cmt_math_format_uint64(&tmp[len], ts);
     }
+    tmp[len++] = '\n';
     cfl_sds_cat_safe(buf, tmp, len);
 }
 
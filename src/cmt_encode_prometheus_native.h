@@ -0,0 +1,57 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+/*
+ * Native histogram helpers shared by the prometheus protobuf and remote write
+ * encoders, not part of the public API.
+ */
+
+#ifndef CMT_ENCODE_PROMETHEUS_NATIVE_H
+#define CMT_ENCODE_PROMETHEUS_NATIVE_H
+
+#include <cmetrics/cmetrics.h>
+#include "cmt_protobuf_wire.h"
+
+/*
+ * Pack the spans and the packed deltas of one side of a native histogram,
+ * 'reduction' is the number of scale steps the buckets are merged down by.
+ * The BucketSpan layout is shared by the exposition format and remote write
+ * 2.0, so the field numbers are supplied by the caller. Returns CMT_TRUE when
+ * at least one bucket was packed.
+ */
+int cmt_encode_prometheus_protobuf_native_buckets(struct cmt_protobuf_writer *writer,
+                                                  uint64_t *counts, size_t count,
+                                                  int32_t offset, int reduction,
+                                                  uint32_t span_field,
+                                                  uint32_t delta_field);
+
+/*
+ * Same layout for encoders that build message structures instead of packing
+ * the fields. There are at most 'count' spans and 3 * 'count' deltas, up to
+ * two empty buckets between two others are kept in a span as zero deltas.
+ */
+void cmt_encode_prometheus_protobuf_native_layout(uint64_t *counts, size_t count,
+                                                  int32_t offset, int reduction,
+                                                  int32_t *span_offsets,
+                                                  uint32_t *span_lengths,
+                                                  size_t *span_count,
+                                                  int64_t *deltas,
+                                                  size_t *delta_count);
+
+#endif
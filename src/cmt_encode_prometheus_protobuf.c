@@ -0,0 +1,820 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_summary.h>
+#include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
+#include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_atomic.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
+
+#include "cmt_encode_prometheus_native.h"
+
+/* io.prometheus.client.MetricType */
+#define PROM_PROTOBUF_TYPE_COUNTER                 0
+#define PROM_PROTOBUF_TYPE_GAUGE                   1
+#define PROM_PROTOBUF_TYPE_SUMMARY                 2
+#define PROM_PROTOBUF_TYPE_UNTYPED                 3
+#define PROM_PROTOBUF_TYPE_HISTOGRAM               4
+
+/* io.prometheus.client.MetricFamily */
+#define PROM_PROTOBUF_FAMILY_NAME                  1
+#define PROM_PROTOBUF_FAMILY_HELP                  2
+#define PROM_PROTOBUF_FAMILY_TYPE                  3
+#define PROM_PROTOBUF_FAMILY_METRIC                4
+#define PROM_PROTOBUF_FAMILY_UNIT                  5
+
+/* io.prometheus.client.Metric */
+#define PROM_PROTOBUF_METRIC_LABEL                 1
+#define PROM_PROTOBUF_METRIC_GAUGE                 2
+#define PROM_PROTOBUF_METRIC_COUNTER               3
+#define PROM_PROTOBUF_METRIC_SUMMARY               4
+#define PROM_PROTOBUF_METRIC_UNTYPED               5
+#define PROM_PROTOBUF_METRIC_TIMESTAMP_MS          6
+#define PROM_PROTOBUF_METRIC_HISTOGRAM             7
+
+/* io.prometheus.client.LabelPair */
+#define PROM_PROTOBUF_LABEL_NAME                   1
+#define PROM_PROTOBUF_LABEL_VALUE                  2
+
+/* io.prometheus.client.{Counter,Gauge,Untyped} */
+#define PROM_PROTOBUF_VALUE                        1
+
+/* io.prometheus.client.Summary */
+#define PROM_PROTOBUF_SUMMARY_SAMPLE_COUNT         1
+#define PROM_PROTOBUF_SUMMARY_SAMPLE_SUM           2
+#define PROM_PROTOBUF_SUMMARY_QUANTILE             3
+
+/* io.prometheus.client.Quantile */
+#define PROM_PROTOBUF_QUANTILE_QUANTILE            1
+#define PROM_PROTOBUF_QUANTILE_VALUE               2
+
+/* io.prometheus.client.Histogram */
+#define PROM_PROTOBUF_HISTOGRAM_SAMPLE_COUNT       1
+#define PROM_PROTOBUF_HISTOGRAM_SAMPLE_SUM         2
+#define PROM_PROTOBUF_HISTOGRAM_BUCKET             3
+#define PROM_PROTOBUF_HISTOGRAM_SCHEMA             5
+#define PROM_PROTOBUF_HISTOGRAM_ZERO_THRESHOLD     6
+#define PROM_PROTOBUF_HISTOGRAM_ZERO_COUNT         7
+#define PROM_PROTOBUF_HISTOGRAM_NEGATIVE_SPAN      9
+#define PROM_PROTOBUF_HISTOGRAM_NEGATIVE_DELTA     10
+#define PROM_PROTOBUF_HISTOGRAM_POSITIVE_SPAN      12
+#define PROM_PROTOBUF_HISTOGRAM_POSITIVE_DELTA     13
+
+/* io.prometheus.client.Bucket */
+#define PROM_PROTOBUF_BUCKET_CUMULATIVE_COUNT      1
+#define PROM_PROTOBUF_BUCKET_UPPER_BOUND           2
+
+/* io.prometheus.client.BucketSpan */
+#define PROM_PROTOBUF_SPAN_OFFSET                  1
+#define PROM_PROTOBUF_SPAN_LENGTH                  2
+
+/*
+ * Runs of up to this many empty buckets are kept inside a span (as zero
+ * deltas) instead of starting a new one, a span costs more than that.
+ */
+#define PROM_PROTOBUF_NATIVE_MAX_SPAN_GAP          2
+
+#define PROM_PROTOBUF_INITIAL_BUFFER_SIZE          4096
+
+struct native_bucket_iterator {
+    uint64_t *counts;
+    size_t    count;
+    int32_t   offset;
+    int       reduction;
+    size_t    position;
+};
+
+static void pack_label(struct cmt_protobuf_writer *writer,
+                       cfl_sds_t name, cfl_sds_t value)
+{
+    size_t mark;
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_METRIC_LABEL);
+    cmt_protobuf_write_bytes_field(writer, PROM_PROTOBUF_LABEL_NAME,
+                                   name, cfl_sds_len(name));
+    cmt_protobuf_write_bytes_field(writer, PROM_PROTOBUF_LABEL_VALUE,
+                                   value, cfl_sds_len(value));
+    cmt_protobuf_end_message(writer, mark);
+}
+
+static void pack_labels(struct cmt_protobuf_writer *writer,
+                        struct cmt *cmt, struct cmt_map *map,
+                        struct cmt_metric *metric)
+{
+    int                   label_index;
+    struct cfl_list      *head;
+    struct cmt_label     *static_label;
+    struct cmt_map_label *label_k;
+    struct cmt_map_label *label_v;
+
+    cfl_list_foreach(head, &cmt->static_labels->list) {
+        static_label = cfl_list_entry(head, struct cmt_label, _head);
+
+        pack_label(writer, static_label->key, static_label->val);
+    }
+
+    if (map->label_count == 0) {
+        return;
+    }
+
+    label_index = 0;
+    label_k = cfl_list_entry_first(&map->label_keys, struct cmt_map_label, _head);
+
+    cfl_list_foreach(head, &metric->labels) {
+        if (label_index >= map->label_count) {
+            break;
+        }
+
+        label_v = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label_k->name != NULL && label_v->name != NULL) {
+            pack_label(writer, label_k->name, label_v->name);
+        }
+
+        label_index++;
+        label_k = cfl_list_entry_next(&label_k->_head, struct cmt_map_label,
+                                      _head, &map->label_keys);
+    }
+}
+
+static void pack_value(struct cmt_protobuf_writer *writer, uint32_t field,
+                       struct cmt_metric *metric)
+{
+    size_t mark;
+
+    mark = cmt_protobuf_begin_message(writer, field);
+    cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_VALUE,
+                                    cmt_metric_get_value(metric));
+    cmt_protobuf_end_message(writer, mark);
+}
+
+static void pack_summary(struct cmt_protobuf_writer *writer,
+                         struct cmt_map *map, struct cmt_metric *metric)
+{
+    size_t              index;
+    size_t              mark;
+    size_t              quantile_mark;
+    struct cmt_summary *summary;
+
+    summary = (struct cmt_summary *) map->parent;
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_METRIC_SUMMARY);
+
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_SUMMARY_SAMPLE_COUNT,
+                                    cmt_summary_get_count_value(metric));
+    cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_SUMMARY_SAMPLE_SUM,
+                                    cmt_summary_get_sum_value(metric));
+
+    if (cmt_atomic_load(&metric->sum_quantiles_set)) {
+        for (index = 0 ; index < summary->quantiles_count ; index++) {
+            quantile_mark = cmt_protobuf_begin_message(writer,
+                                                       PROM_PROTOBUF_SUMMARY_QUANTILE);
+            cmt_protobuf_write_double_field(writer,
+                                            PROM_PROTOBUF_QUANTILE_QUANTILE,
+                                            summary->quantiles[index]);
+            cmt_protobuf_write_double_field(writer,
+                                            PROM_PROTOBUF_QUANTILE_VALUE,
+                                            cmt_summary_quantile_get_value(metric,
+                                                                           index));
+            cmt_protobuf_end_message(writer, quantile_mark);
+        }
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+}
+
+static void pack_classic_bucket(struct cmt_protobuf_writer *writer,
+                                uint64_t cumulative_count, double upper_bound)
+{
+    size_t mark;
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_HISTOGRAM_BUCKET);
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_BUCKET_CUMULATIVE_COUNT,
+                                    cumulative_count);
+    cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_BUCKET_UPPER_BOUND,
+                                    upper_bound);
+    cmt_protobuf_end_message(writer, mark);
+}
+
+/*
+ * The +Inf bucket is implicit in the protobuf exposition format, its value is
+ * the sample count, so only the finite upper bounds are packed.
+ */
+static void pack_histogram(struct cmt_protobuf_writer *writer,
+                           struct cmt_map *map, struct cmt_metric *metric)
+{
+    size_t                        index;
+    size_t                        mark;
+    struct cmt_histogram         *histogram;
+    struct cmt_histogram_buckets *buckets;
+
+    histogram = (struct cmt_histogram *) map->parent;
+    buckets = histogram->buckets;
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_METRIC_HISTOGRAM);
+
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_COUNT,
+                                    cmt_metric_hist_get_count_value(metric));
+    cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_SUM,
+                                    cmt_metric_hist_get_sum_value(metric));
+
+    for (index = 0 ; index < buckets->count ; index++) {
+        pack_classic_bucket(writer,
+                            cmt_metric_hist_get_value(metric, index),
+                            buckets->upper_bounds[index]);
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+}
+
+/*
+ * Exponential histograms with a scale below the lowest native histogram
+ * schema cannot be represented as a native histogram, they are exposed as a
+ * classic histogram instead.
+ */
+static int pack_exp_histogram_as_classic(struct cmt_protobuf_writer *writer,
+                                         struct cmt_metric *metric,
+                                         struct cmt_exp_histogram_snapshot *snapshot)
+{
+    int       result;
+    size_t    index;
+    size_t    mark;
+    size_t    bucket_count;
+    size_t    upper_bounds_count;
+    uint64_t *bucket_values;
+    double   *upper_bounds;
+
+    result = cmt_exp_histogram_to_explicit(metric,
+                                           &upper_bounds,
+                                           &upper_bounds_count,
+                                           &bucket_values,
+                                           &bucket_count);
+    if (result != 0) {
+        return -1;
+    }
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_METRIC_HISTOGRAM);
+
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_COUNT,
+                                    bucket_values[bucket_count - 1]);
+
+    if (snapshot->sum_set) {
+        cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_SUM,
+                                        cmt_math_uint64_to_d64(snapshot->sum));
+    }
+
+    for (index = 0 ; index < upper_bounds_count ; index++) {
+        pack_classic_bucket(writer, bucket_values[index], upper_bounds[index]);
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    free(bucket_values);
+    free(upper_bounds);
+
+    return 0;
+}
+
+static inline int64_t native_bucket_index(int64_t index, int reduction)
+{
+    /* floor division by 2^reduction, also for negative indexes */
+    if (index >= 0) {
+        return index >> reduction;
+    }
+
+    return -((-index - 1) >> reduction) - 1;
+}
+
+static void native_bucket_iterator_init(struct native_bucket_iterator *iterator,
+                                        uint64_t *counts, size_t count,
+                                        int32_t offset, int reduction)
+{
+    iterator->counts = counts;
+    iterator->count = count;
+    iterator->offset = offset;
+    iterator->reduction = reduction;
+    iterator->position = 0;
+}
+
+/*
+ * Returns the next bucket in Prometheus indexing. An exponential histogram
+ * bucket at index i covers (base^i, base^(i+1)] while a native histogram
+ * bucket at index i covers (base^(i-1), base^i], so the index is shifted by
+ * one. When the scale is reduced, adjacent buckets are merged.
+ */
+static int native_bucket_iterator_next(struct native_bucket_iterator *iterator,
+                                       int64_t *index, uint64_t *value)
+{
+    int64_t bucket_index;
+
+    if (iterator->position >= iterator->count) {
+        return CMT_FALSE;
+    }
+
+    bucket_index = native_bucket_index((int64_t) iterator->offset +
+                                       (int64_t) iterator->position,
+                                       iterator->reduction);
+    *value = 0;
+
+    while (iterator->position < iterator->count &&
+           native_bucket_index((int64_t) iterator->offset +
+                               (int64_t) iterator->position,
+                               iterator->reduction) == bucket_index) {
+        *value += iterator->counts[iterator->position];
+        iterator->position++;
+    }
+
+    *index = bucket_index + 1;
+
+    return CMT_TRUE;
+}
+
+static void pack_native_span(struct cmt_protobuf_writer *writer, uint32_t field,
+                             int64_t offset, uint64_t length)
+{
+    size_t mark;
+
+    mark = cmt_protobuf_begin_message(writer, field);
+    cmt_protobuf_write_sint64_field(writer, PROM_PROTOBUF_SPAN_OFFSET, offset);
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_SPAN_LENGTH, length);
+    cmt_protobuf_end_message(writer, mark);
+}
+
+/*
+ * Pack one side (positive or negative) of a native histogram: the bucket
+ * spans followed by the packed count deltas. The first span offset is the
+ * absolute index of its first bucket, the following ones are relative to the
+ * end of the previous span. Returns CMT_TRUE if any bucket was packed.
+ */
+int cmt_encode_prometheus_protobuf_native_buckets(struct cmt_protobuf_writer *writer,
+                                                  uint64_t *counts, size_t count,
+                                                  int32_t offset, int reduction,
+                                                  uint32_t span_field,
+                                                  uint32_t delta_field)
+{
+    int                           span_open;
+    int64_t                       gap;
+    int64_t                       index;
+    int64_t                       last_index;
+    int64_t                       span_offset;
+    uint64_t                      span_length;
+    uint64_t                      value;
+    uint64_t                      previous;
+    size_t                        mark;
+    struct native_bucket_iterator iterator;
+
+    /* spans */
+    span_open = CMT_FALSE;
+    span_offset = 0;
+    span_length = 0;
+    last_index = 0;
+
+    native_bucket_iterator_init(&iterator, counts, count, offset, reduction);
+
+    while (native_bucket_iterator_next(&iterator, &index, &value)) {
+        if (value == 0) {
+            continue;
+        }
+
+        if (!span_open) {
+            span_offset = index;
+            span_length = 1;
+            span_open = CMT_TRUE;
+        }
+        else {
+            gap = index - last_index - 1;
+
+            if (gap <= PROM_PROTOBUF_NATIVE_MAX_SPAN_GAP) {
+                span_length += gap + 1;
+            }
+            else {
+                pack_native_span(writer, span_field, span_offset, span_length);
+
+                span_offset = gap;
+                span_length = 1;
+            }
+        }
+
+        last_index = index;
+    }
+
+    if (!span_open) {
+        return CMT_FALSE;
+    }
+
+    pack_native_span(writer, span_field, span_offset, span_length);
+
+    /* deltas, the bucket sequence must match the spans packed above */
+    span_open = CMT_FALSE;
+    previous = 0;
+
+    native_bucket_iterator_init(&iterator, counts, count, offset, reduction);
+
+    mark = cmt_protobuf_begin_message(writer, delta_field);
+
+    while (native_bucket_iterator_next(&iterator, &index, &value)) {
+        if (value == 0) {
+            continue;
+        }
+
+        if (span_open) {
+            gap = index - last_index - 1;
+
+            if (gap <= PROM_PROTOBUF_NATIVE_MAX_SPAN_GAP) {
+                while (gap > 0) {
+                    cmt_protobuf_write_varint(writer,
+                                              cmt_protobuf_zigzag64(-(int64_t) previous));
+                    previous = 0;
+                    gap--;
+                }
+            }
+        }
+
+        cmt_protobuf_write_varint(writer,
+                                  cmt_protobuf_zigzag64((int64_t) value -
+                                                        (int64_t) previous));
+        previous = value;
+        last_index = index;
+        span_open = CMT_TRUE;
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    return CMT_TRUE;
+}
+
+/*
+ * Same bucket layout as cmt_encode_prometheus_protobuf_native_buckets() for
+ * encoders that fill message structures: the spans and deltas are stored in
+ * the supplied arrays instead of being packed.
+ */
+void cmt_encode_prometheus_protobuf_native_layout(uint64_t *counts, size_t count,
+                                                  int32_t offset, int reduction,
+                                                  int32_t *span_offsets,
+                                                  uint32_t *span_lengths,
+                                                  size_t *span_count,
+                                                  int64_t *deltas,
+                                                  size_t *delta_count)
+{
+    int                           span_open;
+    int64_t                       gap;
+    int64_t                       index;
+    int64_t                       last_index;
+    uint64_t                      value;
+    uint64_t                      previous;
+    struct native_bucket_iterator iterator;
+
+    span_open = CMT_FALSE;
+    last_index = 0;
+    previous = 0;
+    *span_count = 0;
+    *delta_count = 0;
+
+    native_bucket_iterator_init(&iterator, counts, count, offset, reduction);
+
+    while (native_bucket_iterator_next(&iterator, &index, &value)) {
+        if (value == 0) {
+            continue;
+        }
+
+        if (!span_open) {
+            span_offsets[0] = (int32_t) index;
+            span_lengths[0] = 1;
+            *span_count = 1;
+            span_open = CMT_TRUE;
+        }
+        else {
+            gap = index - last_index - 1;
+
+            if (gap <= PROM_PROTOBUF_NATIVE_MAX_SPAN_GAP) {
+                span_lengths[*span_count - 1] += gap + 1;
+
+                while (gap > 0) {
+                    deltas[(*delta_count)++] = -(int64_t) previous;
+                    previous = 0;
+                    gap--;
+                }
+            }
+            else {
+                span_offsets[*span_count] = (int32_t) gap;
+                span_lengths[*span_count] = 1;
+                (*span_count)++;
+            }
+        }
+
+        deltas[(*delta_count)++] = (int64_t) value - (int64_t) previous;
+        previous = value;
+        last_index = index;
+    }
+}
+
+static int pack_native_histogram(struct cmt_protobuf_writer *writer,
+                                 struct cmt_metric *metric)
+{
+    int                               result;
+    int                               reduction;
+    int                               buckets_set;
+    size_t                            mark;
+    struct cmt_exp_histogram_snapshot snapshot;
+
+    if (cmt_metric_exp_hist_get_snapshot(metric, &snapshot) != 0) {
+        return -1;
+    }
+
+    if (snapshot.scale < CMT_ENCODE_PROMETHEUS_PROTOBUF_MIN_SCHEMA) {
+        result = pack_exp_histogram_as_classic(writer, metric, &snapshot);
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+        return result;
+    }
+
+    reduction = 0;
+    if (snapshot.scale > CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA) {
+        reduction = snapshot.scale - CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA;
+    }
+
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_METRIC_HISTOGRAM);
+
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_COUNT,
+                                    snapshot.count);
+
+    if (snapshot.sum_set) {
+        cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_HISTOGRAM_SAMPLE_SUM,
+                                        cmt_math_uint64_to_d64(snapshot.sum));
+    }
+
+    cmt_protobuf_write_sint64_field(writer, PROM_PROTOBUF_HISTOGRAM_SCHEMA,
+                                    snapshot.scale - reduction);
+    cmt_protobuf_write_double_field(writer, PROM_PROTOBUF_HISTOGRAM_ZERO_THRESHOLD,
+                                    snapshot.zero_threshold);
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_HISTOGRAM_ZERO_COUNT,
+                                    snapshot.zero_count);
+
+    buckets_set = cmt_encode_prometheus_protobuf_native_buckets(
+                      writer,
+                      snapshot.negative_buckets,
+                      snapshot.negative_count,
+                      snapshot.negative_offset,
+                      reduction,
+                      PROM_PROTOBUF_HISTOGRAM_NEGATIVE_SPAN,
+                      PROM_PROTOBUF_HISTOGRAM_NEGATIVE_DELTA);
+
+    buckets_set |= cmt_encode_prometheus_protobuf_native_buckets(
+                      writer,
+                      snapshot.positive_buckets,
+                      snapshot.positive_count,
+                      snapshot.positive_offset,
+                      reduction,
+                      PROM_PROTOBUF_HISTOGRAM_POSITIVE_SPAN,
+                      PROM_PROTOBUF_HISTOGRAM_POSITIVE_DELTA);
+
+    /*
+     * An empty native histogram is told apart from a classic histogram
+     * without buckets by a single empty span (same as the Go client).
+     */
+    if (!buckets_set &&
+        snapshot.zero_count == 0 &&
+        snapshot.zero_threshold == 0.0) {
+        pack_native_span(writer, PROM_PROTOBUF_HISTOGRAM_POSITIVE_SPAN, 0, 0);
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+    return 0;
+}
+
+static int pack_metric(struct cmt_protobuf_writer *writer,
+                       struct cmt *cmt, struct cmt_map *map,
+                       struct cmt_metric *metric, int add_timestamp)
+{
+    int    result;
+    size_t mark;
+
+    result = 0;
+    mark = cmt_protobuf_begin_message(writer, PROM_PROTOBUF_FAMILY_METRIC);
+
+    pack_labels(writer, cmt, map, metric);
+
+    if (map->type == CMT_COUNTER) {
+        pack_value(writer, PROM_PROTOBUF_METRIC_COUNTER, metric);
+    }
+    else if (map->type == CMT_GAUGE) {
+        pack_value(writer, PROM_PROTOBUF_METRIC_GAUGE, metric);
+    }
+    else if (map->type == CMT_UNTYPED) {
+        pack_value(writer, PROM_PROTOBUF_METRIC_UNTYPED, metric);
+    }
+    else if (map->type == CMT_SUMMARY) {
+        pack_summary(writer, map, metric);
+    }
+    else if (map->type == CMT_HISTOGRAM) {
+        pack_histogram(writer, map, metric);
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        result = pack_native_histogram(writer, metric);
+    }
+
+    if (add_timestamp) {
+        /* convert from nanoseconds to milliseconds */
+        cmt_protobuf_write_int64_field(writer, PROM_PROTOBUF_METRIC_TIMESTAMP_MS,
+                                       cmt_metric_get_timestamp(metric) / 1000000);
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    return result;
+}
+
+static int metric_family_type(struct cmt_map *map)
+{
+    if (map->type == CMT_COUNTER) {
+        return PROM_PROTOBUF_TYPE_COUNTER;
+    }
+    else if (map->type == CMT_GAUGE) {
+        return PROM_PROTOBUF_TYPE_GAUGE;
+    }
+    else if (map->type == CMT_SUMMARY) {
+        return PROM_PROTOBUF_TYPE_SUMMARY;
+    }
+    else if (map->type == CMT_HISTOGRAM ||
+             map->type == CMT_EXP_HISTOGRAM) {
+        return PROM_PROTOBUF_TYPE_HISTOGRAM;
+    }
+
+    return PROM_PROTOBUF_TYPE_UNTYPED;
+}
+
+static int pack_metric_family(struct cmt_protobuf_writer *writer,
+                              struct cmt *cmt, struct cmt_map *map,
+                              int add_timestamp)
+{
+    int                result;
+    size_t             mark;
+    struct cfl_list   *head;
+    struct cmt_metric *metric;
+    struct cmt_opts   *opts;
+
+    if (!map->metric_static_set && cfl_list_size(&map->metrics) == 0) {
+        return 0;
+    }
+
+    opts = map->opts;
+    result = 0;
+
+    /* every family is prefixed with its size (delimited stream) */
+    mark = cmt_protobuf_begin_length(writer);
+
+    cmt_protobuf_write_bytes_field(writer, PROM_PROTOBUF_FAMILY_NAME,
+                                   opts->fqname, cfl_sds_len(opts->fqname));
+
+    /* a single whitespace description signals that no HELP was provided */
+    if (cfl_sds_len(opts->description) > 1 || opts->description[0] != ' ') {
+        cmt_protobuf_write_bytes_field(writer, PROM_PROTOBUF_FAMILY_HELP,
+                                       opts->description,
+                                       cfl_sds_len(opts->description));
+    }
+
+    cmt_protobuf_write_uint64_field(writer, PROM_PROTOBUF_FAMILY_TYPE,
+                                    metric_family_type(map));
+
+    if (map->metric_static_set) {
+        result = pack_metric(writer, cmt, map, &map->metric, add_timestamp);
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        if (result != 0) {
+            break;
+        }
+
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        result = pack_metric(writer, cmt, map, metric, add_timestamp);
+    }
+
+    if (map->unit != NULL && cfl_sds_len(map->unit) > 0) {
+        cmt_protobuf_write_bytes_field(writer, PROM_PROTOBUF_FAMILY_UNIT,
+                                       map->unit, cfl_sds_len(map->unit));
+    }
+
+    cmt_protobuf_end_message(writer, mark);
+
+    return result;
+}
+
+/* Format all the registered metrics in Prometheus protobuf format */
+cfl_sds_t cmt_encode_prometheus_protobuf_create(struct cmt *cmt, int add_timestamp)
+{
+    int                        result;
+    cfl_sds_t                  buf;
+    struct cfl_list           *head;
+    struct cmt_counter        *counter;
+    struct cmt_gauge          *gauge;
+    struct cmt_summary        *summary;
+    struct cmt_histogram      *histogram;
+    struct cmt_exp_histogram  *exp_histogram;
+    struct cmt_untyped        *untyped;
+    struct cmt_protobuf_writer writer;
+
+    if (cmt == NULL) {
+        return NULL;
+    }
+
+    result = cmt_protobuf_writer_init(&writer, PROM_PROTOBUF_INITIAL_BUFFER_SIZE);
+    if (result != CMT_PROTOBUF_WIRE_SUCCESS) {
+        cmt_protobuf_writer_destroy(&writer);
+        return NULL;
+    }
+
+    /* Counters */
+    cfl_list_foreach(head, &cmt->counters) {
+        if (result != 0) {
+            break;
+        }
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        result = pack_metric_family(&writer, cmt, counter->map, add_timestamp);
+    }
+
+    /* Gauges */
+    cfl_list_foreach(head, &cmt->gauges) {
+        if (result != 0) {
+            break;
+        }
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        result = pack_metric_family(&writer, cmt, gauge->map, add_timestamp);
+    }
+
+    /* Summaries */
+    cfl_list_foreach(head, &cmt->summaries) {
+        if (result != 0) {
+            break;
+        }
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        result = pack_metric_family(&writer, cmt, summary->map, add_timestamp);
+    }
+
+    /* Histograms */
+    cfl_list_foreach(head, &cmt->histograms) {
+        if (result != 0) {
+            break;
+        }
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        result = pack_metric_family(&writer, cmt, histogram->map, add_timestamp);
+    }
+
+    /* Exponential Histograms */
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        if (result != 0) {
+            break;
+        }
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        result = pack_metric_family(&writer, cmt, exp_histogram->map, add_timestamp);
+    }
+
+    /* Untyped */
+    cfl_list_foreach(head, &cmt->untypeds) {
+        if (result != 0) {
+            break;
+        }
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        result = pack_metric_family(&writer, cmt, untyped->map, add_timestamp);
+    }
+
+    buf = NULL;
+    if (result == 0) {
+        buf = cmt_protobuf_writer_to_sds(&writer);
+    }
+
+    cmt_protobuf_writer_destroy(&writer);
+
+    return buf;
+}
+
+void cmt_encode_prometheus_protobuf_destroy(cfl_sds_t payload)
+{
+    if (payload != NULL) {
+        cfl_sds_destroy(payload);
+    }
+}
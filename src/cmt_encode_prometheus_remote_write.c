@@ -26,24 +26,41 @@
 #include <cmetrics/cmt_atomic.h>
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_snappy.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
 #include <cmetrics/cmt_encode_prometheus_remote_write.h>
 
+#include "cmt_encode_prometheus_native.h"
+
 #define SYNTHETIC_METRIC_SUMMARY_COUNT_SEQUENCE_DELTA   10000000
 #define SYNTHETIC_METRIC_SUMMARY_SUM_SEQUENCE_DELTA     100000000
 
 #define SYNTHETIC_METRIC_HISTOGRAM_COUNT_SEQUENCE_DELTA 10000000
 #define SYNTHETIC_METRIC_HISTOGRAM_SUM_SEQUENCE_DELTA   100000000
 
+#define TIME_SERIES_INITIAL_BUCKET_COUNT                64
+#define TIME_SERIES_BUCKET_LOAD_FACTOR                  4
+
 struct cmt_prometheus_time_series_entry {
     uint64_t               label_set_hash;
     size_t                 entries_set;
     Prometheus__TimeSeries data;
     struct cfl_list        _head;
     size_t                 samples_capacity;
+    struct cfl_list        _hash_head;
+    struct cmt_map        *map;
 };
 
+/* Size of an element of a repeated message field, tag included */
+static inline size_t repeated_field_size(size_t message_size)
+{
+    return 1 + cmt_protobuf_varint_size(message_size) + message_size;
+}
+
 static cfl_sds_t render_remote_write_context_to_sds(
-    struct cmt_prometheus_remote_write_context *context);
+    struct cmt_prometheus_remote_write_context *context,
+    size_t time_series_count,
+    int compress);
 
 static void destroy_prometheus_label_list(Prometheus__Label **label_list,
                                           size_t entry_count);
@@ -56,9 +73,9 @@ static void cmt_destroy_prometheus_remote_write_context(
 
 static uint64_t calculate_label_set_hash(struct cfl_list *label_values, uint64_t seed);
 
-static size_t count_metrics_with_matching_label_set(struct cfl_list *metrics,
-                                                    uint64_t sequence_number,
-                                                    uint64_t desired_hash);
+static uint64_t calculate_metric_label_set_hash(
+    struct cmt_prometheus_remote_write_context *context,
+    struct cmt_metric *metric);
 
 static int append_entry_to_prometheus_label_list(Prometheus__Label **label_list,
                                                  size_t *index,
@@ -69,6 +86,7 @@ static int set_up_time_series_for_label_set(
                                     struct cmt_prometheus_remote_write_context *context,
                                     struct cmt_map *map,
                                     struct cmt_metric *metric,
+                                    uint64_t label_set_hash,
                                     struct cmt_prometheus_time_series_entry **time_series);
 
 static int pack_metric_metadata(struct cmt_prometheus_remote_write_context *context,
@@ -115,17 +133,90 @@ static struct cmt_map_label *create_label(char *caption)
     return instance;
 }
 
+/*
+ * The request is packed into a scratch buffer and compressed from there
+ * straight into the result, so the uncompressed payload is never copied.
+ */
+static cfl_sds_t compress_write_request(Prometheus__WriteRequest *write_request,
+                                        size_t write_request_size)
+{
+    int       result;
+    size_t    compressed_size;
+    uint8_t  *packed_buffer;
+    cfl_sds_t result_buffer;
+
+    packed_buffer = malloc(write_request_size + 1);
+
+    if (packed_buffer == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    prometheus__write_request__pack(write_request, packed_buffer);
+
+    compressed_size = cmt_snappy_max_compressed_length(write_request_size);
+
+    result_buffer = cfl_sds_create_size(compressed_size);
+
+    if (result_buffer != NULL) {
+        result = cmt_snappy_compress((char *) packed_buffer,
+                                     write_request_size,
+                                     result_buffer,
+                                     compressed_size,
+                                     &compressed_size);
+
+        if (result == CMT_SNAPPY_SUCCESS) {
+            cfl_sds_set_len(result_buffer, compressed_size);
+        }
+        else {
+            cfl_sds_destroy(result_buffer);
+
+            result_buffer = NULL;
+        }
+    }
+
+    free(packed_buffer);
+
+    return result_buffer;
+}
+
+/*
+ * Appends the metadata of a family to the write request, summaries and
+ * histograms pack one entry per synthesized metric name.
+ */
+static void append_family_metadata(struct cmt_prometheus_remote_write_context *context,
+                                   struct cmt_map *map,
+                                   size_t *entry_index)
+{
+    struct cmt_prometheus_metric_metadata *metadata_entry;
+    struct cfl_list                       *head;
+
+    cfl_list_foreach(head, &context->metadata_entries) {
+        metadata_entry = cfl_list_entry(head, struct cmt_prometheus_metric_metadata, _head);
+
+        if (metadata_entry->map == map) {
+            context->write_request.metadata[(*entry_index)++] = &metadata_entry->data;
+        }
+    }
+}
+
+/* Only the first 'time_series_count' time series are rendered */
 cfl_sds_t render_remote_write_context_to_sds(
-    struct cmt_prometheus_remote_write_context *context)
+    struct cmt_prometheus_remote_write_context *context,
+    size_t time_series_count,
+    int compress)
 {
     size_t                                 write_request_size;
     struct cmt_prometheus_time_series_entry     *time_series_entry;
     struct cmt_prometheus_metric_metadata *metadata_entry;
     cfl_sds_t                              result_buffer;
     size_t                                 entry_index;
+    size_t                                 index;
+    struct cmt_map                        *map;
     struct cfl_list                        *head;
 
-    context->write_request.n_timeseries = cfl_list_size(&context->time_series_entries);
+    context->write_request.n_timeseries = time_series_count;
     context->write_request.n_metadata   = cfl_list_size(&context->metadata_entries);
 
     context->write_request.timeseries = calloc(context->write_request.n_timeseries,
@@ -151,6 +242,10 @@ cfl_sds_t render_remote_write_context_to_sds(
     entry_index = 0;
 
     cfl_list_foreach(head, &context->time_series_entries) {
+        if (entry_index == time_series_count) {
+            break;
+        }
+
         time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry, _head);
 
         context->write_request.timeseries[entry_index++] = &time_series_entry->data;
@@ -158,20 +253,52 @@ cfl_sds_t render_remote_write_context_to_sds(
 
     entry_index = 0;
 
-    cfl_list_foreach(head, &context->metadata_entries) {
-        metadata_entry = cfl_list_entry(head, struct cmt_prometheus_metric_metadata, _head);
+    if (context->split_payloads != NULL) {
+        /* only the families of the rendered time series */
+        map = NULL;
+
+        for (index = 0 ; index < time_series_count ; index++) {
+            if (context->write_request.timeseries[index] == NULL) {
+                break;
+            }
+
+            time_series_entry = cfl_container_of(context->write_request.timeseries[index],
+                                                 struct cmt_prometheus_time_series_entry,
+                                                 data);
 
-        context->write_request.metadata[entry_index++] = &metadata_entry->data;
+            if (time_series_entry->map == map) {
+                continue;
+            }
+
+            map = time_series_entry->map;
+
+            append_family_metadata(context, map, &entry_index);
+        }
+
+        context->write_request.n_metadata = entry_index;
+    }
+    else {
+        cfl_list_foreach(head, &context->metadata_entries) {
+            metadata_entry = cfl_list_entry(head, struct cmt_prometheus_metric_metadata, _head);
+
+            context->write_request.metadata[entry_index++] = &metadata_entry->data;
+        }
     }
 
     write_request_size = prometheus__write_request__get_packed_size(&context->write_request);
 
-    result_buffer = cfl_sds_create_size(write_request_size);
+    if (compress) {
+        result_buffer = compress_write_request(&context->write_request,
+                                               write_request_size);
+    }
+    else {
+        result_buffer = cfl_sds_create_size(write_request_size);
 
-    if(result_buffer != NULL) {
-        prometheus__write_request__pack(&context->write_request, (uint8_t *) result_buffer);
+        if(result_buffer != NULL) {
+            prometheus__write_request__pack(&context->write_request, (uint8_t *) result_buffer);
 
-        cfl_sds_set_len(result_buffer, write_request_size);
+            cfl_sds_set_len(result_buffer, write_request_size);
+        }
     }
 
     free(context->write_request.timeseries);
@@ -181,6 +308,58 @@ cfl_sds_t render_remote_write_context_to_sds(
     return result_buffer;
 }
 
+static void destroy_native_histogram(Prometheus__Histogram *histogram)
+{
+    /* the spans of a side are allocated as a single block */
+    if (histogram->n_negative_spans > 0) {
+        free(histogram->negative_spans[0]);
+    }
+
+    if (histogram->n_positive_spans > 0) {
+        free(histogram->positive_spans[0]);
+    }
+
+    free(histogram->negative_spans);
+    free(histogram->negative_deltas);
+    free(histogram->positive_spans);
+    free(histogram->positive_deltas);
+    free(histogram);
+}
+
+static void destroy_time_series_entry(
+    struct cmt_prometheus_time_series_entry *time_series_entry)
+{
+    size_t index;
+
+    if (time_series_entry->data.histograms != NULL) {
+        for (index = 0 ; index < time_series_entry->data.n_histograms ; index++) {
+            destroy_native_histogram(time_series_entry->data.histograms[index]);
+        }
+
+        free(time_series_entry->data.histograms);
+
+        time_series_entry->data.histograms = NULL;
+    }
+
+    if (time_series_entry->data.labels != NULL) {
+        destroy_prometheus_label_list(time_series_entry->data.labels,
+                                      time_series_entry->data.n_labels);
+
+        time_series_entry->data.labels = NULL;
+    }
+
+    if (time_series_entry->data.samples != NULL) {
+        destroy_prometheus_sample_list(time_series_entry->data.samples,
+                                      time_series_entry->data.n_samples);
+
+        time_series_entry->data.samples = NULL;
+    }
+
+    cfl_list_del(&time_series_entry->_head);
+
+    free(time_series_entry);
+}
+
 void cmt_destroy_prometheus_remote_write_context(
     struct cmt_prometheus_remote_write_context *context)
 {
@@ -192,23 +371,15 @@ void cmt_destroy_prometheus_remote_write_context(
     cfl_list_foreach_safe(head, tmp, &context->time_series_entries) {
         time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry, _head);
 
-        if (time_series_entry->data.labels != NULL) {
-            destroy_prometheus_label_list(time_series_entry->data.labels,
-                                          time_series_entry->data.n_labels);
-
-            time_series_entry->data.labels = NULL;
-        }
-
-        if (time_series_entry->data.samples != NULL) {
-            destroy_prometheus_sample_list(time_series_entry->data.samples,
-                                          time_series_entry->data.n_samples);
-
-            time_series_entry->data.samples = NULL;
-        }
+        destroy_time_series_entry(time_series_entry);
+    }
 
-        cfl_list_del(&time_series_entry->_head);
+    if (context->time_series_buckets != NULL) {
+        free(context->time_series_buckets);
 
-        free(time_series_entry);
+        context->time_series_buckets = NULL;
+        context->time_series_bucket_count = 0;
+        context->time_series_count = 0;
     }
 
     cfl_list_foreach_safe(head, tmp, &context->metadata_entries) {
@@ -255,28 +426,118 @@ uint64_t calculate_label_set_hash(struct cfl_list *label_values, uint64_t seed)
     return cfl_hash_64bits_digest(&state);
 }
 
-size_t count_metrics_with_matching_label_set(struct cfl_list *metrics,
-                                             uint64_t sequence_number,
-                                             uint64_t desired_hash)
+/* Series of basic types keep their label set untouched, which lets us reuse the
+ * hash computed by the map instead of hashing every label value again.
+ */
+uint64_t calculate_metric_label_set_hash(
+    struct cmt_prometheus_remote_write_context *context,
+    struct cmt_metric *metric)
 {
-    uint64_t           label_set_hash;
-    size_t             matches;
-    struct cmt_metric *metric;
-    struct cfl_list    *head;
+    cfl_hash_state_t state;
 
-    matches = 0;
+    if (metric->hash == 0) {
+        return calculate_label_set_hash(&metric->labels, context->sequence_number);
+    }
 
-    cfl_list_foreach(head, metrics) {
-        metric = cfl_list_entry(head, struct cmt_metric, _head);
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, &context->sequence_number, sizeof(uint64_t));
+    cfl_hash_64bits_update(&state, &metric->hash, sizeof(uint64_t));
 
-        label_set_hash = calculate_label_set_hash(&metric->labels, sequence_number);
+    return cfl_hash_64bits_digest(&state);
+}
+
+static int time_series_index_resize(struct cmt_prometheus_remote_write_context *context,
+                                    size_t bucket_count)
+{
+    size_t                                   index;
+    struct cfl_list                         *head;
+    struct cfl_list                         *buckets;
+    struct cmt_prometheus_time_series_entry *time_series_entry;
+
+    buckets = calloc(bucket_count, sizeof(struct cfl_list));
+
+    if (buckets == NULL) {
+        cmt_errno();
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < bucket_count ; index++) {
+        cfl_list_init(&buckets[index]);
+    }
+
+    cfl_list_foreach(head, &context->time_series_entries) {
+        time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry, _head);
+
+        cfl_list_add(&time_series_entry->_hash_head,
+                     &buckets[time_series_entry->label_set_hash % bucket_count]);
+    }
+
+    if (context->time_series_buckets != NULL) {
+        free(context->time_series_buckets);
+    }
+
+    context->time_series_buckets = buckets;
+    context->time_series_bucket_count = bucket_count;
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
+static struct cmt_prometheus_time_series_entry *time_series_index_lookup(
+    struct cmt_prometheus_remote_write_context *context,
+    uint64_t label_set_hash)
+{
+    struct cfl_list                         *head;
+    struct cfl_list                         *bucket;
+    struct cmt_prometheus_time_series_entry *time_series_entry;
+
+    if (context->time_series_buckets == NULL) {
+        return NULL;
+    }
+
+    bucket = &context->time_series_buckets[label_set_hash %
+                                           context->time_series_bucket_count];
+
+    cfl_list_foreach(head, bucket) {
+        time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry,
+                                           _hash_head);
 
-        if (label_set_hash == desired_hash) {
-            matches++;
+        if (time_series_entry->label_set_hash == label_set_hash) {
+            return time_series_entry;
         }
     }
 
-    return matches;
+    return NULL;
+}
+
+static int time_series_index_add(struct cmt_prometheus_remote_write_context *context,
+                                 struct cmt_prometheus_time_series_entry *time_series_entry)
+{
+    int result;
+
+    if (context->time_series_buckets == NULL) {
+        result = time_series_index_resize(context, TIME_SERIES_INITIAL_BUCKET_COUNT);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            return result;
+        }
+    }
+    else if (context->time_series_count >=
+             context->time_series_bucket_count * TIME_SERIES_BUCKET_LOAD_FACTOR) {
+        result = time_series_index_resize(context,
+                                          context->time_series_bucket_count * 2);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            return result;
+        }
+    }
+
+    cfl_list_add(&time_series_entry->_hash_head,
+                 &context->time_series_buckets[time_series_entry->label_set_hash %
+                                               context->time_series_bucket_count]);
+    context->time_series_count++;
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
 }
 
 int append_entry_to_prometheus_label_list(Prometheus__Label **label_list,
@@ -363,12 +624,10 @@ void destroy_prometheus_label_list(Prometheus__Label **label_list,
 int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context *context,
                                      struct cmt_map *map,
                                      struct cmt_metric *metric,
+                                     uint64_t label_set_hash,
                                      struct cmt_prometheus_time_series_entry **time_series)
 {
-    uint8_t                            time_series_match_found;
-    size_t                             label_set_hash_matches;
     struct cmt_prometheus_time_series_entry *time_series_entry;
-    uint64_t                           label_set_hash;
     struct cmt_label                  *static_label;
     size_t                             label_index;
     size_t                             label_count;
@@ -383,37 +642,15 @@ int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context
     size_t                             label_name_count;
     size_t                             label_name_index;
 
-    label_set_hash = calculate_label_set_hash(&metric->labels, context->sequence_number);
-
     /* Determine if there is an existing time series for this label set */
-    time_series_match_found = CMT_FALSE;
-
-    cfl_list_foreach(head, &context->time_series_entries) {
-        time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry, _head);
+    time_series_entry = time_series_index_lookup(context, label_set_hash);
 
-        if (time_series_entry->label_set_hash == label_set_hash) {
-            time_series_match_found = CMT_TRUE;
-
-            break;
-        }
-    }
-
-    if (time_series_match_found == CMT_TRUE) {
+    if (time_series_entry != NULL) {
         *time_series = time_series_entry;
 
         return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
     }
 
-    /* Find out how many samples share these label values */
-    label_set_hash_matches = count_metrics_with_matching_label_set(&map->metrics,
-                                                                   context->sequence_number,
-                                                                   label_set_hash);
-
-    if (label_set_hash_matches == 0)
-    {
-        label_set_hash_matches++;
-    }
-
     /* Allocate the memory required for the label and value lists, we need to add
      * one for the fixed __name__ label
      */
@@ -449,7 +686,7 @@ int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context
         return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
-    value_list = calloc(label_set_hash_matches, sizeof(Prometheus__Sample *));
+    value_list = calloc(1, sizeof(Prometheus__Sample *));
 
     if (value_list == NULL) {
         cmt_errno();
@@ -470,8 +707,9 @@ int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context
 
     time_series_entry->label_set_hash = label_set_hash;
     time_series_entry->entries_set = 0;
-    /* Capacity is initialized to at least one and grows geometrically. */
-    time_series_entry->samples_capacity = label_set_hash_matches;
+    time_series_entry->map = map;
+    /* Capacity starts at one and grows geometrically. */
+    time_series_entry->samples_capacity = 1;
 
     /* Initialize the label list */
     label_index = 0;
@@ -565,6 +803,10 @@ int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context
         }
     }
 
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        result = time_series_index_add(context, time_series_entry);
+    }
+
     if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
         destroy_prometheus_label_list(label_list, label_index);
         free(time_series_entry);
@@ -574,7 +816,8 @@ int set_up_time_series_for_label_set(struct cmt_prometheus_remote_write_context
     }
 
     /* Add the time series to the context so we can find it when we try to format
-     * a metric with these same labels;
+     * a metric with these same labels, the lookup index has to be updated first
+     * because growing it relinks every entry in this list.
      */
     cfl_list_add(&time_series_entry->_head, &context->time_series_entries);
 
@@ -652,11 +895,148 @@ int pack_metric_metadata(struct cmt_prometheus_remote_write_context *context,
         return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
+    metadata_entry->map = map;
+
     cfl_list_add(&metadata_entry->_head, &context->metadata_entries);
 
     return 0;
 }
 
+/*
+ * Payload splitting: every time a metric has been packed the time series it
+ * created are measured, once the next one does not fit in the budget the
+ * pending time series are rendered into a payload of their own and released.
+ * A payload carries the metadata of the families its time series belong to,
+ * counted in the budget when the first time series of a family is measured.
+ */
+static int flush_time_series(struct cmt_prometheus_remote_write_context *context)
+{
+    struct cmt_prometheus_time_series_entry *time_series_entry;
+    cfl_sds_t                                payload;
+    size_t                                   index;
+    int                                      result;
+
+    payload = render_remote_write_context_to_sds(context,
+                                                 context->split_pending_series,
+                                                 context->split_compress);
+
+    if (payload == NULL) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    result = cmt_encode_split_append(context->split_payloads,
+                                     payload,
+                                     context->split_pending_series);
+
+    if (result != 0) {
+        cfl_sds_destroy(payload);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < context->split_pending_series ; index++) {
+        time_series_entry = cfl_list_entry_first(&context->time_series_entries,
+                                                 struct cmt_prometheus_time_series_entry,
+                                                 _head);
+
+        cfl_list_del(&time_series_entry->_hash_head);
+        context->time_series_count--;
+
+        destroy_time_series_entry(time_series_entry);
+    }
+
+    context->split_pending_series = 0;
+    context->split_pending_bytes = 0;
+    context->split_pending_map = NULL;
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
+static size_t split_metadata_size(struct cmt_prometheus_remote_write_context *context,
+                                  struct cmt_map *map)
+{
+    struct cmt_prometheus_metric_metadata *metadata_entry;
+    struct cfl_list                       *head;
+    size_t                                 size;
+
+    /* the family is already accounted for in the pending payload */
+    if (map == context->split_pending_map) {
+        return 0;
+    }
+
+    size = 0;
+
+    cfl_list_foreach(head, &context->metadata_entries) {
+        metadata_entry = cfl_list_entry(head, struct cmt_prometheus_metric_metadata, _head);
+
+        if (metadata_entry->map == map) {
+            size += repeated_field_size(prometheus__metric_metadata__get_packed_size(
+                                            &metadata_entry->data));
+        }
+    }
+
+    return size;
+}
+
+static int split_time_series(struct cmt_prometheus_remote_write_context *context)
+{
+    struct cmt_prometheus_time_series_entry *time_series_entry;
+    size_t                                   new_series;
+    size_t                                   index;
+    size_t                                   size;
+    size_t                                   metadata_size;
+    int                                      result;
+    struct cfl_list                          *head;
+
+    if (context->split_payloads == NULL) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    new_series = context->time_series_count - context->split_pending_series;
+
+    if (new_series == 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    /* New time series are appended, walk back to the first unmeasured one */
+    head = context->time_series_entries.prev;
+
+    for (index = 1 ; index < new_series ; index++) {
+        head = head->prev;
+    }
+
+    for (index = 0 ; index < new_series ; index++) {
+        time_series_entry = cfl_list_entry(head, struct cmt_prometheus_time_series_entry, _head);
+        head = head->next;
+
+        size = repeated_field_size(prometheus__time_series__get_packed_size(
+                                       &time_series_entry->data));
+        metadata_size = split_metadata_size(context, time_series_entry->map);
+
+        if (context->split_pending_series > 0 &&
+            ((context->split_max_series > 0 &&
+              context->split_pending_series >= context->split_max_series) ||
+             (context->split_max_bytes > 0 &&
+              context->split_pending_bytes + metadata_size + size >
+              context->split_max_bytes))) {
+            result = flush_time_series(context);
+
+            if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+                return result;
+            }
+
+            /* the family starts over in the next payload */
+            metadata_size = split_metadata_size(context, time_series_entry->map);
+        }
+
+        context->split_pending_series++;
+        context->split_pending_bytes += metadata_size + size;
+        context->split_pending_map = time_series_entry->map;
+    }
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
 int append_metric_to_timeseries(struct cmt_prometheus_time_series_entry *time_series,
                                 struct cmt_metric *metric)
 {
@@ -712,7 +1092,9 @@ int pack_basic_metric_sample(struct cmt_prometheus_remote_write_context *context
     struct cmt_prometheus_time_series_entry *time_series;
     int                                result;
 
-    result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+    result = set_up_time_series_for_label_set(context, map, metric,
+                                              calculate_metric_label_set_hash(context, metric),
+                                              &time_series);
 
     if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
         return result;
@@ -772,6 +1154,11 @@ int pack_basic_type(struct cmt_prometheus_remote_write_context *context,
                 return result;
             }
             add_metadata = CMT_FALSE;
+
+            result = split_time_series(context);
+            if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+                return result;
+            }
         }
     }
 
@@ -793,8 +1180,204 @@ int pack_basic_type(struct cmt_prometheus_remote_write_context *context,
         if (add_metadata == CMT_TRUE) {
             add_metadata = CMT_FALSE;
         }
+
+        result = split_time_series(context);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            return result;
+        }
+    }
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
+/* Spans and delta encoded counts of one side of a native histogram */
+static int native_histogram_buckets(uint64_t *counts, size_t count,
+                                    int32_t offset, int reduction,
+                                    size_t *span_count,
+                                    Prometheus__BucketSpan ***span_list,
+                                    size_t *delta_count,
+                                    int64_t **delta_list)
+{
+    size_t                  index;
+    int32_t                *span_offsets;
+    uint32_t               *span_lengths;
+    Prometheus__BucketSpan *spans;
+
+    if (count == 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    span_offsets = malloc(count * (sizeof(int32_t) + sizeof(uint32_t)));
+    *delta_list = malloc(count * 3 * sizeof(int64_t));
+
+    if (span_offsets == NULL || *delta_list == NULL) {
+        cmt_errno();
+
+        free(span_offsets);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
     }
 
+    span_lengths = (uint32_t *) &span_offsets[count];
+
+    cmt_encode_prometheus_protobuf_native_layout(counts, count, offset, reduction,
+                                                 span_offsets, span_lengths,
+                                                 span_count,
+                                                 *delta_list, delta_count);
+
+    if (*span_count == 0) {
+        free(span_offsets);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    *span_list = calloc(*span_count, sizeof(Prometheus__BucketSpan *));
+    spans = calloc(*span_count, sizeof(Prometheus__BucketSpan));
+
+    if (*span_list == NULL || spans == NULL) {
+        cmt_errno();
+
+        free(span_offsets);
+        free(spans);
+        free(*span_list);
+        *span_list = NULL;
+        *span_count = 0;
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < *span_count ; index++) {
+        prometheus__bucket_span__init(&spans[index]);
+
+        spans[index].offset = span_offsets[index];
+        spans[index].length = span_lengths[index];
+
+        (*span_list)[index] = &spans[index];
+    }
+
+    free(span_offsets);
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+}
+
+/*
+ * Exponential histograms are sent as native histograms, a single time series
+ * holding the whole data point in its histograms field instead of one series
+ * per bucket. Scales finer than the highest schema are merged down, 'packed'
+ * is left unset for scales below the lowest one so the caller can fall back
+ * to classic buckets.
+ */
+static int pack_native_histogram_sample(struct cmt_prometheus_remote_write_context *context,
+                                        struct cmt_map *map,
+                                        struct cmt_metric *metric,
+                                        int add_metadata,
+                                        int *packed)
+{
+    int                                      result;
+    int                                      reduction;
+    Prometheus__Histogram                   *histogram;
+    Prometheus__Histogram                  **histogram_list;
+    struct cmt_exp_histogram_snapshot        snapshot;
+    struct cmt_prometheus_time_series_entry *time_series;
+
+    *packed = CMT_FALSE;
+
+    if (cmt_metric_exp_hist_get_snapshot(metric, &snapshot) != 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    if (snapshot.scale < CMT_ENCODE_PROMETHEUS_PROTOBUF_MIN_SCHEMA) {
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    reduction = 0;
+    if (snapshot.scale > CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA) {
+        reduction = snapshot.scale - CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA;
+    }
+
+    *packed = CMT_TRUE;
+
+    histogram = calloc(1, sizeof(Prometheus__Histogram));
+
+    if (histogram == NULL) {
+        cmt_errno();
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    prometheus__histogram__init(histogram);
+
+    histogram->count_case = PROMETHEUS__HISTOGRAM__COUNT_COUNT_INT;
+    histogram->count_int = snapshot.count;
+    histogram->zero_count_case = PROMETHEUS__HISTOGRAM__ZERO_COUNT_ZERO_COUNT_INT;
+    histogram->zero_count_int = snapshot.zero_count;
+    histogram->zero_threshold = snapshot.zero_threshold;
+    histogram->schema = snapshot.scale - reduction;
+
+    if (snapshot.sum_set) {
+        histogram->sum = cmt_math_uint64_to_d64(snapshot.sum);
+    }
+
+    /* convert from nanoseconds to milliseconds */
+    histogram->timestamp = cmt_metric_get_timestamp(metric) / 1000000;
+
+    result = native_histogram_buckets(snapshot.negative_buckets,
+                                      snapshot.negative_count,
+                                      snapshot.negative_offset,
+                                      reduction,
+                                      &histogram->n_negative_spans,
+                                      &histogram->negative_spans,
+                                      &histogram->n_negative_deltas,
+                                      &histogram->negative_deltas);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        result = native_histogram_buckets(snapshot.positive_buckets,
+                                          snapshot.positive_count,
+                                          snapshot.positive_offset,
+                                          reduction,
+                                          &histogram->n_positive_spans,
+                                          &histogram->positive_spans,
+                                          &histogram->n_positive_deltas,
+                                          &histogram->positive_deltas);
+    }
+
+    cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        result = set_up_time_series_for_label_set(context, map, metric,
+                                                  calculate_metric_label_set_hash(context, metric),
+                                                  &time_series);
+    }
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
+        add_metadata == CMT_TRUE) {
+        result = pack_metric_metadata(context, map, metric);
+    }
+
+    if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        destroy_native_histogram(histogram);
+
+        return result;
+    }
+
+    histogram_list = realloc(time_series->data.histograms,
+                             (time_series->data.n_histograms + 1) *
+                             sizeof(Prometheus__Histogram *));
+
+    if (histogram_list == NULL) {
+        cmt_errno();
+        destroy_native_histogram(histogram);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_ALLOCATION_ERROR;
+    }
+
+    histogram_list[time_series->data.n_histograms++] = histogram;
+    time_series->data.histograms = histogram_list;
+
     return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
 }
 
@@ -824,6 +1407,7 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
     double                             sum_value;
     double                             count_value;
     int                                result;
+    int                                packed;
     size_t                             index;
     uint64_t                           now;
 
@@ -839,6 +1423,15 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
         return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR;
     }
 
+    if (map->type == CMT_EXP_HISTOGRAM) {
+        result = pack_native_histogram_sample(context, map, metric,
+                                              add_metadata, &packed);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS || packed) {
+            return result;
+        }
+    }
+
     additional_label_caption = cfl_sds_create_len(NULL, 128);
 
     if (additional_label_caption == NULL) {
@@ -880,7 +1473,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
                        dummy_metric.timestamp,
                        cmt_summary_get_count_value(metric));
 
-        result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+        result = set_up_time_series_for_label_set(context, map, metric,
+                                                  calculate_label_set_hash(&metric->labels,
+                                                                           context->sequence_number),
+                                                  &time_series);
 
         if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
             if (add_metadata == CMT_TRUE) {
@@ -906,7 +1502,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
                            dummy_metric.timestamp,
                            cmt_summary_get_sum_value(metric));
 
-            result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+            result = set_up_time_series_for_label_set(context, map, metric,
+                                                      calculate_label_set_hash(&metric->labels,
+                                                                               context->sequence_number),
+                                                      &time_series);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
                 if (add_metadata == CMT_TRUE) {
@@ -961,7 +1560,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
 
                         dummy_metric.val = cmt_math_d64_to_uint64(cmt_summary_quantile_get_value(metric, index));
 
-                        result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+                        result = set_up_time_series_for_label_set(context, map, metric,
+                                                                  calculate_label_set_hash(&metric->labels,
+                                                                                           context->sequence_number),
+                                                                  &time_series);
 
                         if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
                             if (add_metadata == CMT_TRUE) {
@@ -1014,7 +1616,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
             }
 
             cmt_metric_set(&dummy_metric, dummy_metric.timestamp, count_value);
-            result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+            result = set_up_time_series_for_label_set(context, map, metric,
+                                                      calculate_label_set_hash(&metric->labels,
+                                                                               context->sequence_number),
+                                                      &time_series);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
                 if (add_metadata == CMT_TRUE) {
@@ -1050,7 +1655,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
             }
 
             cmt_metric_set(&dummy_metric, dummy_metric.timestamp, sum_value);
-            result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+            result = set_up_time_series_for_label_set(context, map, metric,
+                                                      calculate_label_set_hash(&metric->labels,
+                                                                               context->sequence_number),
+                                                      &time_series);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
                 if (add_metadata == CMT_TRUE) {
@@ -1127,7 +1735,10 @@ int pack_complex_metric_sample(struct cmt_prometheus_remote_write_context *conte
                     }
 
                     dummy_metric.val = cmt_math_d64_to_uint64(bucket_value);
-                    result = set_up_time_series_for_label_set(context, map, metric, &time_series);
+                    result = set_up_time_series_for_label_set(context, map, metric,
+                                                              calculate_label_set_hash(&metric->labels,
+                                                                                       context->sequence_number),
+                                                              &time_series);
 
                     if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
                         if (add_metadata == CMT_TRUE) {
@@ -1220,6 +1831,8 @@ int pack_complex_type(struct cmt_prometheus_remote_write_context *context,
         }
         else if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
             add_metadata = CMT_FALSE;
+
+            result = split_time_series(context);
         }
     }
 
@@ -1241,6 +1854,12 @@ int pack_complex_type(struct cmt_prometheus_remote_write_context *context,
             if (add_metadata == CMT_TRUE) {
                 add_metadata = CMT_FALSE;
             }
+
+            result = split_time_series(context);
+
+            if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+                break;
+            }
         }
     }
 
@@ -1254,36 +1873,39 @@ int pack_complex_type(struct cmt_prometheus_remote_write_context *context,
     return result;
 }
 
-/* Format all the registered metrics in Prometheus Text format */
-cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
+static void initialize_remote_write_context(
+    struct cmt_prometheus_remote_write_context *context,
+    struct cmt *cmt)
+{
+    memset(context, 0, sizeof(struct cmt_prometheus_remote_write_context));
+
+    prometheus__write_request__init(&context->write_request);
+
+    context->cmt = cmt;
+
+    cfl_list_init(&context->time_series_entries);
+    cfl_list_init(&context->metadata_entries);
+}
+
+static int pack_remote_write_context(struct cmt_prometheus_remote_write_context *context)
 {
     struct cmt_histogram                      *histogram;
     struct cmt_exp_histogram                  *exp_histogram;
-    struct cmt_prometheus_remote_write_context context;
     struct cmt_untyped                        *untyped;
     struct cmt_counter                        *counter;
     struct cmt_summary                        *summary;
     int                                        result;
     struct cmt_gauge                          *gauge;
     struct cfl_list                            *head;
-    cfl_sds_t                                  buf;
+    struct cmt                                *cmt;
 
     result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
-    buf = NULL;
-
-    memset(&context, 0, sizeof(struct cmt_prometheus_remote_write_context));
-
-    prometheus__write_request__init(&context.write_request);
-
-    context.cmt = cmt;
-
-    cfl_list_init(&context.time_series_entries);
-    cfl_list_init(&context.metadata_entries);
+    cmt = context->cmt;
 
     /* Counters */
     cfl_list_foreach(head, &cmt->counters) {
         counter = cfl_list_entry(head, struct cmt_counter, _head);
-        result = pack_basic_type(&context, counter->map);
+        result = pack_basic_type(context, counter->map);
 
         if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
             result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1299,7 +1921,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Gauges */
         cfl_list_foreach(head, &cmt->gauges) {
             gauge = cfl_list_entry(head, struct cmt_gauge, _head);
-            result = pack_basic_type(&context, gauge->map);
+            result = pack_basic_type(context, gauge->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1316,7 +1938,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Untyped */
         cfl_list_foreach(head, &cmt->untypeds) {
             untyped = cfl_list_entry(head, struct cmt_untyped, _head);
-            result = pack_basic_type(&context, untyped->map);
+            result = pack_basic_type(context, untyped->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1333,7 +1955,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Summaries */
         cfl_list_foreach(head, &cmt->summaries) {
             summary = cfl_list_entry(head, struct cmt_summary, _head);
-            result = pack_complex_type(&context, summary->map);
+            result = pack_complex_type(context, summary->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1350,7 +1972,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Histograms */
         cfl_list_foreach(head, &cmt->histograms) {
             histogram = cfl_list_entry(head, struct cmt_histogram, _head);
-            result = pack_complex_type(&context, histogram->map);
+            result = pack_complex_type(context, histogram->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1367,7 +1989,7 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         /* Exponential Histograms */
         cfl_list_foreach(head, &cmt->exp_histograms) {
             exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
-            result = pack_complex_type(&context, exp_histogram->map);
+            result = pack_complex_type(context, exp_histogram->map);
 
             if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
                 result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
@@ -1380,9 +2002,29 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
         }
     }
 
-    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS ||
-        result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
-        buf = render_remote_write_context_to_sds(&context);
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_ERROR) {
+        result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS;
+    }
+
+    return result;
+}
+
+static cfl_sds_t encode_prometheus_remote_write(struct cmt *cmt, int compress)
+{
+    struct cmt_prometheus_remote_write_context context;
+    int                                        result;
+    cfl_sds_t                                  buf;
+
+    buf = NULL;
+
+    initialize_remote_write_context(&context, cmt);
+
+    result = pack_remote_write_context(&context);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        buf = render_remote_write_context_to_sds(&context,
+                                                 cfl_list_size(&context.time_series_entries),
+                                                 compress);
     }
 
     cmt_destroy_prometheus_remote_write_context(&context);
@@ -1390,6 +2032,73 @@ cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
     return buf;
 }
 
+static struct cfl_list *encode_prometheus_remote_write_split(struct cmt *cmt,
+                                                             size_t max_bytes,
+                                                             size_t max_series,
+                                                             int compress)
+{
+    struct cmt_prometheus_remote_write_context context;
+    struct cfl_list                           *payloads;
+    int                                        result;
+
+    payloads = cmt_encode_split_create();
+
+    if (payloads == NULL) {
+        return NULL;
+    }
+
+    initialize_remote_write_context(&context, cmt);
+
+    context.split_payloads = payloads;
+    context.split_max_bytes = max_bytes;
+    context.split_max_series = max_series;
+    context.split_compress = compress;
+
+    result = pack_remote_write_context(&context);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS &&
+        context.split_pending_series > 0) {
+        result = flush_time_series(&context);
+    }
+
+    cmt_destroy_prometheus_remote_write_context(&context);
+
+    if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        cmt_encode_split_destroy(payloads);
+
+        return NULL;
+    }
+
+    return payloads;
+}
+
+/* Format all the registered metrics in Prometheus Remote Write format */
+cfl_sds_t cmt_encode_prometheus_remote_write_create(struct cmt *cmt)
+{
+    return encode_prometheus_remote_write(cmt, CMT_FALSE);
+}
+
+/* Same as above but the payload is snappy compressed, ready to be sent */
+cfl_sds_t cmt_encode_prometheus_remote_write_create_compressed(struct cmt *cmt)
+{
+    return encode_prometheus_remote_write(cmt, CMT_TRUE);
+}
+
+/* Format the metrics as a list of size bounded payloads */
+struct cfl_list *cmt_encode_prometheus_remote_write_create_split(struct cmt *cmt,
+                                                                 size_t max_bytes,
+                                                                 size_t max_series)
+{
+    return encode_prometheus_remote_write_split(cmt, max_bytes, max_series, CMT_FALSE);
+}
+
+struct cfl_list *cmt_encode_prometheus_remote_write_create_split_compressed(struct cmt *cmt,
+                                                                            size_t max_bytes,
+                                                                            size_t max_series)
+{
+    return encode_prometheus_remote_write_split(cmt, max_bytes, max_series, CMT_TRUE);
+}
+
 void cmt_encode_prometheus_remote_write_destroy(cfl_sds_t text)
 {
     cfl_sds_destroy(text);
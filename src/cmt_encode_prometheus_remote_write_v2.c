@@ -0,0 +1,1116 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_map.h>
+#include <cmetrics/cmt_counter.h>
+#include <cmetrics/cmt_gauge.h>
+#include <cmetrics/cmt_summary.h>
+#include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
+#include <cmetrics/cmt_untyped.h>
+#include <cmetrics/cmt_atomic.h>
+#include <cmetrics/cmt_snappy.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write_v2.h>
+
+#include "cmt_encode_prometheus_native.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* io.prometheus.write.v2.Request */
+#define RW2_REQUEST_SYMBOLS                4
+#define RW2_REQUEST_TIMESERIES             5
+
+/* io.prometheus.write.v2.TimeSeries */
+#define RW2_TIMESERIES_LABELS_REFS         1
+#define RW2_TIMESERIES_SAMPLES             2
+#define RW2_TIMESERIES_HISTOGRAMS          3
+#define RW2_TIMESERIES_METADATA            5
+
+/* io.prometheus.write.v2.Sample */
+#define RW2_SAMPLE_VALUE                   1
+#define RW2_SAMPLE_TIMESTAMP               2
+
+/* io.prometheus.write.v2.Metadata */
+#define RW2_METADATA_TYPE                  1
+#define RW2_METADATA_HELP_REF              3
+#define RW2_METADATA_UNIT_REF              4
+
+/* io.prometheus.write.v2.Metadata.MetricType */
+#define RW2_METRIC_TYPE_UNSPECIFIED        0
+#define RW2_METRIC_TYPE_COUNTER            1
+#define RW2_METRIC_TYPE_GAUGE              2
+#define RW2_METRIC_TYPE_HISTOGRAM          3
+#define RW2_METRIC_TYPE_SUMMARY            5
+
+/* io.prometheus.write.v2.Histogram */
+#define RW2_HISTOGRAM_COUNT_INT            1
+#define RW2_HISTOGRAM_SUM                  3
+#define RW2_HISTOGRAM_SCHEMA               4
+#define RW2_HISTOGRAM_ZERO_THRESHOLD       5
+#define RW2_HISTOGRAM_ZERO_COUNT_INT       6
+#define RW2_HISTOGRAM_NEGATIVE_SPANS       8
+#define RW2_HISTOGRAM_NEGATIVE_DELTAS      9
+#define RW2_HISTOGRAM_POSITIVE_SPANS       11
+#define RW2_HISTOGRAM_POSITIVE_DELTAS      12
+#define RW2_HISTOGRAM_TIMESTAMP            15
+
+#define RW2_INITIAL_BUFFER_SIZE            4096
+#define RW2_INITIAL_SYMBOL_SLOT_COUNT      256
+#define RW2_INITIAL_LABEL_CAPACITY         16
+
+/* The symbol table is kept at most 3/4 full */
+#define RW2_SYMBOL_TABLE_LOAD_NUMERATOR    3
+#define RW2_SYMBOL_TABLE_LOAD_DENOMINATOR  4
+
+/*
+ * Interned strings are not copied, a slot refers to the bytes already
+ * written to the symbols section of the request. Reference zero is the empty
+ * string, so it also marks unused slots.
+ */
+struct rw2_symbol_slot {
+    uint64_t hash;
+    size_t   offset;
+    size_t   length;
+    uint32_t reference;
+};
+
+struct rw2_label {
+    const char *name;
+    size_t      name_length;
+    uint32_t    name_reference;
+    uint32_t    value_reference;
+};
+
+struct rw2_metadata {
+    int      type;
+    uint32_t help_reference;
+    uint32_t unit_reference;
+};
+
+struct rw2_context {
+    struct cmt                 *cmt;
+    uint64_t                    now;
+
+    /* the symbols and the time series are packed apart and joined at the end */
+    struct cmt_protobuf_writer  symbols;
+    struct cmt_protobuf_writer  series;
+
+    struct rw2_symbol_slot     *slots;
+    size_t                      slot_count;
+    uint32_t                    symbol_count;
+
+    /* static and metric labels of the metric being packed, sorted by name */
+    struct rw2_label           *labels;
+    size_t                      label_count;
+    size_t                      label_capacity;
+
+    /* scratch space for synthesized series names */
+    char                       *name;
+    size_t                      name_capacity;
+};
+
+static uint64_t hash_symbol(const char *value, size_t length)
+{
+    cfl_hash_state_t state;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, value, length);
+
+    return cfl_hash_64bits_digest(&state);
+}
+
+static int symbol_table_resize(struct rw2_context *context, size_t slot_count)
+{
+    size_t                  index;
+    size_t                  position;
+    struct rw2_symbol_slot *slots;
+
+    slots = calloc(slot_count, sizeof(struct rw2_symbol_slot));
+
+    if (slots == NULL) {
+        cmt_errno();
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index < context->slot_count ; index++) {
+        if (context->slots[index].reference == 0) {
+            continue;
+        }
+
+        position = context->slots[index].hash & (slot_count - 1);
+
+        while (slots[position].reference != 0) {
+            position = (position + 1) & (slot_count - 1);
+        }
+
+        slots[position] = context->slots[index];
+    }
+
+    if (context->slots != NULL) {
+        free(context->slots);
+    }
+
+    context->slots = slots;
+    context->slot_count = slot_count;
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+}
+
+/* Return the reference of a string, adding it to the symbols table if needed */
+static int intern_symbol(struct rw2_context *context,
+                         const char *value, size_t length,
+                         uint32_t *reference)
+{
+    int                     result;
+    size_t                  position;
+    uint64_t                hash;
+    struct rw2_symbol_slot *slot;
+
+    if (value == NULL || length == 0) {
+        *reference = 0;
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+    }
+
+    hash = hash_symbol(value, length);
+    position = hash & (context->slot_count - 1);
+
+    while (context->slots[position].reference != 0) {
+        slot = &context->slots[position];
+
+        if (slot->hash == hash &&
+            slot->length == length &&
+            memcmp(&context->symbols.data[slot->offset], value, length) == 0) {
+            *reference = slot->reference;
+
+            return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+        }
+
+        position = (position + 1) & (context->slot_count - 1);
+    }
+
+    cmt_protobuf_write_bytes_field(&context->symbols, RW2_REQUEST_SYMBOLS,
+                                   value, length);
+
+    if (context->symbols.error != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    slot = &context->slots[position];
+    slot->hash = hash;
+    slot->offset = context->symbols.size - length;
+    slot->length = length;
+    slot->reference = context->symbol_count++;
+
+    *reference = slot->reference;
+
+    if ((size_t) context->symbol_count * RW2_SYMBOL_TABLE_LOAD_DENOMINATOR >=
+        context->slot_count * RW2_SYMBOL_TABLE_LOAD_NUMERATOR) {
+        result = symbol_table_resize(context, context->slot_count * 2);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            return result;
+        }
+    }
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+}
+
+static int intern_sds(struct rw2_context *context, cfl_sds_t value,
+                      uint32_t *reference)
+{
+    if (value == NULL) {
+        *reference = 0;
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+    }
+
+    return intern_symbol(context, value, cfl_sds_len(value), reference);
+}
+
+static int compare_label_names(const char *left, size_t left_length,
+                               const char *right, size_t right_length)
+{
+    int result;
+
+    result = memcmp(left, right,
+                    left_length < right_length ? left_length : right_length);
+
+    if (result != 0) {
+        return result;
+    }
+
+    if (left_length == right_length) {
+        return 0;
+    }
+
+    return left_length < right_length ? -1 : 1;
+}
+
+/* Insert a label keeping the list sorted by name, label sets are small */
+static void insert_label(struct rw2_label *labels, size_t *count,
+                         struct rw2_label *label)
+{
+    size_t index;
+
+    index = *count;
+
+    while (index > 0 &&
+           compare_label_names(labels[index - 1].name,
+                               labels[index - 1].name_length,
+                               label->name, label->name_length) > 0) {
+        labels[index] = labels[index - 1];
+        index--;
+    }
+
+    labels[index] = *label;
+    (*count)++;
+}
+
+static int append_label(struct rw2_context *context,
+                        cfl_sds_t name, cfl_sds_t value)
+{
+    int               result;
+    size_t            capacity;
+    struct rw2_label  label;
+    struct rw2_label *labels;
+
+    if (context->label_count == context->label_capacity) {
+        capacity = context->label_capacity * 2;
+
+        if (capacity == 0) {
+            capacity = RW2_INITIAL_LABEL_CAPACITY;
+        }
+
+        labels = realloc(context->labels, capacity * sizeof(struct rw2_label));
+
+        if (labels == NULL) {
+            cmt_errno();
+
+            return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+        }
+
+        context->labels = labels;
+        context->label_capacity = capacity;
+    }
+
+    label.name = name;
+    label.name_length = cfl_sds_len(name);
+
+    result = intern_sds(context, name, &label.name_reference);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        result = intern_sds(context, value, &label.value_reference);
+    }
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        insert_label(context->labels, &context->label_count, &label);
+    }
+
+    return result;
+}
+
+/*
+ * Collect the static labels and the labels of the metric, every series
+ * generated from the metric shares them.
+ */
+static int set_up_metric_labels(struct rw2_context *context,
+                                struct cmt_map *map,
+                                struct cmt_metric *metric)
+{
+    int                   result;
+    int                   label_index;
+    struct cfl_list      *head;
+    struct cmt_label     *static_label;
+    struct cmt_map_label *label_k;
+    struct cmt_map_label *label_v;
+
+    context->label_count = 0;
+    result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+
+    cfl_list_foreach(head, &context->cmt->static_labels->list) {
+        static_label = cfl_list_entry(head, struct cmt_label, _head);
+
+        result = append_label(context, static_label->key, static_label->val);
+
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (map->label_count == 0) {
+        return result;
+    }
+
+    label_index = 0;
+    label_k = cfl_list_entry_first(&map->label_keys, struct cmt_map_label, _head);
+
+    cfl_list_foreach(head, &metric->labels) {
+        if (label_index >= map->label_count) {
+            break;
+        }
+
+        label_v = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        if (label_k->name != NULL && label_v->name != NULL) {
+            result = append_label(context, label_k->name, label_v->name);
+
+            if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+                return result;
+            }
+        }
+
+        label_index++;
+        label_k = cfl_list_entry_next(&label_k->_head, struct cmt_map_label,
+                                      _head, &map->label_keys);
+    }
+
+    return result;
+}
+
+/* Build '<fqname><suffix>' in the name scratch buffer */
+static const char *synthesize_name(struct rw2_context *context,
+                                   cfl_sds_t fqname, const char *suffix,
+                                   size_t *length)
+{
+    char   *name;
+    size_t  fqname_length;
+    size_t  suffix_length;
+
+    fqname_length = cfl_sds_len(fqname);
+    suffix_length = strlen(suffix);
+
+    if (fqname_length + suffix_length > context->name_capacity) {
+        name = realloc(context->name, fqname_length + suffix_length);
+
+        if (name == NULL) {
+            cmt_errno();
+
+            return NULL;
+        }
+
+        context->name = name;
+        context->name_capacity = fqname_length + suffix_length;
+    }
+
+    memcpy(context->name, fqname, fqname_length);
+    memcpy(&context->name[fqname_length], suffix, suffix_length);
+
+    *length = fqname_length + suffix_length;
+
+    return context->name;
+}
+
+/*
+ * Start a time series and pack its label references: the metric labels
+ * merged with __name__ and the optional le or quantile label, in name order.
+ */
+static size_t begin_series(struct rw2_context *context,
+                           const char *name, size_t name_length,
+                           const char *extra_name, const char *extra_value)
+{
+    size_t           index;
+    size_t           extra_index;
+    size_t           extra_count;
+    size_t           series_mark;
+    size_t           labels_mark;
+    struct rw2_label extra[2];
+
+    extra[0].name = "__name__";
+    extra[0].name_length = 8;
+
+    if (intern_symbol(context, extra[0].name, extra[0].name_length,
+                      &extra[0].name_reference) != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS ||
+        intern_symbol(context, name, name_length,
+                      &extra[0].value_reference) != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        return 0;
+    }
+
+    extra_count = 1;
+
+    if (extra_name != NULL) {
+        extra[1].name = extra_name;
+        extra[1].name_length = strlen(extra_name);
+
+        if (intern_symbol(context, extra_name, extra[1].name_length,
+                          &extra[1].name_reference) != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS ||
+            intern_symbol(context, extra_value, strlen(extra_value),
+                          &extra[1].value_reference) != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            return 0;
+        }
+
+        extra_count = 2;
+    }
+
+    series_mark = cmt_protobuf_begin_message(&context->series,
+                                             RW2_REQUEST_TIMESERIES);
+    labels_mark = cmt_protobuf_begin_message(&context->series,
+                                             RW2_TIMESERIES_LABELS_REFS);
+
+    index = 0;
+    extra_index = 0;
+
+    while (index < context->label_count || extra_index < extra_count) {
+        if (extra_index < extra_count &&
+            (index >= context->label_count ||
+             compare_label_names(extra[extra_index].name,
+                                 extra[extra_index].name_length,
+                                 context->labels[index].name,
+                                 context->labels[index].name_length) < 0)) {
+            cmt_protobuf_write_varint(&context->series,
+                                      extra[extra_index].name_reference);
+            cmt_protobuf_write_varint(&context->series,
+                                      extra[extra_index].value_reference);
+            extra_index++;
+        }
+        else {
+            cmt_protobuf_write_varint(&context->series,
+                                      context->labels[index].name_reference);
+            cmt_protobuf_write_varint(&context->series,
+                                      context->labels[index].value_reference);
+            index++;
+        }
+    }
+
+    cmt_protobuf_end_message(&context->series, labels_mark);
+
+    return series_mark;
+}
+
+static int end_series(struct rw2_context *context, size_t series_mark,
+                      struct rw2_metadata *metadata)
+{
+    size_t mark;
+
+    mark = cmt_protobuf_begin_message(&context->series, RW2_TIMESERIES_METADATA);
+
+    if (metadata->type != RW2_METRIC_TYPE_UNSPECIFIED) {
+        cmt_protobuf_write_uint64_field(&context->series, RW2_METADATA_TYPE,
+                                        metadata->type);
+    }
+
+    if (metadata->help_reference != 0) {
+        cmt_protobuf_write_uint64_field(&context->series, RW2_METADATA_HELP_REF,
+                                        metadata->help_reference);
+    }
+
+    if (metadata->unit_reference != 0) {
+        cmt_protobuf_write_uint64_field(&context->series, RW2_METADATA_UNIT_REF,
+                                        metadata->unit_reference);
+    }
+
+    cmt_protobuf_end_message(&context->series, mark);
+    cmt_protobuf_end_message(&context->series, series_mark);
+
+    if (context->series.error != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+}
+
+static int pack_sample_series(struct rw2_context *context,
+                              struct rw2_metadata *metadata,
+                              const char *name, size_t name_length,
+                              const char *extra_name, const char *extra_value,
+                              double value, uint64_t timestamp)
+{
+    size_t series_mark;
+    size_t mark;
+
+    if (name == NULL) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    series_mark = begin_series(context, name, name_length,
+                               extra_name, extra_value);
+
+    if (series_mark == 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    mark = cmt_protobuf_begin_message(&context->series, RW2_TIMESERIES_SAMPLES);
+    cmt_protobuf_write_double_field(&context->series, RW2_SAMPLE_VALUE, value);
+    /* convert from nanoseconds to milliseconds */
+    cmt_protobuf_write_int64_field(&context->series, RW2_SAMPLE_TIMESTAMP,
+                                   timestamp / 1000000);
+    cmt_protobuf_end_message(&context->series, mark);
+
+    return end_series(context, series_mark, metadata);
+}
+
+static int pack_summary(struct rw2_context *context,
+                        struct rw2_metadata *metadata,
+                        struct cmt_map *map,
+                        struct cmt_metric *metric,
+                        uint64_t timestamp)
+{
+    int                 result;
+    size_t              index;
+    size_t              length;
+    const char         *name;
+    char                quantile[64];
+    struct cmt_summary *summary;
+
+    summary = (struct cmt_summary *) map->parent;
+
+    name = synthesize_name(context, map->opts->fqname, "_count", &length);
+    result = pack_sample_series(context, metadata, name, length, NULL, NULL,
+                                (double) cmt_summary_get_count_value(metric),
+                                timestamp);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        name = synthesize_name(context, map->opts->fqname, "_sum", &length);
+        result = pack_sample_series(context, metadata, name, length, NULL, NULL,
+                                    cmt_summary_get_sum_value(metric),
+                                    timestamp);
+    }
+
+    if (!cmt_atomic_load(&metric->sum_quantiles_set)) {
+        return result;
+    }
+
+    for (index = 0 ;
+         result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS &&
+         index < summary->quantiles_count ;
+         index++) {
+        snprintf(quantile, sizeof(quantile) - 1, "%.17g", summary->quantiles[index]);
+
+        result = pack_sample_series(context, metadata,
+                                    map->opts->fqname,
+                                    cfl_sds_len(map->opts->fqname),
+                                    "quantile", quantile,
+                                    cmt_summary_quantile_get_value(metric, index),
+                                    timestamp);
+    }
+
+    return result;
+}
+
+/* Classic buckets as cumulative _bucket series plus the _count and _sum series */
+static int pack_classic_histogram(struct rw2_context *context,
+                                  struct rw2_metadata *metadata,
+                                  struct cmt_map *map,
+                                  double *upper_bounds,
+                                  size_t upper_bounds_count,
+                                  uint64_t *bucket_values,
+                                  int sum_set,
+                                  double sum,
+                                  uint64_t timestamp)
+{
+    int         result;
+    size_t      index;
+    size_t      length;
+    const char *name;
+    char        upper_bound[64];
+
+    name = synthesize_name(context, map->opts->fqname, "_count", &length);
+    result = pack_sample_series(context, metadata, name, length, NULL, NULL,
+                                (double) bucket_values[upper_bounds_count],
+                                timestamp);
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS && sum_set) {
+        name = synthesize_name(context, map->opts->fqname, "_sum", &length);
+        result = pack_sample_series(context, metadata, name, length, NULL, NULL,
+                                    sum, timestamp);
+    }
+
+    for (index = 0 ;
+         result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS &&
+         index <= upper_bounds_count ;
+         index++) {
+        if (index < upper_bounds_count) {
+            snprintf(upper_bound, sizeof(upper_bound) - 1, "%.17g",
+                     upper_bounds[index]);
+        }
+        else {
+            strcpy(upper_bound, "+Inf");
+        }
+
+        name = synthesize_name(context, map->opts->fqname, "_bucket", &length);
+        result = pack_sample_series(context, metadata, name, length,
+                                    "le", upper_bound,
+                                    (double) bucket_values[index],
+                                    timestamp);
+    }
+
+    return result;
+}
+
+static int pack_histogram(struct rw2_context *context,
+                          struct rw2_metadata *metadata,
+                          struct cmt_map *map,
+                          struct cmt_metric *metric,
+                          uint64_t timestamp)
+{
+    int                           result;
+    size_t                        index;
+    uint64_t                     *bucket_values;
+    struct cmt_histogram         *histogram;
+    struct cmt_histogram_buckets *buckets;
+
+    histogram = (struct cmt_histogram *) map->parent;
+    buckets = histogram->buckets;
+
+    /* the last value is the +Inf bucket, which matches the sample count */
+    bucket_values = malloc(sizeof(uint64_t) * (buckets->count + 1));
+
+    if (bucket_values == NULL) {
+        cmt_errno();
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ; index <= buckets->count ; index++) {
+        bucket_values[index] = cmt_metric_hist_get_value(metric, index);
+    }
+
+    result = pack_classic_histogram(context, metadata, map,
+                                    buckets->upper_bounds, buckets->count,
+                                    bucket_values,
+                                    CMT_TRUE,
+                                    cmt_metric_hist_get_sum_value(metric),
+                                    timestamp);
+
+    free(bucket_values);
+
+    return result;
+}
+
+/*
+ * Exponential histograms with a scale below the lowest native histogram
+ * schema cannot be represented as a native histogram, they are sent as a
+ * classic histogram instead.
+ */
+static int pack_exp_histogram_as_classic(struct rw2_context *context,
+                                         struct rw2_metadata *metadata,
+                                         struct cmt_map *map,
+                                         struct cmt_metric *metric,
+                                         struct cmt_exp_histogram_snapshot *snapshot,
+                                         uint64_t timestamp)
+{
+    int       result;
+    size_t    bucket_count;
+    size_t    upper_bounds_count;
+    uint64_t *bucket_values;
+    double   *upper_bounds;
+
+    result = cmt_exp_histogram_to_explicit(metric,
+                                           &upper_bounds,
+                                           &upper_bounds_count,
+                                           &bucket_values,
+                                           &bucket_count);
+    if (result != 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    result = pack_classic_histogram(context, metadata, map,
+                                    upper_bounds, upper_bounds_count,
+                                    bucket_values,
+                                    snapshot->sum_set,
+                                    cmt_math_uint64_to_d64(snapshot->sum),
+                                    timestamp);
+
+    free(bucket_values);
+    free(upper_bounds);
+
+    return result;
+}
+
+static int pack_native_histogram(struct rw2_context *context,
+                                 struct rw2_metadata *metadata,
+                                 struct cmt_map *map,
+                                 struct cmt_metric *metric,
+                                 uint64_t timestamp)
+{
+    int                               result;
+    int                               reduction;
+    size_t                            mark;
+    size_t                            series_mark;
+    struct cmt_exp_histogram_snapshot snapshot;
+
+    if (cmt_metric_exp_hist_get_snapshot(metric, &snapshot) != 0) {
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    if (snapshot.scale < CMT_ENCODE_PROMETHEUS_PROTOBUF_MIN_SCHEMA) {
+        result = pack_exp_histogram_as_classic(context, metadata, map, metric,
+                                               &snapshot, timestamp);
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+        return result;
+    }
+
+    reduction = 0;
+    if (snapshot.scale > CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA) {
+        reduction = snapshot.scale - CMT_ENCODE_PROMETHEUS_PROTOBUF_MAX_SCHEMA;
+    }
+
+    series_mark = begin_series(context, map->opts->fqname,
+                               cfl_sds_len(map->opts->fqname), NULL, NULL);
+
+    if (series_mark == 0) {
+        cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_ALLOCATION_ERROR;
+    }
+
+    mark = cmt_protobuf_begin_message(&context->series, RW2_TIMESERIES_HISTOGRAMS);
+
+    cmt_protobuf_write_uint64_field(&context->series, RW2_HISTOGRAM_COUNT_INT,
+                                    snapshot.count);
+
+    if (snapshot.sum_set) {
+        cmt_protobuf_write_double_field(&context->series, RW2_HISTOGRAM_SUM,
+                                        cmt_math_uint64_to_d64(snapshot.sum));
+    }
+
+    cmt_protobuf_write_sint64_field(&context->series, RW2_HISTOGRAM_SCHEMA,
+                                    snapshot.scale - reduction);
+    cmt_protobuf_write_double_field(&context->series, RW2_HISTOGRAM_ZERO_THRESHOLD,
+                                    snapshot.zero_threshold);
+    cmt_protobuf_write_uint64_field(&context->series, RW2_HISTOGRAM_ZERO_COUNT_INT,
+                                    snapshot.zero_count);
+
+    cmt_encode_prometheus_protobuf_native_buckets(&context->series,
+                                                  snapshot.negative_buckets,
+                                                  snapshot.negative_count,
+                                                  snapshot.negative_offset,
+                                                  reduction,
+                                                  RW2_HISTOGRAM_NEGATIVE_SPANS,
+                                                  RW2_HISTOGRAM_NEGATIVE_DELTAS);
+
+    cmt_encode_prometheus_protobuf_native_buckets(&context->series,
+                                                  snapshot.positive_buckets,
+                                                  snapshot.positive_count,
+                                                  snapshot.positive_offset,
+                                                  reduction,
+                                                  RW2_HISTOGRAM_POSITIVE_SPANS,
+                                                  RW2_HISTOGRAM_POSITIVE_DELTAS);
+
+    /* convert from nanoseconds to milliseconds */
+    cmt_protobuf_write_int64_field(&context->series, RW2_HISTOGRAM_TIMESTAMP,
+                                   timestamp / 1000000);
+
+    cmt_protobuf_end_message(&context->series, mark);
+
+    cmt_metric_exp_hist_snapshot_destroy(&snapshot);
+
+    return end_series(context, series_mark, metadata);
+}
+
+static int check_staled_timestamp(uint64_t timestamp, uint64_t now)
+{
+    if (timestamp >= now) {
+        return CMT_FALSE;
+    }
+
+    return now - timestamp > CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_CUTOFF_THRESHOLD;
+}
+
+static int pack_metric(struct rw2_context *context,
+                       struct rw2_metadata *metadata,
+                       struct cmt_map *map,
+                       struct cmt_metric *metric)
+{
+    int      result;
+    uint64_t timestamp;
+
+    timestamp = cmt_metric_get_timestamp(metric);
+
+    if (check_staled_timestamp(timestamp, context->now)) {
+        /* Skip processing metrics which are staled over the threshold */
+        return CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+    }
+
+    result = set_up_metric_labels(context, map, metric);
+
+    if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        return result;
+    }
+
+    if (map->type == CMT_SUMMARY) {
+        return pack_summary(context, metadata, map, metric, timestamp);
+    }
+    else if (map->type == CMT_HISTOGRAM) {
+        return pack_histogram(context, metadata, map, metric, timestamp);
+    }
+    else if (map->type == CMT_EXP_HISTOGRAM) {
+        return pack_native_histogram(context, metadata, map, metric, timestamp);
+    }
+
+    return pack_sample_series(context, metadata,
+                              map->opts->fqname, cfl_sds_len(map->opts->fqname),
+                              NULL, NULL,
+                              cmt_metric_get_value(metric), timestamp);
+}
+
+static int metric_type(struct cmt_map *map)
+{
+    if (map->type == CMT_COUNTER) {
+        return RW2_METRIC_TYPE_COUNTER;
+    }
+    else if (map->type == CMT_GAUGE) {
+        return RW2_METRIC_TYPE_GAUGE;
+    }
+    else if (map->type == CMT_SUMMARY) {
+        return RW2_METRIC_TYPE_SUMMARY;
+    }
+    else if (map->type == CMT_HISTOGRAM ||
+             map->type == CMT_EXP_HISTOGRAM) {
+        return RW2_METRIC_TYPE_HISTOGRAM;
+    }
+
+    return RW2_METRIC_TYPE_UNSPECIFIED;
+}
+
+static int pack_map(struct rw2_context *context, struct cmt_map *map)
+{
+    int                  result;
+    struct cfl_list     *head;
+    struct cmt_metric   *metric;
+    struct cmt_opts     *opts;
+    struct rw2_metadata  metadata;
+
+    opts = map->opts;
+
+    metadata.type = metric_type(map);
+    metadata.help_reference = 0;
+    metadata.unit_reference = 0;
+
+    result = CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS;
+
+    /* a single whitespace description signals that no HELP was provided */
+    if (opts->description != NULL &&
+        (cfl_sds_len(opts->description) > 1 || opts->description[0] != ' ')) {
+        result = intern_sds(context, opts->description, &metadata.help_reference);
+    }
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        result = intern_sds(context, map->unit, &metadata.unit_reference);
+    }
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS &&
+        map->metric_static_set) {
+        result = pack_metric(context, &metadata, map, &map->metric);
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        result = pack_metric(context, &metadata, map, metric);
+    }
+
+    return result;
+}
+
+static void destroy_context(struct rw2_context *context)
+{
+    cmt_protobuf_writer_destroy(&context->symbols);
+    cmt_protobuf_writer_destroy(&context->series);
+
+    if (context->slots != NULL) {
+        free(context->slots);
+    }
+
+    if (context->labels != NULL) {
+        free(context->labels);
+    }
+
+    if (context->name != NULL) {
+        free(context->name);
+    }
+}
+
+static cfl_sds_t compress_payload(unsigned char *payload, size_t payload_size)
+{
+    int       result;
+    size_t    compressed_size;
+    cfl_sds_t result_buffer;
+
+    compressed_size = cmt_snappy_max_compressed_length(payload_size);
+
+    result_buffer = cfl_sds_create_size(compressed_size);
+
+    if (result_buffer == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    result = cmt_snappy_compress((char *) payload, payload_size,
+                                 result_buffer, compressed_size,
+                                 &compressed_size);
+
+    if (result != CMT_SNAPPY_SUCCESS) {
+        cfl_sds_destroy(result_buffer);
+
+        return NULL;
+    }
+
+    cfl_sds_set_len(result_buffer, compressed_size);
+
+    return result_buffer;
+}
+
+static cfl_sds_t encode_prometheus_remote_write_v2(struct cmt *cmt, int compress)
+{
+    int                       result;
+    cfl_sds_t                 buf;
+    struct cfl_list          *head;
+    struct cmt_counter       *counter;
+    struct cmt_gauge         *gauge;
+    struct cmt_summary       *summary;
+    struct cmt_histogram     *histogram;
+    struct cmt_exp_histogram *exp_histogram;
+    struct cmt_untyped       *untyped;
+    struct rw2_context        context;
+
+    if (cmt == NULL) {
+        return NULL;
+    }
+
+    memset(&context, 0, sizeof(struct rw2_context));
+
+    context.cmt = cmt;
+    context.now = cfl_time_now();
+
+    result = cmt_protobuf_writer_init(&context.symbols, RW2_INITIAL_BUFFER_SIZE);
+
+    if (result == CMT_PROTOBUF_WIRE_SUCCESS) {
+        result = cmt_protobuf_writer_init(&context.series, RW2_INITIAL_BUFFER_SIZE);
+    }
+
+    if (result == CMT_PROTOBUF_WIRE_SUCCESS) {
+        result = symbol_table_resize(&context, RW2_INITIAL_SYMBOL_SLOT_COUNT);
+    }
+
+    if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        destroy_context(&context);
+
+        return NULL;
+    }
+
+    /* the first symbol is always the empty string */
+    cmt_protobuf_write_bytes_field(&context.symbols, RW2_REQUEST_SYMBOLS, "", 0);
+    context.symbol_count = 1;
+
+    /* Counters */
+    cfl_list_foreach(head, &cmt->counters) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        result = pack_map(&context, counter->map);
+    }
+
+    /* Gauges */
+    cfl_list_foreach(head, &cmt->gauges) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        result = pack_map(&context, gauge->map);
+    }
+
+    /* Untyped */
+    cfl_list_foreach(head, &cmt->untypeds) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        untyped = cfl_list_entry(head, struct cmt_untyped, _head);
+        result = pack_map(&context, untyped->map);
+    }
+
+    /* Summaries */
+    cfl_list_foreach(head, &cmt->summaries) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        result = pack_map(&context, summary->map);
+    }
+
+    /* Histograms */
+    cfl_list_foreach(head, &cmt->histograms) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        result = pack_map(&context, histogram->map);
+    }
+
+    /* Exponential Histograms */
+    cfl_list_foreach(head, &cmt->exp_histograms) {
+        if (result != CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+            break;
+        }
+        exp_histogram = cfl_list_entry(head, struct cmt_exp_histogram, _head);
+        result = pack_map(&context, exp_histogram->map);
+    }
+
+    buf = NULL;
+
+    if (result == CMT_ENCODE_PROMETHEUS_REMOTE_WRITE_V2_SUCCESS) {
+        /* the symbols table goes first, followed by the time series */
+        cmt_protobuf_write_raw(&context.symbols, context.series.data,
+                               context.series.size);
+
+        if (context.symbols.error == CMT_PROTOBUF_WIRE_SUCCESS &&
+            context.series.error == CMT_PROTOBUF_WIRE_SUCCESS) {
+            if (compress) {
+                buf = compress_payload(context.symbols.data, context.symbols.size);
+            }
+            else {
+                buf = cmt_protobuf_writer_to_sds(&context.symbols);
+            }
+        }
+    }
+
+    destroy_context(&context);
+
+    return buf;
+}
+
+cfl_sds_t cmt_encode_prometheus_remote_write_v2_create(struct cmt *cmt)
+{
+    return encode_prometheus_remote_write_v2(cmt, CMT_FALSE);
+}
+
+cfl_sds_t cmt_encode_prometheus_remote_write_v2_create_compressed(struct cmt *cmt)
+{
+    return encode_prometheus_remote_write_v2(cmt, CMT_TRUE);
+}
+
+void cmt_encode_prometheus_remote_write_v2_destroy(cfl_sds_t payload)
+{
+    if (payload != NULL) {
+        cfl_sds_destroy(payload);
+    }
+}
@@ -0,0 +1,80 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_encode_split.h>
+
+struct cfl_list *cmt_encode_split_create(void)
+{
+    struct cfl_list *payloads;
+
+    payloads = malloc(sizeof(struct cfl_list));
+
+    if (payloads == NULL) {
+        cmt_errno();
+
+        return NULL;
+    }
+
+    cfl_list_init(payloads);
+
+    return payloads;
+}
+
+int cmt_encode_split_append(struct cfl_list *payloads,
+                            cfl_sds_t data, size_t series_count)
+{
+    struct cmt_encode_split_payload *payload;
+
+    payload = calloc(1, sizeof(struct cmt_encode_split_payload));
+
+    if (payload == NULL) {
+        cmt_errno();
+
+        return -1;
+    }
+
+    payload->data = data;
+    payload->series_count = series_count;
+
+    cfl_list_add(&payload->_head, payloads);
+
+    return 0;
+}
+
+void cmt_encode_split_destroy(struct cfl_list *payloads)
+{
+    struct cmt_encode_split_payload *payload;
+    struct cfl_list                 *head;
+    struct cfl_list                 *tmp;
+
+    if (payloads == NULL) {
+        return;
+    }
+
+    cfl_list_foreach_safe(head, tmp, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        cfl_list_del(&payload->_head);
+        cfl_sds_destroy(payload->data);
+        free(payload);
+    }
+
+    free(payloads);
+}
@@ -143,7 +143,7 @@ static void append_variant_value(cfl_sds_t *buf, struct cfl_variant *value)
 
     if (value->type == CFL_VARIANT_STRING || value->type == CFL_VARIANT_REFERENCE) {
         cfl_sds_cat_safe(buf, "\"", 1);
-        cfl_sds_cat_safe(buf, value->data.as_string, cfl_sds_len(value->data.as_string));
+        cfl_sds_cat_safe(buf, value->data.as_string, strlen(value->data.as_string));
         cfl_sds_cat_safe(buf, "\"", 1);
     }
     else if (value->type == CFL_VARIANT_BOOL) {
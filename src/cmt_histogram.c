@@ -206,6 +206,20 @@ static int check_buckets(struct cmt_histogram_buckets *buckets)
     return 0;
 }
 
+/*
+ * Release a histogram that could not be created, buckets passed by the caller
+ * are left to it so they are owned by the histogram only on success.
+ */
+static void histogram_create_abort(struct cmt_histogram *h,
+                                   struct cmt_histogram_buckets *buckets)
+{
+    if (h->buckets == buckets) {
+        h->buckets = NULL;
+    }
+
+    cmt_histogram_destroy(h);
+}
+
 struct cmt_histogram *cmt_histogram_create(struct cmt *cmt,
                                            char *ns, char *subsystem,
                                            char *name, char *help,
@@ -258,7 +272,7 @@ struct cmt_histogram *cmt_histogram_create(struct cmt *cmt,
     /* Validate buckets order */
     ret = check_buckets(h->buckets);
     if (ret != 0) {
-        cmt_histogram_destroy(h);
+        histogram_create_abort(h, buckets);
         return NULL;
     }
 
@@ -266,7 +280,7 @@ struct cmt_histogram *cmt_histogram_create(struct cmt *cmt,
     ret = cmt_opts_init(&h->opts, ns, subsystem, name, help);
     if (ret == -1) {
         cmt_log_error(cmt, "unable to initialize options for histogram");
-        cmt_histogram_destroy(h);
+        histogram_create_abort(h, buckets);
         return NULL;
     }
 
@@ -275,7 +289,7 @@ struct cmt_histogram *cmt_histogram_create(struct cmt *cmt,
                             (void *) h);
     if (!h->map) {
         cmt_log_error(cmt, "unable to allocate map for histogram");
-        cmt_histogram_destroy(h);
+        histogram_create_abort(h, buckets);
         return NULL;
     }
 
@@ -0,0 +1,133 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_hll.h>
+
+struct cmt_hll *cmt_hll_create()
+{
+    struct cmt_hll *hll;
+
+    hll = calloc(1, sizeof(struct cmt_hll));
+    if (hll == NULL) {
+        cmt_errno();
+        return NULL;
+    }
+
+    return hll;
+}
+
+struct cmt_hll *cmt_hll_clone(struct cmt_hll *hll)
+{
+    struct cmt_hll *clone;
+
+    clone = malloc(sizeof(struct cmt_hll));
+    if (clone == NULL) {
+        cmt_errno();
+        return NULL;
+    }
+
+    memcpy(clone, hll, sizeof(struct cmt_hll));
+
+    return clone;
+}
+
+void cmt_hll_destroy(struct cmt_hll *hll)
+{
+    free(hll);
+}
+
+void cmt_hll_add(struct cmt_hll *hll, const void *data, size_t length)
+{
+    cmt_hll_add_hash(hll, cfl_hash_64bits(data, length));
+}
+
+/*
+ * The top bits of the hash pick a register, which keeps the longest run of
+ * leading zeros seen in the remaining bits, plus one.
+ */
+void cmt_hll_add_hash(struct cmt_hll *hll, uint64_t hash)
+{
+    size_t   index;
+    uint8_t  rank;
+    uint64_t bits;
+
+    index = hash >> (64 - CMT_HLL_PRECISION);
+
+    /* the sentinel bit caps the rank once the remaining bits are consumed */
+    bits = (hash << CMT_HLL_PRECISION) |
+           (UINT64_C(1) << (CMT_HLL_PRECISION - 1));
+
+    for (rank = 1 ; (bits & (UINT64_C(1) << 63)) == 0 ; rank++) {
+        bits <<= 1;
+    }
+
+    if (hll->registers[index] < rank) {
+        hll->registers[index] = rank;
+    }
+}
+
+void cmt_hll_merge(struct cmt_hll *dst, struct cmt_hll *src)
+{
+    size_t index;
+
+    for (index = 0 ; index < CMT_HLL_REGISTERS ; index++) {
+        if (dst->registers[index] < src->registers[index]) {
+            dst->registers[index] = src->registers[index];
+        }
+    }
+}
+
+/*
+ * Harmonic mean of the registers, with linear counting for small sets where
+ * the raw estimate is biased. With 64 bit hashes no large range correction is
+ * needed. The estimate is rounded to a whole number of members.
+ */
+double cmt_hll_estimate(struct cmt_hll *hll)
+{
+    size_t index;
+    size_t zeros;
+    double sum;
+    double alpha;
+    double estimate;
+
+    zeros = 0;
+    sum = 0;
+
+    for (index = 0 ; index < CMT_HLL_REGISTERS ; index++) {
+        sum += ldexp(1.0, -hll->registers[index]);
+
+        if (hll->registers[index] == 0) {
+            zeros++;
+        }
+    }
+
+    alpha = 0.7213 / (1.0 + 1.079 / CMT_HLL_REGISTERS);
+    estimate = alpha * CMT_HLL_REGISTERS * CMT_HLL_REGISTERS / sum;
+
+    if (estimate <= 2.5 * CMT_HLL_REGISTERS && zeros > 0) {
+        estimate = CMT_HLL_REGISTERS * log((double) CMT_HLL_REGISTERS / zeros);
+    }
+
+    return round(estimate);
+}
@@ -0,0 +1,1294 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_math.h>
+#include <cmetrics/cmt_json.h>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMT_JSON_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#define CMT_JSON_WRITER_MINIMUM_CAPACITY 256
+
+static const char json_hex_digits[] = "0123456789abcdef";
+static const char json_base64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#ifdef CMT_JSON_SSE2
+static inline int first_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    _BitScanForward(&index, mask);
+
+    return (int) index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*
+ * Position of the first byte in 'data' that ends a run of plain string
+ * content: a quote, a backslash or a control character. Returns 'size' when
+ * there is none.
+ */
+static size_t scan_string(const char *data, size_t size)
+{
+    size_t        index;
+    unsigned char byte;
+#ifdef CMT_JSON_SSE2
+    unsigned int  mask;
+    __m128i       chunk;
+    __m128i       quote;
+    __m128i       backslash;
+    __m128i       control;
+
+    quote = _mm_set1_epi8('"');
+    backslash = _mm_set1_epi8('\\');
+    control = _mm_set1_epi8(0x1F);
+#endif
+
+    index = 0;
+
+#ifdef CMT_JSON_SSE2
+    while (index + 16 <= size) {
+        chunk = _mm_loadu_si128((const __m128i *) &data[index]);
+
+        /* max(byte, 0x1F) == 0x1F only holds for bytes up to 0x1F */
+        mask = _mm_movemask_epi8(
+                   _mm_or_si128(
+                       _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                    _mm_cmpeq_epi8(chunk, backslash)),
+                       _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control)));
+
+        if (mask != 0) {
+            return index + first_bit(mask);
+        }
+
+        index += 16;
+    }
+#endif
+
+    while (index < size) {
+        byte = (unsigned char) data[index];
+
+        if (byte == '"' || byte == '\\' || byte < 0x20) {
+            return index;
+        }
+
+        index++;
+    }
+
+    return size;
+}
+
+/*
+ * Position of the next byte that matters when skipping over a container: a
+ * quote or a bracket. Returns 'size' when there is none.
+ */
+static size_t scan_structural(const char *data, size_t size)
+{
+    size_t       index;
+    char         byte;
+#ifdef CMT_JSON_SSE2
+    unsigned int mask;
+    __m128i      chunk;
+    __m128i      matches;
+    __m128i      quote;
+    __m128i      brace_open;
+    __m128i      brace_close;
+    __m128i      bracket_open;
+    __m128i      bracket_close;
+
+    quote = _mm_set1_epi8('"');
+    brace_open = _mm_set1_epi8('{');
+    brace_close = _mm_set1_epi8('}');
+    bracket_open = _mm_set1_epi8('[');
+    bracket_close = _mm_set1_epi8(']');
+#endif
+
+    index = 0;
+
+#ifdef CMT_JSON_SSE2
+    while (index + 16 <= size) {
+        chunk = _mm_loadu_si128((const __m128i *) &data[index]);
+
+        matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                               _mm_cmpeq_epi8(chunk, brace_open));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, brace_close));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, bracket_open));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, bracket_close));
+
+        mask = _mm_movemask_epi8(matches);
+        if (mask != 0) {
+            return index + first_bit(mask);
+        }
+
+        index += 16;
+    }
+#endif
+
+    while (index < size) {
+        byte = data[index];
+
+        if (byte == '"' || byte == '{' || byte == '}' ||
+            byte == '[' || byte == ']') {
+            return index;
+        }
+
+        index++;
+    }
+
+    return size;
+}
+
+static int writer_reserve(struct cmt_json_writer *writer, size_t length)
+{
+    size_t  capacity;
+    char   *data;
+
+    if (writer->error != CMT_JSON_SUCCESS) {
+        return writer->error;
+    }
+
+    if (writer->capacity - writer->size >= length) {
+        return CMT_JSON_SUCCESS;
+    }
+
+    capacity = writer->capacity;
+    if (capacity < CMT_JSON_WRITER_MINIMUM_CAPACITY) {
+        capacity = CMT_JSON_WRITER_MINIMUM_CAPACITY;
+    }
+
+    while (capacity - writer->size < length) {
+        capacity *= 2;
+    }
+
+    data = realloc(writer->data, capacity);
+    if (data == NULL) {
+        cmt_errno();
+        writer->error = CMT_JSON_ALLOCATION_ERROR;
+
+        return writer->error;
+    }
+
+    writer->data = data;
+    writer->capacity = capacity;
+
+    return CMT_JSON_SUCCESS;
+}
+
+/* reserve room for a value plus its leading separator and write the latter */
+static inline int writer_begin_value(struct cmt_json_writer *writer,
+                                     size_t length)
+{
+    if (writer_reserve(writer, length + 1) != CMT_JSON_SUCCESS) {
+        return writer->error;
+    }
+
+    if (writer->separator) {
+        writer->data[writer->size++] = ',';
+    }
+    writer->separator = CMT_TRUE;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_writer_init(struct cmt_json_writer *writer,
+                         size_t initial_capacity)
+{
+    if (writer == NULL) {
+        return CMT_JSON_INVALID_ARGUMENT_ERROR;
+    }
+
+    memset(writer, 0, sizeof(struct cmt_json_writer));
+
+    if (initial_capacity > 0) {
+        return writer_reserve(writer, initial_capacity);
+    }
+
+    return CMT_JSON_SUCCESS;
+}
+
+void cmt_json_writer_destroy(struct cmt_json_writer *writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+
+    if (writer->data != NULL) {
+        free(writer->data);
+    }
+
+    memset(writer, 0, sizeof(struct cmt_json_writer));
+}
+
+cfl_sds_t cmt_json_writer_to_sds(struct cmt_json_writer *writer)
+{
+    cfl_sds_t result;
+
+    if (writer->error != CMT_JSON_SUCCESS) {
+        return NULL;
+    }
+
+    result = cfl_sds_create_size(writer->size + 1);
+    if (result == NULL) {
+        cmt_errno();
+        return NULL;
+    }
+
+    if (writer->size > 0) {
+        memcpy(result, writer->data, writer->size);
+    }
+    cfl_sds_set_len(result, writer->size);
+
+    return result;
+}
+
+void cmt_json_begin_object(struct cmt_json_writer *writer)
+{
+    if (writer_begin_value(writer, 1) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '{';
+    writer->separator = CMT_FALSE;
+}
+
+void cmt_json_end_object(struct cmt_json_writer *writer)
+{
+    if (writer_reserve(writer, 1) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '}';
+    writer->separator = CMT_TRUE;
+}
+
+void cmt_json_begin_array(struct cmt_json_writer *writer)
+{
+    if (writer_begin_value(writer, 1) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '[';
+    writer->separator = CMT_FALSE;
+}
+
+void cmt_json_end_array(struct cmt_json_writer *writer)
+{
+    if (writer_reserve(writer, 1) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = ']';
+    writer->separator = CMT_TRUE;
+}
+
+void cmt_json_write_key(struct cmt_json_writer *writer, const char *key)
+{
+    size_t length;
+
+    length = strlen(key);
+
+    if (writer_begin_value(writer, length + 3) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '"';
+    memcpy(&writer->data[writer->size], key, length);
+    writer->size += length;
+    writer->data[writer->size++] = '"';
+    writer->data[writer->size++] = ':';
+
+    /* the value that follows does not take a comma */
+    writer->separator = CMT_FALSE;
+}
+
+void cmt_json_write_string(struct cmt_json_writer *writer,
+                           const char *value, size_t length)
+{
+    size_t        run;
+    unsigned char byte;
+
+    if (writer_begin_value(writer, length + 2) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '"';
+
+    while (length > 0) {
+        run = scan_string(value, length);
+
+        /* room for the run, an escape sequence and the closing quote */
+        if (writer_reserve(writer, run + 7) != CMT_JSON_SUCCESS) {
+            return;
+        }
+
+        memcpy(&writer->data[writer->size], value, run);
+        writer->size += run;
+        value += run;
+        length -= run;
+
+        if (length == 0) {
+            break;
+        }
+
+        byte = (unsigned char) *value;
+        writer->data[writer->size++] = '\\';
+
+        switch (byte) {
+        case '"':
+        case '\\':
+            writer->data[writer->size++] = byte;
+            break;
+        case '\n':
+            writer->data[writer->size++] = 'n';
+            break;
+        case '\r':
+            writer->data[writer->size++] = 'r';
+            break;
+        case '\t':
+            writer->data[writer->size++] = 't';
+            break;
+        case '\b':
+            writer->data[writer->size++] = 'b';
+            break;
+        case '\f':
+            writer->data[writer->size++] = 'f';
+            break;
+        default:
+            writer->data[writer->size++] = 'u';
+            writer->data[writer->size++] = '0';
+            writer->data[writer->size++] = '0';
+            writer->data[writer->size++] = json_hex_digits[byte >> 4];
+            writer->data[writer->size++] = json_hex_digits[byte & 0x0F];
+            break;
+        }
+
+        value++;
+        length--;
+    }
+
+    if (writer_reserve(writer, 1) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    writer->data[writer->size++] = '"';
+}
+
+static void write_number(struct cmt_json_writer *writer,
+                         const char *number, size_t length, int quoted)
+{
+    if (writer_begin_value(writer, length + 2) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    if (quoted) {
+        writer->data[writer->size++] = '"';
+    }
+
+    memcpy(&writer->data[writer->size], number, length);
+    writer->size += length;
+
+    if (quoted) {
+        writer->data[writer->size++] = '"';
+    }
+}
+
+static size_t format_int64(char *output, int64_t value)
+{
+    if (value < 0) {
+        output[0] = '-';
+
+        /* negate as unsigned so INT64_MIN does not overflow */
+        return cmt_math_format_uint64(&output[1],
+                                      0 - (uint64_t) value) + 1;
+    }
+
+    return cmt_math_format_uint64(output, (uint64_t) value);
+}
+
+void cmt_json_write_uint64(struct cmt_json_writer *writer, uint64_t value)
+{
+    char number[CMT_MATH_FORMAT_SIZE];
+
+    write_number(writer, number, cmt_math_format_uint64(number, value),
+                 CMT_FALSE);
+}
+
+void cmt_json_write_int64(struct cmt_json_writer *writer, int64_t value)
+{
+    char number[CMT_MATH_FORMAT_SIZE + 1];
+
+    write_number(writer, number, format_int64(number, value), CMT_FALSE);
+}
+
+void cmt_json_write_uint64_string(struct cmt_json_writer *writer,
+                                  uint64_t value)
+{
+    char number[CMT_MATH_FORMAT_SIZE];
+
+    write_number(writer, number, cmt_math_format_uint64(number, value),
+                 CMT_TRUE);
+}
+
+void cmt_json_write_int64_string(struct cmt_json_writer *writer,
+                                 int64_t value)
+{
+    char number[CMT_MATH_FORMAT_SIZE + 1];
+
+    write_number(writer, number, format_int64(number, value), CMT_TRUE);
+}
+
+void cmt_json_write_double(struct cmt_json_writer *writer, double value)
+{
+    char number[CMT_MATH_FORMAT_SIZE];
+
+    if (isnan(value)) {
+        write_number(writer, "NaN", 3, CMT_TRUE);
+    }
+    else if (isinf(value)) {
+        if (value > 0) {
+            write_number(writer, "Infinity", 8, CMT_TRUE);
+        }
+        else {
+            write_number(writer, "-Infinity", 9, CMT_TRUE);
+        }
+    }
+    else {
+        write_number(writer, number, cmt_math_format_double(number, value),
+                     CMT_FALSE);
+    }
+}
+
+void cmt_json_write_bool(struct cmt_json_writer *writer, int value)
+{
+    if (value) {
+        write_number(writer, "true", 4, CMT_FALSE);
+    }
+    else {
+        write_number(writer, "false", 5, CMT_FALSE);
+    }
+}
+
+void cmt_json_write_base64(struct cmt_json_writer *writer,
+                           const void *data, size_t length)
+{
+    size_t               index;
+    uint32_t             block;
+    char                *output;
+    const unsigned char *input;
+
+    if (writer_begin_value(writer, ((length + 2) / 3) * 4 + 2) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    input = data;
+    output = &writer->data[writer->size];
+    *output++ = '"';
+
+    for (index = 0 ; index + 3 <= length ; index += 3) {
+        block = ((uint32_t) input[index] << 16) |
+                ((uint32_t) input[index + 1] << 8) |
+                input[index + 2];
+
+        *output++ = json_base64_digits[(block >> 18) & 0x3F];
+        *output++ = json_base64_digits[(block >> 12) & 0x3F];
+        *output++ = json_base64_digits[(block >> 6) & 0x3F];
+        *output++ = json_base64_digits[block & 0x3F];
+    }
+
+    if (index < length) {
+        block = (uint32_t) input[index] << 16;
+        if (index + 1 < length) {
+            block |= (uint32_t) input[index + 1] << 8;
+        }
+
+        *output++ = json_base64_digits[(block >> 18) & 0x3F];
+        *output++ = json_base64_digits[(block >> 12) & 0x3F];
+        *output++ = index + 1 < length ?
+                    json_base64_digits[(block >> 6) & 0x3F] : '=';
+        *output++ = '=';
+    }
+
+    *output++ = '"';
+    writer->size = output - writer->data;
+}
+
+void cmt_json_write_hex(struct cmt_json_writer *writer,
+                        const void *data, size_t length)
+{
+    size_t               index;
+    char                *output;
+    const unsigned char *input;
+
+    if (writer_begin_value(writer, length * 2 + 2) != CMT_JSON_SUCCESS) {
+        return;
+    }
+
+    input = data;
+    output = &writer->data[writer->size];
+    *output++ = '"';
+
+    for (index = 0 ; index < length ; index++) {
+        *output++ = json_hex_digits[input[index] >> 4];
+        *output++ = json_hex_digits[input[index] & 0x0F];
+    }
+
+    *output++ = '"';
+    writer->size = output - writer->data;
+}
+
+void cmt_json_reader_init(struct cmt_json_reader *reader,
+                          const void *data, size_t size)
+{
+    reader->data = data;
+    reader->size = size;
+    reader->offset = 0;
+    reader->first = CMT_FALSE;
+}
+
+static inline void skip_whitespace(struct cmt_json_reader *reader)
+{
+    char byte;
+
+    while (reader->offset < reader->size) {
+        byte = reader->data[reader->offset];
+
+        if (byte != ' ' && byte != '\n' && byte != '\r' && byte != '\t') {
+            break;
+        }
+
+        reader->offset++;
+    }
+}
+
+/* consume 'byte' after any whitespace */
+static inline int expect_byte(struct cmt_json_reader *reader, char byte)
+{
+    skip_whitespace(reader);
+
+    if (reader->offset >= reader->size ||
+        reader->data[reader->offset] != byte) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    reader->offset++;
+
+    return CMT_JSON_SUCCESS;
+}
+
+static inline int expect_literal(struct cmt_json_reader *reader,
+                                 const char *literal, size_t length)
+{
+    skip_whitespace(reader);
+
+    if (reader->size - reader->offset < length ||
+        memcmp(&reader->data[reader->offset], literal, length) != 0) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    reader->offset += length;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_peek(struct cmt_json_reader *reader)
+{
+    char byte;
+
+    skip_whitespace(reader);
+
+    if (reader->offset >= reader->size) {
+        return CMT_JSON_TYPE_INVALID;
+    }
+
+    byte = reader->data[reader->offset];
+
+    switch (byte) {
+    case '{':
+        return CMT_JSON_TYPE_OBJECT;
+    case '[':
+        return CMT_JSON_TYPE_ARRAY;
+    case '"':
+        return CMT_JSON_TYPE_STRING;
+    case 't':
+    case 'f':
+        return CMT_JSON_TYPE_BOOLEAN;
+    case 'n':
+        return CMT_JSON_TYPE_NULL;
+    default:
+        if (byte == '-' || (byte >= '0' && byte <= '9')) {
+            return CMT_JSON_TYPE_NUMBER;
+        }
+    }
+
+    return CMT_JSON_TYPE_INVALID;
+}
+
+int cmt_json_object_begin(struct cmt_json_reader *reader)
+{
+    if (expect_byte(reader, '{') != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    reader->first = CMT_TRUE;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_array_begin(struct cmt_json_reader *reader)
+{
+    if (expect_byte(reader, '[') != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    reader->first = CMT_TRUE;
+
+    return CMT_JSON_SUCCESS;
+}
+
+/*
+ * Shared by the object and array iterators: consumes either the closing
+ * bracket or the separator that precedes the next entry.
+ */
+static int container_next(struct cmt_json_reader *reader, char closing,
+                          int *more)
+{
+    int first;
+
+    skip_whitespace(reader);
+
+    if (reader->offset >= reader->size) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    first = reader->first;
+    reader->first = CMT_FALSE;
+
+    if (reader->data[reader->offset] == closing) {
+        reader->offset++;
+        *more = CMT_FALSE;
+
+        return CMT_JSON_SUCCESS;
+    }
+
+    if (!first && expect_byte(reader, ',') != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    *more = CMT_TRUE;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_object_next(struct cmt_json_reader *reader, int *more,
+                         const char **key, size_t *length)
+{
+    int result;
+    int escaped;
+
+    result = container_next(reader, '}', more);
+    if (result != CMT_JSON_SUCCESS || !*more) {
+        return result;
+    }
+
+    result = cmt_json_read_string(reader, key, length, &escaped);
+    if (result != CMT_JSON_SUCCESS) {
+        return result;
+    }
+
+    /* keys are compared verbatim, escaped keys cannot match a known field */
+    if (escaped) {
+        *length = 0;
+    }
+
+    return expect_byte(reader, ':');
+}
+
+int cmt_json_array_next(struct cmt_json_reader *reader, int *more)
+{
+    return container_next(reader, ']', more);
+}
+
+int cmt_json_read_string(struct cmt_json_reader *reader,
+                         const char **data, size_t *length, int *escaped)
+{
+    size_t start;
+    size_t offset;
+    char   byte;
+
+    if (expect_byte(reader, '"') != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    start = reader->offset;
+    offset = start;
+    *escaped = CMT_FALSE;
+
+    while (1) {
+        offset += scan_string(&reader->data[offset], reader->size - offset);
+
+        if (offset >= reader->size) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+
+        byte = reader->data[offset];
+
+        if (byte == '"') {
+            break;
+        }
+        else if (byte == '\\') {
+            /* the escape sequence itself is validated by cmt_json_unescape() */
+            if (offset + 1 >= reader->size) {
+                return CMT_JSON_CORRUPTED_INPUT_ERROR;
+            }
+
+            *escaped = CMT_TRUE;
+            offset += 2;
+        }
+        else {
+            /* unescaped control character */
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+    }
+
+    *data = &reader->data[start];
+    *length = offset - start;
+    reader->offset = offset + 1;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_read_number(struct cmt_json_reader *reader,
+                         const char **data, size_t *length)
+{
+    size_t      start;
+    size_t      offset;
+    size_t      digits;
+    const char *input;
+
+    skip_whitespace(reader);
+
+    input = reader->data;
+    start = reader->offset;
+    offset = start;
+
+    if (offset < reader->size && input[offset] == '-') {
+        offset++;
+    }
+
+    /* integer part, without leading zeros */
+    digits = offset;
+    while (offset < reader->size && input[offset] >= '0' && input[offset] <= '9') {
+        offset++;
+    }
+
+    if (offset == digits ||
+        (offset - digits > 1 && input[digits] == '0')) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    if (offset < reader->size && input[offset] == '.') {
+        offset++;
+
+        digits = offset;
+        while (offset < reader->size && input[offset] >= '0' && input[offset] <= '9') {
+            offset++;
+        }
+
+        if (offset == digits) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+    }
+
+    if (offset < reader->size && (input[offset] == 'e' || input[offset] == 'E')) {
+        offset++;
+
+        if (offset < reader->size && (input[offset] == '+' || input[offset] == '-')) {
+            offset++;
+        }
+
+        digits = offset;
+        while (offset < reader->size && input[offset] >= '0' && input[offset] <= '9') {
+            offset++;
+        }
+
+        if (offset == digits) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+    }
+
+    *data = &input[start];
+    *length = offset - start;
+    reader->offset = offset;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_read_bool(struct cmt_json_reader *reader, int *value)
+{
+    if (expect_literal(reader, "true", 4) == CMT_JSON_SUCCESS) {
+        *value = CMT_TRUE;
+        return CMT_JSON_SUCCESS;
+    }
+
+    if (expect_literal(reader, "false", 5) == CMT_JSON_SUCCESS) {
+        *value = CMT_FALSE;
+        return CMT_JSON_SUCCESS;
+    }
+
+    return CMT_JSON_CORRUPTED_INPUT_ERROR;
+}
+
+int cmt_json_read_null(struct cmt_json_reader *reader)
+{
+    return expect_literal(reader, "null", 4);
+}
+
+/* the text of a number, quoted or not */
+static int read_numeric_text(struct cmt_json_reader *reader,
+                             const char **data, size_t *length)
+{
+    int escaped;
+    int result;
+
+    if (cmt_json_peek(reader) == CMT_JSON_TYPE_STRING) {
+        result = cmt_json_read_string(reader, data, length, &escaped);
+
+        if (result == CMT_JSON_SUCCESS && escaped) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+
+        return result;
+    }
+
+    return cmt_json_read_number(reader, data, length);
+}
+
+/* integers written in exponent or fraction form, e.g. 1e3 or 10.0 */
+static int parse_integral_double(const char *data, size_t length,
+                                 double minimum, double maximum,
+                                 double *value)
+{
+    if (cmt_math_parse_double(data, length, value) != 0 ||
+        *value != floor(*value) ||
+        *value < minimum || *value >= maximum) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_read_uint64(struct cmt_json_reader *reader, uint64_t *value)
+{
+    int         result;
+    size_t      length;
+    double      number;
+    const char *data;
+
+    result = read_numeric_text(reader, &data, &length);
+    if (result != CMT_JSON_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_math_parse_uint64(data, length, value) == 0) {
+        return CMT_JSON_SUCCESS;
+    }
+
+    if (parse_integral_double(data, length, 0, 18446744073709551616.0,
+                              &number) != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    *value = (uint64_t) number;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_read_int64(struct cmt_json_reader *reader, int64_t *value)
+{
+    int         result;
+    size_t      length;
+    double      number;
+    const char *data;
+
+    result = read_numeric_text(reader, &data, &length);
+    if (result != CMT_JSON_SUCCESS) {
+        return result;
+    }
+
+    if (cmt_math_parse_int64(data, length, value) == 0) {
+        return CMT_JSON_SUCCESS;
+    }
+
+    if (parse_integral_double(data, length,
+                              -9223372036854775808.0, 9223372036854775808.0,
+                              &number) != CMT_JSON_SUCCESS) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    *value = (int64_t) number;
+
+    return CMT_JSON_SUCCESS;
+}
+
+int cmt_json_read_double(struct cmt_json_reader *reader, double *value)
+{
+    int         result;
+    size_t      length;
+    const char *data;
+
+    result = read_numeric_text(reader, &data, &length);
+    if (result != CMT_JSON_SUCCESS) {
+        return result;
+    }
+
+    if (length == 3 && memcmp(data, "NaN", 3) == 0) {
+        *value = NAN;
+    }
+    else if (length == 8 && memcmp(data, "Infinity", 8) == 0) {
+        *value = INFINITY;
+    }
+    else if (length == 9 && memcmp(data, "-Infinity", 9) == 0) {
+        *value = -INFINITY;
+    }
+    else if (cmt_math_parse_double(data, length, value) != 0) {
+        return CMT_JSON_CORRUPTED_INPUT_ERROR;
+    }
+
+    return CMT_JSON_SUCCESS;
+}
+
+/*
+ * Containers are skipped by jumping from one quote or bracket to the next,
+ * only the bracket pairing and the strings are checked on the way.
+ */
+static int skip_container(struct cmt_json_reader *reader)
+{
+    int         depth;
+    int         escaped;
+    char        byte;
+    size_t      length;
+    uint64_t    arrays;
+    const char *data;
+
+    depth = 0;
+    arrays = 0;
+
+    while (1) {
+        reader->offset += scan_structural(&reader->data[reader->offset],
+                                          reader->size - reader->offset);
+
+        if (reader->offset >= reader->size) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+
+        byte = reader->data[reader->offset];
+
+        if (byte == '"') {
+            if (cmt_json_read_string(reader, &data, &length,
+                                     &escaped) != CMT_JSON_SUCCESS) {
+                return CMT_JSON_CORRUPTED_INPUT_ERROR;
+            }
+
+            continue;
+        }
+
+        reader->offset++;
+
+        if (byte == '{' || byte == '[') {
+            if (depth >= CMT_JSON_MAXIMUM_DEPTH) {
+                return CMT_JSON_CORRUPTED_INPUT_ERROR;
+            }
+
+            /* one bit per level tells arrays from objects */
+            arrays = (arrays << 1) | (byte == '[');
+            depth++;
+
+            continue;
+        }
+
+        if (depth == 0 || (byte == ']') != (int) (arrays & 1)) {
+            return CMT_JSON_CORRUPTED_INPUT_ERROR;
+        }
+
+        arrays >>= 1;
+        depth--;
+
+        if (depth == 0) {
+            return CMT_JSON_SUCCESS;
+        }
+    }
+}
+
+int cmt_json_skip_value(struct cmt_json_reader *reader)
+{
+    int         escaped;
+    int         value;
+    size_t      length;
+    const char *data;
+
+    switch (cmt_json_peek(reader)) {
+    case CMT_JSON_TYPE_OBJECT:
+    case CMT_JSON_TYPE_ARRAY:
+        return skip_container(reader);
+    case CMT_JSON_TYPE_STRING:
+        return cmt_json_read_string(reader, &data, &length, &escaped);
+    case CMT_JSON_TYPE_NUMBER:
+        return cmt_json_read_number(reader, &data, &length);
+    case CMT_JSON_TYPE_BOOLEAN:
+        return cmt_json_read_bool(reader, &value);
+    case CMT_JSON_TYPE_NULL:
+        return cmt_json_read_null(reader);
+    }
+
+    return CMT_JSON_CORRUPTED_INPUT_ERROR;
+}
+
+static int parse_hex4(const char *data, unsigned int *value)
+{
+    int  index;
+    char byte;
+
+    *value = 0;
+
+    for (index = 0 ; index < 4 ; index++) {
+        byte = data[index];
+        *value <<= 4;
+
+        if (byte >= '0' && byte <= '9') {
+            *value |= byte - '0';
+        }
+        else if (byte >= 'a' && byte <= 'f') {
+            *value |= byte - 'a' + 10;
+        }
+        else if (byte >= 'A' && byte <= 'F') {
+            *value |= byte - 'A' + 10;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static size_t put_utf8(char *output, unsigned int code_point)
+{
+    if (code_point < 0x80) {
+        output[0] = (char) code_point;
+        return 1;
+    }
+    else if (code_point < 0x800) {
+        output[0] = (char) (0xC0 | (code_point >> 6));
+        output[1] = (char) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    else if (code_point < 0x10000) {
+        output[0] = (char) (0xE0 | (code_point >> 12));
+        output[1] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        output[2] = (char) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+
+    output[0] = (char) (0xF0 | (code_point >> 18));
+    output[1] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+    output[2] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+    output[3] = (char) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+int cmt_json_unescape(const char *data, size_t length, char *output)
+{
+    size_t       index;
+    size_t       written;
+    unsigned int code_point;
+    unsigned int low;
+
+    index = 0;
+    written = 0;
+
+    while (index < length) {
+        if (data[index] != '\\') {
+            output[written++] = data[index++];
+            continue;
+        }
+
+        if (index + 1 >= length) {
+            return -1;
+        }
+
+        index += 2;
+
+        switch (data[index - 1]) {
+        case '"':
+        case '\\':
+        case '/':
+            output[written++] = data[index - 1];
+            break;
+        case 'b':
+            output[written++] = '\b';
+            break;
+        case 'f':
+            output[written++] = '\f';
+            break;
+        case 'n':
+            output[written++] = '\n';
+            break;
+        case 'r':
+            output[written++] = '\r';
+            break;
+        case 't':
+            output[written++] = '\t';
+            break;
+        case 'u':
+            if (length - index < 4 || parse_hex4(&data[index], &code_point) != 0) {
+                return -1;
+            }
+            index += 4;
+
+            /* a high surrogate must be followed by its low pair */
+            if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+                if (length - index < 6 ||
+                    data[index] != '\\' || data[index + 1] != 'u' ||
+                    parse_hex4(&data[index + 2], &low) != 0 ||
+                    low < 0xDC00 || low > 0xDFFF) {
+                    return -1;
+                }
+                index += 6;
+
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                             (low - 0xDC00);
+            }
+            else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                return -1;
+            }
+
+            /* the UTF-8 form is never longer than the escape sequence */
+            written += put_utf8(&output[written], code_point);
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return (int) written;
+}
+
+static int base64_value(char digit)
+{
+    if (digit >= 'A' && digit <= 'Z') {
+        return digit - 'A';
+    }
+    else if (digit >= 'a' && digit <= 'z') {
+        return digit - 'a' + 26;
+    }
+    else if (digit >= '0' && digit <= '9') {
+        return digit - '0' + 52;
+    }
+    else if (digit == '+' || digit == '-') {
+        return 62;
+    }
+    else if (digit == '/' || digit == '_') {
+        return 63;
+    }
+
+    return -1;
+}
+
+int cmt_json_base64_decode(const char *data, size_t length,
+                           unsigned char *output)
+{
+    int      value;
+    int      bits;
+    size_t   index;
+    size_t   written;
+    uint32_t block;
+
+    /* padding is optional, the URL safe alphabet is accepted as well */
+    while (length > 0 && data[length - 1] == '=') {
+        length--;
+    }
+
+    if (length % 4 == 1) {
+        return -1;
+    }
+
+    bits = 0;
+    block = 0;
+    written = 0;
+
+    for (index = 0 ; index < length ; index++) {
+        value = base64_value(data[index]);
+        if (value < 0) {
+            return -1;
+        }
+
+        block = (block << 6) | value;
+        bits += 6;
+
+        if (bits >= 8) {
+            bits -= 8;
+            output[written++] = (unsigned char) (block >> bits);
+        }
+    }
+
+    return (int) written;
+}
+
+int cmt_json_hex_decode(const char *data, size_t length,
+                        unsigned char *output)
+{
+    size_t       index;
+    unsigned int value;
+    char         digits[4];
+
+    if (length % 2 != 0) {
+        return -1;
+    }
+
+    digits[0] = '0';
+    digits[1] = '0';
+
+    for (index = 0 ; index < length ; index += 2) {
+        digits[2] = data[index];
+        digits[3] = data[index + 1];
+
+        if (parse_hex4(digits, &value) != 0) {
+            return -1;
+        }
+
+        output[index / 2] = (unsigned char) value;
+    }
+
+    return (int) (length / 2);
+}
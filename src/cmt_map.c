@@ -24,6 +24,7 @@
 #include <cmetrics/cmt_atomic.h>
 #include <cmetrics/cmt_histogram.h>
 #include <cmetrics/cmt_summary.h>
+#include <cmetrics/cmt_hll.h>
 #include <cmetrics/cmt_compat.h>
 
 #define CMT_MAP_INITIAL_BUCKET_COUNT 64
@@ -46,11 +47,37 @@ static void metric_release_storage(struct cmt_metric *metric)
     free(metric->exp_hist_positive_buckets);
     free(metric->exp_hist_negative_buckets);
     free(metric->sum_quantiles);
+    cmt_hll_destroy(metric->hll);
 
     metric->hist_buckets = NULL;
     metric->exp_hist_positive_buckets = NULL;
     metric->exp_hist_negative_buckets = NULL;
     metric->sum_quantiles = NULL;
+    metric->hll = NULL;
+}
+
+/* Unlink a series from the metric list, keeping the indexed tail valid */
+static void metric_list_del(struct cmt_map *map, struct cmt_metric *metric)
+{
+    if (map != NULL && map->indexed_tail == &metric->_head) {
+        map->indexed_tail = metric->_head.prev;
+    }
+
+    cfl_list_del(&metric->_head);
+}
+
+/* Append a series, once indexed it extends the indexed tail it follows */
+static void metric_list_add(struct cmt_map *map, struct cmt_metric *metric)
+{
+    if (map->indexed_tail == NULL && cfl_list_is_empty(&map->metrics)) {
+        map->indexed_tail = &map->metrics;
+    }
+
+    if (metric->hash_indexed && map->indexed_tail == map->metrics.prev) {
+        map->indexed_tail = &metric->_head;
+    }
+
+    cfl_list_add(&metric->_head, &map->metrics);
 }
 
 static int metric_index_resize(struct cmt_map *map, size_t bucket_count)
@@ -261,8 +288,11 @@ static struct cmt_metric *metric_hash_lookup(struct cmt_map *map, uint64_t hash,
     }
 
     /* Decoders can populate the public metric list directly. Search only
-     * entries that have not yet been indexed, then index a successful match. */
-    cfl_list_foreach(head, &map->metrics) {
+     * entries that have not yet been indexed, then index a successful match.
+     * Those are appended, so entries up to the indexed tail are skipped. */
+    head = map->indexed_tail != NULL ? map->indexed_tail->next :
+                                       map->metrics.next;
+    for (; head != &map->metrics; head = head->next) {
         metric = cfl_list_entry(head, struct cmt_metric, _head);
         if (!metric->hash_indexed && metric->hash == hash &&
             metric_labels_match(metric, labels_count, labels_val)) {
@@ -341,6 +371,8 @@ static void map_metric_destroy_unlocked(struct cmt_metric *metric)
 
     metric_release_storage(metric);
 
+    metric_list_del(map, metric);
+
     if (map != NULL && map->last_metric == metric) {
         map->last_metric = NULL;
     }
@@ -354,7 +386,6 @@ static void map_metric_destroy_unlocked(struct cmt_metric *metric)
         cfl_list_del(&metric->_hash_head);
     }
 
-    cfl_list_del(&metric->_head);
     free(metric);
 }
 
@@ -374,17 +405,37 @@ void cmt_map_metric_destroy(struct cmt_metric *metric)
     }
 }
 
+static uint64_t metric_hash(struct cmt_opts *opts,
+                            int labels_count, char **labels_val)
+{
+    int i;
+    size_t len;
+    char *ptr;
+    cfl_hash_state_t state;
+
+    cfl_hash_64bits_reset(&state);
+    cfl_hash_64bits_update(&state, opts->fqname, cfl_sds_len(opts->fqname));
+    for (i = 0; i < labels_count; i++) {
+        ptr = labels_val[i];
+        if (!ptr) {
+            cfl_hash_64bits_update(&state, "_NULL_", 6);
+        }
+        else {
+            len = strlen(ptr);
+            cfl_hash_64bits_update(&state, ptr, len);
+        }
+    }
+
+    return cfl_hash_64bits_digest(&state);
+}
+
 static struct cmt_metric *map_metric_get_unlocked(struct cmt_opts *opts,
                                                   struct cmt_map *map,
                                                   int labels_count,
                                                   char **labels_val,
                                                   int write_op)
 {
-    int i;
-    size_t len;
-    char *ptr;
     uint64_t hash;
-    cfl_hash_state_t state;
     struct cmt_metric *metric = NULL;
 
     /* Enforce zero or exact labels */
@@ -416,20 +467,7 @@ static struct cmt_metric *map_metric_get_unlocked(struct cmt_opts *opts,
     }
 
     /* Lookup the metric */
-    cfl_hash_64bits_reset(&state);
-    cfl_hash_64bits_update(&state, opts->fqname, cfl_sds_len(opts->fqname));
-    for (i = 0; i < labels_count; i++) {
-        ptr = labels_val[i];
-        if (!ptr) {
-            cfl_hash_64bits_update(&state, "_NULL_", 6);
-        }
-        else {
-            len = strlen(ptr);
-            cfl_hash_64bits_update(&state, ptr, len);
-        }
-    }
-
-    hash = cfl_hash_64bits_digest(&state);
+    hash = metric_hash(opts, labels_count, labels_val);
     metric = metric_hash_lookup(map, hash, labels_count, labels_val);
 
     if (metric) {
@@ -449,8 +487,8 @@ static struct cmt_metric *map_metric_get_unlocked(struct cmt_opts *opts,
     if (!metric) {
         return NULL;
     }
-    cfl_list_add(&metric->_head, &map->metrics);
     metric_index_add(map, metric);
+    metric_list_add(map, metric);
     map->last_metric = metric;
     return metric_prepare_storage(map, metric, write_op);
 }
@@ -469,6 +507,127 @@ struct cmt_metric *cmt_map_metric_get(struct cmt_opts *opts, struct cmt_map *map
     return metric;
 }
 
+void cmt_map_reindex(struct cmt_map *map)
+{
+    size_t count;
+    size_t bucket_count;
+    cfl_hash_state_t state;
+    struct cfl_list *head;
+    struct cfl_list *label_head;
+    struct cmt_metric *metric;
+    struct cmt_map_label *label;
+
+    map_lock(map);
+
+    count = 0;
+    cfl_list_foreach(head, &map->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+
+        /* same digest as metric_hash(), straight from the label list */
+        cfl_hash_64bits_reset(&state);
+        cfl_hash_64bits_update(&state, map->opts->fqname,
+                               cfl_sds_len(map->opts->fqname));
+        cfl_list_foreach(label_head, &metric->labels) {
+            label = cfl_list_entry(label_head, struct cmt_map_label, _head);
+            if (!label->name) {
+                cfl_hash_64bits_update(&state, "_NULL_", 6);
+            }
+            else {
+                cfl_hash_64bits_update(&state, label->name,
+                                       cfl_sds_len(label->name));
+            }
+        }
+
+        metric->hash = cfl_hash_64bits_digest(&state);
+        metric->hash_indexed = CMT_FALSE;
+        metric->map = map;
+        count++;
+    }
+
+    free(map->metric_buckets);
+    map->metric_buckets = NULL;
+    map->metric_bucket_count = 0;
+    map->indexed_metric_count = 0;
+    map->last_metric = NULL;
+
+    bucket_count = CMT_MAP_INITIAL_BUCKET_COUNT;
+    while (bucket_count * CMT_MAP_BUCKET_LOAD_FACTOR < count) {
+        bucket_count *= 2;
+    }
+
+    map->indexed_tail = NULL;
+
+    if (count == 0) {
+        map->indexed_tail = &map->metrics;
+    }
+    else if (metric_index_resize(map, bucket_count) == 0) {
+        map->indexed_tail = &map->metrics;
+
+        cfl_list_foreach(head, &map->metrics) {
+            metric = cfl_list_entry(head, struct cmt_metric, _head);
+            metric_index_add(map, metric);
+
+            if (metric->hash_indexed && map->indexed_tail == head->prev) {
+                map->indexed_tail = head;
+            }
+        }
+    }
+
+    map_unlock(map);
+}
+
+struct cmt_metric *cmt_map_metric_move(struct cmt_opts *opts, struct cmt_map *map,
+                                       int labels_count, char **labels_val,
+                                       struct cmt_metric *metric)
+{
+    uint64_t hash;
+    struct cmt_map *source;
+    struct cmt_metric *found;
+
+    map_lock(map);
+
+    if (labels_count == 0 || labels_count != map->label_count) {
+        found = map_metric_get_unlocked(opts, map, labels_count, labels_val,
+                                        CMT_TRUE);
+        map_unlock(map);
+
+        return found;
+    }
+
+    hash = metric_hash(opts, labels_count, labels_val);
+    found = metric_hash_lookup(map, hash, labels_count, labels_val);
+    if (found) {
+        map_unlock(map);
+
+        return metric_prepare_storage(map, found, CMT_TRUE);
+    }
+
+    /* unlink the series from the map it was decoded into */
+    source = metric->map;
+    if (source != NULL && source->last_metric == metric) {
+        source->last_metric = NULL;
+    }
+
+    if (metric->hash_indexed) {
+        if (source != NULL && source->indexed_metric_count > 0) {
+            source->indexed_metric_count--;
+        }
+        cfl_list_del(&metric->_hash_head);
+        metric->hash_indexed = CMT_FALSE;
+    }
+    metric_list_del(source, metric);
+
+    metric->hash = hash;
+    metric->map = map;
+    metric_index_add(map, metric);
+    metric_list_add(map, metric);
+    map->last_metric = metric;
+
+    map_unlock(map);
+
+    return metric;
+}
+
 int cmt_map_metric_get_val(struct cmt_opts *opts, struct cmt_map *map,
                            int labels_count, char **labels_val,
                            double *out_val)
@@ -0,0 +1,272 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2024 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_math.h>
+
+/* numbers up to this length are copied to the stack for strtod() */
+#define CMT_MATH_NUMBER_BUFFER_SIZE 64
+
+/*
+ * Clinger's fast path: a decimal with at most 19 significant digits whose
+ * mantissa fits in 53 bits and a power of ten exponent within [-22, 22] is
+ * exactly one correctly rounded multiplication or division away. Returns -1
+ * for everything else so the caller falls back to strtod().
+ */
+static int parse_double_fast(const char *in, const char *end, double *out)
+{
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+#if FLT_EVAL_METHOD == 0
+    int negative;
+    int digits;
+    int exponent;
+    int exponent_value;
+    int exponent_negative;
+    uint64_t mantissa;
+    double val;
+
+    negative = 0;
+    if (in < end && (*in == '-' || *in == '+')) {
+        negative = *in == '-';
+        in++;
+    }
+
+    digits = 0;
+    exponent = 0;
+    mantissa = 0;
+    for (; in < end && *in >= '0' && *in <= '9'; in++, digits++) {
+        mantissa = mantissa * 10 + (*in - '0');
+    }
+    if (in < end && *in == '.') {
+        for (in++; in < end && *in >= '0' && *in <= '9';
+             in++, digits++, exponent--) {
+            mantissa = mantissa * 10 + (*in - '0');
+        }
+    }
+    if (digits == 0 || digits > 19) {
+        return -1;
+    }
+
+    if (in < end && (*in == 'e' || *in == 'E')) {
+        in++;
+        exponent_negative = 0;
+        if (in < end && (*in == '-' || *in == '+')) {
+            exponent_negative = *in == '-';
+            in++;
+        }
+        if (in == end || *in < '0' || *in > '9') {
+            return -1;
+        }
+        for (exponent_value = 0; in < end && *in >= '0' && *in <= '9'; in++) {
+            if (exponent_value > 100) {
+                return -1;
+            }
+            exponent_value = exponent_value * 10 + (*in - '0');
+        }
+        exponent += exponent_negative ? -exponent_value : exponent_value;
+    }
+
+    if (in != end || mantissa > (UINT64_C(1) << 53) ||
+        exponent < -22 || exponent > 22) {
+        return -1;
+    }
+
+    val = (double) mantissa;
+    if (exponent < 0) {
+        val /= powers[-exponent];
+    }
+    else {
+        val *= powers[exponent];
+    }
+    *out = negative ? -val : val;
+
+    return 0;
+#else
+    /* extended precision intermediates would double round */
+    (void) in;
+    (void) end;
+    (void) out;
+    (void) powers;
+    return -1;
+#endif
+}
+
+int cmt_math_parse_double(const char *in, size_t length, double *out)
+{
+    int result;
+    char *end;
+    char *copy;
+    char buffer[CMT_MATH_NUMBER_BUFFER_SIZE];
+    double val;
+
+    if (parse_double_fast(in, in + length, out) == 0) {
+        return 0;
+    }
+
+    if (length == 0) {
+        return -1;
+    }
+
+    /* strtod() needs a NUL terminated copy */
+    if (length < sizeof(buffer)) {
+        copy = buffer;
+    }
+    else {
+        copy = malloc(length + 1);
+        if (copy == NULL) {
+            cmt_errno();
+            return -1;
+        }
+    }
+    memcpy(copy, in, length);
+    copy[length] = '\0';
+
+    result = 0;
+    errno = 0;
+    val = strtod(copy, &end);
+    if (end != copy + length || errno) {
+        result = -1;
+    }
+    else {
+        *out = val;
+    }
+
+    if (copy != buffer) {
+        free(copy);
+    }
+
+    return result;
+}
+
+int cmt_math_parse_uint64(const char *in, size_t length, uint64_t *out)
+{
+    size_t index;
+    uint64_t digit;
+    uint64_t val;
+
+    if (length == 0) {
+        return -1;
+    }
+
+    val = 0;
+    for (index = 0; index < length; index++) {
+        if (in[index] < '0' || in[index] > '9') {
+            return -1;
+        }
+
+        digit = in[index] - '0';
+        if (val > (UINT64_MAX - digit) / 10) {
+            return -1;
+        }
+        val = val * 10 + digit;
+    }
+
+    *out = val;
+
+    return 0;
+}
+
+int cmt_math_parse_int64(const char *in, size_t length, int64_t *out)
+{
+    int negative;
+    uint64_t val;
+
+    negative = 0;
+    if (length > 0 && (*in == '-' || *in == '+')) {
+        negative = *in == '-';
+        in++;
+        length--;
+    }
+
+    if (cmt_math_parse_uint64(in, length, &val) != 0) {
+        return -1;
+    }
+
+    if (negative) {
+        if (val > (uint64_t) INT64_MAX + 1) {
+            return -1;
+        }
+        *out = val == (uint64_t) INT64_MAX + 1 ? INT64_MIN : -(int64_t) val;
+    }
+    else {
+        if (val > INT64_MAX) {
+            return -1;
+        }
+        *out = (int64_t) val;
+    }
+
+    return 0;
+}
+
+size_t cmt_math_format_uint64(char *out, uint64_t val)
+{
+    size_t length;
+    size_t index;
+    char digits[20];
+
+    length = 0;
+    do {
+        digits[length++] = '0' + (val % 10);
+        val /= 10;
+    } while (val > 0);
+
+    for (index = 0; index < length; index++) {
+        out[index] = digits[length - index - 1];
+    }
+    out[length] = '\0';
+
+    return length;
+}
+
+size_t cmt_math_format_double(char *out, double val)
+{
+    int length;
+
+    /*
+     * Integers below 2^53 are exact and have at most 16 digits, so "%.17g"
+     * prints them without a fraction or an exponent. Negative zero and
+     * non-finite values take the snprintf() path.
+     */
+    if (val > -9007199254740992.0 && val < 9007199254740992.0 &&
+        val == (double) (int64_t) val && !(val == 0 && signbit(val))) {
+        if (val < 0) {
+            out[0] = '-';
+            return cmt_math_format_uint64(&out[1], (uint64_t) -(int64_t) val) + 1;
+        }
+
+        return cmt_math_format_uint64(out, (uint64_t) val);
+    }
+
+    length = snprintf(out, CMT_MATH_FORMAT_SIZE, "%.17g", val);
+    if (length < 0) {
+        out[0] = '\0';
+        return 0;
+    }
+
+    return length;
+}
@@ -243,6 +243,75 @@ int cmt_mpack_unpack_map(mpack_reader_t *reader,
     return result;
 }
 
+/* Unpack a map keyed by integer tags, the handler of tag N is callback_list[N] */
+int cmt_mpack_unpack_tagged_map(mpack_reader_t *reader,
+                                cmt_mpack_unpacker_entry_callback_fn_t *callback_list,
+                                size_t callback_count,
+                                void *context)
+{
+    uint32_t    entry_index;
+    uint32_t    entry_count;
+    uint64_t    seen_keys;
+    uint64_t    key;
+    int         result;
+    mpack_tag_t tag;
+
+    if (64 < callback_count) {
+        return CMT_MPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_MPACK_ENGINE_ERROR;
+    }
+
+    if (mpack_type_map != mpack_tag_type(&tag)) {
+        return CMT_MPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    entry_count = mpack_tag_map_count(&tag);
+
+    /* Every tag is expected at most once */
+    if (callback_count < entry_count) {
+        return CMT_MPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    result = CMT_MPACK_SUCCESS;
+    seen_keys = 0;
+
+    for (entry_index = 0 ;
+         CMT_MPACK_SUCCESS == result && entry_index < entry_count ;
+         entry_index++) {
+        result = cmt_mpack_consume_uint_tag(reader, &key);
+
+        if (CMT_MPACK_SUCCESS == result) {
+            if (key >= callback_count || NULL == callback_list[key]) {
+                result = CMT_MPACK_UNEXPECTED_KEY_ERROR;
+            }
+            else if (seen_keys & ((uint64_t) 1 << key)) {
+                result = CMT_MPACK_CORRUPT_INPUT_DATA_ERROR;
+            }
+            else {
+                seen_keys |= (uint64_t) 1 << key;
+
+                result = callback_list[key](reader, entry_index, context);
+            }
+        }
+    }
+
+    if (CMT_MPACK_SUCCESS == result) {
+        mpack_done_map(reader);
+
+        if (mpack_ok != mpack_reader_error(reader))
+        {
+            return CMT_MPACK_PENDING_MAP_ENTRIES;
+        }
+    }
+
+    return result;
+}
+
 int cmt_mpack_unpack_array(mpack_reader_t *reader,
                            cmt_mpack_unpacker_entry_callback_fn_t entry_processor_callback,
                            void *context)
@@ -319,3 +388,164 @@ int cmt_mpack_peek_array_length(mpack_reader_t *reader)
 
     return mpack_tag_array_count(&tag);
 }
+
+static uint64_t read_big_endian(const unsigned char *data, size_t size)
+{
+    size_t   index;
+    uint64_t value;
+
+    value = 0;
+
+    for (index = 0 ; index < size ; index++) {
+        value = (value << 8) | data[index];
+    }
+
+    return value;
+}
+
+/*
+ * Find the size of the object at the start of a buffer without decoding it,
+ * strings, binaries and extensions are jumped over and nested maps and arrays
+ * only add to the number of pending objects.
+ */
+int cmt_mpack_skip_object(const char *buffer, size_t size, size_t *object_size)
+{
+    uint8_t              type;
+    size_t               position;
+    size_t               header_size;
+    uint64_t             length;
+    uint64_t             pending;
+    const unsigned char *data;
+
+    if (NULL == buffer || NULL == object_size) {
+        return CMT_MPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    data = (const unsigned char *) buffer;
+    position = 0;
+    pending = 1;
+
+    while (pending > 0) {
+        if (position >= size) {
+            return CMT_MPACK_INSUFFICIENT_DATA;
+        }
+
+        type = data[position++];
+        pending--;
+
+        /* positive and negative fixint, nil, false and true */
+        if (type <= 0x7f || type >= 0xe0 ||
+            type == 0xc0 || type == 0xc2 || type == 0xc3) {
+            continue;
+        }
+
+        if (type <= 0x8f) {
+            pending += (uint64_t) (type & 0x0f) * 2;
+            continue;
+        }
+
+        if (type <= 0x9f) {
+            pending += type & 0x0f;
+            continue;
+        }
+
+        if (type <= 0xbf) {
+            length = type & 0x1f;
+            header_size = 0;
+        }
+        else {
+            switch (type) {
+            case 0xc4: /* bin 8 */
+            case 0xd9: /* str 8 */
+                header_size = 1;
+                break;
+            case 0xc5: /* bin 16 */
+            case 0xda: /* str 16 */
+            case 0xdc: /* array 16 */
+            case 0xde: /* map 16 */
+                header_size = 2;
+                break;
+            case 0xc6: /* bin 32 */
+            case 0xdb: /* str 32 */
+            case 0xdd: /* array 32 */
+            case 0xdf: /* map 32 */
+                header_size = 4;
+                break;
+            case 0xc7: /* ext 8, the type byte follows the length */
+                header_size = 1;
+                break;
+            case 0xc8: /* ext 16 */
+                header_size = 2;
+                break;
+            case 0xc9: /* ext 32 */
+                header_size = 4;
+                break;
+            case 0xcc: /* uint 8 */
+            case 0xd0: /* int 8 */
+                header_size = 0;
+                length = 1;
+                break;
+            case 0xcd: /* uint 16 */
+            case 0xd1: /* int 16 */
+                header_size = 0;
+                length = 2;
+                break;
+            case 0xca: /* float 32 */
+            case 0xce: /* uint 32 */
+            case 0xd2: /* int 32 */
+                header_size = 0;
+                length = 4;
+                break;
+            case 0xcb: /* float 64 */
+            case 0xcf: /* uint 64 */
+            case 0xd3: /* int 64 */
+                header_size = 0;
+                length = 8;
+                break;
+            case 0xd4: /* fixext 1 */
+            case 0xd5: /* fixext 2 */
+            case 0xd6: /* fixext 4 */
+            case 0xd7: /* fixext 8 */
+            case 0xd8: /* fixext 16 */
+                header_size = 0;
+                length = 1 + ((size_t) 1 << (type - 0xd4));
+                break;
+            default: /* 0xc1 is never used */
+                return CMT_MPACK_CORRUPT_INPUT_DATA_ERROR;
+            }
+
+            if (header_size > 0) {
+                if (size - position < header_size) {
+                    return CMT_MPACK_INSUFFICIENT_DATA;
+                }
+
+                length = read_big_endian(&data[position], header_size);
+                position += header_size;
+
+                if (type == 0xdc || type == 0xdd) {
+                    pending += length;
+                    continue;
+                }
+
+                if (type == 0xde || type == 0xdf) {
+                    pending += length * 2;
+                    continue;
+                }
+
+                if (type >= 0xc7 && type <= 0xc9) {
+                    length++;
+                }
+            }
+        }
+
+        if (size - position < length) {
+            return CMT_MPACK_INSUFFICIENT_DATA;
+        }
+
+        position += (size_t) length;
+    }
+
+    *object_size = position;
+
+    return CMT_MPACK_SUCCESS;
+}
@@ -0,0 +1,1225 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+#include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_math.h>
+#include <cmetrics/cmt_mpack_utils.h>
+#include <cmetrics/cmt_decode_msgpack.h>
+#include <cmetrics/cmt_encode_msgpack.h>
+#include <cmetrics/cmt_msgpack_view.h>
+
+/* Every reader spans up to the end of the view so positions are absolute */
+static void view_reader_init(struct cmt_msgpack_view *view,
+                             mpack_reader_t *reader, size_t offset)
+{
+    mpack_reader_init_data(reader, &view->buffer[offset], view->size - offset);
+}
+
+static size_t view_position(struct cmt_msgpack_view *view, mpack_reader_t *reader)
+{
+    return view->size - mpack_reader_remaining(reader, NULL);
+}
+
+static int view_discard(mpack_reader_t *reader)
+{
+    mpack_discard(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int view_read_map(mpack_reader_t *reader, uint32_t *entry_count)
+{
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (mpack_type_map != mpack_tag_type(&tag)) {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    *entry_count = mpack_tag_map_count(&tag);
+
+    /* same limit as the decoder */
+    if (CMT_MPACK_MAX_MAP_ENTRY_COUNT < *entry_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int view_read_array(mpack_reader_t *reader, uint32_t *entry_count)
+{
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (mpack_type_array != mpack_tag_type(&tag)) {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    *entry_count = mpack_tag_array_count(&tag);
+
+    /* every entry takes at least one byte */
+    if (CMT_MPACK_MAX_ARRAY_ENTRY_COUNT < *entry_count ||
+        mpack_reader_remaining(reader, NULL) < *entry_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int view_done_map(mpack_reader_t *reader)
+{
+    mpack_done_map(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_PENDING_MAP_ENTRIES;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int view_done_array(mpack_reader_t *reader)
+{
+    mpack_done_array(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_PENDING_ARRAY_ENTRIES;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+/* Read a v1 string in place, nil is only accepted for labels */
+static int view_read_string(mpack_reader_t *reader,
+                            struct cmt_msgpack_view_string *value,
+                            int allow_nil)
+{
+    uint32_t    length;
+    const char *data;
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (allow_nil && mpack_type_nil == mpack_tag_type(&tag)) {
+        value->data = NULL;
+        value->length = 0;
+
+        return CMT_DECODE_MSGPACK_SUCCESS;
+    }
+
+    if (mpack_type_str != mpack_tag_type(&tag)) {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    length = mpack_tag_str_length(&tag);
+    data = mpack_read_bytes_inplace(reader, length);
+    mpack_done_str(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (0 == length) {
+        data = "";
+    }
+
+    value->data = data;
+    value->length = length;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+/* Compact payloads reference the dictionary instead */
+static int view_read_dictionary_string(struct cmt_msgpack_view *view,
+                                       mpack_reader_t *reader,
+                                       struct cmt_msgpack_view_string *value,
+                                       int allow_nil)
+{
+    uint64_t    index;
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (allow_nil && mpack_type_nil == mpack_tag_type(&tag)) {
+        value->data = NULL;
+        value->length = 0;
+
+        return CMT_DECODE_MSGPACK_SUCCESS;
+    }
+
+    if (mpack_type_uint != mpack_tag_type(&tag)) {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    index = mpack_tag_uint_value(&tag);
+
+    if (index >= view->dictionary_size) {
+        return CMT_DECODE_MSGPACK_DICTIONARY_LOOKUP_ERROR;
+    }
+
+    value->data = view->dictionary[index].data;
+    value->length = view->dictionary[index].length;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+static int view_read_label(struct cmt_msgpack_view *view,
+                           mpack_reader_t *reader,
+                           struct cmt_msgpack_view_string *value)
+{
+    if (view->compact) {
+        return view_read_dictionary_string(view, reader, value, CMT_TRUE);
+    }
+
+    return view_read_string(reader, value, CMT_TRUE);
+}
+
+static int view_key_is(struct cmt_msgpack_view_string *key, const char *name)
+{
+    size_t length;
+
+    length = strlen(name);
+
+    return key->length == length && 0 == memcmp(key->data, name, length);
+}
+
+/* Summary and exponential histogram sums are packed as their raw bits */
+static int view_read_sum(mpack_reader_t *reader, double *sum)
+{
+    mpack_tag_t tag;
+
+    tag = mpack_read_tag(reader);
+
+    if (mpack_ok != mpack_reader_error(reader)) {
+        return CMT_DECODE_MSGPACK_ENGINE_ERROR;
+    }
+
+    if (mpack_type_double == mpack_tag_type(&tag)) {
+        *sum = mpack_tag_double_value(&tag);
+    }
+    else if (mpack_type_uint == mpack_tag_type(&tag)) {
+        *sum = cmt_math_uint64_to_d64(mpack_tag_uint_value(&tag));
+    }
+    else {
+        return CMT_DECODE_MSGPACK_UNEXPECTED_DATA_TYPE_ERROR;
+    }
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+/* The label array is validated once, the iterators read it again later */
+static int view_read_label_list(struct cmt_msgpack_view *view,
+                                mpack_reader_t *reader,
+                                size_t *label_count, size_t *labels_offset)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string label;
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    *label_count = entry_count;
+    *labels_offset = view_position(view, reader);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_label(view, reader, &label);
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+static int view_reserve_series(struct cmt_msgpack_view *view, size_t count)
+{
+    size_t                                capacity;
+    struct cmt_msgpack_view_series_entry *series;
+
+    if (view->series_count + count <= view->series_capacity) {
+        return CMT_DECODE_MSGPACK_SUCCESS;
+    }
+
+    capacity = view->series_capacity * 2;
+
+    if (capacity < view->series_count + count) {
+        capacity = view->series_count + count;
+    }
+
+    series = realloc(view->series,
+                     capacity * sizeof(struct cmt_msgpack_view_series_entry));
+
+    if (NULL == series) {
+        cmt_errno();
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    view->series = series;
+    view->series_capacity = capacity;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+/* Only the timestamp delta of a compact series is read while indexing */
+static int view_skip_compact_series(struct cmt_msgpack_view *view,
+                                    mpack_reader_t *reader)
+{
+    int      result;
+    int64_t  delta;
+    uint32_t index;
+    uint32_t entry_count;
+    uint64_t key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = cmt_mpack_consume_uint_tag(reader, &key);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (MSGPACK_COMPACT_VALUE_TS == key) {
+            result = cmt_mpack_consume_int_tag(reader, &delta);
+
+            if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+                view->timestamp += (uint64_t) delta;
+            }
+        }
+        else {
+            result = view_discard(reader);
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_index_series_list(struct cmt_msgpack_view *view,
+                                  mpack_reader_t *reader,
+                                  struct cmt_msgpack_view_family *family)
+{
+    int                                   result;
+    uint32_t                              index;
+    uint32_t                              entry_count;
+    struct cmt_msgpack_view_series_entry *entry;
+
+    if (0 != family->series_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    /*
+     * The index grows with the announced count, every series takes at least
+     * one byte so a larger count can only come from a corrupt payload.
+     */
+    if (entry_count > mpack_reader_remaining(reader, NULL)) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    result = view_reserve_series(view, entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    family->first_series = view->series_count;
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        entry = &view->series[view->series_count];
+
+        entry->offset = view_position(view, reader);
+        entry->timestamp = view->timestamp;
+
+        if (view->compact) {
+            result = view_skip_compact_series(view, reader);
+        }
+        else {
+            result = view_discard(reader);
+        }
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+            view->series_count++;
+            family->series_count++;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+static int view_index_family_opts(mpack_reader_t *reader,
+                                  struct cmt_msgpack_view_family *family)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "ns")) {
+            result = view_read_string(reader, &family->ns, CMT_FALSE);
+        }
+        else if (view_key_is(&key, "ss")) {
+            result = view_read_string(reader, &family->subsystem, CMT_FALSE);
+        }
+        else if (view_key_is(&key, "name")) {
+            result = view_read_string(reader, &family->name, CMT_FALSE);
+        }
+        else if (view_key_is(&key, "desc")) {
+            result = view_read_string(reader, &family->description, CMT_FALSE);
+        }
+        else if (view_key_is(&key, "unit")) {
+            result = view_read_string(reader, &family->unit, CMT_FALSE);
+        }
+        else {
+            result = view_discard(reader);
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_index_family_meta(struct cmt_msgpack_view *view,
+                                  mpack_reader_t *reader,
+                                  struct cmt_msgpack_view_family *family)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    uint64_t                       type;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "type")) {
+            result = cmt_mpack_consume_uint_tag(reader, &type);
+            family->type = (int) type;
+        }
+        else if (view_key_is(&key, "opts")) {
+            result = view_index_family_opts(reader, family);
+        }
+        else if (view_key_is(&key, "labels")) {
+            result = view_read_label_list(view, reader,
+                                          &family->label_count,
+                                          &family->labels_offset);
+        }
+        else {
+            /* 'ver', the buckets, the quantiles and the aggregation type */
+            result = view_discard(reader);
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_index_family(struct cmt_msgpack_view *view,
+                             mpack_reader_t *reader,
+                             struct cmt_msgpack_view_family *family)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "meta")) {
+            result = view_index_family_meta(view, reader, family);
+        }
+        else if (view_key_is(&key, "values")) {
+            result = view_index_series_list(view, reader, family);
+        }
+        else {
+            result = CMT_DECODE_MSGPACK_UNEXPECTED_KEY_ERROR;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+/* [ns, subsystem, name, description, unit] */
+static int view_index_compact_family_opts(struct cmt_msgpack_view *view,
+                                          mpack_reader_t *reader,
+                                          struct cmt_msgpack_view_family *family)
+{
+    int                             result;
+    uint32_t                        index;
+    uint32_t                        entry_count;
+    struct cmt_msgpack_view_string *fields[5];
+
+    fields[0] = &family->ns;
+    fields[1] = &family->subsystem;
+    fields[2] = &family->name;
+    fields[3] = &family->description;
+    fields[4] = &family->unit;
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (5 != entry_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_dictionary_string(view, reader, fields[index],
+                                             CMT_FALSE);
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+static int view_index_compact_family(struct cmt_msgpack_view *view,
+                                     mpack_reader_t *reader,
+                                     struct cmt_msgpack_view_family *family)
+{
+    int      result;
+    uint32_t index;
+    uint32_t entry_count;
+    uint64_t key;
+    uint64_t type;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = cmt_mpack_consume_uint_tag(reader, &key);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        switch (key) {
+        case MSGPACK_COMPACT_META_TYPE:
+            result = cmt_mpack_consume_uint_tag(reader, &type);
+            family->type = (int) type;
+            break;
+        case MSGPACK_COMPACT_META_OPTS:
+            result = view_index_compact_family_opts(view, reader, family);
+            break;
+        case MSGPACK_COMPACT_META_LABELS:
+            result = view_read_label_list(view, reader,
+                                          &family->label_count,
+                                          &family->labels_offset);
+            break;
+        case MSGPACK_COMPACT_META_VALUES:
+            result = view_index_series_list(view, reader, family);
+            break;
+        case MSGPACK_COMPACT_META_BUCKETS:
+        case MSGPACK_COMPACT_META_QUANTILES:
+        case MSGPACK_COMPACT_META_AGGREGATION_TYPE:
+            result = view_discard(reader);
+            break;
+        default:
+            result = CMT_DECODE_MSGPACK_UNEXPECTED_KEY_ERROR;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_index_families(struct cmt_msgpack_view *view,
+                               mpack_reader_t *reader)
+{
+    int                             result;
+    uint32_t                        index;
+    uint32_t                        entry_count;
+    struct cmt_msgpack_view_family *family;
+
+    if (NULL != view->families) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    view->families = calloc(entry_count + 1, sizeof(struct cmt_msgpack_view_family));
+
+    if (NULL == view->families) {
+        cmt_errno();
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        family = &view->families[index];
+
+        if (view->compact) {
+            result = view_index_compact_family(view, reader, family);
+        }
+        else {
+            result = view_index_family(view, reader, family);
+        }
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+            view->family_count++;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+static int view_index_context(struct cmt_msgpack_view *view,
+                              mpack_reader_t *reader)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "meta")) {
+            result = view_discard(reader);
+        }
+        else if (view_key_is(&key, "metrics")) {
+            result = view_index_families(view, reader);
+        }
+        else {
+            result = CMT_DECODE_MSGPACK_UNEXPECTED_KEY_ERROR;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_index_dictionary(struct cmt_msgpack_view *view,
+                                 mpack_reader_t *reader)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string entry;
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    /* the first entry is always the empty string */
+    if (0 == entry_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    view->dictionary = calloc(entry_count,
+                              sizeof(struct cmt_msgpack_dictionary_entry));
+
+    if (NULL == view->dictionary) {
+        cmt_errno();
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &entry, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+            view->dictionary[index].data = entry.data;
+            view->dictionary[index].length = entry.length;
+            view->dictionary_size++;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+/* [version, dictionary, context header, metrics] */
+static int view_index_compact_context(struct cmt_msgpack_view *view,
+                                      mpack_reader_t *reader)
+{
+    int      result;
+    uint32_t entry_count;
+    uint64_t version;
+
+    result = view_read_array(reader, &entry_count);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (4 != entry_count) {
+        return CMT_DECODE_MSGPACK_CORRUPT_INPUT_DATA_ERROR;
+    }
+
+    result = cmt_mpack_consume_uint_tag(reader, &version);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    if (MSGPACK_COMPACT_VERSION != version) {
+        return CMT_DECODE_MSGPACK_VERSION_ERROR;
+    }
+
+    result = view_index_dictionary(view, reader);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        result = view_discard(reader);
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS == result) {
+        result = view_index_families(view, reader);
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_array(reader);
+}
+
+int cmt_msgpack_view_create(struct cmt_msgpack_view **out_view,
+                            char *in_buf, size_t in_size, size_t *offset)
+{
+    int                      result;
+    size_t                   consumed;
+    mpack_tag_t              tag;
+    mpack_reader_t           reader;
+    struct cmt_msgpack_view *view;
+
+    if (NULL == out_view ||
+        NULL == in_buf ||
+        NULL == offset ||
+        in_size < *offset) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    *out_view = NULL;
+
+    if (0 == in_size - *offset) {
+        return CMT_DECODE_MSGPACK_INSUFFICIENT_DATA;
+    }
+
+    view = calloc(1, sizeof(struct cmt_msgpack_view));
+
+    if (NULL == view) {
+        cmt_errno();
+
+        return CMT_DECODE_MSGPACK_ALLOCATION_ERROR;
+    }
+
+    view->buffer = &in_buf[*offset];
+    view->size = in_size - *offset;
+
+    view_reader_init(view, &reader, 0);
+
+    tag = mpack_peek_tag(&reader);
+
+    if (mpack_ok == mpack_reader_error(&reader) &&
+        mpack_type_array == mpack_tag_type(&tag)) {
+        view->compact = CMT_TRUE;
+
+        result = view_index_compact_context(view, &reader);
+    }
+    else {
+        result = view_index_context(view, &reader);
+    }
+
+    consumed = view_position(view, &reader);
+
+    mpack_reader_destroy(&reader);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        cmt_msgpack_view_destroy(view);
+
+        return result;
+    }
+
+    view->size = consumed;
+    *offset += consumed;
+    *out_view = view;
+
+    return CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+void cmt_msgpack_view_destroy(struct cmt_msgpack_view *view)
+{
+    if (NULL == view) {
+        return;
+    }
+
+    if (NULL != view->dictionary) {
+        free(view->dictionary);
+    }
+
+    if (NULL != view->families) {
+        free(view->families);
+    }
+
+    if (NULL != view->series) {
+        free(view->series);
+    }
+
+    free(view);
+}
+
+struct cmt_msgpack_view_family *cmt_msgpack_view_family_get(struct cmt_msgpack_view *view,
+                                                            size_t index)
+{
+    if (NULL == view || index >= view->family_count) {
+        return NULL;
+    }
+
+    return &view->families[index];
+}
+
+/* 'histogram', 'summary' and 'exp_histogram' */
+static int view_read_aggregate(mpack_reader_t *reader,
+                               struct cmt_msgpack_view_series *series)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "count")) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->count);
+        }
+        else if (view_key_is(&key, "sum")) {
+            result = view_read_sum(reader, &series->sum);
+        }
+        else {
+            result = view_discard(reader);
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_read_series(struct cmt_msgpack_view *view,
+                            mpack_reader_t *reader,
+                            struct cmt_msgpack_view_series *series)
+{
+    int                            result;
+    uint32_t                       index;
+    uint32_t                       entry_count;
+    uint64_t                       value_type;
+    struct cmt_msgpack_view_string key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = view_read_string(reader, &key, CMT_FALSE);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (view_key_is(&key, "ts")) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->timestamp);
+        }
+        else if (view_key_is(&key, "start_ts")) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->start_timestamp);
+            series->has_start_timestamp = CMT_TRUE;
+        }
+        else if (view_key_is(&key, "value")) {
+            result = cmt_mpack_consume_double_tag(reader, &series->value);
+        }
+        else if (view_key_is(&key, "value_type")) {
+            result = cmt_mpack_consume_uint_tag(reader, &value_type);
+            series->value_type = (int) value_type;
+        }
+        else if (view_key_is(&key, "value_int64")) {
+            result = cmt_mpack_consume_int_tag(reader, &series->int64_value);
+        }
+        else if (view_key_is(&key, "value_uint64")) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->uint64_value);
+        }
+        else if (view_key_is(&key, "histogram") ||
+                 view_key_is(&key, "summary") ||
+                 view_key_is(&key, "exp_histogram")) {
+            result = view_read_aggregate(reader, series);
+        }
+        else if (view_key_is(&key, "labels")) {
+            result = view_read_label_list(view, reader,
+                                          &series->label_count,
+                                          &series->labels_offset);
+        }
+        else if (view_key_is(&key, "hash")) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->hash);
+        }
+        else {
+            result = CMT_DECODE_MSGPACK_UNEXPECTED_KEY_ERROR;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_read_compact_aggregate(mpack_reader_t *reader,
+                                       struct cmt_msgpack_view_series *series,
+                                       uint64_t count_key, uint64_t sum_key)
+{
+    int      result;
+    uint32_t index;
+    uint32_t entry_count;
+    uint64_t key;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = cmt_mpack_consume_uint_tag(reader, &key);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        if (count_key == key) {
+            result = cmt_mpack_consume_uint_tag(reader, &series->count);
+        }
+        else if (sum_key == key) {
+            result = view_read_sum(reader, &series->sum);
+        }
+        else {
+            result = view_discard(reader);
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    return view_done_map(reader);
+}
+
+static int view_read_compact_series(struct cmt_msgpack_view *view,
+                                    mpack_reader_t *reader,
+                                    struct cmt_msgpack_view_series_entry *entry,
+                                    struct cmt_msgpack_view_series *series)
+{
+    int      result;
+    int64_t  delta;
+    int64_t  start_delta;
+    uint32_t index;
+    uint32_t entry_count;
+    uint64_t key;
+
+    delta = 0;
+    start_delta = 0;
+
+    result = view_read_map(reader, &entry_count);
+
+    for (index = 0 ;
+         CMT_DECODE_MSGPACK_SUCCESS == result && index < entry_count ;
+         index++) {
+        result = cmt_mpack_consume_uint_tag(reader, &key);
+
+        if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+            break;
+        }
+
+        switch (key) {
+        case MSGPACK_COMPACT_VALUE_TS:
+            result = cmt_mpack_consume_int_tag(reader, &delta);
+            break;
+        case MSGPACK_COMPACT_VALUE_START_TS:
+            result = cmt_mpack_consume_int_tag(reader, &start_delta);
+            series->has_start_timestamp = CMT_TRUE;
+            break;
+        case MSGPACK_COMPACT_VALUE_DOUBLE:
+            result = cmt_mpack_consume_double_tag(reader, &series->value);
+            series->value_type = CMT_METRIC_VALUE_DOUBLE;
+            break;
+        case MSGPACK_COMPACT_VALUE_INT64:
+            result = cmt_mpack_consume_int_tag(reader, &series->int64_value);
+            series->value_type = CMT_METRIC_VALUE_INT64;
+            series->value = (double) series->int64_value;
+            break;
+        case MSGPACK_COMPACT_VALUE_UINT64:
+            result = cmt_mpack_consume_uint_tag(reader, &series->uint64_value);
+            series->value_type = CMT_METRIC_VALUE_UINT64;
+            series->value = (double) series->uint64_value;
+            break;
+        case MSGPACK_COMPACT_VALUE_LABELS:
+            result = view_read_label_list(view, reader,
+                                          &series->label_count,
+                                          &series->labels_offset);
+            break;
+        case MSGPACK_COMPACT_VALUE_HISTOGRAM:
+            result = view_read_compact_aggregate(reader, series,
+                                                 MSGPACK_COMPACT_HISTOGRAM_COUNT,
+                                                 MSGPACK_COMPACT_HISTOGRAM_SUM);
+            break;
+        case MSGPACK_COMPACT_VALUE_SUMMARY:
+            result = view_read_compact_aggregate(reader, series,
+                                                 MSGPACK_COMPACT_SUMMARY_COUNT,
+                                                 MSGPACK_COMPACT_SUMMARY_SUM);
+            break;
+        case MSGPACK_COMPACT_VALUE_EXP_HISTOGRAM:
+            result = view_read_compact_aggregate(reader, series,
+                                                 MSGPACK_COMPACT_EXP_HISTOGRAM_COUNT,
+                                                 MSGPACK_COMPACT_EXP_HISTOGRAM_SUM);
+            break;
+        case MSGPACK_COMPACT_VALUE_HASH:
+            result = cmt_mpack_consume_uint_tag(reader, &series->hash);
+            break;
+        default:
+            result = CMT_DECODE_MSGPACK_UNEXPECTED_KEY_ERROR;
+        }
+    }
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        return result;
+    }
+
+    series->timestamp = entry->timestamp + (uint64_t) delta;
+
+    if (series->has_start_timestamp) {
+        series->start_timestamp = series->timestamp + (uint64_t) start_delta;
+    }
+
+    return view_done_map(reader);
+}
+
+int cmt_msgpack_view_series_get(struct cmt_msgpack_view *view,
+                                struct cmt_msgpack_view_family *family,
+                                size_t index,
+                                struct cmt_msgpack_view_series *series)
+{
+    int                                   result;
+    mpack_reader_t                        reader;
+    struct cmt_msgpack_view_series_entry *entry;
+
+    if (NULL == view ||
+        NULL == family ||
+        NULL == series ||
+        index >= family->series_count) {
+        return CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR;
+    }
+
+    memset(series, 0, sizeof(struct cmt_msgpack_view_series));
+    series->value_type = CMT_METRIC_VALUE_DOUBLE;
+
+    entry = &view->series[family->first_series + index];
+
+    view_reader_init(view, &reader, entry->offset);
+
+    if (view->compact) {
+        result = view_read_compact_series(view, &reader, entry, series);
+    }
+    else {
+        result = view_read_series(view, &reader, series);
+    }
+
+    mpack_reader_destroy(&reader);
+
+    return result;
+}
+
+void cmt_msgpack_view_family_labels(struct cmt_msgpack_view *view,
+                                    struct cmt_msgpack_view_family *family,
+                                    struct cmt_msgpack_view_label_iterator *iterator)
+{
+    iterator->view = view;
+    iterator->offset = family->labels_offset;
+    iterator->remaining = family->label_count;
+    iterator->error = CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+void cmt_msgpack_view_series_labels(struct cmt_msgpack_view *view,
+                                    struct cmt_msgpack_view_series *series,
+                                    struct cmt_msgpack_view_label_iterator *iterator)
+{
+    iterator->view = view;
+    iterator->offset = series->labels_offset;
+    iterator->remaining = series->label_count;
+    iterator->error = CMT_DECODE_MSGPACK_SUCCESS;
+}
+
+int cmt_msgpack_view_label_next(struct cmt_msgpack_view_label_iterator *iterator,
+                                struct cmt_msgpack_view_string *label)
+{
+    int            result;
+    mpack_reader_t reader;
+
+    if (0 == iterator->remaining ||
+        CMT_DECODE_MSGPACK_SUCCESS != iterator->error) {
+        return CMT_FALSE;
+    }
+
+    view_reader_init(iterator->view, &reader, iterator->offset);
+
+    result = view_read_label(iterator->view, &reader, label);
+
+    iterator->offset = view_position(iterator->view, &reader);
+
+    mpack_reader_destroy(&reader);
+
+    if (CMT_DECODE_MSGPACK_SUCCESS != result) {
+        iterator->error = result;
+
+        return CMT_FALSE;
+    }
+
+    iterator->remaining--;
+
+    return CMT_TRUE;
+}
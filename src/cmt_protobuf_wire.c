@@ -0,0 +1,474 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmetrics.h>
+
+#include "cmt_protobuf_wire.h"
+
+#include <string.h>
+
+#define CMT_PROTOBUF_WRITER_MINIMUM_CAPACITY 256
+
+static int writer_reserve(struct cmt_protobuf_writer *writer, size_t length)
+{
+    size_t         capacity;
+    unsigned char *data;
+
+    if (writer->error != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return writer->error;
+    }
+
+    if (writer->capacity - writer->size >= length) {
+        return CMT_PROTOBUF_WIRE_SUCCESS;
+    }
+
+    capacity = writer->capacity;
+    if (capacity < CMT_PROTOBUF_WRITER_MINIMUM_CAPACITY) {
+        capacity = CMT_PROTOBUF_WRITER_MINIMUM_CAPACITY;
+    }
+
+    while (capacity - writer->size < length) {
+        capacity *= 2;
+    }
+
+    data = realloc(writer->data, capacity);
+    if (data == NULL) {
+        cmt_errno();
+        writer->error = CMT_PROTOBUF_WIRE_ALLOCATION_ERROR;
+
+        return writer->error;
+    }
+
+    writer->data = data;
+    writer->capacity = capacity;
+
+    return CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+static inline void writer_put_varint(struct cmt_protobuf_writer *writer,
+                                     uint64_t value)
+{
+    unsigned char *output;
+
+    output = &writer->data[writer->size];
+
+    while (value >= 0x80) {
+        *output++ = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    *output++ = (unsigned char) value;
+
+    writer->size = output - writer->data;
+}
+
+static inline void writer_put_fixed64(struct cmt_protobuf_writer *writer,
+                                      uint64_t value)
+{
+    int            index;
+    unsigned char *output;
+
+    output = &writer->data[writer->size];
+
+    /* the wire format is little endian regardless of the host */
+    for (index = 0 ; index < 8 ; index++) {
+        output[index] = (unsigned char) (value >> (index * 8));
+    }
+
+    writer->size += 8;
+}
+
+int cmt_protobuf_writer_init(struct cmt_protobuf_writer *writer,
+                             size_t initial_capacity)
+{
+    if (writer == NULL) {
+        return CMT_PROTOBUF_WIRE_INVALID_ARGUMENT_ERROR;
+    }
+
+    memset(writer, 0, sizeof(struct cmt_protobuf_writer));
+
+    if (initial_capacity > 0) {
+        return writer_reserve(writer, initial_capacity);
+    }
+
+    return CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+void cmt_protobuf_writer_destroy(struct cmt_protobuf_writer *writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+
+    if (writer->data != NULL) {
+        free(writer->data);
+    }
+
+    memset(writer, 0, sizeof(struct cmt_protobuf_writer));
+}
+
+void cmt_protobuf_writer_reset(struct cmt_protobuf_writer *writer)
+{
+    writer->size = 0;
+    writer->error = CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+cfl_sds_t cmt_protobuf_writer_to_sds(struct cmt_protobuf_writer *writer)
+{
+    cfl_sds_t result;
+
+    if (writer->error != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return NULL;
+    }
+
+    result = cfl_sds_create_size(writer->size + 1);
+    if (result == NULL) {
+        cmt_errno();
+        return NULL;
+    }
+
+    if (writer->size > 0) {
+        memcpy(result, writer->data, writer->size);
+    }
+    cfl_sds_set_len(result, writer->size);
+
+    return result;
+}
+
+void cmt_protobuf_write_raw(struct cmt_protobuf_writer *writer,
+                            const void *data, size_t length)
+{
+    if (length == 0 ||
+        writer_reserve(writer, length) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    memcpy(&writer->data[writer->size], data, length);
+    writer->size += length;
+}
+
+unsigned char *cmt_protobuf_write_reserve(struct cmt_protobuf_writer *writer,
+                                          size_t length)
+{
+    unsigned char *output;
+
+    if (writer_reserve(writer, length) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return NULL;
+    }
+
+    output = &writer->data[writer->size];
+    writer->size += length;
+
+    return output;
+}
+
+void cmt_protobuf_write_varint(struct cmt_protobuf_writer *writer,
+                               uint64_t value)
+{
+    if (writer_reserve(writer, 10) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    writer_put_varint(writer, value);
+}
+
+void cmt_protobuf_write_tag(struct cmt_protobuf_writer *writer,
+                            uint32_t field, int wire_type)
+{
+    cmt_protobuf_write_varint(writer, ((uint64_t) field << 3) | wire_type);
+}
+
+void cmt_protobuf_write_uint64_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, uint64_t value)
+{
+    /* tag (at most 5 bytes) plus value (at most 10 bytes) */
+    if (writer_reserve(writer, 15) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    writer_put_varint(writer, ((uint64_t) field << 3) |
+                              CMT_PROTOBUF_WIRE_TYPE_VARINT);
+    writer_put_varint(writer, value);
+}
+
+void cmt_protobuf_write_int64_field(struct cmt_protobuf_writer *writer,
+                                    uint32_t field, int64_t value)
+{
+    cmt_protobuf_write_uint64_field(writer, field, (uint64_t) value);
+}
+
+void cmt_protobuf_write_sint64_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, int64_t value)
+{
+    cmt_protobuf_write_uint64_field(writer, field, cmt_protobuf_zigzag64(value));
+}
+
+void cmt_protobuf_write_bool_field(struct cmt_protobuf_writer *writer,
+                                   uint32_t field, int value)
+{
+    cmt_protobuf_write_uint64_field(writer, field, value ? 1 : 0);
+}
+
+void cmt_protobuf_write_fixed64_field(struct cmt_protobuf_writer *writer,
+                                      uint32_t field, uint64_t value)
+{
+    if (writer_reserve(writer, 13) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    writer_put_varint(writer, ((uint64_t) field << 3) |
+                              CMT_PROTOBUF_WIRE_TYPE_FIXED64);
+    writer_put_fixed64(writer, value);
+}
+
+void cmt_protobuf_write_double_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(uint64_t));
+    cmt_protobuf_write_fixed64_field(writer, field, bits);
+}
+
+void cmt_protobuf_write_fixed64(struct cmt_protobuf_writer *writer,
+                                uint64_t value)
+{
+    if (writer_reserve(writer, 8) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    writer_put_fixed64(writer, value);
+}
+
+void cmt_protobuf_write_double(struct cmt_protobuf_writer *writer,
+                               double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(uint64_t));
+    cmt_protobuf_write_fixed64(writer, bits);
+}
+
+void cmt_protobuf_write_bytes_field(struct cmt_protobuf_writer *writer,
+                                    uint32_t field,
+                                    const void *data, size_t length)
+{
+    if (writer_reserve(writer, 15 + length) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return;
+    }
+
+    writer_put_varint(writer, ((uint64_t) field << 3) |
+                              CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED);
+    writer_put_varint(writer, length);
+
+    if (length > 0) {
+        memcpy(&writer->data[writer->size], data, length);
+        writer->size += length;
+    }
+}
+
+void cmt_protobuf_write_string_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, const char *value)
+{
+    if (value == NULL) {
+        return;
+    }
+
+    cmt_protobuf_write_bytes_field(writer, field, value, strlen(value));
+}
+
+size_t cmt_protobuf_begin_length(struct cmt_protobuf_writer *writer)
+{
+    if (writer_reserve(writer, 1) != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return 0;
+    }
+
+    /* placeholder for a single byte length, fixed up by end_message */
+    writer->data[writer->size] = 0;
+    writer->size++;
+
+    return writer->size;
+}
+
+size_t cmt_protobuf_begin_message(struct cmt_protobuf_writer *writer,
+                                  uint32_t field)
+{
+    cmt_protobuf_write_tag(writer, field, CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED);
+
+    return cmt_protobuf_begin_length(writer);
+}
+
+void cmt_protobuf_end_message(struct cmt_protobuf_writer *writer, size_t mark)
+{
+    size_t length;
+    size_t prefix_size;
+    size_t content_size;
+
+    if (writer->error != CMT_PROTOBUF_WIRE_SUCCESS || mark == 0) {
+        return;
+    }
+
+    content_size = writer->size - mark;
+    prefix_size = cmt_protobuf_varint_size(content_size);
+
+    if (prefix_size > 1) {
+        if (writer_reserve(writer, prefix_size - 1) != CMT_PROTOBUF_WIRE_SUCCESS) {
+            return;
+        }
+
+        memmove(&writer->data[mark + prefix_size - 1],
+                &writer->data[mark],
+                content_size);
+    }
+
+    /* write the length over the placeholder */
+    length = writer->size;
+    writer->size = mark - 1;
+    writer_put_varint(writer, content_size);
+    writer->size = length + prefix_size - 1;
+}
+
+void cmt_protobuf_reader_init(struct cmt_protobuf_reader *reader,
+                              const void *data, size_t size)
+{
+    reader->data = data;
+    reader->size = size;
+    reader->offset = 0;
+}
+
+int cmt_protobuf_read_varint(struct cmt_protobuf_reader *reader,
+                             uint64_t *value)
+{
+    int           shift;
+    uint64_t      result;
+    unsigned char byte;
+
+    result = 0;
+
+    for (shift = 0 ; shift < 64 ; shift += 7) {
+        if (reader->offset >= reader->size) {
+            return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+        }
+
+        byte = reader->data[reader->offset++];
+        result |= (uint64_t) (byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            *value = result;
+
+            return CMT_PROTOBUF_WIRE_SUCCESS;
+        }
+    }
+
+    return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+}
+
+int cmt_protobuf_read_tag(struct cmt_protobuf_reader *reader,
+                          uint32_t *field, int *wire_type)
+{
+    uint64_t tag;
+    int      result;
+
+    result = cmt_protobuf_read_varint(reader, &tag);
+
+    if (result != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return result;
+    }
+
+    if ((tag >> 3) == 0 || (tag >> 3) > UINT32_MAX) {
+        return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+    }
+
+    *field = (uint32_t) (tag >> 3);
+    *wire_type = (int) (tag & 0x07);
+
+    return CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+int cmt_protobuf_read_fixed64(struct cmt_protobuf_reader *reader,
+                              uint64_t *value)
+{
+    int      index;
+    uint64_t result;
+
+    if (reader->size - reader->offset < 8) {
+        return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+    }
+
+    result = 0;
+
+    for (index = 0 ; index < 8 ; index++) {
+        result |= (uint64_t) reader->data[reader->offset + index] << (index * 8);
+    }
+
+    reader->offset += 8;
+    *value = result;
+
+    return CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+int cmt_protobuf_read_bytes(struct cmt_protobuf_reader *reader,
+                            const unsigned char **data, size_t *length)
+{
+    uint64_t size;
+    int      result;
+
+    result = cmt_protobuf_read_varint(reader, &size);
+
+    if (result != CMT_PROTOBUF_WIRE_SUCCESS) {
+        return result;
+    }
+
+    if (size > reader->size - reader->offset) {
+        return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+    }
+
+    *data = &reader->data[reader->offset];
+    *length = (size_t) size;
+
+    reader->offset += (size_t) size;
+
+    return CMT_PROTOBUF_WIRE_SUCCESS;
+}
+
+int cmt_protobuf_skip_field(struct cmt_protobuf_reader *reader, int wire_type)
+{
+    const unsigned char *data;
+    uint64_t             value;
+    size_t               length;
+
+    switch (wire_type) {
+    case CMT_PROTOBUF_WIRE_TYPE_VARINT:
+        return cmt_protobuf_read_varint(reader, &value);
+    case CMT_PROTOBUF_WIRE_TYPE_FIXED64:
+        return cmt_protobuf_read_fixed64(reader, &value);
+    case CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED:
+        return cmt_protobuf_read_bytes(reader, &data, &length);
+    case CMT_PROTOBUF_WIRE_TYPE_FIXED32:
+        if (reader->size - reader->offset < 4) {
+            return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+        }
+
+        reader->offset += 4;
+
+        return CMT_PROTOBUF_WIRE_SUCCESS;
+    }
+
+    /* groups are not used by any of the supported messages */
+    return CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR;
+}
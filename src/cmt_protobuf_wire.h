@@ -0,0 +1,156 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef CMT_PROTOBUF_WIRE_H
+#define CMT_PROTOBUF_WIRE_H
+
+#include <cmetrics/cmetrics.h>
+#include <stdint.h>
+
+#define CMT_PROTOBUF_WIRE_SUCCESS                 0
+#define CMT_PROTOBUF_WIRE_ALLOCATION_ERROR        1
+#define CMT_PROTOBUF_WIRE_INVALID_ARGUMENT_ERROR  2
+#define CMT_PROTOBUF_WIRE_CORRUPTED_INPUT_ERROR   3
+
+#define CMT_PROTOBUF_WIRE_TYPE_VARINT             0
+#define CMT_PROTOBUF_WIRE_TYPE_FIXED64            1
+#define CMT_PROTOBUF_WIRE_TYPE_LENGTH_DELIMITED   2
+#define CMT_PROTOBUF_WIRE_TYPE_FIXED32            5
+
+/*
+ * Minimal protocol buffers wire format writer, it serializes fields straight
+ * into a growing buffer so encoders do not need to build an intermediate
+ * message tree.
+ *
+ * Errors are sticky: once an allocation fails every further write becomes a
+ * no-op and the caller only needs to check 'error' once it is done.
+ *
+ * Nested messages are written by reserving a single byte for the length
+ * prefix; when the message is closed the content is shifted only if the
+ * length needs more than one byte, which keeps small messages (labels, spans,
+ * quantiles) free of any extra copy.
+ */
+struct cmt_protobuf_writer {
+    unsigned char *data;
+    size_t         size;
+    size_t         capacity;
+    int            error;
+};
+
+int cmt_protobuf_writer_init(struct cmt_protobuf_writer *writer,
+                             size_t initial_capacity);
+void cmt_protobuf_writer_destroy(struct cmt_protobuf_writer *writer);
+void cmt_protobuf_writer_reset(struct cmt_protobuf_writer *writer);
+cfl_sds_t cmt_protobuf_writer_to_sds(struct cmt_protobuf_writer *writer);
+
+void cmt_protobuf_write_raw(struct cmt_protobuf_writer *writer,
+                            const void *data, size_t length);
+/*
+ * Append 'length' bytes for the caller to fill in (e.g. a message packed by
+ * another serializer), returns NULL once the writer has failed.
+ */
+unsigned char *cmt_protobuf_write_reserve(struct cmt_protobuf_writer *writer,
+                                          size_t length);
+void cmt_protobuf_write_varint(struct cmt_protobuf_writer *writer,
+                               uint64_t value);
+void cmt_protobuf_write_tag(struct cmt_protobuf_writer *writer,
+                            uint32_t field, int wire_type);
+
+void cmt_protobuf_write_uint64_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, uint64_t value);
+void cmt_protobuf_write_int64_field(struct cmt_protobuf_writer *writer,
+                                    uint32_t field, int64_t value);
+void cmt_protobuf_write_sint64_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, int64_t value);
+void cmt_protobuf_write_bool_field(struct cmt_protobuf_writer *writer,
+                                   uint32_t field, int value);
+void cmt_protobuf_write_fixed64_field(struct cmt_protobuf_writer *writer,
+                                      uint32_t field, uint64_t value);
+void cmt_protobuf_write_double_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, double value);
+void cmt_protobuf_write_bytes_field(struct cmt_protobuf_writer *writer,
+                                    uint32_t field,
+                                    const void *data, size_t length);
+void cmt_protobuf_write_string_field(struct cmt_protobuf_writer *writer,
+                                     uint32_t field, const char *value);
+
+/* Packed repeated field elements (to be used between begin and end) */
+void cmt_protobuf_write_fixed64(struct cmt_protobuf_writer *writer,
+                                uint64_t value);
+void cmt_protobuf_write_double(struct cmt_protobuf_writer *writer,
+                               double value);
+
+/*
+ * Length delimited sections: 'begin' returns a mark that must be handed back
+ * to 'end' once the content has been written. The untagged variant is used
+ * for the size prefixed framing of delimited streams.
+ */
+size_t cmt_protobuf_begin_message(struct cmt_protobuf_writer *writer,
+                                  uint32_t field);
+size_t cmt_protobuf_begin_length(struct cmt_protobuf_writer *writer);
+void cmt_protobuf_end_message(struct cmt_protobuf_writer *writer, size_t mark);
+
+/*
+ * Wire format reader, it walks a buffer field by field without copying:
+ * length delimited fields are returned as slices of the input which can be
+ * handed to a nested reader.
+ */
+struct cmt_protobuf_reader {
+    const unsigned char *data;
+    size_t               size;
+    size_t               offset;
+};
+
+void cmt_protobuf_reader_init(struct cmt_protobuf_reader *reader,
+                              const void *data, size_t size);
+
+static inline int cmt_protobuf_reader_has_data(struct cmt_protobuf_reader *reader)
+{
+    return reader->offset < reader->size;
+}
+
+int cmt_protobuf_read_tag(struct cmt_protobuf_reader *reader,
+                          uint32_t *field, int *wire_type);
+int cmt_protobuf_read_varint(struct cmt_protobuf_reader *reader,
+                             uint64_t *value);
+int cmt_protobuf_read_fixed64(struct cmt_protobuf_reader *reader,
+                              uint64_t *value);
+int cmt_protobuf_read_bytes(struct cmt_protobuf_reader *reader,
+                            const unsigned char **data, size_t *length);
+int cmt_protobuf_skip_field(struct cmt_protobuf_reader *reader, int wire_type);
+
+static inline uint64_t cmt_protobuf_zigzag64(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline size_t cmt_protobuf_varint_size(uint64_t value)
+{
+    size_t size;
+
+    size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+#endif
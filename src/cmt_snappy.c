@@ -0,0 +1,469 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  CMetrics
+ *  ========
+ *  Copyright 2021-2022 The CMetrics Authors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <cmetrics/cmt_snappy.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Input is compressed in independent blocks of 64KB so every back reference
+ * fits in a two byte offset and the hash table can store 16 bit positions.
+ */
+#define SNAPPY_BLOCK_SIZE          (1 << 16)
+#define SNAPPY_MAX_HASH_TABLE_BITS 14
+#define SNAPPY_MAX_HASH_TABLE_SIZE (1 << SNAPPY_MAX_HASH_TABLE_BITS)
+
+/* Blocks shorter than this are emitted as a single literal */
+#define SNAPPY_INPUT_MARGIN        15
+
+#define SNAPPY_TAG_LITERAL         0x00
+#define SNAPPY_TAG_COPY_1          0x01
+#define SNAPPY_TAG_COPY_2          0x02
+#define SNAPPY_TAG_COPY_4          0x03
+
+static inline uint32_t load32(const uint8_t *pointer)
+{
+    uint32_t value;
+
+    memcpy(&value, pointer, sizeof(uint32_t));
+
+    return value;
+}
+
+static inline uint32_t hash_bytes(const uint8_t *pointer, int shift)
+{
+    return (load32(pointer) * 0x1e35a7bd) >> shift;
+}
+
+static inline uint8_t *emit_literal(uint8_t *output,
+                                    const uint8_t *literal, size_t length)
+{
+    size_t n;
+    int    count;
+
+    n = length - 1;
+
+    if (n < 60) {
+        *output++ = SNAPPY_TAG_LITERAL | (uint8_t) (n << 2);
+    }
+    else {
+        /* 60 to 63 mean the length follows in 1 to 4 little endian bytes */
+        count = 0;
+        while ((n >> (count * 8)) > 0 && count < 4) {
+            output[count + 1] = (uint8_t) (n >> (count * 8));
+            count++;
+        }
+
+        *output = SNAPPY_TAG_LITERAL | (uint8_t) ((59 + count) << 2);
+        output += count + 1;
+    }
+
+    memcpy(output, literal, length);
+
+    return output + length;
+}
+
+static inline uint8_t *emit_copy_upto_64(uint8_t *output,
+                                         size_t offset, size_t length)
+{
+    if (length < 12 && offset < 2048) {
+        *output++ = SNAPPY_TAG_COPY_1 |
+                    (uint8_t) ((length - 4) << 2) |
+                    (uint8_t) ((offset >> 8) << 5);
+        *output++ = (uint8_t) offset;
+    }
+    else {
+        *output++ = SNAPPY_TAG_COPY_2 | (uint8_t) ((length - 1) << 2);
+        *output++ = (uint8_t) offset;
+        *output++ = (uint8_t) (offset >> 8);
+    }
+
+    return output;
+}
+
+static inline uint8_t *emit_copy(uint8_t *output, size_t offset, size_t length)
+{
+    /* a single copy can hold up to 64 bytes, never leave less than 4 */
+    while (length >= 68) {
+        output = emit_copy_upto_64(output, offset, 64);
+        length -= 64;
+    }
+
+    if (length > 64) {
+        output = emit_copy_upto_64(output, offset, 60);
+        length -= 60;
+    }
+
+    return emit_copy_upto_64(output, offset, length);
+}
+
+static inline size_t match_length(const uint8_t *s1,
+                                  const uint8_t *s2,
+                                  const uint8_t *s2_limit)
+{
+    size_t matched;
+
+    matched = 0;
+
+    while (s2 + 8 <= s2_limit) {
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&a, s1 + matched, sizeof(uint64_t));
+        memcpy(&b, s2, sizeof(uint64_t));
+
+        if (a != b) {
+            break;
+        }
+
+        s2 += 8;
+        matched += 8;
+    }
+
+    while (s2 < s2_limit && s1[matched] == *s2) {
+        s2++;
+        matched++;
+    }
+
+    return matched;
+}
+
+static uint8_t *compress_block(const uint8_t *input, size_t input_size,
+                               uint8_t *output,
+                               uint16_t *table, int table_bits)
+{
+    int            shift;
+    uint32_t       skip;
+    uint32_t       hash;
+    uint32_t       next_hash;
+    size_t         matched;
+    const uint8_t *ip;
+    const uint8_t *ip_end;
+    const uint8_t *ip_limit;
+    const uint8_t *next_ip;
+    const uint8_t *next_emit;
+    const uint8_t *candidate;
+    const uint8_t *base;
+
+    memset(table, 0, sizeof(uint16_t) << table_bits);
+
+    shift = 32 - table_bits;
+    ip = input;
+    ip_end = input + input_size;
+    next_emit = input;
+
+    if (input_size < SNAPPY_INPUT_MARGIN) {
+        goto emit_remainder;
+    }
+
+    ip_limit = input + input_size - SNAPPY_INPUT_MARGIN;
+    next_hash = hash_bytes(++ip, shift);
+
+    for (;;) {
+        /*
+         * Look for a 4 byte match, the distance between probes grows the
+         * longer no match is found so incompressible data is skipped fast.
+         */
+        skip = 32;
+        next_ip = ip;
+
+        do {
+            ip = next_ip;
+            hash = next_hash;
+            next_ip = ip + (skip >> 5);
+            skip++;
+
+            if (next_ip > ip_limit) {
+                goto emit_remainder;
+            }
+
+            next_hash = hash_bytes(next_ip, shift);
+            candidate = input + table[hash];
+            table[hash] = (uint16_t) (ip - input);
+        } while (load32(ip) != load32(candidate));
+
+        output = emit_literal(output, next_emit, ip - next_emit);
+
+        /* emit copies as long as the next position keeps matching */
+        do {
+            base = ip;
+            matched = 4 + match_length(candidate + 4, ip + 4, ip_end);
+            ip += matched;
+
+            output = emit_copy(output, base - candidate, matched);
+            next_emit = ip;
+
+            if (ip >= ip_limit) {
+                goto emit_remainder;
+            }
+
+            table[hash_bytes(ip - 1, shift)] = (uint16_t) (ip - input - 1);
+
+            hash = hash_bytes(ip, shift);
+            candidate = input + table[hash];
+            table[hash] = (uint16_t) (ip - input);
+        } while (load32(ip) == load32(candidate));
+
+        next_hash = hash_bytes(++ip, shift);
+    }
+
+emit_remainder:
+    if (next_emit < ip_end) {
+        output = emit_literal(output, next_emit, ip_end - next_emit);
+    }
+
+    return output;
+}
+
+size_t cmt_snappy_max_compressed_length(size_t length)
+{
+    return 32 + length + length / 6;
+}
+
+int cmt_snappy_compress(const char *input, size_t input_length,
+                        char *output, size_t output_capacity,
+                        size_t *output_length)
+{
+    int       table_bits;
+    size_t    block_size;
+    size_t    remaining;
+    uint8_t  *op;
+    uint16_t  table[SNAPPY_MAX_HASH_TABLE_SIZE];
+    uint64_t  preamble;
+
+    if ((input == NULL && input_length > 0) ||
+        output == NULL ||
+        output_length == NULL ||
+        input_length > UINT32_MAX) {
+        return CMT_SNAPPY_INVALID_ARGUMENT_ERROR;
+    }
+
+    if (output_capacity < cmt_snappy_max_compressed_length(input_length)) {
+        return CMT_SNAPPY_BUFFER_TOO_SMALL_ERROR;
+    }
+
+    op = (uint8_t *) output;
+
+    /* preamble: uncompressed length as a varint */
+    preamble = input_length;
+    while (preamble >= 0x80) {
+        *op++ = (uint8_t) (preamble | 0x80);
+        preamble >>= 7;
+    }
+    *op++ = (uint8_t) preamble;
+
+    remaining = input_length;
+
+    while (remaining > 0) {
+        block_size = remaining;
+        if (block_size > SNAPPY_BLOCK_SIZE) {
+            block_size = SNAPPY_BLOCK_SIZE;
+        }
+
+        /* size the hash table to the block, clearing it is not free */
+        table_bits = 8;
+        while (table_bits < SNAPPY_MAX_HASH_TABLE_BITS &&
+               ((size_t) 1 << table_bits) < block_size) {
+            table_bits++;
+        }
+
+        op = compress_block((const uint8_t *) input, block_size, op,
+                            table, table_bits);
+
+        input += block_size;
+        remaining -= block_size;
+    }
+
+    *output_length = op - (uint8_t *) output;
+
+    return CMT_SNAPPY_SUCCESS;
+}
+
+static int read_preamble(const uint8_t *input, size_t input_length,
+                         size_t *result, size_t *preamble_length)
+{
+    int      shift;
+    size_t   index;
+    uint64_t value;
+
+    value = 0;
+    shift = 0;
+
+    for (index = 0 ; index < input_length && index < 5 ; index++) {
+        value |= (uint64_t) (input[index] & 0x7f) << shift;
+
+        if ((input[index] & 0x80) == 0) {
+            if (value > UINT32_MAX) {
+                return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+            }
+
+            *result = (size_t) value;
+            *preamble_length = index + 1;
+
+            return CMT_SNAPPY_SUCCESS;
+        }
+
+        shift += 7;
+    }
+
+    return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+}
+
+int cmt_snappy_uncompressed_length(const char *input, size_t input_length,
+                                   size_t *result)
+{
+    size_t preamble_length;
+
+    if (input == NULL || result == NULL) {
+        return CMT_SNAPPY_INVALID_ARGUMENT_ERROR;
+    }
+
+    return read_preamble((const uint8_t *) input, input_length,
+                         result, &preamble_length);
+}
+
+int cmt_snappy_uncompress(const char *input, size_t input_length,
+                          char *output, size_t output_capacity,
+                          size_t *output_length)
+{
+    int            result;
+    size_t         index;
+    size_t         length;
+    size_t         offset;
+    size_t         extra;
+    size_t         expected_length;
+    size_t         preamble_length;
+    uint8_t        tag;
+    uint8_t       *op;
+    uint8_t       *op_end;
+    const uint8_t *ip;
+    const uint8_t *ip_end;
+
+    if (input == NULL || output_length == NULL ||
+        (output == NULL && output_capacity > 0)) {
+        return CMT_SNAPPY_INVALID_ARGUMENT_ERROR;
+    }
+
+    ip = (const uint8_t *) input;
+    ip_end = ip + input_length;
+
+    result = read_preamble(ip, input_length, &expected_length, &preamble_length);
+    if (result != CMT_SNAPPY_SUCCESS) {
+        return result;
+    }
+
+    if (expected_length > output_capacity) {
+        return CMT_SNAPPY_BUFFER_TOO_SMALL_ERROR;
+    }
+
+    ip += preamble_length;
+    op = (uint8_t *) output;
+    op_end = op + expected_length;
+
+    while (ip < ip_end) {
+        tag = *ip++;
+
+        if ((tag & 0x03) == SNAPPY_TAG_LITERAL) {
+            length = (tag >> 2) + 1;
+
+            if (length > 60) {
+                extra = length - 60;
+                if ((size_t) (ip_end - ip) < extra) {
+                    return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+                }
+
+                length = 0;
+                for (index = 0 ; index < extra ; index++) {
+                    length |= (size_t) ip[index] << (index * 8);
+                }
+                length++;
+                ip += extra;
+            }
+
+            if ((size_t) (ip_end - ip) < length ||
+                (size_t) (op_end - op) < length) {
+                return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+            }
+
+            memcpy(op, ip, length);
+            op += length;
+            ip += length;
+
+            continue;
+        }
+
+        if ((tag & 0x03) == SNAPPY_TAG_COPY_1) {
+            if (ip >= ip_end) {
+                return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+            }
+
+            length = 4 + ((tag >> 2) & 0x07);
+            offset = ((size_t) (tag >> 5) << 8) | ip[0];
+            ip += 1;
+        }
+        else if ((tag & 0x03) == SNAPPY_TAG_COPY_2) {
+            if ((size_t) (ip_end - ip) < 2) {
+                return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+            }
+
+            length = (tag >> 2) + 1;
+            offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+            ip += 2;
+        }
+        else {
+            if ((size_t) (ip_end - ip) < 4) {
+                return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+            }
+
+            length = (tag >> 2) + 1;
+            offset = (size_t) ip[0] |
+                     ((size_t) ip[1] << 8) |
+                     ((size_t) ip[2] << 16) |
+                     ((size_t) ip[3] << 24);
+            ip += 4;
+        }
+
+        if (offset == 0 ||
+            offset > (size_t) (op - (uint8_t *) output) ||
+            (size_t) (op_end - op) < length) {
+            return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+        }
+
+        if (offset >= length) {
+            memcpy(op, op - offset, length);
+            op += length;
+        }
+        else {
+            /* overlapping copies repeat the pattern, copy byte by byte */
+            for (index = 0 ; index < length ; index++) {
+                *op = *(op - offset);
+                op++;
+            }
+        }
+    }
+
+    if (op != op_end) {
+        return CMT_SNAPPY_CORRUPTED_INPUT_ERROR;
+    }
+
+    *output_length = expected_length;
+
+    return CMT_SNAPPY_SUCCESS;
+}
@@ -786,6 +786,223 @@ void test_summary_concatenation_rejects_mismatched_label_schema()
     cmt_destroy(dst);
 }
 
+static struct cmt *create_move_source(int round)
+{
+    int                           i;
+    uint64_t                      ts;
+    double                        quantiles[] = {0.5, 0.9};
+    double                        values[] = {1.0, 2.0};
+    struct cmt                   *cmt;
+    struct cmt_counter           *c;
+    struct cmt_gauge             *g;
+    struct cmt_histogram         *h;
+    struct cmt_histogram_buckets *buckets;
+    struct cmt_summary           *s;
+
+    ts = 1000 + round;
+
+    cmt = cmt_create();
+    TEST_ASSERT(cmt != NULL);
+
+    c = cmt_counter_create(cmt, "cmetrics", "test", "move_counter", "counter",
+                           1, (char *[]) {"kind"});
+    TEST_ASSERT(c != NULL);
+    cmt_counter_set(c, ts, 10 + round, 1, (char *[]) {"shared"});
+    cmt_counter_set(c, ts, 20 + round, 1, (char *[]) {round ? "second" : "first"});
+    cmt_counter_set(c, ts, 30 + round, 0, NULL);
+
+    if (round == 1) {
+        g = cmt_gauge_create(cmt, "cmetrics", "test", "move_gauge", "gauge",
+                             0, NULL);
+        TEST_ASSERT(g != NULL);
+        cmt_gauge_set(g, ts, 5, 0, NULL);
+    }
+
+    buckets = cmt_histogram_buckets_create(3, 1.0, 5.0, 10.0);
+    TEST_ASSERT(buckets != NULL);
+    h = cmt_histogram_create(cmt, "cmetrics", "test", "move_histogram", "histogram",
+                             buckets, 1, (char *[]) {"kind"});
+    TEST_ASSERT(h != NULL);
+    for (i = 0; i < 10; i++) {
+        cmt_histogram_observe(h, ts, hist_observe_values[i], 1, (char *[]) {"shared"});
+    }
+
+    s = cmt_summary_create(cmt, "cmetrics", "test", "move_summary", "summary",
+                           2, quantiles, 1, (char *[]) {"kind"});
+    TEST_ASSERT(s != NULL);
+    cmt_summary_set_default(s, ts, values, 3.0 + round, 2 + round,
+                            1, (char *[]) {"shared"});
+
+    return cmt;
+}
+
+void test_cat_move()
+{
+    int                   ret;
+    int                   round;
+    double                value;
+    cfl_sds_t             copied_text;
+    cfl_sds_t             moved_text;
+    struct cmt           *src;
+    struct cmt           *copied;
+    struct cmt           *moved;
+    struct cmt           *mismatched;
+    struct cmt_counter   *counter;
+    struct cmt_histogram *histogram;
+
+    copied = cmt_create();
+    moved = cmt_create();
+    TEST_ASSERT(copied != NULL);
+    TEST_ASSERT(moved != NULL);
+
+    for (round = 0; round < 2; round++) {
+        src = create_move_source(round);
+        ret = cmt_cat(copied, src);
+        TEST_CHECK(ret == 0);
+        cmt_destroy(src);
+
+        src = create_move_source(round);
+        ret = cmt_cat_move(moved, src);
+        TEST_CHECK(ret == 0);
+
+        /* families missing from the destination were moved, not copied */
+        if (round == 0) {
+            TEST_CHECK(cfl_list_is_empty(&src->counters));
+            TEST_CHECK(cfl_list_is_empty(&src->histograms));
+        }
+        else {
+            TEST_CHECK(cfl_list_is_empty(&src->gauges));
+            TEST_CHECK(cfl_list_size(&src->counters) == 1);
+        }
+        cmt_destroy(src);
+    }
+
+    copied_text = cmt_encode_text_create(copied);
+    moved_text = cmt_encode_text_create(moved);
+    TEST_ASSERT(copied_text != NULL);
+    TEST_ASSERT(moved_text != NULL);
+    TEST_CHECK(strcmp(copied_text, moved_text) == 0);
+    cmt_encode_text_destroy(copied_text);
+    cmt_encode_text_destroy(moved_text);
+
+    /* moved series stay reachable through the destination lookups */
+    counter = cfl_list_entry_first(&moved->counters, struct cmt_counter, _head);
+    TEST_CHECK(counter->cmt == moved);
+    TEST_CHECK(cfl_list_size(&counter->map->metrics) == 3);
+
+    ret = cmt_counter_get_val(counter, 1, (char *[]) {"second"}, &value);
+    TEST_CHECK(ret == 0 && value == 21);
+    ret = cmt_counter_get_val(counter, 1, (char *[]) {"shared"}, &value);
+    TEST_CHECK(ret == 0 && value == 11);
+
+    cmt_counter_set(counter, 2000, 40, 1, (char *[]) {"second"});
+    TEST_CHECK(cfl_list_size(&counter->map->metrics) == 3);
+
+    /* histograms with a different bucket layout are rejected */
+    mismatched = cmt_create();
+    TEST_ASSERT(mismatched != NULL);
+    histogram = cmt_histogram_create(mismatched, "cmetrics", "test", "move_histogram",
+                                     "histogram",
+                                     cmt_histogram_buckets_create(2, 1.0, 5.0),
+                                     1, (char *[]) {"kind"});
+    TEST_ASSERT(histogram != NULL);
+    cmt_histogram_observe(histogram, 3000, 1.0, 1, (char *[]) {"shared"});
+
+    ret = cmt_cat_move(moved, mismatched);
+    TEST_CHECK(ret == -1);
+
+    cmt_destroy(mismatched);
+    cmt_destroy(moved);
+    cmt_destroy(copied);
+}
+
+void test_cat_move_label_keys()
+{
+    int                   ret;
+    double                value;
+    cfl_sds_t             before;
+    cfl_sds_t             after;
+    struct cmt           *dst;
+    struct cmt           *src;
+    struct cmt_counter   *c;
+    struct cmt_counter   *tagged;
+    struct cmt_counter   *untagged;
+    struct cmt_histogram *h;
+
+    dst = cmt_create();
+    TEST_ASSERT(dst != NULL);
+
+    c = cmt_counter_create(dst, "", "", "req", "counter", 0, NULL);
+    TEST_ASSERT(c != NULL);
+    cmt_counter_set(c, 1000, 1, 0, NULL);
+
+    h = cmt_histogram_create(dst, "", "", "latency", "histogram",
+                             cmt_histogram_buckets_create(3, 1.0, 5.0, 10.0),
+                             0, NULL);
+    TEST_ASSERT(h != NULL);
+    cmt_histogram_observe(h, 1000, 2.0, 0, NULL);
+
+    /* a family that cannot be merged rejects the whole move */
+    src = cmt_create();
+    TEST_ASSERT(src != NULL);
+
+    c = cmt_counter_create(src, "", "", "hits", "counter", 0, NULL);
+    TEST_ASSERT(c != NULL);
+    cmt_counter_set(c, 2000, 1, 0, NULL);
+
+    h = cmt_histogram_create(src, "", "", "latency", "histogram",
+                             cmt_histogram_buckets_create(2, 1.0, 5.0),
+                             0, NULL);
+    TEST_ASSERT(h != NULL);
+    cmt_histogram_observe(h, 2000, 2.0, 0, NULL);
+
+    before = cmt_encode_text_create(dst);
+    TEST_ASSERT(before != NULL);
+
+    ret = cmt_cat_move(dst, src);
+    TEST_CHECK(ret == -1);
+    TEST_CHECK(cfl_list_size(&src->counters) == 1);
+    TEST_CHECK(cfl_list_size(&dst->counters) == 1);
+
+    after = cmt_encode_text_create(dst);
+    TEST_ASSERT(after != NULL);
+    TEST_CHECK(strcmp(before, after) == 0);
+    cmt_encode_text_destroy(before);
+    cmt_encode_text_destroy(after);
+    cmt_destroy(src);
+
+    /* same name, different label keys: each set lands in its own family */
+    src = cmt_create();
+    TEST_ASSERT(src != NULL);
+
+    c = cmt_counter_create(src, "", "", "req", "counter", 1, (char *[]) {"code"});
+    TEST_ASSERT(c != NULL);
+    cmt_counter_set(c, 2000, 1, 1, (char *[]) {"200"});
+
+    c = cmt_counter_create(src, "", "", "req", "counter", 0, NULL);
+    TEST_ASSERT(c != NULL);
+    cmt_counter_set(c, 2000, 2, 0, NULL);
+
+    ret = cmt_cat_move(dst, src);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(cfl_list_size(&src->counters) == 1);
+    TEST_CHECK(cfl_list_size(&dst->counters) == 2);
+    cmt_destroy(src);
+
+    untagged = cfl_list_entry_first(&dst->counters, struct cmt_counter, _head);
+    tagged = cfl_list_entry_last(&dst->counters, struct cmt_counter, _head);
+    TEST_CHECK(untagged->map->label_count == 0);
+    TEST_CHECK(tagged->map->label_count == 1);
+    TEST_CHECK(tagged->cmt == dst);
+
+    ret = cmt_counter_get_val(untagged, 0, NULL, &value);
+    TEST_CHECK(ret == 0 && value == 2);
+    ret = cmt_counter_get_val(tagged, 1, (char *[]) {"200"}, &value);
+    TEST_CHECK(ret == 0 && value == 1);
+
+    cmt_destroy(dst);
+}
+
 TEST_LIST = {
     {"cat", test_cat},
     {"duplicate_metrics", test_duplicate_metrics},
@@ -797,5 +1014,7 @@ TEST_LIST = {
     {"summary_concatenation_preserves_series", test_summary_concatenation_preserves_series},
     {"summary_concatenation_rejects_mismatched_label_schema",
      test_summary_concatenation_rejects_mismatched_label_schema},
+    {"cat_move", test_cat_move},
+    {"cat_move_label_keys", test_cat_move_label_keys},
     { 0 }
 };
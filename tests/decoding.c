@@ -21,12 +21,22 @@
 #include <cmetrics/cmt_counter.h>
 #include <cmetrics/cmt_gauge.h>
 #include <cmetrics/cmt_histogram.h>
+#include <cmetrics/cmt_exp_histogram.h>
 #include <cmetrics/cmt_map.h>
 #include <cmetrics/cmt_metric.h>
+#include <cmetrics/cmt_math.h>
 #include <cmetrics/cmt_encode_prometheus.h>
 #include <cmetrics/cmt_encode_prometheus_remote_write.h>
 #include <cmetrics/cmt_decode_prometheus_remote_write.h>
 #include <cmetrics/cmt_decode_statsd.h>
+#include <cmetrics/cmt_encode_influx.h>
+#include <cmetrics/cmt_decode_influx.h>
+#include <cmetrics/cmt_encode_graphite.h>
+#include <cmetrics/cmt_decode_graphite.h>
+#include <cmetrics/cmt_cat.h>
+#include <cmetrics/cmt_snappy.h>
+
+#include <math.h>
 
 #include "cmt_tests.h"
 
@@ -160,6 +170,86 @@ static cfl_sds_t generate_remote_write_out_of_order_metadata_payload()
     return payload;
 }
 
+/*
+ * Three series of the same counter, two of them share their label keys and
+ * one repeats a label set, plus a metadata entry for every series.
+ */
+static cfl_sds_t generate_remote_write_grouping_payload()
+{
+    int index;
+    Prometheus__WriteRequest request;
+    Prometheus__MetricMetadata metadata;
+    Prometheus__TimeSeries series[4];
+    Prometheus__Label name_label;
+    Prometheus__Label method_labels[4];
+    Prometheus__Label code_label;
+    Prometheus__Sample samples[4];
+    Prometheus__MetricMetadata *metadata_list[4];
+    Prometheus__TimeSeries *time_series_list[4];
+    Prometheus__Label *label_lists[4][3];
+    Prometheus__Sample *sample_lists[4][1];
+    char *methods[] = {"GET", "POST", "GET", "GET"};
+    size_t payload_size;
+    unsigned char *packed_payload;
+    cfl_sds_t payload;
+
+    prometheus__write_request__init(&request);
+    prometheus__metric_metadata__init(&metadata);
+    prometheus__label__init(&name_label);
+    prometheus__label__init(&code_label);
+
+    metadata.type = PROMETHEUS__METRIC_METADATA__METRIC_TYPE__COUNTER;
+    metadata.metric_family_name = "rw_requests";
+    metadata.help = "remote write requests";
+
+    name_label.name = "__name__";
+    name_label.value = "rw_requests";
+    code_label.name = "code";
+    code_label.value = "200";
+
+    for (index = 0; index < 4; index++) {
+        prometheus__time_series__init(&series[index]);
+        prometheus__label__init(&method_labels[index]);
+        prometheus__sample__init(&samples[index]);
+
+        method_labels[index].name = "method";
+        method_labels[index].value = methods[index];
+
+        /* labels are not sorted by name on purpose */
+        label_lists[index][0] = &method_labels[index];
+        label_lists[index][1] = &name_label;
+        label_lists[index][2] = &code_label;
+        series[index].labels = label_lists[index];
+        series[index].n_labels = index < 3 ? 2 : 3;
+
+        samples[index].value = index + 1;
+        samples[index].timestamp = 123 + index;
+        sample_lists[index][0] = &samples[index];
+        series[index].samples = sample_lists[index];
+        series[index].n_samples = 1;
+
+        metadata_list[index] = &metadata;
+        time_series_list[index] = &series[index];
+    }
+
+    request.n_metadata = 4;
+    request.metadata = metadata_list;
+    request.n_timeseries = 4;
+    request.timeseries = time_series_list;
+
+    payload_size = prometheus__write_request__get_packed_size(&request);
+    packed_payload = calloc(1, payload_size);
+    if (packed_payload == NULL) {
+        return NULL;
+    }
+
+    prometheus__write_request__pack(&request, packed_payload);
+    payload = cfl_sds_create_len((char *) packed_payload, payload_size);
+    free(packed_payload);
+
+    return payload;
+}
+
 static cfl_sds_t generate_remote_write_sparse_metadata_histogram_payload()
 {
     Prometheus__WriteRequest request;
@@ -330,7 +420,7 @@ void test_prometheus_remote_write_sparse_metadata_histogram()
 {
     int ret;
     struct cmt_metric *metric;
-    struct cmt_histogram *histogram;
+    struct cmt_exp_histogram *exp_histogram;
     struct cmt *decoded_context = NULL;
     cfl_sds_t payload;
 
@@ -345,32 +435,32 @@ void test_prometheus_remote_write_sparse_metadata_histogram()
         TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
         if (ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
             TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 1);
-            TEST_CHECK(cfl_list_size(&decoded_context->histograms) == 1);
-
-            histogram = cfl_list_entry_first(&decoded_context->histograms,
-                                             struct cmt_histogram, _head);
-            TEST_CHECK(histogram != NULL);
-            if (histogram != NULL) {
-                TEST_CHECK(histogram->buckets != NULL);
-                if (histogram->buckets != NULL) {
-                    TEST_CHECK(histogram->buckets->count == 3);
-                    TEST_CHECK(histogram->buckets->upper_bounds[0] == 1.0);
-                    TEST_CHECK(histogram->buckets->upper_bounds[1] == 2.0);
-                    TEST_CHECK(histogram->buckets->upper_bounds[2] == 3.0);
-                }
-
-                TEST_CHECK(cfl_list_size(&histogram->map->metrics) == 1);
-                metric = cfl_list_entry_first(&histogram->map->metrics,
+            TEST_CHECK(cfl_list_size(&decoded_context->histograms) == 0);
+            TEST_CHECK(cfl_list_size(&decoded_context->exp_histograms) == 1);
+
+            exp_histogram = cfl_list_entry_first(&decoded_context->exp_histograms,
+                                                 struct cmt_exp_histogram, _head);
+            TEST_CHECK(exp_histogram != NULL);
+            if (exp_histogram != NULL) {
+                TEST_CHECK(cfl_list_size(&exp_histogram->map->metrics) == 1);
+                metric = cfl_list_entry_first(&exp_histogram->map->metrics,
                                               struct cmt_metric, _head);
                 TEST_CHECK(metric != NULL);
                 if (metric != NULL) {
-                    TEST_CHECK(metric->hist_buckets != NULL);
-                    if (metric->hist_buckets != NULL) {
-                        TEST_CHECK(cmt_metric_hist_get_value(metric, 0) == 1);
-                        TEST_CHECK(cmt_metric_hist_get_value(metric, 1) == 2);
-                        TEST_CHECK(cmt_metric_hist_get_value(metric, 2) == 3);
+                    /* native bucket 1 is the exponential bucket 0 */
+                    TEST_CHECK(metric->exp_hist_scale == 0);
+                    TEST_CHECK(metric->exp_hist_positive_offset == 0);
+                    TEST_CHECK(metric->exp_hist_positive_count == 3);
+                    TEST_CHECK(metric->exp_hist_negative_count == 0);
+                    TEST_CHECK(metric->exp_hist_positive_buckets != NULL);
+                    if (metric->exp_hist_positive_buckets != NULL) {
+                        TEST_CHECK(metric->exp_hist_positive_buckets[0] == 1);
+                        TEST_CHECK(metric->exp_hist_positive_buckets[1] == 2);
+                        TEST_CHECK(metric->exp_hist_positive_buckets[2] == 3);
                     }
-                    TEST_CHECK(cmt_metric_hist_get_count_value(metric) == 6);
+                    TEST_CHECK(metric->exp_hist_count == 6);
+                    TEST_CHECK(cmt_math_uint64_to_d64(metric->exp_hist_sum) == 6.0);
+                    TEST_CHECK(cmt_metric_get_timestamp(metric) == 456000000);
                 }
             }
         }
@@ -424,6 +514,285 @@ void test_prometheus_remote_write_metadata_matched_by_name()
     }
 }
 
+void test_prometheus_remote_write_series_grouping()
+{
+    int ret;
+    int round;
+    double value;
+    struct cmt *decoded_context = NULL;
+    struct cmt *merged;
+    struct cmt_counter *counter;
+    cfl_sds_t payload;
+
+    cmt_initialize();
+
+    payload = generate_remote_write_grouping_payload();
+    TEST_CHECK(payload != NULL);
+    if (payload == NULL) {
+        return;
+    }
+
+    ret = cmt_decode_prometheus_remote_write_create(&decoded_context,
+                                                    payload,
+                                                    cfl_sds_len(payload));
+    TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+    if (ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        /* one family per label key set */
+        TEST_CHECK(cfl_list_size(&decoded_context->counters) == 2);
+
+        counter = cfl_list_entry_first(&decoded_context->counters,
+                                       struct cmt_counter, _head);
+        TEST_CHECK(strcmp(counter->opts.name, "rw_requests") == 0);
+        TEST_CHECK(strcmp(counter->opts.description,
+                          "remote write requests") == 0);
+        TEST_CHECK(counter->map->label_count == 2);
+        TEST_CHECK(cfl_list_size(&counter->map->metrics) == 2);
+
+        /* the repeated label set keeps its last sample */
+        ret = cmt_counter_get_val(counter, 2,
+                                  (char *[]) {"rw_requests", "GET"}, &value);
+        TEST_CHECK(ret == 0 && value == 3);
+
+        counter = cfl_list_entry_last(&decoded_context->counters,
+                                      struct cmt_counter, _head);
+        TEST_CHECK(counter->map->label_count == 3);
+        TEST_CHECK(cfl_list_size(&counter->map->metrics) == 1);
+
+        cmt_decode_prometheus_remote_write_destroy(decoded_context);
+    }
+
+    /* merging keeps the families apart, again on a second request */
+    merged = cmt_create();
+    TEST_ASSERT(merged != NULL);
+
+    for (round = 0; round < 2; round++) {
+        ret = cmt_decode_prometheus_remote_write_merge(merged, payload,
+                                                       cfl_sds_len(payload));
+        TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+        TEST_CHECK(cfl_list_size(&merged->counters) == 2);
+
+        counter = cfl_list_entry_first(&merged->counters,
+                                       struct cmt_counter, _head);
+        TEST_CHECK(counter->map->label_count == 2);
+        TEST_CHECK(cfl_list_size(&counter->map->metrics) == 2);
+
+        counter = cfl_list_entry_last(&merged->counters,
+                                      struct cmt_counter, _head);
+        TEST_CHECK(counter->map->label_count == 3);
+        TEST_CHECK(cfl_list_size(&counter->map->metrics) == 1);
+    }
+
+    cmt_destroy(merged);
+    cfl_sds_destroy(payload);
+}
+
+void test_prometheus_remote_write_truncated()
+{
+    int ret;
+    size_t size;
+    struct cmt *decoded_context;
+    cfl_sds_t payload;
+
+    cmt_initialize();
+
+    payload = read_file(CMT_TESTS_DATA_PATH "/remote_write_dump_originally_from_node_exporter.bin");
+    TEST_CHECK(payload != NULL);
+    if (payload == NULL) {
+        return;
+    }
+
+    /* every cut either fails to unpack or decodes a shorter request */
+    for (size = 0 ; size < cfl_sds_len(payload) ; size += 97) {
+        decoded_context = NULL;
+        ret = cmt_decode_prometheus_remote_write_create(&decoded_context,
+                                                        payload, size);
+        if (ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            TEST_CHECK(decoded_context != NULL);
+            cmt_decode_prometheus_remote_write_destroy(decoded_context);
+        }
+        else {
+            TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_UNPACK_ERROR ||
+                       ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECODE_ERROR);
+        }
+    }
+
+    cfl_sds_destroy(payload);
+}
+
+static void check_snappy_roundtrip(const char *input, size_t input_length)
+{
+    int ret;
+    char *compressed;
+    char *uncompressed;
+    size_t compressed_length;
+    size_t uncompressed_length;
+    size_t capacity;
+
+    capacity = cmt_snappy_max_compressed_length(input_length);
+    compressed = malloc(capacity);
+    uncompressed = malloc(input_length + 1);
+    TEST_CHECK(compressed != NULL && uncompressed != NULL);
+    if (compressed == NULL || uncompressed == NULL) {
+        free(compressed);
+        free(uncompressed);
+        return;
+    }
+
+    ret = cmt_snappy_compress(input, input_length, compressed, capacity,
+                              &compressed_length);
+    TEST_CHECK(ret == CMT_SNAPPY_SUCCESS);
+
+    ret = cmt_snappy_uncompressed_length(compressed, compressed_length,
+                                         &uncompressed_length);
+    TEST_CHECK(ret == CMT_SNAPPY_SUCCESS);
+    TEST_CHECK(uncompressed_length == input_length);
+
+    ret = cmt_snappy_uncompress(compressed, compressed_length,
+                                uncompressed, input_length,
+                                &uncompressed_length);
+    TEST_CHECK(ret == CMT_SNAPPY_SUCCESS);
+    TEST_CHECK(uncompressed_length == input_length);
+    TEST_CHECK(memcmp(input, uncompressed, input_length) == 0);
+
+    /* a truncated block must be rejected */
+    if (compressed_length > 1) {
+        ret = cmt_snappy_uncompress(compressed, compressed_length - 1,
+                                    uncompressed, input_length,
+                                    &uncompressed_length);
+        TEST_CHECK(ret == CMT_SNAPPY_CORRUPTED_INPUT_ERROR);
+    }
+
+    free(compressed);
+    free(uncompressed);
+}
+
+void test_snappy()
+{
+    size_t index;
+    size_t length;
+    char *input;
+    uint32_t seed;
+    char compressed[64];
+    size_t compressed_length;
+    /* 'a' literal followed by an overlapping copy of length 8, offset 1 */
+    const char block[] = {0x09, 0x00, 'a', 0x11, 0x01};
+    const char pattern[] = "metric_name{label=\"value\"} 1\n";
+    char output[9];
+
+    length = 300000;
+    input = malloc(length);
+    TEST_CHECK(input != NULL);
+    if (input == NULL) {
+        return;
+    }
+
+    check_snappy_roundtrip("", 0);
+    check_snappy_roundtrip("a", 1);
+    check_snappy_roundtrip("cmetrics cmetrics cmetrics cmetrics", 35);
+
+    /* repetitive text spanning several blocks */
+    for (index = 0; index < length; index++) {
+        input[index] = pattern[index % (sizeof(pattern) - 1)];
+    }
+    check_snappy_roundtrip(input, length);
+
+    /* incompressible data */
+    seed = 42;
+    for (index = 0; index < length; index++) {
+        seed = seed * 1103515245 + 12345;
+        input[index] = (char) (seed >> 16);
+    }
+    check_snappy_roundtrip(input, length);
+
+    free(input);
+
+    TEST_CHECK(cmt_snappy_compress("a", 1, compressed, sizeof(compressed),
+                                   &compressed_length) == CMT_SNAPPY_SUCCESS);
+    TEST_CHECK(compressed_length == 3);
+    TEST_CHECK(memcmp(compressed, "\x01\x00" "a", 3) == 0);
+
+    TEST_CHECK(cmt_snappy_uncompress(block, sizeof(block), output,
+                                     sizeof(output), &length) == CMT_SNAPPY_SUCCESS);
+    TEST_CHECK(length == 9);
+    TEST_CHECK(memcmp(output, "aaaaaaaaa", 9) == 0);
+}
+
+void test_prometheus_remote_write_compressed()
+{
+    int ret;
+    size_t index;
+    uint64_t ts;
+    char label[32];
+    cfl_sds_t payload;
+    cfl_sds_t compressed;
+    cfl_sds_t buffer = NULL;
+    cfl_sds_t expected_text;
+    cfl_sds_t text;
+    struct cmt *cmt;
+    struct cmt_counter *counter;
+    struct cmt *decoded_context = NULL;
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    counter = cmt_counter_create(cmt, "cmt", "remote_write", "requests",
+                                 "compressed payload", 2,
+                                 (char *[]) {"host", "path"});
+    TEST_CHECK(counter != NULL);
+
+    ts = cfl_time_now();
+    for (index = 0; index < 200; index++) {
+        snprintf(label, sizeof(label), "/api/v1/endpoint/%zu", index);
+        cmt_counter_set(counter, ts, index, 2, (char *[]) {"localhost", label});
+    }
+
+    payload = cmt_encode_prometheus_remote_write_create(cmt);
+    compressed = cmt_encode_prometheus_remote_write_create_compressed(cmt);
+    TEST_CHECK(payload != NULL && compressed != NULL);
+    TEST_CHECK(cfl_sds_len(compressed) < cfl_sds_len(payload) / 2);
+
+    ret = cmt_decode_prometheus_remote_write_create(&decoded_context, payload,
+                                                    cfl_sds_len(payload));
+    TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+    expected_text = cmt_encode_prometheus_create(decoded_context, CMT_TRUE);
+    cmt_decode_prometheus_remote_write_destroy(decoded_context);
+
+    /* the decompression buffer is reused across calls */
+    for (index = 0; index < 2; index++) {
+        ret = cmt_decode_prometheus_remote_write_create_compressed(&decoded_context,
+                                                                   compressed,
+                                                                   cfl_sds_len(compressed),
+                                                                   &buffer);
+        TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+        TEST_CHECK(buffer != NULL);
+
+        if (ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            TEST_CHECK(cfl_sds_len(buffer) == cfl_sds_len(payload));
+            TEST_CHECK(memcmp(buffer, payload, cfl_sds_len(payload)) == 0);
+
+            text = cmt_encode_prometheus_create(decoded_context, CMT_TRUE);
+            TEST_CHECK(strcmp(text, expected_text) == 0);
+            cmt_encode_prometheus_destroy(text);
+            cmt_decode_prometheus_remote_write_destroy(decoded_context);
+        }
+    }
+
+    /* uncompressed input is rejected instead of being misinterpreted */
+    ret = cmt_decode_prometheus_remote_write_create_compressed(&decoded_context,
+                                                               payload,
+                                                               cfl_sds_len(payload),
+                                                               NULL);
+    TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_DECOMPRESSION_ERROR);
+
+    cfl_sds_destroy(buffer);
+    cmt_encode_prometheus_destroy(expected_text);
+    cmt_encode_prometheus_remote_write_destroy(compressed);
+    cmt_encode_prometheus_remote_write_destroy(payload);
+    cmt_destroy(cmt);
+}
+
 void test_statsd()
 {
     int ret;
@@ -454,6 +823,845 @@ void test_statsd()
     cfl_sds_destroy(payload);
 }
 
+/* statsd lines are aggregated per series */
+void test_statsd_aggregation()
+{
+    int         ret;
+    char        payload[] =
+        "api_requests:1|c|#route:/a,method:get\n"
+        "api_requests:1|c|#method:get,route:/a\n"
+        "api_requests:2|c|#route:/b,method:get\n"
+        "api_requests:1|c|@0.1|#method:get,route:/a\n"
+        "temperature:10|g|#room:kitchen\n"
+        "temperature:+5|g|#room:kitchen\n"
+        "temperature:-3|g|#room:kitchen\n"
+        "queue:+4|g\n"
+        "queue:+1|g\n"
+        "enabled:1|g|#env\n";
+    char       *expected =
+        "# HELP api_requests -\n"
+        "# TYPE api_requests counter\n"
+        "api_requests{method=\"get\",route=\"/a\"} 12\n"
+        "api_requests{method=\"get\",route=\"/b\"} 2\n"
+        "# HELP temperature -\n"
+        "# TYPE temperature gauge\n"
+        "temperature{room=\"kitchen\"} 12\n"
+        "# HELP queue -\n"
+        "# TYPE queue gauge\n"
+        "queue{incremental=\"true\"} 5\n"
+        "# HELP enabled -\n"
+        "# TYPE enabled gauge\n"
+        "enabled{env=\"\"} 1\n";
+    cfl_sds_t   text;
+    struct cmt *decoded_context;
+
+    cmt_initialize();
+
+    ret = cmt_decode_statsd_create(&decoded_context, payload, sizeof(payload), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+    if (ret != CMT_DECODE_STATSD_SUCCESS) {
+        return;
+    }
+
+    text = cmt_encode_prometheus_create(decoded_context, CMT_FALSE);
+    TEST_CHECK(text != NULL && strcmp(text, expected) == 0);
+    if (text != NULL) {
+        TEST_MSG("%s", text);
+    }
+
+    cmt_encode_prometheus_destroy(text);
+    cmt_decode_statsd_destroy(decoded_context);
+}
+
+/* lines are scanned in place, within the given size */
+void test_statsd_scanner()
+{
+    int         ret;
+    char        payload[] =
+        "requests:1|c|#route:/a|c:83c0a99c|T1656581400\r\n"
+        "\n"
+        "not a statsd line\r\n"
+        "requests:2|c|@0.5|#route:/a\n"
+        "requests:4|c|@0.25"
+        "|#route:/b";
+    char       *expected =
+        "# HELP requests -\n"
+        "# TYPE requests counter\n"
+        "requests{route=\"/a\"} 5\n"
+        "# HELP requests -\n"
+        "# TYPE requests counter\n"
+        "requests 16\n";
+    cfl_sds_t   text;
+    struct cmt *decoded_context;
+
+    cmt_initialize();
+
+    /* the size cuts the tags of the last line */
+    ret = cmt_decode_statsd_create(&decoded_context, payload,
+                                   strlen(payload) - strlen("|#route:/b"), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+    if (ret == CMT_DECODE_STATSD_SUCCESS) {
+        text = cmt_encode_prometheus_create(decoded_context, CMT_FALSE);
+        TEST_CHECK(text != NULL && strcmp(text, expected) == 0);
+        if (text != NULL) {
+            TEST_MSG("%s", text);
+        }
+
+        cmt_encode_prometheus_destroy(text);
+        cmt_decode_statsd_destroy(decoded_context);
+    }
+
+    ret = cmt_decode_statsd_create(&decoded_context, "requests:one|c\n",
+                                   strlen("requests:one|c\n"), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_DECODE_ERROR);
+
+    ret = cmt_decode_statsd_create(&decoded_context, "requests|c\n",
+                                   strlen("requests|c\n"), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_DECODE_ERROR);
+}
+
+/* merging decoders give the same result as decoding and cmt_cat() */
+/* observations are weighted by their sample rate */
+void test_statsd_histogram()
+{
+    int                           ret;
+    double                        buckets[] = { 10.0, 100.0 };
+    char                          payload[] =
+        "latency:5|ms|#route:/a\n"
+        "latency:50|ms|@0.5|#route:/a\n"
+        "latency:500:7|d|#route:/a\n"
+        "latency:inf|h|#route:/a\n";
+    char                          unnamed[] = ":5|ms\n";
+    char                         *expected =
+        "# HELP latency -\n"
+        "# TYPE latency histogram\n"
+        "latency_bucket{le=\"10.0\",route=\"/a\"} 1\n"
+        "latency_bucket{le=\"100.0\",route=\"/a\"} 3\n"
+        "latency_bucket{le=\"+Inf\",route=\"/a\"} 3\n"
+        "latency_sum{route=\"/a\"} 105\n"
+        "latency_count{route=\"/a\"} 3\n"
+        "# HELP latency -\n"
+        "# TYPE latency histogram\n"
+        "latency_bucket{le=\"10.0\",route=\"/a\"} 1\n"
+        "latency_bucket{le=\"100.0\",route=\"/a\"} 1\n"
+        "latency_bucket{le=\"+Inf\",route=\"/a\"} 2\n"
+        "latency_sum{route=\"/a\"} 507\n"
+        "latency_count{route=\"/a\"} 2\n"
+        "# HELP latency -\n"
+        "# TYPE latency histogram\n"
+        "latency_bucket{le=\"10.0\",route=\"/a\"} 0\n"
+        "latency_bucket{le=\"100.0\",route=\"/a\"} 0\n"
+        "latency_bucket{le=\"+Inf\",route=\"/a\"} 0\n"
+        "latency_sum{route=\"/a\"} 0\n"
+        "latency_count{route=\"/a\"} 0\n";
+    cfl_sds_t                     text;
+    struct cmt                   *decoded_context;
+    struct cmt_decode_statsd_opts opts = {0};
+
+    cmt_initialize();
+
+    opts.buckets = buckets;
+    opts.bucket_count = 2;
+
+    ret = cmt_decode_statsd_create_with_opts(&decoded_context, payload,
+                                             sizeof(payload), &opts);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+    if (ret == CMT_DECODE_STATSD_SUCCESS) {
+        text = cmt_encode_prometheus_create(decoded_context, CMT_FALSE);
+        TEST_CHECK(text != NULL && strcmp(text, expected) == 0);
+        if (text != NULL) {
+            TEST_MSG("%s", text);
+        }
+
+        cmt_encode_prometheus_destroy(text);
+        cmt_decode_statsd_destroy(decoded_context);
+    }
+
+    /* a metric needs a name */
+    ret = cmt_decode_statsd_create_with_opts(&decoded_context, unnamed,
+                                             sizeof(unnamed) - 1, &opts);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_DECODE_ERROR);
+
+    /* bounds must be sorted */
+    buckets[0] = 1000.0;
+    ret = cmt_decode_statsd_create_with_opts(&decoded_context, payload,
+                                             sizeof(payload), &opts);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR);
+}
+
+/* exponential histograms downscale to stay within the bucket limit */
+void test_statsd_exp_histogram()
+{
+    int                           ret;
+    int                           index;
+    uint64_t                      total;
+    size_t                        bucket;
+    cfl_sds_t                     payload;
+    struct cmt                   *decoded_context;
+    struct cmt_map               *map;
+    struct cmt_metric            *metric;
+    struct cmt_exp_histogram     *exp_histogram;
+    struct cmt_decode_statsd_opts opts = {0};
+
+    cmt_initialize();
+
+    payload = cfl_sds_create_size(64 * 1024);
+    TEST_CHECK(payload != NULL);
+    if (payload == NULL) {
+        return;
+    }
+
+    /* values spanning 1e-3 to 1e6, plus zeros and negative values */
+    for (index = 0 ; index < 1000 ; index++) {
+        cfl_sds_printf(&payload, "latency:%g|d\n",
+                       0.001 * pow(1e9, index / 999.0));
+    }
+    cfl_sds_printf(&payload, "latency:0|d\nlatency:-2|d|@0.5\n");
+
+    opts.flags = CMT_DECODE_STATSD_EXP_HISTOGRAM_OBSERVER;
+    opts.exp_histogram_max_buckets = 16;
+
+    ret = cmt_decode_statsd_create_with_opts(&decoded_context, payload,
+                                             cfl_sds_len(payload), &opts);
+    cfl_sds_destroy(payload);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+    if (ret != CMT_DECODE_STATSD_SUCCESS) {
+        return;
+    }
+
+    TEST_CHECK(cfl_list_size(&decoded_context->exp_histograms) == 1);
+    exp_histogram = cfl_list_entry_first(&decoded_context->exp_histograms,
+                                         struct cmt_exp_histogram, _head);
+    map = exp_histogram->map;
+    metric = &map->metric;
+
+    TEST_CHECK(map->metric_static_set == CMT_TRUE);
+    TEST_CHECK(metric->exp_hist_positive_count <= 16);
+    TEST_CHECK(metric->exp_hist_negative_count == 1);
+    TEST_CHECK(metric->exp_hist_scale < CMT_DECODE_STATSD_EXP_HISTOGRAM_MAX_SCALE);
+    TEST_CHECK(metric->exp_hist_zero_count == 1);
+    TEST_CHECK(metric->exp_hist_negative_buckets[0] == 2);
+    TEST_CHECK(metric->exp_hist_count == 1003);
+
+    total = 0;
+    for (bucket = 0 ; bucket < metric->exp_hist_positive_count ; bucket++) {
+        total += metric->exp_hist_positive_buckets[bucket];
+    }
+    TEST_CHECK(total == 1000);
+
+    cmt_decode_statsd_destroy(decoded_context);
+}
+
+static double statsd_set_estimate(struct cmt *cmt)
+{
+    struct cmt_gauge *gauge;
+
+    if (cfl_list_size(&cmt->gauges) != 1) {
+        return -1;
+    }
+
+    gauge = cfl_list_entry_first(&cmt->gauges, struct cmt_gauge, _head);
+
+    return cmt_metric_get_value(&gauge->map->metric);
+}
+
+static cfl_sds_t statsd_set_payload(int first, int last)
+{
+    int       index;
+    cfl_sds_t payload;
+
+    payload = cfl_sds_create_size(32 * (last - first));
+    if (payload == NULL) {
+        return NULL;
+    }
+
+    for (index = first ; index < last ; index++) {
+        cfl_sds_printf(&payload, "users:user-%d|s|@0.5\n", index);
+    }
+
+    return payload;
+}
+
+/* sets count distinct members and merge through cmt_cat() */
+void test_statsd_set()
+{
+    int         ret;
+    double      estimate;
+    char        payload[] =
+        "users:alice|s\n"
+        "users:bob|s\n"
+        "users:alice|s\n";
+    cfl_sds_t   first;
+    cfl_sds_t   second;
+    struct cmt *merged;
+    struct cmt *decoded_context;
+
+    cmt_initialize();
+
+    ret = cmt_decode_statsd_create(&decoded_context, payload, sizeof(payload), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+    if (ret == CMT_DECODE_STATSD_SUCCESS) {
+        TEST_CHECK(statsd_set_estimate(decoded_context) == 2);
+        cmt_decode_statsd_destroy(decoded_context);
+    }
+
+    first = statsd_set_payload(0, 10000);
+    second = statsd_set_payload(5000, 15000);
+    merged = cmt_create();
+    TEST_CHECK(first != NULL && second != NULL && merged != NULL);
+    if (first == NULL || second == NULL || merged == NULL) {
+        return;
+    }
+
+    ret = cmt_decode_statsd_merge(merged, first, cfl_sds_len(first), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+
+    /* the estimate has a standard error of about 1.6% */
+    estimate = statsd_set_estimate(merged);
+    TEST_CHECK(fabs(estimate - 10000) < 500);
+    TEST_MSG("estimate: %f", estimate);
+
+    ret = cmt_decode_statsd_merge(merged, second, cfl_sds_len(second), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+
+    estimate = statsd_set_estimate(merged);
+    TEST_CHECK(fabs(estimate - 15000) < 750);
+    TEST_MSG("estimate: %f", estimate);
+
+    cmt_destroy(merged);
+    cfl_sds_destroy(first);
+    cfl_sds_destroy(second);
+}
+
+/* tagged and untagged lines of one name merge into separate families */
+void test_statsd_merge_mixed_tags()
+{
+    int         i;
+    int         ret;
+    char       *payloads[] = {
+        "req:1|c\nreq:1|c|#code:200\n",
+        "req:1|c|#code:200\nreq:1|c\n"
+    };
+    cfl_sds_t   decoded_text;
+    cfl_sds_t   merged_text;
+    struct cmt *decoded_context;
+    struct cmt *merged;
+
+    cmt_initialize();
+
+    for (i = 0; i < 2; i++) {
+        ret = cmt_decode_statsd_create(&decoded_context, payloads[i],
+                                       strlen(payloads[i]), 0);
+        TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+        if (ret != CMT_DECODE_STATSD_SUCCESS) {
+            return;
+        }
+
+        merged = cmt_create();
+        TEST_ASSERT(merged != NULL);
+
+        ret = cmt_decode_statsd_merge(merged, payloads[i], strlen(payloads[i]), 0);
+        TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+        TEST_CHECK(cfl_list_size(&merged->counters) == 2);
+
+        decoded_text = cmt_encode_prometheus_create(decoded_context, CMT_FALSE);
+        merged_text = cmt_encode_prometheus_create(merged, CMT_FALSE);
+        TEST_CHECK(decoded_text != NULL && merged_text != NULL &&
+                   strcmp(decoded_text, merged_text) == 0);
+        cmt_encode_prometheus_destroy(decoded_text);
+        cmt_encode_prometheus_destroy(merged_text);
+
+        /* a second batch lands on the existing families */
+        ret = cmt_decode_statsd_merge(merged, payloads[1 - i],
+                                      strlen(payloads[1 - i]), 0);
+        TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+        TEST_CHECK(cfl_list_size(&merged->counters) == 2);
+
+        cmt_destroy(merged);
+        cmt_decode_statsd_destroy(decoded_context);
+    }
+}
+
+/* encode_influx -> decode_influx -> encode_influx keeps the payload */
+void test_influx_round_trip()
+{
+    int                           ret;
+    uint64_t                      ts;
+    cfl_sds_t                     first;
+    cfl_sds_t                     second;
+    struct cmt                   *cmt;
+    struct cmt                   *decoded_context;
+    struct cmt_counter           *counter;
+    struct cmt_gauge             *gauge;
+    struct cmt_gauge             *load;
+    struct cmt_decode_influx_rule rules[] = {
+        {"kubernetes", "*_total", CMT_COUNTER}
+    };
+    struct cmt_decode_influx_opts opts = {0};
+
+    cmt_initialize();
+
+    ts = 1700000000123456789;
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    counter = cmt_counter_create(cmt, "kubernetes", "", "requests_total",
+                                 "requests", 2, (char *[]) {"app", "host"});
+    gauge = cmt_gauge_create(cmt, "kubernetes", "", "memory_bytes", "memory",
+                             1, (char *[]) {"host"});
+    load = cmt_gauge_create(cmt, "system", "", "load", "load", 0, NULL);
+    TEST_CHECK(counter != NULL && gauge != NULL && load != NULL);
+
+    cmt_counter_set(counter, ts, 10, 2, (char *[]) {"api", "web 1"});
+    cmt_counter_set(counter, ts, 25, 2, (char *[]) {"db", "web,2"});
+    cmt_gauge_set(gauge, ts, 1048576.5, 1, (char *[]) {"web=1"});
+    cmt_gauge_set(load, ts, 0.25, 0, NULL);
+
+    first = cmt_encode_influx_create(cmt);
+    TEST_CHECK(first != NULL);
+
+    opts.rules = rules;
+    opts.rule_count = 1;
+
+    ret = cmt_decode_influx_create(&decoded_context, first, cfl_sds_len(first),
+                                   &opts);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_SUCCESS);
+    if (ret == CMT_DECODE_INFLUX_SUCCESS) {
+        TEST_CHECK(cfl_list_size(&decoded_context->counters) == 1);
+        TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 2);
+
+        second = cmt_encode_influx_create(decoded_context);
+        TEST_CHECK(second != NULL);
+        TEST_CHECK(strcmp(first, second) == 0);
+        TEST_MSG("expected:\n%s\ngot:\n%s", first, second);
+
+        cmt_encode_influx_destroy(second);
+        cmt_decode_influx_destroy(decoded_context);
+    }
+
+    cmt_encode_influx_destroy(first);
+    cmt_destroy(cmt);
+}
+
+void test_influx_line_protocol()
+{
+    int                           i;
+    int                           ret;
+    double                        value;
+    char                          payload[] =
+        "# comment\n"
+        "cpu,host=a,region=eu usage_idle=90.5,usage_user=9.5 1700000000\n"
+        "cpu,region=eu,host=b usage_idle=80,usage_user=20 1700000000\n"
+        "cpu,host=a,region=eu usage_idle=91.5 1700000010\n"
+        "disk,path=/var\\ log used=12345i,total=99999u,ok=true,"
+        "label=\"a, b=c\" 1700000000\r\n"
+        "\n"
+        "mem free=1e3\n";
+    char                         *mixed[] = {
+        "cpu usage=2 1700000000\ncpu,host=a usage=1 1700000000\n",
+        "cpu,host=a usage=1 1700000000\ncpu usage=2 1700000000\n"
+    };
+    struct cmt                   *decoded_context;
+    struct cmt                   *merged;
+    struct cmt_gauge             *gauge;
+    struct cmt_decode_influx_opts opts = {0};
+    struct cfl_list              *head;
+
+    cmt_initialize();
+
+    opts.precision = CMT_DECODE_INFLUX_PRECISION_SECONDS;
+
+    ret = cmt_decode_influx_create(&decoded_context, payload,
+                                   sizeof(payload) - 1, &opts);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_SUCCESS);
+    if (ret != CMT_DECODE_INFLUX_SUCCESS) {
+        return;
+    }
+
+    /* cpu usage_idle/usage_user, disk used/total/ok and mem free */
+    TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 6);
+    TEST_CHECK(cfl_list_size(&decoded_context->counters) == 0);
+
+    cfl_list_foreach(head, &decoded_context->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+
+        if (strcmp(gauge->opts.fqname, "cpu_usage_idle") == 0) {
+            TEST_CHECK(cfl_list_size(&gauge->map->metrics) == 2);
+            ret = cmt_gauge_get_val(gauge, 2, (char *[]) {"a", "eu"}, &value);
+            TEST_CHECK(ret == 0 && value == 91.5);
+            ret = cmt_gauge_get_val(gauge, 2, (char *[]) {"b", "eu"}, &value);
+            TEST_CHECK(ret == 0 && value == 80);
+        }
+        else if (strcmp(gauge->opts.fqname, "disk_used") == 0) {
+            ret = cmt_gauge_get_val(gauge, 1, (char *[]) {"/var log"}, &value);
+            TEST_CHECK(ret == 0 && value == 12345);
+            TEST_CHECK(cmt_metric_get_timestamp(
+                           cfl_list_entry_first(&gauge->map->metrics,
+                                                struct cmt_metric, _head)) ==
+                       UINT64_C(1700000000000000000));
+        }
+        else if (strcmp(gauge->opts.fqname, "disk_ok") == 0) {
+            ret = cmt_gauge_get_val(gauge, 1, (char *[]) {"/var log"}, &value);
+            TEST_CHECK(ret == 0 && value == 1);
+        }
+        else if (strcmp(gauge->opts.fqname, "mem_free") == 0) {
+            TEST_CHECK(gauge->map->metric_static_set == 1);
+            TEST_CHECK(cmt_metric_get_value(&gauge->map->metric) == 1000);
+        }
+        else {
+            TEST_CHECK(strcmp(gauge->opts.fqname, "cpu_usage_user") == 0 ||
+                       strcmp(gauge->opts.fqname, "disk_total") == 0);
+        }
+    }
+
+    cmt_decode_influx_destroy(decoded_context);
+
+    /* malformed lines fail the whole payload */
+    ret = cmt_decode_influx_create(&decoded_context, "cpu usage", 9, NULL);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_DECODE_ERROR);
+    ret = cmt_decode_influx_create(&decoded_context, "cpu,host usage=1", 16, NULL);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_DECODE_ERROR);
+    ret = cmt_decode_influx_create(&decoded_context, "cpu usage=1 -5", 14, NULL);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_DECODE_ERROR);
+    ret = cmt_decode_influx_create(&decoded_context, "cpu usage=\"x\"y", 15, NULL);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_DECODE_ERROR);
+    ret = cmt_decode_influx_create(&decoded_context, "cpu usage=1x", 12, NULL);
+    TEST_CHECK(ret == CMT_DECODE_INFLUX_DECODE_ERROR);
+
+    /* lines with and without tags merge into separate families */
+    merged = cmt_create();
+    TEST_ASSERT(merged != NULL);
+
+    for (i = 0; i < 2; i++) {
+        ret = cmt_decode_influx_merge(merged, mixed[i], strlen(mixed[i]), &opts);
+        TEST_CHECK(ret == CMT_DECODE_INFLUX_SUCCESS);
+        TEST_CHECK(cfl_list_size(&merged->gauges) == 2);
+    }
+
+    cfl_list_foreach(head, &merged->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+
+        if (gauge->map->label_count == 0) {
+            TEST_CHECK(cmt_metric_get_value(&gauge->map->metric) == 2);
+        }
+        else {
+            ret = cmt_gauge_get_val(gauge, 1, (char *[]) {"a"}, &value);
+            TEST_CHECK(ret == 0 && value == 1);
+        }
+    }
+
+    cmt_destroy(merged);
+}
+
+/* encode_graphite -> decode_graphite -> encode_graphite keeps the payload */
+void test_graphite_round_trip()
+{
+    int                             ret;
+    uint64_t                        ts;
+    cfl_sds_t                       first;
+    cfl_sds_t                       second;
+    struct cmt                     *cmt;
+    struct cmt                     *decoded_context;
+    struct cmt_counter             *counter;
+    struct cmt_gauge               *gauge;
+    struct cmt_gauge               *load;
+    struct cmt_decode_graphite_rule rules[] = {
+        {"*_total", CMT_COUNTER}
+    };
+    struct cmt_decode_graphite_opts opts = {0};
+
+    cmt_initialize();
+
+    ts = UINT64_C(1700000000000000000);
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    counter = cmt_counter_create(cmt, "kubernetes", "", "requests_total",
+                                 "requests", 2, (char *[]) {"app", "host"});
+    gauge = cmt_gauge_create(cmt, "kubernetes", "node", "memory_bytes",
+                             "memory", 1, (char *[]) {"host"});
+    load = cmt_gauge_create(cmt, "", "", "load", "load", 0, NULL);
+    TEST_CHECK(counter != NULL && gauge != NULL && load != NULL);
+
+    cmt_counter_set(counter, ts, 10, 2, (char *[]) {"api", "web-1"});
+    cmt_counter_set(counter, ts, 25, 2, (char *[]) {"db", "web-2"});
+    cmt_gauge_set(gauge, ts, 1048576.5, 1, (char *[]) {"web-1"});
+    cmt_gauge_set(load, ts, 0.1, 0, NULL);
+
+    opts.rules = rules;
+    opts.rule_count = 1;
+
+    first = cmt_encode_graphite_create(cmt);
+    TEST_CHECK(first != NULL);
+
+    ret = cmt_decode_graphite_create(&decoded_context, first,
+                                     cfl_sds_len(first), &opts);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_SUCCESS);
+    if (ret == CMT_DECODE_GRAPHITE_SUCCESS) {
+        TEST_CHECK(cfl_list_size(&decoded_context->counters) == 1);
+        TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 2);
+
+        second = cmt_encode_graphite_create(decoded_context);
+        TEST_CHECK(second != NULL);
+        TEST_CHECK(strcmp(first, second) == 0);
+        TEST_MSG("expected:\n%s\ngot:\n%s", first, second);
+
+        cfl_sds_destroy(second);
+        cmt_decode_graphite_destroy(decoded_context);
+    }
+
+    cfl_sds_destroy(first);
+
+    cmt_destroy(cmt);
+}
+
+void test_graphite_plaintext()
+{
+    int                                i;
+    int                                ret;
+    size_t                             offset;
+    size_t                             size;
+    double                             value;
+    char                               payload[] =
+        "servers.web1.cpu;region=eu;dc=ams 90.5 1700000000\n"
+        "servers.web1.cpu;dc=ams;region=eu 91.5 1700000010\r\n"
+        "servers.web1.cpu;dc=fra;region=eu\t80\t1700000000.5\n"
+        "\n"
+        "servers.web1.uptime 12 -1\n"
+        "servers.web1.mem 1e3";
+    char                              *mixed[] = {
+        "a.b 1 1700000000\na.b;k=v 2 1700000000\n",
+        "a.b;k=v 2 1700000000\na.b 1 1700000000\n"
+    };
+    struct cmt                        *decoded_context;
+    struct cmt                        *merged;
+    struct cmt_gauge                  *gauge;
+    struct cmt_metric                 *metric;
+    struct cmt_decode_graphite_stream *stream;
+    struct cfl_list                   *head;
+
+    cmt_initialize();
+
+    /* feed the payload in uneven chunks, lines end up split across them */
+    ret = cmt_decode_graphite_stream_create(&stream, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_SUCCESS);
+    if (ret != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return;
+    }
+
+    for (offset = 0, size = 1 ; offset < sizeof(payload) - 1 ;
+         offset += size, size = size * 2 + 1) {
+        if (size > sizeof(payload) - 1 - offset) {
+            size = sizeof(payload) - 1 - offset;
+        }
+
+        ret = cmt_decode_graphite_stream_feed(stream, &payload[offset], size);
+        TEST_CHECK(ret == CMT_DECODE_GRAPHITE_SUCCESS);
+    }
+
+    ret = cmt_decode_graphite_stream_finish(stream, &decoded_context);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_SUCCESS);
+
+    /* nothing can be fed once the context was handed over */
+    TEST_CHECK(cmt_decode_graphite_stream_feed(stream, "a 1\n", 4) ==
+               CMT_DECODE_GRAPHITE_INVALID_ARGUMENT_ERROR);
+    cmt_decode_graphite_stream_destroy(stream);
+
+    if (ret != CMT_DECODE_GRAPHITE_SUCCESS) {
+        return;
+    }
+
+    TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 3);
+
+    cfl_list_foreach(head, &decoded_context->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+
+        if (strcmp(gauge->opts.name, "servers.web1.cpu") == 0) {
+            TEST_CHECK(cfl_list_size(&gauge->map->metrics) == 2);
+            ret = cmt_gauge_get_val(gauge, 2, (char *[]) {"ams", "eu"}, &value);
+            TEST_CHECK(ret == 0 && value == 91.5);
+            ret = cmt_gauge_get_val(gauge, 2, (char *[]) {"fra", "eu"}, &value);
+            TEST_CHECK(ret == 0 && value == 80);
+
+            metric = cfl_list_entry_last(&gauge->map->metrics,
+                                         struct cmt_metric, _head);
+            TEST_CHECK(cmt_metric_get_timestamp(metric) ==
+                       UINT64_C(1700000000500000000));
+        }
+        else if (strcmp(gauge->opts.name, "servers.web1.uptime") == 0) {
+            TEST_CHECK(gauge->map->metric_static_set == 1);
+            TEST_CHECK(cmt_metric_get_timestamp(&gauge->map->metric) > 0);
+        }
+        else {
+            TEST_CHECK(strcmp(gauge->opts.name, "servers.web1.mem") == 0);
+            TEST_CHECK(cmt_metric_get_value(&gauge->map->metric) == 1000);
+        }
+    }
+
+    cmt_decode_graphite_destroy(decoded_context);
+
+    /* malformed lines fail the whole payload */
+    ret = cmt_decode_graphite_create(&decoded_context, "cpu", 3, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+    ret = cmt_decode_graphite_create(&decoded_context, "cpu x", 5, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+    ret = cmt_decode_graphite_create(&decoded_context, "cpu 1 -5", 8, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+    ret = cmt_decode_graphite_create(&decoded_context, "cpu 1 2 3", 9, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+    ret = cmt_decode_graphite_create(&decoded_context, "cpu;dc 1", 8, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+    ret = cmt_decode_graphite_create(&decoded_context, ";dc=a 1", 7, NULL);
+    TEST_CHECK(ret == CMT_DECODE_GRAPHITE_DECODE_ERROR);
+
+    /* lines with and without tags merge into separate families */
+    merged = cmt_create();
+    TEST_ASSERT(merged != NULL);
+
+    for (i = 0; i < 2; i++) {
+        ret = cmt_decode_graphite_merge(merged, mixed[i], strlen(mixed[i]), NULL);
+        TEST_CHECK(ret == CMT_DECODE_GRAPHITE_SUCCESS);
+        TEST_CHECK(cfl_list_size(&merged->gauges) == 2);
+    }
+
+    cfl_list_foreach(head, &merged->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+
+        if (gauge->map->label_count == 0) {
+            TEST_CHECK(cmt_metric_get_value(&gauge->map->metric) == 1);
+        }
+        else {
+            ret = cmt_gauge_get_val(gauge, 1, (char *[]) {"v"}, &value);
+            TEST_CHECK(ret == 0 && value == 2);
+        }
+    }
+
+    cmt_destroy(merged);
+}
+
+/* the carbon pickle message, framed with its size */
+void test_graphite_pickle()
+{
+    cfl_sds_t         payload;
+    struct cmt       *cmt;
+    struct cmt_gauge *gauge;
+    /* pickle.loads(): [('ns.gauge;key=a', (1700000000, 1.5))] */
+    char              expected[] =
+        "\x00\x00\x00\x29\x80\x02](X\x0e\x00\x00\x00ns.gauge;key=a"
+        "J\x00\xf1\x53\x65G\x3f\xf8\x00\x00\x00\x00\x00\x00\x86\x86" "e.";
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_ASSERT(cmt != NULL);
+
+    gauge = cmt_gauge_create(cmt, "ns", "", "gauge", "gauge", 1,
+                             (char *[]) {"key"});
+    TEST_ASSERT(gauge != NULL);
+    cmt_gauge_set(gauge, UINT64_C(1700000000000000000), 1.5, 1,
+                  (char *[]) {"a"});
+
+    payload = cmt_encode_graphite_pickle_create(cmt);
+    TEST_CHECK(payload != NULL);
+    if (payload != NULL) {
+        TEST_CHECK(cfl_sds_len(payload) == sizeof(expected) - 1 &&
+                   memcmp(payload, expected, sizeof(expected) - 1) == 0);
+        cmt_encode_graphite_pickle_destroy(payload);
+    }
+
+    cmt_destroy(cmt);
+}
+
+void test_decode_merge()
+{
+    int                 ret;
+    int                 round;
+    uint64_t            ts;
+    char                statsd_payload[] =
+        "requests:5|c|#path:/a\n"
+        "requests:7|c|#path:/b\n"
+        "temperature:21|g|#room:kitchen\n"
+        "users:3|s|#site:main\n";
+    cfl_sds_t           remote_write_payload;
+    cfl_sds_t           copied_text;
+    cfl_sds_t           merged_text;
+    struct cmt         *cmt;
+    struct cmt         *decoded_context;
+    struct cmt         *copied;
+    struct cmt         *merged;
+    struct cmt_counter *counter;
+    struct cmt_gauge   *gauge;
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_ASSERT(cmt != NULL);
+
+    counter = cmt_counter_create(cmt, "cmt", "merge", "requests", "Requests",
+                                 1, (char *[]) {"path"});
+    gauge = cmt_gauge_create(cmt, "cmt", "merge", "load", "Load", 0, NULL);
+    TEST_ASSERT(counter != NULL && gauge != NULL);
+
+    ts = cfl_time_now();
+    cmt_counter_set(counter, ts, 10, 1, (char *[]) {"/a"});
+    cmt_counter_set(counter, ts, 20, 1, (char *[]) {"/b"});
+    cmt_gauge_set(gauge, ts, 0.5, 0, NULL);
+
+    remote_write_payload = cmt_encode_prometheus_remote_write_create(cmt);
+    TEST_ASSERT(remote_write_payload != NULL);
+
+    copied = cmt_create();
+    merged = cmt_create();
+    TEST_ASSERT(copied != NULL && merged != NULL);
+
+    for (round = 0; round < 2; round++) {
+        ret = cmt_decode_statsd_create(&decoded_context, statsd_payload,
+                                       sizeof(statsd_payload), 0);
+        TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+        if (ret == CMT_DECODE_STATSD_SUCCESS) {
+            TEST_CHECK(cmt_cat(copied, decoded_context) == 0);
+            cmt_decode_statsd_destroy(decoded_context);
+        }
+
+        ret = cmt_decode_statsd_merge(merged, statsd_payload,
+                                      sizeof(statsd_payload), 0);
+        TEST_CHECK(ret == CMT_DECODE_STATSD_SUCCESS);
+
+        ret = cmt_decode_prometheus_remote_write_create(&decoded_context,
+                                                        remote_write_payload,
+                                                        cfl_sds_len(remote_write_payload));
+        TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+        if (ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+            TEST_CHECK(cmt_cat(copied, decoded_context) == 0);
+            cmt_decode_prometheus_remote_write_destroy(decoded_context);
+        }
+
+        ret = cmt_decode_prometheus_remote_write_merge(merged,
+                                                       remote_write_payload,
+                                                       cfl_sds_len(remote_write_payload));
+        TEST_CHECK(ret == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+    }
+
+    /* statsd stamps samples with the decoding time */
+    copied_text = cmt_encode_prometheus_create(copied, CMT_FALSE);
+    merged_text = cmt_encode_prometheus_create(merged, CMT_FALSE);
+    TEST_CHECK(copied_text != NULL && merged_text != NULL &&
+               strcmp(copied_text, merged_text) == 0);
+    cmt_encode_prometheus_destroy(copied_text);
+    cmt_encode_prometheus_destroy(merged_text);
+
+    ret = cmt_decode_statsd_merge(NULL, statsd_payload,
+                                  sizeof(statsd_payload), 0);
+    TEST_CHECK(ret == CMT_DECODE_STATSD_INVALID_ARGUMENT_ERROR);
+
+    cmt_destroy(merged);
+    cmt_destroy(copied);
+    cmt_encode_prometheus_remote_write_destroy(remote_write_payload);
+    cmt_destroy(cmt);
+}
+
 
 TEST_LIST = {
     {"prometheus_remote_write", test_prometheus_remote_write},
@@ -461,6 +1669,22 @@ TEST_LIST = {
     {"prometheus_remote_write_missing_label_value_no_crash", test_prometheus_remote_write_missing_label_value_no_crash},
     {"prometheus_remote_write_sparse_metadata_histogram", test_prometheus_remote_write_sparse_metadata_histogram},
     {"prometheus_remote_write_metadata_matched_by_name", test_prometheus_remote_write_metadata_matched_by_name},
+    {"prometheus_remote_write_series_grouping", test_prometheus_remote_write_series_grouping},
+    {"prometheus_remote_write_truncated", test_prometheus_remote_write_truncated},
+    {"snappy", test_snappy},
+    {"prometheus_remote_write_compressed", test_prometheus_remote_write_compressed},
     {"statsd", test_statsd},
+    {"statsd_aggregation", test_statsd_aggregation},
+    {"statsd_scanner", test_statsd_scanner},
+    {"statsd_histogram", test_statsd_histogram},
+    {"statsd_exp_histogram", test_statsd_exp_histogram},
+    {"statsd_set", test_statsd_set},
+    {"statsd_merge_mixed_tags", test_statsd_merge_mixed_tags},
+    {"influx_round_trip", test_influx_round_trip},
+    {"influx_line_protocol", test_influx_line_protocol},
+    {"graphite_round_trip", test_graphite_round_trip},
+    {"graphite_plaintext", test_graphite_plaintext},
+    {"graphite_pickle", test_graphite_pickle},
+    {"decode_merge", test_decode_merge},
     { 0 }
 };
@@ -29,9 +29,16 @@
 #include <cmetrics/cmt_map.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 #include <cmetrics/cmt_decode_msgpack.h>
+#include <cmetrics/cmt_msgpack_view.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_encode_prometheus_remote_write.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write_v2.h>
+#include <cmetrics/cmt_snappy.h>
 #include <cmetrics/cmt_encode_prometheus.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
 #include <cmetrics/cmt_encode_opentelemetry.h>
+#include <cmetrics/cmt_decode_opentelemetry.h>
+#include <cmetrics/cmt_encode_split.h>
 #include <cmetrics/cmt_encode_text.h>
 #include <cmetrics/cmt_encode_influx.h>
 #include <cmetrics/cmt_encode_splunk_hec.h>
@@ -215,6 +222,504 @@ void test_cmt_to_msgpack()
     cmt_encode_msgpack_destroy(mp2_buf);
 }
 
+/*
+ * The compact format must carry exactly the same context:
+ *
+ * CMT -> MSGPACK (compact) -> CMT -> MSGPACK
+ *  |                                    |
+ *  |---> MSGPACK -------> compare <-----|
+ */
+void test_cmt_to_msgpack_compact()
+{
+    int ret;
+    size_t offset;
+    char *mp1_buf = NULL;
+    size_t mp1_size = 0;
+    char *mp2_buf = NULL;
+    size_t mp2_size = 0;
+    char *compact_buf = NULL;
+    size_t compact_size = 0;
+    char *corrupt_buf;
+    struct cmt *cmt1;
+    struct cmt *cmt2 = NULL;
+
+    cmt_initialize();
+
+    cmt1 = generate_encoder_test_data_with_timestamp(cfl_time_now());
+    TEST_CHECK(cmt1 != NULL);
+    if (cmt1 == NULL) {
+        return;
+    }
+
+    cmt_label_add(cmt1, "dev", "Calyptia");
+
+    ret = cmt_encode_msgpack_create(cmt1, &mp1_buf, &mp1_size);
+    TEST_CHECK(ret == 0);
+
+    ret = cmt_encode_msgpack_compact_create(cmt1, &compact_buf, &compact_size);
+    TEST_CHECK(ret == 0);
+    if (ret != 0) {
+        cmt_destroy(cmt1);
+        cmt_encode_msgpack_destroy(mp1_buf);
+        return;
+    }
+
+    TEST_CHECK(compact_size < mp1_size);
+    TEST_MSG("msgpack=%zu bytes compact=%zu bytes", mp1_size, compact_size);
+
+    /* the decoder detects the compact format on its own */
+    offset = 0;
+    ret = cmt_decode_msgpack_create(&cmt2, compact_buf, compact_size, &offset);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(offset == compact_size);
+
+    if (ret == CMT_DECODE_MSGPACK_SUCCESS) {
+        ret = cmt_encode_msgpack_create(cmt2, &mp2_buf, &mp2_size);
+        TEST_CHECK(ret == 0);
+
+        TEST_CHECK(mp1_size == mp2_size);
+        if (mp1_size == mp2_size) {
+            TEST_CHECK(memcmp(mp1_buf, mp2_buf, mp1_size) == 0);
+        }
+
+        cmt_decode_msgpack_destroy(cmt2);
+        cmt_encode_msgpack_destroy(mp2_buf);
+    }
+
+    corrupt_buf = malloc(compact_size);
+    TEST_CHECK(corrupt_buf != NULL);
+
+    if (corrupt_buf != NULL) {
+        /* the format version follows the top level array header */
+        memcpy(corrupt_buf, compact_buf, compact_size);
+        corrupt_buf[1] = MSGPACK_COMPACT_VERSION + 1;
+
+        offset = 0;
+        cmt2 = NULL;
+        ret = cmt_decode_msgpack_create(&cmt2, corrupt_buf, compact_size, &offset);
+        TEST_CHECK(ret == CMT_DECODE_MSGPACK_VERSION_ERROR);
+        TEST_CHECK(cmt2 == NULL);
+
+        /* truncated payloads are rejected */
+        offset = 0;
+        ret = cmt_decode_msgpack_create(&cmt2, compact_buf, compact_size / 2, &offset);
+        TEST_CHECK(ret != CMT_DECODE_MSGPACK_SUCCESS);
+        TEST_CHECK(cmt2 == NULL);
+
+        free(corrupt_buf);
+    }
+
+    cmt_destroy(cmt1);
+    cmt_encode_msgpack_destroy(mp1_buf);
+    cmt_encode_msgpack_destroy(compact_buf);
+}
+
+static int view_string_is(struct cmt_msgpack_view_string *value, const char *expected)
+{
+    if (expected == NULL) {
+        return value->data == NULL;
+    }
+
+    return value->data != NULL &&
+           value->length == strlen(expected) &&
+           memcmp(value->data, expected, value->length) == 0;
+}
+
+static void check_view_labels(struct cmt_msgpack_view_label_iterator *iterator,
+                              struct cfl_list *labels)
+{
+    struct cfl_list                *head;
+    struct cmt_map_label           *label;
+    struct cmt_msgpack_view_string  value;
+
+    cfl_list_foreach(head, labels) {
+        label = cfl_list_entry(head, struct cmt_map_label, _head);
+
+        TEST_CHECK(cmt_msgpack_view_label_next(iterator, &value) == CMT_TRUE);
+        TEST_CHECK(view_string_is(&value, label->name));
+    }
+
+    TEST_CHECK(cmt_msgpack_view_label_next(iterator, &value) == CMT_FALSE);
+    TEST_CHECK(iterator->error == CMT_DECODE_MSGPACK_SUCCESS);
+}
+
+static void check_view_series(struct cmt_msgpack_view *view,
+                              struct cmt_msgpack_view_family *family,
+                              size_t index,
+                              struct cmt_map *map,
+                              struct cmt_metric *metric)
+{
+    int                                    ret;
+    struct cmt_msgpack_view_series         series;
+    struct cmt_msgpack_view_label_iterator iterator;
+
+    ret = cmt_msgpack_view_series_get(view, family, index, &series);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    if (ret != CMT_DECODE_MSGPACK_SUCCESS) {
+        return;
+    }
+
+    TEST_CHECK(series.timestamp == cmt_metric_get_timestamp(metric));
+    TEST_CHECK(series.hash == metric->hash);
+    TEST_CHECK(series.label_count == (size_t) cfl_list_size(&metric->labels));
+
+    if (map->type == CMT_HISTOGRAM) {
+        TEST_CHECK(series.count == cmt_metric_hist_get_count_value(metric));
+        TEST_CHECK(series.sum == cmt_metric_hist_get_sum_value(metric));
+    }
+    else if (map->type == CMT_SUMMARY) {
+        TEST_CHECK(series.count == cmt_summary_get_count_value(metric));
+        TEST_CHECK(series.sum == cmt_summary_get_sum_value(metric));
+    }
+    else {
+        TEST_CHECK(series.value == cmt_metric_get_value(metric));
+    }
+
+    cmt_msgpack_view_series_labels(view, &series, &iterator);
+    check_view_labels(&iterator, &metric->labels);
+}
+
+static void check_view_family(struct cmt_msgpack_view *view,
+                              size_t family_index, struct cmt_map *map)
+{
+    size_t                                 index;
+    struct cfl_list                       *head;
+    struct cmt_metric                     *metric;
+    struct cmt_msgpack_view_family        *family;
+    struct cmt_msgpack_view_label_iterator iterator;
+
+    family = cmt_msgpack_view_family_get(view, family_index);
+    TEST_CHECK(family != NULL);
+    if (family == NULL) {
+        return;
+    }
+
+    TEST_CHECK(family->type == map->type);
+    TEST_CHECK(view_string_is(&family->ns, map->opts->ns));
+    TEST_CHECK(view_string_is(&family->subsystem, map->opts->subsystem));
+    TEST_CHECK(view_string_is(&family->name, map->opts->name));
+    TEST_CHECK(view_string_is(&family->description, map->opts->description));
+    TEST_CHECK(family->series_count == (size_t) cfl_list_size(&map->metrics) +
+                                       (map->metric_static_set ? 1 : 0));
+
+    cmt_msgpack_view_family_labels(view, family, &iterator);
+    check_view_labels(&iterator, &map->label_keys);
+
+    index = 0;
+
+    if (map->metric_static_set) {
+        check_view_series(view, family, index++, map, &map->metric);
+    }
+
+    cfl_list_foreach(head, &map->metrics) {
+        metric = cfl_list_entry(head, struct cmt_metric, _head);
+        check_view_series(view, family, index++, map, metric);
+    }
+}
+
+static void check_view(char *buf, size_t size, struct cmt *cmt)
+{
+    int                      ret;
+    size_t                   index;
+    size_t                   offset;
+    struct cfl_list         *head;
+    struct cmt_counter      *counter;
+    struct cmt_gauge        *gauge;
+    struct cmt_summary      *summary;
+    struct cmt_histogram    *histogram;
+    struct cmt_msgpack_view *view;
+
+    offset = 0;
+    ret = cmt_msgpack_view_create(&view, buf, size, &offset);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(offset == size);
+    if (ret != CMT_DECODE_MSGPACK_SUCCESS) {
+        return;
+    }
+
+    TEST_CHECK(view->family_count == 4);
+
+    /* families are packed by type */
+    index = 0;
+
+    cfl_list_foreach(head, &cmt->counters) {
+        counter = cfl_list_entry(head, struct cmt_counter, _head);
+        check_view_family(view, index++, counter->map);
+    }
+
+    cfl_list_foreach(head, &cmt->gauges) {
+        gauge = cfl_list_entry(head, struct cmt_gauge, _head);
+        check_view_family(view, index++, gauge->map);
+    }
+
+    cfl_list_foreach(head, &cmt->summaries) {
+        summary = cfl_list_entry(head, struct cmt_summary, _head);
+        check_view_family(view, index++, summary->map);
+    }
+
+    cfl_list_foreach(head, &cmt->histograms) {
+        histogram = cfl_list_entry(head, struct cmt_histogram, _head);
+        check_view_family(view, index++, histogram->map);
+    }
+
+    TEST_CHECK(cmt_msgpack_view_family_get(view, index) == NULL);
+
+    cmt_msgpack_view_destroy(view);
+
+    /* truncated payloads are rejected */
+    offset = 0;
+    ret = cmt_msgpack_view_create(&view, buf, size / 2, &offset);
+    TEST_CHECK(ret != CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(view == NULL);
+    TEST_CHECK(offset == 0);
+}
+
+void test_cmt_msgpack_view()
+{
+    int ret;
+    char *mp_buf;
+    size_t mp_size;
+    char *compact_buf;
+    size_t compact_size;
+    struct cmt *cmt;
+
+    cmt_initialize();
+
+    cmt = generate_encoder_test_data_with_timestamp(cfl_time_now());
+    TEST_CHECK(cmt != NULL);
+    if (cmt == NULL) {
+        return;
+    }
+
+    ret = cmt_encode_msgpack_create(cmt, &mp_buf, &mp_size);
+    TEST_CHECK(ret == 0);
+    if (ret == 0) {
+        check_view(mp_buf, mp_size, cmt);
+        cmt_encode_msgpack_destroy(mp_buf);
+    }
+
+    ret = cmt_encode_msgpack_compact_create(cmt, &compact_buf, &compact_size);
+    TEST_CHECK(ret == 0);
+    if (ret == 0) {
+        check_view(compact_buf, compact_size, cmt);
+        cmt_encode_msgpack_destroy(compact_buf);
+    }
+
+    cmt_destroy(cmt);
+}
+
+/* Concatenate 'count' encoded contexts whose counter value changes */
+static char *generate_concatenated_msgpack(size_t count, size_t *out_size,
+                                           struct cmt **out_sequential)
+{
+    int                 ret;
+    size_t              index;
+    size_t              size;
+    size_t              buffer_size;
+    char               *mp_buf;
+    char               *buffer;
+    char               *tmp;
+    struct cmt         *cmt;
+    struct cmt_counter *counter;
+
+    buffer = NULL;
+    buffer_size = 0;
+
+    *out_sequential = cmt_create();
+    if (*out_sequential == NULL) {
+        return NULL;
+    }
+
+    for (index = 0 ; index < count ; index++) {
+        cmt = generate_encoder_test_data_with_timestamp(index + 1);
+        if (cmt == NULL) {
+            free(buffer);
+            return NULL;
+        }
+
+        counter = cmt_counter_create(cmt, "parallel", "", "chunks", "Chunks",
+                                     1, (char *[]) {"chunk"});
+        cmt_counter_set(counter, index + 1, index, 1, (char *[]) {"last"});
+        cmt_counter_set(counter, index + 1, 1, 1,
+                        (char *[]) {index % 2 ? "odd" : "even"});
+
+        ret = cmt_encode_msgpack_create(cmt, &mp_buf, &size);
+        TEST_CHECK(ret == 0);
+
+        /* the expected result of merging the chunks one after the other */
+        TEST_CHECK(cmt_cat(*out_sequential, cmt) == 0);
+        cmt_destroy(cmt);
+
+        if (ret != 0) {
+            free(buffer);
+            return NULL;
+        }
+
+        tmp = realloc(buffer, buffer_size + size);
+        if (tmp == NULL) {
+            cmt_encode_msgpack_destroy(mp_buf);
+            free(buffer);
+            return NULL;
+        }
+
+        buffer = tmp;
+        memcpy(&buffer[buffer_size], mp_buf, size);
+        buffer_size += size;
+
+        cmt_encode_msgpack_destroy(mp_buf);
+    }
+
+    *out_size = buffer_size;
+
+    return buffer;
+}
+
+void test_cmt_msgpack_parallel_decode()
+{
+    int                       ret;
+    size_t                    index;
+    size_t                    offset;
+    size_t                    buffer_size;
+    size_t                    chunk_count;
+    char                     *buffer;
+    char                     *mp1_buf;
+    size_t                    mp1_size;
+    cfl_sds_t                 text1;
+    cfl_sds_t                 text2;
+    struct cfl_list           contexts;
+    struct cfl_list          *head;
+    struct cmt               *cmt;
+    struct cmt               *sequential;
+    struct cmt               *merged;
+    struct cmt_msgpack_chunk *chunks;
+
+    cmt_initialize();
+
+    buffer = generate_concatenated_msgpack(37, &buffer_size, &sequential);
+    TEST_CHECK(buffer != NULL);
+    if (buffer == NULL) {
+        cmt_destroy(sequential);
+        return;
+    }
+
+    ret = cmt_decode_msgpack_scan(buffer, buffer_size, &chunks, &chunk_count);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(chunk_count == 37);
+
+    /* the contexts come back in buffer order */
+    cfl_list_init(&contexts);
+    ret = cmt_decode_msgpack_parallel_create(&contexts, buffer, buffer_size, 4);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(cfl_list_size(&contexts) == 37);
+
+    index = 0;
+    cfl_list_foreach(head, &contexts) {
+        cmt = cfl_list_entry(head, struct cmt, _head);
+
+        ret = cmt_encode_msgpack_create(cmt, &mp1_buf, &mp1_size);
+        TEST_CHECK(ret == 0);
+        if (ret == 0 && index < chunk_count) {
+            TEST_CHECK(mp1_size == chunks[index].size);
+            TEST_CHECK(memcmp(mp1_buf, &buffer[chunks[index].offset],
+                              chunks[index].size) == 0);
+            cmt_encode_msgpack_destroy(mp1_buf);
+        }
+
+        index++;
+    }
+
+    cmt_decode_msgpack_parallel_destroy(&contexts);
+    TEST_CHECK(cfl_list_size(&contexts) == 0);
+    cmt_decode_msgpack_scan_destroy(chunks);
+
+    /*
+     * merging gives the same result as merging the chunks in order, the text
+     * format is compared since histogram sums are added in another order
+     */
+    text1 = cmt_encode_text_create(sequential);
+    TEST_CHECK(text1 != NULL);
+
+    for (index = 1 ; index <= 8 ; index *= 2) {
+        merged = cmt_create();
+        TEST_CHECK(merged != NULL);
+
+        ret = cmt_decode_msgpack_parallel_merge(merged, buffer, buffer_size, index);
+        TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+
+        text2 = cmt_encode_text_create(merged);
+        TEST_CHECK(text2 != NULL);
+        TEST_CHECK(text1 != NULL && text2 != NULL && strcmp(text1, text2) == 0);
+        TEST_MSG("worker_count=%zu", index);
+
+        cmt_encode_text_destroy(text2);
+        cmt_destroy(merged);
+    }
+
+    cmt_encode_text_destroy(text1);
+
+    /* a truncated buffer is rejected as a whole */
+    offset = buffer_size - 1;
+    cfl_list_init(&contexts);
+    ret = cmt_decode_msgpack_parallel_create(&contexts, buffer, offset, 4);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_INSUFFICIENT_DATA);
+    TEST_CHECK(cfl_list_size(&contexts) == 0);
+
+    free(buffer);
+    cmt_destroy(sequential);
+}
+
+void test_cmt_msgpack_merge()
+{
+    int         ret;
+    size_t      offset;
+    size_t      buffer_size;
+    char       *buffer;
+    cfl_sds_t   text1;
+    cfl_sds_t   text2;
+    struct cmt *sequential;
+    struct cmt *merged;
+
+    cmt_initialize();
+
+    buffer = generate_concatenated_msgpack(9, &buffer_size, &sequential);
+    TEST_CHECK(buffer != NULL);
+    if (buffer == NULL) {
+        cmt_destroy(sequential);
+        return;
+    }
+
+    merged = cmt_create();
+    TEST_CHECK(merged != NULL);
+
+    /* decoding straight into the destination matches cmt_cat() */
+    offset = 0;
+    while (offset < buffer_size) {
+        ret = cmt_decode_msgpack_merge(merged, buffer, buffer_size, &offset);
+        TEST_CHECK(ret == CMT_DECODE_MSGPACK_SUCCESS);
+        if (ret != CMT_DECODE_MSGPACK_SUCCESS) {
+            break;
+        }
+    }
+
+    ret = cmt_decode_msgpack_merge(merged, buffer, buffer_size, &offset);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_INSUFFICIENT_DATA);
+
+    text1 = cmt_encode_text_create(sequential);
+    text2 = cmt_encode_text_create(merged);
+    TEST_CHECK(text1 != NULL && text2 != NULL && strcmp(text1, text2) == 0);
+
+    cmt_encode_text_destroy(text1);
+    cmt_encode_text_destroy(text2);
+
+    offset = 0;
+    ret = cmt_decode_msgpack_merge(NULL, buffer, buffer_size, &offset);
+    TEST_CHECK(ret == CMT_DECODE_MSGPACK_INVALID_ARGUMENT_ERROR);
+
+    cmt_destroy(merged);
+    free(buffer);
+    cmt_destroy(sequential);
+}
+
 void test_cmt_msgpack_metric_unit_roundtrip()
 {
     int ret;
@@ -1173,6 +1678,608 @@ void test_prometheus_remote_write_skips_only_stale_histograms()
     cmt_destroy(cmt);
 }
 
+#define REMOTE_WRITE_V2_MAX_SYMBOLS 128
+
+struct remote_write_v2_symbol {
+    const unsigned char *data;
+    uint64_t             length;
+};
+
+static int read_test_varint(const unsigned char **cursor,
+                            const unsigned char *end, uint64_t *value)
+{
+    int shift;
+
+    *value = 0;
+
+    for (shift = 0 ; shift < 64 && *cursor < end ; shift += 7) {
+        *value |= (uint64_t) (**cursor & 0x7f) << shift;
+
+        if ((*(*cursor)++ & 0x80) == 0) {
+            return CMT_TRUE;
+        }
+    }
+
+    return CMT_FALSE;
+}
+
+static int compare_test_symbols(struct remote_write_v2_symbol *left,
+                                struct remote_write_v2_symbol *right)
+{
+    int result;
+
+    result = memcmp(left->data, right->data,
+                    left->length < right->length ? left->length : right->length);
+
+    if (result == 0) {
+        result = (left->length > right->length) - (left->length < right->length);
+    }
+
+    return result;
+}
+
+/*
+ * Walk an io.prometheus.write.v2.Request checking that the symbols are unique,
+ * that every label reference is valid and that the labels are sorted by name.
+ * Returns the number of time series or -1.
+ */
+static int check_remote_write_v2_request(cfl_sds_t payload)
+{
+    int                            series_count;
+    size_t                         index;
+    size_t                         inner;
+    size_t                         symbol_count;
+    uint64_t                       key;
+    uint64_t                       length;
+    uint64_t                       reference;
+    uint64_t                       previous_name;
+    const unsigned char           *cursor;
+    const unsigned char           *end;
+    const unsigned char           *series_end;
+    const unsigned char           *refs_end;
+    struct remote_write_v2_symbol  symbols[REMOTE_WRITE_V2_MAX_SYMBOLS];
+
+    cursor = (const unsigned char *) payload;
+    end = cursor + cfl_sds_len(payload);
+    symbol_count = 0;
+    series_count = 0;
+
+    while (cursor < end) {
+        if (!read_test_varint(&cursor, end, &key) ||
+            (key & 0x07) != 2 ||
+            !read_test_varint(&cursor, end, &length) ||
+            length > (uint64_t) (end - cursor)) {
+            return -1;
+        }
+
+        if ((key >> 3) == 4) {
+            /* every symbol is stored before the first time series */
+            if (series_count > 0 || symbol_count >= REMOTE_WRITE_V2_MAX_SYMBOLS) {
+                return -1;
+            }
+
+            symbols[symbol_count].data = cursor;
+            symbols[symbol_count].length = length;
+            symbol_count++;
+            cursor += length;
+
+            continue;
+        }
+
+        if ((key >> 3) != 5) {
+            return -1;
+        }
+
+        series_count++;
+        series_end = cursor + length;
+
+        while (cursor < series_end) {
+            if (!read_test_varint(&cursor, series_end, &key)) {
+                return -1;
+            }
+
+            if ((key & 0x07) == 0) {
+                if (!read_test_varint(&cursor, series_end, &length)) {
+                    return -1;
+                }
+
+                continue;
+            }
+
+            if ((key & 0x07) != 2 ||
+                !read_test_varint(&cursor, series_end, &length) ||
+                length > (uint64_t) (series_end - cursor)) {
+                return -1;
+            }
+
+            if ((key >> 3) != 1) {
+                cursor += length;
+
+                continue;
+            }
+
+            refs_end = cursor + length;
+            previous_name = 0;
+            index = 0;
+
+            while (cursor < refs_end) {
+                if (!read_test_varint(&cursor, refs_end, &reference) ||
+                    reference >= symbol_count) {
+                    return -1;
+                }
+
+                if (index % 2 == 0) {
+                    if (index > 0 &&
+                        compare_test_symbols(&symbols[previous_name],
+                                             &symbols[reference]) >= 0) {
+                        return -1;
+                    }
+
+                    previous_name = reference;
+                }
+
+                index++;
+            }
+
+            if (index % 2 != 0) {
+                return -1;
+            }
+        }
+    }
+
+    if (symbol_count == 0 || symbols[0].length != 0) {
+        return -1;
+    }
+
+    for (index = 0 ; index < symbol_count ; index++) {
+        for (inner = index + 1 ; inner < symbol_count ; inner++) {
+            if (compare_test_symbols(&symbols[index], &symbols[inner]) == 0) {
+                return -1;
+            }
+        }
+    }
+
+    return series_count;
+}
+
+void test_prometheus_remote_write_v2()
+{
+    int                       result;
+    int                       series_count;
+    size_t                    length;
+    char                     *uncompressed;
+    cfl_sds_t                 v1_payload;
+    cfl_sds_t                 payload;
+    cfl_sds_t                 compressed;
+    struct cmt               *cmt;
+    Prometheus__WriteRequest *request;
+
+    cmt_initialize();
+
+    cmt = generate_encoder_test_data_with_timestamp(cfl_time_now());
+    TEST_CHECK(cmt != NULL);
+    cmt_label_add(cmt, "dev", "Calyptia");
+
+    v1_payload = cmt_encode_prometheus_remote_write_create(cmt);
+    TEST_CHECK(v1_payload != NULL);
+
+    payload = cmt_encode_prometheus_remote_write_v2_create(cmt);
+    TEST_CHECK(payload != NULL);
+
+    if (v1_payload == NULL || payload == NULL) {
+        cmt_encode_prometheus_remote_write_destroy(v1_payload);
+        cmt_encode_prometheus_remote_write_v2_destroy(payload);
+        cmt_destroy(cmt);
+        return;
+    }
+
+    /* the same series are sent, with every string stored once */
+    request = decode_remote_write_payload(v1_payload);
+    TEST_CHECK(request != NULL);
+
+    series_count = check_remote_write_v2_request(payload);
+    TEST_CHECK(series_count > 0);
+
+    if (request != NULL) {
+        TEST_CHECK(series_count == (int) request->n_timeseries);
+        TEST_MSG("v2 series: %d, v1 series: %zu", series_count, request->n_timeseries);
+        prometheus__write_request__free_unpacked(request, NULL);
+    }
+
+    TEST_CHECK(cfl_sds_len(payload) < cfl_sds_len(v1_payload));
+    TEST_CHECK(memmem(payload, cfl_sds_len(payload),
+                      "\x22\x08" "Calyptia", 10) != NULL);
+
+    /* help strings are referenced from the metadata of every series */
+    TEST_CHECK(memmem(payload, cfl_sds_len(payload),
+                      "\x22\x14" "Network load counter", 22) != NULL);
+
+    compressed = cmt_encode_prometheus_remote_write_v2_create_compressed(cmt);
+    TEST_CHECK(compressed != NULL);
+
+    if (compressed != NULL) {
+        uncompressed = malloc(cfl_sds_len(payload));
+        TEST_CHECK(uncompressed != NULL);
+
+        if (uncompressed != NULL) {
+            result = cmt_snappy_uncompress(compressed, cfl_sds_len(compressed),
+                                           uncompressed, cfl_sds_len(payload),
+                                           &length);
+            TEST_CHECK(result == CMT_SNAPPY_SUCCESS);
+            TEST_CHECK(length == cfl_sds_len(payload));
+            TEST_CHECK(memcmp(uncompressed, payload, cfl_sds_len(payload)) == 0);
+            free(uncompressed);
+        }
+
+        cmt_encode_prometheus_remote_write_v2_destroy(compressed);
+    }
+
+    cmt_encode_prometheus_remote_write_destroy(v1_payload);
+    cmt_encode_prometheus_remote_write_v2_destroy(payload);
+    cmt_destroy(cmt);
+}
+
+/* Sample data plus a counter with enough series to need several payloads */
+static struct cmt *generate_split_test_data()
+{
+    int                 index;
+    char                host[32];
+    uint64_t            ts;
+    struct cmt         *cmt;
+    struct cmt_counter *c1;
+
+    ts = cfl_time_now();
+
+    cmt = generate_encoder_test_data_with_timestamp(ts);
+
+    if (cmt == NULL) {
+        return NULL;
+    }
+
+    c1 = cmt_counter_create(cmt, "kubernetes", "network", "requests",
+                            "Requests per host", 1, (char *[]) {"hostname"});
+
+    for (index = 0 ; index < 64 ; index++) {
+        snprintf(host, sizeof(host) - 1, "host-%03d", index);
+
+        cmt_counter_add(c1, ts, index, 1, (char *[]) {host});
+    }
+
+    return cmt;
+}
+
+/* Length of a metric name without the suffix of a synthesized series */
+static size_t remote_write_family_name_length(char *name)
+{
+    size_t  index;
+    size_t  length;
+    size_t  suffix_length;
+    char   *suffixes[] = {"_bucket", "_count", "_sum"};
+
+    length = strlen(name);
+
+    for (index = 0 ; index < sizeof(suffixes) / sizeof(suffixes[0]) ; index++) {
+        suffix_length = strlen(suffixes[index]);
+
+        if (length > suffix_length &&
+            strcmp(&name[length - suffix_length], suffixes[index]) == 0) {
+            return length - suffix_length;
+        }
+    }
+
+    return length;
+}
+
+/* Every metadata entry of a payload must describe a family of its time series */
+static int remote_write_metadata_matches_series(Prometheus__WriteRequest *request)
+{
+    size_t             metadata_index;
+    size_t             series_index;
+    size_t             label_index;
+    size_t             length;
+    int                found;
+    char              *name;
+    Prometheus__Label *label;
+
+    for (metadata_index = 0 ; metadata_index < request->n_metadata ; metadata_index++) {
+        name = request->metadata[metadata_index]->metric_family_name;
+        length = remote_write_family_name_length(name);
+        found = CMT_FALSE;
+
+        for (series_index = 0 ;
+             found == CMT_FALSE && series_index < request->n_timeseries ;
+             series_index++) {
+            for (label_index = 0 ;
+                 label_index < request->timeseries[series_index]->n_labels ;
+                 label_index++) {
+                label = request->timeseries[series_index]->labels[label_index];
+
+                if (strcmp(label->name, "__name__") == 0 &&
+                    remote_write_family_name_length(label->value) == length &&
+                    strncmp(label->value, name, length) == 0) {
+                    found = CMT_TRUE;
+                    break;
+                }
+            }
+        }
+
+        if (found == CMT_FALSE) {
+            return CMT_FALSE;
+        }
+    }
+
+    return CMT_TRUE;
+}
+
+void test_prometheus_remote_write_split()
+{
+    int                              result;
+    size_t                           length;
+    size_t                           series_count;
+    size_t                           payload_count;
+    char                            *uncompressed;
+    cfl_sds_t                        full_payload;
+    struct cmt                      *cmt;
+    struct cfl_list                 *payloads;
+    struct cfl_list                 *head;
+    struct cmt_encode_split_payload *payload;
+    Prometheus__WriteRequest        *request;
+    Prometheus__WriteRequest        *full_request;
+
+    cmt_initialize();
+
+    cmt = generate_split_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    full_payload = cmt_encode_prometheus_remote_write_create(cmt);
+    full_request = decode_remote_write_payload(full_payload);
+    TEST_CHECK(full_request != NULL);
+
+    if (full_request == NULL) {
+        cmt_encode_prometheus_remote_write_destroy(full_payload);
+        cmt_destroy(cmt);
+        return;
+    }
+
+    /* series budget */
+    payloads = cmt_encode_prometheus_remote_write_create_split(cmt, 0, 10);
+    TEST_CHECK(payloads != NULL);
+
+    series_count = 0;
+    payload_count = 0;
+
+    cfl_list_foreach(head, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        request = decode_remote_write_payload(payload->data);
+        TEST_CHECK(request != NULL);
+
+        if (request != NULL) {
+            TEST_CHECK(request->n_timeseries == payload->series_count);
+            TEST_CHECK(request->n_timeseries <= 10);
+            prometheus__write_request__free_unpacked(request, NULL);
+        }
+
+        series_count += payload->series_count;
+        payload_count++;
+    }
+
+    TEST_CHECK(series_count == full_request->n_timeseries);
+    TEST_CHECK(payload_count == (full_request->n_timeseries + 9) / 10);
+    cmt_encode_split_destroy(payloads);
+
+    /* size budget */
+    payloads = cmt_encode_prometheus_remote_write_create_split(cmt, 512, 0);
+    TEST_CHECK(payloads != NULL);
+
+    series_count = 0;
+    payload_count = 0;
+
+    cfl_list_foreach(head, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        TEST_CHECK(cfl_sds_len(payload->data) <= 512);
+        TEST_MSG("payload size: %zu", cfl_sds_len(payload->data));
+
+        request = decode_remote_write_payload(payload->data);
+        TEST_CHECK(request != NULL);
+
+        if (request != NULL) {
+            TEST_CHECK(request->n_timeseries == payload->series_count);
+            TEST_CHECK(request->n_metadata <= full_request->n_metadata);
+            TEST_CHECK(remote_write_metadata_matches_series(request) == CMT_TRUE);
+            prometheus__write_request__free_unpacked(request, NULL);
+        }
+
+        series_count += payload->series_count;
+        payload_count++;
+    }
+
+    TEST_CHECK(series_count == full_request->n_timeseries);
+    TEST_CHECK(payload_count > 1);
+    cmt_encode_split_destroy(payloads);
+
+    /* compressed payloads are independent snappy blocks */
+    payloads = cmt_encode_prometheus_remote_write_create_split_compressed(cmt, 1024, 0);
+    TEST_CHECK(payloads != NULL);
+
+    series_count = 0;
+
+    cfl_list_foreach(head, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        result = cmt_snappy_uncompressed_length(payload->data,
+                                                cfl_sds_len(payload->data),
+                                                &length);
+        TEST_CHECK(result == CMT_SNAPPY_SUCCESS);
+        TEST_CHECK(length <= 1024);
+
+        uncompressed = malloc(length + 1);
+        TEST_CHECK(uncompressed != NULL);
+
+        if (uncompressed == NULL) {
+            break;
+        }
+
+        result = cmt_snappy_uncompress(payload->data, cfl_sds_len(payload->data),
+                                       uncompressed, length, &length);
+        TEST_CHECK(result == CMT_SNAPPY_SUCCESS);
+
+        request = prometheus__write_request__unpack(NULL, length,
+                                                    (uint8_t *) uncompressed);
+        TEST_CHECK(request != NULL);
+
+        if (request != NULL) {
+            TEST_CHECK(remote_write_metadata_matches_series(request) == CMT_TRUE);
+            series_count += request->n_timeseries;
+            prometheus__write_request__free_unpacked(request, NULL);
+        }
+
+        free(uncompressed);
+    }
+
+    TEST_CHECK(series_count == full_request->n_timeseries);
+    cmt_encode_split_destroy(payloads);
+
+    prometheus__write_request__free_unpacked(full_request, NULL);
+    cmt_encode_prometheus_remote_write_destroy(full_payload);
+    cmt_destroy(cmt);
+}
+
+static size_t count_otlp_data_points(cfl_sds_t payload)
+{
+    size_t                                          count;
+    size_t                                          resource_index;
+    size_t                                          scope_index;
+    size_t                                          metric_index;
+    Opentelemetry__Proto__Metrics__V1__Metric      *metric;
+    Opentelemetry__Proto__Metrics__V1__ScopeMetrics *scope_metrics;
+    Opentelemetry__Proto__Metrics__V1__MetricsData *metrics_data;
+
+    metrics_data = opentelemetry__proto__metrics__v1__metrics_data__unpack(
+                        NULL, cfl_sds_len(payload), (uint8_t *) payload);
+
+    if (metrics_data == NULL) {
+        return 0;
+    }
+
+    count = 0;
+
+    for (resource_index = 0 ;
+         resource_index < metrics_data->n_resource_metrics ;
+         resource_index++) {
+        for (scope_index = 0 ;
+             scope_index < metrics_data->resource_metrics[resource_index]->n_scope_metrics ;
+             scope_index++) {
+            scope_metrics = metrics_data->resource_metrics[resource_index]->scope_metrics[scope_index];
+
+            for (metric_index = 0 ; metric_index < scope_metrics->n_metrics ; metric_index++) {
+                metric = scope_metrics->metrics[metric_index];
+
+                if (metric->sum != NULL) {
+                    count += metric->sum->n_data_points;
+                }
+                else if (metric->gauge != NULL) {
+                    count += metric->gauge->n_data_points;
+                }
+                else if (metric->summary != NULL) {
+                    count += metric->summary->n_data_points;
+                }
+                else if (metric->histogram != NULL) {
+                    count += metric->histogram->n_data_points;
+                }
+                else if (metric->exponential_histogram != NULL) {
+                    count += metric->exponential_histogram->n_data_points;
+                }
+            }
+        }
+    }
+
+    opentelemetry__proto__metrics__v1__metrics_data__free_unpacked(metrics_data, NULL);
+
+    return count;
+}
+
+void test_opentelemetry_split()
+{
+    int                              result;
+    size_t                           offset;
+    size_t                           total_count;
+    size_t                           series_count;
+    size_t                           payload_count;
+    cfl_sds_t                        full_payload;
+    struct cmt                      *cmt;
+    struct cfl_list                  decoded_list;
+    struct cfl_list                 *payloads;
+    struct cfl_list                 *head;
+    struct cmt_encode_split_payload *payload;
+
+    cmt_initialize();
+
+    cmt = generate_split_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    full_payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(full_payload != NULL);
+
+    total_count = count_otlp_data_points(full_payload);
+    TEST_CHECK(total_count > 64);
+
+    payloads = cmt_encode_opentelemetry_create_split(cmt, 768, 0);
+    TEST_CHECK(payloads != NULL);
+
+    series_count = 0;
+    payload_count = 0;
+
+    cfl_list_foreach(head, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        TEST_CHECK(cfl_sds_len(payload->data) <= 768 || payload->series_count == 1);
+        TEST_MSG("payload size: %zu", cfl_sds_len(payload->data));
+        TEST_CHECK(count_otlp_data_points(payload->data) == payload->series_count);
+
+        offset = 0;
+        result = cmt_decode_opentelemetry_create(&decoded_list, payload->data,
+                                                 cfl_sds_len(payload->data),
+                                                 &offset);
+        TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            cmt_decode_opentelemetry_destroy(&decoded_list);
+        }
+
+        series_count += payload->series_count;
+        payload_count++;
+    }
+
+    TEST_CHECK(series_count == total_count);
+    TEST_CHECK(payload_count > 1);
+    cmt_encode_split_destroy(payloads);
+
+    payloads = cmt_encode_opentelemetry_create_split(cmt, 0, 7);
+    TEST_CHECK(payloads != NULL);
+
+    series_count = 0;
+    payload_count = 0;
+
+    cfl_list_foreach(head, payloads) {
+        payload = cfl_list_entry(head, struct cmt_encode_split_payload, _head);
+
+        TEST_CHECK(payload->series_count <= 7);
+        TEST_CHECK(count_otlp_data_points(payload->data) == payload->series_count);
+
+        series_count += payload->series_count;
+        payload_count++;
+    }
+
+    TEST_CHECK(series_count == total_count);
+    TEST_CHECK(payload_count == (total_count + 6) / 7);
+    cmt_encode_split_destroy(payloads);
+
+    cmt_encode_opentelemetry_destroy(full_payload);
+    cmt_destroy(cmt);
+}
+
 void test_opentelemetry()
 {
     cfl_sds_t payload;
@@ -1345,6 +2452,53 @@ void test_prometheus_histogram_bucket_decimal_label()
     cmt_destroy(cmt);
 }
 
+void test_prometheus_protobuf()
+{
+    cfl_sds_t payload;
+    struct cmt *cmt;
+    struct cmt_counter *c;
+
+    /* size prefixed MetricFamily with a single counter metric */
+    const unsigned char expected[] = {
+        0x28,
+        0x0a, 0x11, 'c', 'm', 't', '_', 'p', 'r', 'o', 't', 'o', 'b', 'u', 'f',
+                    '_', 't', 'e', 's', 't',
+        0x12, 0x04, 'h', 'e', 'l', 'p',
+        0x18, 0x00,
+        0x22, 0x0b,
+            0x1a, 0x09,
+                0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x3f
+    };
+
+    cmt_initialize();
+
+    cmt = cmt_create();
+    TEST_CHECK(cmt != NULL);
+
+    c = cmt_counter_create(cmt, "cmt", "protobuf", "test", "help", 0, NULL);
+    TEST_CHECK(c != NULL);
+    cmt_counter_inc(c, 0, 0, NULL);
+
+    payload = cmt_encode_prometheus_protobuf_create(cmt, CMT_FALSE);
+    TEST_CHECK(payload != NULL);
+    TEST_CHECK(cfl_sds_len(payload) == sizeof(expected));
+    if (cfl_sds_len(payload) == sizeof(expected)) {
+        TEST_CHECK(memcmp(payload, expected, sizeof(expected)) == 0);
+    }
+    cmt_encode_prometheus_protobuf_destroy(payload);
+
+    /* the label pair is packed in the metric, the frame grows accordingly */
+    cmt_label_add(cmt, "dev", "Calyptia");
+    payload = cmt_encode_prometheus_protobuf_create(cmt, CMT_TRUE);
+    TEST_CHECK(payload != NULL);
+    TEST_CHECK((unsigned char) payload[0] + 1 == cfl_sds_len(payload));
+    TEST_CHECK(memmem(payload, cfl_sds_len(payload), "\x0a\x03" "dev" "\x12\x08" "Calyptia",
+                      15) != NULL);
+    cmt_encode_prometheus_protobuf_destroy(payload);
+
+    cmt_destroy(cmt);
+}
+
 void test_text()
 {
     uint64_t ts;
@@ -1814,15 +2968,23 @@ TEST_LIST = {
     {"prometheus_remote_write_continues_after_stale_family", test_prometheus_remote_write_continues_after_stale_family},
     {"prometheus_remote_write_preserves_future_samples", test_prometheus_remote_write_preserves_future_samples},
     {"prometheus_remote_write_skips_only_stale_histograms", test_prometheus_remote_write_skips_only_stale_histograms},
+    {"prometheus_remote_write_v2",     test_prometheus_remote_write_v2},
+    {"prometheus_remote_write_split",  test_prometheus_remote_write_split},
     {"cmt_msgpack_stability",          test_cmt_to_msgpack_stability},
     {"cmt_msgpack_integrity",          test_cmt_to_msgpack_integrity},
     {"cmt_msgpack_labels",             test_cmt_to_msgpack_labels},
     {"cmt_msgpack_metric_unit_roundtrip", test_cmt_msgpack_metric_unit_roundtrip},
     {"cmt_msgpack",                    test_cmt_to_msgpack},
+    {"cmt_msgpack_compact",            test_cmt_to_msgpack_compact},
+    {"cmt_msgpack_view",               test_cmt_msgpack_view},
+    {"cmt_msgpack_parallel_decode",    test_cmt_msgpack_parallel_decode},
+    {"cmt_msgpack_merge",              test_cmt_msgpack_merge},
     {"opentelemetry",                  test_opentelemetry},
+    {"opentelemetry_split",            test_opentelemetry_split},
     {"cloudwatch_emf",                 test_cloudwatch_emf},
     {"prometheus",                     test_prometheus},
     {"prometheus_histogram_bucket_decimal_label", test_prometheus_histogram_bucket_decimal_label},
+    {"prometheus_protobuf",            test_prometheus_protobuf},
     {"text",                           test_text},
     {"influx",                         test_influx},
     {"influx_without_namespaces",      test_influx_without_namespaces},
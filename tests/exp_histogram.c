@@ -27,10 +27,13 @@
 #include <cmetrics/cmt_decode_msgpack.h>
 #include <cmetrics/cmt_encode_text.h>
 #include <cmetrics/cmt_encode_prometheus.h>
+#include <cmetrics/cmt_encode_prometheus_protobuf.h>
 #include <cmetrics/cmt_encode_influx.h>
 #include <cmetrics/cmt_encode_splunk_hec.h>
 #include <cmetrics/cmt_encode_cloudwatch_emf.h>
 #include <cmetrics/cmt_encode_prometheus_remote_write.h>
+#include <cmetrics/cmt_decode_prometheus_remote_write.h>
+#include <cmetrics/cmt_encode_prometheus_remote_write_v2.h>
 #include <cmetrics/cmt_encode_opentelemetry.h>
 
 #include <math.h>
@@ -199,6 +202,20 @@ static struct cmt_exp_histogram *create_test_metric_custom(
     return exp_histogram;
 }
 
+static int payload_contains(cfl_sds_t payload, const unsigned char *pattern,
+                            size_t pattern_size)
+{
+    size_t index;
+
+    for (index = 0; index + pattern_size <= cfl_sds_len(payload); index++) {
+        if (memcmp(&payload[index], pattern, pattern_size) == 0) {
+            return CMT_TRUE;
+        }
+    }
+
+    return CMT_FALSE;
+}
+
 static int get_prometheus_bucket_value(cfl_sds_t encoded_prometheus,
                                        const char *le,
                                        double *out_value)
@@ -398,6 +415,57 @@ void test_exp_histogram_msgpack_roundtrip()
     cmt_encode_msgpack_destroy(packed_buffer);
 }
 
+void test_exp_histogram_msgpack_compact_roundtrip()
+{
+    int result;
+    size_t offset;
+    char *packed_buffer;
+    size_t packed_size;
+    char *compact_buffer;
+    size_t compact_size;
+    char *repacked_buffer;
+    size_t repacked_size;
+    struct cmt *input_context;
+    struct cmt *output_context;
+
+    cmt_initialize();
+
+    input_context = cmt_create();
+    TEST_CHECK(input_context != NULL);
+    TEST_CHECK(create_test_metric(input_context, 123) != NULL);
+
+    result = cmt_encode_msgpack_create(input_context, &packed_buffer, &packed_size);
+    TEST_CHECK(result == 0);
+
+    result = cmt_encode_msgpack_compact_create(input_context,
+                                               &compact_buffer, &compact_size);
+    TEST_CHECK(result == 0);
+
+    offset = 0;
+    output_context = NULL;
+    result = cmt_decode_msgpack_create(&output_context, compact_buffer, compact_size, &offset);
+    TEST_CHECK(result == CMT_DECODE_MSGPACK_SUCCESS);
+    TEST_CHECK(output_context != NULL);
+
+    if (output_context != NULL) {
+        result = cmt_encode_msgpack_create(output_context,
+                                           &repacked_buffer, &repacked_size);
+        TEST_CHECK(result == 0);
+        TEST_CHECK(repacked_size == packed_size);
+
+        if (repacked_size == packed_size) {
+            TEST_CHECK(memcmp(repacked_buffer, packed_buffer, packed_size) == 0);
+        }
+
+        cmt_encode_msgpack_destroy(repacked_buffer);
+        cmt_decode_msgpack_destroy(output_context);
+    }
+
+    cmt_destroy(input_context);
+    cmt_encode_msgpack_destroy(packed_buffer);
+    cmt_encode_msgpack_destroy(compact_buffer);
+}
+
 void test_exp_histogram_encoder_smoke()
 {
     int result;
@@ -755,6 +823,7 @@ void test_exp_histogram_remote_write_no_sum()
     cfl_sds_t encoded_remote_write;
     struct cmt *context;
     Prometheus__WriteRequest *request;
+    Prometheus__Histogram *histogram;
 
     cmt_initialize();
 
@@ -778,9 +847,39 @@ void test_exp_histogram_remote_write_no_sum()
                                                     (uint8_t *) encoded_remote_write);
         TEST_CHECK(request != NULL);
         if (request != NULL) {
-            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist_count") == CMT_TRUE);
-            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist_sum") == CMT_FALSE);
-            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist_bucket") == CMT_TRUE);
+            /* a single native histogram series replaces the classic ones */
+            TEST_CHECK(request->n_timeseries == 1);
+            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist") == CMT_TRUE);
+            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist_count") == CMT_FALSE);
+            TEST_CHECK(remote_write_contains_metric_name(request, "cm_native_exp_hist_bucket") == CMT_FALSE);
+
+            if (request->n_timeseries == 1 &&
+                request->timeseries[0]->n_histograms == 1) {
+                histogram = request->timeseries[0]->histograms[0];
+
+                TEST_CHECK(request->timeseries[0]->n_samples == 0);
+                TEST_CHECK(histogram->schema == 2);
+                TEST_CHECK(histogram->count_int == 29);
+                TEST_CHECK(histogram->zero_count_int == 11);
+                TEST_CHECK(histogram->sum == 0.0);
+                TEST_CHECK(histogram->n_negative_spans == 1);
+                TEST_CHECK(histogram->n_negative_deltas == 2);
+                TEST_CHECK(histogram->n_positive_spans == 1);
+                TEST_CHECK(histogram->n_positive_deltas == 3);
+
+                if (histogram->n_positive_spans == 1 &&
+                    histogram->n_positive_deltas == 3) {
+                    TEST_CHECK(histogram->positive_spans[0]->offset == -1);
+                    TEST_CHECK(histogram->positive_spans[0]->length == 3);
+                    TEST_CHECK(histogram->positive_deltas[0] == 3);
+                    TEST_CHECK(histogram->positive_deltas[1] == 2);
+                    TEST_CHECK(histogram->positive_deltas[2] == 2);
+                }
+            }
+            else {
+                TEST_CHECK(CMT_FALSE);
+            }
+
             prometheus__write_request__free_unpacked(request, NULL);
         }
     }
@@ -789,13 +888,281 @@ void test_exp_histogram_remote_write_no_sum()
     cmt_destroy(context);
 }
 
+static struct cmt_metric *remote_write_roundtrip_metric(struct cmt *context,
+                                                        struct cmt **decoded)
+{
+    int result;
+    cfl_sds_t encoded;
+    struct cmt_exp_histogram *exp_histogram;
+
+    *decoded = NULL;
+
+    encoded = cmt_encode_prometheus_remote_write_create(context);
+    TEST_CHECK(encoded != NULL);
+    if (encoded == NULL) {
+        return NULL;
+    }
+
+    result = cmt_decode_prometheus_remote_write_create(decoded, encoded,
+                                                       cfl_sds_len(encoded));
+    cmt_encode_prometheus_remote_write_destroy(encoded);
+
+    TEST_CHECK(result == CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS);
+    if (result != CMT_DECODE_PROMETHEUS_REMOTE_WRITE_SUCCESS) {
+        return NULL;
+    }
+
+    TEST_CHECK(cfl_list_size(&(*decoded)->histograms) == 0);
+    TEST_CHECK(cfl_list_size(&(*decoded)->exp_histograms) == 1);
+    if (cfl_list_size(&(*decoded)->exp_histograms) != 1) {
+        return NULL;
+    }
+
+    exp_histogram = cfl_list_entry_first(&(*decoded)->exp_histograms,
+                                         struct cmt_exp_histogram, _head);
+    TEST_CHECK(strcmp(exp_histogram->opts.name, "cm_native_exp_hist") == 0);
+    TEST_CHECK(cfl_list_size(&exp_histogram->map->metrics) == 1);
+    if (cfl_list_size(&exp_histogram->map->metrics) != 1) {
+        return NULL;
+    }
+
+    return cfl_list_entry_first(&exp_histogram->map->metrics,
+                                struct cmt_metric, _head);
+}
+
+void test_exp_histogram_remote_write_native_roundtrip()
+{
+    int index;
+    uint64_t timestamp;
+    uint64_t positive[6] = {2, 0, 0, 0, 3, 1};
+    uint64_t negative[1] = {4};
+    uint64_t fine_positive[5] = {1, 1, 1, 1, 1};
+    struct cmt *context;
+    struct cmt *decoded;
+    struct cmt_metric *metric;
+
+    cmt_initialize();
+
+    /* remote write carries milliseconds */
+    timestamp = cfl_time_now() / 1000000 * 1000000;
+
+    /* the empty buckets split the positive side in two spans */
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, timestamp,
+                                         0, 1, 0.25,
+                                         -1, 6, positive,
+                                         0, 1, negative,
+                                         CMT_TRUE, 10.5, 11) != NULL);
+
+    metric = remote_write_roundtrip_metric(context, &decoded);
+    TEST_CHECK(metric != NULL);
+    if (metric != NULL) {
+        TEST_CHECK(cmt_metric_get_timestamp(metric) == timestamp);
+        TEST_CHECK(metric->exp_hist_scale == 0);
+        TEST_CHECK(metric->exp_hist_zero_count == 1);
+        TEST_CHECK(metric->exp_hist_zero_threshold == 0.25);
+        TEST_CHECK(metric->exp_hist_count == 11);
+        TEST_CHECK(metric->exp_hist_sum_set == CMT_TRUE);
+        TEST_CHECK(cmt_math_uint64_to_d64(metric->exp_hist_sum) == 10.5);
+        TEST_CHECK(metric->exp_hist_positive_offset == -1);
+        TEST_CHECK(metric->exp_hist_positive_count == 6);
+        TEST_CHECK(metric->exp_hist_negative_offset == 0);
+        TEST_CHECK(metric->exp_hist_negative_count == 1);
+
+        if (metric->exp_hist_positive_count == 6) {
+            for (index = 0 ; index < 6 ; index++) {
+                TEST_CHECK(metric->exp_hist_positive_buckets[index] == positive[index]);
+            }
+        }
+
+        if (metric->exp_hist_negative_count == 1) {
+            TEST_CHECK(metric->exp_hist_negative_buckets[0] == 4);
+        }
+    }
+
+    cmt_decode_prometheus_remote_write_destroy(decoded);
+    cmt_destroy(context);
+
+    /* scale 10 comes back as schema 8 with four buckets merged into one */
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, timestamp,
+                                         10, 0, 0.0,
+                                         0, 5, fine_positive,
+                                         0, 0, NULL,
+                                         CMT_TRUE, 5.0, 5) != NULL);
+
+    metric = remote_write_roundtrip_metric(context, &decoded);
+    TEST_CHECK(metric != NULL);
+    if (metric != NULL) {
+        TEST_CHECK(metric->exp_hist_scale == 8);
+        TEST_CHECK(metric->exp_hist_count == 5);
+        TEST_CHECK(metric->exp_hist_positive_offset == 0);
+        TEST_CHECK(metric->exp_hist_positive_count == 2);
+        TEST_CHECK(metric->exp_hist_negative_count == 0);
+
+        if (metric->exp_hist_positive_count == 2) {
+            TEST_CHECK(metric->exp_hist_positive_buckets[0] == 4);
+            TEST_CHECK(metric->exp_hist_positive_buckets[1] == 1);
+        }
+    }
+
+    cmt_decode_prometheus_remote_write_destroy(decoded);
+    cmt_destroy(context);
+}
+
+void test_exp_histogram_prometheus_protobuf_native()
+{
+    uint64_t positive[6] = {2, 0, 0, 0, 3, 1};
+    uint64_t negative[1] = {4};
+    uint64_t fine_positive[5] = {1, 1, 1, 1, 1};
+    cfl_sds_t encoded;
+    struct cmt *context;
+
+    /* schema 0, zero count 1 */
+    const unsigned char schema[] = {0x28, 0x00};
+    const unsigned char zero_count[] = {0x38, 0x01};
+    /* negative span {offset 1, length 1}, delta 4 */
+    const unsigned char negative_span[] = {0x4a, 0x04, 0x08, 0x02, 0x10, 0x01};
+    const unsigned char negative_delta[] = {0x52, 0x01, 0x08};
+    /* the three empty buckets split the positive buckets in two spans */
+    const unsigned char positive_span_1[] = {0x62, 0x04, 0x08, 0x00, 0x10, 0x01};
+    const unsigned char positive_span_2[] = {0x62, 0x04, 0x08, 0x06, 0x10, 0x02};
+    const unsigned char positive_delta[] = {0x6a, 0x03, 0x04, 0x02, 0x03};
+    /* scale 10 is reduced to schema 8 merging four buckets into one */
+    const unsigned char reduced_schema[] = {0x28, 0x10};
+    const unsigned char reduced_span[] = {0x62, 0x04, 0x08, 0x02, 0x10, 0x02};
+    const unsigned char reduced_delta[] = {0x6a, 0x02, 0x08, 0x05};
+
+    cmt_initialize();
+
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, cfl_time_now(),
+                                         0, 1, 0.0,
+                                         -1, 6, positive,
+                                         0, 1, negative,
+                                         CMT_TRUE, 10.5, 11) != NULL);
+
+    encoded = cmt_encode_prometheus_protobuf_create(context, CMT_FALSE);
+    TEST_CHECK(encoded != NULL);
+    if (encoded != NULL) {
+        TEST_CHECK(payload_contains(encoded, schema, sizeof(schema)));
+        TEST_CHECK(payload_contains(encoded, zero_count, sizeof(zero_count)));
+        TEST_CHECK(payload_contains(encoded, negative_span, sizeof(negative_span)));
+        TEST_CHECK(payload_contains(encoded, negative_delta, sizeof(negative_delta)));
+        TEST_CHECK(payload_contains(encoded, positive_span_1, sizeof(positive_span_1)));
+        TEST_CHECK(payload_contains(encoded, positive_span_2, sizeof(positive_span_2)));
+        TEST_CHECK(payload_contains(encoded, positive_delta, sizeof(positive_delta)));
+        TEST_CHECK(strstr(encoded, "_bucket") == NULL);
+    }
+    cmt_encode_prometheus_protobuf_destroy(encoded);
+    cmt_destroy(context);
+
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, cfl_time_now(),
+                                         10, 0, 0.0,
+                                         0, 5, fine_positive,
+                                         0, 0, NULL,
+                                         CMT_TRUE, 5.0, 5) != NULL);
+
+    encoded = cmt_encode_prometheus_protobuf_create(context, CMT_FALSE);
+    TEST_CHECK(encoded != NULL);
+    if (encoded != NULL) {
+        TEST_CHECK(payload_contains(encoded, reduced_schema, sizeof(reduced_schema)));
+        TEST_CHECK(payload_contains(encoded, reduced_span, sizeof(reduced_span)));
+        TEST_CHECK(payload_contains(encoded, reduced_delta, sizeof(reduced_delta)));
+    }
+    cmt_encode_prometheus_protobuf_destroy(encoded);
+    cmt_destroy(context);
+}
+
+void test_exp_histogram_prometheus_remote_write_v2_native()
+{
+    uint64_t positive[6] = {2, 0, 0, 0, 3, 1};
+    uint64_t negative[1] = {4};
+    cfl_sds_t encoded;
+    struct cmt *context;
+
+    /* count 11, schema 0, zero count 1 */
+    const unsigned char count[] = {0x08, 0x0b};
+    const unsigned char schema[] = {0x20, 0x00};
+    const unsigned char zero_count[] = {0x30, 0x01};
+    /* negative span {offset 1, length 1}, delta 4 */
+    const unsigned char negative_span[] = {0x42, 0x04, 0x08, 0x02, 0x10, 0x01};
+    const unsigned char negative_delta[] = {0x4a, 0x01, 0x08};
+    /* the three empty buckets split the positive buckets in two spans */
+    const unsigned char positive_span_1[] = {0x5a, 0x04, 0x08, 0x00, 0x10, 0x01};
+    const unsigned char positive_span_2[] = {0x5a, 0x04, 0x08, 0x06, 0x10, 0x02};
+    const unsigned char positive_delta[] = {0x62, 0x03, 0x04, 0x02, 0x03};
+    /* metadata with the histogram type */
+    const unsigned char metadata_type[] = {0x08, 0x03};
+
+    cmt_initialize();
+
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, cfl_time_now(),
+                                         0, 1, 0.0,
+                                         -1, 6, positive,
+                                         0, 1, negative,
+                                         CMT_TRUE, 10.5, 11) != NULL);
+
+    encoded = cmt_encode_prometheus_remote_write_v2_create(context);
+    TEST_CHECK(encoded != NULL);
+    if (encoded != NULL) {
+        TEST_CHECK(payload_contains(encoded, count, sizeof(count)));
+        TEST_CHECK(payload_contains(encoded, schema, sizeof(schema)));
+        TEST_CHECK(payload_contains(encoded, zero_count, sizeof(zero_count)));
+        TEST_CHECK(payload_contains(encoded, negative_span, sizeof(negative_span)));
+        TEST_CHECK(payload_contains(encoded, negative_delta, sizeof(negative_delta)));
+        TEST_CHECK(payload_contains(encoded, positive_span_1, sizeof(positive_span_1)));
+        TEST_CHECK(payload_contains(encoded, positive_span_2, sizeof(positive_span_2)));
+        TEST_CHECK(payload_contains(encoded, positive_delta, sizeof(positive_delta)));
+        TEST_CHECK(payload_contains(encoded, metadata_type, sizeof(metadata_type)));
+        TEST_CHECK(payload_contains(encoded, (const unsigned char *) "_bucket", 7) == CMT_FALSE);
+    }
+    cmt_encode_prometheus_remote_write_v2_destroy(encoded);
+    cmt_destroy(context);
+
+    /* a scale below the lowest schema is sent as classic buckets */
+    context = cmt_create();
+    TEST_CHECK(context != NULL);
+
+    TEST_CHECK(create_test_metric_custom(context, cfl_time_now(),
+                                         -5, 0, 0.0,
+                                         0, 6, positive,
+                                         0, 0, NULL,
+                                         CMT_TRUE, 10.5, 6) != NULL);
+
+    encoded = cmt_encode_prometheus_remote_write_v2_create(context);
+    TEST_CHECK(encoded != NULL);
+    if (encoded != NULL) {
+        TEST_CHECK(payload_contains(encoded, (const unsigned char *) "_bucket", 7));
+        TEST_CHECK(payload_contains(encoded, (const unsigned char *) "+Inf", 4));
+    }
+    cmt_encode_prometheus_remote_write_v2_destroy(encoded);
+    cmt_destroy(context);
+}
+
 TEST_LIST = {
     {"exp_histogram_msgpack_roundtrip", test_exp_histogram_msgpack_roundtrip},
+    {"exp_histogram_msgpack_compact_roundtrip", test_exp_histogram_msgpack_compact_roundtrip},
     {"exp_histogram_encoder_smoke",     test_exp_histogram_encoder_smoke},
     {"exp_histogram_nonzero_zero_threshold", test_exp_histogram_nonzero_zero_threshold},
     {"exp_histogram_cat_filter_smoke",  test_exp_histogram_cat_filter_smoke},
     {"exp_histogram_cat_sparse_merge",  test_exp_histogram_cat_sparse_merge},
     {"exp_histogram_prometheus_no_sum", test_exp_histogram_prometheus_no_sum},
     {"exp_histogram_remote_write_no_sum", test_exp_histogram_remote_write_no_sum},
+    {"exp_histogram_remote_write_native_roundtrip", test_exp_histogram_remote_write_native_roundtrip},
+    {"exp_histogram_prometheus_protobuf_native", test_exp_histogram_prometheus_protobuf_native},
+    {"exp_histogram_prometheus_remote_write_v2_native", test_exp_histogram_prometheus_remote_write_v2_native},
     { 0 }
 };
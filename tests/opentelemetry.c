@@ -30,6 +30,8 @@
 #include <cmetrics/cmt_encode_prometheus.h>
 #include <cmetrics/cmt_decode_opentelemetry.h>
 #include <cmetrics/cmt_encode_opentelemetry.h>
+#include <cmetrics/cmt_encode_split.h>
+#include <cmetrics/cmt_cat.h>
 #include <cmetrics/cmt_encode_msgpack.h>
 #include <cmetrics/cmt_decode_msgpack.h>
 
@@ -1993,6 +1995,752 @@ static void test_opentelemetry_omitted_null_key_label_encoded(void)
     cmt_destroy(cmt);
 }
 
+/*
+ * The direct wire format encoder must produce exactly the bytes the protobuf-c
+ * tree encoder (still used by the split variant) produces.
+ */
+static void check_direct_encoder_matches_tree(struct cmt *cmt)
+{
+    cfl_sds_t                        payload;
+    struct cfl_list                 *payloads;
+    struct cmt_encode_split_payload *split_payload;
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(payload != NULL);
+
+    payloads = cmt_encode_opentelemetry_create_split(cmt, 0, 0);
+    TEST_CHECK(payloads != NULL);
+
+    if (payload != NULL && payloads != NULL) {
+        TEST_CHECK(cfl_list_size(payloads) == 1);
+
+        split_payload = cfl_list_entry_first(payloads,
+                                             struct cmt_encode_split_payload,
+                                             _head);
+
+        TEST_CHECK(cfl_sds_len(split_payload->data) == cfl_sds_len(payload));
+        TEST_CHECK(memcmp(split_payload->data, payload, cfl_sds_len(payload)) == 0);
+    }
+
+    if (payloads != NULL) {
+        cmt_encode_split_destroy(payloads);
+    }
+
+    if (payload != NULL) {
+        cmt_encode_opentelemetry_destroy(payload);
+    }
+}
+
+void test_opentelemetry_direct_encoder_byte_equivalence()
+{
+    cfl_sds_t        payload;
+    cfl_sds_t        second_payload;
+    struct cfl_list  decoded_context_list;
+    struct cmt      *decoded_context;
+    struct cmt      *cmt;
+    size_t           offset;
+    int              result;
+
+    cmt_initialize();
+
+    /* Every metric type, static labels and unit */
+    cmt = generate_api_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    if (cmt == NULL) {
+        return;
+    }
+
+    TEST_CHECK(cmt_label_add(cmt, "static_key", "static_value") == 0);
+
+    check_direct_encoder_matches_tree(cmt);
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(payload != NULL);
+    cmt_destroy(cmt);
+
+    if (payload == NULL) {
+        return;
+    }
+
+    /* Decoded contexts carry the resource, scope and data point metadata */
+    offset = 0;
+    result = cmt_decode_opentelemetry_create(&decoded_context_list,
+                                             payload,
+                                             cfl_sds_len(payload),
+                                             &offset);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        decoded_context = cfl_list_entry_first(&decoded_context_list, struct cmt, _head);
+
+        check_direct_encoder_matches_tree(decoded_context);
+
+        second_payload = cmt_encode_opentelemetry_create(decoded_context);
+        TEST_CHECK(second_payload != NULL);
+
+        if (second_payload != NULL) {
+            TEST_CHECK(cfl_sds_len(second_payload) == cfl_sds_len(payload));
+            TEST_CHECK(memcmp(second_payload, payload, cfl_sds_len(payload)) == 0);
+
+            cmt_encode_opentelemetry_destroy(second_payload);
+        }
+
+        cmt_decode_opentelemetry_destroy(&decoded_context_list);
+    }
+
+    cmt_encode_opentelemetry_destroy(payload);
+
+    /* Exemplars, min/max and metric metadata */
+    payload = generate_exponential_histogram_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload == NULL) {
+        return;
+    }
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_create(&decoded_context_list,
+                                             payload,
+                                             cfl_sds_len(payload),
+                                             &offset);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        decoded_context = cfl_list_entry_first(&decoded_context_list, struct cmt, _head);
+
+        check_direct_encoder_matches_tree(decoded_context);
+
+        cmt_decode_opentelemetry_destroy(&decoded_context_list);
+    }
+
+    cfl_sds_destroy(payload);
+}
+
+static void check_arena_decoder_matches_default(cfl_sds_t payload)
+{
+    cfl_sds_t        expected;
+    cfl_sds_t        encoded;
+    struct cfl_list  default_list;
+    struct cfl_list  arena_list;
+    struct cfl_arena *arena;
+    struct cmt      *decoded_context;
+    struct cmt      *kept;
+    size_t           offset;
+    int              result;
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_create(&default_list,
+                                             payload, cfl_sds_len(payload),
+                                             &offset);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return;
+    }
+
+    decoded_context = cfl_list_entry_first(&default_list, struct cmt, _head);
+    expected = cmt_encode_opentelemetry_create(decoded_context);
+    TEST_CHECK(expected != NULL);
+    cmt_decode_opentelemetry_destroy(&default_list);
+
+    if (expected == NULL) {
+        return;
+    }
+
+    arena = cfl_arena_create(1024);
+    TEST_CHECK(arena != NULL);
+
+    if (arena == NULL) {
+        cmt_encode_opentelemetry_destroy(expected);
+        return;
+    }
+
+    kept = cmt_create();
+    TEST_CHECK(kept != NULL);
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_create_with_arena(&arena_list,
+                                                        payload,
+                                                        cfl_sds_len(payload),
+                                                        &offset,
+                                                        arena);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        TEST_CHECK(offset == 0);
+
+        decoded_context = cfl_list_entry_first(&arena_list, struct cmt, _head);
+
+        encoded = cmt_encode_opentelemetry_create(decoded_context);
+        TEST_CHECK(encoded != NULL);
+
+        if (encoded != NULL) {
+            TEST_CHECK(cfl_sds_len(encoded) == cfl_sds_len(expected));
+            TEST_CHECK(memcmp(encoded, expected, cfl_sds_len(expected)) == 0);
+            cmt_encode_opentelemetry_destroy(encoded);
+        }
+
+        /* samples copied with cmt_cat() survive the arena */
+        TEST_CHECK(cmt_cat(kept, decoded_context) == 0);
+
+        cmt_decode_opentelemetry_destroy(&arena_list);
+    }
+
+    cfl_arena_destroy(arena);
+
+    encoded = cmt_encode_text_create(kept);
+    TEST_CHECK(encoded != NULL);
+    if (encoded != NULL) {
+        TEST_CHECK(cfl_sds_len(encoded) > 0);
+        cmt_encode_text_destroy(encoded);
+    }
+
+    cmt_destroy(kept);
+    cmt_encode_opentelemetry_destroy(expected);
+}
+
+void test_opentelemetry_arena_decoder()
+{
+    cfl_sds_t        payload;
+    struct cfl_list  decoded_context_list;
+    struct cmt      *cmt;
+    size_t           offset;
+    int              result;
+
+    cmt_initialize();
+
+    cmt = generate_api_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    if (cmt == NULL) {
+        return;
+    }
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(payload != NULL);
+    cmt_destroy(cmt);
+
+    if (payload != NULL) {
+        check_arena_decoder_matches_default(payload);
+
+        offset = 0;
+        result = cmt_decode_opentelemetry_create_with_arena(&decoded_context_list,
+                                                            payload,
+                                                            cfl_sds_len(payload),
+                                                            &offset,
+                                                            NULL);
+        TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_INVALID_ARGUMENT_ERROR);
+        TEST_CHECK(cfl_list_is_empty(&decoded_context_list));
+
+        cmt_encode_opentelemetry_destroy(payload);
+    }
+
+    /* Resource, scope and metric metadata, exemplars */
+    payload = generate_exponential_histogram_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_arena_decoder_matches_default(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    /* More labels than the decoder keeps on the stack */
+    payload = generate_gauge_int_otlp_payload_with_many_attributes(130);
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_arena_decoder_matches_default(payload);
+        cfl_sds_destroy(payload);
+    }
+}
+
+static void check_stream_decoder_matches_default(cfl_sds_t payload)
+{
+    cfl_sds_t        expected;
+    cfl_sds_t        encoded;
+    struct cfl_list  default_list;
+    struct cfl_list  stream_list;
+    struct cfl_list *head;
+    struct cmt      *decoded_context;
+    size_t           offset;
+    int              result;
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_create(&default_list,
+                                             payload, cfl_sds_len(payload),
+                                             &offset);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return;
+    }
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_stream_create(&stream_list,
+                                                    payload, cfl_sds_len(payload),
+                                                    &offset, NULL, NULL);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        TEST_CHECK(cfl_list_size(&stream_list) == cfl_list_size(&default_list));
+
+        /* contexts are produced in the same order, compare them pairwise */
+        head = stream_list.next;
+
+        while (!cfl_list_is_empty(&default_list) && head != &stream_list) {
+            decoded_context = cfl_list_entry_first(&default_list, struct cmt, _head);
+            expected = cmt_encode_opentelemetry_create(decoded_context);
+
+            cfl_list_del(&decoded_context->_head);
+            cmt_destroy(decoded_context);
+
+            decoded_context = cfl_list_entry(head, struct cmt, _head);
+            encoded = cmt_encode_opentelemetry_create(decoded_context);
+
+            TEST_CHECK(expected != NULL && encoded != NULL);
+
+            if (expected != NULL && encoded != NULL) {
+                TEST_CHECK(cfl_sds_len(encoded) == cfl_sds_len(expected));
+                TEST_CHECK(memcmp(encoded, expected, cfl_sds_len(expected)) == 0);
+            }
+
+            if (expected != NULL) {
+                cmt_encode_opentelemetry_destroy(expected);
+            }
+
+            if (encoded != NULL) {
+                cmt_encode_opentelemetry_destroy(encoded);
+            }
+
+            head = head->next;
+        }
+
+        cmt_decode_opentelemetry_destroy(&stream_list);
+    }
+
+    cmt_decode_opentelemetry_destroy(&default_list);
+
+    /* a truncated request must be rejected */
+    offset = 0;
+    result = cmt_decode_opentelemetry_stream_create(&stream_list,
+                                                    payload, cfl_sds_len(payload) - 1,
+                                                    &offset, NULL, NULL);
+    TEST_CHECK(result != CMT_DECODE_OPENTELEMETRY_SUCCESS);
+}
+
+static int keep_histograms(void *context, const char *name, size_t length)
+{
+    int *calls;
+
+    calls = (int *) context;
+    (*calls)++;
+
+    if (length >= 9 && memcmp(&name[length - 9], "histogram", 9) == 0) {
+        return CMT_TRUE;
+    }
+
+    return CMT_FALSE;
+}
+
+void test_opentelemetry_stream_decoder()
+{
+    cfl_sds_t        payload;
+    struct cfl_list  decoded_context_list;
+    struct cmt      *decoded_context;
+    struct cmt      *cmt;
+    size_t           offset;
+    int              filter_calls;
+    int              result;
+    /* a metric with a description cut in the middle of the next tag */
+    char             truncated_metric[] = {0x0a, 0x08, 0x12, 0x06, 0x12, 0x04,
+                                           0x12, 0x01, 'd', (char) 0x80};
+
+    cmt_initialize();
+
+    cmt = generate_api_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    if (cmt == NULL) {
+        return;
+    }
+
+    TEST_CHECK(cmt_label_add(cmt, "static_key", "static_value") == 0);
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(payload != NULL);
+    cmt_destroy(cmt);
+
+    if (payload == NULL) {
+        return;
+    }
+
+    check_stream_decoder_matches_default(payload);
+
+    /* only histograms are decoded, other metrics are skipped */
+    filter_calls = 0;
+    offset = 0;
+    result = cmt_decode_opentelemetry_stream_create(&decoded_context_list,
+                                                    payload, cfl_sds_len(payload),
+                                                    &offset,
+                                                    &filter_calls, keep_histograms);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        TEST_CHECK(filter_calls == 6);
+
+        decoded_context = cfl_list_entry_first(&decoded_context_list, struct cmt, _head);
+
+        TEST_CHECK(cfl_list_is_empty(&decoded_context->counters));
+        TEST_CHECK(cfl_list_is_empty(&decoded_context->gauges));
+        TEST_CHECK(cfl_list_is_empty(&decoded_context->untypeds));
+        TEST_CHECK(cfl_list_is_empty(&decoded_context->summaries));
+        TEST_CHECK(cfl_list_size(&decoded_context->histograms) == 1);
+        TEST_CHECK(cfl_list_size(&decoded_context->exp_histograms) == 0);
+
+        cmt_decode_opentelemetry_destroy(&decoded_context_list);
+    }
+
+    cmt_encode_opentelemetry_destroy(payload);
+
+    /* Resource, scope and metric metadata, exemplars */
+    payload = generate_exponential_histogram_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_stream_decoder_matches_default(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    payload = generate_sum_non_monotonic_int_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_stream_decoder_matches_default(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    /* Metrics without a name or data are rejected like the tree decoder */
+    payload = generate_invalid_otlp_metric_payload(CMT_TRUE, CMT_FALSE);
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        offset = 0;
+        result = cmt_decode_opentelemetry_stream_create(&decoded_context_list,
+                                                        payload, cfl_sds_len(payload),
+                                                        &offset, NULL, NULL);
+        TEST_CHECK(result != CMT_DECODE_OPENTELEMETRY_SUCCESS);
+        cfl_sds_destroy(payload);
+    }
+
+    payload = generate_invalid_otlp_metric_payload(CMT_FALSE, CMT_TRUE);
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        offset = 0;
+        result = cmt_decode_opentelemetry_stream_create(&decoded_context_list,
+                                                        payload, cfl_sds_len(payload),
+                                                        &offset, NULL, NULL);
+        TEST_CHECK(result != CMT_DECODE_OPENTELEMETRY_SUCCESS);
+        cfl_sds_destroy(payload);
+    }
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_stream_create(&decoded_context_list,
+                                                    truncated_metric,
+                                                    sizeof(truncated_metric),
+                                                    &offset, NULL, NULL);
+    TEST_CHECK(result != CMT_DECODE_OPENTELEMETRY_SUCCESS);
+}
+
+void test_opentelemetry_merge()
+{
+    cfl_sds_t        payload;
+    cfl_sds_t        copied_text;
+    cfl_sds_t        merged_text;
+    struct cfl_list  decoded_context_list;
+    struct cfl_list *head;
+    struct cmt      *cmt;
+    struct cmt      *copied;
+    struct cmt      *merged;
+    size_t           offset;
+    int              round;
+    int              result;
+
+    cmt_initialize();
+
+    cmt = generate_api_test_data();
+    TEST_ASSERT(cmt != NULL);
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_ASSERT(payload != NULL);
+
+    copied = cmt_create();
+    merged = cmt_create();
+    TEST_ASSERT(copied != NULL && merged != NULL);
+
+    /* histograms add up across rounds, the rest keeps the last value */
+    for (round = 0; round < 2; round++) {
+        offset = 0;
+        result = cmt_decode_opentelemetry_create(&decoded_context_list,
+                                                 payload, cfl_sds_len(payload),
+                                                 &offset);
+        TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            cfl_list_foreach(head, &decoded_context_list) {
+                TEST_CHECK(cmt_cat(copied, cfl_list_entry(head, struct cmt, _head)) == 0);
+            }
+            cmt_decode_opentelemetry_destroy(&decoded_context_list);
+        }
+
+        offset = 0;
+        result = cmt_decode_opentelemetry_merge(merged,
+                                                payload, cfl_sds_len(payload),
+                                                &offset);
+        TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+    }
+
+    copied_text = cmt_encode_text_create(copied);
+    merged_text = cmt_encode_text_create(merged);
+    TEST_CHECK(copied_text != NULL && merged_text != NULL &&
+               strcmp(copied_text, merged_text) == 0);
+
+    cmt_encode_text_destroy(copied_text);
+    cmt_encode_text_destroy(merged_text);
+    cmt_destroy(merged);
+    cmt_destroy(copied);
+    cmt_encode_opentelemetry_destroy(payload);
+    cmt_destroy(cmt);
+}
+
+/* protobuf -> cmt -> OTLP/JSON -> cmt must not lose anything */
+static void check_json_roundtrip_matches_protobuf(cfl_sds_t payload)
+{
+    cfl_sds_t        expected;
+    cfl_sds_t        encoded;
+    cfl_sds_t        json;
+    struct cfl_list  default_list;
+    struct cfl_list  json_list;
+    struct cfl_list *head;
+    struct cmt      *decoded_context;
+    size_t           offset;
+    int              result;
+
+    offset = 0;
+    result = cmt_decode_opentelemetry_create(&default_list,
+                                             payload, cfl_sds_len(payload),
+                                             &offset);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result != CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        return;
+    }
+
+    cfl_list_foreach(head, &default_list) {
+        decoded_context = cfl_list_entry(head, struct cmt, _head);
+
+        expected = cmt_encode_opentelemetry_create(decoded_context);
+        json = cmt_encode_opentelemetry_json_create(decoded_context);
+        TEST_CHECK(expected != NULL && json != NULL);
+
+        if (expected == NULL || json == NULL) {
+            break;
+        }
+
+        offset = 0;
+        result = cmt_decode_opentelemetry_json_create(&json_list,
+                                                      json, cfl_sds_len(json),
+                                                      &offset);
+        TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+        if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+            TEST_CHECK(offset == cfl_sds_len(json));
+            TEST_CHECK(cfl_list_size(&json_list) == 1);
+
+            encoded = cmt_encode_opentelemetry_create(
+                        cfl_list_entry_first(&json_list, struct cmt, _head));
+            TEST_CHECK(encoded != NULL);
+
+            if (encoded != NULL) {
+                TEST_CHECK(cfl_sds_len(encoded) == cfl_sds_len(expected));
+                TEST_CHECK(memcmp(encoded, expected, cfl_sds_len(expected)) == 0);
+                cmt_encode_opentelemetry_destroy(encoded);
+            }
+
+            cmt_decode_opentelemetry_destroy(&json_list);
+        }
+
+        /* a truncated document must be rejected */
+        offset = 0;
+        result = cmt_decode_opentelemetry_json_create(&json_list,
+                                                      json, cfl_sds_len(json) - 1,
+                                                      &offset);
+        TEST_CHECK(result != CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+        cmt_encode_opentelemetry_json_destroy(json);
+        cmt_encode_opentelemetry_destroy(expected);
+    }
+
+    cmt_decode_opentelemetry_destroy(&default_list);
+}
+
+void test_opentelemetry_json_roundtrip()
+{
+    cfl_sds_t   payload;
+    struct cmt *cmt;
+
+    cmt_initialize();
+
+    cmt = generate_api_test_data();
+    TEST_CHECK(cmt != NULL);
+
+    if (cmt == NULL) {
+        return;
+    }
+
+    TEST_CHECK(cmt_label_add(cmt, "static_key", "static_value") == 0);
+
+    payload = cmt_encode_opentelemetry_create(cmt);
+    TEST_CHECK(payload != NULL);
+    cmt_destroy(cmt);
+
+    if (payload != NULL) {
+        check_json_roundtrip_matches_protobuf(payload);
+        cmt_encode_opentelemetry_destroy(payload);
+    }
+
+    /* Resource, scope and metric metadata, exemplars */
+    payload = generate_exponential_histogram_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_json_roundtrip_matches_protobuf(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    payload = generate_sum_non_monotonic_int_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_json_roundtrip_matches_protobuf(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    payload = generate_gauge_large_int_otlp_payload();
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_json_roundtrip_matches_protobuf(payload);
+        cfl_sds_destroy(payload);
+    }
+
+    /* request dumped by the encoding tests */
+    payload = read_file(CMT_TESTS_DATA_PATH "/../opentelemetry_payload.bin");
+    TEST_CHECK(payload != NULL);
+
+    if (payload != NULL) {
+        check_json_roundtrip_matches_protobuf(payload);
+        cfl_sds_destroy(payload);
+    }
+}
+
+static int decode_json_document(const char *document, struct cfl_list *context_list)
+{
+    size_t offset;
+
+    offset = 0;
+
+    return cmt_decode_opentelemetry_json_create(context_list,
+                                                (char *) document,
+                                                strlen(document),
+                                                &offset);
+}
+
+void test_opentelemetry_json_decoder()
+{
+    struct cfl_list     decoded_context_list;
+    struct cmt_counter *counter;
+    struct cmt_metric  *metric;
+    struct cmt         *decoded_context;
+    cfl_sds_t           text;
+    int                 result;
+
+    /*
+     * Any member order is valid: data before the name, data points before
+     * isMonotonic, original field names, integers as strings or numbers and
+     * enums by name.
+     */
+    const char *reordered =
+        "{\"resource_metrics\":[{\"scopeMetrics\":[{\"metrics\":["
+        "{\"sum\":{\"dataPoints\":[{\"asInt\":\"-5\",\"time_unix_nano\":\"1\","
+        "\"attributes\":[{\"key\":\"k\",\"value\":{\"stringValue\":\"a\\u00e9\"}}]}],"
+        "\"aggregationTemporality\":\"AGGREGATION_TEMPORALITY_DELTA\","
+        "\"is_monotonic\":false},"
+        "\"unit\":\"s\",\"name\":\"reordered_sum\",\"description\":\"desc\"},"
+        "{\"name\":\"plain_gauge\",\"gauge\":{\"data_points\":"
+        "[{\"asDouble\":2.5,\"timeUnixNano\":2,\"unknown\":[1,{\"x\":null}]}]}}"
+        "]}],\"resource\":null}]}";
+
+    const char *invalid[] = {
+        "",
+        "[]",
+        "{\"resourceMetrics\":{}}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":[{\"name\":\"x\"}]}]}]}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":[{\"gauge\":{}}]}]}]}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":"
+            "[{\"name\":\"x\",\"gauge\":{},\"sum\":{}}]}]}]}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":"
+            "[{\"name\":\"x\",\"gauge\":{\"dataPoints\":[{\"asInt\":\"1x\"}]}}]}]}]}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":"
+            "[{\"name\":\"x\",\"sum\":{\"aggregationTemporality\":\"BOGUS\"}}]}]}]}",
+        "{\"resourceMetrics\":[{\"scopeMetrics\":[{\"metrics\":[{\"name\":\"x\",",
+        NULL
+    };
+    int index;
+
+    cmt_initialize();
+
+    result = decode_json_document(reordered, &decoded_context_list);
+    TEST_CHECK(result == CMT_DECODE_OPENTELEMETRY_SUCCESS);
+
+    if (result == CMT_DECODE_OPENTELEMETRY_SUCCESS) {
+        TEST_CHECK(cfl_list_size(&decoded_context_list) == 1);
+
+        decoded_context = cfl_list_entry_first(&decoded_context_list, struct cmt, _head);
+        TEST_CHECK(cfl_list_size(&decoded_context->counters) == 1);
+        TEST_CHECK(cfl_list_size(&decoded_context->gauges) == 1);
+
+        counter = cfl_list_entry_first(&decoded_context->counters,
+                                       struct cmt_counter, _head);
+        TEST_CHECK(counter->allow_reset == CMT_TRUE);
+        TEST_CHECK(counter->aggregation_type == CMT_AGGREGATION_TYPE_DELTA);
+        TEST_CHECK(strcmp(counter->map->opts->description, "desc") == 0);
+        TEST_CHECK(strcmp(counter->map->unit, "s") == 0);
+
+        metric = cfl_list_entry_first(&counter->map->metrics,
+                                      struct cmt_metric, _head);
+        TEST_CHECK(cmt_metric_get_value(metric) == -5.0);
+
+        text = cmt_encode_text_create(decoded_context);
+        TEST_CHECK(text != NULL);
+
+        if (text != NULL) {
+            TEST_CHECK(strstr(text, "reordered_sum{k=\"a\xc3\xa9\"} = -5") != NULL);
+            TEST_CHECK(strstr(text, "plain_gauge = 2.5") != NULL);
+            cmt_encode_text_destroy(text);
+        }
+
+        cmt_decode_opentelemetry_destroy(&decoded_context_list);
+    }
+
+    for (index = 0 ; invalid[index] != NULL ; index++) {
+        result = decode_json_document(invalid[index], &decoded_context_list);
+        TEST_CHECK_(result != CMT_DECODE_OPENTELEMETRY_SUCCESS,
+                    "invalid document %d", index);
+    }
+}
+
 TEST_LIST = {
     {"opentelemetry_api_full_roundtrip_with_msgpack", test_opentelemetry_api_full_roundtrip_with_msgpack},
     {"opentelemetry_encode_multi_resource_scope_containers", test_opentelemetry_encode_multi_resource_scope_containers},
@@ -2009,5 +2757,11 @@ TEST_LIST = {
     {"opentelemetry_missing_metric_name_rejected",     test_opentelemetry_missing_metric_name_rejected},
     {"opentelemetry_missing_metric_data_rejected",     test_opentelemetry_missing_metric_data_rejected},
     {"opentelemetry_omitted_null_key_label_encoded",   test_opentelemetry_omitted_null_key_label_encoded},
+    {"opentelemetry_direct_encoder_byte_equivalence",  test_opentelemetry_direct_encoder_byte_equivalence},
+    {"opentelemetry_arena_decoder",                    test_opentelemetry_arena_decoder},
+    {"opentelemetry_stream_decoder",                   test_opentelemetry_stream_decoder},
+    {"opentelemetry_merge",                            test_opentelemetry_merge},
+    {"opentelemetry_json_roundtrip",                   test_opentelemetry_json_roundtrip},
+    {"opentelemetry_json_decoder",                     test_opentelemetry_json_decoder},
     { 0 }
 };
@@ -64,6 +64,23 @@ int parse(struct fixture *f)
     return cmt_decode_prometheus_parse(f->scanner, &f->context);
 }
 
+/* parser used by the tests that decode through cmt_decode_prometheus_create() */
+static int parser_type = CMT_DECODE_PROMETHEUS_PARSER_BISON;
+
+int decode_create(struct cmt **out_cmt, const char *in_buf, size_t in_size,
+                  struct cmt_decode_prometheus_parse_opts *opts)
+{
+    struct cmt_decode_prometheus_parse_opts defaults;
+
+    if (!opts) {
+        memset(&defaults, 0, sizeof(defaults));
+        opts = &defaults;
+    }
+    opts->parser = parser_type;
+
+    return cmt_decode_prometheus_create(out_cmt, in_buf, in_size, opts);
+}
+
 void test_header_help()
 {
     struct fixture *f = init(START_HEADER,
@@ -181,7 +198,7 @@ void test_metric_name_ownership_resets()
         "# TYPE namespace_subsystem_metric gauge\n"
         "namespace_subsystem_metric 3\n";
 
-    status = cmt_decode_prometheus_create(&cmt, input, 0, NULL);
+    status = decode_create(&cmt, input, 0, NULL);
     TEST_ASSERT(status == CMT_DECODE_PROMETHEUS_SUCCESS);
     TEST_ASSERT(cmt != NULL);
     cmt_decode_prometheus_destroy(cmt);
@@ -192,58 +209,43 @@ void test_metric_name_ownership_error_cleanup()
     int status;
     struct cmt *cmt = NULL;
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# TYPE metric counter\nmetric {key=", 0, NULL);
     TEST_CHECK(status == CMT_DECODE_PROMETHEUS_SYNTAX_ERROR);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# TYPE namespace_subsystem_metric counter\n"
             "namespace_subsystem_metric {key=", 0, NULL);
     TEST_CHECK(status == CMT_DECODE_PROMETHEUS_SYNTAX_ERROR);
 }
 
-struct cmt_decode_prometheus_context_sample *add_empty_sample(struct fixture *f)
-{
-    struct cmt_decode_prometheus_context_sample *sample;
-    sample = malloc(sizeof(*sample));
-    memset(sample, 0, sizeof(*sample));
-    cfl_list_add(&sample->_head, &f->context.metric.samples);
-    return sample;
-}
-
 void test_labels()
 {
     struct fixture *f = init(START_LABELS, "dev=\"Calyptia\",lang=\"C\"");
-    struct cmt_decode_prometheus_context_sample *sample = add_empty_sample(f);
     TEST_CHECK(parse(f) == 0);
     TEST_CHECK(f->context.metric.label_count == 2);
     TEST_CHECK(strcmp(f->context.metric.labels[0], "dev") == 0);
-    TEST_CHECK(strcmp(sample->label_values[0], "Calyptia") == 0);
+    TEST_CHECK(strcmp(f->context.metric.label_values[0], "Calyptia") == 0);
     TEST_CHECK(strcmp(f->context.metric.labels[1], "lang") == 0);
-    TEST_CHECK(strcmp(sample->label_values[1], "C") == 0);
+    TEST_CHECK(strcmp(f->context.metric.label_values[1], "C") == 0);
     cfl_sds_destroy(f->context.metric.labels[0]);
-    cfl_sds_destroy(sample->label_values[0]);
     cfl_sds_destroy(f->context.metric.labels[1]);
-    cfl_sds_destroy(sample->label_values[1]);
-    free(sample);
+    cfl_arena_destroy(f->context.metric.arena);
     destroy(f);
 }
 
 void test_labels_trailing_comma()
 {
     struct fixture *f = init(START_LABELS, "dev=\"Calyptia\",lang=\"C\",");
-    struct cmt_decode_prometheus_context_sample *sample = add_empty_sample(f);
     TEST_CHECK(parse(f) == 0);
     TEST_CHECK(f->context.metric.label_count == 2);
     TEST_CHECK(strcmp(f->context.metric.labels[0], "dev") == 0);
-    TEST_CHECK(strcmp(sample->label_values[0], "Calyptia") == 0);
+    TEST_CHECK(strcmp(f->context.metric.label_values[0], "Calyptia") == 0);
     TEST_CHECK(strcmp(f->context.metric.labels[1], "lang") == 0);
-    TEST_CHECK(strcmp(sample->label_values[1], "C") == 0);
+    TEST_CHECK(strcmp(f->context.metric.label_values[1], "C") == 0);
     cfl_sds_destroy(f->context.metric.labels[0]);
-    cfl_sds_destroy(sample->label_values[0]);
     cfl_sds_destroy(f->context.metric.labels[1]);
-    cfl_sds_destroy(sample->label_values[1]);
-    free(sample);
+    cfl_arena_destroy(f->context.metric.arena);
     destroy(f);
 }
 
@@ -433,7 +435,7 @@ void test_prometheus_spec_example()
         ;
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, 0, &opts);
+    status = decode_create(&cmt, in_buf, 0, &opts);
     TEST_CHECK(status == 0);
     result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
     TEST_CHECK(strcmp(result, expected) == 0);
@@ -454,12 +456,12 @@ void test_bison_parsing_error()
     opts.errbuf = errbuf;
     opts.errbuf_size = sizeof(errbuf);
 
-    status = cmt_decode_prometheus_create(&cmt, "", 0, &opts);
+    status = decode_create(&cmt, "", 0, &opts);
     TEST_CHECK(status == CMT_DECODE_PROMETHEUS_SYNTAX_ERROR);
     // TEST_CHECK(strcmp(errbuf,
     //             "syntax error, unexpected end of file") == 0);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name", 0, &opts);
@@ -468,7 +470,7 @@ void test_bison_parsing_error()
     //             "syntax error, unexpected end of file, expecting '{' "
     //             "or FPOINT or INTEGER") == 0);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key", 0, &opts);
@@ -476,7 +478,7 @@ void test_bison_parsing_error()
     // TEST_CHECK(strcmp(errbuf,
     //             "syntax error, unexpected end of file, expecting '='") == 0);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=", 0, &opts);
@@ -484,7 +486,7 @@ void test_bison_parsing_error()
     // TEST_CHECK(strcmp(errbuf,
     //             "syntax error, unexpected end of file, expecting QUOTED") == 0);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=\"abc\"", 0, &opts);
@@ -492,7 +494,7 @@ void test_bison_parsing_error()
     // TEST_CHECK(strcmp(errbuf,
     //             "syntax error, unexpected end of file, expecting '}'") == 0);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=\"abc\"}", 0, &opts);
@@ -525,7 +527,7 @@ void test_label_limits()
     }
     snprintf(inbuf + pos, sizeof(inbuf) - pos, "} 55 0\n");
 
-    status = cmt_decode_prometheus_create(&cmt, inbuf, 0, &opts);
+    status = decode_create(&cmt, inbuf, 0, &opts);
     TEST_CHECK(status == 0);
     counter = cfl_list_entry_first(&cmt->counters, struct cmt_counter, _head);
     TEST_CHECK(counter->map->label_count == CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT);
@@ -533,7 +535,7 @@ void test_label_limits()
 
     // write one more label to exceed limit
     snprintf(inbuf + pos, sizeof(inbuf) - pos, "last=\"val\"} 55 0\n");
-    status = cmt_decode_prometheus_create(&cmt, inbuf, 0, &opts);
+    status = decode_create(&cmt, inbuf, 0, &opts);
     TEST_CHECK(status == CMT_DECODE_PROMETHEUS_MAX_LABEL_COUNT_EXCEEDED);
     TEST_CHECK(strcmp(errbuf, "maximum number of labels exceeded") == 0);
 }
@@ -548,7 +550,7 @@ void test_invalid_value()
     opts.errbuf = errbuf;
     opts.errbuf_size = sizeof(errbuf);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=\"abc\"} 10e", 0, &opts);
@@ -567,7 +569,7 @@ void test_invalid_timestamp()
     opts.errbuf = errbuf;
     opts.errbuf_size = sizeof(errbuf);
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=\"abc\"} 10 3e", 0, &opts);
@@ -586,7 +588,7 @@ void test_default_timestamp()
     opts.default_timestamp = 557 * 10e5;
 
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name counter\n"
             "metric_name {key=\"abc\"} 10", 0, &opts);
@@ -616,7 +618,7 @@ void test_values()
             "metric_name{key=\"Positive infinity\"} inf 0\n"
             "metric_name{key=\"Negative infinity\"} -inf 0\n";
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP metric_name some docstring\n"
             "# TYPE metric_name gauge\n"
             "metric_name {key=\"simple integer\"} 54\n"
@@ -652,7 +654,7 @@ void test_in_size()
     in_size = cfl_sds_len(in_buf);
     in_buf = cfl_sds_cat(in_buf, "metric_name {key=\"2\"} 2\n", in_size);
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, NULL);
+    status = decode_create(&cmt, in_buf, in_size, NULL);
     TEST_CHECK(status == 0);
     result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
     TEST_CHECK(strcmp(result,
@@ -672,7 +674,7 @@ void test_issue_71()
     cfl_sds_t in_buf = read_file(CMT_TESTS_DATA_PATH "/issue_71.txt");
     size_t in_size = cfl_sds_len(in_buf);
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, NULL);
+    status = decode_create(&cmt, in_buf, in_size, NULL);
     TEST_CHECK(status == 0);
     cfl_sds_destroy(in_buf);
     cmt_decode_prometheus_destroy(cmt);
@@ -686,7 +688,7 @@ void test_histogram()
     cfl_sds_t result;
     memset(&opts, 0, sizeof(opts));
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP http_request_duration_seconds A histogram of the request duration.\n"
             "# TYPE http_request_duration_seconds histogram\n"
             "http_request_duration_seconds_bucket{le=\"0.05\"} 24054\n"
@@ -722,7 +724,7 @@ void test_histogram_labels()
     memset(&opts, 0, sizeof(opts));
     cfl_sds_t result;
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP http_request_duration_seconds A histogram of the request duration.\n"
             "# TYPE http_request_duration_seconds histogram\n"
             "http_request_duration_seconds_bucket{label1=\"val1\",le=\"0.05\",label2=\"val2\"} 24054\n"
@@ -750,6 +752,42 @@ void test_histogram_labels()
     cmt_decode_prometheus_destroy(cmt);
 }
 
+void test_histogram_float_counts()
+{
+    int status;
+    struct cmt *cmt;
+    cfl_sds_t result;
+
+    /* counts are integers, but some tools write them as floats */
+    status = decode_create(&cmt,
+            "# HELP float_counts Float counts.\n"
+            "# TYPE float_counts histogram\n"
+            "float_counts_bucket{le=\"1\"} 1.5e1\n"
+            "float_counts_bucket{le=\"+Inf\"} 20\n"
+            "float_counts_sum 3.25\n"
+            "float_counts_count 2e1\n", 0, NULL);
+    TEST_CHECK(status == 0);
+    result = cmt_encode_prometheus_create(cmt, CMT_FALSE);
+    TEST_CHECK(strcmp(result,
+            "# HELP float_counts Float counts.\n"
+            "# TYPE float_counts histogram\n"
+            "float_counts_bucket{le=\"1.0\"} 15\n"
+            "float_counts_bucket{le=\"+Inf\"} 20\n"
+            "float_counts_sum 3.25\n"
+            "float_counts_count 20\n") == 0);
+    TEST_MSG("%s", result);
+    cfl_sds_destroy(result);
+    cmt_decode_prometheus_destroy(cmt);
+
+    status = decode_create(&cmt,
+            "# TYPE float_counts histogram\n"
+            "float_counts_bucket{le=\"1\"} 1\n"
+            "float_counts_bucket{le=\"+Inf\"} 2\n"
+            "float_counts_sum 3.25\n"
+            "float_counts_count -1.5\n", 0, NULL);
+    TEST_CHECK(status == CMT_DECODE_PROMETHEUS_CMT_CREATE_ERROR);
+}
+
 void test_histogram_missing_le_label()
 {
     int status;
@@ -759,7 +797,7 @@ void test_histogram_missing_le_label()
     cmt = NULL;
     memset(&opts, 0, sizeof(opts));
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
             "# HELP test_histogram A histogram missing the le label.\n"
             "# TYPE test_histogram histogram\n"
             "test_histogram_bucket{foo=\"bar\"} 1\n"
@@ -778,7 +816,7 @@ void test_summary()
     cfl_sds_t result;
     memset(&opts, 0, sizeof(opts));
 
-    status = cmt_decode_prometheus_create(&cmt,
+    status = decode_create(&cmt,
         "# HELP rpc_duration_seconds A summary of the RPC duration in seconds.\n"
         "# TYPE rpc_duration_seconds summary\n"
         "rpc_duration_seconds{quantile=\"0.01\"} 3102\n"
@@ -825,7 +863,7 @@ void test_null_labels()
         ;
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, 0, &opts);
+    status = decode_create(&cmt, in_buf, 0, &opts);
     TEST_CHECK(status == 0);
     result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
     TEST_CHECK(strcmp(result, expected) == 0);
@@ -864,7 +902,7 @@ void test_issue_fluent_bit_5541()
         "http_request_duration_seconds_count 2 0\n"
         ;
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, NULL);
+    status = decode_create(&cmt, in_buf, in_size, NULL);
     TEST_CHECK(status == 0);
 
     result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
@@ -1033,7 +1071,7 @@ void test_issue_fluent_bit_5894()
         "jvm_gc_pause_seconds_count{action=\"end of minor GC\",cause=\"G1 Evacuation Pause\"} 1 0\n"
         ;
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, &opts);
+    status = decode_create(&cmt, in_buf, in_size, &opts);
     TEST_CHECK(status == 0);
     if (status) {
         fprintf(stderr, "PARSE ERROR:\n======\n%s\n======\n", errbuf);
@@ -1091,7 +1129,7 @@ void test_empty_metrics()
     const char expected[] = "";
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, 0, &opts);
+    status = decode_create(&cmt, in_buf, 0, &opts);
     TEST_CHECK(status == 0);
     result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
     TEST_CHECK(strcmp(result, expected) == 0);
@@ -1337,7 +1375,7 @@ void test_issue_fluent_bit_6021()
         "envoy_server_initialization_time_ms_count 1 0\n"
         ;
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, &opts);
+    status = decode_create(&cmt, in_buf, in_size, &opts);
     TEST_CHECK(status == 0);
     if (status) {
         fprintf(stderr, "PARSE ERROR:\n======\n%s\n======\n", errbuf);
@@ -1426,7 +1464,7 @@ void test_override_timestamp()
         ;
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, 0, &opts);
+    status = decode_create(&cmt, in_buf, 0, &opts);
     TEST_CHECK(status == 0);
     if (!status) {
         result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
@@ -1477,7 +1515,7 @@ void test_pr_168()
         "prometheus_engine_query_duration_seconds_count{slice=\"result_sort\"} 0 0\n";
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, cfl_sds_len(in_buf), &opts);
+    status = decode_create(&cmt, in_buf, cfl_sds_len(in_buf), &opts);
     TEST_CHECK(status == 0);
     if (!status) {
         result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
@@ -1523,7 +1561,7 @@ void test_histogram_different_label_count()
         ;
 
     cmt_initialize();
-    status = cmt_decode_prometheus_create(&cmt, in_buf, cfl_sds_len(in_buf), &opts);
+    status = decode_create(&cmt, in_buf, cfl_sds_len(in_buf), &opts);
     TEST_CHECK(status == 0);
     if (!status) {
         result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
@@ -1724,7 +1762,7 @@ void test_issue_fluent_bit_6534()
         "dotnet_gc_collection_seconds_count{gc_generation=\"0\",gc_type=\"non_concurrent_gc\"} 618 0\n"
         ;
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, &opts);
+    status = decode_create(&cmt, in_buf, in_size, &opts);
     TEST_CHECK(status == 0);
     if (status) {
         fprintf(stderr, "PARSE ERROR:\n======\n%s\n======\n", errbuf);
@@ -1756,7 +1794,7 @@ void test_issue_fluent_bit_9267()
     size_t in_size = cfl_sds_len(in_buf);
 
     cmt = NULL;
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, &opts);
+    status = decode_create(&cmt, in_buf, in_size, &opts);
     TEST_CHECK(status == 0);
     if (status) {
         fprintf(stderr, "PARSE ERROR:\n======\n%s\n======\n", errbuf);
@@ -1776,12 +1814,406 @@ void test_issue_274()
     cfl_sds_t in_buf = read_file(CMT_TESTS_DATA_PATH "/issue_274.txt");
     size_t in_size = cfl_sds_len(in_buf);
 
-    status = cmt_decode_prometheus_create(&cmt, in_buf, in_size, NULL);
+    status = decode_create(&cmt, in_buf, in_size, NULL);
     TEST_CHECK(status == 0);
     cfl_sds_destroy(in_buf);
     cmt_decode_prometheus_destroy(cmt);
 }
 
+void test_fast_parser()
+{
+    parser_type = CMT_DECODE_PROMETHEUS_PARSER_FAST;
+
+    test_metric_name_ownership_resets();
+    test_metric_name_ownership_error_cleanup();
+    test_prometheus_spec_example();
+    test_bison_parsing_error();
+    test_label_limits();
+    test_invalid_value();
+    test_invalid_timestamp();
+    test_default_timestamp();
+    test_values();
+    test_in_size();
+    test_issue_71();
+    test_histogram();
+    test_histogram_labels();
+    test_histogram_float_counts();
+    test_histogram_missing_le_label();
+    test_summary();
+    test_null_labels();
+    test_issue_fluent_bit_5541();
+    test_issue_fluent_bit_5894();
+    test_empty_metrics();
+    test_issue_fluent_bit_6021();
+    test_override_timestamp();
+    test_pr_168();
+    test_histogram_different_label_count();
+    test_issue_fluent_bit_6534();
+    test_issue_fluent_bit_9267();
+    test_issue_274();
+
+    parser_type = CMT_DECODE_PROMETHEUS_PARSER_BISON;
+}
+
+void test_fast_parser_matches_bison()
+{
+    int i;
+    int bison_status;
+    int fast_status;
+    struct cmt *bison_cmt;
+    struct cmt *fast_cmt;
+    cfl_sds_t bison_result;
+    cfl_sds_t fast_result;
+    struct cmt_decode_prometheus_parse_opts opts;
+    const char *inputs[] = {
+        /* CRLF line endings and blank lines */
+        "# HELP crlf_metric line endings\r\n"
+        "# TYPE crlf_metric gauge\r\n"
+        "\r\n"
+        "crlf_metric{a=\"1\"} 1 1000\r\n"
+        "crlf_metric{a=\"2\"} 2\r\n",
+
+        /* samples can span lines and comments can sit between tokens */
+        "split_metric\n"
+        "  {a=\"1\",\n"
+        "# a comment\n"
+        "   b=\"2\"}\n"
+        "  3 4000\n"
+        "split_metric{a=\"1\",b=\"3\"} 5\n",
+
+        /* escapes, values and labels known from previous samples */
+        "# HELP escaped_metric a \\\\ doc\\nstring\n"
+        "# TYPE escaped_metric counter\n"
+        "escaped_metric{path=\"C:\\\\\",msg=\"a\\\"b\\nc\"} 1e3\n"
+        "escaped_metric{msg=\"x\",path=\"y\"} .5\n"
+        "escaped_metric{msg=\"z\"} +Inf\n"
+        "escaped_metric{path=\"w\"} 123456789012345678901234 -5\n",
+
+        /* histogram and summary grouping */
+        "# TYPE grouped histogram\n"
+        "grouped_bucket{le=\"1\"} 1\n"
+        "grouped_bucket{le=\"+Inf\"} 2\n"
+        "grouped_sum 3\n"
+        "grouped_count 2\n"
+        "# TYPE quantiles summary\n"
+        "quantiles{quantile=\"0.5\"} 1\n"
+        "quantiles_sum 3\n"
+        "quantiles_count 2\n",
+
+        /* syntax errors */
+        "# TYPE broken counter\nbroken{a=\"1\" b=\"2\"} 1\n",
+        "broken 1 2 3\n",
+        "  # comment\n\tbroken{} 1 # trailing\n",
+        "# only comments\n",
+        NULL
+    };
+
+    memset(&opts, 0, sizeof(opts));
+    cmt_initialize();
+
+    for (i = 0; inputs[i]; i++) {
+        bison_cmt = NULL;
+        fast_cmt = NULL;
+
+        opts.parser = CMT_DECODE_PROMETHEUS_PARSER_BISON;
+        bison_status = cmt_decode_prometheus_create(&bison_cmt, inputs[i], 0, &opts);
+        opts.parser = CMT_DECODE_PROMETHEUS_PARSER_FAST;
+        fast_status = cmt_decode_prometheus_create(&fast_cmt, inputs[i], 0, &opts);
+
+        TEST_CHECK(bison_status == fast_status);
+        TEST_MSG("input %d: bison %d, fast %d", i, bison_status, fast_status);
+        if (bison_status || fast_status) {
+            if (!bison_status) {
+                cmt_decode_prometheus_destroy(bison_cmt);
+            }
+            if (!fast_status) {
+                cmt_decode_prometheus_destroy(fast_cmt);
+            }
+            continue;
+        }
+
+        bison_result = cmt_encode_prometheus_create(bison_cmt, CMT_TRUE);
+        fast_result = cmt_encode_prometheus_create(fast_cmt, CMT_TRUE);
+        TEST_CHECK(strcmp(bison_result, fast_result) == 0);
+        TEST_MSG("input %d:\n%s\n----\n%s", i, bison_result, fast_result);
+
+        cfl_sds_destroy(bison_result);
+        cfl_sds_destroy(fast_result);
+        cmt_decode_prometheus_destroy(bison_cmt);
+        cmt_decode_prometheus_destroy(fast_cmt);
+    }
+}
+
+/*
+ * Families are encoded as they are emitted, a name can show up in several
+ * families so they are not merged back together.
+ */
+static int stream_collect(void *data, struct cmt *cmt)
+{
+    cfl_sds_t *text = data;
+    cfl_sds_t result;
+
+    result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
+    cmt_destroy(cmt);
+    if (!result) {
+        return -1;
+    }
+    cfl_sds_cat_safe(text, result, cfl_sds_len(result));
+    cmt_encode_prometheus_destroy(result);
+
+    return 0;
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+/* encoders group families by type, compare the lines regardless of order */
+static cfl_sds_t sort_lines(cfl_sds_t text)
+{
+    size_t i;
+    size_t count = 0;
+    char *p;
+    char **lines;
+    cfl_sds_t sorted;
+
+    lines = calloc(cfl_sds_len(text) + 1, sizeof(char *));
+    for (p = strtok(text, "\n"); p; p = strtok(NULL, "\n")) {
+        lines[count++] = p;
+    }
+    qsort(lines, count, sizeof(char *), compare_lines);
+
+    sorted = cfl_sds_create("");
+    for (i = 0; i < count; i++) {
+        cfl_sds_printf(&sorted, "%s\n", lines[i]);
+    }
+    free(lines);
+
+    return sorted;
+}
+
+/*
+ * Decode 'in_buf' in chunks of 'chunk_size' bytes. With 'out_text' the
+ * families are collected by the callback, otherwise the decoded context is
+ * returned in 'out_cmt'.
+ */
+static int stream_decode(struct cmt **out_cmt, cfl_sds_t *out_text,
+                         const char *in_buf, size_t chunk_size,
+                         size_t *max_buffer_size)
+{
+    int ret;
+    size_t offset;
+    size_t length;
+    size_t size;
+    struct cmt_decode_prometheus_stream *stream;
+    struct cmt_decode_prometheus_parse_opts opts;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.default_timestamp = 1000;
+
+    ret = cmt_decode_prometheus_stream_create(&stream, &opts, out_text,
+                                              out_text ? stream_collect : NULL);
+    if (ret) {
+        return ret;
+    }
+
+    length = strlen(in_buf);
+    for (offset = 0; offset < length && !ret; offset += size) {
+        size = length - offset;
+        if (size > chunk_size) {
+            size = chunk_size;
+        }
+        ret = cmt_decode_prometheus_stream_feed(stream, in_buf + offset, size);
+        if (max_buffer_size && stream->buffer_size > *max_buffer_size) {
+            *max_buffer_size = stream->buffer_size;
+        }
+    }
+
+    if (!ret) {
+        ret = cmt_decode_prometheus_stream_finish(stream, out_text ? NULL : out_cmt);
+    }
+    cmt_decode_prometheus_stream_destroy(stream);
+
+    return ret;
+}
+
+/* decoding in chunks of any size gives the same result as a one-shot decode */
+static void check_stream_decoder(const char *input)
+{
+    int i;
+    int status;
+    int stream_status;
+    struct cmt *cmt = NULL;
+    struct cmt *stream_cmt;
+    cfl_sds_t result = NULL;
+    cfl_sds_t sorted = NULL;
+    cfl_sds_t stream_result;
+    cfl_sds_t stream_sorted;
+    struct cmt_decode_prometheus_parse_opts opts;
+    size_t chunk_sizes[] = {1, 2, 7, 64, 4096};
+
+    memset(&opts, 0, sizeof(opts));
+    opts.default_timestamp = 1000;
+    opts.parser = CMT_DECODE_PROMETHEUS_PARSER_FAST;
+
+    status = cmt_decode_prometheus_create(&cmt, input, 0, &opts);
+    if (!status) {
+        result = cmt_encode_prometheus_create(cmt, CMT_TRUE);
+        stream_result = cfl_sds_create(result);
+        sorted = sort_lines(stream_result);
+        cfl_sds_destroy(stream_result);
+    }
+
+    for (i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        stream_cmt = NULL;
+        stream_status = stream_decode(&stream_cmt, NULL, input, chunk_sizes[i], NULL);
+        TEST_CHECK(stream_status == status);
+        TEST_MSG("chunk %zu: expected %d, got %d", chunk_sizes[i], status, stream_status);
+        if (!stream_status && !status) {
+            stream_result = cmt_encode_prometheus_create(stream_cmt, CMT_TRUE);
+            TEST_CHECK(strcmp(result, stream_result) == 0);
+            TEST_MSG("chunk %zu:\n%s\n----\n%s", chunk_sizes[i], result, stream_result);
+            cfl_sds_destroy(stream_result);
+        }
+        if (!stream_status) {
+            cmt_destroy(stream_cmt);
+        }
+
+        stream_result = cfl_sds_create("");
+        stream_status = stream_decode(NULL, &stream_result, input, chunk_sizes[i], NULL);
+        TEST_CHECK(stream_status == status);
+        TEST_MSG("callback, chunk %zu: expected %d, got %d",
+                 chunk_sizes[i], status, stream_status);
+        if (!stream_status && !status) {
+            stream_sorted = sort_lines(stream_result);
+            TEST_CHECK(strcmp(sorted, stream_sorted) == 0);
+            TEST_MSG("callback, chunk %zu:\n%s\n----\n%s",
+                     chunk_sizes[i], sorted, stream_sorted);
+            cfl_sds_destroy(stream_sorted);
+        }
+        cfl_sds_destroy(stream_result);
+    }
+
+    if (!status) {
+        cfl_sds_destroy(result);
+        cfl_sds_destroy(sorted);
+        cmt_decode_prometheus_destroy(cmt);
+    }
+}
+
+void test_stream_decoder()
+{
+    int i;
+    cfl_sds_t in_buf;
+    const char *files[] = {
+        CMT_TESTS_DATA_PATH "/issue_71.txt",
+        CMT_TESTS_DATA_PATH "/issue_fluent_bit_5541.txt",
+        CMT_TESTS_DATA_PATH "/issue_fluent_bit_5894.txt",
+        CMT_TESTS_DATA_PATH "/issue_fluent_bit_6021.txt",
+        CMT_TESTS_DATA_PATH "/pr_168.txt",
+        CMT_TESTS_DATA_PATH "/histogram_different_label_count.txt",
+        CMT_TESTS_DATA_PATH "/issue_6534.txt",
+        CMT_TESTS_DATA_PATH "/issue_fluent_bit_9267.txt",
+        CMT_TESTS_DATA_PATH "/issue_274.txt",
+        NULL
+    };
+    const char *inputs[] = {
+        "# HELP crlf_metric line endings\r\n"
+        "# TYPE crlf_metric gauge\r\n"
+        "\r\n"
+        "crlf_metric{a=\"1\"} 1 1000\r\n"
+        "crlf_metric{a=\"2\"} 2\r\n",
+
+        /* a timestamp on the next line still belongs to the sample */
+        "split_metric\n"
+        "  {a=\"1\",\n"
+        "# a comment\n"
+        "   b=\"2\"}\n"
+        "  3\n"
+        "  4000\n"
+        "split_metric{a=\"1\",b=\"3\"} -Inf\n",
+
+        "# HELP escaped_metric a \\\\ doc\\nstring\n"
+        "# TYPE escaped_metric counter\n"
+        "escaped_metric{path=\"C:\\\\\",msg=\"a\\\"b\\nc\"} 1e3\n"
+        "escaped_metric{msg=\"x\",path=\"y\"} .5\n"
+        "escaped_metric{path=\"w\"} 123456789012345678901234 -5",
+
+        "# TYPE grouped histogram\n"
+        "grouped_bucket{le=\"1\"} 1\n"
+        "grouped_bucket{le=\"+Inf\"} 2\n"
+        "grouped_sum 3\n"
+        "grouped_count 2\n"
+        "# TYPE quantiles summary\n"
+        "quantiles{quantile=\"0.5\"} 1\n"
+        "quantiles_sum 3\n"
+        "quantiles_count 2\n"
+        "after_summary 1\n",
+
+        /* syntax errors */
+        "broken 1 2 3\n",
+        "broken{a=\"1\" b=\"2\"} 1\n",
+        "# only comments\n",
+
+        /* an error recorded while the histogram is created, not returned */
+        "# TYPE h histogram\n"
+        "h_bucket{le=\"+Inf\"} 3 0\n"
+        "h_sum 1 0\n"
+        "h_count 3 0\n"
+        "x 1 0\n",
+        NULL
+    };
+
+    cmt_initialize();
+
+    for (i = 0; files[i]; i++) {
+        in_buf = read_file(files[i]);
+        TEST_ASSERT(in_buf != NULL);
+        TEST_CASE(files[i]);
+        check_stream_decoder(in_buf);
+        cfl_sds_destroy(in_buf);
+    }
+
+    for (i = 0; inputs[i]; i++) {
+        TEST_CASE(inputs[i]);
+        check_stream_decoder(inputs[i]);
+    }
+}
+
+void test_stream_decoder_memory()
+{
+    int i;
+    int ret;
+    size_t max_buffer_size = 0;
+    cfl_sds_t in_buf;
+    cfl_sds_t result;
+
+    cmt_initialize();
+
+    in_buf = cfl_sds_create("");
+    TEST_ASSERT(in_buf != NULL);
+    for (i = 0; i < 5000; i++) {
+        cfl_sds_printf(&in_buf,
+                       "# HELP family_%d a family\n"
+                       "# TYPE family_%d counter\n"
+                       "family_%d{instance=\"host-%d\"} %d\n",
+                       i, i, i, i, i);
+    }
+
+    result = cfl_sds_create("");
+    ret = stream_decode(NULL, &result, in_buf, 100, &max_buffer_size);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(strstr(result, "family_4999{instance=\"host-4999\"} 4999") != NULL);
+
+    /* only the statement a chunk ends in is carried over */
+    TEST_CHECK(max_buffer_size <= 512);
+    TEST_MSG("buffer grew to %zu bytes", max_buffer_size);
+
+    cfl_sds_destroy(result);
+    cfl_sds_destroy(in_buf);
+}
+
 TEST_LIST = {
     {"header_help", test_header_help},
     {"header_type", test_header_type},
@@ -1807,6 +2239,7 @@ TEST_LIST = {
     {"issue_71", test_issue_71},
     {"histogram", test_histogram},
     {"histogram_labels", test_histogram_labels},
+    {"histogram_float_counts", test_histogram_float_counts},
     {"histogram_missing_le_label", test_histogram_missing_le_label},
     {"summary", test_summary},
     {"null_labels", test_null_labels},
@@ -1820,5 +2253,9 @@ TEST_LIST = {
     {"issue_fluent_bit_6534", test_issue_fluent_bit_6534},
     {"issue_fluent_bit_9267", test_issue_fluent_bit_9267},
     {"issue_274", test_issue_274},
+    {"fast_parser", test_fast_parser},
+    {"fast_parser_matches_bison", test_fast_parser_matches_bison},
+    {"stream_decoder", test_stream_decoder},
+    {"stream_decoder_memory", test_stream_decoder_memory},
     { 0 }
 };